@@ -35,6 +35,7 @@
 #include "kml.h"
 #include "geojson.h"
 #include "babel.h"
+#include "trace.h"
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -62,6 +63,26 @@ static GList *a_babel_file_list = NULL;
  */
 static GList *a_babel_device_list = NULL;
 
+/**
+ * The lists above are filled in the background, as running gpsbabel can take a while.
+ * Until then the lists are empty.
+ */
+static GThread *probe_thread = NULL;
+static gboolean probed = FALSE;
+
+typedef struct {
+  BabelReadyFunc func;
+  gpointer user_data;
+} BabelReady;
+
+static GSList *ready_callbacks = NULL;
+
+// What a probe finds, installed into the lists above once finished
+typedef struct {
+  GList *files;
+  GList *devices;
+} BabelFeatures;
+
 /**
  * Run a function on all file formats supporting a given mode.
  */
@@ -211,47 +232,217 @@ static gboolean babel_general_convert( BabelStatusFunc cb, gchar **args, gpointe
   return ret;
 }
 
+// Large enough to keep up with gpsbabel's output
+#define BABEL_READ_SIZE 65536
+
+typedef struct {
+  GMainLoop *loop;
+  GpxReader *reader;   // NULL when the data is not wanted
+  BabelStatusFunc cb;
+  gpointer user_data;
+  guint open;          // Number of the program's outputs not yet finished
+} BabelStream;
+
+typedef struct {
+  const gchar *url;
+  DownloadFileOptions *options;
+  FILE *ff;
+  DownloadResult_t result;
+} BabelFeed;
+
+static void babel_stream_closed ( BabelStream *bs )
+{
+  if ( --bs->open == 0 )
+    g_main_loop_quit ( bs->loop );
+}
+
+/**
+ * The GPX data, parsed as soon as it arrives
+ */
+static gboolean babel_stream_data ( GIOChannel *source, GIOCondition condition, BabelStream *bs )
+{
+  gchar buf[BABEL_READ_SIZE];
+  gsize len = 0;
+  GIOStatus status;
+  while ( (status = g_io_channel_read_chars(source, buf, sizeof(buf), &len, NULL)) == G_IO_STATUS_NORMAL ) {
+    // Even if no longer parseable, keep reading so the program isn't blocked
+    if ( bs->reader )
+      (void)a_gpx_reader_feed ( bs->reader, buf, len );
+  }
+  if ( status == G_IO_STATUS_AGAIN )
+    return TRUE;
+  babel_stream_closed ( bs );
+  return FALSE;
+}
+
+/**
+ * Each line of diagnostic output is passed on to the callback
+ */
+static gboolean babel_stream_diag ( GIOChannel *source, GIOCondition condition, BabelStream *bs )
+{
+  gchar *line = NULL;
+  GIOStatus status;
+  while ( (status = g_io_channel_read_line(source, &line, NULL, NULL, NULL)) == G_IO_STATUS_NORMAL ) {
+    bs->cb ( BABEL_DIAG_OUTPUT, line, bs->user_data );
+    g_free ( line );
+  }
+  if ( status == G_IO_STATUS_AGAIN )
+    return TRUE;
+  babel_stream_closed ( bs );
+  return FALSE;
+}
+
+static void babel_stream_watch ( BabelStream *bs, GMainContext *context, gint fd, GIOFunc func )
+{
+  GIOChannel *channel = g_io_channel_unix_new ( fd );
+  g_io_channel_set_close_on_unref ( channel, TRUE );
+  (void)g_io_channel_set_encoding ( channel, NULL, NULL );
+  (void)g_io_channel_set_flags ( channel, G_IO_FLAG_NONBLOCK, NULL );
+  GSource *source = g_io_create_watch ( channel, G_IO_IN | G_IO_HUP | G_IO_ERR );
+  g_source_set_callback ( source, (GSourceFunc)func, bs, NULL );
+  g_source_attach ( source, context );
+  g_source_unref ( source );
+  g_io_channel_unref ( channel );
+  bs->open++;
+}
+
+/**
+ * Download into the program's input
+ */
+static gpointer babel_feed_thread ( BabelFeed *feed )
+{
+  feed->result = a_download_uri_to_stream ( feed->url, feed->ff, feed->options );
+  // Let the program know there is no more input
+  fclose ( feed->ff );
+  return NULL;
+}
+
 /**
  * babel_general_convert_from:
  * @vtl: The TrackWaypoint Layer to save the data into
  *   If it is null it signifies that no data is to be processed,
  *    however the gpsbabel command is still ran as it can be for non-data related options eg:
  *    for use with the power off command - 'command_off'
- * @cb: callback that is run upon new data from STDOUT (?)
- *     (TODO: STDERR would be nice since we usually redirect STDOUT)
+ * @cb: callback that is run for each line of diagnostic output (from STDERR)
+ * @url: Optional URL to download and feed into STDIN
+ * @options: Download options for the URL (may be NULL)
  * @user_data: passed along to cb
  *
- * Runs args[0] with the arguments and uses the GPX module
- * to import the GPX data into layer vt. Assumes that upon
- * running the command, the data will appear in the (usually
- * temporary) file name_dst.
+ * Runs args[0] with the arguments and uses the GPX module to import
+ *  the GPX data into layer vt as it appears on STDOUT
+ *  (i.e. when using gpsbabel the output file is '-').
+ * Thus the parsing occurs whilst the conversion is still in progress,
+ *  without the need of any intermediate file.
  *
  * Returns: %TRUE on success
  */
-static gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb, gchar **args, const gchar *name_dst, gpointer user_data )
+static gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb, gchar **args, const gchar *url, DownloadFileOptions *options, gpointer user_data )
 {
-  gboolean ret = FALSE;
-  FILE *f = NULL;
+  GPid pid;
+  GError *error = NULL;
+  gint babel_stdin, babel_stdout, babel_stderr;
 
-  if (babel_general_convert(cb, args, user_data)) {
+  if ( vik_debug ) {
+    GString *gstr = g_string_new ( NULL );
+    g_string_append_printf ( gstr, "%s:", __FUNCTION__ );
+    for ( guint i=0; args[i]; i++ )
+      g_string_append_printf ( gstr, " %s", args[i] );
+    g_message ( "%s", gstr->str );
+    g_string_free ( gstr, TRUE );
+  }
 
-    /* No data actually required but still need to have run gpsbabel anyway
-       - eg using the device power command_off */
-    if ( vt == NULL )
-      return TRUE;
+  if (!g_spawn_async_with_pipes (NULL, args, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid,
+                                 url ? &babel_stdin : NULL, &babel_stdout, cb ? &babel_stderr : NULL, &error)) {
+    g_warning ("Async command failed: %s", error->message);
+    g_error_free(error);
+    return FALSE;
+  }
 
-    f = g_fopen(name_dst, "r");
-    if (f) {
-      gchar *dirpath = g_path_get_dirname ( name_dst );
-      ret = a_gpx_read_file ( vt, f, dirpath, FALSE );
-      g_free ( dirpath );
-      fclose(f);
+  BabelFeed feed = { url, options, NULL, DOWNLOAD_SUCCESS };
+  GThread *feeder = NULL;
+  if ( url ) {
+    feed.ff = fdopen ( babel_stdin, "w" );
+    if ( feed.ff )
+      feeder = g_thread_try_new ( "babel_feed", (GThreadFunc)babel_feed_thread, &feed, NULL );
+    if ( !feeder ) {
+      // Ensure the program sees the end of its input
+      if ( feed.ff )
+        fclose ( feed.ff );
+      else
+        close ( babel_stdin );
+      feed.result = DOWNLOAD_FILE_WRITE_ERROR;
     }
   }
 
+  // Run a loop in this thread just for the program's outputs
+  GMainContext *context = g_main_context_new ();
+  BabelStream bs = { g_main_loop_new(context, FALSE), NULL, cb, user_data, 0 };
+  if ( vt )
+    bs.reader = a_gpx_reader_new ( vt, g_get_tmp_dir(), FALSE );
+  babel_stream_watch ( &bs, context, babel_stdout, (GIOFunc)babel_stream_data );
+  if ( cb )
+    babel_stream_watch ( &bs, context, babel_stderr, (GIOFunc)babel_stream_diag );
+  g_main_loop_run ( bs.loop );
+  g_main_loop_unref ( bs.loop );
+  g_main_context_unref ( context );
+
+  if ( feeder )
+    g_thread_join ( feeder );
+
+  if ( cb )
+    cb(BABEL_DONE, NULL, user_data);
+
+  g_child_watch_add ( pid, (GChildWatchFunc) babel_watch, NULL );
+
+  /* No data actually required but still need to have run gpsbabel anyway
+     - eg using the device power command_off */
+  if ( !bs.reader )
+    return TRUE;
+
+  gboolean ret = a_gpx_reader_finish ( bs.reader );
+  if ( feed.result != DOWNLOAD_SUCCESS ) {
+    g_warning ( "%s: download failed: %d for %s", __FUNCTION__, feed.result, url );
+    ret = FALSE;
+  }
   return ret;
 }
 
+/**
+ * Build the arguments to gpsbabel for reading from @from (which may be '-' for STDIN),
+ *  with the GPX output to STDOUT
+ */
+static GPtrArray *babel_convert_from_args ( const char *babelargs, const char *from, const char *babelfilters )
+{
+  GPtrArray *args = g_ptr_array_new_with_free_func ( g_free );
+  g_ptr_array_add ( args, g_strdup(gpsbabel_loc) );
+
+  gchar **sub_args = g_strsplit(babelargs, " ", 0);
+  for (guint j = 0; sub_args[j]; j++) {
+    /* some version of gpsbabel can not take extra blank arg */
+    if (sub_args[j][0] != '\0')
+      g_ptr_array_add ( args, g_strdup(sub_args[j]) );
+  }
+  g_strfreev(sub_args);
+
+  g_ptr_array_add ( args, g_strdup("-f") );
+  g_ptr_array_add ( args, g_strdup(from) );
+  if (babelfilters) {
+    gchar **sub_filters = g_strsplit(babelfilters, " ", 0);
+    for (guint j = 0; sub_filters[j]; j++) {
+      /* some version of gpsbabel can not take extra blank arg */
+      if (sub_filters[j][0] != '\0')
+        g_ptr_array_add ( args, g_strdup(sub_filters[j]) );
+    }
+    g_strfreev(sub_filters);
+  }
+  g_ptr_array_add ( args, g_strdup("-o") );
+  g_ptr_array_add ( args, g_strdup("gpx") );
+  g_ptr_array_add ( args, g_strdup("-F") );
+  g_ptr_array_add ( args, g_strdup("-") );
+  g_ptr_array_add ( args, NULL );
+  return args;
+}
+
 /**
  * a_babel_convert_from_filter:
  * @vt:           The TRW layer to place data into. Duplicate items will be overwritten.
@@ -271,56 +462,15 @@ static gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb,
  */
 gboolean a_babel_convert_from_filter( VikTrwLayer *vt, const char *babelargs, const char *from, const char *babelfilters, BabelStatusFunc cb, gpointer user_data, gpointer not_used )
 {
-  int i,j;
-  int fd_dst;
-  gchar *name_dst = NULL;
-  gboolean ret = FALSE;
-  gchar *args[64];
-
-  if ((fd_dst = g_file_open_tmp("tmp-viking.XXXXXX", &name_dst, NULL)) >= 0) {
-    g_debug ("%s: temporary file: %s", __FUNCTION__, name_dst);
-    close(fd_dst);
-
-    if (gpsbabel_loc ) {
-      gchar **sub_args = g_strsplit(babelargs, " ", 0);
-      gchar **sub_filters = NULL;
-
-      i = 0;
-      if (unbuffer_loc)
-        args[i++] = unbuffer_loc;
-      args[i++] = gpsbabel_loc;
-      for (j = 0; sub_args[j]; j++) {
-        /* some version of gpsbabel can not take extra blank arg */
-        if (sub_args[j][0] != '\0')
-          args[i++] = sub_args[j];
-      }
-      args[i++] = "-f";
-      args[i++] = (char *)from;
-      if (babelfilters) {
-        sub_filters = g_strsplit(babelfilters, " ", 0);
-        for (j = 0; sub_filters[j]; j++) {
-          /* some version of gpsbabel can not take extra blank arg */
-          if (sub_filters[j][0] != '\0')
-            args[i++] = sub_filters[j];
-        }
-      }
-      args[i++] = "-o";
-      args[i++] = "gpx";
-      args[i++] = "-F";
-      args[i++] = name_dst;
-      args[i] = NULL;
-
-      ret = babel_general_convert_from ( vt, cb, args, name_dst, user_data );
-
-      g_strfreev(sub_args);
-      if (sub_filters)
-          g_strfreev(sub_filters);
-    } else
-      g_critical("gpsbabel not found in PATH");
-    (void)g_remove(name_dst);
-    g_free(name_dst);
+  if ( !gpsbabel_loc ) {
+    g_critical("gpsbabel not found in PATH");
+    return FALSE;
   }
 
+  // NB 'unbuffer' is not used, as the diagnostic output must be kept separate from the data
+  GPtrArray *args = babel_convert_from_args ( babelargs, from, babelfilters );
+  gboolean ret = babel_general_convert_from ( vt, cb, (gchar**)args->pdata, NULL, NULL, user_data );
+  g_ptr_array_free ( args, TRUE );
   return ret;
 }
 
@@ -337,40 +487,27 @@ gboolean a_babel_convert_from_filter( VikTrwLayer *vt, const char *babelargs, co
  * If input_file_type is %NULL, doesn't use GPSBabel. Input must be GPX (or Geocaching *.loc)
  *
  * Uses babel_general_convert_from() to actually run the command. This function
- * prepares the command and temporary file, and sets up the arguments for bash.
+ * prepares the command, and sets up the arguments for bash.
  */
 gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_cmd, const char *input_file_type, BabelStatusFunc cb, gpointer user_data, gpointer not_used )
 {
-  int fd_dst;
-  gchar *name_dst = NULL;
-  gboolean ret = FALSE;
-  gchar **args;  
-
-  if ((fd_dst = g_file_open_tmp("tmp-viking.XXXXXX", &name_dst, NULL)) >= 0) {
-    g_debug ("%s: temporary file: %s", __FUNCTION__, name_dst);
-    gchar *shell_command;
-    if ( input_file_type )
-      shell_command = g_strdup_printf("%s | %s -i %s -f - -o gpx -F %s",
-        input_cmd, gpsbabel_loc, input_file_type, name_dst);
-    else
-      shell_command = g_strdup_printf("%s > %s", input_cmd, name_dst);
-
-    g_debug("%s: %s", __FUNCTION__, shell_command);
-    close(fd_dst);
-
-    args = g_malloc(sizeof(gchar *)*4);
-    args[0] = BASH_LOCATION;
-    args[1] = "-c";
-    args[2] = shell_command;
-    args[3] = NULL;
-
-    ret = babel_general_convert_from ( vt, cb, args, name_dst, user_data );
-    g_free ( args );
-    g_free ( shell_command );
-    (void)g_remove(name_dst);
-    g_free(name_dst);
-  }
+  gchar *shell_command;
+  if ( input_file_type )
+    shell_command = g_strdup_printf("%s | %s -i %s -f - -o gpx -F -",
+      input_cmd, gpsbabel_loc, input_file_type);
+  else
+    shell_command = g_strdup(input_cmd);
+
+  g_debug("%s: %s", __FUNCTION__, shell_command);
+
+  gchar *args[4];
+  args[0] = BASH_LOCATION;
+  args[1] = "-c";
+  args[2] = shell_command;
+  args[3] = NULL;
 
+  gboolean ret = babel_general_convert_from ( vt, cb, args, NULL, NULL, user_data );
+  g_free ( shell_command );
   return ret;
 }
 
@@ -387,6 +524,8 @@ gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_
  * Download the file pointed by the URL and optionally uses GPSBabel to convert from input_type.
  * If input_type and babelfilters are %NULL, gpsbabel is not used.
  * If input_type is 'gpx' or 'kml' or 'geojson-osrm' then we will use our own native parsers.
+ * When GPSBabel is used, the download is fed straight into it
+ *  (unless the download options need to check or convert the whole file first).
  * NB TCX and indeed Vikings own files aren't available via this method since they can only be
  * loaded into an aggregate layer (i.e. not into a %VikTrwLayer which is all that is available here)
  *
@@ -407,6 +546,32 @@ gboolean a_babel_convert_from_url_filter ( VikTrwLayer *vt, const char *url, con
 
   g_debug("%s: input_type=%s url=%s", __FUNCTION__, input_type, url);
 
+  gboolean do_gpx = FALSE;
+  gboolean do_kml = FALSE;
+  gboolean do_gjo = FALSE;
+  if ( g_strcmp0(input_type, "gpx") == 0 )
+    do_gpx = TRUE;
+  if ( g_strcmp0(input_type, "kml") == 0 )
+    do_kml = TRUE;
+  if ( g_strcmp0(input_type, "viking-geojson-osrm") == 0 )
+    do_gjo = TRUE;
+  if ( !do_gpx && !do_kml && !do_gjo && input_type == NULL && babelfilters == NULL )
+    // No input_type specified - resort to GPX
+    do_gpx = TRUE;
+  gboolean do_babel = !do_gpx && !do_kml && !do_gjo;
+
+  if ( do_babel ) {
+    babelargs = (input_type) ? g_strdup_printf(" -i %s", input_type) : g_strdup("");
+    if ( gpsbabel_loc && !myoptions.check_file && !myoptions.convert_file ) {
+      g_debug ( "%s: streaming into gpsbabel", __FUNCTION__ );
+      GPtrArray *args = babel_convert_from_args ( babelargs, "-", babelfilters );
+      ret = babel_general_convert_from ( vt, NULL, (gchar**)args->pdata, url, &myoptions, NULL );
+      g_ptr_array_free ( args, TRUE );
+      g_free ( babelargs );
+      return ret;
+    }
+  }
+
   if ((fd_src = g_file_open_tmp("tmp-viking.XXXXXX", &name_src, NULL)) >= 0) {
     g_debug ("%s: temporary file: %s", __FUNCTION__, name_src);
     close(fd_src);
@@ -414,25 +579,9 @@ gboolean a_babel_convert_from_url_filter ( VikTrwLayer *vt, const char *url, con
 
     fetch_ret = a_http_download_get_url(url, "", name_src, &myoptions, NULL);
     if (fetch_ret == DOWNLOAD_SUCCESS) {
-      gboolean do_gpx = FALSE;
-      gboolean do_kml = FALSE;
-      gboolean do_gjo = FALSE;
-      if ( g_strcmp0(input_type, "gpx") == 0 )
-        do_gpx = TRUE;
-      if ( g_strcmp0(input_type, "kml") == 0 )
-        do_kml = TRUE;
-      if ( g_strcmp0(input_type, "viking-geojson-osrm") == 0 )
-        do_gjo = TRUE;
-
-      if ( !do_gpx && !do_kml && !do_gjo ) {
-        if (input_type != NULL || babelfilters != NULL) {
-          babelargs = (input_type) ? g_strdup_printf(" -i %s", input_type) : g_strdup("");
-          ret = a_babel_convert_from_filter( vt, babelargs, name_src, babelfilters, NULL, NULL, NULL );
-        } else
-          // No input_type specified - resort to GPX
-          do_gpx = TRUE;
-      }
-      if ( do_gpx || do_kml || do_gjo ) {
+      if ( do_babel )
+        ret = a_babel_convert_from_filter( vt, babelargs, name_src, babelfilters, NULL, NULL, NULL );
+      else {
         /* Process directly the retrieved file */
         g_debug ( "%s: directly read file %s", __FUNCTION__, name_src );
         FILE *f = g_fopen(name_src, "r");
@@ -462,9 +611,9 @@ gboolean a_babel_convert_from_url_filter ( VikTrwLayer *vt, const char *url, con
       }
     }
     (void)util_remove(name_src);
-    g_free(babelargs);
     g_free(name_src);
   }
+  g_free(babelargs);
 
   return ret;
 }
@@ -580,7 +729,7 @@ static void set_mode(BabelMode *mode, gchar *smode)
  *
  * Load a single feature stored in the given line.
  */
-static void load_feature_parse_line (gchar *line)
+static void load_feature_parse_line (gchar *line, BabelFeatures *bf)
 {
   gchar **tokens = g_strsplit ( line, "\t", 0 );
   if ( tokens != NULL
@@ -594,7 +743,7 @@ static void load_feature_parse_line (gchar *line)
         set_mode (&(device->mode), tokens[1]);
         device->name = g_strdup (tokens[2]);
         device->label = g_strndup (tokens[4], 50); // Limit really long label text
-        a_babel_device_list = g_list_append (a_babel_device_list, device);
+        bf->devices = g_list_append (bf->devices, device);
         if ( vik_verbose )
           g_debug ("New gpsbabel device: %s, %d%d%d%d%d%d(%s)",
         		device->name,
@@ -615,7 +764,7 @@ static void load_feature_parse_line (gchar *line)
         file->name = g_strdup (tokens[2]);
         file->ext = g_strdup (tokens[3]);
         file->label = g_strdup (tokens[4]);
-        a_babel_file_list = g_list_append (a_babel_file_list, file);
+        bf->files = g_list_append (bf->files, file);
         if ( vik_verbose )
           g_debug ("New gpsbabel file: %s, %d%d%d%d%d%d(%s)",
 			file->name,
@@ -636,10 +785,10 @@ static void load_feature_parse_line (gchar *line)
 static void load_feature_cb (BabelProgressCode code, gpointer line, gpointer user_data)
 {
   if (line != NULL)
-    load_feature_parse_line (line);
+    load_feature_parse_line (line, user_data);
 }
 
-static gboolean load_feature ()
+static gboolean load_feature ( BabelFeatures *bf )
 {
   int i;
   gboolean ret = FALSE;
@@ -653,7 +802,7 @@ static gboolean load_feature ()
     args[i++] = "-^3";
     args[i] = NULL;
 
-    ret = babel_general_convert (load_feature_cb, args, NULL);
+    ret = babel_general_convert (load_feature_cb, args, bf);
   }
 
   return ret;
@@ -689,12 +838,67 @@ void a_babel_init ()
   a_preferences_register ( &prefs[0], (VikLayerParamData){0}, VIKING_PREFERENCES_IO_GROUP_KEY );
 }
 
+static gboolean probe_done ( gpointer data );
+
+static gpointer probe_thread_func ( gpointer data )
+{
+  BabelFeatures *bf = g_malloc0 ( sizeof(BabelFeatures) );
+  gint64 begin = a_trace_begin ();
+  if ( !load_feature ( bf ) )
+    g_warning ( "%s: running gpsbabel to get features failed", __FUNCTION__ );
+  a_trace_end ( "babel_probe", begin );
+  (void)g_idle_add ( probe_done, NULL );
+  return bf;
+}
+
+/**
+ * Wait for the probe and make its results available
+ */
+static void probe_finish ()
+{
+  BabelFeatures *bf = g_thread_join ( probe_thread );
+  probe_thread = NULL;
+  a_babel_file_list = bf->files;
+  a_babel_device_list = bf->devices;
+  g_free ( bf );
+  probed = TRUE;
+}
+
+static gboolean probe_done ( gpointer data )
+{
+  a_babel_wait_ready ();
+  return FALSE;
+}
+
+/**
+ * a_babel_wait_ready:
+ *
+ * Block until gpsbabel's features are known,
+ *  e.g. for programs without a main loop
+ */
+void a_babel_wait_ready ()
+{
+  // Unless already done
+  if ( probe_thread ) {
+    probe_finish ();
+    g_debug ( "%s: gpsbabel has %d file formats and %d devices", __FUNCTION__,
+              g_list_length(a_babel_file_list), g_list_length(a_babel_device_list) );
+    for ( GSList *sl = ready_callbacks; sl; sl = sl->next ) {
+      BabelReady *ready = sl->data;
+      ready->func ( ready->user_data );
+    }
+    g_slist_free_full ( ready_callbacks, g_free );
+    ready_callbacks = NULL;
+  }
+}
+
 /**
  * a_babel_post_init:
  *
  * Initialises babel module.
  * Mainly check existence of gpsbabel progam
- * and load all features available in that version.
+ * and start loading all features available in that version.
+ * See a_babel_ready() for when they have been loaded.
  */
 void a_babel_post_init ()
 {
@@ -718,10 +922,14 @@ void a_babel_post_init ()
 #endif
 
   if ( gpsbabel_loc ) {
-    if ( !load_feature() ) {
-      g_warning ( "%s: running gpsbabel to get features failed", __FUNCTION__ );
+    probe_thread = g_thread_try_new ( "babel_probe", (GThreadFunc)probe_thread_func, NULL, NULL );
+    if ( !probe_thread ) {
+      g_warning ( "%s: could not start finding gpsbabel's features", __FUNCTION__ );
+      probed = TRUE;
     }
   }
+  else
+    probed = TRUE;
 }
 
 /**
@@ -731,6 +939,11 @@ void a_babel_post_init ()
  */
 void a_babel_uninit ()
 {
+  if ( probe_thread )
+    probe_finish ();
+  g_slist_free_full ( ready_callbacks, g_free );
+  ready_callbacks = NULL;
+
   g_free ( gpsbabel_loc );
   g_free ( unbuffer_loc );
 
@@ -771,6 +984,36 @@ gboolean a_babel_available ()
   return a_babel_device_list != NULL;
 }
 
+/**
+ * a_babel_ready:
+ *
+ * Returns: TRUE once gpsbabel's features are known
+ *  (including when it is not available at all)
+ */
+gboolean a_babel_ready ()
+{
+  return probed;
+}
+
+/**
+ * a_babel_add_ready_callback:
+ * @func:      Called in the main thread when gpsbabel's features become known
+ * @user_data: Passed into the function
+ *
+ * If already known, the function is called straight away.
+ */
+void a_babel_add_ready_callback ( BabelReadyFunc func, gpointer user_data )
+{
+  if ( probed ) {
+    func ( user_data );
+    return;
+  }
+  BabelReady *ready = g_malloc ( sizeof(BabelReady) );
+  ready->func = func;
+  ready->user_data = user_data;
+  ready_callbacks = g_slist_append ( ready_callbacks, ready );
+}
+
 /**
  * a_babel_file_list_get:
  *
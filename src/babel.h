@@ -123,6 +123,11 @@ void a_babel_uninit ();
 
 gboolean a_babel_available ();
 
+typedef void (*BabelReadyFunc) ( gpointer user_data );
+gboolean a_babel_ready ();
+void a_babel_add_ready_callback ( BabelReadyFunc func, gpointer user_data );
+void a_babel_wait_ready ();
+
 GList *a_babel_file_list_get ();
 GList *a_babel_device_list_get ();
 
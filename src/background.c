@@ -30,6 +30,7 @@
 #include "uibuilder.h"
 #include "globals.h"
 #include "preferences.h"
+#include "trace.h"
 
 static GThreadPool *thread_pool_remote = NULL;
 static GThreadPool *thread_pool_local = NULL;
@@ -48,7 +49,7 @@ static GSList *windows_to_update = NULL;
 
 static gint bgitemcount = 0;
 
-#define VIK_BG_NUM_ARGS 8
+#define VIK_BG_NUM_ARGS 9
 
 enum
 {
@@ -130,6 +131,7 @@ static void thread_die ( gpointer args[VIK_BG_NUM_ARGS] )
     background_thread_update ();
   }
 
+  g_free ( args[8] );
   g_free ( args );
 }
 
@@ -169,8 +171,15 @@ static void thread_helper ( gpointer args[VIK_BG_NUM_ARGS], gpointer user_data )
 
   g_debug(__FUNCTION__);
 
+  a_trace_count ( VIK_TRACE_BACKGROUND_QUEUED, -1 );
+  a_trace_count ( VIK_TRACE_BACKGROUND_RUNNING, 1 );
+  gint64 trace_begin = a_trace_begin ();
+
   func ( userdata, args );
 
+  a_trace_end_detail ( "background", args[8], trace_begin );
+  a_trace_count ( VIK_TRACE_BACKGROUND_RUNNING, -1 );
+
   if ( ! args[0] ) {
     gdk_threads_add_idle ( idle_remove, args[5] );
   }
@@ -205,6 +214,7 @@ void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gch
   args[5] = piter;
   args[6] = GINT_TO_POINTER(number_items);
   args[7] = GUINT_TO_POINTER(0); // Will be id of progress update func
+  args[8] = vik_trace_enabled ? g_strdup ( message ) : NULL;
 
   bgitemcount += number_items;
 
@@ -215,6 +225,8 @@ void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gch
 		       DATA_COLUMN, args,
 		       -1 );
 
+  a_trace_count ( VIK_TRACE_BACKGROUND_QUEUED, 1 );
+
   /* run the thread in the background */
   if ( bp == BACKGROUND_POOL_REMOTE )
     g_thread_pool_push( thread_pool_remote, args, NULL );
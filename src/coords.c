@@ -130,7 +130,25 @@ double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2
   return isnan(tmp3)?0:tmp3;
 }
 
+static void latlon_to_utm ( const struct LatLon *latlon, int force_zone, struct UTM *utm );
+
 void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
+    {
+    latlon_to_utm ( latlon, 0, utm );
+    }
+
+/**
+ * a_coords_latlon_to_utm_zone:
+ *
+ * As a_coords_latlon_to_utm() but always in the given zone,
+ *  even when the position is outside of it (e.g. to continue a grid past the zone boundary)
+ */
+void a_coords_latlon_to_utm_zone ( const struct LatLon *latlon, int zone, struct UTM *utm )
+    {
+    latlon_to_utm ( latlon, zone, utm );
+    }
+
+static void latlon_to_utm ( const struct LatLon *latlon, int force_zone, struct UTM *utm )
     {
     double latitude;
     double longitude;
@@ -165,6 +183,8 @@ void a_coords_latlon_to_utm( const struct LatLon *latlon, struct UTM *utm )
 	else if ( longitude >= 21.0 && longitude < 33.0 ) zone = 35;
 	else if ( longitude >= 33.0 && longitude < 42.0 ) zone = 37;
 	}
+    if ( force_zone > 0 )
+	zone = force_zone;
     long_origin = ( zone - 1 ) * 6 - 180 + 3;	/* +3 puts origin in middle of zone */
     long_origin_rad = DEG2RAD(long_origin);
     eccPrimeSquared = EccentricitySquared / ( 1.0 - EccentricitySquared );
@@ -329,3 +349,23 @@ void a_coords_latlon_destination ( const struct LatLon *start, double distance,
   destination->lat = RAD2DEG(phi2);
   destination->lon = RAD2DEG(lambda2);
 }
+
+/**
+ * Using the 'AA' lettering scheme, as for WGS84
+ * Columns cycle through three sets of letters by zone, rows cycle every 2,000km
+ *  starting 500km further on in even numbered zones.
+ */
+void a_coords_utm_to_mgrs_square ( const struct UTM *utm, char square[3] )
+{
+  static const char *cols[3] = { "STUVWXYZ", "ABCDEFGH", "JKLMNPQR" };
+  static const char *rows = "ABCDEFGHJKLMNPQRSTUV";
+  int col = (int)floor ( utm->easting / 100000.0 ) - 1;
+  int row = (int)floor ( utm->northing / 100000.0 );
+  if ( utm->zone % 2 == 0 )
+    row += 5;
+  col = CLAMP ( col, 0, 7 );
+  row = ((row % 20) + 20) % 20;
+  square[0] = cols[utm->zone % 3][col];
+  square[1] = rows[row];
+  square[2] = '\0';
+}
@@ -55,6 +55,7 @@ struct LatLon {
 
 int a_coords_utm_equal( const struct UTM *utm1, const struct UTM *utm2 );
 void a_coords_latlon_to_utm ( const struct LatLon *latlon, struct UTM *utm );
+void a_coords_latlon_to_utm_zone ( const struct LatLon *latlon, int zone, struct UTM *utm );
 void a_coords_utm_to_latlon ( const struct UTM *utm, struct LatLon *latlon );
 double a_coords_utm_diff( const struct UTM *utm1, const struct UTM *utm2 );
 double a_coords_latlon_diff ( const struct LatLon *ll1, const struct LatLon *ll2 );
@@ -96,6 +97,13 @@ void a_coords_latlon_to_string ( const struct LatLon *latlon, gchar **lat, gchar
  */
 void a_coords_latlon_destination ( const struct LatLon *start, double distance, double brg, struct LatLon *destination );
 
+/**
+ * a_coords_utm_to_mgrs_square:
+ *
+ * @square: Set to the two letter identifier of the 100km MGRS square containing the position
+ */
+void a_coords_utm_to_mgrs_square ( const struct UTM *utm, char square[3] );
+
 G_END_DECLS
 
 #endif
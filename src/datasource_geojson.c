@@ -45,7 +45,7 @@ VikDataSourceInterface vik_datasource_geojson_interface = {
 	VIK_DATASOURCE_INPUTTYPE_NONE,
 	TRUE,
 	FALSE, // We should be able to see the data on the screen so no point in keeping the dialog open
-	FALSE, // Not thread method - open each file in the main loop
+	FALSE, // Not thread method - read each file in the main loop
 	(VikDataSourceInitFunc)               datasource_geojson_init,
 	(VikDataSourceCheckExistenceFunc)     NULL,
 	(VikDataSourceAddSetupWidgetsFunc)    datasource_geojson_add_setup_widgets,
@@ -125,7 +125,7 @@ static void datasource_geojson_get_process_options ( datasource_geojson_user_dat
 }
 
 /**
- * Process selected files and try to generate waypoints storing them in the given vtl
+ * Process selected files, reading the tracks, routes and waypoints directly into the given vtl
  */
 static gboolean datasource_geojson_process ( VikTrwLayer *vtl, ProcessOptions *process_options, BabelStatusFunc status_cb, acq_dialog_widgets_t *adw, DownloadFileOptions *options_unused )
 {
@@ -136,15 +136,7 @@ static gboolean datasource_geojson_process ( VikTrwLayer *vtl, ProcessOptions *p
 	while ( cur_file ) {
 		gchar *filename = cur_file->data;
 
-		gchar *gpx_filename = a_geojson_import_to_gpx ( filename );
-		if ( gpx_filename ) {
-			// Important that this process is run in the main thread
-			vik_window_open_file ( adw->vw, gpx_filename, FALSE, TRUE, TRUE, TRUE, FALSE );
-			// Delete the temporary file
-			(void)g_remove (gpx_filename);
-			g_free (gpx_filename);
-		}
-		else {
+		if ( !a_geojson_read_file ( vtl, filename ) ) {
 			gchar* msg = g_strdup_printf ( _("Unable to import from: %s"), filename );
 			vik_window_statusbar_update ( adw->vw, msg, VIK_STATUSBAR_INFO );
 			g_free (msg);
@@ -33,6 +33,12 @@ typedef struct {
 GHashTable *loaded_dems = NULL;
 /* filename -> DEM */
 
+// Lookups may happen in background threads (e.g. for track profiles)
+//  whilst DEMs are being loaded or unloaded
+static GMutex dems_mutex;
+// Changes whenever a DEM is loaded or unloaded, so anything derived from the DEMs can tell when it is out of date
+static guint dems_generation = 0;
+
 static void loaded_dem_free ( LoadedDEM *ldem )
 {
   vik_dem_free ( ldem->dem );
@@ -41,8 +47,22 @@ static void loaded_dem_free ( LoadedDEM *ldem )
 
 void a_dems_uninit ()
 {
+  g_mutex_lock ( &dems_mutex );
   if ( loaded_dems )
     g_hash_table_destroy ( loaded_dems );
+  loaded_dems = NULL;
+  g_atomic_int_inc ( &dems_generation );
+  g_mutex_unlock ( &dems_mutex );
+}
+
+/**
+ * a_dems_get_generation:
+ *
+ * Returns: A value that changes whenever the set of loaded DEMs changes
+ */
+guint a_dems_get_generation ()
+{
+  return g_atomic_int_get ( &dems_generation );
 }
 
 /* To load a dem. if it was already loaded, will simply
@@ -52,6 +72,7 @@ VikDEM *a_dems_load(const gchar *filename)
 {
   LoadedDEM *ldem;
 
+  g_mutex_lock ( &dems_mutex );
   /* dems init hash table */
   if ( ! loaded_dems )
     loaded_dems = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) loaded_dem_free );
@@ -59,29 +80,51 @@ VikDEM *a_dems_load(const gchar *filename)
   ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
   if ( ldem ) {
     ldem->ref_count++;
+    g_mutex_unlock ( &dems_mutex );
     return ldem->dem;
+  }
+  g_mutex_unlock ( &dems_mutex );
+
+  // Don't hold up lookups whilst reading the file
+  VikDEM *dem = vik_dem_new_from_file ( filename );
+  if ( ! dem )
+    return NULL;
+
+  g_mutex_lock ( &dems_mutex );
+  if ( ! loaded_dems )
+    loaded_dems = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) loaded_dem_free );
+  // Loaded by another thread in the meantime?
+  ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
+  if ( ldem ) {
+    ldem->ref_count++;
+    vik_dem_free ( dem );
+    dem = ldem->dem;
   } else {
-    VikDEM *dem = vik_dem_new_from_file ( filename );
-    if ( ! dem )
-      return NULL;
     ldem = g_malloc ( sizeof(LoadedDEM) );
     ldem->ref_count = 1;
     ldem->dem = dem;
     g_hash_table_insert ( loaded_dems, g_strdup(filename), ldem );
-    return dem;
+    g_atomic_int_inc ( &dems_generation );
   }
+  g_mutex_unlock ( &dems_mutex );
+  return dem;
 }
 
 void a_dems_unref(const gchar *filename)
 {
-  LoadedDEM *ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
+  g_mutex_lock ( &dems_mutex );
+  LoadedDEM *ldem = loaded_dems ? (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename ) : NULL;
   if ( !ldem ) {
     /* This is fine - probably means the loaded list was aborted / not completed for some reason */
+    g_mutex_unlock ( &dems_mutex );
     return;
   }
   ldem->ref_count--;
-  if ( ldem->ref_count == 0 )
+  if ( ldem->ref_count == 0 ) {
     g_hash_table_remove ( loaded_dems, filename );
+    g_atomic_int_inc ( &dems_generation );
+  }
+  g_mutex_unlock ( &dems_mutex );
 }
 
 /* to get a DEM that was already loaded.
@@ -90,10 +133,13 @@ void a_dems_unref(const gchar *filename)
  */
 VikDEM *a_dems_get(const gchar *filename)
 {
-  LoadedDEM *ldem = g_hash_table_lookup ( loaded_dems, filename );
+  VikDEM *dem = NULL;
+  g_mutex_lock ( &dems_mutex );
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
   if ( ldem )
-    return ldem->dem;
-  return NULL;
+    dem = ldem->dem;
+  g_mutex_unlock ( &dems_mutex );
+  return dem;
 }
 
 
@@ -214,10 +260,10 @@ static gboolean get_elev_by_coord(gpointer key, LoadedDEM *ldem, CoordElev *ce)
     lat = ll_tmp.lat * 3600;
     lon = ll_tmp.lon * 3600;
   } else if (dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS) {
-    static struct UTM utm_tmp;
+    struct UTM utm_tmp;
+    vik_coord_to_utm (ce->coord, &utm_tmp);
     if (utm_tmp.zone != dem->utm_zone)
       return FALSE;
-    vik_coord_to_utm (ce->coord, &utm_tmp);
     lat = utm_tmp.northing;
     lon = utm_tmp.easting;
   } else
@@ -243,14 +289,14 @@ gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
 {
   CoordElev ce;
 
-  if (!loaded_dems)
-    return VIK_DEM_INVALID_ELEVATION;
-
   ce.coord = coord;
   ce.method = method;
   ce.elev = VIK_DEM_INVALID_ELEVATION;
 
-  if(!g_hash_table_find(loaded_dems, (GHRFunc)get_elev_by_coord, &ce))
+  g_mutex_lock ( &dems_mutex );
+  gboolean found = loaded_dems && g_hash_table_find(loaded_dems, (GHRFunc)get_elev_by_coord, &ce);
+  g_mutex_unlock ( &dems_mutex );
+  if ( !found )
     return VIK_DEM_INVALID_ELEVATION;
   return ce.elev;
 }
@@ -263,12 +309,15 @@ gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
  */
 gboolean a_dems_overlaps_bbox ( LatLonBBox bbox )
 {
-  if (!loaded_dems)
-    return FALSE;
-
   gboolean ans = FALSE;
   LatLonBBox dem_bbox;
 
+  g_mutex_lock ( &dems_mutex );
+  if ( !loaded_dems ) {
+    g_mutex_unlock ( &dems_mutex );
+    return FALSE;
+  }
+
   gpointer key, value;
   GHashTableIter ght_iter;
   g_hash_table_iter_init ( &ght_iter, loaded_dems );
@@ -279,5 +328,6 @@ gboolean a_dems_overlaps_bbox ( LatLonBBox bbox )
       break;
     }
   }
+  g_mutex_unlock ( &dems_mutex );
   return ans;
 }
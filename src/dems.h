@@ -45,6 +45,8 @@ gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method);
 
 gboolean a_dems_overlaps_bbox ( LatLonBBox bbox );
 
+guint a_dems_get_generation ();
+
 G_END_DECLS
 
 #endif
@@ -494,6 +494,23 @@ void a_download_handle_cleanup ( void *handle )
   curl_download_handle_cleanup ( handle );
 }
 
+/**
+ * a_download_uri_to_stream:
+ * @uri:         The URI (Uniform Resource Identifier)
+ * @ff:          Where to write the content as it is received, e.g. a pipe to another program
+ * @options:     Download options (maybe NULL)
+ *
+ * NB Options that need the whole file (check_file and convert_file) are not applied
+ */
+DownloadResult_t a_download_uri_to_stream ( const gchar *uri, FILE *ff, DownloadFileOptions *options )
+{
+  if ( curl_download_uri ( uri, ff, options, NULL, NULL ) != CURL_DOWNLOAD_NO_ERROR )
+    return DOWNLOAD_HTTP_ERROR;
+  if ( fflush(ff) != 0 )
+    return DOWNLOAD_FILE_WRITE_ERROR;
+  return DOWNLOAD_SUCCESS;
+}
+
 /**
  * a_download_url_to_tmp_file:
  * @uri:         The URI (Uniform Resource Identifier)
@@ -135,6 +135,7 @@ void *a_download_handle_init ();
 void a_download_handle_cleanup ( void *handle );
 
 gchar *a_download_uri_to_tmp_file ( const gchar *uri, DownloadFileOptions *options );
+DownloadResult_t a_download_uri_to_stream ( const gchar *uri, FILE *ff, DownloadFileOptions *options );
 
 G_END_DECLS
 
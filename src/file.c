@@ -795,6 +795,11 @@ VikLoadType_t a_file_load_stream ( FILE *f,
 	  trw_layer_replace_external ( vtl, filename );
       }
     }
+    else if ( a_file_check_ext ( filename, ".geojson" ) ) {
+      if ( ! ( success = a_geojson_read_file ( vtl, filename ) ) ) {
+        load_answer = LOAD_TYPE_GEOJSON_FAILURE;
+      }
+    }
     else {
       // Try final supported file type
       if ( ! ( success = a_gpspoint_read_file ( vtl, f, dirpath ) ) ) {
@@ -921,21 +926,6 @@ gboolean a_file_check_ext ( const gchar *filename, const gchar *fileext )
   return FALSE;
 }
 
-gboolean kml_export ( VikTrwLayer *vtl, const gchar *filename )
-{
-  gchar *ustr = NULL;
-  switch ( a_vik_get_kml_export_units () ) {
-  case VIK_KML_EXPORT_UNITS_STATUTE:  ustr = ""; break;
-  case VIK_KML_EXPORT_UNITS_NAUTICAL: ustr = ",units=n"; break;
-  default: ustr = ",units=m"; break;
-  }
-  gchar *babelargs = g_strdup_printf ("-o kml%s,track=%d,points=%d",
-                                      ustr, a_vik_get_kml_export_track(), a_vik_get_kml_export_points() );
-  gboolean ans = a_babel_convert_to ( vtl, NULL, babelargs, filename, NULL, NULL );
-  g_free ( babelargs );
-  return ans;
-}
-
 /**
  * a_file_export:
  * @vtl: The TrackWaypoint to export data from
@@ -982,10 +972,11 @@ gboolean a_file_export ( VikTrwLayer *vtl, const gchar *filename, VikFileType_t
         case FILE_TYPE_GEOJSON:
           result = a_geojson_write_file ( vtl, f );
           break;
-        case FILE_TYPE_KML:
-          fclose ( f );
-          return kml_export ( vtl, filename );
+        case FILE_TYPE_KML: {
+          KmlWritingOptions kml_options = { a_vik_get_kml_export_units(), a_vik_get_kml_export_track(), a_vik_get_kml_export_points(), write_hidden };
+          result = a_kml_write_file ( vtl, f, &kml_options );
           break;
+        }
         default:
           g_critical("Houston, we've had a problem. file_type=%d", file_type);
       }
@@ -55,6 +55,7 @@ typedef enum {
   LOAD_TYPE_TCX_FAILURE,
   LOAD_TYPE_KML_FAILURE,
   LOAD_TYPE_FIT_FAILURE,
+  LOAD_TYPE_GEOJSON_FAILURE,
   LOAD_TYPE_UNSUPPORTED_FAILURE,
   LOAD_TYPE_OTHER_FAILURE_NON_FATAL,
   LOAD_TYPE_VIK_FAILURE_NON_FATAL,
@@ -40,8 +40,6 @@
 // (seconds from device power on)
 #define FIT_DATE_TIME_MIN 0x10000000
 
-static guint32 g_data_size = 0;
-
 // NB Force structure to minimum size in order to match binary representation
 // Although without CRC, packed is the same as normal layout
 // FIT files may omit the upfront CRC
@@ -54,28 +52,49 @@ typedef struct __attribute__((__packed__)) {
 	//guint16 crc;
 } header_t;
 
-// As published on https://developer.garmin.com/fit/protocol/
-//  but changed to use 'g' types
-guint16 FitCRC_Get16(guint16 crc, guint8 byte)
+// The CRC as published on https://developer.garmin.com/fit/protocol/
+//  but a whole byte at a time rather than a nibble
+static const guint16 fit_crc_table[256] =
+{
+	0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+	0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+	0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+	0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+	0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+	0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+	0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+	0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+	0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+	0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+	0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+	0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+	0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+	0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+	0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+	0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+	0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+	0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+	0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+	0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+	0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+	0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+	0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+	0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+	0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+	0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+	0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+	0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+	0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+	0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+	0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+	0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+static guint16 fit_crc ( guint16 crc, const guint8 *data, gsize len )
 {
-   static const guint16 crc_table[16] =
-   {
-      0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
-      0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
-   };
-   guint16 tmp;
-
-   // compute checksum of lower four bits of byte
-   tmp = crc_table[crc & 0xF];
-   crc = (crc >> 4) & 0x0FFF;
-   crc = crc ^ tmp ^ crc_table[byte & 0xF];
-
-   // now compute checksum of upper four bits of byte
-   tmp = crc_table[crc & 0xF];
-   crc = (crc >> 4) & 0x0FFF;
-   crc = crc ^ tmp ^ crc_table[(byte >> 4) & 0xF];
-
-   return crc;
+	for ( gsize ii = 0; ii < len; ii++ )
+		crc = (crc >> 8) ^ fit_crc_table[(crc ^ data[ii]) & 0xFF];
+	return crc;
 }
 
 gboolean a_fit_check_magic ( FILE *ff )
@@ -106,79 +125,111 @@ typedef struct {
 	field_t *fields;
 } mesg_def_t;
 
-static mesg_def_t g_defs[FIT_MAX_LOCAL_MESGS];
+typedef struct {
+	VikWaypoint *wp;
+	gchar *name;
+	guint8 type;   // Course point type, or FIT_UINT8_INVALID
+} fit_waypoint_t;
 
-static gboolean read_uint8 ( FILE *ff, guint8 *data, gboolean trackSize )
+//
+// Everything about decoding one file
+// The decoding itself only fills in the tracks & waypoints lists,
+//  so multiple files can be decoded at the same time in different threads.
+// Creation of the layer to hold them is done afterwards in fit_context_finish()
+//
+typedef struct {
+	GMappedFile *mf;
+	GByteArray *contents;  // When the file could not be mapped
+	const guint8 *data;    // The whole file
+	gsize size;
+	gsize pos;             // Current read position in data
+	guint32 data_size;     // Remaining size of the records to be decoded
+
+	mesg_def_t defs[FIT_MAX_LOCAL_MESGS];
+
+	gboolean supported;    // A supported File Id message has been seen
+	VikTrack *tr;          // Current track
+	GList *tracks;         // Completed tracks (in reverse order)
+	GList *waypoints;      // of fit_waypoint_t (in reverse order)
+	gboolean newseg;
+	guint32 settings_ts_offset;
+	guint unnamed_waypoints;
+} fit_context_t;
+
+static gboolean read_uint8 ( fit_context_t *ctx, guint8 *data, gboolean trackSize )
 {
-	if ( fread(data, 1, sizeof(*data), ff) != sizeof(*data))
+	if ( ctx->pos + sizeof(*data) > ctx->size )
 		return FALSE;
-	if ( trackSize ) {
-		g_data_size -= sizeof(*data);
-		//g_debug ( "%s: data=%d g_data_size=%u", __FUNCTION__, *data, g_data_size );
-	}
+	*data = ctx->data[ctx->pos];
+	ctx->pos += sizeof(*data);
+	if ( trackSize )
+		ctx->data_size -= sizeof(*data);
 	return TRUE;
 }
 
-static gboolean read_uint16 ( FILE *ff, guint16 *data, guint8 endian, gboolean monitor_size )
+static gboolean read_uint16 ( fit_context_t *ctx, guint16 *data, guint8 endian, gboolean monitor_size )
 {
 	guint16 val;
-	if ( fread(&val, 2, 1, ff) != 1)
+	if ( ctx->pos + sizeof(val) > ctx->size )
 		return FALSE;
+	memcpy ( &val, ctx->data + ctx->pos, sizeof(val) );
+	ctx->pos += sizeof(val);
 	if ( endian == FIT_ARCH_ENDIAN_LITTLE )
 		*data = GUINT16_FROM_LE(val);
 	else
 		*data = GUINT16_FROM_BE(val);
-	if ( monitor_size ) {
-		g_data_size -= sizeof(*data);
-		//g_debug ( "%s: data=%d g_data_size=%u", __FUNCTION__, *data, g_data_size );
-	}
+	if ( monitor_size )
+		ctx->data_size -= sizeof(*data);
 	return TRUE;
 }
 
-static gboolean read_uint32 ( FILE *ff, guint32 *data, guint8 endian, gboolean monitor_size )
+static gboolean read_uint32 ( fit_context_t *ctx, guint32 *data, guint8 endian, gboolean monitor_size )
 {
 	guint32 val;
-	if ( fread(&val, 4, 1, ff) != 1)
+	if ( ctx->pos + sizeof(val) > ctx->size )
 		return FALSE;
+	memcpy ( &val, ctx->data + ctx->pos, sizeof(val) );
+	ctx->pos += sizeof(val);
 	if ( endian == FIT_ARCH_ENDIAN_LITTLE )
-		*data = GINT32_FROM_LE(val);
+		*data = GUINT32_FROM_LE(val);
 	else
-		*data = GINT32_FROM_BE(val);
-	if ( monitor_size ) {
-		g_data_size -= sizeof(*data);
-		//g_debug ( "%s: data=%d g_data_size=%u", __FUNCTION__, *data, g_data_size );
-	}
+		*data = GUINT32_FROM_BE(val);
+	if ( monitor_size )
+		ctx->data_size -= sizeof(*data);
 	return TRUE;
 }
 
-// As each component is 8bit - no need to cater for endian in this type
-static gboolean read_field_t ( FILE *ff, field_t *data )
+// Move on over data that is not used
+static gboolean skip_bytes ( fit_context_t *ctx, gsize len )
 {
-	if ( fread(data, 1, sizeof(*data), ff) != sizeof(*data))
+	if ( ctx->pos + len > ctx->size )
 		return FALSE;
-	g_data_size -= sizeof(*data);
-	//g_debug ( "%s: g_data_size=%d", __FUNCTION__, g_data_size );
+	ctx->pos += len;
+	ctx->data_size -= len;
 	return TRUE;
 }
 
-static guint unnamed_waypoints = 0;
-static guint unnamed_tracks = 0;
-static guint unnamed_layers = 0;
-
-// Current ("fit_") objects
-// Easier to have as globals rather than passing around the functions
-static VikTrwLayer *fit_vtl = NULL;
-static VikWaypoint *fit_wp = NULL;
-static VikTrackpoint *fit_tp = NULL;
-static VikTrack *fit_tr = NULL;
-static VikTRWMetadata *fit_md = NULL;
+// As each component is 8bit - no need to cater for endian in this type
+static gboolean read_field_t ( fit_context_t *ctx, field_t *data )
+{
+	if ( ctx->pos + sizeof(*data) > ctx->size )
+		return FALSE;
+	memcpy ( data, ctx->data + ctx->pos, sizeof(*data) );
+	ctx->pos += sizeof(*data);
+	ctx->data_size -= sizeof(*data);
+	return TRUE;
+}
 
-static void fit_add_track ()
+static void fit_add_track ( fit_context_t *ctx )
 {
-	if ( fit_tr && fit_tr->trackpoints ) {
-		gchar *tr_name = g_strdup_printf ( _("Track%03d"), unnamed_tracks++ );
-		fit_tr->trackpoints = g_list_reverse ( fit_tr->trackpoints );
-		vik_trw_layer_filein_add_track ( fit_vtl, tr_name, fit_tr );
+	if ( ctx->tr ) {
+		if ( ctx->tr->trackpoints ) {
+			ctx->tr->trackpoints = g_list_reverse ( ctx->tr->trackpoints );
+			ctx->tracks = g_list_prepend ( ctx->tracks, ctx->tr );
+		}
+		else
+			vik_track_free ( ctx->tr );
+		ctx->tr = NULL;
 	}
 }
 
@@ -233,15 +284,10 @@ gdouble semi2degrees(gint32 value)
 	return ((gdouble)value / (gdouble)(1U<<31)) * 180.0;
 }
 
-static gboolean f_tr_newseg = FALSE;
-
-static gboolean read_fields ( FILE *ff, int num_fields, int id, int time_offset, VikViewport *vvp )
+static gboolean read_fields ( fit_context_t *ctx, int num_fields, int id )
 {
 	//g_debug ( "%s: fields=%d", __FUNCTION__, num_fields );
-	static guint32 ts = 0;
-	ts = ts + time_offset;
-	static guint32 settings_ts_offset = 0;
-	//static guint32 last_ts = 0;
+	mesg_def_t *def = &ctx->defs[id];
 	// c.f. 'FIT_RECORD_MESG'
 	gint32 lat = FIT_SINT32_INVALID;
 	gint32 lon = FIT_SINT32_INVALID;
@@ -260,76 +306,73 @@ static gboolean read_fields ( FILE *ff, int num_fields, int id, int time_offset,
 
 	// Read Fields...
 	for ( guint8 ii = 0; ii < num_fields; ii++ ) {
-		field_t field = g_defs[id].fields[ii];
+		field_t field = def->fields[ii];
 		//g_debug ( "%s: field=%d size=%d", __FUNCTION__, ii, field.size );
 
-		guint8 data8;
-		guint16 data16;
-		guint32 data32;
+		guint8 data8 = 0;
+		guint16 data16 = 0;
+		guint32 data32 = 0;
 		gchar* str = NULL;
 		// Read per indicated type
 		//  and then depending on the size
 		//   whether a singular or multiple of that type
+		// ATM means if array of them we only use the final one,
+		//  so skip over all the preceding values
 		switch ( field.type ) {
 		case FIT_BASE_TYPE_ENUM:
 		case FIT_BASE_TYPE_SINT8:
 		case FIT_BASE_TYPE_UINT8:
 		case FIT_BASE_TYPE_UINT8Z:
-			// ATM means if array of them we only use the final one
-			for (guint8 jj = 0; jj < field.size; jj++)
-				if ( !read_uint8(ff, &data8, TRUE) ) return FALSE;
+			if ( field.size ) {
+				if ( !skip_bytes(ctx, field.size-1) ) return FALSE;
+				if ( !read_uint8(ctx, &data8, TRUE) ) return FALSE;
+			}
 			break;
 		case FIT_BASE_TYPE_SINT16:
 		case FIT_BASE_TYPE_UINT16:
 			// Maybe should check field.size is rem 2
-			for (guint8 jj = 0; jj < field.size/2; jj++)
-				if ( !read_uint16(ff, &data16, g_defs[id].arch, TRUE) ) return FALSE;
+			if ( field.size/2 ) {
+				if ( !skip_bytes(ctx, (field.size/2-1)*2) ) return FALSE;
+				if ( !read_uint16(ctx, &data16, def->arch, TRUE) ) return FALSE;
+			}
 			break;
 		case FIT_BASE_TYPE_STRING:
-			{
-				str = g_malloc0(field.size+1); // Ensure null terminator
-				if ( !str ) {
-					g_warning ( "%s: Unable to allocate memory of size %d ", __FUNCTION__, field.size );
-					return FALSE;
-				}
-				for (guint8 jj = 0; jj < field.size; jj++)
-					if ( !read_uint8(ff, (guint8*)&str[jj], TRUE) ) return FALSE;
-			}
+			if ( ctx->pos + field.size > ctx->size )
+				return FALSE;
+			str = g_strndup ( (const gchar*)ctx->data + ctx->pos, field.size ); // Ensure null terminator
+			(void)skip_bytes ( ctx, field.size );
 			break;
 		case FIT_BASE_TYPE_SINT32:
 		case FIT_BASE_TYPE_UINT32:
 		case FIT_BASE_TYPE_FLOAT32:
 		case FIT_BASE_TYPE_UINT32Z:
 			// Maybe should check field.size is rem 4
-			for (guint8 jj = 0; jj < field.size/4; jj++)
-				if ( !read_uint32(ff, &data32, g_defs[id].arch, TRUE) ) return FALSE;
+			if ( field.size/4 ) {
+				if ( !skip_bytes(ctx, (field.size/4-1)*4) ) return FALSE;
+				if ( !read_uint32(ctx, &data32, def->arch, TRUE) ) return FALSE;
+			}
 			break;
 		default:
 			// So basically ignore them
-			for (guint8 jj = 0; jj < field.size; jj++)
-				if ( !read_uint8(ff, &data8, TRUE) ) return FALSE;
+			if ( !skip_bytes(ctx, field.size) ) return FALSE;
 			break;
 		}
 
 		// PARSE FIELDS
 
 		// Is 'File Id Message'
-		if ( g_defs[id].mesg_id == FIT_MESG_NUM_FILE_ID ) {
+		if ( def->mesg_id == FIT_MESG_NUM_FILE_ID ) {
 			if ( field.num == FIT_FILE_ID_FIELD_NUM_TYPE ) {
 				if ( !(data8 == FIT_FILE_ACTIVITY || data8 == FIT_FILE_COURSE) ) {
 					// Ignore
 					g_warning ( "%s: Fit File Id Type=%d not supported", __FUNCTION__, data8 );
 				} else {
-					// If existing track, add to layer and then create new track
-					if ( fit_tr )
-						fit_add_track();
-					fit_vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, vvp, FALSE ));
-					// Always force V1.1, since we may read in 'extended' data like cadence, etc...
-					vik_trw_layer_set_gpx_version ( fit_vtl, GPX_V1_1 );
-					fit_md = vik_trw_metadata_new();
-					fit_tr = vik_track_new ();
+					// If existing track, keep it and then create new track
+					fit_add_track ( ctx );
+					ctx->supported = TRUE;
+					ctx->tr = vik_track_new ();
 					if ( data8 == FIT_FILE_COURSE )
-						fit_tr->is_route = TRUE;
+						ctx->tr->is_route = TRUE;
 				}
 			}
 
@@ -348,12 +391,12 @@ static gboolean read_fields ( FILE *ff, int num_fields, int id, int time_offset,
 				g_free ( msg );
 				g_date_time_unref ( gdt );
 #endif
-				settings_ts_offset = data32;
+				ctx->settings_ts_offset = data32;
 			}
 		}
 
 		// Main track information
-		if ( g_defs[id].mesg_id == FIT_MESG_NUM_RECORD ) {
+		if ( def->mesg_id == FIT_MESG_NUM_RECORD ) {
 			if ( field.num == FIT_RECORD_FIELD_NUM_POSITION_LAT && field.size == 4 )
 				lat = (gint32)data32;
 
@@ -391,7 +434,7 @@ static gboolean read_fields ( FILE *ff, int num_fields, int id, int time_offset,
 
 		}
 
-		if ( g_defs[id].mesg_id == FIT_MESG_NUM_EVENT ) {
+		if ( def->mesg_id == FIT_MESG_NUM_EVENT ) {
 			// ATM I can't work out the event nums in the SDK
 			if ( field.num == 0 && field.size == 1 ) {
 				event = data8;
@@ -401,7 +444,7 @@ static gboolean read_fields ( FILE *ff, int num_fields, int id, int time_offset,
 			}
 		}
 
-		if ( g_defs[id].mesg_id == FIT_MESG_NUM_COURSE_POINT ) {
+		if ( def->mesg_id == FIT_MESG_NUM_COURSE_POINT ) {
 			if ( field.num == FIT_COURSE_POINT_FIELD_NUM_TIMESTAMP && field.size == 4 ) {
 				timestamp = data32;
 			}
@@ -411,8 +454,10 @@ static gboolean read_fields ( FILE *ff, int num_fields, int id, int time_offset,
 			if ( field.num == FIT_COURSE_POINT_FIELD_NUM_POSITION_LONG && field.size == 4 )
 				lon = (gint32)data32;
 
-			if ( field.num == FIT_COURSE_POINT_FIELD_NUM_NAME )
+			if ( field.num == FIT_COURSE_POINT_FIELD_NUM_NAME && str ) {
+				g_free ( name );
 				name = g_strdup ( str );
+			}
 
 			if ( field.num == FIT_COURSE_POINT_FIELD_NUM_TYPE && field.size == 1 )
 				eventtype = data8;
@@ -420,228 +465,170 @@ static gboolean read_fields ( FILE *ff, int num_fields, int id, int time_offset,
 
 		//if ( field.type == FIT_BASE_TYPE_STRING )
 		//	g_debug ( "%s: String=%s", __FUNCTION__, str );
-		if ( str ) g_free ( str );
+		g_free ( str );
 	}
 
 	// PARSE DATA from the collected field info
 	// Events before tracks, as we insert this into the trackpoint
-	if ( g_defs[id].mesg_id == FIT_MESG_NUM_EVENT ) {
+	if ( def->mesg_id == FIT_MESG_NUM_EVENT ) {
 		if ( event == FIT_EVENT_TIMER && eventtype == FIT_EVENT_TYPE_START ) {
-			f_tr_newseg = TRUE;
+			ctx->newseg = TRUE;
 			g_debug ( "%s: NEWSEGMENT EVENT", __FUNCTION__ );
 		}
 	}
 
 	// Main track information
-	if ( g_defs[id].mesg_id == FIT_MESG_NUM_RECORD ) {
+	// (Only once the File Id has been seen, as otherwise there is no track)
+	if ( def->mesg_id == FIT_MESG_NUM_RECORD && ctx->tr ) {
 		if ( lat != FIT_SINT32_INVALID && lon != FIT_SINT32_INVALID ) {
-			fit_tp = vik_trackpoint_new ();
+			VikTrackpoint *tp = vik_trackpoint_new ();
 			struct LatLon fit_ll;
 			fit_ll.lat = semi2degrees ( lat );
 			fit_ll.lon = semi2degrees ( lon );
-			vik_coord_load_from_latlon ( &(fit_tp->coord), vik_trw_layer_get_coord_mode(fit_vtl), &fit_ll );
-			if ( f_tr_newseg ) {
-				fit_tp->newsegment = f_tr_newseg;
-				f_tr_newseg = FALSE; // Reset
+			// Converted to the layer's coordinate mode (if necessary) when added to it
+			vik_coord_load_from_latlon ( &(tp->coord), VIK_COORD_LATLON, &fit_ll );
+			if ( ctx->newseg ) {
+				tp->newsegment = ctx->newseg;
+				ctx->newseg = FALSE; // Reset
 			}
 
 			if ( alt != FIT_UINT16_INVALID )
 				// Encoded as "5 * m + 500" (for both normal and enhanced), thus apply the reverse
-				fit_tp->altitude = (alt / 5.0) - 500;
+				tp->altitude = (alt / 5.0) - 500;
 
 			if ( timestamp != FIT_UINT32_INVALID ) {
 				guint32 ts = timestamp;
 				if ( timestamp < FIT_DATE_TIME_MIN )
-					ts = ts + settings_ts_offset;
-				//last_ts = ts;
+					ts = ts + ctx->settings_ts_offset;
 				gint64 ts64 = (gint64)ts + (gint64)FIT_EPOCH_OFFSET;
-#if GLIB_CHECK_VERSION(2,62,0)
-				//GDateTime* gdt = g_date_time_new_from_unix_utc ( ts64 );
-				//gchar* msg = g_date_time_format_iso8601 ( gdt );
-				//g_printf ( "%s: [%d] time=%s\n", __FUNCTION__, timestamp, msg );
-				//g_free ( msg );
-				//g_date_time_unref ( gdt );
-#endif
-				fit_tp->timestamp = (gdouble)ts64;
+				tp->timestamp = (gdouble)ts64;
 			}
 
 			// Both normal and enhanced
 			if ( speed != FIT_UINT16_INVALID )
-				fit_tp->speed = (speed / 1000.0);
+				tp->speed = (speed / 1000.0);
 
 			if ( hr != FIT_UINT8_INVALID )
-				fit_tp->heart_rate = hr;
+				tp->heart_rate = hr;
 
 			if ( cad != FIT_UINT8_INVALID )
-				fit_tp->cadence = cad;
+				tp->cadence = cad;
 
 			if ( temp != FIT_SINT8_INVALID )
-				fit_tp->temp = temp;
+				tp->temp = temp;
 
 			if ( pow != FIT_UINT16_INVALID )
-				fit_tp->power = pow;
+				tp->power = pow;
 
-			fit_tr->trackpoints = g_list_prepend ( fit_tr->trackpoints, fit_tp );
+			ctx->tr->trackpoints = g_list_prepend ( ctx->tr->trackpoints, tp );
 		}
 	}
 
 	// Waypoints
-	if ( g_defs[id].mesg_id == FIT_MESG_NUM_COURSE_POINT ) {
+	if ( def->mesg_id == FIT_MESG_NUM_COURSE_POINT && ctx->supported ) {
 		if ( lat != FIT_SINT32_INVALID && lon != FIT_SINT32_INVALID ) {
-			fit_wp = vik_waypoint_new ();
+			fit_waypoint_t *fwp = g_malloc ( sizeof(fit_waypoint_t) );
+			fwp->wp = vik_waypoint_new ();
 			struct LatLon fit_ll;
 			fit_ll.lat = semi2degrees ( lat );
 			fit_ll.lon = semi2degrees ( lon );
-			vik_coord_load_from_latlon ( &(fit_wp->coord), vik_trw_layer_get_coord_mode(fit_vtl), &fit_ll );
-			gchar* wp_name = name;
-			if ( !wp_name )
-				wp_name = g_strdup_printf ( _("Waypoint%04d"), unnamed_waypoints++ );
-			if ( eventtype != FIT_UINT8_INVALID )
-				fit_waypoint_symbol ( fit_wp, eventtype );
-			vik_trw_layer_filein_add_waypoint ( fit_vtl, wp_name, fit_wp );
+			vik_coord_load_from_latlon ( &(fwp->wp->coord), VIK_COORD_LATLON, &fit_ll );
+			fwp->name = name;
+			name = NULL;
+			if ( !fwp->name )
+				fwp->name = g_strdup_printf ( _("Waypoint%04d"), ctx->unnamed_waypoints++ );
+			// Symbol lookup may load icons, so it is left until added to the layer
+			fwp->type = eventtype;
+			ctx->waypoints = g_list_prepend ( ctx->waypoints, fwp );
 		}
 	}
+	g_free ( name );
 
 	return TRUE;
 }
 
-static gboolean read_data ( FILE *ff, int id, int time_offset, VikViewport *vvp )
+static gboolean read_data_msg ( fit_context_t *ctx, int local_id )
 {
 	// Read This mesg type...
-	//g_debug ( "%s: id=%d - mesg id=%d", __FUNCTION__, id, g_defs[id].mesg_id );
-	if ( g_defs[id].reserved )
-		return read_fields ( ff, g_defs[id].num_fields, id, time_offset, vvp );
+	//g_debug ( "%s: id=%d - mesg id=%d", __FUNCTION__, local_id, ctx->defs[local_id].mesg_id );
+	if ( ctx->defs[local_id].reserved )
+		return read_fields ( ctx, ctx->defs[local_id].num_fields, local_id );
 	else {
-		g_warning ( "%s: Data id %d encountered before definition", __FUNCTION__, id );
+		g_warning ( "%s: Data id %d encountered before definition", __FUNCTION__, local_id );
 		return FALSE;
 	}
 }
 
-static gboolean read_data_msg ( FILE *ff, guint8 header, int time_offset, VikViewport *vvp )
-{
-	int local_id = header & FIT_HDR_TYPE_MASK;
-	//g_debug ( "%s: id=%d ", __FUNCTION__, local_id );
-	if ( local_id > FIT_HDR_TYPE_MASK )
-	{
-		g_warning ( "%s: id=%d is bigger than maximum allowed %d", __FUNCTION__, local_id, FIT_HDR_TYPE_MASK);
-		return FALSE;
-	}
-
-	return read_data ( ff, local_id, time_offset, vvp );
-}
-
-static gboolean read_msg_type_def ( FILE *ff, guint8 header )
+static gboolean read_msg_type_def ( fit_context_t *ctx, guint8 header )
 {
 	int local_id = header & FIT_HDR_TYPE_MASK;
+	mesg_def_t *def = &ctx->defs[local_id];
 
 	// Instead of trying to read mesg_def_t;
 	// Do one by one
 	guint8 reserved; // Read byte from file but otherwise basically ignore
-	if ( !read_uint8(ff, &reserved, TRUE) ) return FALSE;
+	if ( !read_uint8(ctx, &reserved, TRUE) ) return FALSE;
 	// Use internally as whether this message id been 'defined' yet
 	// Messages can be redefined according to FIT protocol
 	// Normally not done, but perhaps if the file needs to store more message types than FIT_MAX_LOCAL_MESGS allows
 	//  then the only way is to override a previous definition
-	if ( g_defs[local_id].reserved )
+	if ( def->reserved )
 		g_debug ( "%s: ID [%d] REDEFINED!!", __FUNCTION__, local_id );
-	g_defs[local_id].reserved = TRUE;
+	def->reserved = TRUE;
 
-	if ( !read_uint8(ff, &g_defs[local_id].arch, TRUE) ) return FALSE;
+	if ( !read_uint8(ctx, &def->arch, TRUE) ) return FALSE;
 
-	if ( !read_uint16(ff, &g_defs[local_id].mesg_id, g_defs[local_id].arch, TRUE) ) return FALSE;
+	if ( !read_uint16(ctx, &def->mesg_id, def->arch, TRUE) ) return FALSE;
 
-	g_debug ( "%s: Defining id=%u as %u", __FUNCTION__, local_id, g_defs[local_id].mesg_id );
+	g_debug ( "%s: Defining id=%u as %u", __FUNCTION__, local_id, def->mesg_id );
 
-	if ( !read_uint8(ff, &g_defs[local_id].num_fields, TRUE) ) return FALSE;
+	if ( !read_uint8(ctx, &def->num_fields, TRUE) ) return FALSE;
 
-	field_t *fields = g_malloc0 ( sizeof(field_t) * g_defs[local_id].num_fields );
-	g_defs[local_id].fields = fields;
+	g_free ( def->fields );
+	def->fields = g_malloc0 ( sizeof(field_t) * def->num_fields );
 
-	for ( guint ii = 0; ii < g_defs[local_id].num_fields; ii++ ) {
-		if ( !read_field_t(ff, &fields[ii]) ) return FALSE;
-		//g_debug ( "%s: Field[%d] num, size, type= %d %d 0x%02x", __FUNCTION__, ii, fields[ii].num, fields[ii].size, fields[ii].type );
+	for ( guint ii = 0; ii < def->num_fields; ii++ ) {
+		if ( !read_field_t(ctx, &def->fields[ii]) ) return FALSE;
+		//g_debug ( "%s: Field[%d] num, size, type= %d %d 0x%02x", __FUNCTION__, ii, def->fields[ii].num, def->fields[ii].size, def->fields[ii].type );
 	}
 
 	if ( header & FIT_HDR_DEV_DATA_BIT ) {
 		guint8 dev_num_fields;
-		if ( !read_uint8(ff, &dev_num_fields, TRUE) ) return FALSE;
+		if ( !read_uint8(ctx, &dev_num_fields, TRUE) ) return FALSE;
 		//g_debug ( "%s: dev_num_fields=%d", __FUNCTION__, dev_num_fields );
 
-		// Read in one block and otherwise ignore
-		gchar *dev_buffer = g_malloc ( sizeof(field_t)*dev_num_fields );
-		if ( fread(dev_buffer, 1, sizeof(field_t)*dev_num_fields, ff) != sizeof(field_t)*dev_num_fields )
-			return FALSE;
-		g_data_size -= sizeof(field_t)*dev_num_fields;
-		//g_debug ( "%s: g_data_size=%d", __FUNCTION__, g_data_size );
+		// Otherwise ignored
+		if ( !skip_bytes(ctx, sizeof(field_t)*dev_num_fields) ) return FALSE;
 	}
 
 	return TRUE;
 }
 
-static gboolean read_compressed_time_rec ( FILE *ff, guint8 header, VikViewport *vvp )
-{
-	//g_debug ( "%s: ", __FUNCTION__ );
-	return read_data_msg ( ff, header, header & FIT_HDR_TIME_OFFSET_MASK, vvp );
-}
-
-static gboolean read_record ( FILE *ff, VikViewport *vvp )
+static gboolean read_record ( fit_context_t *ctx )
 {
 	// Data/Msg Header is 1 byte
 	guint8 header;
-	if ( !read_uint8(ff, &header, TRUE) ) return FALSE;
+	if ( !read_uint8(ctx, &header, TRUE) ) return FALSE;
 
+	// Compressed timestamp header - only local message types 0..3 are possible
+	//  (the time offset is not used, as only full timestamps are processed)
 	if ( header & FIT_HDR_TIME_REC_BIT )
-		return read_compressed_time_rec ( ff, header, vvp );
+		return read_data_msg ( ctx, (header & FIT_HDR_TIME_TYPE_MASK) >> FIT_HDR_TIME_TYPE_SHIFT );
 	// Otherwise 'Normal' header kinds:
 	else if ( header & FIT_HDR_TYPE_DEF_BIT )
-		return read_msg_type_def ( ff, header );
+		return read_msg_type_def ( ctx, header );
 	else
-		return read_data_msg ( ff, header, 0, vvp );
+		return read_data_msg ( ctx, header & FIT_HDR_TYPE_MASK );
 }
 
-static header_t read_header ( FILE *ff )
-{
-	header_t header = { 0, 0, 0, 0, 0 };
-	// Very simple if on a Little Endian machine as all multi-byte
-	//  values are by protocol definition in LE order,
-	//  so can just map the entire header structure in one go. e.g.:
-	//fread ( &header, 1, sizeof(header), ff );
-
-	// However to be fully compatible...
-
-	// Annoyingly compiler warns about taking address of packed member of 'struct <anonymous>' may result in an unaligned pointer value
-	// so repeat variables and assign at the end, instead of using struct directly
-	guint8 header_size;
-	guint8 protocol_version;
-	guint16 profile_version;
-	guint32 data_size;
-	guint32 magic;
-	if ( !read_uint8(ff, &header_size, FALSE) ) goto FAIL;
-	if ( !read_uint8(ff, &protocol_version, FALSE) ) goto FAIL;
-	if ( !read_uint16(ff, &profile_version, FIT_ARCH_ENDIAN_LITTLE, FALSE) ) goto FAIL;
-	if ( !read_uint32(ff, &data_size, FIT_ARCH_ENDIAN_LITTLE, FALSE) ) goto FAIL;
-	if ( !read_uint32(ff, &magic, FIT_ARCH_ENDIAN_LITTLE, FALSE) ) goto FAIL;
-	header.header_size = header_size;
-	header.protocol_version = protocol_version;
-	header.profile_version = profile_version;
-	header.data_size = data_size;
-	header.magic = magic;
-	goto FINISH;
-FAIL:
-	g_warning ( "%s: Read Header failed", __FUNCTION__ );
-	header.data_size = 0;
-FINISH:
-	return header;
-}
-
-header_t get_header ( FILE *ff )
+static header_t get_header ( fit_context_t *ctx )
 {
 	header_t header = { 0, 0, 0, 0, 0 };
 
 	// NB very first byte is the size of the Header
 	// Check header size is as we support
 	guint8 hdr_size;
-	if ( fread(&hdr_size, 1, sizeof(hdr_size), ff) != sizeof(hdr_size) ) {
+	if ( !read_uint8(ctx, &hdr_size, FALSE) ) {
 		g_warning ( "%s: Header read failure", __FUNCTION__ );
 		return header;
 	}
@@ -649,17 +636,31 @@ header_t get_header ( FILE *ff )
 	// Allow for a missing CRC
 	if ( hdr_size == FIT_HEADER_SIZE || (hdr_size == FIT_HEADER_SIZE+2) ) {
 
-		rewind ( ff );
-		// NB Should not fail as already performed a_fit_check_magic()
-		header = read_header ( ff );
-		if ( header.data_size == 0 )
+		// All multi-byte values are by protocol definition in LE order
+		// NB Annoyingly compiler warns about taking address of packed member of 'struct <anonymous>'
+		//  so read into separate variables and assign at the end, instead of using struct directly
+		guint8 protocol_version;
+		guint16 profile_version;
+		guint32 data_size;
+		guint32 magic;
+		if ( !read_uint8(ctx, &protocol_version, FALSE) ||
+		     !read_uint16(ctx, &profile_version, FIT_ARCH_ENDIAN_LITTLE, FALSE) ||
+		     !read_uint32(ctx, &data_size, FIT_ARCH_ENDIAN_LITTLE, FALSE) ||
+		     !read_uint32(ctx, &magic, FIT_ARCH_ENDIAN_LITTLE, FALSE) ) {
+			g_warning ( "%s: Read Header failed", __FUNCTION__ );
 			return header;
+		}
+		header.header_size = hdr_size;
+		header.protocol_version = protocol_version;
+		header.profile_version = profile_version;
+		header.data_size = data_size;
+		header.magic = magic;
 
 		// Does it have the CRC?
 		if ( hdr_size > FIT_HEADER_SIZE ) {
 
 			guint16 crc;
-			if ( !read_uint16(ff, &crc, FIT_ARCH_ENDIAN_LITTLE, FALSE) ) {
+			if ( !read_uint16(ctx, &crc, FIT_ARCH_ENDIAN_LITTLE, FALSE) ) {
 				g_warning ( "%s: Read CRC failed", __FUNCTION__ );
 				// Fake the data size so caller can detect failure.
 				header.data_size = 0;
@@ -668,23 +669,11 @@ header_t get_header ( FILE *ff )
 			g_debug ( "%s: HAS CRC = %d", __FUNCTION__, crc );
 			// Check the CRC if it is not 0 (which is allowed)
 			if ( crc != 0 ) {
-				guint16 hh = 0;
-				rewind ( ff );
-				for ( guint8 ii = 0; ii < FIT_HEADER_SIZE; ii++ ) {
-					guint8 byte;
-					if ( !read_uint8(ff, &byte, FALSE) ) {
-						g_warning ( "%s: CRC check reading failed", __FUNCTION__ );
-						header.data_size = 0;
-						return header;
-					}
-					hh = FitCRC_Get16 ( hh, byte );
-				};
+				guint16 hh = fit_crc ( 0, ctx->data, FIT_HEADER_SIZE );
 				// Only warn, carry on to attempt to read the file even if CRC value not as expected
 				if ( hh != crc ) {
 					g_warning ( "%s: Header CRC check failure: expected=%d vs calculated= %d", __FUNCTION__, crc, hh );
 				}
-				// Return to end of header
-				(void)fseek ( ff, hdr_size, SEEK_SET );
 			}
 		}
 	} else
@@ -692,41 +681,98 @@ header_t get_header ( FILE *ff )
 	return header;
 }
 
+/**
+ * Check the CRC at the end of the file, which covers both the header and the data records
+ */
+static void check_file_crc ( fit_context_t *ctx, header_t *header, const gchar *filename )
+{
+	gsize len = (gsize)header->header_size + header->data_size;
+	if ( len + 2 > ctx->size ) {
+		g_warning ( "%s: %s is truncated - no CRC", __FUNCTION__, filename );
+		return;
+	}
+	guint16 crc = ctx->data[len] | (ctx->data[len+1] << 8);
+	guint16 calc = fit_crc ( 0, ctx->data, len );
+	// Only warn, as whatever can be read is still potentially useful
+	if ( calc != crc )
+		g_warning ( "%s: %s CRC check failure: expected=%d vs calculated= %d", __FUNCTION__, filename, crc, calc );
+}
+
+static fit_context_t *fit_context_new ( void )
+{
+	fit_context_t *ctx = g_malloc0 ( sizeof(fit_context_t) );
+	ctx->unnamed_waypoints = 1;
+	return ctx;
+}
+
+static void fit_context_free ( fit_context_t *ctx )
+{
+	for ( guint ii = 0; ii < FIT_MAX_LOCAL_MESGS; ii++ )
+		g_free ( ctx->defs[ii].fields );
+	if ( ctx->tr )
+		vik_track_free ( ctx->tr );
+	g_list_free_full ( ctx->tracks, (GDestroyNotify)vik_track_free );
+	for ( GList *iter = ctx->waypoints; iter; iter = iter->next ) {
+		fit_waypoint_t *fwp = iter->data;
+		vik_waypoint_free ( fwp->wp );
+		g_free ( fwp->name );
+		g_free ( fwp );
+	}
+	g_list_free ( ctx->waypoints );
+	if ( ctx->mf )
+		g_mapped_file_unref ( ctx->mf );
+	if ( ctx->contents )
+		g_byte_array_free ( ctx->contents, TRUE );
+	g_free ( ctx );
+}
 
 /**
- * Returns TRUE on a successful file read
- *   NB The file of course could contain no actual geo data that we can use!
- * NB2 Filename is used in case a name from within the file itself can not be found
- *   as file access is via the FILE* stream methods
+ * Map the file into memory, or otherwise read it all in from the stream
  */
-gboolean a_fit_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, const gchar* filename )
+static gboolean fit_context_load ( fit_context_t *ctx, FILE *ff, const gchar *filename )
 {
-	gboolean ans = FALSE;
+	ctx->mf = g_mapped_file_new ( filename, FALSE, NULL );
+	if ( ctx->mf ) {
+		ctx->data = (const guint8*)g_mapped_file_get_contents ( ctx->mf );
+		ctx->size = g_mapped_file_get_length ( ctx->mf );
+		return TRUE;
+	}
+	if ( !ff )
+		return FALSE;
 
-	for ( guint8 ii = 0; ii < FIT_HDR_TYPE_MASK+1; ii++ )
-		g_defs[ii].reserved = FALSE;
+	ctx->contents = g_byte_array_new ();
+	guint8 buf[65536];
+	size_t len;
+	while ( (len = fread(buf, 1, sizeof(buf), ff)) > 0 )
+		g_byte_array_append ( ctx->contents, buf, len );
+	ctx->data = ctx->contents->data;
+	ctx->size = ctx->contents->len;
+	return TRUE;
+}
 
-	header_t header = get_header ( ff );
+/**
+ * Decode all the records
+ * This does not touch any layers, thus is safe to run in any thread
+ */
+static gboolean fit_context_decode ( fit_context_t *ctx, const gchar *filename )
+{
+	header_t header = get_header ( ctx );
 	g_debug ( "%s: Protocol=%d", __FUNCTION__, header.protocol_version );
 	g_debug ( "%s: Profile=%d", __FUNCTION__, header.profile_version );
 	g_debug ( "%s: Data size=%d", __FUNCTION__, header.data_size );
+	if ( header.data_size == 0 )
+		return FALSE;
 
-	unnamed_waypoints = 1;
-	unnamed_tracks = 1;
-	unnamed_layers = 1;
-	f_tr_newseg = FALSE;
+	check_file_crc ( ctx, &header, filename );
 
-	fit_vtl = NULL;
-	fit_tp = NULL;
-	fit_wp = NULL;
-	fit_tr = NULL;
-	fit_md = NULL;
+	// Records follow on from the header, whatever size it is
+	ctx->pos = header.header_size;
 
 	// Keep decoding until nothing left
-	g_data_size = header.data_size;
-	while ( g_data_size ) {
-		if ( !read_record(ff, vvp) ) {
-			g_warning ( "%s: data size not read =%d", __FUNCTION__, g_data_size );
+	ctx->data_size = header.data_size;
+	while ( ctx->data_size ) {
+		if ( !read_record(ctx) ) {
+			g_warning ( "%s: data size not read =%d", __FUNCTION__, ctx->data_size );
 			return FALSE;
 		}
 	}
@@ -734,24 +780,136 @@ gboolean a_fit_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, c
 	// TODO - support 'chained' fit files.
 	// Not found any examples to test with, so probably would end up with multiple tracks,
 	//  rather than say mulitple TRW layers, however that should be good enough.
-	if ( fit_vtl ) {
-		fit_add_track ();
-		if ( vik_trw_layer_is_empty(fit_vtl) ) {
-			// free up layer
-			g_warning ( "%s: No useable geo data found in %s", __FUNCTION__, vik_layer_get_name(VIK_LAYER(fit_vtl)) );
-			g_object_unref ( fit_vtl );
-		} else {
-			// Add it
-			gchar *name = g_strdup_printf ( "%s", a_file_basename(filename) );
-			vik_layer_rename ( VIK_LAYER(fit_vtl), name );
-			g_free ( name );
-			vik_layer_post_read ( VIK_LAYER(fit_vtl), vvp, TRUE );
-			vik_aggregate_layer_add_layer ( val, VIK_LAYER(fit_vtl), FALSE );
-			vik_trw_layer_set_metadata ( fit_vtl, fit_md );
-			vik_trw_layer_auto_set_view ( fit_vtl, vvp );
-			ans = TRUE;
-		}
+	fit_add_track ( ctx );
+	return TRUE;
+}
+
+/**
+ * Put the decoded data into a new layer
+ * Must be run in the main thread
+ */
+static gboolean fit_context_finish ( fit_context_t *ctx, VikAggregateLayer *val, VikViewport *vvp, const gchar *filename )
+{
+	if ( !ctx->supported )
+		return FALSE;
+
+	VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, vvp, FALSE ));
+	// Always force V1.1, since we may read in 'extended' data like cadence, etc...
+	vik_trw_layer_set_gpx_version ( vtl, GPX_V1_1 );
+	VikCoordMode mode = vik_trw_layer_get_coord_mode ( vtl );
+
+	guint unnamed_tracks = 1;
+	ctx->tracks = g_list_reverse ( ctx->tracks );
+	for ( GList *iter = ctx->tracks; iter; iter = iter->next ) {
+		VikTrack *trk = VIK_TRACK(iter->data);
+		if ( mode != VIK_COORD_LATLON )
+			vik_track_convert ( trk, mode );
+		gchar *tr_name = g_strdup_printf ( _("Track%03d"), unnamed_tracks++ );
+		vik_trw_layer_filein_add_track ( vtl, tr_name, trk );
+		g_free ( tr_name );
+	}
+	g_list_free ( ctx->tracks );
+	ctx->tracks = NULL;
+
+	ctx->waypoints = g_list_reverse ( ctx->waypoints );
+	for ( GList *iter = ctx->waypoints; iter; iter = iter->next ) {
+		fit_waypoint_t *fwp = iter->data;
+		if ( mode != VIK_COORD_LATLON )
+			vik_coord_convert ( &(fwp->wp->coord), mode );
+		if ( fwp->type != FIT_UINT8_INVALID )
+			fit_waypoint_symbol ( fwp->wp, fwp->type );
+		vik_trw_layer_filein_add_waypoint ( vtl, fwp->name, fwp->wp );
+		g_free ( fwp->name );
+		g_free ( fwp );
+	}
+	g_list_free ( ctx->waypoints );
+	ctx->waypoints = NULL;
+
+	if ( vik_trw_layer_is_empty(vtl) ) {
+		// free up layer
+		g_warning ( "%s: No useable geo data found in %s", __FUNCTION__, vik_layer_get_name(VIK_LAYER(vtl)) );
+		g_object_unref ( vtl );
+		return FALSE;
 	}
 
+	// Add it
+	gchar *name = g_strdup_printf ( "%s", a_file_basename(filename) );
+	vik_layer_rename ( VIK_LAYER(vtl), name );
+	g_free ( name );
+	vik_layer_post_read ( VIK_LAYER(vtl), vvp, TRUE );
+	vik_aggregate_layer_add_layer ( val, VIK_LAYER(vtl), FALSE );
+	vik_trw_layer_set_metadata ( vtl, vik_trw_metadata_new() );
+	vik_trw_layer_auto_set_view ( vtl, vvp );
+	return TRUE;
+}
+
+/**
+ * Returns TRUE on a successful file read
+ *   NB The file of course could contain no actual geo data that we can use!
+ * NB2 Filename is used in case a name from within the file itself can not be found
+ *   and to map the file into memory, with the FILE* stream as the fallback
+ */
+gboolean a_fit_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, const gchar* filename )
+{
+	gboolean ans = FALSE;
+	fit_context_t *ctx = fit_context_new ();
+	if ( fit_context_load(ctx, ff, filename) )
+		if ( fit_context_decode(ctx, filename) )
+			ans = fit_context_finish ( ctx, val, vvp, filename );
+	fit_context_free ( ctx );
 	return ans;
 }
+
+typedef struct {
+	const gchar *filename;
+	fit_context_t *ctx;
+	gboolean decoded;
+} fit_job_t;
+
+static void fit_decode_job ( fit_job_t *job, gpointer user_data )
+{
+	job->ctx = fit_context_new ();
+	if ( fit_context_load(job->ctx, NULL, job->filename) )
+		job->decoded = fit_context_decode ( job->ctx, job->filename );
+	else
+		g_warning ( "%s: Unable to open %s", __FUNCTION__, job->filename );
+}
+
+/**
+ * a_fit_read_files:
+ * @filenames: A #GSList of FIT filenames
+ *
+ * Decode several FIT files at once (e.g. a folder of activities),
+ *  spread across the available processors.
+ * Each file that has usable data is put into its own layer,
+ *  with the layers added in the same order as the list.
+ *
+ * Returns: The number of files successfully loaded
+ */
+guint a_fit_read_files ( VikAggregateLayer *val, VikViewport *vvp, GSList *filenames )
+{
+	guint num = g_slist_length ( filenames );
+	if ( !num )
+		return 0;
+
+	fit_job_t *jobs = g_new0 ( fit_job_t, num );
+	GThreadPool *pool = g_thread_pool_new ( (GFunc)fit_decode_job, NULL, MIN(util_get_number_of_cpus(), num), FALSE, NULL );
+	guint ii = 0;
+	for ( GSList *iter = filenames; iter; iter = iter->next, ii++ ) {
+		jobs[ii].filename = iter->data;
+		g_thread_pool_push ( pool, &jobs[ii], NULL );
+	}
+	// Wait for all to be decoded
+	g_thread_pool_free ( pool, FALSE, TRUE );
+
+	guint loaded = 0;
+	for ( ii = 0; ii < num; ii++ ) {
+		if ( jobs[ii].decoded ) {
+			if ( fit_context_finish(jobs[ii].ctx, val, vvp, jobs[ii].filename) )
+				loaded++;
+		}
+		fit_context_free ( jobs[ii].ctx );
+	}
+	g_free ( jobs );
+	return loaded;
+}
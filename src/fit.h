@@ -30,6 +30,8 @@ G_BEGIN_DECLS
 
 gboolean a_fit_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, const gchar* filename );
 
+guint a_fit_read_files ( VikAggregateLayer *val, VikViewport *vvp, GSList *filenames );
+
 gboolean a_fit_check_magic ( FILE *ff );
 
 G_END_DECLS
@@ -26,166 +26,502 @@
 #include "gpx.h"
 #include "globals.h"
 #include "vikwindow.h"
+#include "coords.h"
 
+#include <math.h>
+#include <stdlib.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
 #include <json-glib/json-glib.h>
 
+
+// Output is gathered in memory and handed over to the file in blocks of about this size
+#define GEOJSON_WRITE_BUFFER_SIZE (256*1024)
+
+static void geojson_flush ( GString *gs, FILE *ff, gboolean force )
+{
+	if ( force || gs->len >= GEOJSON_WRITE_BUFFER_SIZE ) {
+		if ( gs->len )
+			(void)fwrite ( gs->str, 1, gs->len, ff );
+		g_string_truncate ( gs, 0 );
+	}
+}
+
+/**
+ * Append the string as a JSON string value (i.e. quoted and escaped)
+ */
+static void geojson_append_string ( GString *gs, const gchar *str )
+{
+	g_string_append_c ( gs, '"' );
+	for ( const guchar *pp = (const guchar*)str; *pp; pp++ ) {
+		switch ( *pp ) {
+		case '"':  g_string_append ( gs, "\\\"" ); break;
+		case '\\': g_string_append ( gs, "\\\\" ); break;
+		case '\n': g_string_append ( gs, "\\n" ); break;
+		case '\r': g_string_append ( gs, "\\r" ); break;
+		case '\t': g_string_append ( gs, "\\t" ); break;
+		default:
+			if ( *pp < 0x20 )
+				g_string_append_printf ( gs, "\\u%04x", *pp );
+			else
+				g_string_append_c ( gs, *pp );
+			break;
+		}
+	}
+	g_string_append_c ( gs, '"' );
+}
+
+static void geojson_append_double ( GString *gs, gdouble value )
+{
+	gchar buf[COORDS_STR_BUFFER_SIZE];
+	a_coords_dtostr_buffer ( value, buf );
+	g_string_append ( gs, buf );
+}
+
+static void geojson_append_time ( GString *gs, gdouble timestamp )
+{
+	GTimeVal tv;
+	tv.tv_sec = timestamp;
+	tv.tv_usec = abs((timestamp-(gint64)timestamp)*G_USEC_PER_SEC);
+	gchar *time_iso8601 = g_time_val_to_iso8601 ( &tv );
+	if ( time_iso8601 )
+		geojson_append_string ( gs, time_iso8601 );
+	else
+		g_string_append ( gs, "null" );
+	g_free ( time_iso8601 );
+}
+
+// Write a ',"key":"value"' property, when there is a value
+static void geojson_append_property ( GString *gs, const gchar *key, const gchar *value )
+{
+	if ( value && value[0] ) {
+		g_string_append_c ( gs, ',' );
+		geojson_append_string ( gs, key );
+		g_string_append_c ( gs, ':' );
+		geojson_append_string ( gs, value );
+	}
+}
+
+// GeoJSON positions are in the 'lon,lat[,ele]' order
+static void geojson_append_position ( GString *gs, const VikCoord *coord, gdouble altitude )
+{
+	struct LatLon ll;
+	vik_coord_to_latlon ( coord, &ll );
+	g_string_append_c ( gs, '[' );
+	geojson_append_double ( gs, ll.lon );
+	g_string_append_c ( gs, ',' );
+	geojson_append_double ( gs, ll.lat );
+	if ( !isnan(altitude) ) {
+		g_string_append_c ( gs, ',' );
+		geojson_append_double ( gs, altitude );
+	}
+	g_string_append_c ( gs, ']' );
+}
+
+static void geojson_write_waypoint ( GString *gs, VikWaypoint *wp )
+{
+	g_string_append ( gs, "{\"type\":\"Feature\",\"properties\":{\"name\":" );
+	geojson_append_string ( gs, wp->name ? wp->name : "" );
+	geojson_append_property ( gs, "cmt", wp->comment );
+	geojson_append_property ( gs, "desc", wp->description );
+	geojson_append_property ( gs, "src", wp->source );
+	geojson_append_property ( gs, "sym", wp->symbol );
+	geojson_append_property ( gs, "type", wp->type );
+	if ( !isnan(wp->timestamp) ) {
+		g_string_append ( gs, ",\"time\":" );
+		geojson_append_time ( gs, wp->timestamp );
+	}
+	g_string_append ( gs, "},\"geometry\":{\"type\":\"Point\",\"coordinates\":" );
+	geojson_append_position ( gs, &wp->coord, wp->altitude );
+	g_string_append ( gs, "}}" );
+}
+
 /**
- * Perform any cleanup actions once program has completed running
+ * Tracks are written as LineStrings, or as MultiLineStrings when there are several segments
+ * Trackpoint times are in the 'coordTimes' property, as togeojson does
  */
-static void my_watch ( GPid pid,
-                       gint status,
-                       gpointer user_data )
+static void geojson_write_track ( GString *gs, VikTrack *trk )
+{
+	gboolean multi = FALSE;
+	gboolean have_times = FALSE;
+	for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+		VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+		if ( tp->newsegment && iter != trk->trackpoints )
+			multi = TRUE;
+		if ( !isnan(tp->timestamp) )
+			have_times = TRUE;
+	}
+
+	g_string_append ( gs, "{\"type\":\"Feature\",\"properties\":{\"name\":" );
+	geojson_append_string ( gs, trk->name ? trk->name : "" );
+	geojson_append_property ( gs, "cmt", trk->comment );
+	geojson_append_property ( gs, "desc", trk->description );
+	geojson_append_property ( gs, "src", trk->source );
+	geojson_append_property ( gs, "type", trk->type );
+	geojson_append_property ( gs, "_gpxType", trk->is_route ? "rte" : "trk" );
+	if ( trk->has_color ) {
+		gchar color[8];
+		g_snprintf ( color, sizeof(color), "#%02x%02x%02x", trk->color.red/256, trk->color.green/256, trk->color.blue/256 );
+		geojson_append_property ( gs, "stroke", color );
+	}
+
+	VikTrackpoint *tp_first = vik_track_get_tp_first ( trk );
+	if ( tp_first && !isnan(tp_first->timestamp) ) {
+		g_string_append ( gs, ",\"time\":" );
+		geojson_append_time ( gs, tp_first->timestamp );
+	}
+
+	if ( have_times ) {
+		g_string_append ( gs, multi ? ",\"coordTimes\":[[" : ",\"coordTimes\":[" );
+		for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+			VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+			if ( iter != trk->trackpoints )
+				g_string_append ( gs, (multi && tp->newsegment) ? "],[" : "," );
+			if ( isnan(tp->timestamp) )
+				g_string_append ( gs, "null" );
+			else
+				geojson_append_time ( gs, tp->timestamp );
+		}
+		g_string_append ( gs, multi ? "]]" : "]" );
+	}
+
+	g_string_append ( gs, multi ? "},\"geometry\":{\"type\":\"MultiLineString\",\"coordinates\":[[" :
+	                              "},\"geometry\":{\"type\":\"LineString\",\"coordinates\":[" );
+	for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+		VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+		if ( iter != trk->trackpoints )
+			g_string_append ( gs, (multi && tp->newsegment) ? "],[" : "," );
+		geojson_append_position ( gs, &tp->coord, tp->altitude );
+	}
+	g_string_append ( gs, multi ? "]]}}" : "]}}" );
+}
+
+static gint geojson_waypoint_compare ( gconstpointer aa, gconstpointer bb )
 {
-	g_spawn_close_pid ( pid );
+	return g_strcmp0 ( ((VikWaypoint*)aa)->name, ((VikWaypoint*)bb)->name );
+}
+
+static gint geojson_track_compare ( gconstpointer aa, gconstpointer bb )
+{
+	return g_strcmp0 ( ((VikTrack*)aa)->name, ((VikTrack*)bb)->name );
 }
 
 /**
  * a_geojson_write_file:
  *
+ * Write the layer as a GeoJSON FeatureCollection,
+ *  with one feature per line to keep it reasonably readable.
+ * As for GPX, only the visible kinds of items are written (but including any hidden items).
+ *
  * Returns TRUE if successfully written
  */
 gboolean a_geojson_write_file ( VikTrwLayer *vtl, FILE *ff )
 {
-	gboolean result = FALSE;
+	GString *gs = g_string_sized_new ( GEOJSON_WRITE_BUFFER_SIZE + 4096 );
+	gboolean first = TRUE;
+
+	g_string_append ( gs, "{\"type\":\"FeatureCollection\",\"features\":[" );
+
+	if ( vik_trw_layer_get_waypoints_visibility(vtl) ) {
+		GList *gl = g_hash_table_get_values ( vik_trw_layer_get_waypoints(vtl) );
+		gl = g_list_sort ( gl, geojson_waypoint_compare );
+		for ( GList *iter = gl; iter; iter = iter->next ) {
+			g_string_append ( gs, first ? "\n" : ",\n" );
+			first = FALSE;
+			geojson_write_waypoint ( gs, VIK_WAYPOINT(iter->data) );
+			geojson_flush ( gs, ff, FALSE );
+		}
+		g_list_free ( gl );
+	}
+
+	for ( guint ii = 0; ii < 2; ii++ ) {
+		GHashTable *ght = NULL;
+		if ( ii == 0 && vik_trw_layer_get_tracks_visibility(vtl) )
+			ght = vik_trw_layer_get_tracks ( vtl );
+		else if ( ii == 1 && vik_trw_layer_get_routes_visibility(vtl) )
+			ght = vik_trw_layer_get_routes ( vtl );
+		if ( !ght )
+			continue;
+		GList *gl = g_hash_table_get_values ( ght );
+		gl = g_list_sort ( gl, geojson_track_compare );
+		for ( GList *iter = gl; iter; iter = iter->next ) {
+			VikTrack *trk = VIK_TRACK(iter->data);
+			// A geometry needs positions
+			if ( !trk->trackpoints )
+				continue;
+			g_string_append ( gs, first ? "\n" : ",\n" );
+			first = FALSE;
+			geojson_write_track ( gs, trk );
+			geojson_flush ( gs, ff, FALSE );
+		}
+		g_list_free ( gl );
+	}
 
-	gchar *tmp_filename = a_gpx_write_tmp_file ( vtl, NULL );
-	if ( !tmp_filename )
-		return result;
+	g_string_append ( gs, "\n]}\n" );
+	geojson_flush ( gs, ff, TRUE );
+	g_string_free ( gs, TRUE );
 
-	GPid pid;
-	gint mystdout;
+	return !ferror ( ff );
+}
 
-	// geojson program should be on the $PATH
-	gchar **argv;
-	argv = g_new (gchar*, 5);
-	argv[0] = g_strdup (a_geojson_program_export());
-	argv[1] = g_strdup ("-f");
-	argv[2] = g_strdup ("gpx");
-	argv[3] = g_strdup (tmp_filename);
-	argv[4] = NULL;
+typedef struct {
+	VikTrwLayer *vtl;
+	VikCoordMode coord_mode;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
+	guint items; // Number of tracks, routes and waypoints added
+} geojson_read_t;
 
-	GError *error = NULL;
-	// TODO: monitor stderr?
-	if (!g_spawn_async_with_pipes (NULL, argv, NULL, (GSpawnFlags) G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL, &mystdout, NULL, &error)) {
+static const gchar *get_string_member ( JsonObject *obj, const gchar *name )
+{
+	if ( !obj )
+		return NULL;
+	JsonNode *node = json_object_get_member ( obj, name );
+	if ( node && JSON_NODE_HOLDS_VALUE(node) && json_node_get_value_type(node) == G_TYPE_STRING )
+		return json_node_get_string ( node );
+	return NULL;
+}
 
-		if ( IS_VIK_WINDOW ((VikWindow *)VIK_GTK_WINDOW_FROM_LAYER(vtl)) ) {
-			gchar* msg = g_strdup_printf ( _("%s command failed: %s"), argv[0], error->message );
-			vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vtl), msg, VIK_STATUSBAR_INFO );
-			g_free (msg);
+static gdouble parse_time ( JsonNode *node )
+{
+	if ( node && JSON_NODE_HOLDS_VALUE(node) && json_node_get_value_type(node) == G_TYPE_STRING ) {
+		GTimeVal tv;
+		if ( g_time_val_from_iso8601(json_node_get_string(node), &tv) ) {
+			gdouble d1 = tv.tv_sec;
+			gdouble d2 = (gdouble)tv.tv_usec/G_USEC_PER_SEC;
+			return (d1 < 0) ? d1 - d2 : d1 + d2;
 		}
-		else
-			g_warning ("Async command failed: %s", error->message);
+	}
+	return NAN;
+}
+
+/**
+ * Positions are [lon, lat] with an optional elevation
+ */
+static gboolean parse_position ( JsonNode *node, geojson_read_t *gr, VikCoord *coord, gdouble *altitude )
+{
+	if ( !node || !JSON_NODE_HOLDS_ARRAY(node) )
+		return FALSE;
+	JsonArray *pos = json_node_get_array ( node );
+	guint len = json_array_get_length ( pos );
+	if ( len < 2 )
+		return FALSE;
+	struct LatLon ll;
+	ll.lon = json_array_get_double_element ( pos, 0 );
+	ll.lat = json_array_get_double_element ( pos, 1 );
+	vik_coord_load_from_latlon ( coord, gr->coord_mode, &ll );
+	*altitude = (len > 2) ? json_array_get_double_element ( pos, 2 ) : NAN;
+	return TRUE;
+}
 
-		g_error_free(error);
+static void add_waypoint ( geojson_read_t *gr, JsonNode *position, JsonObject *props )
+{
+	VikWaypoint *wp = vik_waypoint_new ();
+	if ( !parse_position(position, gr, &wp->coord, &wp->altitude) ) {
+		vik_waypoint_free ( wp );
+		return;
 	}
-	else {
-		// Probably should use GIOChannels...
-		gchar line[512];
-		FILE *fout = fdopen(mystdout, "r");
-		setvbuf(fout, NULL, _IONBF, 0);
-
-		while (fgets(line, sizeof(line), fout)) {
-			fprintf ( ff, "%s", line );
-		}
 
-		fclose(fout);
+	const gchar *str;
+	if ( (str = get_string_member(props, "cmt")) )
+		vik_waypoint_set_comment ( wp, str );
+	if ( (str = get_string_member(props, "desc")) || (str = get_string_member(props, "description")) )
+		vik_waypoint_set_description ( wp, str );
+	if ( (str = get_string_member(props, "src")) )
+		vik_waypoint_set_source ( wp, str );
+	if ( (str = get_string_member(props, "sym")) || (str = get_string_member(props, "marker-symbol")) )
+		vik_waypoint_set_symbol ( wp, str );
+	if ( (str = get_string_member(props, "type")) )
+		vik_waypoint_set_type ( wp, str );
+	if ( props )
+		wp->timestamp = parse_time ( json_object_get_member(props, "time") );
+
+	gchar *name = g_strdup ( get_string_member(props, "name") );
+	if ( !name || !name[0] ) {
+		g_free ( name );
+		name = g_strdup_printf ( _("Waypoint%04d"), gr->unnamed_waypoints++ );
+	}
+	vik_trw_layer_filein_add_waypoint ( gr->vtl, name, wp );
+	g_free ( name );
+	gr->items++;
+}
 
-		g_child_watch_add ( pid, (GChildWatchFunc) my_watch, NULL );
-		result = TRUE;
+/**
+ * Append one line of positions to the track
+ * @times: Matching 'coordTimes' for the positions (can be NULL)
+ */
+static void add_line ( geojson_read_t *gr, VikTrack *trk, JsonNode *line, JsonNode *times )
+{
+	if ( !line || !JSON_NODE_HOLDS_ARRAY(line) )
+		return;
+	JsonArray *positions = json_node_get_array ( line );
+	JsonArray *tarray = (times && JSON_NODE_HOLDS_ARRAY(times)) ? json_node_get_array ( times ) : NULL;
+	guint tlen = tarray ? json_array_get_length ( tarray ) : 0;
+	gboolean newsegment = (trk->trackpoints != NULL);
+
+	guint len = json_array_get_length ( positions );
+	for ( guint ii = 0; ii < len; ii++ ) {
+		VikTrackpoint *tp = vik_trackpoint_new ();
+		if ( !parse_position(json_array_get_element(positions, ii), gr, &tp->coord, &tp->altitude) ) {
+			vik_trackpoint_free ( tp );
+			continue;
+		}
+		if ( ii < tlen )
+			tp->timestamp = parse_time ( json_array_get_element(tarray, ii) );
+		tp->newsegment = newsegment;
+		newsegment = FALSE;
+		// Reversed once complete
+		trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
 	}
+}
 
-	g_strfreev (argv);
+static void add_track ( geojson_read_t *gr, JsonObject *geometry, gboolean multi, JsonObject *props )
+{
+	VikTrack *trk = vik_track_new ();
+	JsonNode *coordinates = json_object_get_member ( geometry, "coordinates" );
+	JsonNode *times = props ? json_object_get_member ( props, "coordTimes" ) : NULL;
+
+	// Lines are added in reverse, so the final reversal gets everything into order
+	if ( multi ) {
+		if ( coordinates && JSON_NODE_HOLDS_ARRAY(coordinates) ) {
+			JsonArray *lines = json_node_get_array ( coordinates );
+			JsonArray *tlines = (times && JSON_NODE_HOLDS_ARRAY(times)) ? json_node_get_array ( times ) : NULL;
+			guint nlines = json_array_get_length ( lines );
+			for ( guint ii = 0; ii < nlines; ii++ ) {
+				JsonNode *tline = (tlines && ii < json_array_get_length(tlines)) ? json_array_get_element ( tlines, ii ) : NULL;
+				add_line ( gr, trk, json_array_get_element(lines, ii), tline );
+			}
+		}
+	}
+	else
+		add_line ( gr, trk, coordinates, times );
 
-	// Delete the temporary file
-	(void)g_remove (tmp_filename);
-	g_free (tmp_filename);
+	if ( !trk->trackpoints ) {
+		vik_track_free ( trk );
+		return;
+	}
+	trk->trackpoints = g_list_reverse ( trk->trackpoints );
+
+	const gchar *str;
+	if ( (str = get_string_member(props, "cmt")) )
+		vik_track_set_comment ( trk, str );
+	if ( (str = get_string_member(props, "desc")) || (str = get_string_member(props, "description")) )
+		vik_track_set_description ( trk, str );
+	if ( (str = get_string_member(props, "src")) )
+		vik_track_set_source ( trk, str );
+	if ( (str = get_string_member(props, "type")) )
+		vik_track_set_type ( trk, str );
+	if ( (str = get_string_member(props, "stroke")) ) {
+		if ( gdk_color_parse(str, &trk->color) )
+			trk->has_color = TRUE;
+	}
+	trk->is_route = ( g_strcmp0 ( get_string_member(props, "_gpxType"), "rte" ) == 0 );
 
-	return result;
+	gchar *name = g_strdup ( get_string_member(props, "name") );
+	if ( !name || !name[0] ) {
+		g_free ( name );
+		name = g_strdup_printf ( _("Track%03d"), gr->unnamed_tracks++ );
+	}
+	vik_trw_layer_filein_add_track ( gr->vtl, name, trk );
+	g_free ( name );
+	gr->items++;
 }
 
-//
-// https://github.com/mapbox/togeojson
-//
-// https://www.npmjs.org/package/togeojson
-//
-// Tested with version 0.7.0
-const gchar* a_geojson_program_export ( void )
+static void read_geometry ( geojson_read_t *gr, JsonObject *geometry, JsonObject *props )
 {
-	return "togeojson";
+	const gchar *type = get_string_member ( geometry, "type" );
+	if ( !type )
+		return;
+
+	if ( g_strcmp0(type, "Point") == 0 )
+		add_waypoint ( gr, json_object_get_member(geometry, "coordinates"), props );
+	else if ( g_strcmp0(type, "MultiPoint") == 0 ) {
+		JsonNode *coordinates = json_object_get_member ( geometry, "coordinates" );
+		if ( coordinates && JSON_NODE_HOLDS_ARRAY(coordinates) ) {
+			JsonArray *points = json_node_get_array ( coordinates );
+			for ( guint ii = 0; ii < json_array_get_length(points); ii++ )
+				add_waypoint ( gr, json_array_get_element(points, ii), props );
+		}
+	}
+	else if ( g_strcmp0(type, "LineString") == 0 )
+		add_track ( gr, geometry, FALSE, props );
+	else if ( g_strcmp0(type, "MultiLineString") == 0 )
+		add_track ( gr, geometry, TRUE, props );
+	else if ( g_strcmp0(type, "GeometryCollection") == 0 ) {
+		JsonNode *geometries = json_object_get_member ( geometry, "geometries" );
+		if ( geometries && JSON_NODE_HOLDS_ARRAY(geometries) ) {
+			JsonArray *array = json_node_get_array ( geometries );
+			for ( guint ii = 0; ii < json_array_get_length(array); ii++ ) {
+				JsonNode *node = json_array_get_element ( array, ii );
+				if ( JSON_NODE_HOLDS_OBJECT(node) )
+					read_geometry ( gr, json_node_get_object(node), props );
+			}
+		}
+	}
+	else
+		g_debug ( "%s: Ignoring geometry type %s", __FUNCTION__, type );
 }
 
-//
-// https://github.com/tyrasd/togpx
-//
-// https://www.npmjs.org/package/togpx
-//
-// Tested with version 0.3.1
-const gchar* a_geojson_program_import ( void )
+static void read_feature ( geojson_read_t *gr, JsonObject *feature )
 {
-	return "togpx";
+	JsonNode *geometry = json_object_get_member ( feature, "geometry" );
+	if ( !geometry || !JSON_NODE_HOLDS_OBJECT(geometry) )
+		return;
+	JsonNode *properties = json_object_get_member ( feature, "properties" );
+	JsonObject *props = (properties && JSON_NODE_HOLDS_OBJECT(properties)) ? json_node_get_object ( properties ) : NULL;
+	read_geometry ( gr, json_node_get_object(geometry), props );
 }
 
 /**
- * a_geojson_import_to_gpx:
+ * a_geojson_read_file:
+ *
+ * @vtl:      The layer to put the data in
+ * @filename: The GeoJSON file
  *
- * @filename: The source GeoJSON file
+ * Read a GeoJSON FeatureCollection, a single Feature or just a geometry directly into the layer.
+ * Points become waypoints and LineStrings/MultiLineStrings become tracks
+ *  (or routes when marked as such by togeojson's '_gpxType' property),
+ *  with the properties mapped onto the equivalent GPX named fields.
  *
- * Returns: The name of newly created temporary GPX file
- *          This file should be removed once used and the string freed.
- *          If NULL then the process failed.
+ * Returns: TRUE if anything was read in
  */
-gchar* a_geojson_import_to_gpx ( const gchar *filename )
+gboolean a_geojson_read_file ( VikTrwLayer *vtl, const gchar *filename )
 {
-	gchar *gpx_filename = NULL;
+	JsonParser *jp = json_parser_new ();
 	GError *error = NULL;
-	// Opening temporary file
-	int fd = g_file_open_tmp("vik_geojson_XXXXXX.gpx", &gpx_filename, &error);
-	if (fd < 0) {
-		g_warning ( _("failed to open temporary file: %s"), error->message );
+	if ( !json_parser_load_from_file(jp, filename, &error) ) {
+		g_warning ( "%s: parse load failed: %s", __FUNCTION__, error ? error->message : "" );
 		g_clear_error ( &error );
-		return NULL;
+		g_object_unref ( jp );
+		return FALSE;
 	}
-	g_debug ( "%s: temporary file = %s", __FUNCTION__, gpx_filename );
-
-	GPid pid;
-	gint mystdout;
-
-	// geojson program should be on the $PATH
-	gchar **argv;
-	argv = g_new (gchar*, 3);
-	argv[0] = g_strdup (a_geojson_program_import());
-	argv[1] = g_strdup (filename);
-	argv[2] = NULL;
 
-	FILE *gpxfile = fdopen (fd, "w");
-
-	// TODO: monitor stderr?
-	if (!g_spawn_async_with_pipes (NULL, argv, NULL, (GSpawnFlags) G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL, &mystdout, NULL, &error)) {
-		g_warning ("Async command failed: %s", error->message);
-		g_error_free(error);
-	}
-	else {
-		// Probably should use GIOChannels...
-		gchar line[512];
-		FILE *fout = fdopen(mystdout, "r");
-		setvbuf(fout, NULL, _IONBF, 0);
-
-		while (fgets(line, sizeof(line), fout)) {
-			fprintf ( gpxfile, "%s", line );
+	geojson_read_t gr = { vtl, vik_trw_layer_get_coord_mode(vtl), 1, 1, 0 };
+
+	JsonNode *root = json_parser_get_root ( jp );
+	if ( root && JSON_NODE_HOLDS_OBJECT(root) ) {
+		JsonObject *obj = json_node_get_object ( root );
+		const gchar *type = get_string_member ( obj, "type" );
+		if ( g_strcmp0(type, "FeatureCollection") == 0 ) {
+			JsonNode *features = json_object_get_member ( obj, "features" );
+			if ( features && JSON_NODE_HOLDS_ARRAY(features) ) {
+				JsonArray *array = json_node_get_array ( features );
+				for ( guint ii = 0; ii < json_array_get_length(array); ii++ ) {
+					JsonNode *node = json_array_get_element ( array, ii );
+					if ( JSON_NODE_HOLDS_OBJECT(node) )
+						read_feature ( &gr, json_node_get_object(node) );
+				}
+			}
 		}
-
-		fclose(fout);
-		g_child_watch_add ( pid, (GChildWatchFunc) my_watch, NULL );
+		else if ( g_strcmp0(type, "Feature") == 0 )
+			read_feature ( &gr, obj );
+		else
+			read_geometry ( &gr, obj, NULL );
 	}
+	g_object_unref ( jp );
 
-	fclose (gpxfile);
-
-	g_strfreev (argv);
-
-	return gpx_filename;
+	return gr.items > 0;
 }
 
 /**
@@ -29,10 +29,7 @@ G_BEGIN_DECLS
 
 gboolean a_geojson_write_file ( VikTrwLayer *vtl, FILE *ff );
 
-const gchar* a_geojson_program_export ( void );
-const gchar* a_geojson_program_import ( void );
-
-gchar* a_geojson_import_to_gpx ( const gchar *filename );
+gboolean a_geojson_read_file ( VikTrwLayer *vtl, const gchar *filename );
 
 gboolean a_geojson_read_file_OSRM ( VikTrwLayer *vtl, const gchar *filename );
 
@@ -29,6 +29,7 @@
 #include "gpx.h"
 #include "viking.h"
 #include "file_magic.h"
+#include "trace.h"
 #include <expat.h>
 #include "misc/gtkhtml-private.h"
 
@@ -123,8 +124,19 @@ typedef struct {
 	FILE *file;
 	const gchar *dirpath;
 	VikTrwLayer *vtl;
+	GString *out;        // Pending output, passed on to the file in large blocks
+	gint64 date_day;     // Days since the epoch of date_str
+	gchar date_str[12];  // "YYYY-MM-DDT" of the last timestamp written; empty when not yet set
 } GpxWritingContext;
 
+// Output is gathered in memory and handed over to the file in blocks of this size,
+//  rather than a fprintf() for every element
+#define GPX_WRITE_BUFFER_SIZE (1024*1024)
+
+// Below this total number of trackpoints, tracks are always written sequentially
+#define GPX_WRITE_PARALLEL_POINTS 20000
+static guint write_parallel_threshold = GPX_WRITE_PARALLEL_POINTS;
+
 /*
  * xpath(ish) mappings between full tag paths and internal identifiers.
  * These appear in the order they appear in the GPX specification.
@@ -264,40 +276,43 @@ static tag_type get_tag(const char *t)
 
 /******************************************/
 
-static tag_type current_tag = tt_unknown;
-static GString *xpath = NULL;
-
-/* current ("c_") objects */
-static VikTrackpoint *c_tp = NULL;
-static VikWaypoint *c_wp = NULL;
-static VikTrack *c_tr = NULL;
-static VikTRWMetadata *c_md = NULL;
-static GString *c_cdata = NULL;
-static GString *c_ext = NULL;
-static GString *c_trkpt_ext = NULL;
-
-static gchar *c_wp_name = NULL;
-static gchar *c_tr_name = NULL;
-
-// Global colour for all tracks (ATM not for waypoints)
-static GdkColor c_color;
-static gboolean c_have_color = FALSE;
-
-/* temporary things so we don't have to create them lots of times */
-static const gchar *c_slat, *c_slon;
-static struct LatLon c_ll;
-
-/* specialty flags / etc */
-static gboolean f_tr_newseg;
-static const gchar *c_link = NULL;
-static guint unnamed_waypoints = 0;
-static guint unnamed_tracks = 0;
-static guint unnamed_routes = 0;
-
+// The state of a single parse, so separate parses may be in progress at the same time
 typedef struct {
 	VikTrwLayer *vtl;
 	const gchar *dirpath;
 	gboolean append;
+
+	tag_type current_tag;
+	GString *xpath;
+
+	/* current ("c_") objects */
+	VikTrackpoint *c_tp;
+	VikWaypoint *c_wp;
+	VikTrack *c_tr;
+	VikTRWMetadata *c_md;
+	GString *c_cdata;
+	GString *c_ext;
+	GString *c_trkpt_ext;
+
+	gchar *c_wp_name;
+	gchar *c_tr_name;
+
+	// Global colour for all tracks (ATM not for waypoints)
+	GdkColor c_color;
+	gboolean c_have_color;
+
+	struct LatLon c_ll;
+
+	/* specialty flags / etc */
+	gboolean f_tr_newseg;
+	const gchar *c_link;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
+	guint unnamed_routes;
+
+	// Secondary parser for track and trackpoint extension fragments
+	GMarkupParseContext *gcontext;
+	GString *gs_ext;
 } UserDataT;
 
 static const char *get_attr ( const char **attr, const char *key )
@@ -313,7 +328,7 @@ static const char *get_attr ( const char **attr, const char *key )
 /**
  * Attempt to set the colour given a string value
  */
-static gboolean global_set_color ( gchar *color )
+static gboolean global_set_color ( UserDataT *ud, gchar *color )
 {
 	// If "#AARRGGBB" style
 	if ( strlen(color) == 9 && color[0] == '#' ) {
@@ -327,11 +342,11 @@ static gboolean global_set_color ( gchar *color )
 		gcol[5] = color[7];
 		gcol[6] = color[8];
 		gcol[7] = '\0';
-		return gdk_color_parse ( gcol, &c_color );
+		return gdk_color_parse ( gcol, &ud->c_color );
 	}
 	// Otherwise try whole string
 	//  hopefully "#RRGGBB" or named colour
-	return gdk_color_parse ( color, &c_color );
+	return gdk_color_parse ( color, &ud->c_color );
 }
 
 /**
@@ -366,11 +381,12 @@ static GString *get_header ( const char **attr )
   return gs;
 }
 
-static gboolean set_c_ll ( const char **attr )
+static gboolean set_c_ll ( UserDataT *ud, const char **attr )
 {
+  const gchar *c_slat, *c_slon;
   if ( (c_slat = get_attr ( attr, "lat" )) && (c_slon = get_attr ( attr, "lon" )) ) {
-    c_ll.lat = g_ascii_strtod(c_slat, NULL);
-    c_ll.lon = g_ascii_strtod(c_slon, NULL);
+    ud->c_ll.lat = g_ascii_strtod(c_slat, NULL);
+    ud->c_ll.lon = g_ascii_strtod(c_slon, NULL);
     return TRUE;
   }
   return FALSE;
@@ -436,8 +452,6 @@ static tag_type_ext get_tag_ext_specific (const char *tt)
  return ext_unknown;
 }
 
-static GString *gs_ext;
-
 // Reprocess the extension text to extract tags we handle
 static void ext_start_element ( GMarkupParseContext *context,
                                 const gchar         *element_name,
@@ -446,7 +460,8 @@ static void ext_start_element ( GMarkupParseContext *context,
                                 gpointer             user_data,
                                 GError             **error )
 {
-  g_string_erase ( gs_ext, 0, -1 ); // Reset the tmp string buffer
+  UserDataT *ud = user_data;
+  g_string_erase ( ud->gs_ext, 0, -1 ); // Reset the tmp string buffer
 }
 
 // NB Text is not null terminated
@@ -456,8 +471,9 @@ static void ext_text ( GMarkupParseContext *context,
                        gpointer             user_data,
                        GError             **error )
 {
+  UserDataT *ud = user_data;
   // Store tag contents
-  g_string_append_len ( gs_ext, text, text_len );
+  g_string_append_len ( ud->gs_ext, text, text_len );
 }
 
 // Main trackpoint extension processing here
@@ -466,57 +482,63 @@ static void ext_end_element ( GMarkupParseContext *context,
                               gpointer             user_data,
                               GError             **error )
 {
+  UserDataT *ud = user_data;
   // If it is any of the extended tags we are interested in,
   //  then use the text stored in the string buffer to set the appropriate track or trackpoint value
   tag_type_ext tag = get_tag_ext_specific ( element_name );
   switch ( tag ) {
   case ext_tp_heart_rate:
-    if ( c_tp ) c_tp->heart_rate = atoi ( gs_ext->str ); // bpm
+    if ( ud->c_tp ) ud->c_tp->heart_rate = atoi ( ud->gs_ext->str ); // bpm
     break;
   case ext_tp_cadence:
-    if ( c_tp ) c_tp->cadence = atoi ( gs_ext->str ); // RPM
+    if ( ud->c_tp ) ud->c_tp->cadence = atoi ( ud->gs_ext->str ); // RPM
     break;
   case ext_tp_speed:
-    if ( c_tp ) c_tp->speed = g_ascii_strtod ( gs_ext->str, NULL ); // m/s
+    if ( ud->c_tp ) ud->c_tp->speed = g_ascii_strtod ( ud->gs_ext->str, NULL ); // m/s
     break;
   case ext_tp_course:
-    if ( c_tp ) c_tp->course = g_ascii_strtod ( gs_ext->str, NULL ); // Degrees
+    if ( ud->c_tp ) ud->c_tp->course = g_ascii_strtod ( ud->gs_ext->str, NULL ); // Degrees
     break;
   case ext_tp_temp:
-    if ( c_tp ) c_tp->temp = g_ascii_strtod ( gs_ext->str, NULL ); // Degrees Celsius
+    if ( ud->c_tp ) ud->c_tp->temp = g_ascii_strtod ( ud->gs_ext->str, NULL ); // Degrees Celsius
     break;
   case ext_tp_power:
-    if ( c_tp ) c_tp->power = atoi ( gs_ext->str ); // Watts
+    if ( ud->c_tp ) ud->c_tp->power = atoi ( ud->gs_ext->str ); // Watts
     break;
   case ext_trk_color:
-    if ( c_tr ) {
+    if ( ud->c_tr ) {
       GdkColor gclr;
-      if ( gdk_color_parse ( gs_ext->str, &gclr ) ) {
-        c_tr->has_color = TRUE;
-        c_tr->color = gclr;
+      if ( gdk_color_parse ( ud->gs_ext->str, &gclr ) ) {
+        ud->c_tr->has_color = TRUE;
+        ud->c_tr->color = gclr;
       }
     }
     break;
   default:
     break;
   }
-  g_string_erase ( gs_ext, 0, -1 );
+  g_string_erase ( ud->gs_ext, 0, -1 );
 }
 
-static GMarkupParser gparser;
-static GMarkupParseContext *gcontext;
+static const GMarkupParser gparser = {
+  ext_start_element,
+  ext_end_element,
+  ext_text,
+  NULL,
+  NULL
+};
 
-static void track_or_trackpoint_extension_process ( gchar *str )
+static void track_or_trackpoint_extension_process ( UserDataT *ud, gchar *str )
 {
   if ( !str )
     return;
 
   // Parse xml fragment to extract extension tag values
   GError *error = NULL;
-  if ( !g_markup_parse_context_parse ( gcontext, str, strlen(str), &error ) )
+  if ( !g_markup_parse_context_parse ( ud->gcontext, str, strlen(str), &error ) )
     g_warning ( "%s: parse error %s on:%s", __FUNCTION__, error ? error->message : "???", str );
 
-  if ( !g_markup_parse_context_end_parse ( gcontext, &error) )
+  if ( !g_markup_parse_context_end_parse ( ud->gcontext, &error) )
     g_warning ( "%s: error %s occurred on end of:%s", __FUNCTION__, error ? error->message : "???", str );
 }
 
@@ -537,25 +559,25 @@ static void extension_append_attributions ( GString *gs, const char *el, const c
 
 static void gpx_start(UserDataT *ud, const char *el, const char **attr)
 {
-  static const gchar *tmp;
+  const gchar *tmp;
   VikTrwLayer *vtl = ud->vtl;
 
-  g_string_append_c ( xpath, '/' );
-  g_string_append ( xpath, el );
-  current_tag = get_tag ( xpath->str );
-  if ( current_tag == tt_unknown )
-    current_tag = get_tag_extension ( xpath->str );
+  g_string_append_c ( ud->xpath, '/' );
+  g_string_append ( ud->xpath, el );
+  ud->current_tag = get_tag ( ud->xpath->str );
+  if ( ud->current_tag == tt_unknown )
+    ud->current_tag = get_tag_extension ( ud->xpath->str );
 
-  switch ( current_tag ) {
+  switch ( ud->current_tag ) {
 
      case tt_gpx:
        {
-         c_md = vik_trw_metadata_new();
+         ud->c_md = vik_trw_metadata_new();
          // Store creator information if possible
          const gchar *crt = get_attr ( attr, "creator" );
          if ( crt ) {
            // If there is an actual description field it will overwrite this value
-           c_md->description = g_strdup_printf ( _("Created by: %s"), crt );
+           ud->c_md->description = g_strdup_printf ( _("Created by: %s"), crt );
          }
 
          const gchar *version = get_attr ( attr, "version" );
@@ -579,49 +601,49 @@ static void gpx_start(UserDataT *ud, const char *el, const char **attr)
        }
        break;
      case tt_wpt:
-       if ( set_c_ll( attr ) ) {
-         c_wp = vik_waypoint_new ();
+       if ( set_c_ll( ud, attr ) ) {
+         ud->c_wp = vik_waypoint_new ();
          if ( get_attr ( attr, "hidden" ) )
-           c_wp->visible = FALSE;
+           ud->c_wp->visible = FALSE;
 
-         vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
+         vik_coord_load_from_latlon ( &(ud->c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &ud->c_ll );
        }
        break;
 
      case tt_trk:
      case tt_rte:
-       c_tr = vik_track_new ();
-       c_tr->is_route = (current_tag == tt_rte) ? TRUE : FALSE;
+       ud->c_tr = vik_track_new ();
+       ud->c_tr->is_route = (ud->current_tag == tt_rte) ? TRUE : FALSE;
        if ( get_attr ( attr, "hidden" ) )
-         c_tr->visible = FALSE;
+         ud->c_tr->visible = FALSE;
        // Apply default colouring if applicable,
        //  which will then get overridden by any specific colour later
-       if ( c_have_color ) {
-           c_tr->has_color = TRUE;
-           c_tr->color = c_color;
+       if ( ud->c_have_color ) {
+           ud->c_tr->has_color = TRUE;
+           ud->c_tr->color = ud->c_color;
        }
        break;
 
      case tt_trk_trkseg:
-       f_tr_newseg = TRUE;
+       ud->f_tr_newseg = TRUE;
        break;
 
      case tt_trk_trkseg_trkpt:
-       if ( set_c_ll( attr ) ) {
-         c_tp = vik_trackpoint_new ();
-         vik_coord_load_from_latlon ( &(c_tp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
-         if ( f_tr_newseg ) {
-           c_tp->newsegment = TRUE;
-           f_tr_newseg = FALSE;
+       if ( set_c_ll( ud, attr ) ) {
+         ud->c_tp = vik_trackpoint_new ();
+         vik_coord_load_from_latlon ( &(ud->c_tp->coord), vik_trw_layer_get_coord_mode ( vtl ), &ud->c_ll );
+         if ( ud->f_tr_newseg ) {
+           ud->c_tp->newsegment = TRUE;
+           ud->f_tr_newseg = FALSE;
          }
-         c_tr->trackpoints = g_list_prepend ( c_tr->trackpoints, c_tp );
+         ud->c_tr->trackpoints = g_list_prepend ( ud->c_tr->trackpoints, ud->c_tp );
        }
        break;
 
      case tt_gpx_url:
      case tt_wpt_link:
      case tt_trk_link:
-       c_link = get_attr ( attr, "href" );
+       ud->c_link = get_attr ( attr, "href" );
        break;
      case tt_gpx_url_name:
      case tt_gpx_name:
@@ -661,42 +683,42 @@ static void gpx_start(UserDataT *ud, const char *el, const char **attr)
      case tt_trk_url:
      case tt_trk_url_name:
      case tt_trk_name:
-       g_string_erase ( c_cdata, 0, -1 ); /* clear the cdata buffer */
+       g_string_erase ( ud->c_cdata, 0, -1 ); /* clear the cdata buffer */
        break;
 
      case tt_waypoint:
-       c_wp = vik_waypoint_new ();
+       ud->c_wp = vik_waypoint_new ();
        break;
 
      case tt_waypoint_coord:
-       if ( set_c_ll( attr ) )
-         vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &c_ll );
+       if ( set_c_ll( ud, attr ) )
+         vik_coord_load_from_latlon ( &(ud->c_wp->coord), vik_trw_layer_get_coord_mode ( vtl ), &ud->c_ll );
        break;
 
      case tt_waypoint_name:
        if ( ( tmp = get_attr(attr, "id") ) ) {
-         if ( c_wp_name )
-           g_free ( c_wp_name );
-         c_wp_name = g_strdup ( tmp );
+         if ( ud->c_wp_name )
+           g_free ( ud->c_wp_name );
+         ud->c_wp_name = g_strdup ( tmp );
        }
-       g_string_erase ( c_cdata, 0, -1 ); /* clear the cdata buffer for description */
+       g_string_erase ( ud->c_cdata, 0, -1 ); /* clear the cdata buffer for description */
        break;
 
      case tt_gpx_extensions:
      case tt_wpt_extensions:
      case tt_trk_extensions:
-       g_string_erase ( c_ext, 0, -1 ); // clear the buffer
+       g_string_erase ( ud->c_ext, 0, -1 ); // clear the buffer
        break;      
      case tt_trk_trkseg_trkpt_extensions:
-       g_string_erase ( c_trkpt_ext, 0, -1 ); // clear the buffer
+       g_string_erase ( ud->c_trkpt_ext, 0, -1 ); // clear the buffer
        break;
      case tt_gpx_an_extension:
      case tt_wpt_an_extension:
      case tt_trk_an_extension:
-       extension_append_attributions ( c_ext, el, attr );
+       extension_append_attributions ( ud->c_ext, el, attr );
        break;
      case tt_trk_trkseg_trkpt_an_extension:
-       extension_append_attributions ( c_trkpt_ext, el, attr );
+       extension_append_attributions ( ud->c_trkpt_ext, el, attr );
        break;
 
      default: break;
@@ -734,17 +756,17 @@ static void track_tidy_processing ( VikTrwLayer *vtl )
 
 static void gpx_end(UserDataT *ud, const char *el)
 {
-  static GTimeVal tp_time;
-  static GTimeVal wp_time;
+  GTimeVal tp_time;
+  GTimeVal wp_time;
   VikTrwLayer *vtl = ud->vtl;
 
-  g_string_truncate ( xpath, xpath->len - strlen(el) - 1 );
+  g_string_truncate ( ud->xpath, ud->xpath->len - strlen(el) - 1 );
 
-  switch ( current_tag ) {
+  switch ( ud->current_tag ) {
 
      case tt_gpx:
-       vik_trw_layer_set_metadata ( vtl, c_md );
-       c_md = NULL;
+       vik_trw_layer_set_metadata ( vtl, ud->c_md );
+       ud->c_md = NULL;
 
        // Essentially the end for a TrackWaypoint layer,
        //  so any specific GPX post processing can occur here
@@ -753,386 +775,386 @@ static void gpx_end(UserDataT *ud, const char *el)
        break;
 
      case tt_gpx_name:
-       vik_layer_rename ( VIK_LAYER(vtl), c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_layer_rename ( VIK_LAYER(vtl), ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_author:
-       if ( c_md->author )
-         g_free ( c_md->author );
-       c_md->author = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->author )
+         g_free ( ud->c_md->author );
+       ud->c_md->author = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_desc:
-       if ( c_md->description )
-         g_free ( c_md->description );
-       c_md->description = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->description )
+         g_free ( ud->c_md->description );
+       ud->c_md->description = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_keywords:
-       if ( c_md->keywords )
-         g_free ( c_md->keywords );
-       c_md->keywords = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->keywords )
+         g_free ( ud->c_md->keywords );
+       ud->c_md->keywords = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_time:
-       if ( c_md->timestamp )
-         g_free ( c_md->timestamp );
-       c_md->timestamp = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->timestamp )
+         g_free ( ud->c_md->timestamp );
+       ud->c_md->timestamp = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_url:
-       if ( c_md->url )
-         g_free ( c_md->url );
-       if ( c_link ) {
-         c_md->url = g_strdup ( c_link );
-         c_link = NULL;
-       } else if ( c_cdata->len > 0 ) {
-         c_md->url = g_strdup ( c_cdata->str );
-         g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->url )
+         g_free ( ud->c_md->url );
+       if ( ud->c_link ) {
+         ud->c_md->url = g_strdup ( ud->c_link );
+         ud->c_link = NULL;
+       } else if ( ud->c_cdata->len > 0 ) {
+         ud->c_md->url = g_strdup ( ud->c_cdata->str );
+         g_string_erase ( ud->c_cdata, 0, -1 );
        }
        break;
 
      case tt_gpx_url_name:
-       if ( c_md->url_name )
-         g_free ( c_md->url_name );
-       c_md->url_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_md->url_name )
+         g_free ( ud->c_md->url_name );
+       ud->c_md->url_name = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_color:
-       c_have_color = global_set_color ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_have_color = global_set_color ( ud, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_waypoint:
      case tt_wpt:
-       if ( ! c_wp_name )
-         c_wp_name = g_strdup_printf("VIKING_WP%04d", unnamed_waypoints++);
-       vik_trw_layer_filein_add_waypoint ( vtl, c_wp_name, c_wp );
-       g_free ( c_wp_name );
-       c_wp = NULL;
-       c_wp_name = NULL;
+       if ( ! ud->c_wp_name )
+         ud->c_wp_name = g_strdup_printf("VIKING_WP%04d", ud->unnamed_waypoints++);
+       vik_trw_layer_filein_add_waypoint ( vtl, ud->c_wp_name, ud->c_wp );
+       g_free ( ud->c_wp_name );
+       ud->c_wp = NULL;
+       ud->c_wp_name = NULL;
        break;
 
      case tt_trk:
-       if ( ! c_tr_name )
-         c_tr_name = g_strdup_printf("VIKING_TR%03d", unnamed_tracks++);
+       if ( ! ud->c_tr_name )
+         ud->c_tr_name = g_strdup_printf("VIKING_TR%03d", ud->unnamed_tracks++);
        // Delibrate fall through
      case tt_rte:
-       if ( ! c_tr_name )
-         c_tr_name = g_strdup_printf("VIKING_RT%03d", unnamed_routes++);
-       c_tr->trackpoints = g_list_reverse ( c_tr->trackpoints );
-       vik_trw_layer_filein_add_track ( vtl, c_tr_name, c_tr );
-       g_free ( c_tr_name );
-       c_tr = NULL;
-       c_tr_name = NULL;
+       if ( ! ud->c_tr_name )
+         ud->c_tr_name = g_strdup_printf("VIKING_RT%03d", ud->unnamed_routes++);
+       ud->c_tr->trackpoints = g_list_reverse ( ud->c_tr->trackpoints );
+       vik_trw_layer_filein_add_track ( vtl, ud->c_tr_name, ud->c_tr );
+       g_free ( ud->c_tr_name );
+       ud->c_tr = NULL;
+       ud->c_tr_name = NULL;
        break;
 
      case tt_wpt_name:
-       if ( c_wp_name )
-         g_free ( c_wp_name );
-       c_wp_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_wp_name )
+         g_free ( ud->c_wp_name );
+       ud->c_wp_name = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_name:
-       if ( c_tr_name )
-         g_free ( c_tr_name );
-       c_tr_name = g_strdup ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_tr_name )
+         g_free ( ud->c_tr_name );
+       ud->c_tr_name = g_strdup ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_ele:
-       c_wp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->altitude = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_ele:
-       c_tp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->altitude = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_waypoint_name: /* .loc name is really description. */
      case tt_wpt_desc:
-       vik_waypoint_set_description ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_description ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_cmt:
-       vik_waypoint_set_comment ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_comment ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_src:
-       vik_waypoint_set_source ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_source ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_type:
-       vik_waypoint_set_type ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_type ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_url:
-       vik_waypoint_set_url ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_url ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_url_name:
-       vik_waypoint_set_url_name ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_url_name ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_link:
-       if ( c_link ) {
+       if ( ud->c_link ) {
          // Correct <link href="uri"></link> format
          // NB although Viking itself may write <type> information,
          //  ATM we don't use it and rely on the value of the URI to determine if URL vs Image
-         if ( util_is_url(c_link) ) {
-           vik_waypoint_set_url ( c_wp, c_link );
+         if ( util_is_url(ud->c_link) ) {
+           vik_waypoint_set_url ( ud->c_wp, ud->c_link );
          }
          else {
-           vu_waypoint_set_image_uri ( c_wp, c_link, ud->dirpath );
+           vu_waypoint_set_image_uri ( ud->c_wp, ud->c_link, ud->dirpath );
          }
        }
        else {
          // Fallback for incorrect GPX <link> format (probably from previous versions of Viking!)
          //  of the form <link>file</link>
-         gchar *fn = util_make_absolute_filename ( c_cdata->str, ud->dirpath );
-         vik_waypoint_set_image ( c_wp, fn ? fn : c_cdata->str );
+         gchar *fn = util_make_absolute_filename ( ud->c_cdata->str, ud->dirpath );
+         vik_waypoint_set_image ( ud->c_wp, fn ? fn : ud->c_cdata->str );
          g_free ( fn );
        }
-       c_link = NULL;
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_link = NULL;
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_sym:
-       vik_waypoint_set_symbol ( c_wp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_waypoint_set_symbol ( ud->c_wp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_course:
-       c_wp->course = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->course = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_speed:
-       c_wp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->speed = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_magvar:
-       c_wp->magvar = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->magvar = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_geoidheight:
-       c_wp->geoidheight = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->geoidheight = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_fix:
-       if (!strcmp("2d", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_2D;
-       else if (!strcmp("3d", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_3D;
-       else if (!strcmp("dgps", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_DGPS;
-       else if (!strcmp("pps", c_cdata->str))
-         c_wp->fix_mode = VIK_GPS_MODE_PPS;
+       if (!strcmp("2d", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_2D;
+       else if (!strcmp("3d", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_3D;
+       else if (!strcmp("dgps", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_DGPS;
+       else if (!strcmp("pps", ud->c_cdata->str))
+         ud->c_wp->fix_mode = VIK_GPS_MODE_PPS;
        else
-         c_wp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
-       g_string_erase ( c_cdata, 0, -1 );
+         ud->c_wp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_sat:
-       c_wp->nsats = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->nsats = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_hdop:
-       c_wp->hdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->hdop = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_vdop:
-       c_wp->vdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->vdop = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_pdop:
-       c_wp->pdop = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->pdop = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_ageofdgpsdata:
-       c_wp->ageofdgpsdata = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->ageofdgpsdata = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_dgpsid:
-       c_wp->dgpsid = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_wp->dgpsid = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_desc:
-       vik_track_set_description ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_description ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_src:
-       vik_track_set_source ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_source ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_number:
-       c_tr->number = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tr->number = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_type:
-       vik_track_set_type ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_type ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_url:
-       vik_track_set_url ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_url ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_url_name:
-       vik_track_set_url_name ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_url_name ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_link:
-       if ( c_link )
-         if ( util_is_url(c_link) )
-           vik_track_set_url ( c_tr, c_link );
-       c_link = NULL;
-       g_string_erase ( c_cdata, 0, -1 );
+       if ( ud->c_link )
+         if ( util_is_url(ud->c_link) )
+           vik_track_set_url ( ud->c_tr, ud->c_link );
+       ud->c_link = NULL;
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_cmt:
-       vik_track_set_comment ( c_tr, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_track_set_comment ( ud->c_tr, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_wpt_time:
-       if ( g_time_val_from_iso8601(c_cdata->str, &wp_time) ) {
+       if ( g_time_val_from_iso8601(ud->c_cdata->str, &wp_time) ) {
 	 gdouble d1 = wp_time.tv_sec;
 	 gdouble d2 = (gdouble)wp_time.tv_usec/G_USEC_PER_SEC;
-         c_wp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
+         ud->c_wp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
        }
-       g_string_erase ( c_cdata, 0, -1 );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_name:
-       vik_trackpoint_set_name ( c_tp, c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       vik_trackpoint_set_name ( ud->c_tp, ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_time:
-       if ( g_time_val_from_iso8601(c_cdata->str, &tp_time) ) {
+       if ( g_time_val_from_iso8601(ud->c_cdata->str, &tp_time) ) {
 	 gdouble d1 = tp_time.tv_sec;
 	 gdouble d2 = (gdouble)tp_time.tv_usec/G_USEC_PER_SEC;
-         c_tp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
+         ud->c_tp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
        }
-       g_string_erase ( c_cdata, 0, -1 );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_course:
-       c_tp->course = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->course = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_speed:
-       c_tp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->speed = g_ascii_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_fix:
-       if (!strcmp("2d", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_2D;
-       else if (!strcmp("3d", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_3D;
-       else if (!strcmp("dgps", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_DGPS;
-       else if (!strcmp("pps", c_cdata->str))
-         c_tp->fix_mode = VIK_GPS_MODE_PPS;
+       if (!strcmp("2d", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_2D;
+       else if (!strcmp("3d", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_3D;
+       else if (!strcmp("dgps", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_DGPS;
+       else if (!strcmp("pps", ud->c_cdata->str))
+         ud->c_tp->fix_mode = VIK_GPS_MODE_PPS;
        else
-         c_tp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
-       g_string_erase ( c_cdata, 0, -1 );
+         ud->c_tp->fix_mode = VIK_GPS_MODE_NOT_SEEN;
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_sat:
-       c_tp->nsats = atoi ( c_cdata->str );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->nsats = atoi ( ud->c_cdata->str );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_hdop:
-       c_tp->hdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->hdop = g_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_vdop:
-       c_tp->vdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->vdop = g_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_pdop:
-       c_tp->pdop = g_strtod ( c_cdata->str, NULL );
-       g_string_erase ( c_cdata, 0, -1 );
+       ud->c_tp->pdop = g_strtod ( ud->c_cdata->str, NULL );
+       g_string_erase ( ud->c_cdata, 0, -1 );
        break;
 
      case tt_gpx_an_extension:
      case tt_wpt_an_extension:
      case tt_trk_an_extension:
-       g_string_append_printf ( c_ext, "</%s>", el );
+       g_string_append_printf ( ud->c_ext, "</%s>", el );
        break;
      case tt_trk_trkseg_trkpt_an_extension:
-       g_string_append_printf ( c_trkpt_ext, "</%s>", el );
+       g_string_append_printf ( ud->c_trkpt_ext, "</%s>", el );
        break;
 
      case tt_trk_extensions:
-       if ( current_tag == tt_trk_extensions )
-         track_or_trackpoint_extension_process ( c_ext->str );
-       vik_track_set_extensions ( c_tr, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       if ( ud->current_tag == tt_trk_extensions )
+         track_or_trackpoint_extension_process ( ud, ud->c_ext->str );
+       vik_track_set_extensions ( ud->c_tr, ud->c_ext->str );
+       g_string_erase ( ud->c_ext, 0, -1 );
        break;
 
      case tt_gpx_extensions:
-       vik_trw_layer_set_gpx_extensions ( vtl, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       vik_trw_layer_set_gpx_extensions ( vtl, ud->c_ext->str );
+       g_string_erase ( ud->c_ext, 0, -1 );
        break;
 
      case tt_wpt_extensions:
-       vik_waypoint_set_extensions ( c_wp, c_ext->str );
-       g_string_erase ( c_ext, 0, -1 );
+       vik_waypoint_set_extensions ( ud->c_wp, ud->c_ext->str );
+       g_string_erase ( ud->c_ext, 0, -1 );
        break;
 
      case tt_trk_trkseg_trkpt_extensions:
-       vik_trackpoint_set_extensions ( c_tp, c_trkpt_ext->str );
-       track_or_trackpoint_extension_process ( c_trkpt_ext->str );
-       g_string_erase ( c_trkpt_ext, 0, -1 );
+       vik_trackpoint_set_extensions ( ud->c_tp, ud->c_trkpt_ext->str );
+       track_or_trackpoint_extension_process ( ud, ud->c_trkpt_ext->str );
+       g_string_erase ( ud->c_trkpt_ext, 0, -1 );
        break;
 
      default: break;
   }
 
-  current_tag = get_tag ( xpath->str );
-  if ( current_tag == tt_unknown )
-    current_tag = get_tag_extension ( xpath->str );
+  ud->current_tag = get_tag ( ud->xpath->str );
+  if ( ud->current_tag == tt_unknown )
+    ud->current_tag = get_tag_extension ( ud->xpath->str );
 }
 
-static void gpx_cdata(void *dta, const XML_Char *s, int len)
+static void gpx_cdata(UserDataT *ud, const XML_Char *s, int len)
 {
-  switch ( current_tag ) {
+  switch ( ud->current_tag ) {
     case tt_gpx_name:
     case tt_gpx_author:
     case tt_gpx_desc:
@@ -1183,18 +1205,18 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
     case tt_trk_trkseg_trkpt_vdop:
     case tt_trk_trkseg_trkpt_pdop:
     case tt_waypoint_name: /* .loc name is really description. */
-      g_string_append_len ( c_cdata, s, len );
+      g_string_append_len ( ud->c_cdata, s, len );
       break;
 
     case tt_trk_trkseg_trkpt_an_extension:
     case tt_trk_trkseg_trkpt_extensions:
-      g_string_append_len ( c_trkpt_ext, s, len );
+      g_string_append_len ( ud->c_trkpt_ext, s, len );
       break;
     case tt_trk_extensions:
     case tt_gpx_extensions:
     // No longer store the <extensions> tag itself for waypoints
     //case tt_wpt_extensions:
-      g_string_append_len ( c_ext, s, len );
+      g_string_append_len ( ud->c_ext, s, len );
       break;
     case tt_trk_an_extension:
     case tt_wpt_an_extension:
@@ -1204,7 +1226,7 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
       gchar *txt = g_memdup ( s, len+1 );
       txt[len] = '\0';
       gchar *tmp = a_gpx_entitize ( txt );
-      g_string_append ( c_ext, tmp );
+      g_string_append ( ud->c_ext, tmp );
       g_free ( txt );
       g_free ( tmp );
     }
@@ -1214,75 +1236,137 @@ static void gpx_cdata(void *dta, const XML_Char *s, int len)
   }
 }
 
-// make like a "stack" of tag names
-// like gpspoint's separated like /gpx/wpt/whatever
-// @append: Whether the read is to append to the vtl (or otherwise a new layer)
-//  i.e. primarily to decide what to do regarding appending files with different GPX versions
-// Returns:
-//  TRUE on success
-//
-gboolean a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath, gboolean append ) {
-  XML_Parser parser = XML_ParserCreate(NULL);
-  int done=0, len;
-  enum XML_Status status = XML_STATUS_ERROR;
+struct _GpxReader {
+  XML_Parser parser;
+  UserDataT ud;
+  gint64 trace_begin;
+  gboolean ok;
+};
+
+/**
+ * a_gpx_reader_new:
+ * @append: Whether the read is to append to the vtl (or otherwise a new layer)
+ *  i.e. primarily to decide what to do regarding appending files with different GPX versions
+ *
+ * Start reading GPX data that will be supplied in pieces via a_gpx_reader_feed(),
+ *  e.g. as it is produced by another program.
+ * Each reader has its own parsing state, so several reads may be in progress at the same time.
+ * NB a_gpx_reader_finish() must always be called.
+ */
+GpxReader *a_gpx_reader_new ( VikTrwLayer *vtl, const gchar* dirpath, gboolean append )
+{
+  g_assert ( vtl != NULL );
 
-  UserDataT *ud = g_malloc (sizeof(UserDataT));
-  ud->vtl     = vtl;
-  ud->dirpath = dirpath;
-  ud->append  = append;
+  GpxReader *gr = g_malloc0 ( sizeof(GpxReader) );
+  gr->trace_begin = a_trace_begin ();
+  gr->parser = XML_ParserCreate(NULL);
+  gr->ok = TRUE;
+  gr->ud.vtl     = vtl;
+  gr->ud.dirpath = dirpath;
+  gr->ud.append  = append;
 
-  XML_SetElementHandler(parser, (XML_StartElementHandler) gpx_start, (XML_EndElementHandler) gpx_end);
-  XML_SetUserData(parser, ud);
-  XML_SetCharacterDataHandler(parser, (XML_CharacterDataHandler) gpx_cdata);
+  XML_SetElementHandler(gr->parser, (XML_StartElementHandler) gpx_start, (XML_EndElementHandler) gpx_end);
+  XML_SetUserData(gr->parser, &gr->ud);
+  XML_SetCharacterDataHandler(gr->parser, (XML_CharacterDataHandler) gpx_cdata);
 
   // Secondary parser for trackpoint extension fragments
   //  seems to work better on xml fragments compared to expat,
   //  and also we can reuse a single parser,
   //  rather than having to create an expat parser each time on each <extension> tag group
-  gparser.start_element = &ext_start_element;
-  gparser.end_element = &ext_end_element;
-  gparser.text = &ext_text;
-  gparser.passthrough = NULL;
-  gparser.error = NULL;
-  gcontext = g_markup_parse_context_new ( &gparser, 0, NULL, NULL );
-
-  gchar buf[4096];
-
-  g_assert ( f != NULL && vtl != NULL );
+  gr->ud.gcontext = g_markup_parse_context_new ( &gparser, 0, &gr->ud, NULL );
 
-  xpath = g_string_new ( "" );
-  c_cdata = g_string_new ( "" );
-  c_ext = g_string_new ( NULL );
-  c_trkpt_ext = g_string_new ( NULL );
-  gs_ext = g_string_new ( NULL );
+  gr->ud.current_tag = tt_unknown;
+  gr->ud.xpath = g_string_new ( "" );
+  gr->ud.c_cdata = g_string_new ( "" );
+  gr->ud.c_ext = g_string_new ( NULL );
+  gr->ud.c_trkpt_ext = g_string_new ( NULL );
+  gr->ud.gs_ext = g_string_new ( NULL );
 
-  unnamed_waypoints = 1;
-  unnamed_tracks = 1;
-  unnamed_routes = 1;
+  gr->ud.unnamed_waypoints = 1;
+  gr->ud.unnamed_tracks = 1;
+  gr->ud.unnamed_routes = 1;
 
-  while (!done) {
-    len = fread(buf, 1, sizeof(buf)-7, f);
-    done = feof(f) || !len;
-    status = XML_Parse(parser, buf, len, done);
-  }
+  return gr;
+}
 
-  gboolean ans = (status != XML_STATUS_ERROR);
-  if ( !ans ) {
-    g_warning ( "%s: XML error %s at line %ld", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser) );
+static gboolean gpx_reader_parse ( GpxReader *gr, const gchar *buf, gsize len, gboolean done )
+{
+  // Once in error, there is no point trying to parse any more
+  if ( gr->ok && XML_Parse(gr->parser, buf, len, done) == XML_STATUS_ERROR ) {
+    g_warning ( "%s: XML error %s at line %ld", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(gr->parser)), XML_GetCurrentLineNumber(gr->parser) );
+    gr->ok = FALSE;
   }
+  return gr->ok;
+}
 
-  XML_ParserFree (parser);
-  g_free ( ud );
-  g_string_free ( xpath, TRUE );
-  g_string_free ( c_cdata, TRUE );
-  g_string_free ( c_ext, TRUE );
-  g_string_free ( c_trkpt_ext, TRUE );
-  g_string_free ( gs_ext, TRUE );
-  g_markup_parse_context_free ( gcontext );
+/**
+ * a_gpx_reader_feed:
+ *
+ * Parse the next piece of the GPX data, of any size
+ *
+ * Returns: FALSE once the data is known to be invalid
+ */
+gboolean a_gpx_reader_feed ( GpxReader *gr, const gchar *buf, gsize len )
+{
+  return gpx_reader_parse ( gr, buf, len, FALSE );
+}
 
+/**
+ * a_gpx_reader_finish:
+ *
+ * The end of the data, and frees the reader
+ *
+ * Returns: TRUE on success
+ */
+gboolean a_gpx_reader_finish ( GpxReader *gr )
+{
+  gboolean ans = gpx_reader_parse ( gr, NULL, 0, TRUE );
+
+  XML_ParserFree ( gr->parser );
+  // Anything left incomplete by invalid data
+  if ( gr->ud.c_tr )
+    vik_track_free ( gr->ud.c_tr );
+  if ( gr->ud.c_wp )
+    vik_waypoint_free ( gr->ud.c_wp );
+  if ( gr->ud.c_md )
+    vik_trw_metadata_free ( gr->ud.c_md );
+  g_free ( gr->ud.c_wp_name );
+  g_free ( gr->ud.c_tr_name );
+
+  g_string_free ( gr->ud.xpath, TRUE );
+  g_string_free ( gr->ud.c_cdata, TRUE );
+  g_string_free ( gr->ud.c_ext, TRUE );
+  g_string_free ( gr->ud.c_trkpt_ext, TRUE );
+  g_string_free ( gr->ud.gs_ext, TRUE );
+  g_markup_parse_context_free ( gr->ud.gcontext );
+
+  a_trace_end ( "a_gpx_read_file", gr->trace_begin );
+  g_free ( gr );
   return ans;
 }
 
+// make like a "stack" of tag names
+// like gpspoint's separated like /gpx/wpt/whatever
+// @append: Whether the read is to append to the vtl (or otherwise a new layer)
+//  i.e. primarily to decide what to do regarding appending files with different GPX versions
+// Returns:
+//  TRUE on success
+//
+gboolean a_gpx_read_file( VikTrwLayer *vtl, FILE *f, const gchar* dirpath, gboolean append ) {
+  g_assert ( f != NULL && vtl != NULL );
+
+  GpxReader *gr = a_gpx_reader_new ( vtl, dirpath, append );
+  gchar buf[4096];
+  size_t len;
+
+  while ( (len = fread(buf, 1, sizeof(buf), f)) ) {
+    if ( !a_gpx_reader_feed(gr, buf, len) )
+      break;
+  }
+
+  return a_gpx_reader_finish ( gr );
+}
+
 /**** entitize from GPSBabel ****/
 typedef struct {
         const char * text;
@@ -1515,52 +1599,190 @@ static const gchar * nearest_colour_string ( GdkColor color )
   return allowed_color_names[answer].color_name;
 }
 
-static void write_double ( FILE *ff, guint spaces, const gchar *tag, gdouble value )
+static void gpx_flush ( GpxWritingContext *context, gboolean force )
+{
+  // Buffers for parallel writing of tracks are not attached to a file
+  if ( !context->file )
+    return;
+  if ( force || context->out->len >= GPX_WRITE_BUFFER_SIZE ) {
+    if ( context->out->len )
+      (void)fwrite ( context->out->str, 1, context->out->len, context->file );
+    g_string_truncate ( context->out, 0 );
+  }
+}
+
+static inline void append_spaces ( GString *gs, guint spaces )
+{
+  for ( guint ii = 0; ii < spaces; ii++ )
+    g_string_append_c ( gs, ' ' );
+}
+
+// Same output as printf's %d
+static void append_int ( GString *gs, gint value )
+{
+  gchar buf[12];
+  gchar *pp = buf + sizeof(buf);
+  guint uv = value < 0 ? -(guint)value : (guint)value;
+  do {
+    *--pp = '0' + uv % 10;
+    uv /= 10;
+  } while ( uv );
+  if ( value < 0 )
+    *--pp = '-';
+  g_string_append_len ( gs, pp, buf + sizeof(buf) - pp );
+}
+
+static inline void append_double ( GString *gs, gdouble value )
+{
+  gchar buf[COORDS_STR_BUFFER_SIZE];
+  a_coords_dtostr_buffer ( value, buf );
+  g_string_append ( gs, buf );
+}
+
+static inline void append_open_tag ( GString *gs, guint spaces, const gchar *tag )
+{
+  append_spaces ( gs, spaces );
+  g_string_append_c ( gs, '<' );
+  g_string_append ( gs, tag );
+  g_string_append_c ( gs, '>' );
+}
+
+static inline void append_close_tag ( GString *gs, const gchar *tag )
+{
+  g_string_append_len ( gs, "</", 2 );
+  g_string_append ( gs, tag );
+  g_string_append_len ( gs, ">\n", 2 );
+}
+
+static inline void put_digits ( gchar *pp, guint value, guint width )
+{
+  for ( guint ii = width; ii > 0; ii-- ) {
+    pp[ii-1] = '0' + value % 10;
+    value /= 10;
+  }
+}
+
+#define GPX_TIME_BUFFER_SIZE 64
+
+/**
+ * Format the time exactly as g_time_val_to_iso8601() does,
+ *  i.e. YYYY-MM-DDTHH:MM:SSZ or YYYY-MM-DDTHH:MM:SS.ffffffZ
+ * but without an allocation nor a gmtime() call for every point.
+ * Since consecutive points are nearly always on the same day,
+ *  the date part is only recalculated when the day changes.
+ *
+ * Returns: FALSE if there is no valid time representation
+ */
+static gboolean format_iso8601 ( GpxWritingContext *context, const GTimeVal *tv, gchar buf[GPX_TIME_BUFFER_SIZE] )
+{
+  // Only years 1970 to 9999 are handled directly, anything else is left to GLib
+  if ( tv->tv_sec < 0 || (gint64)tv->tv_sec >= G_GINT64_CONSTANT(253402300800) ||
+       tv->tv_usec < 0 || tv->tv_usec >= G_USEC_PER_SEC ) {
+    gchar *time_iso8601 = g_time_val_to_iso8601 ( (GTimeVal*)tv );
+    if ( !time_iso8601 )
+      return FALSE;
+    g_strlcpy ( buf, time_iso8601, GPX_TIME_BUFFER_SIZE );
+    g_free ( time_iso8601 );
+    return TRUE;
+  }
+
+  gint64 day = tv->tv_sec / 86400;
+  guint secs = tv->tv_sec % 86400;
+
+  if ( !context->date_str[0] || day != context->date_day ) {
+    // Proleptic Gregorian calendar date from the number of days since 1970-01-01
+    gint64 zz = day + 719468;
+    gint64 era = zz / 146097;
+    guint doe = zz - era * 146097;
+    guint yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    guint doy = doe - (365*yoe + yoe/4 - yoe/100);
+    guint mp = (5*doy + 2) / 153;
+    guint dd = doy - (153*mp + 2)/5 + 1;
+    guint mm = mp < 10 ? mp + 3 : mp - 9;
+    guint yy = yoe + era * 400 + (mm <= 2);
+
+    put_digits ( context->date_str, yy, 4 );
+    context->date_str[4] = '-';
+    put_digits ( context->date_str+5, mm, 2 );
+    context->date_str[7] = '-';
+    put_digits ( context->date_str+8, dd, 2 );
+    context->date_str[10] = 'T';
+    context->date_str[11] = '\0';
+    context->date_day = day;
+  }
+
+  gchar *pp = buf;
+  memcpy ( pp, context->date_str, 11 );
+  pp += 11;
+  put_digits ( pp, secs / 3600, 2 );
+  pp[2] = ':';
+  put_digits ( pp+3, (secs / 60) % 60, 2 );
+  pp[5] = ':';
+  put_digits ( pp+6, secs % 60, 2 );
+  pp += 8;
+  if ( tv->tv_usec != 0 ) {
+    *pp++ = '.';
+    put_digits ( pp, tv->tv_usec, 6 );
+    pp += 6;
+  }
+  *pp++ = 'Z';
+  *pp = '\0';
+  return TRUE;
+}
+
+static void write_double ( GString *gs, guint spaces, const gchar *tag, gdouble value )
 {
   if ( !isnan(value) ) {
-    gchar buf[COORDS_STR_BUFFER_SIZE];
-    a_coords_dtostr_buffer ( value, buf );
-    fprintf ( ff, "%*s<%s>%s</%s>\n", spaces, "", tag, buf, tag );
+    append_open_tag ( gs, spaces, tag );
+    append_double ( gs, value );
+    append_close_tag ( gs, tag );
   }
 }
 
 // Value must positive to be written otherwise it is ignored
-static void write_positive_uint ( FILE *ff, guint spaces, const gchar *tag, guint value )
+static void write_positive_uint ( GString *gs, guint spaces, const gchar *tag, guint value )
 {
-  if ( value )
-    fprintf ( ff, "%*s<%s>%d</%s>\n", spaces, "", tag, value, tag );
+  if ( value ) {
+    append_open_tag ( gs, spaces, tag );
+    append_int ( gs, value );
+    append_close_tag ( gs, tag );
+  }
 }
 
-static void write_string ( FILE *ff, guint spaces, const gchar *tag, const gchar *value )
+static void write_string ( GString *gs, guint spaces, const gchar *tag, const gchar *value )
 {
   if ( value && strlen(value) ) {
     gchar *tmp = a_gpx_entitize ( value );
-    fprintf ( ff, "%*s<%s>%s</%s>\n", spaces, "", tag, tmp, tag );
+    append_open_tag ( gs, spaces, tag );
+    g_string_append ( gs, tmp );
+    append_close_tag ( gs, tag );
     g_free ( tmp );
   }
 }
 
-static void write_string_as_is ( FILE *ff, guint spaces, const gchar *tag, const gchar *value )
+static void write_string_as_is ( GString *gs, guint spaces, const gchar *tag, const gchar *value )
 {
   if ( value && strlen(value) ) {
-    fprintf ( ff, "%*s<%s>%s</%s>\n", spaces, "", tag, value, tag );
+    append_open_tag ( gs, spaces, tag );
+    g_string_append ( gs, value );
+    append_close_tag ( gs, tag );
   }
 }
 
-static void write_link ( FILE *ff, guint spaces, const gchar *link, const gchar *text, const gchar *type )
+static void write_link ( GString *gs, guint spaces, const gchar *link, const gchar *text, const gchar *type )
 {
   if ( link && strlen(link) && text && strlen(text) && type && strlen(type) ) {
     gchar *tmp = a_gpx_entitize ( text );
-    fprintf ( ff, "%*s<link href=\"%s\"><text>%s</text><type>%s</type></link>\n", spaces, "", link, text, type );
+    g_string_append_printf ( gs, "%*s<link href=\"%s\"><text>%s</text><type>%s</type></link>\n", spaces, "", link, text, type );
     g_free ( tmp );
   } else if ( link && strlen(link) && text && strlen(text) ) {
     gchar *tmp = a_gpx_entitize ( text );
-    fprintf ( ff, "%*s<link href=\"%s\"><text>%s</text></link>\n", spaces, "", link, text );
+    g_string_append_printf ( gs, "%*s<link href=\"%s\"><text>%s</text></link>\n", spaces, "", link, text );
     g_free ( tmp );
   } else if ( link && strlen(link) && type && strlen(type) ) {
-    fprintf ( ff, "%*s<link href=\"%s\"><type>%s</type></link>\n", spaces, "", link, type );
+    g_string_append_printf ( gs, "%*s<link href=\"%s\"><type>%s</type></link>\n", spaces, "", link, type );
   } else if ( link && strlen(link) ) {
-    fprintf ( ff, "%*s<link href=\"%s\"></link>\n", spaces, "", link );
+    g_string_append_printf ( gs, "%*s<link href=\"%s\"></link>\n", spaces, "", link );
   }
 }
 
@@ -1575,38 +1797,36 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
   if (context->options && !context->options->hidden && !wp->visible)
     return;
 
-  FILE *f = context->file;
+  GString *gs = context->out;
   struct LatLon ll;
-  gchar s_lat[COORDS_STR_BUFFER_SIZE];
-  gchar s_lon[COORDS_STR_BUFFER_SIZE];
   gchar *tmp;
   vik_coord_to_latlon ( &(wp->coord), &ll );
-  a_coords_dtostr_buffer ( ll.lat, s_lat );
-  a_coords_dtostr_buffer ( ll.lon, s_lon );
   // NB 'hidden' is not part of any GPX standard - this appears to be a made up Viking 'extension'
   //  luckily most other GPX processing software ignores things they don't understand
-  fprintf ( f, "<wpt lat=\"%s\" lon=\"%s\"%s>\n",
-               s_lat, s_lon, wp->visible ? "" : " hidden=\"hidden\"" );
+  g_string_append ( gs, "<wpt lat=\"" );
+  append_double ( gs, ll.lat );
+  g_string_append ( gs, "\" lon=\"" );
+  append_double ( gs, ll.lon );
+  g_string_append ( gs, wp->visible ? "\">\n" : "\" hidden=\"hidden\">\n" );
 
-  write_double ( f, WPT_SPACES, "ele", wp->altitude );
+  write_double ( gs, WPT_SPACES, "ele", wp->altitude );
 
   if ( !isnan(wp->timestamp) ) {
     GTimeVal timestamp;
     timestamp.tv_sec = wp->timestamp;
     timestamp.tv_usec = abs((wp->timestamp-(gint64)wp->timestamp)*G_USEC_PER_SEC);
 
-    gchar *time_iso8601 = g_time_val_to_iso8601 ( &timestamp );
-    if ( time_iso8601 != NULL )
-      fprintf ( f, "  <time>%s</time>\n", time_iso8601 );
-    g_free ( time_iso8601 );
+    gchar time_iso8601[GPX_TIME_BUFFER_SIZE];
+    if ( format_iso8601 ( context, &timestamp, time_iso8601 ) )
+      write_string_as_is ( gs, WPT_SPACES, "time", time_iso8601 );
   }
 
   if ( !context->options || (context->options && context->options->version == GPX_V1_0) ) {
-    write_double ( f, WPT_SPACES, "course", wp->course );
-    write_double ( f, WPT_SPACES, "speed", wp->speed );
+    write_double ( gs, WPT_SPACES, "course", wp->course );
+    write_double ( gs, WPT_SPACES, "speed", wp->speed );
   }
-  write_double ( f, WPT_SPACES, "magvar", wp->magvar );
-  write_double ( f, WPT_SPACES, "geoidheight", wp->geoidheight );
+  write_double ( gs, WPT_SPACES, "magvar", wp->magvar );
+  write_double ( gs, WPT_SPACES, "geoidheight", wp->geoidheight );
 
   // Sanity clause
   if ( wp->name )
@@ -1614,18 +1834,18 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
   else
     tmp = g_strdup ("waypoint");
 
-  fprintf ( f, "  <name>%s</name>\n", tmp );
+  g_string_append_printf ( gs, "  <name>%s</name>\n", tmp );
   g_free ( tmp);
 
-  write_string ( f, WPT_SPACES, "cmt", wp->comment );
-  write_string ( f, WPT_SPACES, "desc", wp->description );
-  write_string ( f, WPT_SPACES, "src", wp->source );
+  write_string ( gs, WPT_SPACES, "cmt", wp->comment );
+  write_string ( gs, WPT_SPACES, "desc", wp->description );
+  write_string ( gs, WPT_SPACES, "src", wp->source );
 
   if ( wp->url && context->options && context->options->version == GPX_V1_1 ) {
-    write_link ( f, WPT_SPACES, wp->url, wp->url_name, NULL );
+    write_link ( gs, WPT_SPACES, wp->url, wp->url_name, NULL );
   } else {
-    write_string ( f, WPT_SPACES, "url", wp->url );
-    write_string ( f, WPT_SPACES, "urlname", wp->url_name );
+    write_string ( gs, WPT_SPACES, "url", wp->url );
+    write_string ( gs, WPT_SPACES, "urlname", wp->url_name );
   }
 
   if ( wp->image )
@@ -1642,7 +1862,7 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
     if ( !tmp )
       tmp = gtk_html_filename_to_uri ( wp->image );
     const gchar *mtype = file_magic_type ( wp->image );
-    write_link ( f, WPT_SPACES, tmp, NULL, mtype );
+    write_link ( gs, WPT_SPACES, tmp, NULL, mtype );
     g_free ( (gchar*)mtype );
     g_free ( tmp );
   }
@@ -1653,146 +1873,151 @@ static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
     if ( a_vik_gpx_export_wpt_sym_name ( ) ) {
        // Lowercase the symbol name
        gchar *tmp2 = g_utf8_strdown ( tmp, -1 );
-       fprintf ( f, "  <sym>%s</sym>\n",  tmp2 );
+       g_string_append_printf ( gs, "  <sym>%s</sym>\n",  tmp2 );
        g_free ( tmp2 );
     }
     else
-      fprintf ( f, "  <sym>%s</sym>\n", tmp);
+      g_string_append_printf ( gs, "  <sym>%s</sym>\n", tmp);
     g_free ( tmp );
   }
-  write_string ( f, WPT_SPACES, "type", wp->type );
+  write_string ( gs, WPT_SPACES, "type", wp->type );
 
   if ( wp->fix_mode == VIK_GPS_MODE_2D )
-    fprintf ( f, "  <fix>2d</fix>\n" );
+    g_string_append ( gs, "  <fix>2d</fix>\n" );
   else if ( wp->fix_mode == VIK_GPS_MODE_3D )
-    fprintf ( f, "  <fix>3d</fix>\n" );
+    g_string_append ( gs, "  <fix>3d</fix>\n" );
   else if ( wp->fix_mode == VIK_GPS_MODE_DGPS )
-    fprintf ( f, "  <fix>dgps</fix>\n" );
+    g_string_append ( gs, "  <fix>dgps</fix>\n" );
   else if ( wp->fix_mode == VIK_GPS_MODE_PPS )
-    fprintf ( f, "  <fix>pps</fix>\n" );
+    g_string_append ( gs, "  <fix>pps</fix>\n" );
 
-  write_positive_uint ( f, WPT_SPACES, "sat", wp->nsats );
-  write_double ( f, WPT_SPACES, "hdop", wp->hdop );
-  write_double ( f, WPT_SPACES, "vdop", wp->vdop );
-  write_double ( f, WPT_SPACES, "pdop", wp->pdop );
-  write_double ( f, WPT_SPACES, "ageofdgpsdata", wp->ageofdgpsdata );
-  write_positive_uint ( f, WPT_SPACES, "dgpsid", wp->dgpsid );
+  write_positive_uint ( gs, WPT_SPACES, "sat", wp->nsats );
+  write_double ( gs, WPT_SPACES, "hdop", wp->hdop );
+  write_double ( gs, WPT_SPACES, "vdop", wp->vdop );
+  write_double ( gs, WPT_SPACES, "pdop", wp->pdop );
+  write_double ( gs, WPT_SPACES, "ageofdgpsdata", wp->ageofdgpsdata );
+  write_positive_uint ( gs, WPT_SPACES, "dgpsid", wp->dgpsid );
 
   // NB if 'extensions' have been read in/or set, yet the GPX version is specifically V1.0
   //  then ensure extension fields are not written
   if ( context->options && context->options->version == GPX_V1_1 ) {
     if ( vik_waypoint_have_extensions(wp) ) {
-      GString *gs = vik_waypoint_get_extensions ( wp );
-      write_string_as_is ( f, WPT_SPACES, "extensions", gs->str );
-      g_string_free ( gs, TRUE );
+      GString *gext = vik_waypoint_get_extensions ( wp );
+      write_string_as_is ( gs, WPT_SPACES, "extensions", gext->str );
+      g_string_free ( gext, TRUE );
     }
   }
 
-  fprintf ( f, "</wpt>\n" );
+  g_string_append ( gs, "</wpt>\n" );
+  gpx_flush ( context, FALSE );
 }
 
 #define TRKPT_SPACES 4
 #define TRKPT_EXT_SPACES 8
 /**
  * Note that elements are written in the schema specification order
+ *
+ * @newsegment: Whether to start a new track segment before this point
  */
-static void gpx_write_trackpoint ( VikTrackpoint *tp, GpxWritingContext *context )
+static void gpx_write_trackpoint ( VikTrackpoint *tp, gboolean newsegment, GpxWritingContext *context )
 {
-  FILE *f = context->file;
+  GString *gs = context->out;
   struct LatLon ll;
-  gchar s_lat[COORDS_STR_BUFFER_SIZE];
-  gchar s_lon[COORDS_STR_BUFFER_SIZE];
-  gchar s_alt[COORDS_STR_BUFFER_SIZE];
-  gchar *time_iso8601;
+  gchar time_iso8601[GPX_TIME_BUFFER_SIZE];
+  gboolean have_time = FALSE;
+  gboolean is_route = context->options && context->options->is_route;
   vik_coord_to_latlon ( &(tp->coord), &ll );
 
   // No such thing as a rteseg! So make sure we don't put them in
-  if ( context->options && !context->options->is_route && tp->newsegment )
-    fprintf ( f, "  </trkseg>\n  <trkseg>\n" );
+  if ( context->options && !is_route && newsegment )
+    g_string_append ( gs, "  </trkseg>\n  <trkseg>\n" );
 
-  a_coords_dtostr_buffer ( ll.lat, s_lat );
-  a_coords_dtostr_buffer ( ll.lon, s_lon );
-  fprintf ( f, "  <%spt lat=\"%s\" lon=\"%s\">\n", (context->options && context->options->is_route) ? "rte" : "trk", s_lat, s_lon );
+  g_string_append ( gs, is_route ? "  <rtept lat=\"" : "  <trkpt lat=\"" );
+  append_double ( gs, ll.lat );
+  g_string_append ( gs, "\" lon=\"" );
+  append_double ( gs, ll.lon );
+  g_string_append ( gs, "\">\n" );
 
   if ( !isnan(tp->altitude) )
   {
-    a_coords_dtostr_buffer ( tp->altitude, s_alt );
-    fprintf ( f, "    <ele>%s</ele>\n", s_alt );
+    write_double ( gs, TRKPT_SPACES, "ele", tp->altitude );
   }
   else if ( context->options != NULL && context->options->force_ele )
   {
-    fprintf ( f, "    <ele>0</ele>\n" );
+    g_string_append ( gs, "    <ele>0</ele>\n" );
   }
 
-  time_iso8601 = NULL;
   if ( !isnan(tp->timestamp) ) {
     GTimeVal timestamp;
     timestamp.tv_sec = tp->timestamp;
     timestamp.tv_usec = abs((tp->timestamp-(gint64)tp->timestamp)*G_USEC_PER_SEC);
-    time_iso8601 = g_time_val_to_iso8601 ( &timestamp );
+    have_time = format_iso8601 ( context, &timestamp, time_iso8601 );
   }
   else if ( context->options != NULL && context->options->force_time )
   {
     GTimeVal current;
     g_get_current_time ( &current );
-    time_iso8601 = g_time_val_to_iso8601 ( &current );
+    have_time = format_iso8601 ( context, &current, time_iso8601 );
   }
-  if ( time_iso8601 != NULL )
-    fprintf ( f, "    <time>%s</time>\n", time_iso8601 );
-  g_free(time_iso8601);
-  time_iso8601 = NULL;
+  if ( have_time )
+    write_string_as_is ( gs, TRKPT_SPACES, "time", time_iso8601 );
 
   if ( !context->options || (context->options && context->options->version == GPX_V1_0) ) {
-    write_double ( f, TRKPT_SPACES, "course", tp->course );
-    write_double ( f, TRKPT_SPACES, "speed", tp->speed );
+    write_double ( gs, TRKPT_SPACES, "course", tp->course );
+    write_double ( gs, TRKPT_SPACES, "speed", tp->speed );
   }
-  write_string ( f, TRKPT_SPACES, "name", tp->name );
+  write_string ( gs, TRKPT_SPACES, "name", tp->name );
 
   if (tp->fix_mode == VIK_GPS_MODE_2D)
-    fprintf ( f, "    <fix>2d</fix>\n");
+    g_string_append ( gs, "    <fix>2d</fix>\n");
   if (tp->fix_mode == VIK_GPS_MODE_3D)
-    fprintf ( f, "    <fix>3d</fix>\n");
+    g_string_append ( gs, "    <fix>3d</fix>\n");
   if (tp->fix_mode == VIK_GPS_MODE_DGPS)
-    fprintf ( f, "    <fix>dgps</fix>\n");
+    g_string_append ( gs, "    <fix>dgps</fix>\n");
   if (tp->fix_mode == VIK_GPS_MODE_PPS)
-    fprintf ( f, "    <fix>pps</fix>\n");
+    g_string_append ( gs, "    <fix>pps</fix>\n");
 
-  write_positive_uint ( f, TRKPT_SPACES, "sat", tp->nsats );
-  write_double ( f, TRKPT_SPACES, "hdop", tp->hdop );
-  write_double ( f, TRKPT_SPACES, "vdop", tp->vdop );
-  write_double ( f, TRKPT_SPACES, "pdop", tp->pdop );
+  write_positive_uint ( gs, TRKPT_SPACES, "sat", tp->nsats );
+  write_double ( gs, TRKPT_SPACES, "hdop", tp->hdop );
+  write_double ( gs, TRKPT_SPACES, "vdop", tp->vdop );
+  write_double ( gs, TRKPT_SPACES, "pdop", tp->pdop );
 
   // If have the raw extensions - then save that (which should include all of the individual values we use)
   // NB if 'extensions' have been read in yet the GPX version is V1.0
   //  then ensure extension fields are not written
   if ( tp->extensions && context->options && context->options->version == GPX_V1_1 )
-    write_string_as_is ( f, TRKPT_SPACES, "extensions", tp->extensions );
+    write_string_as_is ( gs, TRKPT_SPACES, "extensions", tp->extensions );
   else {
     // Otherwise write the individual values we are supporting (in Garmin TrackPointExtension/v2 format)
     if ( context->options && context->options->version == GPX_V1_1 ) {
       if ( !isnan(tp->speed) || !isnan(tp->course) ||
            !isnan(tp->temp) || tp->heart_rate || tp->cadence != VIK_TRKPT_CADENCE_NONE ) {
-        fprintf ( f, "    <extensions>\n");
-        fprintf ( f, "      <gpxtpx:TrackPointExtension>\n");
-        write_double ( f, TRKPT_EXT_SPACES, "gpxtpx:atemp", tp->temp );
-        write_positive_uint ( f, TRKPT_EXT_SPACES, "gpxtpx:hr", tp->heart_rate );
-        if ( tp->cadence != VIK_TRKPT_CADENCE_NONE )
-          fprintf ( f, "%*s<%s>%d</%s>\n", TRKPT_EXT_SPACES, "", "gpxtpx:cad", tp->cadence, "gpxtpx:cad" );
-        write_double ( f, TRKPT_EXT_SPACES, "gpxtpx:speed", tp->speed );
-        write_double ( f, TRKPT_EXT_SPACES, "gpxtpx:course", tp->course );
-        fprintf ( f, "      </gpxtpx:TrackPointExtension>\n");
-        fprintf ( f, "    </extensions>\n");
+        g_string_append ( gs, "    <extensions>\n");
+        g_string_append ( gs, "      <gpxtpx:TrackPointExtension>\n");
+        write_double ( gs, TRKPT_EXT_SPACES, "gpxtpx:atemp", tp->temp );
+        write_positive_uint ( gs, TRKPT_EXT_SPACES, "gpxtpx:hr", tp->heart_rate );
+        if ( tp->cadence != VIK_TRKPT_CADENCE_NONE ) {
+          append_open_tag ( gs, TRKPT_EXT_SPACES, "gpxtpx:cad" );
+          append_int ( gs, tp->cadence );
+          append_close_tag ( gs, "gpxtpx:cad" );
+        }
+        write_double ( gs, TRKPT_EXT_SPACES, "gpxtpx:speed", tp->speed );
+        write_double ( gs, TRKPT_EXT_SPACES, "gpxtpx:course", tp->course );
+        g_string_append ( gs, "      </gpxtpx:TrackPointExtension>\n");
+        g_string_append ( gs, "    </extensions>\n");
       }
     }
   }
-  fprintf ( f, "  </%spt>\n", (context->options && context->options->is_route) ? "rte" : "trk" );
+  g_string_append ( gs, is_route ? "  </rtept>\n" : "  </trkpt>\n" );
 }
 
 #define TRK_SPACES 2
 
-static void write_track_extension_color_only ( FILE *ff, VikTrack *trk )
+static void write_track_extension_color_only ( GString *gs, VikTrack *trk )
 {
-  fprintf ( ff, "  <extensions><gpxx:TrackExtension><gpxx:DisplayColor>%s</gpxx:DisplayColor></gpxx:TrackExtension></extensions>\n", nearest_colour_string(trk->color) );
+  g_string_append ( gs, "  <extensions><gpxx:TrackExtension><gpxx:DisplayColor>" );
+  g_string_append ( gs, nearest_colour_string(trk->color) );
+  g_string_append ( gs, "</gpxx:DisplayColor></gpxx:TrackExtension></extensions>\n" );
 }
 
 static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
@@ -1801,9 +2026,8 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
   if (context->options && !context->options->hidden && !t->visible)
     return;
 
-  FILE *f = context->file;
+  GString *gs = context->out;
   gchar *tmp;
-  gboolean first_tp_is_newsegment = FALSE; /* must temporarily make it not so, but we want to restore state. not that it matters. */
 
   // Sanity clause
   if ( t->name )
@@ -1813,23 +2037,23 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
 
   // NB 'hidden' is not part of any GPX standard - this appears to be a made up Viking 'extension'
   //  luckily most other GPX processing software ignores things they don't understand
-  fprintf ( f, "<%s%s>\n  <name>%s</name>\n",
-	    t->is_route ? "rte" : "trk",
-	    t->visible ? "" : " hidden=\"hidden\"",
-	    tmp );
+  g_string_append_printf ( gs, "<%s%s>\n  <name>%s</name>\n",
+                           t->is_route ? "rte" : "trk",
+                           t->visible ? "" : " hidden=\"hidden\"",
+                           tmp );
   g_free ( tmp );
 
-  write_string ( f, TRK_SPACES, "cmt", t->comment );
-  write_string ( f, TRK_SPACES, "desc", t->description );
-  write_string ( f, TRK_SPACES, "src", t->source );
-  write_positive_uint ( f, TRK_SPACES, "number", t->number );
+  write_string ( gs, TRK_SPACES, "cmt", t->comment );
+  write_string ( gs, TRK_SPACES, "desc", t->description );
+  write_string ( gs, TRK_SPACES, "src", t->source );
+  write_positive_uint ( gs, TRK_SPACES, "number", t->number );
   if ( t->url && context->options && context->options->version == GPX_V1_1 ) {
-    write_link ( f, TRK_SPACES, t->url, t->url_name, NULL );
+    write_link ( gs, TRK_SPACES, t->url, t->url_name, NULL );
   } else {
-    write_string ( f, TRK_SPACES, "url", t->url );
-    write_string ( f, TRK_SPACES, "urlname", t->url_name );
+    write_string ( gs, TRK_SPACES, "url", t->url );
+    write_string ( gs, TRK_SPACES, "urlname", t->url_name );
   }
-  write_string ( f, TRK_SPACES, "type", t->type );
+  write_string ( gs, TRK_SPACES, "type", t->type );
 
   // ATM Track Colour is the only extension Viking supports editing
   //  thus if there is some other track extension Viking will not add in the color,
@@ -1848,7 +2072,7 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
         g_strstrip ( text );
         if ( g_str_has_prefix(text, "<gpxx:TrackExtension><gpxx:DisplayColor>") ) {
           if ( g_str_has_suffix(text, "</gpxx:DisplayColor></gpxx:TrackExtension>") )
-            write_track_extension_color_only ( f, t );
+            write_track_extension_color_only ( gs, t );
           else
             write_as_is = TRUE;
         }
@@ -1857,34 +2081,135 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
         g_free ( text );
       }
       if ( write_as_is )
-        write_string_as_is ( f, TRK_SPACES, "extensions", t->extensions );
+        write_string_as_is ( gs, TRK_SPACES, "extensions", t->extensions );
     }
     else {
       if ( context->options && context->options->version == GPX_V1_1 )
         if ( t->has_color )
-          write_track_extension_color_only ( f, t );
+          write_track_extension_color_only ( gs, t );
     }
   }
 
   /* No such thing as a rteseg! */
   if ( !t->is_route )
-    fprintf ( f, "  <trkseg>\n" );
-
-  if ( t->trackpoints && t->trackpoints->data ) {
-    first_tp_is_newsegment = VIK_TRACKPOINT(t->trackpoints->data)->newsegment;
-    VIK_TRACKPOINT(t->trackpoints->data)->newsegment = FALSE; /* so we won't write </trkseg><trkseg> already */
-    g_list_foreach ( t->trackpoints, (GFunc) gpx_write_trackpoint, context );
-    VIK_TRACKPOINT(t->trackpoints->data)->newsegment = first_tp_is_newsegment; /* restore state */
+    g_string_append ( gs, "  <trkseg>\n" );
+
+  // The first point never starts a new segment, as we've just opened one
+  //  (and the track itself is left untouched, so tracks can be written concurrently)
+  for ( GList *iter = t->trackpoints; iter != NULL; iter = iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    gpx_write_trackpoint ( tp, iter != t->trackpoints && tp->newsegment, context );
+    gpx_flush ( context, FALSE );
   }
 
   /* NB apparently no such thing as a rteseg! */
   if (!t->is_route)
-    fprintf ( f, "  </trkseg>\n");
-  fprintf ( f, "</%s>\n", t->is_route ? "rte" : "trk" );
+    g_string_append ( gs, "  </trkseg>\n");
+  g_string_append ( gs, t->is_route ? "</rte>\n" : "</trk>\n" );
 }
 
-static void gpx_write_header( FILE *f, VikTrwLayer *vtl, GpxWritingContext *context )
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+} gpx_jobs_sync_t;
+
+typedef struct {
+  VikTrack *trk;
+  GpxWritingContext context; // With its own output buffer, not attached to the file
+  gboolean done;
+} gpx_track_job_t;
+
+static void gpx_write_track_job ( gpx_track_job_t *job, gpx_jobs_sync_t *sync )
 {
+  gpx_write_track ( job->trk, &job->context );
+  g_mutex_lock ( &sync->mutex );
+  job->done = TRUE;
+  g_cond_broadcast ( &sync->cond );
+  g_mutex_unlock ( &sync->mutex );
+}
+
+/**
+ * Write the list of #VikTrack in order
+ *
+ * When there is plenty to write, tracks are formatted concurrently into separate buffers,
+ *  which are then output in the list order - so the result is identical to writing sequentially.
+ */
+static void gpx_write_tracks ( GList *tracks, GpxWritingContext *context )
+{
+  guint n_tracks = 0;
+  gulong n_points = 0;
+  for ( GList *iter = tracks; iter != NULL; iter = g_list_next(iter) ) {
+    n_tracks++;
+    n_points += vik_track_get_tp_count ( VIK_TRACK(iter->data) );
+  }
+
+  if ( n_tracks < 2 || n_points < write_parallel_threshold ) {
+    for ( GList *iter = tracks; iter != NULL; iter = g_list_next(iter) )
+      gpx_write_track ( VIK_TRACK(iter->data), context );
+    return;
+  }
+
+  guint threads = CLAMP ( util_get_number_of_cpus(), 1, n_tracks );
+  // Only allow a few tracks to be formatted ahead of the one being output,
+  //  so memory usage remains bounded
+  guint ahead = threads * 2;
+
+  gpx_jobs_sync_t sync;
+  g_mutex_init ( &sync.mutex );
+  g_cond_init ( &sync.cond );
+  GThreadPool *pool = g_thread_pool_new ( (GFunc)gpx_write_track_job, &sync, threads, FALSE, NULL );
+  gpx_track_job_t *jobs = g_new0 ( gpx_track_job_t, n_tracks );
+
+  GList *next = tracks;
+  guint pushed = 0;
+  for ( guint ii = 0; ii < n_tracks; ii++ ) {
+    while ( pushed < n_tracks && pushed < ii + ahead ) {
+      gpx_track_job_t *job = &jobs[pushed];
+      job->trk = VIK_TRACK(next->data);
+      job->context = *context;
+      job->context.file = NULL;
+      job->context.out = g_string_sized_new ( 4096 );
+      job->context.date_str[0] = '\0';
+      g_thread_pool_push ( pool, job, NULL );
+      next = g_list_next ( next );
+      pushed++;
+    }
+
+    g_mutex_lock ( &sync.mutex );
+    while ( !jobs[ii].done )
+      g_cond_wait ( &sync.cond, &sync.mutex );
+    g_mutex_unlock ( &sync.mutex );
+
+    g_string_append_len ( context->out, jobs[ii].context.out->str, jobs[ii].context.out->len );
+    g_string_free ( jobs[ii].context.out, TRUE );
+    gpx_flush ( context, FALSE );
+  }
+
+  g_thread_pool_free ( pool, FALSE, TRUE );
+  g_free ( jobs );
+  g_cond_clear ( &sync.cond );
+  g_mutex_clear ( &sync.mutex );
+}
+
+/**
+ * a_gpx_set_write_parallel_threshold:
+ * @points: Total number of trackpoints from which tracks are written concurrently
+ *
+ * Mainly for testing, to force the concurrent writing on small files
+ */
+void a_gpx_set_write_parallel_threshold ( guint points )
+{
+  write_parallel_threshold = points;
+}
+
+/**
+ * Also starts the output buffering, which lasts until gpx_write_footer()
+ */
+static void gpx_write_header( GpxWritingContext *context, VikTrwLayer *vtl )
+{
+  context->out = g_string_sized_new ( GPX_WRITE_BUFFER_SIZE + 4096 );
+  GString *gs = context->out;
+
   // Allow overriding the creator value
   // E.g. if something actually cares about it, see for example:
   //   http://strava.github.io/api/v3/uploads/
@@ -1894,7 +2219,7 @@ static void gpx_write_header( FILE *f, VikTrwLayer *vtl, GpxWritingContext *cont
     creator = g_strdup_printf("Viking %s -- %s", PACKAGE_VERSION, PACKAGE_URL);
   }
 
-  fprintf(f, "<?xml version=\"1.0\"?>\n");
+  g_string_append(gs, "<?xml version=\"1.0\"?>\n");
 
   gpx_version_t version = GPX_V1_0;
   if ( vtl )
@@ -1903,17 +2228,17 @@ static void gpx_write_header( FILE *f, VikTrwLayer *vtl, GpxWritingContext *cont
     version = context->options->version;
 
   if ( version == GPX_V1_1 ) {
-    fprintf(f, "<gpx version=\"1.1\"\n");
-    fprintf(f, "creator=\"%s\"\n", creator);
+    g_string_append(gs, "<gpx version=\"1.1\"\n");
+    g_string_append_printf(gs, "creator=\"%s\"\n", creator);
     // If we already have a ready to use header then use that
     gchar *header = NULL;
     if ( vtl )
       header = vik_trw_layer_get_gpx_header ( vtl );
     if ( header )
-      fprintf(f, "%s%s", header, ">\n");
+      g_string_append_printf(gs, "%s%s", header, ">\n");
     else
       // Otherwise write a load of xmlns stuff, even if we don't actually end up using any extensions
-      fprintf(f, "xmlns=\"http://www.topografix.com/GPX/1/1\" "
+      g_string_append(gs, "xmlns=\"http://www.topografix.com/GPX/1/1\" "
                  "xmlns:gpxx=\"http://www.garmin.com/xmlschemas/GpxExtensions/v3\" "
                  "xmlns:wptx1=\"http://www.garmin.com/xmlschemas/WaypointExtension/v1\" "
                  "xmlns:gpxtpx=\"http://www.garmin.com/xmlschemas/TrackPointExtension/v2\" "
@@ -1921,18 +2246,24 @@ static void gpx_write_header( FILE *f, VikTrwLayer *vtl, GpxWritingContext *cont
                  "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" "
                  "xsi:schemaLocation=\"http://www.topografix.com/GPX/1/1 http://www.topografix.com/GPX/1/1/gpx.xsd http://www.garmin.com/xmlschemas/GpxExtensions/v3 http://www8.garmin.com/xmlschemas/GpxExtensionsv3.xsd http://www.garmin.com/xmlschemas/WaypointExtension/v1 http://www8.garmin.com/xmlschemas/WaypointExtensionv1.xsd http://www.garmin.com/xmlschemas/TrackPointExtension/v2 http://www.garmin.com/xmlschemas/TrackPointExtensionv2.xsd http://www.garmin.com/xmlschemas/PowerExtensionv1.xsd\">\n");
   } else {
-    fprintf(f, "<gpx version=\"1.0\"\n");
-    fprintf(f, "creator=\"%s\"\n", creator);
-    fprintf(f,"xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n"
+    g_string_append(gs, "<gpx version=\"1.0\"\n");
+    g_string_append_printf(gs, "creator=\"%s\"\n", creator);
+    g_string_append(gs,"xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n"
               "xmlns=\"http://www.topografix.com/GPX/1/0\"\n"
               "xsi:schemaLocation=\"http://www.topografix.com/GPX/1/0 http://www.topografix.com/GPX/1/0/gpx.xsd\">\n");
   }
   g_free(creator);
 }
 
-static void gpx_write_footer( FILE *f )
+/**
+ * Outputs everything still buffered and ends the buffering
+ */
+static void gpx_write_footer( GpxWritingContext *context )
 {
-  fprintf(f, "</gpx>\n");
+  g_string_append(context->out, "</gpx>\n");
+  gpx_flush ( context, TRUE );
+  g_string_free ( context->out, TRUE );
+  context->out = NULL;
 }
 
 static int gpx_waypoint_compare(const void *x, const void *y)
@@ -1953,7 +2284,8 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, c
 {
   GpxWritingContext context = { options, f, dirpath, vtl };
 
-  gpx_write_header ( f, vtl, &context );
+  gpx_write_header ( &context, vtl );
+  GString *gs = context.out;
 
   const gchar *name = vik_layer_get_name(VIK_LAYER(vtl));
 
@@ -1962,35 +2294,35 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, c
     version = options->version;
 
   if ( version == GPX_V1_0 )
-    write_string ( f, TRK_SPACES, "name", name );
+    write_string ( gs, TRK_SPACES, "name", name );
 
   VikTRWMetadata *md = vik_trw_layer_get_metadata (vtl);
   if ( md ) {
     if ( version == GPX_V1_1 ) {
-      fprintf ( f, "  <metadata>\n" );
-      write_string ( f, 4, "name", name );
+      g_string_append ( gs, "  <metadata>\n" );
+      write_string ( gs, 4, "name", name );
       if ( md->author && strlen(md->author) > 0 )
-        fprintf ( f, "    <author><name>%s</name></author>\n", md->author );
-      write_string ( f, 4, "desc", md->description );
-      write_link ( f, 4, md->url, md->url_name, NULL );
-      write_string ( f, 4, "time", md->timestamp );
-      write_string ( f, 4, "keywords", md->keywords );
-      fprintf ( f, "  </metadata>\n" );
+        g_string_append_printf ( gs, "    <author><name>%s</name></author>\n", md->author );
+      write_string ( gs, 4, "desc", md->description );
+      write_link ( gs, 4, md->url, md->url_name, NULL );
+      write_string ( gs, 4, "time", md->timestamp );
+      write_string ( gs, 4, "keywords", md->keywords );
+      g_string_append ( gs, "  </metadata>\n" );
     }
     else {
-      write_string ( f, TRK_SPACES, "author", md->author );
-      write_string ( f, TRK_SPACES, "desc", md->description );
-      write_string ( f, TRK_SPACES, "url", md->url );
-      write_string ( f, TRK_SPACES, "urlname", md->url_name );
-      write_string ( f, TRK_SPACES, "time", md->timestamp );
-      write_string ( f, TRK_SPACES, "keywords", md->keywords );
+      write_string ( gs, TRK_SPACES, "author", md->author );
+      write_string ( gs, TRK_SPACES, "desc", md->description );
+      write_string ( gs, TRK_SPACES, "url", md->url );
+      write_string ( gs, TRK_SPACES, "urlname", md->url_name );
+      write_string ( gs, TRK_SPACES, "time", md->timestamp );
+      write_string ( gs, TRK_SPACES, "keywords", md->keywords );
     }
   }
   else {
     if ( version == GPX_V1_1 ) {
-      fprintf ( f, "  <metadata>\n" );
-      write_string ( f, 4, "name", name );
-      fprintf ( f, "  </metadata>\n" );
+      g_string_append ( gs, "  <metadata>\n" );
+      write_string ( gs, 4, "name", name );
+      g_string_append ( gs, "  </metadata>\n" );
     }
   }
 
@@ -2041,16 +2373,12 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, c
     context_tmp.options = &opt_tmp;
   context_tmp.options->is_route = FALSE;
 
-  // Loop around each list and write each one
-  for (GList *iter = g_list_first (gl); iter != NULL; iter = g_list_next (iter)) {
-    gpx_write_track ( (VikTrack*)iter->data, &context_tmp );
-  }
+  // Write each list in turn
+  gpx_write_tracks ( gl, &context_tmp );
 
   // Routes (to get routepoints)
   context_tmp.options->is_route = TRUE;
-  for (GList *iter = g_list_first (glrte); iter != NULL; iter = g_list_next (iter)) {
-    gpx_write_track ( (VikTrack*)iter->data, &context_tmp );
-  }
+  gpx_write_tracks ( glrte, &context_tmp );
 
   g_list_free ( gl );
   g_list_free ( glrte );
@@ -2058,10 +2386,10 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, c
   if ( opt_tmp.version == GPX_V1_1 ) {
     gchar *ext = vik_trw_layer_get_gpx_extensions ( vtl );
     if ( ext )
-      write_string_as_is ( f, 0, "extensions", ext );
+      write_string_as_is ( gs, 0, "extensions", ext );
   }
 
-  gpx_write_footer ( f );
+  gpx_write_footer ( &context );
 }
 
 /*
@@ -2075,9 +2403,9 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options, c
 void a_gpx_write_track_file ( VikTrwLayer *vtl, VikTrack *trk, FILE *f, GpxWritingOptions *options )
 {
   GpxWritingContext context = { options, f, NULL, NULL };
-  gpx_write_header ( f, vtl, &context );
+  gpx_write_header ( &context, vtl );
   gpx_write_track ( trk, &context );
-  gpx_write_footer ( f );
+  gpx_write_footer ( &context );
 }
 
 /**
@@ -2176,9 +2504,9 @@ void a_gpx_write_combined_file ( const gchar *name, GList *vtt, GList *vtwl, FIL
   g_return_if_fail ( options != NULL );
 
   GpxWritingContext context = { options, ff, dirpath, NULL };
-  gpx_write_header ( ff, NULL, &context );
+  gpx_write_header ( &context, NULL );
 
-  write_string ( ff, TRK_SPACES, "name", name );
+  write_string ( context.out, TRK_SPACES, "name", name );
   // NB No overall metadata readily available, so don't bother
 
   GList *gl = NULL;
@@ -2187,26 +2515,34 @@ void a_gpx_write_combined_file ( const gchar *name, GList *vtt, GList *vtwl, FIL
     gpx_write_waypoint ( ((vik_trw_waypoint_list_t*)iter->data)->wpt, &context );
 
   // Sort method determined by preference
+  gl = vtt;
   if ( a_vik_get_gpx_export_trk_sort() == VIK_GPX_EXPORT_TRK_SORT_TIME )
     gl = g_list_sort ( vtt, track_compare_timestamp_vtt );
   else if ( a_vik_get_gpx_export_trk_sort() == VIK_GPX_EXPORT_TRK_SORT_ALPHA )
     gl = g_list_sort ( vtt, track_compare_name_vtt );
 
-  // Tracks First
+  GList *tracks = NULL;
+  GList *routes = NULL;
   for ( GList *iter = gl; iter != NULL; iter = g_list_next(iter) ) {
     VikTrack *trk = ((vik_trw_and_track_t*)iter->data)->trk;
-    if ( !trk->is_route )
-      gpx_write_track ( trk, &context );
+    if ( trk->is_route )
+      routes = g_list_prepend ( routes, trk );
+    else
+      tracks = g_list_prepend ( tracks, trk );
   }
+  tracks = g_list_reverse ( tracks );
+  routes = g_list_reverse ( routes );
+
+  // Tracks First
+  gpx_write_tracks ( tracks, &context );
 
   context.options->is_route = TRUE;
 
   // Finally Routes
-  for ( GList *iter = gl; iter != NULL; iter = g_list_next(iter) ) {
-    VikTrack *trk = ((vik_trw_and_track_t*)iter->data)->trk;
-    if ( trk->is_route )
-      gpx_write_track ( trk, &context );
-  }
+  gpx_write_tracks ( routes, &context );
+
+  g_list_free ( tracks );
+  g_list_free ( routes );
 
-  gpx_write_footer ( ff );
+  gpx_write_footer ( &context );
 }
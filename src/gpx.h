@@ -41,12 +41,20 @@ typedef struct {
 char *a_gpx_entitize(const char * str);
 
 gboolean a_gpx_read_file ( VikTrwLayer *trw, FILE *f, const gchar* dirpath, gboolean append );
+
+// For reading GPX data as it becomes available
+typedef struct _GpxReader GpxReader;
+GpxReader *a_gpx_reader_new ( VikTrwLayer *vtl, const gchar* dirpath, gboolean append );
+gboolean a_gpx_reader_feed ( GpxReader *gr, const gchar *buf, gsize len );
+gboolean a_gpx_reader_finish ( GpxReader *gr );
 void a_gpx_write_file ( VikTrwLayer *trw, FILE *f, GpxWritingOptions *options, const gchar *dirpath );
 void a_gpx_write_track_file ( VikTrwLayer *trw, VikTrack *trk, FILE *f, GpxWritingOptions *options );
 
 gchar* a_gpx_write_tmp_file ( VikTrwLayer *vtl, GpxWritingOptions *options );
 gchar* a_gpx_write_track_tmp_file ( VikTrwLayer *vtl, VikTrack *trk, GpxWritingOptions *options );
 
+void a_gpx_set_write_parallel_threshold ( guint points );
+
 void a_gpx_write_combined_file ( const gchar *name, GList *vtt, GList *vtwl, FILE *ff, GpxWritingOptions *options, const gchar *dirpath );
 
 G_END_DECLS
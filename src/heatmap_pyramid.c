@@ -0,0 +1,306 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Heatmap generation spread over several threads,
+ *  with the result kept as a multi-resolution set of levels
+ *  so that it can be drawn at other zoom levels without being regenerated.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <math.h>
+#include <string.h>
+
+#include "heatmap_pyramid.h"
+#include "globals.h"
+#include "viktrack.h"
+#include "ui_util.h"
+#include "util.h"
+
+// Don't bother with levels smaller than this
+#define HEATMAP_PYRAMID_MIN_SIZE 32
+
+typedef struct {
+  GPtrArray *tracks;
+  const HeatmapArea *area;
+  const heatmap_stamp_t *stamp;
+  guint threads;
+  gint done;    // Number of tracks processed (atomic)
+  gint cancel;  // (atomic)
+} hm_gen_t;
+
+typedef struct {
+  hm_gen_t *gen;
+  guint index;
+  heatmap_t *hm;  // This thread's partial heatmap
+} hm_part_t;
+
+/**
+ * c.f. vik_viewport_coord_to_screen() but for the area's zoom level & Mercator only
+ */
+static void hm_stamp_track ( const HeatmapArea *area, const heatmap_stamp_t *stamp, VikTrack *trk, heatmap_t *hm )
+{
+  gdouble center_merclat = MERCLAT(area->center.lat);
+  for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    // Only do trackpoints with timestamps
+    // - i.e. hopefully to avoid artificial tracks
+    if ( isnan(tp->timestamp) )
+      continue;
+    struct LatLon *ll = (struct LatLon *)&tp->coord;
+    int xx = (int)(area->width/2 + ( area->mf * (ll->lon - area->center.lon) ));
+    int yy = (int)(area->height/2 + ( area->mf * ( center_merclat - MERCLAT(ll->lat) ) ));
+    // NB Negative values become too large and so are ignored
+    heatmap_add_point_with_stamp ( hm, xx, yy, stamp );
+  }
+}
+
+/**
+ * Each part takes every nth track, which keeps the amount of work reasonably even
+ */
+static gboolean hm_part_next ( hm_part_t *part, guint *ii )
+{
+  hm_gen_t *gen = part->gen;
+  if ( g_atomic_int_get(&gen->cancel) || *ii >= gen->tracks->len )
+    return FALSE;
+
+  VikTrack *trk = g_ptr_array_index ( gen->tracks, *ii );
+  if ( BBOX_INTERSECT(trk->bbox, gen->area->bbox) )
+    hm_stamp_track ( gen->area, gen->stamp, trk, part->hm );
+  g_atomic_int_inc ( &gen->done );
+  *ii += gen->threads;
+  return TRUE;
+}
+
+static void hm_part_job ( hm_part_t *part, gpointer user_data )
+{
+  guint ii = part->index;
+  while ( hm_part_next(part, &ii) )
+    ;
+}
+
+/**
+ * Combine the partial results into the first one
+ */
+static heatmap_t *hm_reduce ( hm_part_t *parts, guint num )
+{
+  heatmap_t *hm = parts[0].hm;
+  gsize size = (gsize)hm->w * hm->h;
+  for ( guint nn = 1; nn < num; nn++ ) {
+    const float *src = parts[nn].hm->buf;
+    for ( gsize ii = 0; ii < size; ii++ )
+      hm->buf[ii] += src[ii];
+    heatmap_free ( parts[nn].hm );
+  }
+  hm->max = 0.0;
+  for ( gsize ii = 0; ii < size; ii++ )
+    if ( hm->buf[ii] > hm->max )
+      hm->max = hm->buf[ii];
+  return hm;
+}
+
+/**
+ * Halve the size, by summing each 2x2 block of pixels
+ */
+static heatmap_t *hm_downsample ( const heatmap_t *src )
+{
+  guint ww = (src->w + 1) / 2;
+  guint hh = (src->h + 1) / 2;
+  heatmap_t *hm = heatmap_new ( ww, hh );
+  for ( guint yy = 0; yy < src->h; yy++ ) {
+    const float *line = src->buf + (gsize)yy * src->w;
+    float *dst = hm->buf + (gsize)(yy/2) * ww;
+    for ( guint xx = 0; xx < src->w; xx++ )
+      dst[xx/2] += line[xx];
+  }
+  gsize size = (gsize)ww * hh;
+  for ( gsize ii = 0; ii < size; ii++ )
+    if ( hm->buf[ii] > hm->max )
+      hm->max = hm->buf[ii];
+  return hm;
+}
+
+static void hm_level_init ( HeatmapLevel *level, heatmap_t *hm )
+{
+  level->hm = hm;
+  level->tiles_x = (hm->w + HEATMAP_TILE_SIZE - 1) / HEATMAP_TILE_SIZE;
+  level->tiles_y = (hm->h + HEATMAP_TILE_SIZE - 1) / HEATMAP_TILE_SIZE;
+  level->tiles = g_new0 ( GdkPixbuf*, level->tiles_x * level->tiles_y );
+}
+
+/**
+ * a_heatmap_pyramid_generate:
+ * @tracks:    A list of #VikTrack (in Lat/Lon coordinates)
+ * @area:      The area to cover
+ * @stamp:     The stamp to apply for each trackpoint
+ * @threads:   The number of threads to use; 0 means one per processor
+ * @progress:  Optional progress function, called from this thread
+ *
+ * The tracks are shared out amongst the threads, each of which stamps into its own buffer.
+ * These are added together once all the tracks have been processed.
+ *
+ * Returns: The generated heatmap, or NULL if cancelled
+ */
+HeatmapPyramid *a_heatmap_pyramid_generate ( GList *tracks,
+                                             const HeatmapArea *area,
+                                             const heatmap_stamp_t *stamp,
+                                             guint threads,
+                                             HeatmapProgressFunc progress,
+                                             gpointer user_data )
+{
+  hm_gen_t gen;
+  gen.tracks = g_ptr_array_new ();
+  for ( GList *iter = tracks; iter; iter = iter->next )
+    g_ptr_array_add ( gen.tracks, iter->data );
+  gen.area = area;
+  gen.stamp = stamp;
+  gen.done = 0;
+  gen.cancel = 0;
+  if ( threads == 0 )
+    threads = util_get_number_of_cpus ();
+  // Each thread needs a whole buffer, so no point having more than there are tracks
+  gen.threads = CLAMP ( MIN(threads, gen.tracks->len), 1, 64 );
+
+  hm_part_t *parts = g_new0 ( hm_part_t, gen.threads );
+  for ( guint nn = 0; nn < gen.threads; nn++ ) {
+    parts[nn].gen = &gen;
+    parts[nn].index = nn;
+    parts[nn].hm = heatmap_new ( area->width, area->height );
+  }
+
+  GThreadPool *pool = NULL;
+  if ( gen.threads > 1 ) {
+    pool = g_thread_pool_new ( (GFunc)hm_part_job, NULL, gen.threads-1, FALSE, NULL );
+    for ( guint nn = 1; nn < gen.threads; nn++ )
+      g_thread_pool_push ( pool, &parts[nn], NULL );
+  }
+
+  // This thread does the first part, whilst reporting the overall progress
+  guint ii = 0;
+  while ( hm_part_next(&parts[0], &ii) ) {
+    if ( progress && !progress((gdouble)g_atomic_int_get(&gen.done)/gen.tracks->len, user_data) )
+      g_atomic_int_set ( &gen.cancel, 1 );
+  }
+  if ( pool )
+    g_thread_pool_free ( pool, FALSE, TRUE );
+
+  g_ptr_array_free ( gen.tracks, TRUE );
+
+  if ( g_atomic_int_get(&gen.cancel) ) {
+    for ( guint nn = 0; nn < gen.threads; nn++ )
+      heatmap_free ( parts[nn].hm );
+    g_free ( parts );
+    return NULL;
+  }
+
+  HeatmapPyramid *hp = g_new0 ( HeatmapPyramid, 1 );
+  hm_level_init ( &hp->levels[0], hm_reduce(parts, gen.threads) );
+  hp->num_levels = 1;
+  g_free ( parts );
+
+  while ( hp->num_levels < HEATMAP_PYRAMID_MAX_LEVELS ) {
+    const heatmap_t *prev = hp->levels[hp->num_levels-1].hm;
+    if ( prev->w < HEATMAP_PYRAMID_MIN_SIZE*2 || prev->h < HEATMAP_PYRAMID_MIN_SIZE*2 )
+      break;
+    hm_level_init ( &hp->levels[hp->num_levels], hm_downsample(prev) );
+    hp->num_levels++;
+  }
+
+  return hp;
+}
+
+static void hm_img_free ( guchar *pixels, gpointer data )
+{
+  g_free ( pixels );
+}
+
+/**
+ * a_heatmap_pyramid_get_tile:
+ * @cs:    The colour scheme; NULL for the default
+ *
+ * Colour in the tile if it hasn't been done already.
+ * Should only be used from the main thread.
+ *
+ * Returns: The tile's image (owned by the pyramid), which may be NULL
+ */
+GdkPixbuf *a_heatmap_pyramid_get_tile ( HeatmapPyramid *hp,
+                                        guint level,
+                                        guint tx,
+                                        guint ty,
+                                        const heatmap_colorscheme_t *cs,
+                                        guint8 alpha )
+{
+  g_return_val_if_fail ( level < hp->num_levels, NULL );
+  HeatmapLevel *hl = &hp->levels[level];
+  if ( tx >= hl->tiles_x || ty >= hl->tiles_y )
+    return NULL;
+
+  guint index = ty * hl->tiles_x + tx;
+  if ( hl->tiles[index] )
+    return hl->tiles[index];
+
+  guint x0 = tx * HEATMAP_TILE_SIZE;
+  guint y0 = ty * HEATMAP_TILE_SIZE;
+  guint ww = MIN ( HEATMAP_TILE_SIZE, hl->hm->w - x0 );
+  guint hh = MIN ( HEATMAP_TILE_SIZE, hl->hm->h - y0 );
+
+  // Render via a heatmap of just this tile, normalized to the whole level
+  float *buf = g_malloc ( ww * hh * sizeof(float) );
+  for ( guint yy = 0; yy < hh; yy++ )
+    memcpy ( buf + yy*ww, hl->hm->buf + (gsize)(y0+yy) * hl->hm->w + x0, ww * sizeof(float) );
+  heatmap_t tile = { buf, hl->hm->max, ww, hh };
+
+  guchar *image = g_malloc ( ww*hh*4 );
+  (void)heatmap_render_to ( &tile, cs ? cs : heatmap_cs_default, image );
+  g_free ( buf );
+
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data ( image, GDK_COLORSPACE_RGB, TRUE, 8, ww, hh, 4*ww, hm_img_free, NULL );
+  hl->tiles[index] = ui_pixbuf_set_alpha ( pixbuf, alpha );
+  return hl->tiles[index];
+}
+
+/**
+ * a_heatmap_pyramid_clear_tiles:
+ *
+ * Forget the rendered tiles, e.g. when the colours have been changed
+ */
+void a_heatmap_pyramid_clear_tiles ( HeatmapPyramid *hp )
+{
+  for ( guint ll = 0; ll < hp->num_levels; ll++ ) {
+    HeatmapLevel *hl = &hp->levels[ll];
+    for ( guint ii = 0; ii < hl->tiles_x * hl->tiles_y; ii++ ) {
+      if ( hl->tiles[ii] ) {
+        g_object_unref ( hl->tiles[ii] );
+        hl->tiles[ii] = NULL;
+      }
+    }
+  }
+}
+
+void a_heatmap_pyramid_free ( HeatmapPyramid *hp )
+{
+  if ( !hp )
+    return;
+  a_heatmap_pyramid_clear_tiles ( hp );
+  for ( guint ll = 0; ll < hp->num_levels; ll++ ) {
+    g_free ( hp->levels[ll].tiles );
+    heatmap_free ( hp->levels[ll].hm );
+  }
+  g_free ( hp );
+}
@@ -0,0 +1,86 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_HEATMAP_PYRAMID_H
+#define _VIKING_HEATMAP_PYRAMID_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "coords.h"
+#include "bbox.h"
+#include "misc/heatmap.h"
+
+G_BEGIN_DECLS
+
+// Each level is rendered in tiles of this many pixels square
+#define HEATMAP_TILE_SIZE 256
+#define HEATMAP_PYRAMID_MAX_LEVELS 10
+
+/**
+ * The (Mercator) area to generate the heatmap for
+ */
+typedef struct {
+  struct LatLon center;
+  gdouble mf;          // Pixels per degree, as from mercator_factor()
+  guint width, height; // Pixels
+  LatLonBBox bbox;
+} HeatmapArea;
+
+typedef struct {
+  heatmap_t *hm;       // The density values
+  guint tiles_x, tiles_y;
+  GdkPixbuf **tiles;   // Rendered on demand
+} HeatmapLevel;
+
+/**
+ * Level 0 is at the resolution of the area,
+ *  then each following level is half the size of the previous one
+ *  (each pixel being the sum of the 2x2 pixels below).
+ */
+typedef struct {
+  guint num_levels;
+  HeatmapLevel levels[HEATMAP_PYRAMID_MAX_LEVELS];
+} HeatmapPyramid;
+
+/**
+ * Return FALSE to cancel the generation
+ */
+typedef gboolean (*HeatmapProgressFunc) ( gdouble fraction, gpointer user_data );
+
+HeatmapPyramid *a_heatmap_pyramid_generate ( GList *tracks,
+                                             const HeatmapArea *area,
+                                             const heatmap_stamp_t *stamp,
+                                             guint threads,
+                                             HeatmapProgressFunc progress,
+                                             gpointer user_data );
+
+GdkPixbuf *a_heatmap_pyramid_get_tile ( HeatmapPyramid *hp,
+                                        guint level,
+                                        guint tx,
+                                        guint ty,
+                                        const heatmap_colorscheme_t *cs,
+                                        guint8 alpha );
+
+void a_heatmap_pyramid_clear_tiles ( HeatmapPyramid *hp );
+
+void a_heatmap_pyramid_free ( HeatmapPyramid *hp );
+
+G_END_DECLS
+
+#endif
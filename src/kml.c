@@ -22,8 +22,8 @@
 
 #include "kml.h"
 #include "viking.h"
+#include "gpx.h"
 #include <expat.h>
-#include "ctype.h"
 
 typedef enum {
 	KML_COLOR_MODE_NORMAL=0,
@@ -49,6 +49,15 @@ typedef struct {
 typedef struct {
 	GString *c_cdata;
 	gboolean use_cdata;
+	// LineString coordinates are parsed as the character data arrives,
+	//  since there may be a very large number of them
+	gboolean use_coords;
+	gchar coord_buf[G_ASCII_DTOSTR_BUF_SIZE]; // The number currently being read
+	guint coord_len;
+	gdouble coord_vals[3];
+	guint coord_val;      // Number of parts of the current 'lon,lat(,alt)' tuple
+	gboolean coord_newseg;
+	gboolean coord_bad;   // Stop reading coordinates once invalid
 	gchar *name;
 	gchar *snippet;
 	gchar *desc;
@@ -294,71 +303,85 @@ static void point_start ( xml_data *xd, const char *el, const char **attr )
 	xd->waypoint = vik_waypoint_new();
 }
 
-static void linestring_coordinates_end ( xml_data *xd, const char *el )
+// End of a number within the coordinates
+static void coords_value_end ( xml_data *xd )
 {
-	if ( xd->track ) {
-		gchar *ptr = xd->c_cdata->str;
-		if ( ptr ) {
-			int len = strlen(ptr);
-			gchar *endptr = ptr + len;
-			gchar *cp;
-			for ( cp = ptr; cp < endptr; cp++ )
-				if ( !isspace(*cp) )
-					break;
-
-			gboolean newseg = TRUE;
-			int val = 0;
-			gdouble values[3];
-			gchar *vp;
-			for ( vp = cp; cp <= endptr; cp++ ) {
-				if ( *cp == ',' ) {
-					// Get string before this comma
-					gchar *str = g_malloc0 ( cp-vp+1 );
-					strncpy ( str, vp, cp-vp );
-					values[val] = g_ascii_strtod ( str, NULL );
-					g_free ( str );
-					val++;
-					vp = cp + 1; // +1 for the next one after the comma
-				} else if ( cp == NULL || isspace(*cp) ) {
-					if ( val < 1 || val > 2 )
-						// Not enough or too many coordinate parts
-						goto end;
-					// Otherwise the value is to end of text block
-					//  (should be the last coordinate part)
-					gchar *str = g_malloc0 ( cp-vp+1 );
-					strncpy ( str, vp, cp-vp );
-					values[val] = g_ascii_strtod ( str, NULL );
-					g_free ( str );
-
-					VikTrackpoint *tp = vik_trackpoint_new();
-					// Remember KML coordinates are the 'lon,lat(,alt)' order
-					set_vc_to_ll ( xd, &(tp->coord), xd->vtl, values[1], values[0] );
-					if ( val == 2 )
-						// ATM altitude is always interpreted to be in absolute mode (to sea level)
-						tp->altitude = values[2];
-					if ( newseg ) {
-						tp->newsegment = TRUE;
-						newseg = FALSE;
-					}
+	if ( xd->coord_val < G_N_ELEMENTS(xd->coord_vals) ) {
+		xd->coord_buf[xd->coord_len] = '\0';
+		xd->coord_vals[xd->coord_val] = g_ascii_strtod ( xd->coord_buf, NULL );
+	}
+	xd->coord_val++;
+	xd->coord_len = 0;
+}
 
-					xd->track->trackpoints = g_list_prepend ( xd->track->trackpoints, tp );
+// End of a 'lon,lat(,alt)' tuple
+static void coords_tuple_end ( xml_data *xd )
+{
+	coords_value_end ( xd );
+	if ( xd->coord_val < 2 || xd->coord_val > 3 ) {
+		// Not enough or too many coordinate parts
+		g_warning ( "%s: expected 2 or 3 coordinate parts but got %d at line %ld", G_STRLOC, xd->coord_val, XML_GetCurrentLineNumber(xd->parser) );
+		xd->coord_bad = TRUE;
+		return;
+	}
 
-					// Consume any extra space to get to the next coordinate part
-					while ( cp != NULL && isspace(*cp) )
-						cp++;
-					val = 0;
-					vp = cp;
-				}
-			}
+	VikTrackpoint *tp = vik_trackpoint_new();
+	// Remember KML coordinates are the 'lon,lat(,alt)' order
+	set_vc_to_ll ( xd, &(tp->coord), xd->vtl, xd->coord_vals[1], xd->coord_vals[0] );
+	if ( xd->coord_val == 3 )
+		// ATM altitude is always interpreted to be in absolute mode (to sea level)
+		tp->altitude = xd->coord_vals[2];
+	if ( xd->coord_newseg ) {
+		tp->newsegment = TRUE;
+		xd->coord_newseg = FALSE;
+	}
+	xd->track->trackpoints = g_list_prepend ( xd->track->trackpoints, tp );
+	xd->coord_val = 0;
+}
+
+// Tuples are separated by whitespace and the parts by commas
+// NB character data may be split anywhere, even in the middle of a number
+static void coords_parse ( xml_data *xd, const XML_Char *ss, int len )
+{
+	for ( int ii = 0; ii < len && !xd->coord_bad; ii++ ) {
+		const gchar cc = ss[ii];
+		if ( cc == ',' )
+			coords_value_end ( xd );
+		else if ( g_ascii_isspace(cc) ) {
+			if ( xd->coord_len || xd->coord_val )
+				coords_tuple_end ( xd );
 		}
+		else if ( xd->coord_len < sizeof(xd->coord_buf)-1 )
+			xd->coord_buf[xd->coord_len++] = cc;
+	}
+}
+
+static void linestring_coordinates_end ( xml_data *xd, const char *el )
+{
+	if ( xd->track ) {
+		// Final tuple when not followed by any whitespace
+		if ( !xd->coord_bad && (xd->coord_len || xd->coord_val) )
+			coords_tuple_end ( xd );
 	}
 	else
 		g_warning ( "%s: no track", G_STRLOC );
 
-end:
+	xd->use_coords = FALSE;
 	end_leaf_tag ( xd );
 }
 
+static void setup_to_read_coordinates ( xml_data *xd, gpointer old_end_func )
+{
+	setup_to_read_leaf_tag ( xd, old_end_func, linestring_coordinates_end );
+	// Not collected into the buffer
+	xd->use_cdata = FALSE;
+	xd->use_coords = TRUE;
+	xd->coord_len = 0;
+	xd->coord_val = 0;
+	xd->coord_newseg = TRUE;
+	xd->coord_bad = FALSE;
+}
+
 static void add_track ( xml_data *xd )
 {
 	if ( xd->track ) {
@@ -404,7 +427,7 @@ static void linestring_start ( xml_data *xd, const char *el, const char **attr )
 {
 	// ATM ignoring at least 'extrude', 'tessellate' & 'altitudeMode'
 	if ( g_strcmp0 ( el, "coordinates" ) == 0 ) {
-		setup_to_read_leaf_tag ( xd, linestring_end, linestring_coordinates_end );
+		setup_to_read_coordinates ( xd, linestring_end );
 	}
 }
 
@@ -424,7 +447,7 @@ static void linearring_start ( xml_data *xd, const char *el, const char **attr )
 {
 	// ATM ignoring at least 'extrude', 'tessellate' & 'altitudeMode'
 	if ( g_strcmp0 ( el, "coordinates" ) == 0 ) {
-		setup_to_read_leaf_tag ( xd, linearring_end, linestring_coordinates_end );
+		setup_to_read_coordinates ( xd, linearring_end );
 	}
 }
 
@@ -504,6 +527,11 @@ static void track_end ( xml_data *xd, const char *el )
 				g_free ( xd->desc );
 				xd->desc = NULL;
 			}
+			if ( xd->styleUrl ) {
+				AnyStyle *as = g_hash_table_lookup ( xd->styles, xd->styleUrl );
+				if ( as )
+					track_set_color ( xd->track, as->color );
+			}
 			xd->track->trackpoints = g_list_reverse ( xd->track->trackpoints );
 			xd->timestamps = g_list_reverse ( xd->timestamps );
 			xd->hrs = g_list_reverse ( xd->hrs );
@@ -747,7 +775,7 @@ static void placemark_start ( xml_data *xd, const char *el, const char **attr )
 		setup_to_read_leaf_tag ( xd, placemark_end, name_end );
 	} else if ( g_strcmp0 ( el, "visibility" ) == 0 ) {
 		setup_to_read_leaf_tag ( xd, placemark_end, visibility_end );
-	} else if ( g_strcmp0 ( el, "snippet" ) == 0 ) {
+	} else if ( g_strcmp0 ( el, "snippet" ) == 0 || g_strcmp0 ( el, "Snippet" ) == 0 ) {
 		setup_to_read_leaf_tag ( xd, placemark_end, snippet_end );
 	} else if ( g_strcmp0 ( el, "description" ) == 0 ) {
 		setup_to_read_leaf_tag ( xd, placemark_end, description_end );
@@ -878,6 +906,9 @@ static void kml_cdata ( xml_data *xd, const XML_Char *ss, int len )
 	if ( xd->use_cdata ) {
 		g_string_append_len ( xd->c_cdata, ss, len );
 	}
+	else if ( xd->use_coords && xd->track ) {
+		coords_parse ( xd, ss, len );
+	}
 }
 
 /**
@@ -943,3 +974,355 @@ gboolean a_kml_read_file ( VikTrwLayer *vtl, FILE *ff )
 	g_free ( xd );
 	return ans;
 }
+
+// Writing
+
+#define KML_NAMESPACES "xmlns=\"http://www.opengis.net/kml/2.2\" xmlns:gx=\"http://www.google.com/kml/ext/2.2\""
+
+static int kml_waypoint_compare ( const void *x, const void *y )
+{
+	return g_strcmp0 ( VIK_WAYPOINT(x)->name, VIK_WAYPOINT(y)->name );
+}
+
+static int kml_track_compare_name ( const void *x, const void *y )
+{
+	return g_strcmp0 ( VIK_TRACK(x)->name, VIK_TRACK(y)->name );
+}
+
+static void kml_write_string ( FILE *ff, const gchar *indent, const gchar *tag, const gchar *value )
+{
+	if ( value && strlen(value) ) {
+		gchar *tmp = a_gpx_entitize ( value );
+		fprintf ( ff, "%s<%s>%s</%s>\n", indent, tag, tmp, tag );
+		g_free ( tmp );
+	}
+}
+
+// An empty value is written for an invalid time, so the <when> values stay in step with the <gx:coord> values
+static void kml_write_when ( FILE *ff, const gchar *indent, gdouble timestamp )
+{
+	gchar *str = NULL;
+	if ( !isnan(timestamp) ) {
+		GTimeVal tv;
+		tv.tv_sec = timestamp;
+		tv.tv_usec = fabs ( (timestamp-(gint64)timestamp)*G_USEC_PER_SEC );
+		str = g_time_val_to_iso8601 ( &tv );
+	}
+	fprintf ( ff, "%s<when>%s</when>\n", indent, str ? str : "" );
+	g_free ( str );
+}
+
+// The parts are written in the KML 'lon,lat(,alt)' order, using the given separator
+static void kml_write_coord ( FILE *ff, const VikCoord *coord, gdouble altitude, gchar sep )
+{
+	struct LatLon ll;
+	gchar lon[COORDS_STR_BUFFER_SIZE];
+	gchar lat[COORDS_STR_BUFFER_SIZE];
+	vik_coord_to_latlon ( coord, &ll );
+	a_coords_dtostr_buffer ( ll.lon, lon );
+	a_coords_dtostr_buffer ( ll.lat, lat );
+	if ( isnan(altitude) )
+		fprintf ( ff, "%s%c%s", lon, sep, lat );
+	else {
+		gchar alt[COORDS_STR_BUFFER_SIZE];
+		a_coords_dtostr_buffer ( altitude, alt );
+		fprintf ( ff, "%s%c%s%c%s", lon, sep, lat, sep, alt );
+	}
+}
+
+static void kml_write_point_placemark ( FILE *ff, const gchar *indent, const gchar *name, const gchar *comment, const gchar *desc,
+                                        gboolean visible, gdouble timestamp, const VikCoord *coord, gdouble altitude )
+{
+	fprintf ( ff, "%s<Placemark>\n", indent );
+	gchar *ind = g_strconcat ( indent, "  ", NULL );
+	kml_write_string ( ff, ind, "name", name );
+	if ( !visible )
+		fprintf ( ff, "%s<visibility>0</visibility>\n", ind );
+	kml_write_string ( ff, ind, "Snippet", comment );
+	kml_write_string ( ff, ind, "description", desc );
+	if ( !isnan(timestamp) ) {
+		gchar *ind2 = g_strconcat ( ind, "  ", NULL );
+		fprintf ( ff, "%s<TimeStamp>\n", ind );
+		kml_write_when ( ff, ind2, timestamp );
+		fprintf ( ff, "%s</TimeStamp>\n", ind );
+		g_free ( ind2 );
+	}
+	fprintf ( ff, "%s<Point>\n%s  <coordinates>", ind, ind );
+	kml_write_coord ( ff, coord, altitude, ',' );
+	fprintf ( ff, "</coordinates>\n%s</Point>\n", ind );
+	fprintf ( ff, "%s</Placemark>\n", indent );
+	g_free ( ind );
+}
+
+static void kml_write_waypoint ( VikWaypoint *wp, FILE *ff, KmlWritingOptions *options )
+{
+	if ( !wp->visible && !options->hidden )
+		return;
+	kml_write_point_placemark ( ff, "      ", wp->name, wp->comment, wp->description, wp->visible, wp->timestamp, &wp->coord, wp->altitude );
+}
+
+// Each segment is written by iterating from the start of it until the next segment
+#define SEGMENT_END(iter) ( !(iter) || VIK_TRACKPOINT((iter)->data)->newsegment )
+
+static void kml_write_linestring ( FILE *ff, const gchar *indent, GList *start )
+{
+	fprintf ( ff, "%s<LineString>\n%s  <tessellate>1</tessellate>\n%s  <coordinates>\n", indent, indent, indent );
+	for ( GList *iter = start; iter; iter = iter->next ) {
+		if ( iter != start && SEGMENT_END(iter) )
+			break;
+		VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+		fprintf ( ff, "%s    ", indent );
+		kml_write_coord ( ff, &tp->coord, tp->altitude, ',' );
+		fputc ( '\n', ff );
+	}
+	fprintf ( ff, "%s  </coordinates>\n%s</LineString>\n", indent, indent );
+}
+
+static void kml_write_array ( FILE *ff, const gchar *indent, const gchar *name, GList *start, gint type )
+{
+	fprintf ( ff, "%s<gx:SimpleArrayData name=\"%s\">\n", indent, name );
+	for ( GList *iter = start; iter; iter = iter->next ) {
+		if ( iter != start && SEGMENT_END(iter) )
+			break;
+		VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+		switch ( type ) {
+		case 0:
+			fprintf ( ff, "%s  <gx:value>%u</gx:value>\n", indent, tp->heart_rate );
+			break;
+		case 1:
+			if ( tp->cadence == VIK_TRKPT_CADENCE_NONE )
+				fprintf ( ff, "%s  <gx:value>nan</gx:value>\n", indent );
+			else
+				fprintf ( ff, "%s  <gx:value>%u</gx:value>\n", indent, tp->cadence );
+			break;
+		default: {
+			gchar buf[COORDS_STR_BUFFER_SIZE];
+			if ( isnan(tp->temp) )
+				g_strlcpy ( buf, "nan", sizeof(buf) );
+			else
+				a_coords_dtostr_buffer ( tp->temp, buf );
+			fprintf ( ff, "%s  <gx:value>%s</gx:value>\n", indent, buf );
+			break;
+		}
+		}
+	}
+	fprintf ( ff, "%s</gx:SimpleArrayData>\n", indent );
+}
+
+static void kml_write_gx_track ( FILE *ff, const gchar *indent, GList *start )
+{
+	gboolean has_hr = FALSE, has_cad = FALSE, has_temp = FALSE;
+
+	fprintf ( ff, "%s<gx:Track>\n", indent );
+	gchar *ind = g_strconcat ( indent, "  ", NULL );
+	for ( GList *iter = start; iter; iter = iter->next ) {
+		if ( iter != start && SEGMENT_END(iter) )
+			break;
+		VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+		kml_write_when ( ff, ind, tp->timestamp );
+		has_hr |= tp->heart_rate != 0;
+		has_cad |= tp->cadence != VIK_TRKPT_CADENCE_NONE;
+		has_temp |= !isnan(tp->temp);
+	}
+	for ( GList *iter = start; iter; iter = iter->next ) {
+		if ( iter != start && SEGMENT_END(iter) )
+			break;
+		VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+		fprintf ( ff, "%s<gx:coord>", ind );
+		kml_write_coord ( ff, &tp->coord, tp->altitude, ' ' );
+		fprintf ( ff, "</gx:coord>\n" );
+	}
+	if ( has_hr || has_cad || has_temp ) {
+		gchar *ind3 = g_strconcat ( ind, "    ", NULL );
+		fprintf ( ff, "%s<ExtendedData>\n%s  <SchemaData schemaUrl=\"#schema\">\n", ind, ind );
+		if ( has_hr )
+			kml_write_array ( ff, ind3, "heartrate", start, 0 );
+		if ( has_cad )
+			kml_write_array ( ff, ind3, "cadence", start, 1 );
+		if ( has_temp )
+			kml_write_array ( ff, ind3, "temperature", start, 2 );
+		fprintf ( ff, "%s  </SchemaData>\n%s</ExtendedData>\n", ind, ind );
+		g_free ( ind3 );
+	}
+	fprintf ( ff, "%s</gx:Track>\n", indent );
+	g_free ( ind );
+}
+
+static void kml_write_track ( VikTrack *trk, guint style, FILE *ff, KmlWritingOptions *options )
+{
+	if ( !trk->visible && !options->hidden )
+		return;
+
+	const gchar *ind = "      ";
+	fprintf ( ff, "%s<Placemark>\n", ind );
+	kml_write_string ( ff, "        ", "name", trk->name );
+	if ( !trk->visible )
+		fprintf ( ff, "        <visibility>0</visibility>\n" );
+	kml_write_string ( ff, "        ", "Snippet", trk->comment );
+	kml_write_string ( ff, "        ", "description", trk->description );
+	if ( trk->has_color )
+		fprintf ( ff, "        <styleUrl>#track_%u</styleUrl>\n", style );
+	else
+		fprintf ( ff, "        <styleUrl>#track</styleUrl>\n" );
+
+	vik_units_distance_t dist_units;
+	switch ( options->units ) {
+	case VIK_KML_EXPORT_UNITS_STATUTE:  dist_units = VIK_UNITS_DISTANCE_MILES; break;
+	case VIK_KML_EXPORT_UNITS_NAUTICAL: dist_units = VIK_UNITS_DISTANCE_NAUTICAL_MILES; break;
+	default:                            dist_units = VIK_UNITS_DISTANCE_KILOMETRES; break;
+	}
+	gchar buf[64];
+	vu_distance_text ( buf, sizeof(buf), dist_units, vik_track_get_length_including_gaps(trk), TRUE, "%.2f", FALSE );
+	gchar *dist = a_gpx_entitize ( buf );
+	fprintf ( ff, "        <ExtendedData>\n          <Data name=\"distance\">\n            <displayName>%s</displayName>\n            <value>%s</value>\n          </Data>\n        </ExtendedData>\n", _("Distance"), dist );
+	g_free ( dist );
+
+	// Timestamped tracks keep their times (and other per point values) via <gx:Track>
+	gboolean gx_track = FALSE;
+	if ( options->track && !trk->is_route ) {
+		for ( GList *iter = trk->trackpoints; iter && !gx_track; iter = iter->next )
+			gx_track = !isnan ( VIK_TRACKPOINT(iter->data)->timestamp );
+	}
+
+	guint segments = vik_track_get_segment_count ( trk );
+	if ( gx_track ) {
+		if ( segments > 1 )
+			fprintf ( ff, "        <gx:MultiTrack>\n" );
+		for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+			if ( iter == trk->trackpoints || VIK_TRACKPOINT(iter->data)->newsegment )
+				kml_write_gx_track ( ff, segments > 1 ? "          " : "        ", iter );
+		}
+		if ( segments > 1 )
+			fprintf ( ff, "        </gx:MultiTrack>\n" );
+	}
+	else if ( trk->trackpoints ) {
+		if ( segments > 1 )
+			fprintf ( ff, "        <MultiGeometry>\n" );
+		for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+			if ( iter == trk->trackpoints || VIK_TRACKPOINT(iter->data)->newsegment )
+				kml_write_linestring ( ff, segments > 1 ? "          " : "        ", iter );
+		}
+		if ( segments > 1 )
+			fprintf ( ff, "        </MultiGeometry>\n" );
+	}
+	fprintf ( ff, "%s</Placemark>\n", ind );
+
+	if ( options->points && trk->trackpoints ) {
+		fprintf ( ff, "%s<Folder>\n", ind );
+		gchar *name = g_strdup_printf ( _("%s Points"), trk->name ? trk->name : "" );
+		kml_write_string ( ff, "        ", "name", name );
+		g_free ( name );
+		guint count = 1;
+		for ( GList *iter = trk->trackpoints; iter; iter = iter->next ) {
+			VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+			gchar *tp_name = tp->name ? g_strdup ( tp->name ) : g_strdup_printf ( "%u", count );
+			kml_write_point_placemark ( ff, "        ", tp_name, NULL, NULL, trk->visible, tp->timestamp, &tp->coord, tp->altitude );
+			g_free ( tp_name );
+			count++;
+		}
+		fprintf ( ff, "%s</Folder>\n", ind );
+	}
+}
+
+static void kml_write_track_style ( FILE *ff, const gchar *id, const GdkColor *color, gint width )
+{
+	fprintf ( ff, "    <Style id=\"%s\">\n      <LineStyle>\n", id );
+	// KML colours are 'aabbggrr'
+	if ( color )
+		fprintf ( ff, "        <color>ff%02x%02x%02x</color>\n", color->blue >> 8, color->green >> 8, color->red >> 8 );
+	fprintf ( ff, "        <width>%d</width>\n      </LineStyle>\n    </Style>\n", width );
+}
+
+/**
+ * a_kml_write_file:
+ * @vtl:     The Layer to write
+ * @ff:      The file to write to
+ * @options: How to write the data
+ *
+ * Write the layer directly as KML in one pass
+ *
+ * Returns:
+ *  TRUE on success
+ */
+gboolean a_kml_write_file ( VikTrwLayer *vtl, FILE *ff, KmlWritingOptions *options )
+{
+	GList *wpts = NULL;
+	GList *trks = NULL;
+	GList *rtes = NULL;
+
+	if ( vik_trw_layer_get_waypoints_visibility(vtl) || options->hidden ) {
+		wpts = g_hash_table_get_values ( vik_trw_layer_get_waypoints(vtl) );
+		wpts = g_list_sort ( wpts, kml_waypoint_compare );
+	}
+	if ( vik_trw_layer_get_tracks_visibility(vtl) || options->hidden ) {
+		// Forming the list manually seems to produce one that is more likely to be nearer to the creation order
+		gpointer key, value;
+		GHashTableIter ght_iter;
+		g_hash_table_iter_init ( &ght_iter, vik_trw_layer_get_tracks(vtl) );
+		while ( g_hash_table_iter_next (&ght_iter, &key, &value) )
+			trks = g_list_prepend ( trks, value );
+		trks = g_list_reverse ( trks );
+	}
+	if ( vik_trw_layer_get_routes_visibility(vtl) || options->hidden ) {
+		rtes = g_hash_table_get_values ( vik_trw_layer_get_routes(vtl) );
+		rtes = g_list_sort ( rtes, kml_track_compare_name );
+	}
+
+	fprintf ( ff, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<kml " KML_NAMESPACES ">\n  <Document>\n" );
+	kml_write_string ( ff, "    ", "name", vik_layer_get_name(VIK_LAYER(vtl)) );
+
+	// Styles are numbered by the position in the tracks then routes lists
+	gint width = vik_trw_layer_get_property_tracks_line_thickness ( vtl );
+	kml_write_track_style ( ff, "track", NULL, width );
+	guint style = 0;
+	for ( GList *iter = trks; iter; iter = iter->next, style++ ) {
+		if ( VIK_TRACK(iter->data)->has_color ) {
+			gchar *id = g_strdup_printf ( "track_%u", style );
+			kml_write_track_style ( ff, id, &VIK_TRACK(iter->data)->color, width );
+			g_free ( id );
+		}
+	}
+	for ( GList *iter = rtes; iter; iter = iter->next, style++ ) {
+		if ( VIK_TRACK(iter->data)->has_color ) {
+			gchar *id = g_strdup_printf ( "track_%u", style );
+			kml_write_track_style ( ff, id, &VIK_TRACK(iter->data)->color, width );
+			g_free ( id );
+		}
+	}
+
+	// Describes the gx:SimpleArrayData values of the tracks
+	fprintf ( ff, "    <Schema id=\"schema\">\n" );
+	fprintf ( ff, "      <gx:SimpleArrayField name=\"heartrate\" type=\"int\">\n        <displayName>%s</displayName>\n      </gx:SimpleArrayField>\n", _("Heart Rate") );
+	fprintf ( ff, "      <gx:SimpleArrayField name=\"cadence\" type=\"int\">\n        <displayName>%s</displayName>\n      </gx:SimpleArrayField>\n", _("Cadence") );
+	fprintf ( ff, "      <gx:SimpleArrayField name=\"temperature\" type=\"float\">\n        <displayName>%s</displayName>\n      </gx:SimpleArrayField>\n", _("Temperature") );
+	fprintf ( ff, "    </Schema>\n" );
+
+	if ( wpts ) {
+		fprintf ( ff, "    <Folder>\n      <name>%s</name>\n", _("Waypoints") );
+		for ( GList *iter = wpts; iter; iter = iter->next )
+			kml_write_waypoint ( VIK_WAYPOINT(iter->data), ff, options );
+		fprintf ( ff, "    </Folder>\n" );
+	}
+
+	style = 0;
+	if ( trks ) {
+		fprintf ( ff, "    <Folder>\n      <name>%s</name>\n", _("Tracks") );
+		for ( GList *iter = trks; iter; iter = iter->next, style++ )
+			kml_write_track ( VIK_TRACK(iter->data), style, ff, options );
+		fprintf ( ff, "    </Folder>\n" );
+	}
+	if ( rtes ) {
+		fprintf ( ff, "    <Folder>\n      <name>%s</name>\n", _("Routes") );
+		for ( GList *iter = rtes; iter; iter = iter->next, style++ )
+			kml_write_track ( VIK_TRACK(iter->data), style, ff, options );
+		fprintf ( ff, "    </Folder>\n" );
+	}
+
+	fprintf ( ff, "  </Document>\n</kml>\n" );
+
+	g_list_free ( wpts );
+	g_list_free ( trks );
+	g_list_free ( rtes );
+
+	return !ferror ( ff );
+}
@@ -22,10 +22,19 @@
 #define _VIKING_KML_H
 
 #include "viktrwlayer.h"
+#include "globals.h"
 
 G_BEGIN_DECLS
 
+typedef struct {
+	vik_kml_export_units_t units; /// For the track distance
+	gboolean track;  /// Write timestamped tracks as <gx:Track>
+	gboolean points; /// Also write a placemark for every trackpoint
+	gboolean hidden; /// Write invisible tracks/waypoints
+} KmlWritingOptions;
+
 gboolean a_kml_read_file ( VikTrwLayer *vtl, FILE *ff );
+gboolean a_kml_write_file ( VikTrwLayer *vtl, FILE *ff, KmlWritingOptions *options );
 
 G_END_DECLS
 
@@ -19,6 +19,7 @@
  *
  */
 #include <gmodule.h>
+#include <signal.h>
 
 #ifdef HAVE_CONFIG
 #include "config.h"
@@ -32,6 +33,7 @@
 #include "babel.h"
 #include "curl_download.h"
 #include "logging.h"
+#include "trace.h"
 #include "vikdemlayer.h"
 #include "vikmapslayer.h"
 #include "vikgeoreflayer.h"
@@ -56,6 +58,8 @@ static gdouble longitude = NAN;
 static gint zoom_level_osm = -1;
 static gint map_id = -1;
 static gboolean external = FALSE;
+static gchar *trace_file = NULL;
+static gboolean trace_overlay = FALSE;
 
 /* Options */
 static GOptionEntry entries[] = 
@@ -68,6 +72,8 @@ static GOptionEntry entries[] =
   { "zoom", 'z', 0, G_OPTION_ARG_INT, &zoom_level_osm, N_("Zoom Level (OSM). Value can be 0 - 22"), NULL },
   { "map", 'm', 0, G_OPTION_ARG_INT, &map_id, N_("Add a map layer by id value. Use 0 for the default map."), NULL },
   { "external", 'e', 0, G_OPTION_ARG_NONE, &external, N_("Load all GPX files in external mode."), NULL },
+  { "trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_file, N_("Record timings and write them on exit to the file (in the Chrome trace format)"), N_("FILE") },
+  { "trace-overlay", 0, 0, G_OPTION_ARG_NONE, &trace_overlay, N_("Show the timings of the latest redraw on the map"), NULL },
   { NULL }
 };
 
@@ -115,6 +121,18 @@ gboolean check_for_geo_uri ( char *argv )
   return FALSE;
 }
 
+/**
+ * Log how long each step of startup takes (seen with --debug) and include it in any trace,
+ *  so any step that slows down getting the first window shown stands out
+ */
+#define STARTUP_STEP(step) G_STMT_START { \
+    gint64 step_begin = g_get_monotonic_time (); \
+    gint64 step_trace = a_trace_begin (); \
+    step; \
+    a_trace_end ( #step, step_trace ); \
+    g_debug ( "startup: %s took %.1fms", #step, (g_get_monotonic_time() - step_begin) / 1000.0 ); \
+  } G_STMT_END
+
 int main( int argc, char *argv[] )
 {
   VikWindow *first_window;
@@ -164,17 +182,25 @@ int main( int argc, char *argv[] )
   // Ensure correct capitalization of the program name
   g_set_application_name ("Viking");
 
+  gint64 startup_begin = g_get_monotonic_time ();
   a_logging_init ();
+  a_trace_init ( trace_file, trace_overlay );
+
+#ifdef SIGPIPE
+  // Writing to a program that has exited (e.g. a download being fed into gpsbabel)
+  //  should just be an error, rather than terminating the whole application
+  signal ( SIGPIPE, SIG_IGN );
+#endif
 
   // Discover if this is the very first run
   a_vik_very_first_run ();
 
-  vik_icons_register_resource ();
-  ui_load_icons();
+  STARTUP_STEP ( vik_icons_register_resource () );
+  STARTUP_STEP ( ui_load_icons() );
 
-  a_settings_init ();
-  a_preferences_init ();
-  a_thumbnails_init ();
+  STARTUP_STEP ( a_settings_init () );
+  STARTUP_STEP ( a_preferences_init () );
+  STARTUP_STEP ( a_thumbnails_init () );
 
  /*
   * First stage initialization
@@ -185,28 +211,28 @@ int main( int argc, char *argv[] )
   *  but of course for preferences not registered yet it can't actually understand them
   *  so subsequent initial attempts to get those preferences return the default value, until the values have changed
   */
-  a_vik_preferences_init ();
+  STARTUP_STEP ( a_vik_preferences_init () );
 
-  a_layer_defaults_init ();
+  STARTUP_STEP ( a_layer_defaults_init () );
 
-  a_download_init();
-  curl_download_init();
+  STARTUP_STEP ( a_download_init() );
+  STARTUP_STEP ( curl_download_init() );
 
-  a_babel_init ();
+  STARTUP_STEP ( a_babel_init () );
 
   /* Init modules/plugins */
-  modules_init();
+  STARTUP_STEP ( modules_init() );
 
-  vik_georef_layer_init ();
-  maps_layer_init ();
-  vik_dem_layer_init ();
-  a_mapcache_init ();
-  a_background_init ();
+  STARTUP_STEP ( vik_georef_layer_init () );
+  STARTUP_STEP ( maps_layer_init () );
+  STARTUP_STEP ( vik_dem_layer_init () );
+  STARTUP_STEP ( a_mapcache_init () );
+  STARTUP_STEP ( a_background_init () );
 
-  a_toolbar_init();
-  vik_routing_prefs_init();
-  vik_trw_layer_export_init();
-  vik_trw_layer_propwin_init();
+  STARTUP_STEP ( a_toolbar_init() );
+  STARTUP_STEP ( vik_routing_prefs_init() );
+  STARTUP_STEP ( vik_trw_layer_export_init() );
+  STARTUP_STEP ( vik_trw_layer_propwin_init() );
 
   // Registration of preferences has now been done
   a_preferences_finished_registering();
@@ -216,13 +242,12 @@ int main( int argc, char *argv[] )
    *
    * Can now use a_preferences_get()
    */
-  a_background_post_init ();
-  a_babel_post_init ();
-  modules_post_init ();
+  STARTUP_STEP ( a_background_post_init () );
+  STARTUP_STEP ( a_babel_post_init () );
+  STARTUP_STEP ( modules_post_init () );
 
-  // May need to initialize the Positonal TimeZone lookup
-  if ( a_vik_get_time_ref_frame() == VIK_TIME_REF_WORLD )
-    vu_setup_lat_lon_tz_lookup();
+  // NB The Positional TimeZone lookup is only loaded when first needed
+  //  and gpsbabel's features are found in the background, to get the window shown sooner
 
   /* Set the icon */
   GdkPixbuf *main_icon = ui_get_icon ( "viking", 48 );
@@ -233,7 +258,8 @@ int main( int argc, char *argv[] )
   vu_set_auto_features_on_first_run ();
 
   /* Create the first window */
-  first_window = vik_window_new_window();
+  STARTUP_STEP ( first_window = vik_window_new_window() );
+  g_debug ( "startup: first window after %.1fms", (g_get_monotonic_time() - startup_begin) / 1000.0 );
 
   a_logging_update();
 
@@ -285,6 +311,7 @@ int main( int argc, char *argv[] )
   a_babel_uninit ();
   a_toolbar_uninit ();
   a_background_uninit ();
+  a_trace_uninit ();
   maps_layer_uninit ();
   a_mapcache_uninit ();
   a_dems_uninit ();
@@ -31,6 +31,8 @@
 
 #define MAP_ID_MAPNIK_RENDER 7
 
+#define MAP_ID_DEM_RENDER 8
+
 // Mostly OSM related - except the Blue Marble value
 #define MAP_ID_OSM_MAPNIK 13
 #define MAP_ID_BLUE_MARBLE 15
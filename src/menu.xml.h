@@ -17,6 +17,7 @@ static const char *menu_xml =
 	"      <menu action='Export'>"
 	"        <menuitem action='ExportGPX'/>"
 	"        <menuitem action='ExportSingleGPX'/>"
+	"        <menuitem action='ExportKML'/>"
 	"      </menu>"
 	"      <menu action='Acquire'>"
 	"        <menuitem action='AcquireRouting'/>"
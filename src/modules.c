@@ -56,6 +56,7 @@
 #include "vikgotoxmltool.h"
 #include "vikwebtool_datasource.h"
 #include "vikroutingwebengine.h"
+#include "vikroutingofflineengine.h"
 
 #include "vikgobjectbuilder.h"
 
@@ -222,7 +223,8 @@ register_loadable_types(void)
     VIK_WEBTOOL_DATASOURCE_TYPE,
 
     /* Routing */
-    VIK_ROUTING_WEB_ENGINE_TYPE
+    VIK_ROUTING_WEB_ENGINE_TYPE,
+    VIK_ROUTING_OFFLINE_ENGINE_TYPE
   };
 
   /* kill 'unused variable' + argument type warnings */
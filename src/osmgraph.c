@@ -0,0 +1,1114 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * A road graph built from an OpenStreetMap XML extract, for offline routing.
+ *
+ * Only the nodes used by routable ways are kept; each profile has its own
+ *  directed graph in compressed row form, with the edge costs being the travel times in ms.
+ * Routes are found with a bidirectional A* search, using the average of
+ *  the forward and reverse straight line estimates as the potential so that
+ *  the usual bidirectional stopping condition remains valid.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <glib/gstdio.h>
+#include <expat.h>
+
+#include "osmgraph.h"
+#include "globals.h"
+
+#define OSM_GRAPH_MAGIC "VIKROUTE"
+#define OSM_GRAPH_VERSION 1
+
+#define OSM_GRAPH_EARTH_RADIUS 6371008.8
+// Coordinates are held as integers in units of 1e-7 degrees, as per the OSM database
+#define OSM_GRAPH_COORD_SCALE 1e7
+
+#define OSM_GRAPH_NONE G_MAXUINT32
+#define OSM_GRAPH_INFINITY G_MAXUINT64
+
+// Aim for this many nodes in each cell of the nearest node grid
+#define OSM_GRAPH_NODES_PER_CELL 16
+
+typedef struct {
+  guint32 *first;     // Index into target & cost for each node (num_nodes+1)
+  guint32 *target;
+  guint32 *cost;      // ms
+  guint num_edges;
+  guint speed;        // The fastest speed (km/h), for the A* estimate
+  // The reverse graph, derived from the above
+  guint32 *rfirst;
+  guint32 *rsource;
+  guint32 *rcost;
+} OsmGraphEdges;
+
+typedef struct {
+  gdouble key;
+  guint32 node;
+} HeapItem;
+
+// Per node values (held in arrays so they can be reused between searches)
+enum {
+  SEARCH_TOUCHED = 1,
+  SEARCH_DONE_FORWARD = 2,
+  SEARCH_DONE_REVERSE = 4,
+};
+
+typedef struct {
+  guint64 *dist_forward;
+  guint64 *dist_reverse;
+  guint32 *pred_forward;
+  guint32 *pred_reverse;
+  gdouble *potential;
+  guint8 *state;
+  GArray *touched;
+  GArray *heap_forward;
+  GArray *heap_reverse;
+} OsmGraphSearch;
+
+struct _OsmGraph {
+  guint num_nodes;
+  gint32 *lat;
+  gint32 *lon;
+  OsmGraphEdges profiles[OSM_GRAPH_PROFILE_NUM];
+
+  // Grid of the nodes, for finding the nearest one
+  gint32 grid_lat, grid_lon;  // South west corner
+  gint32 cell_size;
+  guint grid_w, grid_h;
+  guint32 *cell_first;
+  guint32 *cell_nodes;
+  gdouble cell_metres;        // The minimum extent of a cell
+
+  GMutex search_mutex;
+  OsmGraphSearch *search;
+};
+
+static const gchar *profile_names[OSM_GRAPH_PROFILE_NUM] = { "car", "bike", "foot" };
+
+/**
+ * Speeds in km/h for each profile, 0 meaning not allowed (unless tagged otherwise)
+ */
+typedef struct {
+  const gchar *highway;
+  guint8 speed[OSM_GRAPH_PROFILE_NUM];
+} HighwaySpeed;
+
+static const HighwaySpeed highway_speeds[] = {
+  { "motorway",       { 110,  0, 0 } },
+  { "motorway_link",  {  60,  0, 0 } },
+  { "trunk",          {  90, 18, 5 } },
+  { "trunk_link",     {  50, 18, 5 } },
+  { "primary",        {  70, 18, 5 } },
+  { "primary_link",   {  50, 18, 5 } },
+  { "secondary",      {  60, 18, 5 } },
+  { "secondary_link", {  40, 18, 5 } },
+  { "tertiary",       {  50, 18, 5 } },
+  { "tertiary_link",  {  40, 18, 5 } },
+  { "unclassified",   {  40, 18, 5 } },
+  { "residential",    {  30, 18, 5 } },
+  { "living_street",  {  10, 12, 5 } },
+  { "service",        {  15, 14, 5 } },
+  { "road",           {  30, 16, 5 } },
+  { "track",          {   0, 12, 5 } },
+  { "cycleway",       {   0, 20, 5 } },
+  { "path",           {   0, 12, 5 } },
+  { "bridleway",      {   0,  0, 5 } },
+  { "pedestrian",     {   0,  0, 5 } },
+  { "footway",        {   0,  0, 5 } },
+  { "steps",          {   0,  0, 2 } },
+};
+
+// Speeds when a way is explicitly allowed for a profile, but not by default
+static const guint8 allowed_speeds[OSM_GRAPH_PROFILE_NUM] = { 20, 12, 5 };
+
+/**
+ * osm_graph_profile_from_string:
+ *
+ * Returns: The profile named "car", "bike" or "foot"; defaulting to car
+ */
+OsmGraphProfile osm_graph_profile_from_string ( const gchar *name )
+{
+  for ( guint pp = 0; name && pp < OSM_GRAPH_PROFILE_NUM; pp++ )
+    if ( g_ascii_strcasecmp(name, profile_names[pp]) == 0 )
+      return pp;
+  return OSM_GRAPH_PROFILE_CAR;
+}
+
+static gdouble coord_to_degrees ( gint32 value )
+{
+  return value / OSM_GRAPH_COORD_SCALE;
+}
+
+static gint32 degrees_to_coord ( gdouble value )
+{
+  return (gint32)lround ( value * OSM_GRAPH_COORD_SCALE );
+}
+
+/**
+ * Haversine, as the spherical law of cosines is too inaccurate for short edges
+ */
+static gdouble coord_distance ( gint32 lat1, gint32 lon1, gint32 lat2, gint32 lon2 )
+{
+  gdouble phi1 = DEG2RAD(coord_to_degrees(lat1));
+  gdouble phi2 = DEG2RAD(coord_to_degrees(lat2));
+  gdouble sdlat = sin ( (phi2 - phi1) / 2 );
+  gdouble sdlon = sin ( DEG2RAD(coord_to_degrees(lon2) - coord_to_degrees(lon1)) / 2 );
+  gdouble aa = sdlat * sdlat + cos(phi1) * cos(phi2) * sdlon * sdlon;
+  return 2 * OSM_GRAPH_EARTH_RADIUS * asin ( sqrt(MIN(aa, 1.0)) );
+}
+
+static gdouble node_distance ( const OsmGraph *og, guint aa, guint bb )
+{
+  return coord_distance ( og->lat[aa], og->lon[aa], og->lat[bb], og->lon[bb] );
+}
+
+/**
+ * The time in ms to travel the distance (in metres) at the speed (in km/h)
+ */
+static gdouble travel_time ( gdouble distance, guint speed )
+{
+  return distance * 3600.0 / speed;
+}
+
+/*
+ * Reading the OSM XML
+ */
+
+typedef struct {
+  gint64 id;
+  gint32 lat, lon;
+} OsmNode;
+
+typedef struct {
+  guint start, count;  // Position in the refs
+  guint8 speed[OSM_GRAPH_PROFILE_NUM];
+  gint8 oneway[OSM_GRAPH_PROFILE_NUM]; // 1 only forwards, -1 only backwards
+} OsmWay;
+
+typedef struct {
+  GArray *nodes;       // OsmNode
+  GArray *ways;        // OsmWay
+  GArray *refs;        // gint64 node ids, or node positions once resolved
+  gboolean in_way;
+  guint way_start;
+  GHashTable *tags;    // Of the current way
+  gboolean sorted;
+} OsmParse;
+
+static const gchar *get_attr ( const char **attrs, const gchar *name )
+{
+  for ( guint ii = 0; attrs[ii]; ii += 2 )
+    if ( strcmp(attrs[ii], name) == 0 )
+      return attrs[ii+1];
+  return NULL;
+}
+
+static void osm_start ( OsmParse *op, const char *el, const char **attrs )
+{
+  if ( strcmp(el, "node") == 0 ) {
+    const gchar *id = get_attr ( attrs, "id" );
+    const gchar *lat = get_attr ( attrs, "lat" );
+    const gchar *lon = get_attr ( attrs, "lon" );
+    if ( !id || !lat || !lon )
+      return;
+    OsmNode node;
+    node.id = g_ascii_strtoll ( id, NULL, 10 );
+    node.lat = degrees_to_coord ( g_ascii_strtod(lat, NULL) );
+    node.lon = degrees_to_coord ( g_ascii_strtod(lon, NULL) );
+    if ( op->nodes->len && node.id <= g_array_index(op->nodes, OsmNode, op->nodes->len-1).id )
+      op->sorted = FALSE;
+    g_array_append_val ( op->nodes, node );
+  }
+  else if ( strcmp(el, "way") == 0 ) {
+    op->in_way = TRUE;
+    op->way_start = op->refs->len;
+    g_hash_table_remove_all ( op->tags );
+  }
+  else if ( op->in_way && strcmp(el, "nd") == 0 ) {
+    const gchar *ref = get_attr ( attrs, "ref" );
+    if ( ref ) {
+      gint64 id = g_ascii_strtoll ( ref, NULL, 10 );
+      g_array_append_val ( op->refs, id );
+    }
+  }
+  else if ( op->in_way && strcmp(el, "tag") == 0 ) {
+    const gchar *kk = get_attr ( attrs, "k" );
+    const gchar *vv = get_attr ( attrs, "v" );
+    if ( kk && vv )
+      g_hash_table_replace ( op->tags, g_strdup(kk), g_strdup(vv) );
+  }
+}
+
+static gboolean tag_is ( GHashTable *tags, const gchar *key, const gchar *value )
+{
+  const gchar *vv = g_hash_table_lookup ( tags, key );
+  return vv && strcmp(vv, value) == 0;
+}
+
+/**
+ * Returns: -1 if access is explicitly denied, 1 if explicitly allowed, otherwise 0
+ */
+static gint tag_access ( GHashTable *tags, const gchar *key )
+{
+  const gchar *vv = g_hash_table_lookup ( tags, key );
+  if ( !vv )
+    return 0;
+  if ( !strcmp(vv, "no") || !strcmp(vv, "private") || !strcmp(vv, "use_sidepath") )
+    return -1;
+  if ( !strcmp(vv, "yes") || !strcmp(vv, "designated") || !strcmp(vv, "permissive") || !strcmp(vv, "destination") )
+    return 1;
+  return 0;
+}
+
+/**
+ * The most specific access tag that is set for the profile wins
+ */
+static gint profile_access ( GHashTable *tags, OsmGraphProfile profile )
+{
+  static const gchar *car_keys[] = { "motorcar", "motor_vehicle", "vehicle", "access", NULL };
+  static const gchar *bike_keys[] = { "bicycle", "vehicle", "access", NULL };
+  static const gchar *foot_keys[] = { "foot", "access", NULL };
+  const gchar **keys = profile == OSM_GRAPH_PROFILE_CAR ? car_keys :
+                       profile == OSM_GRAPH_PROFILE_BIKE ? bike_keys : foot_keys;
+  for ( guint kk = 0; keys[kk]; kk++ ) {
+    gint access = tag_access ( tags, keys[kk] );
+    if ( access )
+      return access;
+  }
+  return 0;
+}
+
+static gint8 profile_oneway ( GHashTable *tags, const gchar *highway, OsmGraphProfile profile )
+{
+  if ( profile == OSM_GRAPH_PROFILE_FOOT )
+    return 0;
+  const gchar *oneway = NULL;
+  if ( profile == OSM_GRAPH_PROFILE_BIKE )
+    oneway = g_hash_table_lookup ( tags, "oneway:bicycle" );
+  if ( !oneway )
+    oneway = g_hash_table_lookup ( tags, "oneway" );
+  if ( oneway ) {
+    if ( !strcmp(oneway, "yes") || !strcmp(oneway, "1") || !strcmp(oneway, "true") )
+      return 1;
+    if ( !strcmp(oneway, "-1") || !strcmp(oneway, "reverse") )
+      return -1;
+    return 0;
+  }
+  // Implied oneways
+  if ( tag_is(tags, "junction", "roundabout") || tag_is(tags, "junction", "circular") )
+    return 1;
+  if ( !strcmp(highway, "motorway") || !strcmp(highway, "motorway_link") )
+    return 1;
+  return 0;
+}
+
+static guint8 profile_speed ( GHashTable *tags, const HighwaySpeed *hs, OsmGraphProfile profile )
+{
+  gint access = profile_access ( tags, profile );
+  if ( access < 0 )
+    return 0;
+  guint speed = hs->speed[profile];
+  if ( speed == 0 ) {
+    if ( access == 0 )
+      return 0;
+    speed = allowed_speeds[profile];
+  }
+  if ( profile == OSM_GRAPH_PROFILE_CAR ) {
+    const gchar *maxspeed = g_hash_table_lookup ( tags, "maxspeed" );
+    if ( maxspeed ) {
+      gchar *end = NULL;
+      gdouble value = g_ascii_strtod ( maxspeed, &end );
+      if ( end != maxspeed && value > 0 ) {
+        if ( strstr(end, "mph") )
+          value *= 1.609344;
+        speed = (guint)CLAMP ( value, 5, 150 );
+      }
+    }
+  }
+  return speed;
+}
+
+static void osm_end_way ( OsmParse *op )
+{
+  OsmWay way;
+  way.start = op->way_start;
+  way.count = op->refs->len - op->way_start;
+
+  const gchar *highway = g_hash_table_lookup ( op->tags, "highway" );
+  const HighwaySpeed *hs = NULL;
+  for ( guint ii = 0; highway && ii < G_N_ELEMENTS(highway_speeds); ii++ )
+    if ( strcmp(highway, highway_speeds[ii].highway) == 0 )
+      hs = &highway_speeds[ii];
+
+  gboolean allowed = FALSE;
+  if ( hs && way.count > 1 && !tag_is(op->tags, "area", "yes") ) {
+    for ( guint pp = 0; pp < OSM_GRAPH_PROFILE_NUM; pp++ ) {
+      way.speed[pp] = profile_speed ( op->tags, hs, pp );
+      way.oneway[pp] = profile_oneway ( op->tags, highway, pp );
+      allowed = allowed || way.speed[pp];
+    }
+  }
+  if ( allowed )
+    g_array_append_val ( op->ways, way );
+  else
+    g_array_set_size ( op->refs, op->way_start );
+  op->in_way = FALSE;
+}
+
+static void osm_end ( OsmParse *op, const char *el )
+{
+  if ( op->in_way && strcmp(el, "way") == 0 )
+    osm_end_way ( op );
+}
+
+static gint node_id_compare ( gconstpointer aa, gconstpointer bb )
+{
+  gint64 ida = ((const OsmNode*)aa)->id;
+  gint64 idb = ((const OsmNode*)bb)->id;
+  return ida < idb ? -1 : ida > idb;
+}
+
+/**
+ * Returns: The position of the node in the (sorted) array, or -1
+ */
+static gint64 find_node ( GArray *nodes, gint64 id )
+{
+  guint lo = 0, hi = nodes->len;
+  while ( lo < hi ) {
+    guint mid = lo + (hi - lo) / 2;
+    gint64 mid_id = g_array_index ( nodes, OsmNode, mid ).id;
+    if ( mid_id == id )
+      return mid;
+    if ( mid_id < id )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return -1;
+}
+
+static gboolean osm_parse_file ( OsmParse *op, const gchar *filename )
+{
+  FILE *ff = g_fopen ( filename, "rb" );
+  if ( !ff ) {
+    g_warning ( "%s: Unable to open %s", __FUNCTION__, filename );
+    return FALSE;
+  }
+
+  XML_Parser parser = XML_ParserCreate ( NULL );
+  XML_SetElementHandler ( parser, (XML_StartElementHandler)osm_start, (XML_EndElementHandler)osm_end );
+  XML_SetUserData ( parser, op );
+
+  gboolean ok = TRUE;
+  gchar buf[65536];
+  gsize len;
+  do {
+    len = fread ( buf, 1, sizeof(buf), ff );
+    if ( XML_Parse(parser, buf, len, len == 0) == XML_STATUS_ERROR ) {
+      g_warning ( "%s: %s at line %lu of %s", __FUNCTION__,
+                  XML_ErrorString(XML_GetErrorCode(parser)),
+                  (gulong)XML_GetCurrentLineNumber(parser), filename );
+      ok = FALSE;
+      break;
+    }
+  } while ( len > 0 );
+
+  XML_ParserFree ( parser );
+  fclose ( ff );
+  return ok;
+}
+
+typedef struct {
+  guint32 from, to, cost;
+} OsmEdge;
+
+static gint edge_from_compare ( gconstpointer aa, gconstpointer bb )
+{
+  guint32 fa = ((const OsmEdge*)aa)->from;
+  guint32 fb = ((const OsmEdge*)bb)->from;
+  return fa < fb ? -1 : fa > fb;
+}
+
+/**
+ * Put the edges into compressed row form
+ */
+static void edges_assign ( OsmGraphEdges *ge, guint num_nodes, GArray *edges )
+{
+  g_array_sort ( edges, edge_from_compare );
+  ge->num_edges = edges->len;
+  ge->first = g_new0 ( guint32, num_nodes + 1 );
+  ge->target = g_new ( guint32, edges->len );
+  ge->cost = g_new ( guint32, edges->len );
+  for ( guint ii = 0; ii < edges->len; ii++ ) {
+    OsmEdge *edge = &g_array_index ( edges, OsmEdge, ii );
+    ge->first[edge->from+1]++;
+    ge->target[ii] = edge->to;
+    ge->cost[ii] = edge->cost;
+  }
+  for ( guint nn = 0; nn < num_nodes; nn++ )
+    ge->first[nn+1] += ge->first[nn];
+}
+
+static void add_edge ( GArray *edges, guint from, guint to, guint32 cost )
+{
+  OsmEdge edge = { from, to, cost };
+  g_array_append_val ( edges, edge );
+}
+
+static void osm_graph_prepare ( OsmGraph *og );
+
+/**
+ * osm_graph_new_from_osm_file:
+ * @filename: An OSM XML file (as from the API or an extract)
+ *
+ * Returns: The graph, or NULL if the file could not be read or has no routable ways
+ */
+OsmGraph *osm_graph_new_from_osm_file ( const gchar *filename )
+{
+  OsmParse op;
+  op.nodes = g_array_new ( FALSE, FALSE, sizeof(OsmNode) );
+  op.ways = g_array_new ( FALSE, FALSE, sizeof(OsmWay) );
+  op.refs = g_array_new ( FALSE, FALSE, sizeof(gint64) );
+  op.in_way = FALSE;
+  op.way_start = 0;
+  op.tags = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_free );
+  op.sorted = TRUE;
+
+  OsmGraph *og = NULL;
+  if ( !osm_parse_file(&op, filename) )
+    goto end;
+
+  if ( !op.sorted )
+    g_array_sort ( op.nodes, node_id_compare );
+
+  // Number only the nodes that are used by the ways
+  guint32 *index = g_new ( guint32, op.nodes->len );
+  memset ( index, 0xff, op.nodes->len * sizeof(guint32) );
+  guint num_nodes = 0;
+  for ( guint ii = 0; ii < op.refs->len; ii++ ) {
+    gint64 *ref = &g_array_index ( op.refs, gint64, ii );
+    *ref = find_node ( op.nodes, *ref );
+    if ( *ref >= 0 && index[*ref] == OSM_GRAPH_NONE )
+      index[*ref] = num_nodes++;
+  }
+
+  if ( num_nodes == 0 ) {
+    g_warning ( "%s: No routable ways in %s", __FUNCTION__, filename );
+    g_free ( index );
+    goto end;
+  }
+
+  og = g_new0 ( OsmGraph, 1 );
+  og->num_nodes = num_nodes;
+  og->lat = g_new ( gint32, num_nodes );
+  og->lon = g_new ( gint32, num_nodes );
+  for ( guint ii = 0; ii < op.nodes->len; ii++ ) {
+    if ( index[ii] != OSM_GRAPH_NONE ) {
+      OsmNode *node = &g_array_index ( op.nodes, OsmNode, ii );
+      og->lat[index[ii]] = node->lat;
+      og->lon[index[ii]] = node->lon;
+    }
+  }
+
+  for ( guint pp = 0; pp < OSM_GRAPH_PROFILE_NUM; pp++ ) {
+    GArray *edges = g_array_new ( FALSE, FALSE, sizeof(OsmEdge) );
+    OsmGraphEdges *ge = &og->profiles[pp];
+    for ( guint ww = 0; ww < op.ways->len; ww++ ) {
+      OsmWay *way = &g_array_index ( op.ways, OsmWay, ww );
+      guint speed = way->speed[pp];
+      if ( !speed )
+        continue;
+      ge->speed = MAX ( ge->speed, speed );
+      for ( guint ii = 1; ii < way->count; ii++ ) {
+        gint64 ra = g_array_index ( op.refs, gint64, way->start + ii - 1 );
+        gint64 rb = g_array_index ( op.refs, gint64, way->start + ii );
+        // Nodes outside of an extract are missing
+        if ( ra < 0 || rb < 0 || ra == rb )
+          continue;
+        guint aa = index[ra];
+        guint bb = index[rb];
+        guint32 cost = (guint32)ceil ( travel_time(node_distance(og, aa, bb), speed) );
+        if ( way->oneway[pp] >= 0 )
+          add_edge ( edges, aa, bb, cost );
+        if ( way->oneway[pp] <= 0 )
+          add_edge ( edges, bb, aa, cost );
+      }
+    }
+    edges_assign ( ge, num_nodes, edges );
+    g_array_free ( edges, TRUE );
+  }
+  g_free ( index );
+
+  osm_graph_prepare ( og );
+
+ end:
+  g_array_free ( op.nodes, TRUE );
+  g_array_free ( op.ways, TRUE );
+  g_array_free ( op.refs, TRUE );
+  g_hash_table_destroy ( op.tags );
+  return og;
+}
+
+/*
+ * Derived data, so is not saved
+ */
+
+static void edges_prepare_reverse ( OsmGraphEdges *ge, guint num_nodes )
+{
+  ge->rfirst = g_new0 ( guint32, num_nodes + 1 );
+  ge->rsource = g_new ( guint32, ge->num_edges );
+  ge->rcost = g_new ( guint32, ge->num_edges );
+  for ( guint ee = 0; ee < ge->num_edges; ee++ )
+    ge->rfirst[ge->target[ee]+1]++;
+  for ( guint nn = 0; nn < num_nodes; nn++ )
+    ge->rfirst[nn+1] += ge->rfirst[nn];
+  guint32 *pos = g_new ( guint32, num_nodes );
+  memcpy ( pos, ge->rfirst, num_nodes * sizeof(guint32) );
+  for ( guint nn = 0; nn < num_nodes; nn++ ) {
+    for ( guint32 ee = ge->first[nn]; ee < ge->first[nn+1]; ee++ ) {
+      guint32 slot = pos[ge->target[ee]]++;
+      ge->rsource[slot] = nn;
+      ge->rcost[slot] = ge->cost[ee];
+    }
+  }
+  g_free ( pos );
+}
+
+static void grid_prepare ( OsmGraph *og )
+{
+  gint32 min_lat = G_MAXINT32, max_lat = G_MININT32;
+  gint32 min_lon = G_MAXINT32, max_lon = G_MININT32;
+  for ( guint nn = 0; nn < og->num_nodes; nn++ ) {
+    min_lat = MIN ( min_lat, og->lat[nn] );
+    max_lat = MAX ( max_lat, og->lat[nn] );
+    min_lon = MIN ( min_lon, og->lon[nn] );
+    max_lon = MAX ( max_lon, og->lon[nn] );
+  }
+  gdouble height = (gdouble)max_lat - min_lat + 1;
+  gdouble width = (gdouble)max_lon - min_lon + 1;
+  guint cells = MAX ( 1, og->num_nodes / OSM_GRAPH_NODES_PER_CELL );
+  // Not too small, i.e. ~10 metres
+  og->cell_size = (gint32)MAX ( 1000, ceil(sqrt(height * width / cells)) );
+  og->grid_lat = min_lat;
+  og->grid_lon = min_lon;
+  og->grid_w = (guint)(width / og->cell_size) + 1;
+  og->grid_h = (guint)(height / og->cell_size) + 1;
+
+  guint num_cells = og->grid_w * og->grid_h;
+  og->cell_first = g_new0 ( guint32, num_cells + 1 );
+  og->cell_nodes = g_new ( guint32, og->num_nodes );
+  guint32 *cell = g_new ( guint32, og->num_nodes );
+  for ( guint nn = 0; nn < og->num_nodes; nn++ ) {
+    guint cx = (og->lon[nn] - min_lon) / og->cell_size;
+    guint cy = (og->lat[nn] - min_lat) / og->cell_size;
+    cell[nn] = cy * og->grid_w + cx;
+    og->cell_first[cell[nn]+1]++;
+  }
+  for ( guint cc = 0; cc < num_cells; cc++ )
+    og->cell_first[cc+1] += og->cell_first[cc];
+  guint32 *pos = g_new ( guint32, num_cells );
+  memcpy ( pos, og->cell_first, num_cells * sizeof(guint32) );
+  for ( guint nn = 0; nn < og->num_nodes; nn++ )
+    og->cell_nodes[pos[cell[nn]]++] = nn;
+  g_free ( pos );
+  g_free ( cell );
+
+  // Cells get narrower away from the equator
+  gdouble max_abs_lat = MAX ( fabs(coord_to_degrees(min_lat)), fabs(coord_to_degrees(max_lat)) );
+  gdouble cell_height = DEG2RAD(coord_to_degrees(og->cell_size)) * OSM_GRAPH_EARTH_RADIUS;
+  og->cell_metres = cell_height * cos ( DEG2RAD(MIN(max_abs_lat, 89.0)) );
+}
+
+static void osm_graph_prepare ( OsmGraph *og )
+{
+  for ( guint pp = 0; pp < OSM_GRAPH_PROFILE_NUM; pp++ )
+    edges_prepare_reverse ( &og->profiles[pp], og->num_nodes );
+  grid_prepare ( og );
+  g_mutex_init ( &og->search_mutex );
+}
+
+/*
+ * The saved graph file
+ */
+
+static gboolean write_uint32s ( FILE *ff, const guint32 *values, gsize count )
+{
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  return fwrite ( values, sizeof(guint32), count, ff ) == count;
+#else
+  guint32 buf[1024];
+  for ( gsize ii = 0; ii < count; ii += G_N_ELEMENTS(buf) ) {
+    gsize nn = MIN ( G_N_ELEMENTS(buf), count - ii );
+    for ( gsize jj = 0; jj < nn; jj++ )
+      buf[jj] = GUINT32_TO_LE ( values[ii+jj] );
+    if ( fwrite(buf, sizeof(guint32), nn, ff) != nn )
+      return FALSE;
+  }
+  return TRUE;
+#endif
+}
+
+static gboolean write_uint32 ( FILE *ff, guint32 value )
+{
+  return write_uint32s ( ff, &value, 1 );
+}
+
+static gboolean read_uint32s ( FILE *ff, guint32 *values, gsize count )
+{
+  if ( fread(values, sizeof(guint32), count, ff) != count )
+    return FALSE;
+#if G_BYTE_ORDER != G_LITTLE_ENDIAN
+  for ( gsize ii = 0; ii < count; ii++ )
+    values[ii] = GUINT32_FROM_LE ( values[ii] );
+#endif
+  return TRUE;
+}
+
+/**
+ * osm_graph_save:
+ *
+ * Save the graph in a binary form, which is much quicker to load than the original OSM data
+ */
+gboolean osm_graph_save ( const OsmGraph *og, const gchar *filename )
+{
+  FILE *ff = g_fopen ( filename, "wb" );
+  if ( !ff ) {
+    g_warning ( "%s: Unable to create %s", __FUNCTION__, filename );
+    return FALSE;
+  }
+  gboolean ok = fwrite ( OSM_GRAPH_MAGIC, 1, strlen(OSM_GRAPH_MAGIC), ff ) == strlen(OSM_GRAPH_MAGIC) &&
+                write_uint32 ( ff, OSM_GRAPH_VERSION ) &&
+                write_uint32 ( ff, og->num_nodes ) &&
+                write_uint32 ( ff, OSM_GRAPH_PROFILE_NUM ) &&
+                write_uint32s ( ff, (const guint32*)og->lat, og->num_nodes ) &&
+                write_uint32s ( ff, (const guint32*)og->lon, og->num_nodes );
+  for ( guint pp = 0; ok && pp < OSM_GRAPH_PROFILE_NUM; pp++ ) {
+    const OsmGraphEdges *ge = &og->profiles[pp];
+    ok = write_uint32 ( ff, ge->speed ) &&
+         write_uint32 ( ff, ge->num_edges ) &&
+         write_uint32s ( ff, ge->first, og->num_nodes + 1 ) &&
+         write_uint32s ( ff, ge->target, ge->num_edges ) &&
+         write_uint32s ( ff, ge->cost, ge->num_edges );
+  }
+  if ( fclose(ff) != 0 )
+    ok = FALSE;
+  if ( !ok ) {
+    g_warning ( "%s: Failed writing %s", __FUNCTION__, filename );
+    (void)g_remove ( filename );
+  }
+  return ok;
+}
+
+static gboolean edges_valid ( const OsmGraphEdges *ge, guint num_nodes )
+{
+  if ( ge->first[0] != 0 || ge->first[num_nodes] != ge->num_edges )
+    return FALSE;
+  for ( guint nn = 0; nn < num_nodes; nn++ )
+    if ( ge->first[nn] > ge->first[nn+1] )
+      return FALSE;
+  for ( guint ee = 0; ee < ge->num_edges; ee++ )
+    if ( ge->target[ee] >= num_nodes )
+      return FALSE;
+  return TRUE;
+}
+
+/**
+ * osm_graph_load:
+ *
+ * Load a graph saved by osm_graph_save()
+ *
+ * Returns: The graph, or NULL if the file is not a valid graph file
+ */
+OsmGraph *osm_graph_load ( const gchar *filename )
+{
+  FILE *ff = g_fopen ( filename, "rb" );
+  if ( !ff )
+    return NULL;
+
+  OsmGraph *og = NULL;
+  gchar magic[sizeof(OSM_GRAPH_MAGIC)-1];
+  guint32 header[3];
+  if ( fread(magic, 1, sizeof(magic), ff) != sizeof(magic) ||
+       memcmp(magic, OSM_GRAPH_MAGIC, sizeof(magic)) != 0 ||
+       !read_uint32s(ff, header, G_N_ELEMENTS(header)) ||
+       header[0] != OSM_GRAPH_VERSION ||
+       header[1] == 0 ||
+       header[2] != OSM_GRAPH_PROFILE_NUM )
+    goto fail;
+
+  og = g_new0 ( OsmGraph, 1 );
+  og->num_nodes = header[1];
+  og->lat = g_new ( gint32, og->num_nodes );
+  og->lon = g_new ( gint32, og->num_nodes );
+  if ( !read_uint32s(ff, (guint32*)og->lat, og->num_nodes) ||
+       !read_uint32s(ff, (guint32*)og->lon, og->num_nodes) )
+    goto fail;
+
+  for ( guint pp = 0; pp < OSM_GRAPH_PROFILE_NUM; pp++ ) {
+    OsmGraphEdges *ge = &og->profiles[pp];
+    guint32 values[2];
+    if ( !read_uint32s(ff, values, 2) )
+      goto fail;
+    ge->speed = values[0];
+    ge->num_edges = values[1];
+    ge->first = g_new ( guint32, og->num_nodes + 1 );
+    ge->target = g_new ( guint32, ge->num_edges );
+    ge->cost = g_new ( guint32, ge->num_edges );
+    if ( !read_uint32s(ff, ge->first, og->num_nodes + 1) ||
+         !read_uint32s(ff, ge->target, ge->num_edges) ||
+         !read_uint32s(ff, ge->cost, ge->num_edges) ||
+         !edges_valid(ge, og->num_nodes) )
+      goto fail;
+  }
+  fclose ( ff );
+
+  osm_graph_prepare ( og );
+  return og;
+
+ fail:
+  g_warning ( "%s: Invalid graph file %s", __FUNCTION__, filename );
+  fclose ( ff );
+  if ( og ) {
+    for ( guint pp = 0; pp < OSM_GRAPH_PROFILE_NUM; pp++ ) {
+      g_free ( og->profiles[pp].first );
+      g_free ( og->profiles[pp].target );
+      g_free ( og->profiles[pp].cost );
+    }
+    g_free ( og->lat );
+    g_free ( og->lon );
+    g_free ( og );
+  }
+  return NULL;
+}
+
+static void search_free ( OsmGraphSearch *ss )
+{
+  g_free ( ss->dist_forward );
+  g_free ( ss->dist_reverse );
+  g_free ( ss->pred_forward );
+  g_free ( ss->pred_reverse );
+  g_free ( ss->potential );
+  g_free ( ss->state );
+  g_array_free ( ss->touched, TRUE );
+  g_array_free ( ss->heap_forward, TRUE );
+  g_array_free ( ss->heap_reverse, TRUE );
+  g_free ( ss );
+}
+
+void osm_graph_free ( OsmGraph *og )
+{
+  if ( !og )
+    return;
+  for ( guint pp = 0; pp < OSM_GRAPH_PROFILE_NUM; pp++ ) {
+    OsmGraphEdges *ge = &og->profiles[pp];
+    g_free ( ge->first );
+    g_free ( ge->target );
+    g_free ( ge->cost );
+    g_free ( ge->rfirst );
+    g_free ( ge->rsource );
+    g_free ( ge->rcost );
+  }
+  g_free ( og->lat );
+  g_free ( og->lon );
+  g_free ( og->cell_first );
+  g_free ( og->cell_nodes );
+  if ( og->search )
+    search_free ( og->search );
+  g_mutex_clear ( &og->search_mutex );
+  g_free ( og );
+}
+
+guint osm_graph_get_num_nodes ( const OsmGraph *og )
+{
+  return og->num_nodes;
+}
+
+guint osm_graph_get_num_edges ( const OsmGraph *og, OsmGraphProfile profile )
+{
+  g_return_val_if_fail ( profile < OSM_GRAPH_PROFILE_NUM, 0 );
+  return og->profiles[profile].num_edges;
+}
+
+void osm_graph_get_node_latlon ( const OsmGraph *og, guint node, struct LatLon *ll )
+{
+  g_return_if_fail ( node < og->num_nodes );
+  ll->lat = coord_to_degrees ( og->lat[node] );
+  ll->lon = coord_to_degrees ( og->lon[node] );
+}
+
+static gboolean node_is_connected ( const OsmGraphEdges *ge, guint node )
+{
+  return ge->first[node] < ge->first[node+1] || ge->rfirst[node] < ge->rfirst[node+1];
+}
+
+/**
+ * osm_graph_get_nearest_node:
+ *
+ * Find the closest node that can be routed from or to with the profile,
+ *  by searching the cells of the grid in rings around the position.
+ */
+gboolean osm_graph_get_nearest_node ( const OsmGraph *og, OsmGraphProfile profile, const struct LatLon *ll, guint *node )
+{
+  g_return_val_if_fail ( profile < OSM_GRAPH_PROFILE_NUM, FALSE );
+  const OsmGraphEdges *ge = &og->profiles[profile];
+  if ( ge->num_edges == 0 )
+    return FALSE;
+
+  gint32 lat = degrees_to_coord ( ll->lat );
+  gint32 lon = degrees_to_coord ( ll->lon );
+  // Positions outside the grid start from the nearest edge of it
+  gint cx = CLAMP ( ((gint64)lon - og->grid_lon) / og->cell_size, 0, (gint)og->grid_w - 1 );
+  gint cy = CLAMP ( ((gint64)lat - og->grid_lat) / og->cell_size, 0, (gint)og->grid_h - 1 );
+  gint max_ring = MAX ( og->grid_w, og->grid_h );
+
+  gdouble best = G_MAXDOUBLE;
+  for ( gint ring = 0; ring <= max_ring; ring++ ) {
+    // Anything further out is at least this far away
+    if ( best <= (ring - 1) * og->cell_metres )
+      break;
+    for ( gint yy = cy - ring; yy <= cy + ring; yy++ ) {
+      if ( yy < 0 || yy >= (gint)og->grid_h )
+        continue;
+      // Only the edges of the ring, apart from the top and bottom rows
+      gint step = ( yy == cy - ring || yy == cy + ring ) ? 1 : MAX ( 1, 2 * ring );
+      for ( gint xx = cx - ring; xx <= cx + ring; xx += step ) {
+        if ( xx < 0 || xx >= (gint)og->grid_w )
+          continue;
+        guint cell = yy * og->grid_w + xx;
+        for ( guint32 ii = og->cell_first[cell]; ii < og->cell_first[cell+1]; ii++ ) {
+          guint nn = og->cell_nodes[ii];
+          if ( !node_is_connected(ge, nn) )
+            continue;
+          gdouble dist = coord_distance ( lat, lon, og->lat[nn], og->lon[nn] );
+          if ( dist < best ) {
+            best = dist;
+            *node = nn;
+          }
+        }
+      }
+    }
+  }
+  return best < G_MAXDOUBLE;
+}
+
+/*
+ * Binary heap of the search frontier.
+ * Entries are not updated in place, instead superseded entries are skipped when reached.
+ */
+
+static void heap_push ( GArray *heap, guint32 node, gdouble key )
+{
+  HeapItem item = { key, node };
+  g_array_append_val ( heap, item );
+  HeapItem *items = (HeapItem*)heap->data;
+  guint ii = heap->len - 1;
+  while ( ii > 0 ) {
+    guint parent = (ii - 1) / 2;
+    if ( items[parent].key <= item.key )
+      break;
+    items[ii] = items[parent];
+    ii = parent;
+  }
+  items[ii] = item;
+}
+
+static HeapItem heap_pop ( GArray *heap )
+{
+  HeapItem *items = (HeapItem*)heap->data;
+  HeapItem top = items[0];
+  HeapItem last = items[heap->len - 1];
+  g_array_set_size ( heap, heap->len - 1 );
+  guint len = heap->len;
+  guint ii = 0;
+  while ( len ) {
+    guint child = 2 * ii + 1;
+    if ( child >= len )
+      break;
+    if ( child + 1 < len && items[child+1].key < items[child].key )
+      child++;
+    if ( last.key <= items[child].key )
+      break;
+    items[ii] = items[child];
+    ii = child;
+  }
+  if ( len )
+    items[ii] = last;
+  return top;
+}
+
+static OsmGraphSearch *search_new ( guint num_nodes )
+{
+  OsmGraphSearch *ss = g_new0 ( OsmGraphSearch, 1 );
+  ss->dist_forward = g_new ( guint64, num_nodes );
+  ss->dist_reverse = g_new ( guint64, num_nodes );
+  ss->pred_forward = g_new ( guint32, num_nodes );
+  ss->pred_reverse = g_new ( guint32, num_nodes );
+  ss->potential = g_new ( gdouble, num_nodes );
+  ss->state = g_new0 ( guint8, num_nodes );
+  ss->touched = g_array_new ( FALSE, FALSE, sizeof(guint32) );
+  ss->heap_forward = g_array_new ( FALSE, FALSE, sizeof(HeapItem) );
+  ss->heap_reverse = g_array_new ( FALSE, FALSE, sizeof(HeapItem) );
+  return ss;
+}
+
+typedef struct {
+  const OsmGraph *og;
+  OsmGraphSearch *ss;
+  guint from, to;
+  guint speed;
+} SearchContext;
+
+/**
+ * Initialize the node's values on its first visit, so only visited nodes need resetting
+ */
+static void search_touch ( SearchContext *sc, guint node )
+{
+  OsmGraphSearch *ss = sc->ss;
+  if ( ss->state[node] & SEARCH_TOUCHED )
+    return;
+  ss->state[node] = SEARCH_TOUCHED;
+  ss->dist_forward[node] = OSM_GRAPH_INFINITY;
+  ss->dist_reverse[node] = OSM_GRAPH_INFINITY;
+  ss->pred_forward[node] = OSM_GRAPH_NONE;
+  ss->pred_reverse[node] = OSM_GRAPH_NONE;
+  // Estimates are rounded down so they never exceed the actual (rounded up) edge costs
+  gdouble to_target = floor ( travel_time(node_distance(sc->og, node, sc->to), sc->speed) );
+  gdouble to_source = floor ( travel_time(node_distance(sc->og, node, sc->from), sc->speed) );
+  ss->potential[node] = (to_target - to_source) / 2;
+  g_array_append_val ( ss->touched, node );
+}
+
+static void search_reset ( OsmGraphSearch *ss )
+{
+  for ( guint ii = 0; ii < ss->touched->len; ii++ )
+    ss->state[g_array_index(ss->touched, guint32, ii)] = 0;
+  g_array_set_size ( ss->touched, 0 );
+  g_array_set_size ( ss->heap_forward, 0 );
+  g_array_set_size ( ss->heap_reverse, 0 );
+}
+
+/**
+ * Remove entries for nodes already finished with in that direction
+ */
+static gboolean heap_top ( GArray *heap, const guint8 *state, guint8 done, HeapItem *top )
+{
+  while ( heap->len ) {
+    HeapItem *item = &g_array_index ( heap, HeapItem, 0 );
+    if ( !(state[item->node] & done) ) {
+      *top = *item;
+      return TRUE;
+    }
+    (void)heap_pop ( heap );
+  }
+  return FALSE;
+}
+
+/**
+ * osm_graph_route:
+ * @from:  The start node
+ * @to:    The end node
+ * @cost:  Optional return of the total travel time (ms)
+ *
+ * Find the fastest route for the profile
+ *
+ * Returns: An array of the node indices along the route (free with g_array_free()),
+ *          or NULL if there is no route
+ */
+GArray *osm_graph_route ( OsmGraph *og, OsmGraphProfile profile, guint from, guint to, guint32 *cost )
+{
+  g_return_val_if_fail ( profile < OSM_GRAPH_PROFILE_NUM, NULL );
+  g_return_val_if_fail ( from < og->num_nodes && to < og->num_nodes, NULL );
+
+  const OsmGraphEdges *ge = &og->profiles[profile];
+  GArray *route = NULL;
+
+  g_mutex_lock ( &og->search_mutex );
+  if ( !og->search )
+    og->search = search_new ( og->num_nodes );
+  OsmGraphSearch *ss = og->search;
+  SearchContext sc = { og, ss, from, to, MAX(1, ge->speed) };
+
+  search_touch ( &sc, from );
+  search_touch ( &sc, to );
+  ss->dist_forward[from] = 0;
+  ss->dist_reverse[to] = 0;
+  heap_push ( ss->heap_forward, from, ss->potential[from] );
+  heap_push ( ss->heap_reverse, to, -ss->potential[to] );
+
+  guint64 best = from == to ? 0 : OSM_GRAPH_INFINITY;
+  guint meet = from;
+
+  HeapItem top_forward, top_reverse;
+  while ( heap_top(ss->heap_forward, ss->state, SEARCH_DONE_FORWARD, &top_forward) &&
+          heap_top(ss->heap_reverse, ss->state, SEARCH_DONE_REVERSE, &top_reverse) ) {
+    if ( best != OSM_GRAPH_INFINITY && top_forward.key + top_reverse.key >= best )
+      break;
+
+    gboolean forward = top_forward.key <= top_reverse.key;
+    guint node = heap_pop ( forward ? ss->heap_forward : ss->heap_reverse ).node;
+    ss->state[node] |= forward ? SEARCH_DONE_FORWARD : SEARCH_DONE_REVERSE;
+
+    const guint32 *first = forward ? ge->first : ge->rfirst;
+    const guint32 *next = forward ? ge->target : ge->rsource;
+    const guint32 *costs = forward ? ge->cost : ge->rcost;
+    guint64 *dist = forward ? ss->dist_forward : ss->dist_reverse;
+    guint64 *other = forward ? ss->dist_reverse : ss->dist_forward;
+    guint32 *pred = forward ? ss->pred_forward : ss->pred_reverse;
+    GArray *heap = forward ? ss->heap_forward : ss->heap_reverse;
+
+    for ( guint32 ee = first[node]; ee < first[node+1]; ee++ ) {
+      guint nn = next[ee];
+      search_touch ( &sc, nn );
+      guint64 nd = dist[node] + costs[ee];
+      if ( nd >= dist[nn] )
+        continue;
+      dist[nn] = nd;
+      pred[nn] = node;
+      heap_push ( heap, nn, nd + (forward ? ss->potential[nn] : -ss->potential[nn]) );
+      if ( other[nn] != OSM_GRAPH_INFINITY && nd + other[nn] < best ) {
+        best = nd + other[nn];
+        meet = nn;
+      }
+    }
+  }
+
+  if ( best != OSM_GRAPH_INFINITY ) {
+    route = g_array_new ( FALSE, FALSE, sizeof(guint) );
+    for ( guint nn = meet; nn != OSM_GRAPH_NONE; nn = ss->pred_forward[nn] )
+      g_array_append_val ( route, nn );
+    for ( guint ii = 0; ii < route->len / 2; ii++ ) {
+      guint tmp = g_array_index ( route, guint, ii );
+      g_array_index ( route, guint, ii ) = g_array_index ( route, guint, route->len - 1 - ii );
+      g_array_index ( route, guint, route->len - 1 - ii ) = tmp;
+    }
+    for ( guint nn = ss->pred_reverse[meet]; nn != OSM_GRAPH_NONE; nn = ss->pred_reverse[nn] )
+      g_array_append_val ( route, nn );
+    if ( cost )
+      *cost = (guint32)MIN ( best, G_MAXUINT32 );
+  }
+
+  search_reset ( ss );
+  g_mutex_unlock ( &og->search_mutex );
+  return route;
+}
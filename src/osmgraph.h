@@ -0,0 +1,57 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_OSMGRAPH_H
+#define _VIKING_OSMGRAPH_H
+
+#include <glib.h>
+
+#include "coords.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+  OSM_GRAPH_PROFILE_CAR = 0,
+  OSM_GRAPH_PROFILE_BIKE,
+  OSM_GRAPH_PROFILE_FOOT,
+  OSM_GRAPH_PROFILE_NUM,
+} OsmGraphProfile;
+
+/**
+ * A road network derived from OpenStreetMap data,
+ *  with a directed graph for each profile where the edge costs are travel times in milliseconds.
+ */
+typedef struct _OsmGraph OsmGraph;
+
+OsmGraph *osm_graph_new_from_osm_file ( const gchar *filename );
+OsmGraph *osm_graph_load ( const gchar *filename );
+gboolean osm_graph_save ( const OsmGraph *og, const gchar *filename );
+void osm_graph_free ( OsmGraph *og );
+
+guint osm_graph_get_num_nodes ( const OsmGraph *og );
+guint osm_graph_get_num_edges ( const OsmGraph *og, OsmGraphProfile profile );
+void osm_graph_get_node_latlon ( const OsmGraph *og, guint node, struct LatLon *ll );
+
+gboolean osm_graph_get_nearest_node ( const OsmGraph *og, OsmGraphProfile profile, const struct LatLon *ll, guint *node );
+GArray *osm_graph_route ( OsmGraph *og, OsmGraphProfile profile, guint from, guint to, guint32 *cost );
+
+OsmGraphProfile osm_graph_profile_from_string ( const gchar *name );
+
+G_END_DECLS
+
+#endif
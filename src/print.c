@@ -178,6 +178,65 @@ static void copy_row_from_rgba(guchar *surface_pixels, guchar *pixbuf_pixels, gi
   }
 }
 
+// Height of each band of the page drawn in turn, in viewport pixels
+#define PRINT_BAND_HEIGHT 256
+// Limit on how much closer the map tiles used may be than on screen
+#define PRINT_MAX_DETAIL 4
+
+/**
+ * a_print_render:
+ * @top:    The layers to draw
+ * @vvp:    The viewport giving the position, zoom level and other settings
+ * @cr:     Where to draw - e.g. a printer page or a PDF surface
+ * @width:  Size of the area in viewport pixels
+ * @height:
+ * @detail: How many times closer map tiles may be than the zoom level of the viewport
+ *
+ * Draw the layers directly into the cairo context, so tracks, waypoints, grids and text
+ *  stay as vectors at the resolution of the output rather than being a copy of the screen.
+ * The area is drawn in bands, so only the map tiles for one band are needed at a time.
+ * The viewport is left as it was.
+ *
+ * Returns: FALSE if not possible, in which case nothing is drawn
+ */
+gboolean a_print_render ( VikAggregateLayer *top, VikViewport *vvp, cairo_t *cr, gint width, gint height, guint detail )
+{
+  if ( !vik_viewport_render_begin ( vvp, cr, width, height, detail ) )
+    return FALSE;
+  // Layers' GCs now need to refer to the new context
+  vik_aggregate_layer_configure ( top, vvp );
+
+  if ( VIK_LAYER(top)->visible ) {
+    for ( gint yy = 0; yy < height; yy += PRINT_BAND_HEIGHT ) {
+      GdkRectangle band = { 0, yy, width, MIN(PRINT_BAND_HEIGHT, height - yy) };
+      vik_viewport_section_begin ( vvp, &band );
+      vik_aggregate_layer_draw ( top, vvp );
+      vik_viewport_section_end ( vvp );
+    }
+  }
+  vik_viewport_draw_scale ( vvp );
+  vik_viewport_draw_copyright ( vvp );
+  vik_viewport_draw_logo ( vvp );
+
+  vik_viewport_render_end ( vvp );
+  vik_aggregate_layer_configure ( top, vvp );
+  // Layers consider themselves drawn, but that hasn't been on the screen
+  vik_viewport_cache_invalidate ( vvp );
+  return TRUE;
+}
+
+/**
+ * Extra detail for the map tiles based on how many printer dots there are
+ *  to each pixel of the viewport - as a power of two to match the tile zoom levels
+ */
+static guint print_detail ( gdouble dots_per_pixel )
+{
+  guint detail = 1;
+  while ( detail < PRINT_MAX_DETAIL && detail * 1.5 < dots_per_pixel )
+    detail *= 2;
+  return detail;
+}
+
 static void draw_page_cairo(GtkPrintContext *context, PrintData *data)
 {
   cairo_t         *cr;
@@ -195,16 +254,6 @@ static void draw_page_cairo(GtkPrintContext *context, PrintData *data)
   gint             y;
 
   cr = gtk_print_context_get_cairo_context(context);
-#if GTK_CHECK_VERSION (3,0,0)
-  pixbuf_to_draw = gdk_pixbuf_get_from_window ( gtk_widget_get_window (GTK_WIDGET(data->vvp)),
-                                                0, 0, data->width, data->height );
-#else
-  pixbuf_to_draw = gdk_pixbuf_get_from_drawable(NULL,
-                               GDK_DRAWABLE(vik_viewport_get_pixmap(data->vvp)),
-                               NULL, 0, 0, 0, 0, data->width, data->height);
-#endif
-  surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
-                                       data->width, data->height);
 
   cr_dpi_x  = gtk_print_context_get_dpi_x  (context);
   cr_dpi_y  = gtk_print_context_get_dpi_y  (context);
@@ -217,6 +266,28 @@ static void draw_page_cairo(GtkPrintContext *context, PrintData *data)
                    data->offset_y / cr_dpi_y * 72.0);
   cairo_scale (cr, scale_x, scale_y);
 
+  // Draw the layers again directly onto the page
+  cairo_save ( cr );
+  cairo_rectangle ( cr, 0, 0, data->width, data->height );
+  cairo_clip ( cr );
+  gboolean rendered = a_print_render ( vik_layers_panel_get_top_layer(vik_window_layers_panel(data->vw)), data->vvp,
+                                       cr, data->width, data->height, print_detail(MIN(scale_x, scale_y)) );
+  cairo_restore ( cr );
+  if ( rendered )
+    return;
+
+  // Otherwise copy what is on the screen
+#if GTK_CHECK_VERSION (3,0,0)
+  pixbuf_to_draw = gdk_pixbuf_get_from_window ( gtk_widget_get_window (GTK_WIDGET(data->vvp)),
+                                                0, 0, data->width, data->height );
+#else
+  pixbuf_to_draw = gdk_pixbuf_get_from_drawable(NULL,
+                               GDK_DRAWABLE(vik_viewport_get_pixmap(data->vvp)),
+                               NULL, 0, 0, 0, 0, data->width, data->height);
+#endif
+  surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+                                       data->width, data->height);
+
   surface_pixels = cairo_image_surface_get_data (surface);
   stride = cairo_image_surface_get_stride (surface);
   pixbuf_pixels = gdk_pixbuf_get_pixels (pixbuf_to_draw);
@@ -25,11 +25,14 @@
 #define __VIKING_PRINT_H
 
 #include "vikwindow.h"
+#include "vikaggregatelayer.h"
 
 G_BEGIN_DECLS
 
 void a_print(VikWindow *vw, VikViewport *vvp);
 
+gboolean a_print_render ( VikAggregateLayer *top, VikViewport *vvp, cairo_t *cr, gint width, gint height, guint detail );
+
 G_END_DECLS
 
 #endif /*__VIKING_PRINT_H*/
@@ -111,76 +111,178 @@ static tag_mapping tag_path_map[] = {
 	{0}
 };
 
-static tag_type get_tag ( const char *tt )
+// The tag paths as a tree, so each element only needs a lookup amongst the children of its parent
+//  rather than a comparison of the whole path against every mapping
+typedef struct {
+	tag_type tag_type;
+	GHashTable *children; // Element name -> tag_node; NULL when there are none
+} tag_node;
+
+static tag_node *tag_tree_add ( tag_node *parent, const gchar *name )
+{
+	if ( !parent->children )
+		parent->children = g_hash_table_new ( g_str_hash, g_str_equal );
+	tag_node *node = g_hash_table_lookup ( parent->children, name );
+	if ( !node ) {
+		node = g_new0 ( tag_node, 1 );
+		g_hash_table_insert ( parent->children, g_strdup(name), node );
+	}
+	return node;
+}
+
+static gpointer tag_tree_build ( gpointer data )
+{
+	tag_node *root = g_new0 ( tag_node, 1 );
+	for ( tag_mapping *tm = tag_path_map; tm->tag_type != 0; tm++ ) {
+		gchar **parts = g_strsplit ( tm->tag_name + 1, "/", -1 );
+		tag_node *node = root;
+		for ( guint ii = 0; parts[ii]; ii++ )
+			node = tag_tree_add ( node, parts[ii] );
+		node->tag_type = tm->tag_type;
+		g_strfreev ( parts );
+	}
+	return root;
+}
+
+/**
+ * Built on first use and then shared (read only) by all parses
+ */
+static tag_node *get_tag_tree ( void )
 {
-	tag_mapping *tm;
-	for ( tm = tag_path_map; tm->tag_type != 0; tm++ )
-		if ( 0 == strcmp(tm->tag_name, tt) )
-			return tm->tag_type;
-	return tt_unknown;
+	static GOnce once = G_ONCE_INIT;
+	return g_once ( &once, tag_tree_build, NULL );
 }
 
-static tag_type current_tag = tt_unknown;
-static GString *xpath = NULL;
-static GString *c_cdata = NULL;
+typedef struct {
+	gchar *name;
+	gpointer item; // VikTrack or VikWaypoint
+} tcx_item_t;
+
+// Everything read for a course (or lap), turned into a TRW layer at the end
+typedef struct {
+	gchar *name;
+	VikTRWMetadata *md;
+	GList *tracks;    // of tcx_item_t, in reverse order
+	GList *waypoints; // of tcx_item_t, in reverse order
+} tcx_course_t;
+
+// All state of a parse, so that several files can be read at once
+// Nothing here touches any layer, so the parse can be done in any thread
+//  with the layers only created when finishing in the main thread
+typedef struct {
+	GPtrArray *stack;   // Of the tag_node of each open element; NULL within unknown elements
+	tag_type current_tag;
+	GString *cdata;
 
-// current ("c_") objects
-static VikTrackpoint *c_tp = NULL;
-static VikWaypoint *c_wp = NULL;
-static VikTrack *c_tr = NULL;
-static VikTrwLayer *c_vtl = NULL;
-static VikTRWMetadata *c_md = NULL;
+	// current ("c_") objects
+	tcx_course_t *c_course;
+	VikTrackpoint *c_tp;
+	VikWaypoint *c_wp;
+	VikTrack *c_tr;
+	gchar *c_wp_name;
 
-static gchar *c_wp_name = NULL;
-static gchar *c_tr_name = NULL;
-static gboolean has_layer_name = FALSE;
+	// temporary things so we don't have to create them lots of times
+	struct LatLon c_ll;
 
-// temporary things so we don't have to create them lots of times
-static struct LatLon c_ll;
+	// specialty flags / etc
+	gboolean f_tr_newseg;
+	guint unnamed_waypoints;
+	guint unnamed_tracks;
 
-// specialty flags / etc
-static gboolean f_tr_newseg;
-static guint unnamed_waypoints = 0;
-static guint unnamed_tracks = 0;
-static guint unnamed_layers = 0;
+	GList *courses; // of tcx_course_t, in reverse order
+} tcx_context_t;
 
-typedef struct {
-	VikAggregateLayer *val;
-	VikViewport *vvp;
-	const gchar *filename;
-} UserDataT;
+static tcx_context_t *tcx_context_new ( void )
+{
+	tcx_context_t *ctx = g_new0 ( tcx_context_t, 1 );
+	ctx->stack = g_ptr_array_sized_new ( 16 );
+	g_ptr_array_add ( ctx->stack, get_tag_tree() );
+	ctx->cdata = g_string_new ( "" );
+	ctx->unnamed_waypoints = 1;
+	ctx->unnamed_tracks = 1;
+	return ctx;
+}
 
-static void tcx_start ( UserDataT *ud, const char *el, const char **attr )
+static void tcx_item_free ( tcx_item_t *ti, gboolean is_track )
 {
-	g_string_append_c ( xpath, '/' );
-	g_string_append ( xpath, el );
-	current_tag = get_tag ( xpath->str );
+	if ( ti->item ) {
+		if ( is_track )
+			vik_track_free ( ti->item );
+		else
+			vik_waypoint_free ( ti->item );
+	}
+	g_free ( ti->name );
+	g_free ( ti );
+}
 
-	switch ( current_tag ) {
+static void tcx_course_free ( tcx_course_t *course )
+{
+	for ( GList *iter = course->tracks; iter; iter = iter->next )
+		tcx_item_free ( iter->data, TRUE );
+	g_list_free ( course->tracks );
+	for ( GList *iter = course->waypoints; iter; iter = iter->next )
+		tcx_item_free ( iter->data, FALSE );
+	g_list_free ( course->waypoints );
+	if ( course->md )
+		vik_trw_metadata_free ( course->md );
+	g_free ( course->name );
+	g_free ( course );
+}
 
-		case tt_tcx: {
-			c_vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, ud->vvp, FALSE ));
-			// Always force V1.1, since we may read in 'extended' data like cadence, etc...
-			vik_trw_layer_set_gpx_version ( c_vtl, GPX_V1_1 );
-			c_md = vik_trw_metadata_new();
+static void tcx_context_free ( tcx_context_t *ctx )
+{
+	if ( !ctx )
+		return;
+	// Anything left over from an incomplete file
+	if ( ctx->c_tp )
+		vik_trackpoint_free ( ctx->c_tp );
+	if ( ctx->c_tr )
+		vik_track_free ( ctx->c_tr );
+	if ( ctx->c_wp )
+		vik_waypoint_free ( ctx->c_wp );
+	g_free ( ctx->c_wp_name );
+	if ( ctx->c_course )
+		tcx_course_free ( ctx->c_course );
+
+	for ( GList *iter = ctx->courses; iter; iter = iter->next )
+		tcx_course_free ( iter->data );
+	g_list_free ( ctx->courses );
+	g_ptr_array_free ( ctx->stack, TRUE );
+	g_string_free ( ctx->cdata, TRUE );
+	g_free ( ctx );
+}
+
+static void tcx_start ( tcx_context_t *ctx, const char *el, const char **attr )
+{
+	tag_node *parent = g_ptr_array_index ( ctx->stack, ctx->stack->len-1 );
+	tag_node *node = NULL;
+	if ( parent && parent->children )
+		node = g_hash_table_lookup ( parent->children, el );
+	g_ptr_array_add ( ctx->stack, node );
+	ctx->current_tag = node ? node->tag_type : tt_unknown;
+
+	switch ( ctx->current_tag ) {
+
+		case tt_tcx:
+			ctx->c_course = g_new0 ( tcx_course_t, 1 );
+			ctx->c_course->md = vik_trw_metadata_new();
 			break;
-		}
 
 		case tt_wpt:
-			c_wp = vik_waypoint_new ();
-			c_ll.lat = NAN;
-			c_ll.lon = NAN;
+			ctx->c_wp = vik_waypoint_new ();
+			ctx->c_ll.lat = NAN;
+			ctx->c_ll.lon = NAN;
 			break;
 
 		case tt_trk:
-			c_tr = vik_track_new ();
-			f_tr_newseg = TRUE;
+			ctx->c_tr = vik_track_new ();
+			ctx->f_tr_newseg = TRUE;
 			break;
 
 		case tt_trk_trkseg_trkpt:
-			c_tp = vik_trackpoint_new ();
-			c_ll.lat = NAN;
-			c_ll.lon = NAN;
+			ctx->c_tp = vik_trackpoint_new ();
+			ctx->c_ll.lat = NAN;
+			ctx->c_ll.lon = NAN;
 			break;
 
 		case tt_tcx_creator:
@@ -200,222 +302,211 @@ static void tcx_start ( UserDataT *ud, const char *el, const char **attr )
 		case tt_wpt_time:
 		case tt_wpt_pos_lat:
 		case tt_wpt_pos_lon:
-			g_string_erase ( c_cdata, 0, -1 ); // clear the cdata buffer
+			g_string_erase ( ctx->cdata, 0, -1 ); // clear the cdata buffer
 			break;
 
 		default: break;
 	}
 }
 
-static void tcx_end ( UserDataT *ud, const char *el )
+static gdouble tcx_timestamp ( const gchar *str, gdouble current )
 {
-	static GTimeVal tp_time;
-	static GTimeVal wp_time;
+	GTimeVal tv;
+	if ( g_time_val_from_iso8601(str, &tv) ) {
+		gdouble d1 = tv.tv_sec;
+		gdouble d2 = (gdouble)tv.tv_usec/G_USEC_PER_SEC;
+		return (d1 < 0) ? d1 - d2 : d1 + d2;
+	}
+	return current;
+}
 
-	g_string_truncate ( xpath, xpath->len - strlen(el) - 1 );
+static void tcx_end ( tcx_context_t *ctx, const char *el )
+{
+	tag_node *node = g_ptr_array_remove_index ( ctx->stack, ctx->stack->len-1 );
+	GString *cdata = ctx->cdata;
 
-	switch ( current_tag ) {
+	switch ( node ? node->tag_type : tt_unknown ) {
 
 		case tt_tcx:
-			if ( c_vtl ) {
-				if ( vik_trw_layer_is_empty(c_vtl) ) {
-					// free up layer
-					g_warning ( "%s: No useable geo data found in %s", __FUNCTION__, vik_layer_get_name(VIK_LAYER(c_vtl)) );
-					g_object_unref ( c_vtl );
-				} else {
-					// Add it
-					if ( !has_layer_name ) {
-						unnamed_layers++;
-						gchar *name = g_strdup_printf ( "%s %04d", a_file_basename(ud->filename), unnamed_layers );
-						vik_layer_rename ( VIK_LAYER(c_vtl), name );
-						g_free ( name );
-					}
-					vik_layer_post_read ( VIK_LAYER(c_vtl), ud->vvp, TRUE );
-					vik_aggregate_layer_add_layer ( ud->val, VIK_LAYER(c_vtl), FALSE );
-					vik_trw_layer_set_metadata ( c_vtl, c_md );
-					// TODO - only really need to do this once at the end on the aggregate layer, but no functionality for this yet
-					vik_trw_layer_auto_set_view ( c_vtl, ud->vvp );
-				}
-				c_md = NULL;
-				c_vtl = NULL;
-				has_layer_name = FALSE;
+			if ( ctx->c_course ) {
+				ctx->courses = g_list_prepend ( ctx->courses, ctx->c_course );
+				ctx->c_course = NULL;
 			}
 			break;
 
 		case tt_tcx_name:
-			if ( c_vtl ) {
-				vik_layer_rename ( VIK_LAYER(c_vtl), c_cdata->str );
-				has_layer_name = TRUE;
+			if ( ctx->c_course ) {
+				g_free ( ctx->c_course->name );
+				ctx->c_course->name = g_strdup ( cdata->str );
 			}
-			g_string_erase ( c_cdata, 0, -1 );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_tcx_creator:
-			if ( c_md ) {
-				if ( c_md->author )
-					g_free ( c_md->author );
-				c_md->author = g_strdup ( c_cdata->str );
+			if ( ctx->c_course ) {
+				VikTRWMetadata *md = ctx->c_course->md;
+				if ( md->author )
+					g_free ( md->author );
+				md->author = g_strdup ( cdata->str );
 			}
-			g_string_erase ( c_cdata, 0, -1 );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_tcx_cmt:
-			if ( c_md ) {
-				if ( c_md->description )
-					g_free ( c_md->description );
-				c_md->description = g_strdup ( c_cdata->str );
+			if ( ctx->c_course ) {
+				VikTRWMetadata *md = ctx->c_course->md;
+				if ( md->description )
+					g_free ( md->description );
+				md->description = g_strdup ( cdata->str );
 			}
-			g_string_erase ( c_cdata, 0, -1 );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_wpt:
-			if ( !c_wp_name )
-				c_wp_name = g_strdup_printf ( _("Waypoint%04d"), unnamed_waypoints++ );
-
-			if ( !isnan(c_ll.lat) && !isnan(c_ll.lon) ) {
-				vik_coord_load_from_latlon ( &(c_wp->coord), vik_trw_layer_get_coord_mode(c_vtl), &c_ll );
-				vik_trw_layer_filein_add_waypoint ( c_vtl, c_wp_name, c_wp );
+			if ( !ctx->c_wp_name )
+				ctx->c_wp_name = g_strdup_printf ( _("Waypoint%04d"), ctx->unnamed_waypoints++ );
+
+			if ( !isnan(ctx->c_ll.lat) && !isnan(ctx->c_ll.lon) && ctx->c_course ) {
+				// Converted to the layer's coordinate mode when finishing
+				vik_coord_load_from_latlon ( &(ctx->c_wp->coord), VIK_COORD_LATLON, &ctx->c_ll );
+				tcx_item_t *ti = g_new ( tcx_item_t, 1 );
+				ti->name = ctx->c_wp_name;
+				ti->item = ctx->c_wp;
+				ctx->c_course->waypoints = g_list_prepend ( ctx->c_course->waypoints, ti );
 			} else {
-				g_warning ( "%s: Missing a coordinate value for %s", __FUNCTION__, c_wp_name );
-				vik_waypoint_free ( c_wp ); 
+				g_warning ( "%s: Missing a coordinate value for %s", __FUNCTION__, ctx->c_wp_name );
+				vik_waypoint_free ( ctx->c_wp );
+				g_free ( ctx->c_wp_name );
 			}
-
-			g_free ( c_wp_name );
-			c_wp = NULL;
-			c_wp_name = NULL;
+			ctx->c_wp = NULL;
+			ctx->c_wp_name = NULL;
 			break;
 
 		case tt_trk:
-			if ( c_vtl ) {
-				c_tr_name = g_strdup_printf ( _("Track%03d"), unnamed_tracks++ );
-				c_tr->trackpoints = g_list_reverse ( c_tr->trackpoints );
-				vik_trw_layer_filein_add_track ( c_vtl, c_tr_name, c_tr );
-			}
-			g_free ( c_tr_name );
-			c_tr = NULL;
-			c_tr_name = NULL;
+			if ( ctx->c_course ) {
+				ctx->c_tr->trackpoints = g_list_reverse ( ctx->c_tr->trackpoints );
+				tcx_item_t *ti = g_new ( tcx_item_t, 1 );
+				ti->name = g_strdup_printf ( _("Track%03d"), ctx->unnamed_tracks++ );
+				ti->item = ctx->c_tr;
+				ctx->c_course->tracks = g_list_prepend ( ctx->c_course->tracks, ti );
+			} else
+				vik_track_free ( ctx->c_tr );
+			ctx->c_tr = NULL;
 			break;
 
 		case tt_wpt_name:
-			if ( c_wp_name )
-				g_free ( c_wp_name );
-			c_wp_name = g_strdup ( c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			if ( ctx->c_wp_name )
+				g_free ( ctx->c_wp_name );
+			ctx->c_wp_name = g_strdup ( cdata->str );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_wpt_ele:
-			c_wp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ctx->c_wp->altitude = g_ascii_strtod ( cdata->str, NULL );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_ele:
-			c_tp->altitude = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ctx->c_tp->altitude = g_ascii_strtod ( cdata->str, NULL );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_wpt_cmt:
-			vik_waypoint_set_comment ( c_wp, c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			vik_waypoint_set_comment ( ctx->c_wp, cdata->str );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_wpt_time:
-			if ( g_time_val_from_iso8601(c_cdata->str, &wp_time) ) {
-				gdouble d1 = wp_time.tv_sec;
-				gdouble d2 = (gdouble)wp_time.tv_usec/G_USEC_PER_SEC;
-				c_wp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
-			}
-			g_string_erase ( c_cdata, 0, -1 );
+			ctx->c_wp->timestamp = tcx_timestamp ( cdata->str, ctx->c_wp->timestamp );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_time:
-			if ( g_time_val_from_iso8601(c_cdata->str, &tp_time) ) {
-				gdouble d1 = tp_time.tv_sec;
-				gdouble d2 = (gdouble)tp_time.tv_usec/G_USEC_PER_SEC;
-				c_tp->timestamp = (d1 < 0) ? d1 - d2 : d1 + d2;
-			}
-			g_string_erase ( c_cdata, 0, -1 );
+			ctx->c_tp->timestamp = tcx_timestamp ( cdata->str, ctx->c_tp->timestamp );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_pos_lat: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = g_ascii_strtod ( cdata->str, NULL );
 			if ( dd < -90.0 || dd > 90.0 )
 				g_warning ( "%s: Invalid trkpt latitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lat = dd;
+				ctx->c_ll.lat = dd;
 			}
 			break;
 
 		case tt_trk_trkseg_trkpt_pos_lon: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = g_ascii_strtod ( cdata->str, NULL );
 			if ( dd < -180.0 || dd > 180.0 )
 				g_warning ( "%s: Invalid trkpt longitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lon = dd;
+				ctx->c_ll.lon = dd;
 			}
 			break;
 
 		case tt_trk_trkseg_trkpt:
-			if ( !isnan(c_ll.lat) && !isnan(c_ll.lon) ) {
-				vik_coord_load_from_latlon ( &(c_tp->coord), vik_trw_layer_get_coord_mode(c_vtl), &c_ll );
-				if ( f_tr_newseg ) {
-					c_tp->newsegment = TRUE;
-					f_tr_newseg = FALSE;
+			if ( !isnan(ctx->c_ll.lat) && !isnan(ctx->c_ll.lon) ) {
+				vik_coord_load_from_latlon ( &(ctx->c_tp->coord), VIK_COORD_LATLON, &ctx->c_ll );
+				if ( ctx->f_tr_newseg ) {
+					ctx->c_tp->newsegment = TRUE;
+					ctx->f_tr_newseg = FALSE;
 				}
-				c_tr->trackpoints = g_list_prepend ( c_tr->trackpoints, c_tp );
+				ctx->c_tr->trackpoints = g_list_prepend ( ctx->c_tr->trackpoints, ctx->c_tp );
 			} else {
 				g_warning ( "%s: Missing a coordinate value", __FUNCTION__ );
-				vik_trackpoint_free ( c_tp );
+				vik_trackpoint_free ( ctx->c_tp );
 			}
-			c_tp = NULL;
+			ctx->c_tp = NULL;
 			break;
 
 		case tt_wpt_pos_lat: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = g_ascii_strtod ( cdata->str, NULL );
 			if ( dd < -90.0 || dd > 90.0 )
 				g_warning ( "%s: Invalid wpt latitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lat = dd;
+				ctx->c_ll.lat = dd;
 			}
 			break;
 
 		case tt_wpt_pos_lon: {
-			gdouble dd = g_ascii_strtod ( c_cdata->str, NULL );
+			gdouble dd = g_ascii_strtod ( cdata->str, NULL );
 			if ( dd < -180.0 || dd > 180.0 )
 				g_warning ( "%s: Invalid wpt longitude value %.6f", __FUNCTION__, dd );
 			else
-				c_ll.lon = dd;
+				ctx->c_ll.lon = dd;
 			}
 			break;
 
 		case tt_trk_trkseg_trkpt_cadence:
-			c_tp->cadence = atoi ( c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			ctx->c_tp->cadence = atoi ( cdata->str );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_hr:
-			c_tp->heart_rate = atoi ( c_cdata->str );
-			g_string_erase ( c_cdata, 0, -1 );
+			ctx->c_tp->heart_rate = atoi ( cdata->str );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_power:
-			c_tp->power = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ctx->c_tp->power = g_ascii_strtod ( cdata->str, NULL );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 		case tt_trk_trkseg_trkpt_speed:
-			c_tp->speed = g_ascii_strtod ( c_cdata->str, NULL );
-			g_string_erase ( c_cdata, 0, -1 );
+			ctx->c_tp->speed = g_ascii_strtod ( cdata->str, NULL );
+			g_string_erase ( cdata, 0, -1 );
 			break;
 
 	        default: break;
 	}
 
-	current_tag = get_tag ( xpath->str );
+	tag_node *parent = g_ptr_array_index ( ctx->stack, ctx->stack->len-1 );
+	ctx->current_tag = parent ? parent->tag_type : tt_unknown;
 }
 
-static void tcx_cdata ( void *dta, const XML_Char *ss, int len )
+static void tcx_cdata ( tcx_context_t *ctx, const XML_Char *ss, int len )
 {
-	switch ( current_tag ) {
+	switch ( ctx->current_tag ) {
 		case tt_tcx_name:
 		case tt_tcx_creator:
 		case tt_tcx_cmt:
@@ -433,46 +524,41 @@ static void tcx_cdata ( void *dta, const XML_Char *ss, int len )
 		case tt_trk_trkseg_trkpt_hr:
 		case tt_trk_trkseg_trkpt_power:
 		case tt_trk_trkseg_trkpt_speed:
-			g_string_append_len ( c_cdata, ss, len );
+			g_string_append_len ( ctx->cdata, ss, len );
 			break;
 		default: break; // ignore cdata from other things
 	}
 }
 
+// Much larger than a typical file system block, since files are often read many at once
+#define TCX_READ_SIZE (256*1024)
 
 /**
- * Returns TRUE on a successful file read
- *   NB The file of course could contain no actual geo data that we can use!
- * NB2 Filename is used in case a name from within the file itself can not be found
- *   as file access is via the FILE* stream methods
+ * Parse the whole stream into the context, without creating any layers
+ * Safe to call from any thread
  */
-gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, const gchar* filename )
+static gboolean tcx_context_parse ( tcx_context_t *ctx, FILE *ff )
 {
 	XML_Parser parser = XML_ParserCreate ( NULL );
-	int done=0, len;
 	enum XML_Status status = XML_STATUS_ERROR;
-
-	UserDataT *ud = g_malloc (sizeof(UserDataT));
-	ud->val      = val;
-	ud->vvp      = vvp;
-	ud->filename = filename;
+	gboolean done = FALSE;
 
 	XML_SetElementHandler ( parser, (XML_StartElementHandler)tcx_start, (XML_EndElementHandler)tcx_end );
-	XML_SetUserData ( parser, ud );
+	XML_SetUserData ( parser, ctx );
 	XML_SetCharacterDataHandler ( parser, (XML_CharacterDataHandler)tcx_cdata );
 
-	gchar buf[4096];
-
-	xpath = g_string_new ( "" );
-	c_cdata = g_string_new ( "" );
-
-	unnamed_waypoints = 1;
-	unnamed_tracks = 1;
-
 	while ( !done ) {
-		len = fread ( buf, 1, sizeof(buf)-7, ff );
+		// Read directly into expat's own buffer to save a copy
+		void *buf = XML_GetBuffer ( parser, TCX_READ_SIZE );
+		if ( !buf ) {
+			status = XML_STATUS_ERROR;
+			break;
+		}
+		size_t len = fread ( buf, 1, TCX_READ_SIZE, ff );
 		done = feof ( ff ) || !len;
-		status = XML_Parse ( parser, buf, len, done );
+		status = XML_ParseBuffer ( parser, len, done );
+		if ( status == XML_STATUS_ERROR )
+			break;
 	}
 
 	gboolean ans = (status != XML_STATUS_ERROR);
@@ -480,10 +566,147 @@ gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, c
 		g_warning ( "%s: XML error %s at line %ld", __FUNCTION__, XML_ErrorString(XML_GetErrorCode(parser)), XML_GetCurrentLineNumber(parser) );
 	}
 
-	XML_ParserFree (parser);
-	g_free ( ud );
-	g_string_free ( xpath, TRUE );
-	g_string_free ( c_cdata, TRUE );
+	XML_ParserFree ( parser );
+	return ans;
+}
+
+/**
+ * Create a TRW layer for each course read and add them to the aggregate layer
+ * Must be run in the main thread
+ *
+ * Returns: The number of layers added
+ */
+static guint tcx_context_finish ( tcx_context_t *ctx, VikAggregateLayer *val, VikViewport *vvp, const gchar *filename )
+{
+	guint added = 0;
+	guint unnamed_layers = 0;
+	ctx->courses = g_list_reverse ( ctx->courses );
+	for ( GList *iter = ctx->courses; iter; iter = iter->next ) {
+		tcx_course_t *course = iter->data;
+
+		VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, vvp, FALSE ));
+		// Always force V1.1, since we may read in 'extended' data like cadence, etc...
+		vik_trw_layer_set_gpx_version ( vtl, GPX_V1_1 );
+		VikCoordMode mode = vik_trw_layer_get_coord_mode ( vtl );
+
+		if ( course->name )
+			vik_layer_rename ( VIK_LAYER(vtl), course->name );
+
+		course->tracks = g_list_reverse ( course->tracks );
+		for ( GList *it = course->tracks; it; it = it->next ) {
+			tcx_item_t *ti = it->data;
+			if ( mode != VIK_COORD_LATLON )
+				vik_track_convert ( VIK_TRACK(ti->item), mode );
+			vik_trw_layer_filein_add_track ( vtl, ti->name, VIK_TRACK(ti->item) );
+			ti->item = NULL;
+		}
+
+		course->waypoints = g_list_reverse ( course->waypoints );
+		for ( GList *it = course->waypoints; it; it = it->next ) {
+			tcx_item_t *ti = it->data;
+			VikWaypoint *wp = ti->item;
+			if ( mode != VIK_COORD_LATLON )
+				vik_coord_convert ( &(wp->coord), mode );
+			vik_trw_layer_filein_add_waypoint ( vtl, ti->name, wp );
+			ti->item = NULL;
+		}
+
+		if ( vik_trw_layer_is_empty(vtl) ) {
+			// free up layer
+			g_warning ( "%s: No useable geo data found in %s", __FUNCTION__, vik_layer_get_name(VIK_LAYER(vtl)) );
+			g_object_unref ( vtl );
+			continue;
+		}
+
+		// Add it
+		if ( !course->name ) {
+			unnamed_layers++;
+			gchar *name = g_strdup_printf ( "%s %04d", a_file_basename(filename), unnamed_layers );
+			vik_layer_rename ( VIK_LAYER(vtl), name );
+			g_free ( name );
+		}
+		vik_layer_post_read ( VIK_LAYER(vtl), vvp, TRUE );
+		vik_aggregate_layer_add_layer ( val, VIK_LAYER(vtl), FALSE );
+		vik_trw_layer_set_metadata ( vtl, course->md );
+		course->md = NULL;
+		// TODO - only really need to do this once at the end on the aggregate layer, but no functionality for this yet
+		if ( vvp )
+			vik_trw_layer_auto_set_view ( vtl, vvp );
+		added++;
+	}
+	return added;
+}
 
+/**
+ * Returns TRUE on a successful file read
+ *   NB The file of course could contain no actual geo data that we can use!
+ * NB2 Filename is used in case a name from within the file itself can not be found
+ *   as file access is via the FILE* stream methods
+ */
+gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, const gchar* filename )
+{
+	tcx_context_t *ctx = tcx_context_new ();
+	gboolean ans = tcx_context_parse ( ctx, ff );
+	// Even on an error, keep any courses completed before it
+	(void)tcx_context_finish ( ctx, val, vvp, filename );
+	tcx_context_free ( ctx );
 	return ans;
 }
+
+typedef struct {
+	const gchar *filename;
+	tcx_context_t *ctx;
+	gboolean parsed;
+} tcx_job_t;
+
+static void tcx_parse_job ( tcx_job_t *job, gpointer user_data )
+{
+	FILE *ff = g_fopen ( job->filename, "r" );
+	if ( !ff ) {
+		g_warning ( "%s: Unable to open %s", __FUNCTION__, job->filename );
+		return;
+	}
+	job->ctx = tcx_context_new ();
+	job->parsed = tcx_context_parse ( job->ctx, ff );
+	fclose ( ff );
+}
+
+/**
+ * a_tcx_read_files:
+ * @filenames: A #GSList of TCX filenames
+ *
+ * Parse several TCX files at once (e.g. a training history),
+ *  spread across the available processors.
+ * Each course is put into its own layer,
+ *  with the layers added in the same order as the list.
+ *
+ * Returns: The number of files successfully read
+ */
+guint a_tcx_read_files ( VikAggregateLayer *val, VikViewport *vvp, GSList *filenames )
+{
+	guint num = g_slist_length ( filenames );
+	if ( !num )
+		return 0;
+
+	tcx_job_t *jobs = g_new0 ( tcx_job_t, num );
+	GThreadPool *pool = g_thread_pool_new ( (GFunc)tcx_parse_job, NULL, MIN(util_get_number_of_cpus(), num), FALSE, NULL );
+	guint ii = 0;
+	for ( GSList *iter = filenames; iter; iter = iter->next, ii++ ) {
+		jobs[ii].filename = iter->data;
+		g_thread_pool_push ( pool, &jobs[ii], NULL );
+	}
+	// Wait for all to be parsed
+	g_thread_pool_free ( pool, FALSE, TRUE );
+
+	guint loaded = 0;
+	for ( ii = 0; ii < num; ii++ ) {
+		if ( jobs[ii].ctx ) {
+			(void)tcx_context_finish ( jobs[ii].ctx, val, vvp, jobs[ii].filename );
+			if ( jobs[ii].parsed )
+				loaded++;
+		}
+		tcx_context_free ( jobs[ii].ctx );
+	}
+	g_free ( jobs );
+	return loaded;
+}
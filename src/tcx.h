@@ -27,6 +27,7 @@
 G_BEGIN_DECLS
 
 gboolean a_tcx_read_file ( VikAggregateLayer *val, VikViewport *vvp, FILE *ff, const gchar* filename );
+guint a_tcx_read_files ( VikAggregateLayer *val, VikViewport *vvp, GSList *filenames );
 
 G_END_DECLS
 
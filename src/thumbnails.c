@@ -304,6 +304,320 @@ out:
 	return thumb;
 }
 
+/*
+ * Images for drawing, held in a memory cache shared by all users
+ *  and loaded (or created) in the background when not available
+ */
+
+#define VIK_SETTINGS_THUMBNAILS_CACHE_SIZE "thumbnails_cache_size"
+#define VIK_SETTINGS_THUMBNAILS_MAX_THREADS "thumbnails_max_threads"
+// MB
+#define THUMBNAILS_CACHE_SIZE_DEFAULT 64
+
+typedef struct {
+  gchar *key;
+  GdkPixbuf *pixbuf; // NULL when the image could not be loaded
+  gsize bytes;
+  GList *link;       // Position in the LRU queue
+  guint generation;  // Of the last drawing to use it
+} CacheEntry;
+
+typedef struct {
+  ThumbnailsReadyFunc func;
+  gpointer user_data;
+} Waiter;
+
+typedef struct {
+  gchar *key;
+  gchar *filename;
+  guint size;
+  guint8 alpha;
+  guint seq;
+} Job;
+
+static GMutex *cache_mutex = NULL;
+static GHashTable *cache = NULL;   // key -> CacheEntry
+static GQueue lru = G_QUEUE_INIT;  // Most recently used at the head
+static gsize cache_bytes = 0;
+static gsize cache_max_bytes = THUMBNAILS_CACHE_SIZE_DEFAULT * 1024 * 1024;
+static guint cache_generation = 0; // Of the latest drawing
+static GHashTable *pending = NULL; // key -> GSList of Waiter
+static GThreadPool *pool = NULL;
+static guint job_seq = 0;
+
+// Something that can't occur in a real filename
+#define PLACEHOLDER_NAME "\x12"
+
+static gchar *cache_key ( const gchar *filename, guint size, guint8 alpha )
+{
+  return g_strdup_printf ( "%u:%u:%s", size, alpha, filename );
+}
+
+static void cache_entry_free ( CacheEntry *ce )
+{
+  if ( ce->pixbuf )
+    g_object_unref ( ce->pixbuf );
+  g_free ( ce );
+}
+
+// NB All the cache_ functions must be called with the cache_mutex held
+
+/**
+ * Entries used by the current or the previous drawing are kept,
+ *  as they are likely to be wanted again by the drawing in progress.
+ * Otherwise loading an image could evict one still to be drawn,
+ *  whose reload then evicts another and so on.
+ */
+static gboolean cache_evictable ( CacheEntry *ce )
+{
+  return ce->generation + 1 < cache_generation;
+}
+
+/**
+ * Returns: TRUE if the cache is full of entries that can't be evicted
+ */
+static gboolean cache_full ( void )
+{
+  CacheEntry *tail = g_queue_peek_tail ( &lru );
+  return cache_bytes >= cache_max_bytes && tail && !cache_evictable ( tail );
+}
+
+static void cache_remove ( CacheEntry *ce )
+{
+  g_queue_delete_link ( &lru, ce->link );
+  cache_bytes -= ce->bytes;
+  g_hash_table_remove ( cache, ce->key );
+}
+
+/**
+ * Takes ownership of the key and the pixbuf
+ */
+static void cache_insert ( gchar *key, GdkPixbuf *pixbuf )
+{
+  CacheEntry *old = g_hash_table_lookup ( cache, key );
+  if ( old )
+    cache_remove ( old );
+
+  CacheEntry *ce = g_malloc ( sizeof(CacheEntry) );
+  ce->key = key;
+  ce->pixbuf = pixbuf;
+  // Not sure what this 100 represents anyway - c.f. mapcache
+  ce->bytes = 100;
+  if ( pixbuf )
+    ce->bytes += gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+  ce->generation = cache_generation;
+  g_queue_push_head ( &lru, ce );
+  ce->link = lru.head;
+  g_hash_table_insert ( cache, key, ce );
+  cache_bytes += ce->bytes;
+
+  // Always keep the one just added
+  // As the queue is in order of use, once the tail can't be evicted then neither can any other
+  while ( cache_bytes > cache_max_bytes ) {
+    CacheEntry *tail = g_queue_peek_tail ( &lru );
+    if ( tail == ce || !cache_evictable(tail) )
+      break;
+    cache_remove ( tail );
+  }
+}
+
+/**
+ * Returns: TRUE if in the cache, in which case @pixbuf is set (and may be NULL)
+ */
+static gboolean cache_lookup ( const gchar *key, GdkPixbuf **pixbuf )
+{
+  CacheEntry *ce = g_hash_table_lookup ( cache, key );
+  if ( !ce )
+    return FALSE;
+  // Now the most recently used
+  g_queue_unlink ( &lru, ce->link );
+  g_queue_push_head_link ( &lru, ce->link );
+  ce->generation = cache_generation;
+  *pixbuf = ce->pixbuf ? g_object_ref ( ce->pixbuf ) : NULL;
+  return TRUE;
+}
+
+static void job_free ( Job *job )
+{
+  g_free ( job->key );
+  g_free ( job->filename );
+  g_free ( job );
+}
+
+/**
+ * Most recent requests first, as these should be for what is currently on display
+ */
+static gint job_compare ( Job *aa, Job *bb, gpointer user_data )
+{
+  if ( aa->seq == bb->seq )
+    return 0;
+  return aa->seq > bb->seq ? -1 : 1;
+}
+
+static GdkPixbuf *scale_and_alpha ( GdkPixbuf *thumb, guint size, guint8 alpha )
+{
+  GdkPixbuf *pixbuf = a_thumbnails_scale_pixbuf ( thumb, size, size );
+  g_object_unref ( G_OBJECT(thumb) );
+  if ( pixbuf && alpha != 255 )
+    pixbuf = ui_pixbuf_set_alpha ( pixbuf, alpha );
+  return pixbuf;
+}
+
+/**
+ * Background thread
+ */
+static void thumbnail_job ( Job *job, gpointer user_data )
+{
+  GdkPixbuf *pixbuf = a_thumbnails_get ( job->filename );
+  if ( !pixbuf )
+    pixbuf = child_create_thumbnail ( job->filename );
+  if ( pixbuf )
+    pixbuf = scale_and_alpha ( pixbuf, job->size, job->alpha );
+
+  g_mutex_lock ( cache_mutex );
+  GSList *waiters = g_hash_table_lookup ( pending, job->key );
+  g_hash_table_remove ( pending, job->key );
+  // Even when failed, so it won't be tried again
+  cache_insert ( g_strdup(job->key), pixbuf );
+  // Called whilst locked so a_thumbnails_cancel() can be relied upon
+  for ( GSList *iter = waiters; iter; iter = iter->next ) {
+    Waiter *ww = iter->data;
+    ww->func ( ww->user_data );
+  }
+  g_slist_free_full ( waiters, g_free );
+  g_mutex_unlock ( cache_mutex );
+
+  job_free ( job );
+}
+
+/**
+ * a_thumbnails_get_cached:
+ * @filename:  The image file
+ * @size:      The maximum width and height
+ * @alpha:     Alpha to apply
+ * @generation: Identifies the drawing in progress, e.g. from vik_viewport_get_frame()
+ * @func:      Optional function to call (from a background thread) once the image is available
+ * @user_data: Data for @func
+ *
+ * Get the image from the cache, otherwise it will be loaded in the background,
+ *  also creating the thumbnail file if necessary.
+ * Images used by the current drawing are not evicted from the cache,
+ *  so once it is full of them no more are loaded until a later drawing.
+ *
+ * Returns: A new reference to the image, or NULL if not available (yet)
+ */
+GdkPixbuf *a_thumbnails_get_cached ( const gchar *filename, guint size, guint8 alpha, guint generation, ThumbnailsReadyFunc func, gpointer user_data )
+{
+  GdkPixbuf *pixbuf = NULL;
+  gchar *key = cache_key ( filename, size, alpha );
+
+  g_mutex_lock ( cache_mutex );
+  cache_generation = MAX ( cache_generation, generation );
+  if ( cache_lookup(key, &pixbuf) ) {
+    g_mutex_unlock ( cache_mutex );
+    g_free ( key );
+    return pixbuf;
+  }
+
+  gboolean requested = g_hash_table_contains ( pending, key );
+  if ( !requested && cache_full() ) {
+    // No room for it without evicting what is being drawn
+    g_mutex_unlock ( cache_mutex );
+    g_free ( key );
+    return NULL;
+  }
+
+  GSList *waiters = g_hash_table_lookup ( pending, key );
+  if ( func ) {
+    gboolean found = FALSE;
+    for ( GSList *iter = waiters; iter && !found; iter = iter->next ) {
+      Waiter *ww = iter->data;
+      found = ( ww->func == func && ww->user_data == user_data );
+    }
+    if ( !found ) {
+      Waiter *ww = g_malloc ( sizeof(Waiter) );
+      ww->func = func;
+      ww->user_data = user_data;
+      waiters = g_slist_prepend ( waiters, ww );
+    }
+  }
+
+  if ( requested ) {
+    g_hash_table_replace ( pending, key, waiters );
+    g_mutex_unlock ( cache_mutex );
+    return NULL;
+  }
+
+  g_hash_table_insert ( pending, g_strdup(key), waiters );
+  Job *job = g_malloc ( sizeof(Job) );
+  job->key = key;
+  job->filename = g_strdup ( filename );
+  job->size = size;
+  job->alpha = alpha;
+  job->seq = ++job_seq;
+  g_mutex_unlock ( cache_mutex );
+
+  g_thread_pool_push ( pool, job, NULL );
+  return NULL;
+}
+
+/**
+ * a_thumbnails_get_placeholder:
+ *
+ * The image to show whilst the real one is not available
+ *
+ * Returns: A new reference to the image, which may be NULL
+ */
+GdkPixbuf *a_thumbnails_get_placeholder ( guint size, guint8 alpha )
+{
+  GdkPixbuf *pixbuf = NULL;
+  gchar *key = cache_key ( PLACEHOLDER_NAME, size, alpha );
+
+  g_mutex_lock ( cache_mutex );
+  if ( cache_lookup(key, &pixbuf) ) {
+    g_free ( key );
+  }
+  else {
+    GdkPixbuf *thumb = a_thumbnails_get_default ();
+    if ( thumb ) {
+      pixbuf = scale_and_alpha ( thumb, size, alpha );
+      if ( pixbuf )
+        g_object_ref ( pixbuf );
+    }
+    cache_insert ( key, pixbuf );
+  }
+  g_mutex_unlock ( cache_mutex );
+  return pixbuf;
+}
+
+/**
+ * a_thumbnails_cancel:
+ *
+ * Stop any further calls back for @user_data, e.g. when it is about to be freed.
+ * Any images already requested will still be loaded into the cache.
+ */
+void a_thumbnails_cancel ( gpointer user_data )
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_mutex_lock ( cache_mutex );
+  g_hash_table_iter_init ( &iter, pending );
+  while ( g_hash_table_iter_next (&iter, &key, &value) ) {
+    GSList *waiters = value;
+    GSList *keep = NULL;
+    for ( GSList *ww = waiters; ww; ww = ww->next ) {
+      if ( ((Waiter*)ww->data)->user_data == user_data )
+        g_free ( ww->data );
+      else
+        keep = g_slist_prepend ( keep, ww->data );
+    }
+    g_slist_free ( waiters );
+    g_hash_table_iter_replace ( &iter, keep );
+  }
+  g_mutex_unlock ( cache_mutex );
+}
+
 /*
  * Startup and finish routines
  */
@@ -311,9 +625,40 @@ out:
 void a_thumbnails_init ()
 {
   set_thumb_dir ();
+
+  gint size = THUMBNAILS_CACHE_SIZE_DEFAULT;
+  if ( a_settings_get_integer ( VIK_SETTINGS_THUMBNAILS_CACHE_SIZE, &size ) && size > 0 )
+    cache_max_bytes = (gsize)size * 1024 * 1024;
+
+  cache_mutex = vik_mutex_new ();
+  cache = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) cache_entry_free );
+  pending = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+
+  // Mostly waiting on disk access, but creating a thumbnail can take a while too
+  gint cpus = util_get_number_of_cpus ();
+  gint threads = cpus > 1 ? cpus-1 : 1;
+  gint maxt;
+  if ( a_settings_get_integer ( VIK_SETTINGS_THUMBNAILS_MAX_THREADS, &maxt ) && maxt > 0 )
+    threads = maxt;
+  pool = g_thread_pool_new ( (GFunc) thumbnail_job, NULL, threads, FALSE, NULL );
+  g_thread_pool_set_sort_function ( pool, (GCompareDataFunc) job_compare, NULL );
 }
 
 void a_thumbnails_uninit ()
 {
+  // Drop any outstanding requests, but wait for those in progress
+  g_thread_pool_free ( pool, TRUE, TRUE );
+
+  g_queue_clear ( &lru );
+  g_hash_table_destroy ( cache );
+  // Any remaining waiters are just simple allocations
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init ( &iter, pending );
+  while ( g_hash_table_iter_next (&iter, NULL, &value) )
+    g_slist_free_full ( value, g_free );
+  g_hash_table_destroy ( pending );
+  vik_mutex_free ( cache_mutex );
+
   g_free ( thumb_dir );
 }
@@ -36,6 +36,12 @@ GdkPixbuf *a_thumbnails_get(const gchar *filename);
 GdkPixbuf *a_thumbnails_get_default ();
 GdkPixbuf *a_thumbnails_scale_pixbuf(GdkPixbuf *src, int max_w, int max_h);
 
+typedef void (*ThumbnailsReadyFunc) ( gpointer user_data );
+
+GdkPixbuf *a_thumbnails_get_cached ( const gchar *filename, guint size, guint8 alpha, guint generation, ThumbnailsReadyFunc func, gpointer user_data );
+GdkPixbuf *a_thumbnails_get_placeholder ( guint size, guint8 alpha );
+void a_thumbnails_cancel ( gpointer user_data );
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,554 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include "tileset.h"
+
+#define BLOCK_BITS 6
+#define BLOCK_SIZE (1 << BLOCK_BITS)
+#define BLOCK_MASK (BLOCK_SIZE - 1)
+#define BLOCK_TILES (BLOCK_SIZE * BLOCK_SIZE)
+
+// Block positions are at most 16 bits each (for tile positions up to 2^22)
+#define BLOCK_KEY(bx,by) GUINT_TO_POINTER( ((guint)(bx) << 16) | ((guint)(by) & 0xFFFF) )
+
+typedef struct {
+  gint bx, by;
+  guint64 rows[BLOCK_SIZE]; // One bit per tile, bit N being x offset N
+} TileBlock;
+
+struct _TileSet {
+  GHashTable *blocks; // Key is the packed block position
+  guint size;
+  gint xmin, ymin, xmax, ymax;
+};
+
+static inline guint lowest_bit ( guint64 bits )
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll ( bits );
+#else
+  guint nn = 0;
+  while ( !(bits & 1) ) { bits >>= 1; nn++; }
+  return nn;
+#endif
+}
+
+static inline guint highest_bit ( guint64 bits )
+{
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll ( bits );
+#else
+  guint nn = 0;
+  while ( bits >>= 1 ) nn++;
+  return nn;
+#endif
+}
+
+static inline guint count_bits ( guint64 bits )
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll ( bits );
+#else
+  guint nn = 0;
+  for ( ; bits; nn++ ) bits &= bits - 1;
+  return nn;
+#endif
+}
+
+TileSet *tile_set_new ( void )
+{
+  TileSet *ts = g_new0 ( TileSet, 1 );
+  ts->blocks = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+  return ts;
+}
+
+void tile_set_free ( TileSet *ts )
+{
+  if ( !ts )
+    return;
+  g_hash_table_destroy ( ts->blocks );
+  g_free ( ts );
+}
+
+void tile_set_clear ( TileSet *ts )
+{
+  g_hash_table_remove_all ( ts->blocks );
+  ts->size = 0;
+}
+
+/**
+ * tile_set_assign:
+ *
+ * Make the tile set the same as @src
+ */
+void tile_set_assign ( TileSet *ts, const TileSet *src )
+{
+  tile_set_clear ( ts );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, src->blocks );
+  while ( g_hash_table_iter_next(&iter, &key, &value) )
+    g_hash_table_insert ( ts->blocks, key, g_memdup(value, sizeof(TileBlock)) );
+  ts->size = src->size;
+  ts->xmin = src->xmin;
+  ts->ymin = src->ymin;
+  ts->xmax = src->xmax;
+  ts->ymax = src->ymax;
+}
+
+static inline TileBlock *get_block ( const TileSet *ts, gint bx, gint by )
+{
+  return g_hash_table_lookup ( ts->blocks, BLOCK_KEY(bx,by) );
+}
+
+static TileBlock *get_new_block ( TileSet *ts, gint bx, gint by )
+{
+  TileBlock *block = get_block ( ts, bx, by );
+  if ( !block ) {
+    block = g_new0 ( TileBlock, 1 );
+    block->bx = bx;
+    block->by = by;
+    g_hash_table_insert ( ts->blocks, BLOCK_KEY(bx,by), block );
+  }
+  return block;
+}
+
+/**
+ * Add the (new) bits for a row of a block, keeping the size and extents up to date
+ */
+static void add_bits ( TileSet *ts, TileBlock *block, guint row, guint64 bits )
+{
+  block->rows[row] |= bits;
+  gint x1 = (block->bx << BLOCK_BITS) + lowest_bit ( bits );
+  gint x2 = (block->bx << BLOCK_BITS) + highest_bit ( bits );
+  gint yy = (block->by << BLOCK_BITS) + row;
+  if ( ts->size == 0 ) {
+    ts->xmin = x1; ts->xmax = x2;
+    ts->ymin = yy; ts->ymax = yy;
+  } else {
+    if ( x1 < ts->xmin ) ts->xmin = x1;
+    if ( x2 > ts->xmax ) ts->xmax = x2;
+    if ( yy < ts->ymin ) ts->ymin = yy;
+    if ( yy > ts->ymax ) ts->ymax = yy;
+  }
+  ts->size += count_bits ( bits );
+}
+
+/**
+ * tile_set_add:
+ *
+ * Returns: TRUE if the tile was not already in the set
+ */
+gboolean tile_set_add ( TileSet *ts, gint x, gint y )
+{
+  g_return_val_if_fail ( x >= 0 && y >= 0, FALSE );
+  TileBlock *block = get_new_block ( ts, x >> BLOCK_BITS, y >> BLOCK_BITS );
+  guint64 bit = G_GUINT64_CONSTANT(1) << (x & BLOCK_MASK);
+  if ( block->rows[y & BLOCK_MASK] & bit )
+    return FALSE;
+  add_bits ( ts, block, y & BLOCK_MASK, bit );
+  return TRUE;
+}
+
+gboolean tile_set_contains ( const TileSet *ts, gint x, gint y )
+{
+  if ( x < 0 || y < 0 )
+    return FALSE;
+  TileBlock *block = get_block ( ts, x >> BLOCK_BITS, y >> BLOCK_BITS );
+  if ( !block )
+    return FALSE;
+  return (block->rows[y & BLOCK_MASK] >> (x & BLOCK_MASK)) & 1;
+}
+
+guint tile_set_size ( const TileSet *ts )
+{
+  return ts->size;
+}
+
+/**
+ * tile_set_get_extents:
+ *
+ * Returns: FALSE if the set is empty
+ */
+gboolean tile_set_get_extents ( const TileSet *ts, gint *xmin, gint *ymin, gint *xmax, gint *ymax )
+{
+  if ( ts->size == 0 )
+    return FALSE;
+  *xmin = ts->xmin;
+  *ymin = ts->ymin;
+  *xmax = ts->xmax;
+  *ymax = ts->ymax;
+  return TRUE;
+}
+
+/**
+ * tile_set_iter_init:
+ *
+ * Iterate over the tiles (in no particular order) in the manner of a #GHashTableIter.
+ * The set should not be changed whilst iterating.
+ */
+void tile_set_iter_init ( TileSetIter *iter, const TileSet *ts )
+{
+  g_hash_table_iter_init ( &iter->hiter, ts->blocks );
+  iter->block = NULL;
+  iter->index = 0;
+}
+
+gboolean tile_set_iter_next ( TileSetIter *iter, gint *x, gint *y )
+{
+  while ( TRUE ) {
+    if ( !iter->block ) {
+      if ( !g_hash_table_iter_next(&iter->hiter, NULL, &iter->block) )
+        return FALSE;
+      iter->index = 0;
+    }
+    TileBlock *block = iter->block;
+    while ( iter->index < BLOCK_TILES ) {
+      guint row = iter->index >> BLOCK_BITS;
+      guint64 bits = block->rows[row] >> (iter->index & BLOCK_MASK);
+      if ( bits ) {
+        iter->index += lowest_bit ( bits );
+        *x = (block->bx << BLOCK_BITS) + (iter->index & BLOCK_MASK);
+        *y = (block->by << BLOCK_BITS) + row;
+        iter->index++;
+        return TRUE;
+      }
+      // Next row
+      iter->index = (row + 1) << BLOCK_BITS;
+    }
+    iter->block = NULL;
+  }
+}
+
+/**
+ * tile_set_is_surrounded:
+ *
+ * Returns: Whether all 8 tiles around the specified tile are in the set
+ */
+gboolean tile_set_is_surrounded ( const TileSet *ts, gint x, gint y )
+{
+  guint col = x & BLOCK_MASK;
+  guint row = y & BLOCK_MASK;
+  if ( col > 0 && col < BLOCK_MASK && row > 0 && row < BLOCK_MASK ) {
+    // All within the same block
+    TileBlock *block = get_block ( ts, x >> BLOCK_BITS, y >> BLOCK_BITS );
+    if ( !block )
+      return FALSE;
+    guint64 three = G_GUINT64_CONSTANT(7) << (col - 1);
+    guint64 sides = G_GUINT64_CONSTANT(5) << (col - 1);
+    return ( (block->rows[row-1] & three) == three &&
+             (block->rows[row] & sides) == sides &&
+             (block->rows[row+1] & three) == three );
+  }
+  for ( gint yy = y-1; yy <= y+1; yy++ )
+    for ( gint xx = x-1; xx <= x+1; xx++ )
+      if ( (xx != x || yy != y) && !tile_set_contains(ts, xx, yy) )
+        return FALSE;
+  return TRUE;
+}
+
+/**
+ * tile_set_add_difference:
+ *
+ * Add the tiles that are in @aa but not in @bb
+ *
+ * Returns: The number of tiles added
+ */
+guint tile_set_add_difference ( TileSet *ts, const TileSet *aa, const TileSet *bb )
+{
+  guint before = ts->size;
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init ( &iter, aa->blocks );
+  while ( g_hash_table_iter_next(&iter, NULL, &value) ) {
+    TileBlock *ablock = value;
+    TileBlock *bblock = get_block ( bb, ablock->bx, ablock->by );
+    TileBlock *block = NULL;
+    for ( guint row = 0; row < BLOCK_SIZE; row++ ) {
+      guint64 bits = ablock->rows[row];
+      if ( bblock )
+        bits &= ~bblock->rows[row];
+      if ( !bits )
+        continue;
+      if ( !block )
+        block = get_new_block ( ts, ablock->bx, ablock->by );
+      bits &= ~block->rows[row];
+      if ( bits )
+        add_bits ( ts, block, row, bits );
+    }
+  }
+  return ts->size - before;
+}
+
+/**
+ * tile_set_add_surrounded:
+ *
+ * Add the tiles of @src that are completely surrounded by other tiles of @src
+ *
+ * Returns: The number of such tiles
+ */
+guint tile_set_add_surrounded ( TileSet *ts, const TileSet *src )
+{
+  guint count = 0;
+  TileSetIter iter;
+  gint x, y;
+  tile_set_iter_init ( &iter, src );
+  while ( tile_set_iter_next(&iter, &x, &y) ) {
+    if ( tile_set_is_surrounded(src, x, y) ) {
+      (void)tile_set_add ( ts, x, y );
+      count++;
+    }
+  }
+  return count;
+}
+
+static gint block_compare ( gconstpointer aa, gconstpointer bb )
+{
+  const TileBlock *ba = *(const TileBlock**)aa;
+  const TileBlock *bb_ = *(const TileBlock**)bb;
+  if ( ba->by != bb_->by )
+    return ba->by < bb_->by ? -1 : 1;
+  if ( ba->bx != bb_->bx )
+    return ba->bx < bb_->bx ? -1 : 1;
+  return 0;
+}
+
+/**
+ * The blocks in row order (top to bottom, then left to right)
+ *  so any tile is processed after those above and to the left of it
+ */
+static GPtrArray *sorted_blocks ( const TileSet *ts )
+{
+  GPtrArray *blocks = g_ptr_array_sized_new ( g_hash_table_size(ts->blocks) );
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init ( &iter, ts->blocks );
+  while ( g_hash_table_iter_next(&iter, NULL, &value) )
+    g_ptr_array_add ( blocks, value );
+  g_ptr_array_sort ( blocks, block_compare );
+  return blocks;
+}
+
+/**
+ * tile_set_largest_square:
+ * @x: Returns the top left tile of the square
+ * @y:
+ *
+ * The standard dynamic programming method, where the value for each tile is
+ *  the size of the largest square that has its bottom right corner at that tile.
+ * Values are kept per block and only for the current and previous row of blocks.
+ *
+ * Returns: The size of the largest square of tiles (the first one found if several)
+ */
+guint tile_set_largest_square ( const TileSet *ts, gint *x, gint *y )
+{
+  guint best = 0;
+  GPtrArray *blocks = sorted_blocks ( ts );
+  GHashTable *values = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+  guint oldest = 0;
+
+  for ( guint nn = 0; nn < blocks->len; nn++ ) {
+    TileBlock *block = g_ptr_array_index ( blocks, nn );
+    // Forget values no longer needed
+    while ( ((TileBlock*)g_ptr_array_index(blocks, oldest))->by < block->by - 1 ) {
+      TileBlock *old = g_ptr_array_index ( blocks, oldest );
+      g_hash_table_remove ( values, BLOCK_KEY(old->bx,old->by) );
+      oldest++;
+    }
+
+    guint16 *dp = g_new0 ( guint16, BLOCK_TILES );
+    g_hash_table_insert ( values, BLOCK_KEY(block->bx,block->by), dp );
+    const guint16 *up = g_hash_table_lookup ( values, BLOCK_KEY(block->bx,block->by-1) );
+    const guint16 *left = g_hash_table_lookup ( values, BLOCK_KEY(block->bx-1,block->by) );
+    const guint16 *upleft = g_hash_table_lookup ( values, BLOCK_KEY(block->bx-1,block->by-1) );
+
+    for ( guint row = 0; row < BLOCK_SIZE; row++ ) {
+      guint64 bits = block->rows[row];
+      while ( bits ) {
+        guint col = lowest_bit ( bits );
+        bits &= bits - 1;
+        guint vu, vl, vul;
+        if ( row > 0 )
+          vu = dp[(row-1)*BLOCK_SIZE + col];
+        else
+          vu = up ? up[BLOCK_MASK*BLOCK_SIZE + col] : 0;
+        if ( col > 0 )
+          vl = dp[row*BLOCK_SIZE + col-1];
+        else
+          vl = left ? left[row*BLOCK_SIZE + BLOCK_MASK] : 0;
+        if ( row > 0 && col > 0 )
+          vul = dp[(row-1)*BLOCK_SIZE + col-1];
+        else if ( row > 0 )
+          vul = left ? left[(row-1)*BLOCK_SIZE + BLOCK_MASK] : 0;
+        else if ( col > 0 )
+          vul = up ? up[BLOCK_MASK*BLOCK_SIZE + col-1] : 0;
+        else
+          vul = upleft ? upleft[BLOCK_TILES-1] : 0;
+        guint val = MIN ( MIN(vu, vl), vul ) + 1;
+        dp[row*BLOCK_SIZE + col] = MIN ( val, G_MAXUINT16 );
+        if ( val > best ) {
+          best = val;
+          *x = (block->bx << BLOCK_BITS) + col - val + 1;
+          *y = (block->by << BLOCK_BITS) + row - val + 1;
+        }
+      }
+    }
+  }
+
+  g_hash_table_destroy ( values );
+  g_ptr_array_free ( blocks, TRUE );
+  return best;
+}
+
+static guint uf_find ( GArray *labels, guint x )
+{
+  guint *ll = (guint*)labels->data;
+  guint y = x;
+  while ( ll[y] != y )
+    y = ll[y];
+  while ( ll[x] != x ) {
+    guint z = ll[x];
+    ll[x] = y;
+    x = z;
+  }
+  return y;
+}
+
+static guint uf_union ( GArray *labels, guint x, guint y )
+{
+  guint root = uf_find ( labels, y );
+  g_array_index ( labels, guint, uf_find(labels, x) ) = root;
+  return root;
+}
+
+static guint uf_make_set ( GArray *labels )
+{
+  guint label = labels->len;
+  g_array_append_val ( labels, label );
+  return label;
+}
+
+/**
+ * tile_set_largest_area:
+ * @area:  Gets the tiles of the largest area added to it
+ * @count: Optionally returns the number of separate areas
+ *
+ * Labels areas of tiles that are connected North/South or East/West
+ *  c.f. 'labelling clusters on a grid'
+ *  https://en.wikipedia.org/wiki/Hoshen%E2%80%93Kopelman_algorithm
+ *
+ * Returns: The size of the largest area of connected tiles
+ */
+guint tile_set_largest_area ( const TileSet *ts, TileSet *area, guint *count )
+{
+  GPtrArray *blocks = sorted_blocks ( ts );
+  GHashTable *block_labels = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+  // Label 0 means none
+  GArray *labels = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  (void)uf_make_set ( labels );
+
+  for ( guint nn = 0; nn < blocks->len; nn++ ) {
+    TileBlock *block = g_ptr_array_index ( blocks, nn );
+    guint *bl = g_new0 ( guint, BLOCK_TILES );
+    g_hash_table_insert ( block_labels, BLOCK_KEY(block->bx,block->by), bl );
+    const guint *up = g_hash_table_lookup ( block_labels, BLOCK_KEY(block->bx,block->by-1) );
+    const guint *left = g_hash_table_lookup ( block_labels, BLOCK_KEY(block->bx-1,block->by) );
+
+    for ( guint row = 0; row < BLOCK_SIZE; row++ ) {
+      guint64 bits = block->rows[row];
+      while ( bits ) {
+        guint col = lowest_bit ( bits );
+        bits &= bits - 1;
+        guint label_up, label_left;
+        if ( row > 0 )
+          label_up = bl[(row-1)*BLOCK_SIZE + col];
+        else
+          label_up = up ? up[BLOCK_MASK*BLOCK_SIZE + col] : 0;
+        if ( col > 0 )
+          label_left = bl[row*BLOCK_SIZE + col-1];
+        else
+          label_left = left ? left[row*BLOCK_SIZE + BLOCK_MASK] : 0;
+
+        guint label;
+        if ( label_up && label_left )
+          label = uf_union ( labels, label_up, label_left );
+        else if ( label_up || label_left )
+          label = MAX ( label_up, label_left );
+        else
+          label = uf_make_set ( labels );
+        bl[row*BLOCK_SIZE + col] = label;
+      }
+    }
+  }
+
+  // Count the size of each area
+  guint *sizes = g_new0 ( guint, labels->len );
+  guint areas = 0;
+  guint largest = 0;
+  guint largest_label = 0;
+  for ( guint nn = 0; nn < blocks->len; nn++ ) {
+    TileBlock *block = g_ptr_array_index ( blocks, nn );
+    const guint *bl = g_hash_table_lookup ( block_labels, BLOCK_KEY(block->bx,block->by) );
+    for ( guint ii = 0; ii < BLOCK_TILES; ii++ ) {
+      if ( bl[ii] ) {
+        guint root = uf_find ( labels, bl[ii] );
+        if ( sizes[root] == 0 )
+          areas++;
+        sizes[root]++;
+        if ( sizes[root] > largest ) {
+          largest = sizes[root];
+          largest_label = root;
+        }
+      }
+    }
+  }
+
+  if ( area && largest ) {
+    for ( guint nn = 0; nn < blocks->len; nn++ ) {
+      TileBlock *block = g_ptr_array_index ( blocks, nn );
+      const guint *bl = g_hash_table_lookup ( block_labels, BLOCK_KEY(block->bx,block->by) );
+      TileBlock *ablock = NULL;
+      for ( guint row = 0; row < BLOCK_SIZE; row++ ) {
+        guint64 bits = 0;
+        for ( guint col = 0; col < BLOCK_SIZE; col++ )
+          if ( bl[row*BLOCK_SIZE + col] && uf_find(labels, bl[row*BLOCK_SIZE + col]) == largest_label )
+            bits |= G_GUINT64_CONSTANT(1) << col;
+        if ( !bits )
+          continue;
+        if ( !ablock )
+          ablock = get_new_block ( area, block->bx, block->by );
+        bits &= ~ablock->rows[row];
+        if ( bits )
+          add_bits ( area, ablock, row, bits );
+      }
+    }
+  }
+
+  if ( count )
+    *count = areas;
+
+  g_free ( sizes );
+  g_array_free ( labels, TRUE );
+  g_hash_table_destroy ( block_labels );
+  g_ptr_array_free ( blocks, TRUE );
+  return largest;
+}
@@ -0,0 +1,64 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_TILESET_H
+#define _VIKING_TILESET_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * A set of tile positions (e.g. x,y of a #MapCoord at a single zoom level)
+ *
+ * Stored sparsely as blocks of 64x64 tiles, each block being one bit per tile.
+ * Tile positions are expected to be within 0 to 2^22
+ *  (i.e. map zoom levels up to 22).
+ */
+typedef struct _TileSet TileSet;
+
+typedef struct {
+  GHashTableIter hiter;
+  gpointer block;
+  gint bx, by;
+  guint index;
+} TileSetIter;
+
+TileSet *tile_set_new ( void );
+void tile_set_free ( TileSet *ts );
+void tile_set_clear ( TileSet *ts );
+void tile_set_assign ( TileSet *ts, const TileSet *src );
+
+gboolean tile_set_add ( TileSet *ts, gint x, gint y );
+gboolean tile_set_contains ( const TileSet *ts, gint x, gint y );
+guint tile_set_size ( const TileSet *ts );
+gboolean tile_set_get_extents ( const TileSet *ts, gint *xmin, gint *ymin, gint *xmax, gint *ymax );
+
+void tile_set_iter_init ( TileSetIter *iter, const TileSet *ts );
+gboolean tile_set_iter_next ( TileSetIter *iter, gint *x, gint *y );
+
+gboolean tile_set_is_surrounded ( const TileSet *ts, gint x, gint y );
+
+guint tile_set_add_difference ( TileSet *ts, const TileSet *aa, const TileSet *bb );
+guint tile_set_add_surrounded ( TileSet *ts, const TileSet *src );
+guint tile_set_largest_square ( const TileSet *ts, gint *x, gint *y );
+guint tile_set_largest_area ( const TileSet *ts, TileSet *area, guint *count );
+
+G_END_DECLS
+
+#endif
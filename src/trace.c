@@ -0,0 +1,254 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Timing of the main operations (drawing, tile loading, file reading, background jobs)
+ *  along with some counters, to help find out where the time goes.
+ *
+ * Enabled via the command line; the recorded events are written on exit in the
+ *  Chrome trace event JSON format, as understood by chrome://tracing or https://ui.perfetto.dev/
+ * The latest frame values can also be shown on the map.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+
+#include "trace.h"
+#include "vik_compat.h"
+
+gboolean vik_trace_enabled = FALSE;
+
+// Limit memory use if left running for a long time
+#define MAX_EVENTS 1000000
+
+typedef struct {
+  const gchar *name;
+  gchar *detail;
+  gint64 ts;
+  gint64 dur;
+  gint64 value;
+  guint tid;
+  gchar phase; // 'X' for a timed span, 'C' for a counter value
+} TraceEvent;
+
+static gchar *trace_file = NULL;
+static gboolean trace_overlay = FALSE;
+static gint64 trace_start = 0;
+
+static GMutex *events_mutex = NULL;
+static GArray *events = NULL;
+static guint dropped = 0;
+
+static gint counters[VIK_TRACE_NUM_COUNTERS];
+// Values of the frame counters for the last completed frame
+static gint last_frame[VIK_TRACE_NUM_FRAME_COUNTERS];
+static gint64 last_frame_time = 0;
+
+static const gchar *counter_names[VIK_TRACE_NUM_COUNTERS] = {
+  "tiles_decoded",
+  "tiles_cached",
+  "tiles_downloaded",
+  "points_projected",
+  "background_queued",
+  "background_running",
+};
+
+static GPrivate tid_key;
+static gint next_tid = 0;
+
+static guint get_tid ( void )
+{
+  guint tid = GPOINTER_TO_UINT ( g_private_get(&tid_key) );
+  if ( !tid ) {
+    tid = g_atomic_int_add ( &next_tid, 1 ) + 1;
+    g_private_set ( &tid_key, GUINT_TO_POINTER(tid) );
+  }
+  return tid;
+}
+
+static void add_event ( TraceEvent *ev )
+{
+  g_mutex_lock ( events_mutex );
+  if ( events && events->len < MAX_EVENTS )
+    g_array_append_val ( events, *ev );
+  else {
+    g_free ( ev->detail );
+    dropped++;
+  }
+  g_mutex_unlock ( events_mutex );
+}
+
+/**
+ * a_trace_init:
+ * @filename: Where to write the trace on exit (may be NULL)
+ * @overlay:  Whether to show the frame values on the map
+ *
+ * Tracing is only enabled if either is requested.
+ * Must be called from the main thread.
+ */
+void a_trace_init ( const gchar *filename, gboolean overlay )
+{
+  if ( !filename && !overlay )
+    return;
+
+  trace_file = g_strdup ( filename );
+  trace_overlay = overlay;
+  trace_start = g_get_monotonic_time ();
+  events_mutex = vik_mutex_new ();
+  events = g_array_sized_new ( FALSE, FALSE, sizeof(TraceEvent), 4096 );
+  // Ensure the main thread is first
+  (void)get_tid ();
+  vik_trace_enabled = TRUE;
+}
+
+gboolean a_trace_get_overlay ()
+{
+  return trace_overlay;
+}
+
+gint64 a_trace_begin_real ()
+{
+  return g_get_monotonic_time ();
+}
+
+void a_trace_end_real ( const gchar *name, const gchar *detail, gint64 begin )
+{
+  // Not started whilst enabled
+  if ( !begin )
+    return;
+  TraceEvent ev = { name, g_strdup(detail), begin - trace_start, g_get_monotonic_time() - begin, 0, get_tid(), 'X' };
+  add_event ( &ev );
+}
+
+void a_trace_count_real ( VikTraceCounter counter, gint amount )
+{
+  gint value = g_atomic_int_add ( &counters[counter], amount ) + amount;
+  // Frame counters are only recorded once per frame
+  if ( counter >= VIK_TRACE_NUM_FRAME_COUNTERS ) {
+    TraceEvent ev = { counter_names[counter], NULL, g_get_monotonic_time() - trace_start, 0, value, get_tid(), 'C' };
+    add_event ( &ev );
+  }
+}
+
+/**
+ * a_trace_frame_end_real:
+ *
+ * Record the frame duration and the counter values for this frame
+ */
+void a_trace_frame_end_real ( gint64 begin )
+{
+  gint64 now = g_get_monotonic_time ();
+  a_trace_end_real ( "frame", NULL, begin );
+  last_frame_time = now - begin;
+  for ( guint ii = 0; ii < VIK_TRACE_NUM_FRAME_COUNTERS; ii++ ) {
+    last_frame[ii] = g_atomic_int_and ( (guint*)&counters[ii], 0 );
+    TraceEvent ev = { counter_names[ii], NULL, now - trace_start, 0, last_frame[ii], get_tid(), 'C' };
+    add_event ( &ev );
+  }
+}
+
+/**
+ * a_trace_get_summary:
+ *
+ * Returns: A multiline description of the last frame, to be freed by the caller
+ */
+gchar *a_trace_get_summary ()
+{
+  return g_strdup_printf ( _("Frame: %.1f ms\nTiles: %d decoded, %d cached, %d downloaded\nPoints projected: %d\nBackground: %d queued, %d running"),
+                           last_frame_time / 1000.0,
+                           last_frame[VIK_TRACE_TILES_DECODED],
+                           last_frame[VIK_TRACE_TILES_CACHED],
+                           last_frame[VIK_TRACE_TILES_DOWNLOADED],
+                           last_frame[VIK_TRACE_POINTS_PROJECTED],
+                           g_atomic_int_get(&counters[VIK_TRACE_BACKGROUND_QUEUED]),
+                           g_atomic_int_get(&counters[VIK_TRACE_BACKGROUND_RUNNING]) );
+}
+
+static void write_json_string ( FILE *ff, const gchar *str )
+{
+  fputc ( '"', ff );
+  for ( const guchar *cc = (const guchar*)str; *cc; cc++ ) {
+    if ( *cc == '"' || *cc == '\\' )
+      fprintf ( ff, "\\%c", *cc );
+    else if ( *cc < 0x20 )
+      fprintf ( ff, "\\u%04x", *cc );
+    else
+      fputc ( *cc, ff );
+  }
+  fputc ( '"', ff );
+}
+
+static gboolean write_trace ( const gchar *filename )
+{
+  FILE *ff = g_fopen ( filename, "w" );
+  if ( !ff )
+    return FALSE;
+
+  fprintf ( ff, "{\"traceEvents\":[\n" );
+  fprintf ( ff, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"main\"}}" );
+  for ( guint ii = 0; ii < events->len; ii++ ) {
+    TraceEvent *ev = &g_array_index ( events, TraceEvent, ii );
+    fprintf ( ff, ",\n{\"name\":" );
+    write_json_string ( ff, ev->name );
+    fprintf ( ff, ",\"cat\":\"viking\",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT ",\"pid\":1,\"tid\":%u", ev->phase, ev->ts, ev->tid );
+    if ( ev->phase == 'C' )
+      fprintf ( ff, ",\"args\":{\"value\":%" G_GINT64_FORMAT "}", ev->value );
+    else {
+      fprintf ( ff, ",\"dur\":%" G_GINT64_FORMAT, ev->dur );
+      if ( ev->detail ) {
+        fprintf ( ff, ",\"args\":{\"detail\":" );
+        write_json_string ( ff, ev->detail );
+        fprintf ( ff, "}" );
+      }
+    }
+    fprintf ( ff, "}" );
+  }
+  fprintf ( ff, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"version\":\"%s\",\"dropped_events\":%u}}\n", PACKAGE_VERSION, dropped );
+  return fclose ( ff ) == 0;
+}
+
+/**
+ * a_trace_uninit:
+ *
+ * Write the trace file (if requested) and stop tracing
+ */
+void a_trace_uninit ()
+{
+  if ( !vik_trace_enabled )
+    return;
+  vik_trace_enabled = FALSE;
+
+  g_mutex_lock ( events_mutex );
+  if ( trace_file ) {
+    if ( write_trace(trace_file) )
+      g_message ( "%s: Wrote %u events to %s", __FUNCTION__, events->len, trace_file );
+    else
+      g_warning ( "%s: Unable to write %s", __FUNCTION__, trace_file );
+  }
+  for ( guint ii = 0; ii < events->len; ii++ )
+    g_free ( g_array_index(events, TraceEvent, ii).detail );
+  g_array_free ( events, TRUE );
+  events = NULL;
+  g_mutex_unlock ( events_mutex );
+
+  g_free ( trace_file );
+  trace_file = NULL;
+}
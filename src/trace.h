@@ -0,0 +1,74 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _VIKING_TRACE_H
+#define _VIKING_TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  // Totals for each frame (i.e. reset at the end of every redraw)
+  VIK_TRACE_TILES_DECODED = 0,
+  VIK_TRACE_TILES_CACHED,
+  VIK_TRACE_TILES_DOWNLOADED,
+  VIK_TRACE_POINTS_PROJECTED,
+  VIK_TRACE_NUM_FRAME_COUNTERS,
+  // Current levels
+  VIK_TRACE_BACKGROUND_QUEUED = VIK_TRACE_NUM_FRAME_COUNTERS,
+  VIK_TRACE_BACKGROUND_RUNNING,
+  VIK_TRACE_NUM_COUNTERS,
+} VikTraceCounter;
+
+// Only TRUE when tracing was requested on startup
+extern gboolean vik_trace_enabled;
+
+void a_trace_init ( const gchar *filename, gboolean overlay );
+void a_trace_uninit ();
+
+gboolean a_trace_get_overlay ();
+gchar *a_trace_get_summary ();
+
+gint64 a_trace_begin_real ();
+void a_trace_end_real ( const gchar *name, const gchar *detail, gint64 begin );
+void a_trace_count_real ( VikTraceCounter counter, gint amount );
+void a_trace_frame_end_real ( gint64 begin );
+
+/*
+ * These should be used rather than the *_real() functions,
+ *  so that when not enabled the only cost is testing the flag.
+ * The name should be a static string, whereas any detail is copied.
+ */
+#define a_trace_begin() ( G_UNLIKELY(vik_trace_enabled) ? a_trace_begin_real() : 0 )
+
+#define a_trace_end(name,begin) \
+  G_STMT_START { if ( G_UNLIKELY(vik_trace_enabled) ) a_trace_end_real ( (name), NULL, (begin) ); } G_STMT_END
+
+#define a_trace_end_detail(name,detail,begin) \
+  G_STMT_START { if ( G_UNLIKELY(vik_trace_enabled) ) a_trace_end_real ( (name), (detail), (begin) ); } G_STMT_END
+
+#define a_trace_count(counter,amount) \
+  G_STMT_START { if ( G_UNLIKELY(vik_trace_enabled) ) a_trace_count_real ( (counter), (amount) ); } G_STMT_END
+
+#define a_trace_frame_end(begin) \
+  G_STMT_START { if ( G_UNLIKELY(vik_trace_enabled) ) a_trace_frame_end_real ( (begin) ); } G_STMT_END
+
+G_END_DECLS
+
+#endif
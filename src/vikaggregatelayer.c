@@ -30,10 +30,14 @@
 #include "background.h"
 #include "gpx.h"
 #include "dir.h"
+#include "fit.h"
+#include "tcx.h"
 #ifdef HAVE_SQLITE3_H
 #include "sqlite3.h"
 #endif
 #include "misc/heatmap.h"
+#include "heatmap_pyramid.h"
+#include "tileset.h"
 
 #define AGGREGATE_FIXED_NAME "Aggregate"
 
@@ -50,6 +54,7 @@ static void aggregate_layer_post_read ( VikAggregateLayer *val, VikViewport *vvp
 static gboolean aggregate_layer_selected_viewport_menu ( VikAggregateLayer *val, GdkEventButton *event, VikViewport *vvp );
 
 static void tac_calculate ( VikAggregateLayer *val );
+static void tac_calculate_added ( VikAggregateLayer *val, GList *layers );
 static void hm_calculate ( VikAggregateLayer *val );
 
 static gchar *params_tile_area_levels[] = { "17", "16", "15", "14", "13", "12", "11", "10", "9", "8", "7", "6", "5", "4", NULL };
@@ -280,6 +285,7 @@ struct _VikAggregateLayer {
 
   // Tracks Area Coverage
   gboolean calculating;
+  GList *tac_added; // Layers added whilst calculating, to be included afterwards
   guint zoom_level;
   gboolean draw_grid;
   guint zoom_level_prev;
@@ -294,8 +300,6 @@ struct _VikAggregateLayer {
   guint num_prev[CP_NUM]; // Counts to determine change after a new calculation
   guint num_calcs;
 
-  guint cont_label;
-  guint clust_label;
   guint max_square;
   guint max_square_prev;
   gint xx,yy; // Location of top left max square tile
@@ -312,32 +316,26 @@ struct _VikAggregateLayer {
   guint ew_size_prev;
 
   guint8 tac_time_range; // Years
-  // Maybe a sparse table would be more efficient
-  //  but this seems to work OK at least if all tracks are confined within a not too diverse area
-  GHashTable *tiles;
-  GHashTable *tiles_clust;
+  TileSet *tiles;
+  TileSet *tiles_contig; // The largest contiguous area
+  TileSet *tiles_clust;  // The largest cluster
 
   // Enable to determine changed tiles (mainly for those added rather than removed)
-  GHashTable *prev;
-  GHashTable *tiles_new;
+  TileSet *prev;
+  TileSet *tiles_new;
 
   // Heatmap
   gboolean hm_calculating;
   // Values as at original request
   guint hm_scale;
   gint hm_zoom;
-  gint hm_width;
-  gint hm_height;
-  LatLonBBox hm_bbox;
-  const VikCoord *hm_center;
+  HeatmapArea hm_area;
   VikCoord hm_tl;
+  HeatmapPyramid *hm_pyramid;
   // Drawing values (zoom level may have changed)
   gint hm_scaled_zoom;
-  gint hm_zoom_max;
+  GHashTable *hm_scaled_tiles; // Tiles of the pyramid level in use, scaled for hm_scaled_zoom
   guint8 hm_alpha;
-  GdkPixbuf *hm_pixbuf;
-  GdkPixbuf *hm_pbf_scaled;
-  gboolean hm_scaled;
   guint8 hm_stamp_factor;
   guint8 hm_style;
   GdkColor hm_color;
@@ -468,14 +466,38 @@ const heatmap_colorscheme_t* hm_colorschemes[] =
     &d2, // Yellow/Orange/Red
   };
 
+static const heatmap_colorscheme_t *hm_colorscheme ( VikAggregateLayer *val )
+{
+  if ( val->hm_style > 0 && val->hm_style < 4 )
+    return hm_colorschemes[val->hm_style-1];
+  return NULL;
+}
+
+static void hm_clear_tiles ( VikAggregateLayer *val )
+{
+  g_hash_table_remove_all ( val->hm_scaled_tiles );
+  if ( val->hm_pyramid )
+    a_heatmap_pyramid_clear_tiles ( val->hm_pyramid );
+}
+
 // Ensure when 'apply' button heatmap regenerated to use new values
 static void hm_apply ( VikAggregateLayer *val )
 {
   if ( VIK_LAYER(val)->realized )
-    if ( !val->hm_calculating && val->hm_pixbuf )
+    if ( !val->hm_calculating && val->hm_pyramid )
       hm_calculate ( val );
 }
 
+// Only the colouring has changed, so the existing values can be redrawn
+static void hm_apply_colors ( VikAggregateLayer *val )
+{
+  if ( !val->hm_calculating && val->hm_pyramid ) {
+    hm_clear_tiles ( val );
+    if ( VIK_LAYER(val)->realized )
+      vik_layer_emit_update ( VIK_LAYER(val), FALSE );
+  }
+}
+
 static void tac_apply ( VikAggregateLayer *val, VikLayerSetParam *vlsp )
 {
   if ( !vlsp->is_file_operation ) {
@@ -577,7 +599,7 @@ static gboolean aggregate_layer_set_param ( VikAggregateLayer *val, VikLayerSetP
         changed = vik_layer_param_change_uint8 ( vlsp->data, &val->hm_alpha );
 	if ( changed )
 	  if ( !vlsp->is_file_operation )
-	    hm_apply ( val );
+	    hm_apply_colors ( val );
       }
       break;
     case PARAM_HM_STAMP_FACTOR:
@@ -593,7 +615,7 @@ static gboolean aggregate_layer_set_param ( VikAggregateLayer *val, VikLayerSetP
       changed = vik_layer_param_change_uint8 ( vlsp->data, &val->hm_style );
       if ( changed )
         if ( !vlsp->is_file_operation )
-          hm_apply ( val );
+          hm_apply_colors ( val );
       break;
     default: break;
   }
@@ -738,10 +760,12 @@ VikAggregateLayer *vik_aggregate_layer_new (VikViewport *vvp)
   vik_layer_set_type ( VIK_LAYER(val), VIK_LAYER_AGGREGATE );
   vik_layer_set_defaults ( VIK_LAYER(val), vvp );
   val->children = NULL;
-  val->tiles = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->tiles_clust = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->tiles_new = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
-  val->prev = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+  val->tiles = tile_set_new ();
+  val->tiles_contig = tile_set_new ();
+  val->tiles_clust = tile_set_new ();
+  val->tiles_new = tile_set_new ();
+  val->prev = tile_set_new ();
+  val->hm_scaled_tiles = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_object_unref );
 
   return val;
 }
@@ -865,45 +889,6 @@ void vik_aggregate_layer_move_layer ( VikAggregateLayer *val, GtkTreeIter *child
     val->children = second;
 }
 
-static gboolean is_tile_occupied ( GHashTable *ght, gint x, gint y )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  gboolean ans = g_hash_table_contains ( ght, key );
-  g_free ( key );
-  return ans;
-}
-
-static guint tile_label ( GHashTable *ght, gint x, gint y )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  gpointer gp = g_hash_table_lookup ( ght, key );
-  g_free ( key );
-  if ( gp )
-    return GPOINTER_TO_UINT(gp);
-  else
-    return 0;
-}
-
-/**
- * is_cluster: returns whether a tile is surrounded by occupied tiles
- */
-static gboolean is_cluster ( GHashTable *val, gint x, gint y )
-{
-  //if ( !is_tile_occupied(val, x, y) ) return FALSE;
-  if ( !is_tile_occupied(val, x-1, y) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y) ) return FALSE;
-
-  if ( !is_tile_occupied(val, x-1, y-1) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y-1) ) return FALSE;
-  if ( !is_tile_occupied(val, x, y-1) ) return FALSE;
-
-  if ( !is_tile_occupied(val, x-1, y+1) ) return FALSE;
-  if ( !is_tile_occupied(val, x+1, y+1) ) return FALSE;
-  if ( !is_tile_occupied(val, x, y+1) ) return FALSE;
-
-  return TRUE;
-}
-
 static GdkPixbuf *setup_pixbuf ( GdkPixbuf *pixbuf, guint width, guint height )
 {
   if ( pixbuf )
@@ -1009,7 +994,7 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
         ulm.x = x;
         ulm.y = y;
 
-        if ( is_tile_occupied(val->tiles, x, y) ) {
+        if ( tile_set_contains(val->tiles, x, y) ) {
           //g_printf ( "%s1: %d, %d, %d, %d, %d, %d %0.2f\n", __FUNCTION__, xx, yy, tilesize_ceil, tilesize_ceil, width, height, shrinkfactor );
           if ( !is_big ) {
 
@@ -1023,12 +1008,12 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
 
             gdk_pixbuf_copy_area ( val->pixbuf[BASIC], 0, 0, sizex, sizey, val->full_pixbuf[BASIC], destx, desty );
 
-            if ( val->cont_label && (tile_label(val->tiles, x, y) == val->cont_label) )
+            if ( tile_set_contains(val->tiles_contig, x, y) )
               gdk_pixbuf_copy_area ( val->pixbuf[CONTIG], 0, 0, sizex, sizey, val->full_pixbuf[CONTIG], destx, desty );
 
             // Cluster drawing
             if ( val->on[CLUSTER] )
-              if ( val->clust_label && (tile_label(val->tiles_clust, x, y) == val->clust_label) )
+              if ( tile_set_contains(val->tiles_clust, x, y) )
                 gdk_pixbuf_copy_area ( val->pixbuf[CLUSTER], 0, 0, sizex, sizey, val->full_pixbuf[CLUSTER], destx, desty );
 
             // Max Square drawing
@@ -1051,7 +1036,7 @@ static void tac_draw_section ( VikAggregateLayer *val, VikViewport *vvp, VikCoor
             }
 
             if ( val->on[TNEW] )
-              if ( is_tile_occupied(val->tiles_new, x, y) ) {
+              if ( tile_set_contains(val->tiles_new, x, y) ) {
                 gdk_pixbuf_copy_area ( val->pixbuf[TNEW], 0, 0, sizex, sizey, val->full_pixbuf[TNEW], destx, desty );
               }
           } else {
@@ -1166,87 +1151,85 @@ static void tac_draw ( VikAggregateLayer *val, VikViewport *vp )
   tac_draw_section ( val, vp, &ul, &br );
 }
 
-/**
- * c.f. vik_viewport_coord_to_screen() but for a separately configurable zoom level & Mercator only
- */
-static void coord_to_screen ( gint width, gint height, gdouble mf, struct LatLon *center, VikCoord *coord, gint *xx, gint *yy )
-{
-  struct LatLon *ll = (struct LatLon *)coord;
-  *xx = (int)(width/2 + ( mf * (ll->lon - center->lon) ));
-  *yy = (int)(height/2 + ( mf * ( MERCLAT(center->lat) - MERCLAT(ll->lat) ) ));
-}
-
 /**
  *
  */
 static void hm_clear ( VikAggregateLayer *val )
 {
-  if ( val->hm_pixbuf )
-    g_object_unref ( val->hm_pixbuf );
-  if ( val->hm_pbf_scaled )
-    g_object_unref ( val->hm_pbf_scaled );
-  val->hm_pixbuf = NULL;
-  val->hm_pbf_scaled = NULL;
+  g_hash_table_remove_all ( val->hm_scaled_tiles );
+  a_heatmap_pyramid_free ( val->hm_pyramid );
+  val->hm_pyramid = NULL;
 }
 
+// Beyond this the scaled tiles get too big (and slow to generate)
+#define HM_MAX_UPSCALE 8.0
+
 /**
  * Draw heatmap
+ *
+ * Uses the pyramid level closest to (but not coarser than) the current zoom level,
+ *  scaling only those tiles that are visible.
  */
 static void hm_draw ( VikAggregateLayer *val, VikViewport *vp )
 {
   LatLonBBox bbox = vik_viewport_get_bbox ( vp );
+  if ( !BBOX_INTERSECT ( bbox, val->hm_area.bbox ) )
+    return;
 
-  if ( BBOX_INTERSECT ( bbox, val->hm_bbox ) ) {
+  gint zz = (gint)vik_viewport_get_zoom ( vp );
+  if ( zz < 1 )
+    return;
 
-    clock_t begin, end;
+  guint level = 0;
+  while ( level+1 < val->hm_pyramid->num_levels && (val->hm_zoom << (level+1)) <= zz )
+    level++;
+  // Screen pixels per pixel of the level
+  gdouble scale = (gdouble)(val->hm_zoom << level) / (gdouble)zz;
+  // Avoid excessive image scaling as it will be too slow
+  //  (and memory intensive) so simply avoid trying.
+  if ( scale > HM_MAX_UPSCALE )
+    return;
 
-    gint zz = (gint)vik_viewport_get_zoom ( vp );
-    // Avoid excessive image scaling as it will be too slow
-    //  (and memory intensive) so simply avoid trying.
-    if ( zz < val->hm_zoom_max ) {
-      return;
-    }
+  if ( val->hm_scaled_zoom != zz ) {
+    val->hm_scaled_zoom = zz;
+    g_hash_table_remove_all ( val->hm_scaled_tiles );
+  }
 
-    if ( val->hm_width != vik_viewport_get_width(vp) ||
-         val->hm_height != vik_viewport_get_height(vp) ) {
-      hm_clear ( val );
-      return;
-    }
+  gint ox, oy;
+  vik_viewport_coord_to_screen ( vp, &val->hm_tl, &ox, &oy );
 
-    // Calculate width & height (even if no scaling as not excessive computation)
-    gint ww = round (val->hm_width * (gdouble)val->hm_zoom/(gdouble)zz );
-    gint hh = round (val->hm_height * (gdouble)val->hm_zoom/(gdouble)zz );
-    // Scale only once as necessary when zoom level has changed
-    if ( val->hm_scaled_zoom != zz ) {
-      val->hm_scaled_zoom = zz;
-      // Different zoom level so generate new image from the original image
-      if ( val->hm_scaled_zoom != val->hm_zoom ) {
-        if ( val->hm_pbf_scaled )
-          g_object_unref ( val->hm_pbf_scaled );
-
-        val->hm_scaled = TRUE;
-        GdkInterpType interp_type = GDK_INTERP_BILINEAR;
-        // When scaling up: use the fastest method (as scaling up is much slower than scaling down)
-        //  especially since this is being performed in the main thread
-        if ( val->hm_scaled_zoom < val->hm_zoom )
-          interp_type = GDK_INTERP_NEAREST;
-        begin = clock();
-        val->hm_pbf_scaled = gdk_pixbuf_scale_simple ( val->hm_pixbuf, ww, hh, interp_type );
-        end = clock();
-        double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-        // Last usable zoom-level as the next one is going to be an order of magnitude worse or more
-        if ( interp_type == GDK_INTERP_NEAREST && time_spent > 0.05 )
-          val->hm_zoom_max = zz;
-        g_debug ( "%s: time %f scaling to %d, %d", __FUNCTION__, time_spent, ww, hh );
-      } else {
-        // Use original image
-        val->hm_scaled = FALSE;
+  HeatmapLevel *hl = &val->hm_pyramid->levels[level];
+  gdouble tile_size = HEATMAP_TILE_SIZE * scale;
+  gint tx_min = MAX ( 0, (gint)floor(-ox/tile_size) );
+  gint ty_min = MAX ( 0, (gint)floor(-oy/tile_size) );
+  gint tx_max = MIN ( (gint)hl->tiles_x-1, (gint)floor((vik_viewport_get_width(vp)-ox)/tile_size) );
+  gint ty_max = MIN ( (gint)hl->tiles_y-1, (gint)floor((vik_viewport_get_height(vp)-oy)/tile_size) );
+
+  for ( gint ty = ty_min; ty <= ty_max; ty++ ) {
+    for ( gint tx = tx_min; tx <= tx_max; tx++ ) {
+      GdkPixbuf *pixbuf = a_heatmap_pyramid_get_tile ( val->hm_pyramid, level, tx, ty, hm_colorscheme(val), val->hm_alpha );
+      if ( !pixbuf )
+        continue;
+      // Round the edges rather than the sizes, so adjacent tiles always meet
+      gint x1 = round ( tx * tile_size );
+      gint y1 = round ( ty * tile_size );
+      gint x2 = round ( (tx * HEATMAP_TILE_SIZE + gdk_pixbuf_get_width(pixbuf)) * scale );
+      gint y2 = round ( (ty * HEATMAP_TILE_SIZE + gdk_pixbuf_get_height(pixbuf)) * scale );
+      if ( x2 <= x1 || y2 <= y1 )
+        continue;
+      if ( x2-x1 != gdk_pixbuf_get_width(pixbuf) || y2-y1 != gdk_pixbuf_get_height(pixbuf) ) {
+        gpointer key = GINT_TO_POINTER(ty * hl->tiles_x + tx);
+        GdkPixbuf *scaled = g_hash_table_lookup ( val->hm_scaled_tiles, key );
+        if ( !scaled ) {
+          // When scaling up: use the fastest method (as scaling up is much slower than scaling down)
+          //  especially since this is being performed in the main thread
+          scaled = gdk_pixbuf_scale_simple ( pixbuf, x2-x1, y2-y1, scale > 1.0 ? GDK_INTERP_NEAREST : GDK_INTERP_BILINEAR );
+          g_hash_table_insert ( val->hm_scaled_tiles, key, scaled );
+        }
+        pixbuf = scaled;
       }
+      vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, ox+x1, oy+y1, x2-x1, y2-y1 );
     }
-    gint xx, yy;
-    gdouble mf = mercator_factor ( val->hm_scaled_zoom, val->hm_scale );
-    coord_to_screen ( val->hm_width, val->hm_height, mf, (struct LatLon*)val->hm_center, &val->hm_tl, &xx, &yy);
-    vik_viewport_draw_pixbuf ( vp, val->hm_scaled ? val->hm_pbf_scaled : val->hm_pixbuf, 0, 0, xx, yy, ww, hh );
   }
 }
 
@@ -1264,8 +1247,18 @@ void vik_aggregate_layer_draw ( VikAggregateLayer *val, VikViewport *vp )
   GList *iter = val->children;
 #if GTK_CHECK_VERSION (3,0,0)
   // GTK3 Version does not use pixmaps, so no point in trigger layers ATM
+  // Instead each layer keeps its own drawing, which is composited unless that layer has changed
+  // Container layers manage the drawing of their own children
   while ( iter ) {
-    vik_layer_draw ( VIK_LAYER(iter->data), vp );
+    VikLayer *vl = VIK_LAYER(iter->data);
+    if ( vl->type == VIK_LAYER_AGGREGATE || vl->type == VIK_LAYER_GPS
+#ifdef HAVE_LIBGEOCLUE_2
+         || vl->type == VIK_LAYER_GEOCLUE
+#endif
+       )
+      vik_layer_draw ( vl, vp );
+    else
+      vik_layer_draw_cached ( vl, vp );
     iter = iter->next;
   }
 #else
@@ -1291,7 +1284,7 @@ void vik_aggregate_layer_draw ( VikAggregateLayer *val, VikViewport *vp )
     tac_draw ( val, vp );
   }
 
-  if ( !val->hm_calculating && val->hm_pixbuf ) {
+  if ( !val->hm_calculating && val->hm_pyramid ) {
     hm_draw ( val, vp );
   }
 }
@@ -1621,6 +1614,18 @@ static void aggregate_layer_load_external_layers_click ( menu_array_values value
   vik_layers_panel_calendar_update ( values[MA_VLP] );
 }
 
+/**
+ * Returns the child layers that are not in the @before list
+ */
+static GList *aggregate_layer_added_children ( VikAggregateLayer *val, GList *before )
+{
+  GList *added = NULL;
+  for ( GList *iter = val->children; iter; iter = iter->next )
+    if ( !g_list_find(before, iter->data) )
+      added = g_list_prepend ( added, iter->data );
+  return added;
+}
+
 /**
  * Load selected files as external layers into this Aggregate Layer
  *
@@ -1635,6 +1640,7 @@ static void aggregate_layer_load_external_file_cb ( menu_array_values values )
     return;
 
   GSList *files = vu_get_ui_selected_gps_files ( vw, TRUE );
+  GList *before = g_list_copy ( val->children );
   GSList *cur_file = files;
   while ( cur_file ) {
     gchar *filename = cur_file->data;
@@ -1651,6 +1657,11 @@ static void aggregate_layer_load_external_file_cb ( menu_array_values values )
   }
   g_slist_free (files);
 
+  GList *added = aggregate_layer_added_children ( val, before );
+  tac_calculate_added ( val, added );
+  g_list_free ( added );
+  g_list_free ( before );
+
   vik_layer_emit_update ( VIK_LAYER(val), TRUE );
 }
 
@@ -1661,6 +1672,43 @@ static void aggregate_layer_save_layer_as_cb ( menu_array_values values )
   (void)vik_window_save_file_as ( vw, val );
 }
 
+typedef guint (*read_files_fn) ( VikAggregateLayer *val, VikViewport *vvp, GSList *filenames );
+
+/**
+ * aggregate_layer_load_several:
+ * @files: The selected filenames
+ *
+ * When there is more than one file of the given type, load those together via @read_fn
+ *
+ * Returns: The remaining files
+ */
+static GSList *aggregate_layer_load_several ( VikAggregateLayer *val, VikViewport *vvp, VikWindow *vw, GSList *files, const gchar *ext, const gchar *type, read_files_fn read_fn )
+{
+  GSList *these = NULL;
+  for ( GSList *iter = files; iter; iter = g_slist_next(iter) ) {
+    // Devices often use upper case names, e.g. '.FIT'
+    const gchar *dot = strrchr ( a_file_basename(iter->data), '.' );
+    if ( dot && g_ascii_strcasecmp(dot, ext) == 0 )
+      these = g_slist_append ( these, iter->data );
+  }
+  if ( g_slist_length(these) > 1 ) {
+    vik_window_set_busy_cursor ( vw );
+    guint loaded = read_fn ( val, vvp, these );
+    vik_window_clear_busy_cursor ( vw );
+    if ( loaded < g_slist_length(these) ) {
+      gchar *msg = g_strdup_printf ( _("WARNING: Only loaded %d of %d %s files"), loaded, g_slist_length(these), type );
+      vik_window_statusbar_update ( vw, msg, VIK_STATUSBAR_INFO );
+      g_free ( msg );
+    }
+    for ( GSList *iter = these; iter; iter = g_slist_next(iter) ) {
+      files = g_slist_remove ( files, iter->data );
+      g_free ( iter->data );
+    }
+  }
+  g_slist_free ( these );
+  return files;
+}
+
 /**
  * aggregate_layer_file_load:
  *
@@ -1674,8 +1722,14 @@ static void aggregate_layer_file_load ( menu_array_values values )
 
   gchar *filename = NULL;
   GSList *files = vu_get_ui_selected_gps_files ( vw, TRUE ); // Only GPX types for the filter type ATM
+  GList *before = g_list_copy ( val->children );
 
   if ( files ) {
+    // When several FIT or TCX files are selected (e.g. a folder of activities),
+    //  read them all together to make use of multiple processors
+    files = aggregate_layer_load_several ( val, vvp, vw, files, ".fit", "FIT", a_fit_read_files );
+    files = aggregate_layer_load_several ( val, vvp, vw, files, ".tcx", "TCX", a_tcx_read_files );
+
     GSList *cur_file = files;
     while ( cur_file ) {
       filename = cur_file->data;
@@ -1694,6 +1748,11 @@ static void aggregate_layer_file_load ( menu_array_values values )
     g_slist_free ( files );
   }
 
+  GList *added = aggregate_layer_added_children ( val, before );
+  tac_calculate_added ( val, added );
+  g_list_free ( added );
+  g_list_free ( before );
+
   vik_layer_emit_update ( VIK_LAYER(val), TRUE );
 }
 
@@ -1706,23 +1765,6 @@ static void aggregate_layer_export_gpx ( menu_array_values values )
   vik_aggregate_layer_export_gpx_setup ( val );
 }
 
-/**
- *
- */
-static void add_tile_label ( GHashTable *ght, gint x, gint y, guint id )
-{
-  gchar *key = g_strdup_printf ( "%d:%d", x, y );
-  (void)g_hash_table_insert ( ght, key, GUINT_TO_POINTER(id) );
-}
-
-/**
- *
- */
-static void add_tile ( GHashTable *ght, gint x, gint y )
-{
-  add_tile_label ( ght, x, y, 0 );
-}
-
 /**
  *
  */
@@ -1736,10 +1778,8 @@ static void check_point ( VikAggregateLayer *val, VikCoord *coord )
     return;
   }
 
-  if ( ! is_tile_occupied ( val->tiles, mc.x, mc.y ) ) {
-    add_tile ( val->tiles, mc.x, mc.y );
+  if ( tile_set_add(val->tiles, mc.x, mc.y) )
     val->num_tiles[BASIC]++;
-  }
 }
 
 /**
@@ -1770,6 +1810,7 @@ typedef struct {
   GList *tracks_and_layers;
   VikAggregateLayer *val;
   guint num_of_tracks;
+  gboolean incremental; // Only adding these tracks to the existing tiles
 } CalculateThreadT;
 
 static void ct_free ( CalculateThreadT *ct )
@@ -1785,192 +1826,19 @@ static void ct_cancel ( CalculateThreadT *ct )
   vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
 }
 
-// Since previous square should have been checked, only need to consider the next outer row+column
-//  rather than rechecking the contents of the whole square again
-//  this is obviously gets more efficient as the square that needs checking gets bigger
-static gboolean is_square_next ( VikAggregateLayer *val, gint x, gint y, guint n )
-{
-  gint tmpx = x;
-  gint tmpy = y + n - 1;
-  for ( tmpx = x; tmpx < (x + n); tmpx++ ) {
-    if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-      return FALSE;
-    }
-  }
-  tmpx = x + n - 1;
-  for ( gint tmpy = y; tmpy < (y + n); tmpy++ ) {
-    if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-      return FALSE;
-    }
-  }
-  // NB tile (tmpx+n-1, tmpy+n-1) gets checked twice, but this isn't too much of a waste
-  return TRUE;
-}
-
-static gboolean is_square ( VikAggregateLayer *val, gint x, gint y, guint n )
-{
-  for ( gint tmpx = x; tmpx < (x + n); tmpx++ ) {
-     for ( gint tmpy = y; tmpy < (y + n); tmpy++ ) {
-       if ( ! is_tile_occupied(val->tiles, tmpx, tmpy) ) {
-         return FALSE;
-      }
-    }
-  }
-  return TRUE;
-}
-
-/*
- * Union Find stuff for labelling
- */
-
-/* The 'labels' array has the meaning that labels[x] is an alias for the label x; by
-   following this chain until x == labels[x], you can find the canonical name of an
-   equivalence class.  The labels start at one; labels[0] is a special value indicating
-   the highest label already used. */
-
-guint *labels;
-guint n_labels = 0; /* length of the labels array */
-
-/**
- * uf_find:
- *  returns the canonical label for the equivalence class containing x
- */
-static guint uf_find ( guint x ) {
-  guint y = x;
-  while (labels[y] != y)
-    y = labels[y];
-
-  while (labels[x] != x) {
-    guint z = labels[x];
-    labels[x] = y;
-    x = z;
-  }
-  return y;
-}
-
-/**
- * uf_union:
- *   joins two equivalence classes and returns the canonical label of the resulting class.
- */
-static guint uf_union ( guint x, guint y ) {
-  return labels[uf_find(x)] = uf_find(y);
-}
-
-/**
- * uf_make_set:
- *  creates a new equivalence class and returns its label
- */
-static guint uf_make_set(void) {
-  labels[0]++;
-  labels[labels[0]] = labels[0];
-  return labels[0];
-}
-
-/**
- * uf_init:
- *   Allocate array for potential labels
- */
-static void uf_init ( guint max_labels ) {
-  n_labels = max_labels;
-  labels = g_malloc0_n ( sizeof(guint), n_labels );
-  labels[0] = 0;
-}
-
-/**
- * uf_finish: clean up
- */
-static void uf_finish ( void ) {
-  n_labels = 0;
-  g_free ( labels );
-  labels = NULL;
-}
-
 // NB ATM This only tracks one such area
 //  (there might be multiple such areas)
 static void tac_contiguous_calc ( VikAggregateLayer *val )
 {
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
-
-  // Get grid extents
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
-  }
-
-  // Process the grid according to 'labelling clusters on a grid'
-  // https://en.wikipedia.org/wiki/Hoshen%E2%80%93Kopelman_algorithm
-  guint size = (abs(tlx-brx) * abs(tly-bry)) / 2;
-  if ( size == 0 )
-    return;
-
-  uf_init ( size );
-
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) ) {
-        guint label_up = tile_label (val->tiles, xx-1, yy ); // NB don't have to worry about -1 going out of bounds
-        guint label_left = tile_label (val->tiles, xx, yy-1 );
-        switch ( !!label_up + !!label_left ) {
-        case 0: // New
-          add_tile_label ( val->tiles, xx, yy, uf_make_set() );
-          break;
-        case 1: // Existing
-          add_tile_label ( val->tiles, xx, yy, MAX(label_up, label_left) );
-          break;
-        case 2: // Bind existing
-          add_tile_label ( val->tiles, xx, yy, uf_union(label_up, label_left) );
-          break;
-        default: // Should not happen
-          g_critical ("%s: labelling algorithm broken", __FUNCTION__);
-          break;
-        }
-      }
-    }
-  }
-
-  // Reprocess the grid to compare the size of the labels
-  int *new_labels = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  int *sizes = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) ) {
-        gint ll = uf_find(tile_label (val->tiles, xx, yy));
-        if (new_labels[ll] == 0) {
-          new_labels[0]++;
-          new_labels[ll] = new_labels[0];
-        }
-        sizes[new_labels[ll]]++;
-        add_tile_label ( val->tiles, xx, yy, new_labels[ll] );
-      }
-    }
-  }
-  gint total_clusters = new_labels[0];
-
-  guint largist = 0;
-  for ( guint ss = 1; ss < n_labels; ss++ ) {
-    if ( sizes[ss] > largist ) {
-      largist = sizes[ss];
-      val->cont_label = ss;
-      val->num_tiles[CONTIG] = largist;
-    }
-  }
-  g_free ( new_labels );
-  g_free ( sizes );
-  uf_finish();
+  guint areas = 0;
+  tile_set_clear ( val->tiles_contig );
+  val->num_tiles[CONTIG] = tile_set_largest_area ( val->tiles, val->tiles_contig, &areas );
 
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, largist, val->cont_label );
+  g_debug ( "%s: %f %d %d", __FUNCTION__, time_spent, areas, val->num_tiles[CONTIG] );
 }
 
 // NB ATM This only tracks one such area
@@ -1979,129 +1847,28 @@ static void tac_cluster_calc ( VikAggregateLayer *val )
 {
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( is_cluster(val->tiles, x, y) ) {
-      // Make new hashtable from just the tiles that are in a cluster
-      add_tile ( val->tiles_clust, x, y );
-      val->num_tiles[CLUSTER]++;
-    }
-  }
-
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
-
-  // Get grid extents
-  g_hash_table_iter_init ( &iter, val->tiles_clust );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
-  }
-
-  guint size = (abs(tlx-brx) * abs(tly-bry)) / 2;
-  if ( size == 0 )
-    return;
+  // Just the tiles that are in a cluster (i.e. surrounded by occupied tiles)
+  TileSet *surrounded = tile_set_new ();
+  (void)tile_set_add_surrounded ( surrounded, val->tiles );
 
-  uf_init ( size );
-
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles_clust, xx, yy) ) {
-        guint label_up = tile_label (val->tiles_clust, xx-1, yy ); // NB don't have to worry about -1 going out of bounds
-        guint label_left = tile_label (val->tiles_clust, xx, yy-1 );
-        switch ( !!label_up + !!label_left ) {
-        case 0: // New
-          add_tile_label ( val->tiles_clust, xx, yy, uf_make_set() );
-          break;
-        case 1: // Existing
-          add_tile_label ( val->tiles_clust, xx, yy, MAX(label_up, label_left) );
-          break;
-        case 2: // Bind existing
-          add_tile_label ( val->tiles_clust, xx, yy, uf_union(label_up, label_left) );
-          break;
-        default: // Should not happen
-          g_critical ("%s: labelling algorithm broken", __FUNCTION__);
-          break;
-        }
-      }
-    }
-  }
-
-  // Reprocess the grid to compare the size of the labels
-  int *new_labels = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-  int *sizes = g_malloc0_n ( sizeof(int), n_labels ); // allocate array, initialized to zero
-
-  for ( gint xx = tlx; xx <= brx; xx++ ) {
-    for ( gint yy = tly; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles_clust, xx, yy) ) {
-        gint ll = uf_find(tile_label (val->tiles_clust, xx, yy));
-        if (new_labels[ll] == 0) {
-          new_labels[0]++;
-          new_labels[ll] = new_labels[0];
-        }
-        sizes[new_labels[ll]]++;
-        add_tile_label ( val->tiles_clust, xx, yy, new_labels[ll] );
-      }
-    }
-  }
-  gint total_clusters = new_labels[0];
-
-  guint largist = 0;
-  for ( guint ss = 1; ss < n_labels; ss++ ) {
-    if ( sizes[ss] > largist ) {
-      largist = sizes[ss];
-      val->clust_label = ss;
-      val->num_tiles[CLUSTER] = largist;
-    }
-  }
-  g_free ( new_labels );
-  g_free ( sizes );
-  uf_finish();
+  guint areas = 0;
+  tile_set_clear ( val->tiles_clust );
+  val->num_tiles[CLUSTER] = tile_set_largest_area ( surrounded, val->tiles_clust, &areas );
+  tile_set_free ( surrounded );
 
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f %d %d %d", __FUNCTION__, time_spent, total_clusters, largist, val->clust_label );
+  g_debug ( "%s: %f %d %d", __FUNCTION__, time_spent, areas, val->num_tiles[CLUSTER] );
 }
 
-
 // NB ATM This only tracks one square
 //  (there might be multiple such squares)
 static void tac_square_calc ( VikAggregateLayer *val )
 {
-  val->max_square = 1;
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( is_square(val, x, y, val->max_square) ) {
-      g_debug ( "%s: is_square %d at %d:%d", __FUNCTION__, val->max_square, x, y );
-      val->xx = x;
-      val->yy = y;
-      val->max_square++;
-      gboolean do_again = FALSE;
-      do {
-        do_again = FALSE;
-        if ( is_square_next(val, x, y, val->max_square) ) {
-          g_debug ( "%s: is_square_next %d at %d:%d", __FUNCTION__, val->max_square, x, y );
-          do_again = TRUE;
-          val->max_square++;
-        }
-      } while ( do_again );
-    }
-  }
-  val->max_square--;
+  val->max_square = tile_set_largest_square ( val->tiles, &val->xx, &val->yy );
+  g_debug ( "%s: square %d at %d:%d", __FUNCTION__, val->max_square, val->xx, val->yy );
 
   clock_t end = clock();
   double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
@@ -2115,20 +1882,11 @@ static void tac_lines_calc ( VikAggregateLayer *val )
 {
   clock_t begin = clock();
 
-  GHashTableIter iter;
-  gpointer key, value;
-  gint x,y;
-  gint tlx=G_MAXINT,tly=G_MAXINT,brx=-G_MAXINT,bry=-G_MAXINT;
+  gint tlx,tly,brx,bry;
 
   // Get extents of tile coverage
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-    (void)sscanf ( key, "%d:%d", &x, &y );
-    if ( x < tlx ) tlx = x;
-    if ( x > brx ) brx = x;
-    if ( y < tly ) tly = y;
-    if ( y > bry ) bry = y;
-  }
+  if ( !tile_set_get_extents(val->tiles, &tlx, &tly, &brx, &bry) )
+    return;
 
   // Simple brute force method
   // Detects the first instance of the biggest consective run of tiles
@@ -2139,7 +1897,7 @@ static void tac_lines_calc ( VikAggregateLayer *val )
   for ( gint xx = tlx; xx <= brx; xx++ ) {
     gint yy;
     for ( yy = tly ; yy <= bry; yy++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) )
+      if ( tile_set_contains(val->tiles, xx, yy) )
         crt_sz++;
       else {
         if ( crt_sz > val->ns_size ) {
@@ -2165,7 +1923,7 @@ static void tac_lines_calc ( VikAggregateLayer *val )
   for ( gint yy = tly; yy <= bry; yy++ ) {
     gint xx;
     for ( xx = tlx; xx <= brx; xx++ ) {
-      if ( is_tile_occupied(val->tiles, xx, yy) )
+      if ( tile_set_contains(val->tiles, xx, yy) )
         crt_sz++;
       else {
         if ( crt_sz > val->ew_size ) {
@@ -2214,12 +1972,13 @@ static void tac_unreachable ( VikAggregateLayer *val )
   while ( g_hash_table_iter_next(&iter, &key, &value) ) {
     (void)sscanf ( key, "%d %d %d", &z, &x, &y );
     if ( z == zoom )
-      add_tile ( val->tiles, x, y );
+      (void)tile_set_add ( val->tiles, x, y );
   }
 }
 
-// Fwd declaration
+// Fwd declarations
 static void tac_clear ( VikAggregateLayer *val );
+static void tac_clear_derived ( VikAggregateLayer *val );
 
 /**
  *
@@ -2228,8 +1987,8 @@ static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 {
   clock_t begin = clock();
 
-  g_hash_table_remove_all ( ct->val->prev );
-  g_hash_table_remove_all ( ct->val->tiles_new );
+  tile_set_clear ( ct->val->prev );
+  tile_set_clear ( ct->val->tiles_new );
   ct->val->num_tiles[TNEW] = 0;
 
   // Only if there's something before then 'turn on' detection of new tiles...
@@ -2245,11 +2004,7 @@ static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
     sz = g_hash_table_size ( tiles_unreachable );
   if ( (ct->val->num_tiles[BASIC] > sz) && ct->val->on[TNEW]) {
     // Copy current tiles into prev
-    GHashTableIter iter;
-    gpointer key, value;
-    g_hash_table_iter_init ( &iter, ct->val->tiles );
-    while ( g_hash_table_iter_next(&iter, &key, &value) )
-      (void)g_hash_table_insert ( ct->val->prev, g_strdup(key), GUINT_TO_POINTER(0) );
+    tile_set_assign ( ct->val->prev, ct->val->tiles );
 
     for (gint x = 0; x<CP_NUM; x++ )
       ct->val->num_prev[x] = ct->val->num_tiles[x];
@@ -2258,9 +2013,13 @@ static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
   ct->val->ns_size_prev = ct->val->ns_size;
   ct->val->ew_size_prev = ct->val->ew_size;
 
-  tac_clear ( ct->val );
-
-  tac_unreachable ( ct->val );
+  if ( ct->incremental )
+    // Keep the existing tiles, so only the added tracks need checking
+    tac_clear_derived ( ct->val );
+  else {
+    tac_clear ( ct->val );
+    tac_unreachable ( ct->val );
+  }
 
   guint tracks_processed = 0;
   // This is used to prevent the progress going negative or otherwise over 100%
@@ -2319,21 +2078,11 @@ static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 
   if ( (ct->val->num_prev[BASIC] > sz) && ct->val->on[TNEW] && !zoom_level_chgd ) {
     // Determine difference in latest tiles vs prev
-    // Could be slow, but seems not too bad
-    GHashTableIter iter;
-    gpointer key, value;
-    g_hash_table_iter_init ( &iter, ct->val->tiles );
-    while ( g_hash_table_iter_next(&iter, &key, &value) ) {
-      gboolean contained = g_hash_table_contains ( ct->val->prev, key );
-      if ( !contained ) {
-        (void)g_hash_table_insert ( ct->val->tiles_new, g_strdup(key), GUINT_TO_POINTER(0) );
-        ct->val->num_tiles[TNEW]++;
-      }
-    }
+    ct->val->num_tiles[TNEW] = tile_set_add_difference ( ct->val->tiles_new, ct->val->tiles, ct->val->prev );
     // Also doing it here means the detection is only done for the 'first' calculation update
     // (this calculation alsootherwise gets done for any config change - even if just colour changed).
     //  so ATM the new tiles get reset for such subsequent recalculations
-    g_hash_table_remove_all ( ct->val->prev );
+    tile_set_clear ( ct->val->prev );
   }
 
   // Timing for all tile calcs
@@ -2348,19 +2097,18 @@ static gint tac_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 }
 
 /**
- *
+ * Clear the values calculated from the tiles
  */
-static void tac_clear ( VikAggregateLayer *val )
+static void tac_clear_derived ( VikAggregateLayer *val )
 {
   val->max_square = 0;
   for (gint x = 0; x<CP_NUM; x++ ) {
-    val->num_tiles[x] = 0;
+    if ( x != BASIC )
+      val->num_tiles[x] = 0;
   }
-  val->cont_label = 0;
-  val->clust_label = 0;
-  g_hash_table_remove_all ( val->tiles ); // No memory to remove ATM
-  g_hash_table_remove_all ( val->tiles_clust ); // No memory to remove ATM
-  g_hash_table_remove_all ( val->tiles_new ); // No memory to remove ATM
+  tile_set_clear ( val->tiles_contig );
+  tile_set_clear ( val->tiles_clust );
+  tile_set_clear ( val->tiles_new );
   // NB val->prev is not cleared at this point as needed for the later comparison
   val->ns_size = 0;
   val->ew_size = 0;
@@ -2369,17 +2117,22 @@ static void tac_clear ( VikAggregateLayer *val )
 /**
  *
  */
-static void tac_calculate ( VikAggregateLayer *val )
+static void tac_clear ( VikAggregateLayer *val )
 {
-  val->calculating = TRUE;
-  val->num_calcs++;
+  tac_clear_derived ( val );
+  val->num_tiles[BASIC] = 0;
+  tile_set_clear ( val->tiles );
+}
 
+/**
+ * Build the list of tracks to use from the TRW layers
+ *  (i.e. only those within the time range when specified)
+ */
+static GList *tac_build_track_list ( VikAggregateLayer *val, GList *layers )
+{
   GDate *now = g_date_new ();
   g_date_set_time_t ( now, time(NULL) );
 
-  GList *layers = NULL;
-  layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
-
   // For each TRW layers keep adding the tracks to build a list of all of them
   GList *tracks_and_layers = NULL; // A list of #vik_trw_track_list_t
   for ( GList *layer = layers; layer != NULL; layer = layer->next ) {
@@ -2410,13 +2163,49 @@ static void tac_calculate ( VikAggregateLayer *val )
     }
     g_list_free ( tracks );
   }
-  g_list_free ( layers );
   g_date_free ( now );
+  return tracks_and_layers;
+}
+
+/**
+ * Now the calculation has finished, include any layers that were added during it
+ *  (if they are still in this aggregate)
+ */
+static gboolean tac_added_idle ( VikAggregateLayer *val )
+{
+  if ( !val->calculating && val->tac_added ) {
+    GList *added = NULL;
+    for ( GList *iter = val->tac_added; iter; iter = iter->next )
+      if ( g_list_find(val->children, iter->data) )
+        added = g_list_prepend ( added, iter->data );
+    GList *queued = val->tac_added;
+    val->tac_added = NULL;
+    tac_calculate_added ( val, added );
+    g_list_free ( added );
+    g_list_free_full ( queued, g_object_unref );
+  }
+  g_object_unref ( val );
+  return FALSE;
+}
+
+// NB Called in the background thread
+static void tac_ct_free ( CalculateThreadT *ct )
+{
+  VikAggregateLayer *val = g_object_ref ( ct->val );
+  ct_free ( ct );
+  (void)gdk_threads_add_idle ( (GSourceFunc)tac_added_idle, val );
+}
+
+static void tac_calculate_start ( VikAggregateLayer *val, GList *tracks_and_layers, gboolean incremental )
+{
+  val->calculating = TRUE;
+  val->num_calcs++;
 
   CalculateThreadT *ct = g_malloc ( sizeof(CalculateThreadT) );
   ct->tracks_and_layers = tracks_and_layers;
   ct->val = val;
   ct->num_of_tracks = g_list_length (tracks_and_layers);
+  ct->incremental = incremental;
   guint extras = ct->val->on[MAX_SQR] + ct->val->on[CONTIG] + ct->val->on[CLUSTER];
 
   a_background_thread ( BACKGROUND_POOL_LOCAL,
@@ -2424,49 +2213,76 @@ static void tac_calculate ( VikAggregateLayer *val )
                         _("Track Area Coverage"),
                         (vik_thr_func)tac_calculate_thread,
                         ct,
-                        (vik_thr_free_func)ct_free,
+                        (vik_thr_free_func)tac_ct_free,
                         (vik_thr_free_func)ct_cancel,
                         ct->num_of_tracks + extras );
 }
 
-static void rhomboidal (float *values, unsigned d, unsigned r)
+/**
+ *
+ */
+static void tac_calculate ( VikAggregateLayer *val )
 {
-  for (guint y = 0 ; y < d ; ++y) {
-    for (guint x = 0 ; x < d ; ++x) {
-      values[y*d+x] = 1.0 - fmin(1.0, (float)(labs(x-(long)r)+labs(y-(long)r))/(r+1));
-    }
-  }
+  GList *layers = NULL;
+  layers = vik_aggregate_layer_get_all_layers_of_type ( val, layers, VIK_LAYER_TRW, TRUE );
+  GList *tracks_and_layers = tac_build_track_list ( val, layers );
+  g_list_free ( layers );
+
+  tac_calculate_start ( val, tracks_and_layers, FALSE );
 }
 
 /**
+ * tac_calculate_added:
+ * @layers: The layers (from within this aggregate) that have been added
  *
+ * Add the tiles of the tracks in these layers to the existing coverage,
+ *  rather than recalculating everything from scratch.
  */
-static void hm_track ( VikAggregateLayer *val, vik_trw_and_track_t *vtlist, gdouble mf, heatmap_t* hm, heatmap_stamp_t *stamp )
+static void tac_calculate_added ( VikAggregateLayer *val, GList *layers )
 {
-  int xx, yy;
-  VikTrack *trk = vtlist->trk;
-  GList *iter = trk->trackpoints;
-  while ( iter ) {
-    // Only do trackpoints with timestamps
-    // - i.e. hopefully to avoid artificial tracks
-    if ( !isnan(VIK_TRACKPOINT(iter->data)->timestamp) ) {
-      coord_to_screen (val->hm_width, val->hm_height, mf, (struct LatLon*)val->hm_center, &VIK_TRACKPOINT(iter->data)->coord, &xx, &yy);
-      /*
-      struct LatLon *ll = (struct LatLon *)&VIK_TRACKPOINT(iter->data)->coord;
-      xx = (int)(val->hm_width/2 + ( mf * (ll->lon - center->lon) ));
-      yy = (int)(val->hm_height/2 + ( mf * ( MERCLAT(center->lat) - MERCLAT(ll->lat) ) ));
-      */
-      //heatmap_add_point ( hm, xx, yy );
-      heatmap_add_point_with_stamp ( hm, xx, yy, stamp );
-      //hm_point ( val, &VIK_TRACKPOINT(iter->data)->coord, hm );
+  if ( !val->on[BASIC] )
+    return;
+
+  // Keep these until the current calculation has finished
+  if ( val->calculating ) {
+    for ( GList *iter = layers; iter; iter = iter->next )
+      val->tac_added = g_list_prepend ( val->tac_added, g_object_ref(iter->data) );
+    return;
+  }
+
+  // Only possible if there is already coverage at the same level
+  if ( val->num_calcs == 0 || val->zoom_level_prev != val->zoom_level ) {
+    tac_calculate ( val );
+    return;
+  }
+
+  GList *trw_layers = NULL;
+  for ( GList *iter = layers; iter; iter = iter->next ) {
+    VikLayer *vl = VIK_LAYER(iter->data);
+    if ( vl->type == VIK_LAYER_TRW && vl->visible )
+      trw_layers = g_list_prepend ( trw_layers, vl );
+    else if ( vl->type == VIK_LAYER_AGGREGATE )
+      trw_layers = vik_aggregate_layer_get_all_layers_of_type ( VIK_AGGREGATE_LAYER(vl), trw_layers, VIK_LAYER_TRW, TRUE );
+  }
+  GList *tracks_and_layers = tac_build_track_list ( val, trw_layers );
+  g_list_free ( trw_layers );
+
+  if ( tracks_and_layers )
+    tac_calculate_start ( val, tracks_and_layers, TRUE );
+}
+
+static void rhomboidal (float *values, unsigned d, unsigned r)
+{
+  for (guint y = 0 ; y < d ; ++y) {
+    for (guint x = 0 ; x < d ; ++x) {
+      values[y*d+x] = 1.0 - fmin(1.0, (float)(labs(x-(long)r)+labs(y-(long)r))/(r+1));
     }
-    iter = iter->next;
   }
 }
 
-static void hm_img_free ( guchar *pixels, gpointer data )
+static gboolean hm_progress ( gdouble fraction, gpointer threaddata )
 {
-  g_free ( pixels );
+  return a_background_thread_progress ( threaddata, fraction ) == 0;
 }
 
 /**
@@ -2476,7 +2292,7 @@ static gint hm_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
 {
   VikAggregateLayer *val = ct->val;
 
-  clock_t begin = clock();
+  gint64 begin = g_get_monotonic_time ();
 
   // Generate a stamp with a size relative to the zoom level
   unsigned radius = map_utils_mpp_to_zoom_level ( val->hm_zoom ) *
@@ -2485,49 +2301,25 @@ static gint hm_calculate_thread ( CalculateThreadT *ct, gpointer threaddata )
   float pts[d * d];
   rhomboidal ( pts, d, radius );
   heatmap_stamp_t *stamp = heatmap_stamp_load ( d, d, pts );
-  heatmap_t* hm = heatmap_new ( val->hm_width, val->hm_height );
-
-  int ww = val->hm_width;
-  int hh = val->hm_height;
-
-  // Only needs calculating once
-  gdouble mf = mercator_factor ( val->hm_zoom, val->hm_scale );
-
-  guint tracks_processed = 0;
-  for ( GList *tl = ct->tracks_and_layers; tl != NULL; tl = tl->next ) {
-    gdouble percent = (gdouble)tracks_processed/(gdouble)(ct->num_of_tracks);
-    gint res = a_background_thread_progress ( threaddata, percent );
-    if ( res != 0 ) return -1;
-
-    vik_trw_and_track_t *vtlist = tl->data;
-    if ( BBOX_INTERSECT ( vtlist->trk->bbox, val->hm_bbox ) )
-      hm_track ( ct->val, vtlist, mf, hm, stamp );
-
-    tracks_processed++;
-  }
 
-  // Would be better if testing for any tracks actually used
-  if ( tracks_processed > 0 ) {
-    unsigned char *image = g_malloc ( ww*hh*4 );
+  GList *tracks = NULL;
+  for ( GList *tl = ct->tracks_and_layers; tl != NULL; tl = tl->next )
+    tracks = g_list_prepend ( tracks, ((vik_trw_and_track_t*)tl->data)->trk );
 
-    if ( val->hm_style > 0 && val->hm_style < 4 )
-      heatmap_render_to ( hm, hm_colorschemes[val->hm_style-1], image );
-    else
-      heatmap_render_default_to ( hm, image );
+  // The tracks are shared out between several threads (stamping the same area)
+  HeatmapPyramid *hp = a_heatmap_pyramid_generate ( tracks, &val->hm_area, stamp, 0, hm_progress, threaddata );
 
-    val->hm_pixbuf = gdk_pixbuf_new_from_data ( image, GDK_COLORSPACE_RGB, TRUE, 8, ww, hh, 4*ww, hm_img_free, NULL );
-    val->hm_pixbuf = ui_pixbuf_set_alpha ( val->hm_pixbuf, val->hm_alpha );
-  }
-
-  heatmap_free ( hm );
+  g_list_free ( tracks );
   heatmap_stamp_free ( stamp );
 
-  // Timing
-  clock_t end = clock();
-  double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-  g_debug ( "%s: %f", __FUNCTION__, time_spent );
+  if ( !hp )
+    return -1;
+
+  // Timing (NB clock() would be the sum over all threads)
+  g_debug ( "%s: %f", __FUNCTION__, (gdouble)(g_get_monotonic_time() - begin) / G_USEC_PER_SEC );
 
-  ct->val->hm_calculating = FALSE;
+  val->hm_pyramid = hp;
+  val->hm_calculating = FALSE;
   vik_layer_emit_update ( VIK_LAYER(ct->val), FALSE ); // NB update display from background
 
   return 0;
@@ -2541,20 +2333,20 @@ static void hm_calculate ( VikAggregateLayer *val )
   VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(val));
   VikViewport *vvp = vik_window_viewport ( vw );
 
-  val->hm_width = vik_viewport_get_width ( vvp );
-  val->hm_height = vik_viewport_get_height ( vvp );
-  val->hm_bbox = vik_viewport_get_bbox ( vvp );
   val->hm_zoom = (gint)vik_viewport_get_zoom ( vvp );
-  val->hm_scaled_zoom = val->hm_zoom;
-  val->hm_center = vik_viewport_get_center ( vvp );
-  vik_viewport_screen_to_coord ( vvp, 0, 0, &val->hm_tl );
-  val->hm_scale = vik_viewport_get_scale ( vvp );
-  val->hm_scaled = FALSE;
-  val->hm_zoom_max = 0;
   if ( val->hm_zoom == 0 ) {
     g_warning ( "%s: Zoom invalid", __FUNCTION__ );
     return;
   }
+  val->hm_scaled_zoom = val->hm_zoom;
+  val->hm_scale = vik_viewport_get_scale ( vvp );
+  vik_viewport_screen_to_coord ( vvp, 0, 0, &val->hm_tl );
+  // Copy the values, as the viewport may change whilst calculating
+  val->hm_area.width = vik_viewport_get_width ( vvp );
+  val->hm_area.height = vik_viewport_get_height ( vvp );
+  val->hm_area.bbox = vik_viewport_get_bbox ( vvp );
+  val->hm_area.center = *(struct LatLon*)vik_viewport_get_center ( vvp );
+  val->hm_area.mf = mercator_factor ( val->hm_zoom, val->hm_scale );
 
   hm_clear ( val );
   val->hm_calculating = TRUE;
@@ -2664,14 +2456,13 @@ static gint tac_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
 
   guint zoom = (guint)map_utils_mpp_to_zoom_level(val->zoom_level);
 
-  GHashTableIter iter;
-  gpointer key, value;
+  TileSetIter iter;
   gint x,y;
   GdkPixbuf *pixbuf = NULL;
-  guint sz = g_hash_table_size ( val->tiles );
+  guint sz = tile_set_size ( val->tiles );
 
-  g_hash_table_iter_init ( &iter, val->tiles );
-  while ( g_hash_table_iter_next(&iter, &key, &value) ) {
+  tile_set_iter_init ( &iter, val->tiles );
+  while ( tile_set_iter_next(&iter, &x, &y) ) {
 
     num_tiles++;
     gdouble percent = (gdouble)num_tiles/(gdouble)sz;
@@ -2681,8 +2472,6 @@ static gint tac_mbtiles_thread ( MBT_T *mbt, gpointer threaddata  )
       goto cleanup;
     }
 
-    (void)sscanf ( key, "%d:%d", &x, &y );
-
     pixbuf = layer_pixbuf_update ( pixbuf, val->color[BASIC], 256, 256, val->alpha[BASIC] );
 
     gint flip_y = (gint) pow(2, zoom)-1 - y;
@@ -2781,7 +2570,7 @@ static void tac_generate_mbtiles_cb ( menu_array_values values )
                         mbt,
                         (vik_thr_free_func)mbt_free,
                         NULL, // cancel() nothing to do, could delete file but ATM leave as progressed
-                        g_hash_table_size(val->tiles) );
+                        tile_set_size(val->tiles) );
 }
 #endif
 
@@ -3011,7 +2800,7 @@ static void aggregate_build_submenu_hm ( VikAggregateLayer *val, GtkMenu *menu,
     gtk_widget_set_sensitive ( itemhmc, hm_available );
 
     GtkWidget *itemhmlr = vu_menu_add_item ( hm_submenu, _("_Remove"), GTK_STOCK_DELETE, G_CALLBACK(hm_clear_cb), values );
-    gtk_widget_set_sensitive ( itemhmlr, (val->hm_pixbuf != NULL) );
+    gtk_widget_set_sensitive ( itemhmlr, (val->hm_pyramid != NULL) );
   }
 }
 
@@ -3112,7 +2901,7 @@ static gboolean aggregate_layer_selected_viewport_menu ( VikAggregateLayer *val,
 
     if ( map_utils_vikcoord_to_iTMS(&coord, val->zoom_level, val->zoom_level, &val->rc_menu_mc) ) {
       GtkWidget *itemtt = vu_menu_add_item ( sm, _("_Tracks in this Tile"), GTK_STOCK_INFO, G_CALLBACK(tac_track_list_cb), values );
-      available = available && is_tile_occupied ( val->tiles, val->rc_menu_mc.x, val->rc_menu_mc.y );
+      available = available && tile_set_contains ( val->tiles, val->rc_menu_mc.x, val->rc_menu_mc.y );
       gtk_widget_set_sensitive ( itemtt, available );
     }
 
@@ -3198,10 +2987,11 @@ void vik_aggregate_layer_free ( VikAggregateLayer *val )
   g_list_foreach ( val->children, (GFunc)(disconnect_layer_signal), val );
   g_list_foreach ( val->children, (GFunc)(g_object_unref), NULL );
   g_list_free ( val->children );
+  g_list_free_full ( val->tac_added, g_object_unref );
   if ( val->tracks_analysis_dialog != NULL )
     gtk_widget_destroy ( val->tracks_analysis_dialog );
 
-  g_hash_table_destroy ( val->tiles );
+  tile_set_free ( val->tiles );
   for ( guint ii=0; ii<CP_NUM; ii++ ) {
     if ( val->pixbuf[ii] )
       g_object_unref ( val->pixbuf[ii] );
@@ -3210,14 +3000,13 @@ void vik_aggregate_layer_free ( VikAggregateLayer *val )
   }
   if ( val->unreachable_pixbuf )
     g_object_unref ( val->unreachable_pixbuf );
-  g_hash_table_destroy ( val->tiles_clust );
-  g_hash_table_destroy ( val->tiles_new );
-  g_hash_table_destroy ( val->prev );
-
-  if ( val->hm_pixbuf )
-    g_object_unref ( val->hm_pixbuf );
-  if ( val->hm_pbf_scaled )
-    g_object_unref ( val->hm_pbf_scaled );
+  tile_set_free ( val->tiles_contig );
+  tile_set_free ( val->tiles_clust );
+  tile_set_free ( val->tiles_new );
+  tile_set_free ( val->prev );
+
+  g_hash_table_destroy ( val->hm_scaled_tiles );
+  a_heatmap_pyramid_free ( val->hm_pyramid );
 }
 
 static void delete_layer_iter ( VikLayer *vl )
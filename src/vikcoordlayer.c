@@ -23,6 +23,34 @@
 
 #define COORD_FIXED_NAME "Coord"
 
+// Labels are only put on lines at least this far apart (in pixels)
+#define LABEL_SPACING 80
+// UTM grid lines are not drawn closer than this (in pixels)
+#define GRID_MIN_SPACING 64
+// UTM grid lines are curved when not viewed in UTM, so are drawn in this many parts
+#define GRID_SEGMENTS 8
+// Zoomed out too far to draw a UTM grid with more lines than this across
+#define GRID_MAX_LINES 200
+
+typedef enum {
+  GRID_LATLON = 0,
+  GRID_UTM,
+  GRID_MGRS,
+} CoordGridType;
+
+// Lines are drawn in one of these weights, each with its own GC
+enum { WEIGHT_MAJOR = 0, WEIGHT_MINOR, WEIGHT_FINE, NUM_WEIGHTS };
+
+typedef struct {
+  gint x1, y1, x2, y2;
+  guint8 weight;
+} CoordLine;
+
+typedef struct {
+  gint x, y, w, h;
+  PangoLayout *pl;
+} CoordLabel;
+
 static VikCoordLayer *coord_layer_new ( VikViewport *vp );
 static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp );
 static void coord_layer_free ( VikCoordLayer *vcl );
@@ -45,6 +73,10 @@ static VikLayerParamData color_default ( void ) {
 }
 static VikLayerParamData min_inc_default ( void ) { return VIK_LPD_DOUBLE ( 1.0 ); }
 static VikLayerParamData line_thickness_default ( void ) { return VIK_LPD_UINT ( 3 ); }
+static VikLayerParamData grid_default ( void ) { return VIK_LPD_UINT ( GRID_LATLON ); }
+static VikLayerParamData labels_default ( void ) { return VIK_LPD_BOOLEAN ( TRUE ); }
+
+static gchar *params_grids[] = { N_("Latitude/Longitude"), N_("UTM"), N_("MGRS"), NULL };
 
 static void reset_cb ( GtkWidget *widget, gpointer ptr )
 {
@@ -57,11 +89,13 @@ static VikLayerParam coord_layer_params[] = {
   { VIK_LAYER_COORD, "color", VIK_LAYER_PARAM_COLOR, VIK_LAYER_GROUP_NONE, N_("Color:"), VIK_LAYER_WIDGET_COLOR, NULL, NULL, NULL, color_default, NULL, NULL },
   { VIK_LAYER_COORD, "min_inc", VIK_LAYER_PARAM_DOUBLE, VIK_LAYER_GROUP_NONE, N_("Minutes Width:"), VIK_LAYER_WIDGET_SPINBUTTON, &param_scales[0], NULL, NULL, min_inc_default, NULL, NULL },
   { VIK_LAYER_COORD, "line_thickness", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Line Thickness:"), VIK_LAYER_WIDGET_SPINBUTTON, &param_scales[1], NULL, NULL, line_thickness_default, NULL, NULL },
+  { VIK_LAYER_COORD, "grid", VIK_LAYER_PARAM_UINT, VIK_LAYER_GROUP_NONE, N_("Grid:"), VIK_LAYER_WIDGET_COMBOBOX, params_grids, NULL, NULL, grid_default, NULL, NULL },
+  { VIK_LAYER_COORD, "labels", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Labels:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, labels_default, NULL, NULL },
   { VIK_LAYER_COORD, "reset", VIK_LAYER_PARAM_PTR_DEFAULT, VIK_LAYER_GROUP_NONE, NULL,
     VIK_LAYER_WIDGET_BUTTON, N_("Reset to Defaults"), NULL, NULL, reset_default, NULL, NULL },
 };
 
-enum { PARAM_COLOR = 0, PARAM_MIN_INC, PARAM_LINE_THICKNESS, PARAM_RESET, NUM_PARAMS };
+enum { PARAM_COLOR = 0, PARAM_MIN_INC, PARAM_LINE_THICKNESS, PARAM_GRID, PARAM_LABELS, PARAM_RESET, NUM_PARAMS };
 
 VikLayerInterface vik_coord_layer_interface = {
   COORD_FIXED_NAME,
@@ -131,10 +165,24 @@ VikLayerInterface vik_coord_layer_interface = {
 
 struct _VikCoordLayer {
   VikLayer vl;
-  GdkGC *gc;
+  GdkGC *gc[NUM_WEIGHTS];
+  GdkGC *bg_gc; // Behind labels
+  GdkColor bg_color;
   gdouble deg_inc;
   guint8 line_thickness;
   GdkColor color;
+  guint grid;
+  gboolean labels;
+
+  // The lines and labels worked out for the viewport state below,
+  //  only redone when the viewport changes rather than on every draw
+  GArray *lines;
+  GArray *label_list;
+  gboolean cache_valid;
+  VikCoord cache_center;
+  gdouble cache_xmpp, cache_ympp;
+  gint cache_width, cache_height;
+  VikViewportDrawMode cache_drawmode;
 };
 
 GType vik_coord_layer_get_type ()
@@ -183,7 +231,7 @@ gboolean coord_layer_set_param ( VikCoordLayer *vcl, VikLayerSetParam *vlsp )
     case PARAM_COLOR:
       changed = vik_layer_param_change_color ( vlsp->data, &vcl->color );
       // Apply setting
-      if ( vcl->gc )
+      if ( vcl->gc[WEIGHT_MAJOR] )
         coord_layer_update_gc ( vcl, vlsp->vp );
       break;
     case PARAM_MIN_INC: {
@@ -193,11 +241,22 @@ gboolean coord_layer_set_param ( VikCoordLayer *vcl, VikLayerSetParam *vlsp )
       break;
     }
     case PARAM_LINE_THICKNESS:
-      if ( vlsp->data.u >= 1 && vlsp->data.u <= 15 )
+      if ( vlsp->data.u >= 1 && vlsp->data.u <= 15 ) {
         changed = vik_layer_param_change_uint8 ( vlsp->data, &vcl->line_thickness );
+        // Apply setting
+        if ( changed && vcl->gc[WEIGHT_MAJOR] && vlsp->vp )
+          coord_layer_update_gc ( vcl, vlsp->vp );
+      }
+      break;
+    case PARAM_GRID:
+      if ( vlsp->data.u <= GRID_MGRS )
+        changed = vik_layer_param_change_uint ( vlsp->data, &vcl->grid );
       break;
+    case PARAM_LABELS: changed = vik_layer_param_change_boolean ( vlsp->data, &vcl->labels ); break;
     default: break;
   }
+  if ( changed )
+    vcl->cache_valid = FALSE;
   if ( vik_debug && changed )
     g_debug ( "%s: Detected change on param %d", __FUNCTION__, vlsp->id );
   return changed;
@@ -211,6 +270,8 @@ static VikLayerParamData coord_layer_get_param ( VikCoordLayer *vcl, guint16 id,
     case PARAM_COLOR: rv.c = vcl->color; break;
     case PARAM_MIN_INC: rv.d = vcl->deg_inc * 60.0; break;
     case PARAM_LINE_THICKNESS: rv.i = vcl->line_thickness; break;
+    case PARAM_GRID: rv.u = vcl->grid; break;
+    case PARAM_LABELS: rv.b = vcl->labels; break;
     case PARAM_RESET: rv.ptr = reset_cb; break;
     default: break;
   }
@@ -228,199 +289,575 @@ static VikCoordLayer *coord_layer_new ( VikViewport *vvp )
   VikCoordLayer *vcl = VIK_COORD_LAYER ( g_object_new ( VIK_COORD_LAYER_TYPE, NULL ) );
   vik_layer_set_type ( VIK_LAYER(vcl), VIK_LAYER_COORD );
 
+  vcl->lines = g_array_new ( FALSE, FALSE, sizeof(CoordLine) );
+  vcl->label_list = g_array_new ( FALSE, FALSE, sizeof(CoordLabel) );
+  vcl->cache_valid = FALSE;
+
   vik_layer_set_defaults ( VIK_LAYER(vcl), vvp );
 
-  vcl->gc = NULL;
+  for ( guint ii = 0; ii < NUM_WEIGHTS; ii++ )
+    vcl->gc[ii] = NULL;
+  vcl->bg_gc = NULL;
   return vcl;
 }
 
-static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
+static void coord_layer_cache_clear ( VikCoordLayer *vcl )
 {
-  if ( !vcl->gc ) {
-    return;
+  for ( guint ii = 0; ii < vcl->label_list->len; ii++ )
+    g_object_unref ( g_array_index(vcl->label_list, CoordLabel, ii).pl );
+  g_array_set_size ( vcl->label_list, 0 );
+  g_array_set_size ( vcl->lines, 0 );
+  vcl->cache_valid = FALSE;
+}
+
+static gboolean coord_layer_cache_matches ( VikCoordLayer *vcl, VikViewport *vp )
+{
+  return vcl->cache_valid &&
+    vik_coord_equals ( &vcl->cache_center, vik_viewport_get_center(vp) ) &&
+    vcl->cache_xmpp == vik_viewport_get_xmpp(vp) &&
+    vcl->cache_ympp == vik_viewport_get_ympp(vp) &&
+    vcl->cache_width == vik_viewport_get_width(vp) &&
+    vcl->cache_height == vik_viewport_get_height(vp) &&
+    vcl->cache_drawmode == vik_viewport_get_drawmode(vp);
+}
+
+static void coord_layer_add_line ( VikCoordLayer *vcl, gint x1, gint y1, gint x2, gint y2, guint8 weight )
+{
+  CoordLine line = { x1, y1, x2, y2, weight };
+  g_array_append_val ( vcl->lines, line );
+}
+
+/**
+ * Returns the width of the label, or 0 if it is not on screen
+ */
+static gint coord_layer_add_label ( VikCoordLayer *vcl, VikViewport *vp, gint x, gint y, const gchar *text, gboolean centred )
+{
+  CoordLabel label;
+  label.pl = gtk_widget_create_pango_layout ( GTK_WIDGET(vp), text );
+  pango_layout_get_pixel_size ( label.pl, &label.w, &label.h );
+  label.x = centred ? x - label.w/2 : x;
+  label.y = centred ? y - label.h/2 : y;
+  if ( label.x < 0 || label.y < 0 ||
+       label.x + label.w > vik_viewport_get_width(vp) || label.y + label.h > vik_viewport_get_height(vp) ) {
+    g_object_unref ( label.pl );
+    return 0;
   }
+  g_array_append_val ( vcl->label_list, label );
+  return label.w;
+}
 
-  if ( vik_viewport_get_coord_mode(vp) != VIK_COORD_UTM ) 
-  {
-    VikCoord left, right, left2, right2;
-    gdouble l, r, i, j;
-    gint x1, y1, x2, y2, smod = 1, mmod = 1;
-    gboolean mins = FALSE, secs = FALSE;
-    gint mlt = MAX(vcl->line_thickness/2, 1);
-    gint slt = MAX(vcl->line_thickness/5, 1);
-    GdkGC *dgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), vcl->line_thickness);
-    GdkGC *mgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), mlt);
-    GdkGC *sgc = vik_viewport_new_gc_from_color(vp, &(vcl->color), slt);
-
-    vik_viewport_screen_to_coord ( vp, 0, 0, &left );
-    vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), 0, &right );
-    vik_viewport_screen_to_coord ( vp, 0, vik_viewport_get_height(vp), &left2 );
-    vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), vik_viewport_get_height(vp), &right2 );
-
-#define CLINE(gc, c1, c2, lt) {                              \
+/**
+ * Height of a line of label text
+ */
+static gint coord_layer_label_height ( VikViewport *vp )
+{
+  gint height = 0;
+  PangoLayout *pl = gtk_widget_create_pango_layout ( GTK_WIDGET(vp), "0" );
+  pango_layout_get_pixel_size ( pl, NULL, &height );
+  g_object_unref ( pl );
+  return height;
+}
+
+/**
+ * How many lines apart labels need to be so they don't run into each other,
+ *  or 0 if even the most spaced out labels would
+ */
+static gint coord_layer_label_every ( gdouble line_spacing )
+{
+  static const gint multiples[] = { 1, 2, 5, 10, 15, 30, 60, 120, 300, 600 };
+  for ( guint ii = 0; ii < G_N_ELEMENTS(multiples); ii++ )
+    if ( line_spacing * multiples[ii] >= LABEL_SPACING )
+      return multiples[ii];
+  return 0;
+}
+
+/**
+ * Degrees, minutes and seconds only as precise as the lines being labelled
+ */
+static void coord_layer_latlon_label ( gdouble value, gboolean is_lon, gdouble step_secs, gchar *buf, gsize size )
+{
+  gchar hemi = is_lon ? (value < 0 ? 'W' : 'E') : (value < 0 ? 'S' : 'N');
+  gint secs = (gint)round ( fabs(value) * 3600.0 );
+  if ( step_secs >= 3600.0 )
+    g_snprintf ( buf, size, "%d°%c", secs/3600, hemi );
+  else if ( step_secs >= 60.0 )
+    g_snprintf ( buf, size, "%d°%02d'%c", secs/3600, (secs/60)%60, hemi );
+  else
+    g_snprintf ( buf, size, "%d°%02d'%02d\"%c", secs/3600, (secs/60)%60, secs%60, hemi );
+}
+
+/**
+ * Lat/Lon lines on a Lat/Lon based viewport
+ */
+static void coord_layer_make_latlon ( VikCoordLayer *vcl, VikViewport *vp )
+{
+  VikCoord left, right, left2, right2;
+  gdouble l, r, i, j;
+  gint x1, y1, x2, y2, smod = 1, mmod = 1;
+  gboolean mins = FALSE, secs = FALSE;
+  gint width = vik_viewport_get_width ( vp );
+  gint height = vik_viewport_get_height ( vp );
+
+  vik_viewport_screen_to_coord ( vp, 0, 0, &left );
+  vik_viewport_screen_to_coord ( vp, width, 0, &right );
+  vik_viewport_screen_to_coord ( vp, 0, height, &left2 );
+  vik_viewport_screen_to_coord ( vp, width, height, &right2 );
+
+#define CLINE(weight, c1, c2) {                              \
 	  vik_viewport_coord_to_screen(vp, (c1), &x1, &y1);  \
 	  vik_viewport_coord_to_screen(vp, (c2), &x2, &y2);  \
-	  vik_viewport_draw_line (vp, (gc), x1, y1, x2, y2, &vcl->color, lt); \
+	  coord_layer_add_line (vcl, x1, y1, x2, y2, weight); \
 	}
 
-    l = left.east_west;
-    r = right.east_west;
-    if (60*fabs(l-r) < 4) {
-      secs = TRUE;
-      smod = MIN(6, (int)ceil(3600*fabs(l-r)/30.0));
+  l = left.east_west;
+  r = right.east_west;
+  if (60*fabs(l-r) < 4) {
+    secs = TRUE;
+    smod = MIN(6, (int)ceil(3600*fabs(l-r)/30.0));
+  }
+  if (fabs(l-r) < 4) {
+    mins = TRUE;
+    mmod = MIN(6, (int)ceil(60*fabs(l-r)/30.0));
+  }
+  for (i=floor(l*60); i<ceil(r*60); i+=1.0) {
+    if (secs) {
+      for (j=i*60+1; j<(i+1)*60; j+=1.0) {
+	left.east_west = j/3600.0;
+	left2.east_west = j/3600.0;
+	if ((int)j % smod == 0) CLINE(WEIGHT_FINE, &left, &left2);
+      }
     }
-    if (fabs(l-r) < 4) {
-      mins = TRUE;
-      mmod = MIN(6, (int)ceil(60*fabs(l-r)/30.0));
+    if (mins) {
+      left.east_west = i/60.0;
+      left2.east_west = i/60.0;
+      if ((int)i % mmod == 0) CLINE(WEIGHT_MINOR, &left, &left2);
     }
-    for (i=floor(l*60); i<ceil(r*60); i+=1.0) {
-      if (secs) {
-	for (j=i*60+1; j<(i+1)*60; j+=1.0) {
-	  left.east_west = j/3600.0;
-	  left2.east_west = j/3600.0;
-	  if ((int)j % smod == 0) CLINE(sgc, &left, &left2, slt);
-	}
-      }
-      if (mins) {
-	left.east_west = i/60.0;
-	left2.east_west = i/60.0;
-	if ((int)i % mmod == 0) CLINE(mgc, &left, &left2, mlt);
-      }
-      if ((int)i % 60 == 0) {
-	left.east_west = i/60.0;
-	left2.east_west = i/60.0;
-	CLINE(dgc, &left, &left2, vcl->line_thickness);
-      }
+    if ((int)i % 60 == 0) {
+      left.east_west = i/60.0;
+      left2.east_west = i/60.0;
+      CLINE(WEIGHT_MAJOR, &left, &left2);
     }
+  }
 
-    vik_viewport_screen_to_coord ( vp, 0, 0, &left );
-    l = left2.north_south;
-    r = left.north_south;
-    for (i=floor(l*60); i<ceil(r*60); i+=1.0) {
-      if (secs) {
-	for (j=i*60+1; j<(i+1)*60; j+=1.0) {
-	  left.north_south = j/3600.0;
-	  right.north_south = j/3600.0;
-	  if ((int)j % smod == 0) CLINE(sgc, &left, &right, slt);
-	}
-      }
-      if (mins) {
-	left.north_south = i/60.0;
-	right.north_south = i/60.0;
-	if ((int)i % mmod == 0) CLINE(mgc, &left, &right, mlt);
-      }
-      if ((int)i % 60 == 0) {
-	left.north_south = i/60.0;
-	right.north_south = i/60.0;
-	CLINE(dgc, &left, &right, vcl->line_thickness);
+  vik_viewport_screen_to_coord ( vp, 0, 0, &left );
+  l = left2.north_south;
+  r = left.north_south;
+  for (i=floor(l*60); i<ceil(r*60); i+=1.0) {
+    if (secs) {
+      for (j=i*60+1; j<(i+1)*60; j+=1.0) {
+	left.north_south = j/3600.0;
+	right.north_south = j/3600.0;
+	if ((int)j % smod == 0) CLINE(WEIGHT_FINE, &left, &right);
       }
     }
+    if (mins) {
+      left.north_south = i/60.0;
+      right.north_south = i/60.0;
+      if ((int)i % mmod == 0) CLINE(WEIGHT_MINOR, &left, &right);
+    }
+    if ((int)i % 60 == 0) {
+      left.north_south = i/60.0;
+      right.north_south = i/60.0;
+      CLINE(WEIGHT_MAJOR, &left, &right);
+    }
+  }
 #undef CLINE
-    ui_gc_unref(dgc);
-    ui_gc_unref(sgc);
-    ui_gc_unref(mgc);
+
+  if ( !vcl->labels )
     return;
+
+  // Label the finest lines drawn, or fewer of them when too close together
+  gint line_secs = secs ? smod : mins ? 60*mmod : 3600;
+  gint band = coord_layer_label_height ( vp ) + 2;
+  gchar buf[32];
+  VikCoord topleft, coord;
+  vik_viewport_screen_to_coord ( vp, 0, 0, &topleft );
+  vik_viewport_screen_to_coord ( vp, width, height, &right2 );
+
+  l = topleft.east_west * 3600.0;
+  r = right2.east_west * 3600.0;
+  gint every = ( r > l ) ? coord_layer_label_every ( line_secs * width / (r - l) ) : 0;
+  if ( every ) {
+    gint step = line_secs * every;
+    for ( i = ceil(l/step)*step; i <= r; i += step ) {
+      coord = topleft;
+      coord.east_west = i/3600.0;
+      vik_viewport_coord_to_screen ( vp, &coord, &x1, &y1 );
+      coord_layer_latlon_label ( coord.east_west, TRUE, step, buf, sizeof(buf) );
+      (void)coord_layer_add_label ( vcl, vp, x1+2, 1, buf, FALSE );
+    }
   }
 
-  if ( vik_viewport_get_coord_mode(vp) == VIK_COORD_UTM ) 
-  {
-    const struct UTM *center = (const struct UTM *)vik_viewport_get_center ( vp );
-    gdouble xmpp = vik_viewport_get_xmpp ( vp ), ympp = vik_viewport_get_ympp ( vp );
-    guint16 width = vik_viewport_get_width ( vp ), height = vik_viewport_get_height ( vp );
-    struct LatLon ll, ll2, min, max;
-    double lon;
-    int x1, x2;
-    struct UTM utm;
+  l = right2.north_south * 3600.0;
+  r = topleft.north_south * 3600.0;
+  every = ( r > l ) ? coord_layer_label_every ( line_secs * height / (r - l) ) : 0;
+  if ( every ) {
+    gint step = line_secs * every;
+    for ( i = ceil(l/step)*step; i <= r; i += step ) {
+      coord = topleft;
+      coord.north_south = i/3600.0;
+      vik_viewport_coord_to_screen ( vp, &coord, &x1, &y1 );
+      // Keep clear of the labels along the top
+      if ( y1 < band )
+        continue;
+      coord_layer_latlon_label ( coord.north_south, FALSE, step, buf, sizeof(buf) );
+      (void)coord_layer_add_label ( vcl, vp, 2, y1+1, buf, FALSE );
+    }
+  }
+}
+
+/**
+ * Lat/Lon lines on a UTM based viewport
+ */
+static void coord_layer_make_latlon_utm ( VikCoordLayer *vcl, VikViewport *vp )
+{
+  const struct UTM *center = (const struct UTM *)vik_viewport_get_center ( vp );
+  gdouble xmpp = vik_viewport_get_xmpp ( vp ), ympp = vik_viewport_get_ympp ( vp );
+  guint16 width = vik_viewport_get_width ( vp ), height = vik_viewport_get_height ( vp );
+  struct LatLon ll, ll2, min, max;
+  double lon;
+  int x1, x2;
+  struct UTM utm;
+  gint band = vcl->labels ? coord_layer_label_height ( vp ) + 2 : 0;
+  gint every;
+  gchar buf[32];
 
-    utm = *center;
-    utm.northing = center->northing - ( ympp * height / 2 );
+  utm = *center;
+  utm.northing = center->northing - ( ympp * height / 2 );
 
-    a_coords_utm_to_latlon ( &utm, &ll );
+  a_coords_utm_to_latlon ( &utm, &ll );
 
-    utm.northing = center->northing + ( ympp * height / 2 );
+  utm.northing = center->northing + ( ympp * height / 2 );
 
-    a_coords_utm_to_latlon ( &utm, &ll2 );
+  a_coords_utm_to_latlon ( &utm, &ll2 );
 
-    {
-      /* find corner coords in lat/lon.
-        start at whichever is less: top or bottom left lon. goto whichever more: top or bottom right lon
-      */
-      struct LatLon topleft, topright, bottomleft, bottomright;
-      struct UTM temp_utm;
-      temp_utm = *center;
-      temp_utm.easting -= (width/2)*xmpp;
-      temp_utm.northing += (height/2)*ympp;
-      a_coords_utm_to_latlon ( &temp_utm, &topleft );
-      temp_utm.easting += (width*xmpp);
-      a_coords_utm_to_latlon ( &temp_utm, &topright );
-      temp_utm.northing -= (height*ympp);
-      a_coords_utm_to_latlon ( &temp_utm, &bottomright );
-      temp_utm.easting -= (width*xmpp);
-      a_coords_utm_to_latlon ( &temp_utm, &bottomleft );
-      min.lon = (topleft.lon < bottomleft.lon) ? topleft.lon : bottomleft.lon;
-      max.lon = (topright.lon > bottomright.lon) ? topright.lon : bottomright.lon;
-      min.lat = (bottomleft.lat < bottomright.lat) ? bottomleft.lat : bottomright.lat;
-      max.lat = (topleft.lat > topright.lat) ? topleft.lat : topright.lat;
+  {
+    /* find corner coords in lat/lon.
+      start at whichever is less: top or bottom left lon. goto whichever more: top or bottom right lon
+    */
+    struct LatLon topleft, topright, bottomleft, bottomright;
+    struct UTM temp_utm;
+    temp_utm = *center;
+    temp_utm.easting -= (width/2)*xmpp;
+    temp_utm.northing += (height/2)*ympp;
+    a_coords_utm_to_latlon ( &temp_utm, &topleft );
+    temp_utm.easting += (width*xmpp);
+    a_coords_utm_to_latlon ( &temp_utm, &topright );
+    temp_utm.northing -= (height*ympp);
+    a_coords_utm_to_latlon ( &temp_utm, &bottomright );
+    temp_utm.easting -= (width*xmpp);
+    a_coords_utm_to_latlon ( &temp_utm, &bottomleft );
+    min.lon = (topleft.lon < bottomleft.lon) ? topleft.lon : bottomleft.lon;
+    max.lon = (topright.lon > bottomright.lon) ? topright.lon : bottomright.lon;
+    min.lat = (bottomleft.lat < bottomright.lat) ? bottomleft.lat : bottomright.lat;
+    max.lat = (topleft.lat > topright.lat) ? topleft.lat : topright.lat;
+  }
+
+  /* Can zoom out more than whole world and so the above can give invalid positions */
+  /* Restrict values properly so drawing doesn't go into a near 'infinite' loop */
+  if ( min.lon < -180.0 )
+    min.lon = -180.0;
+  if ( max.lon > 180.0 )
+    max.lon = 180.0;
+  if ( min.lat < -90.0 )
+    min.lat = -90.0;
+  if ( max.lat > 90.0 )
+    max.lat = 90.0;
+
+  lon = ((double) ((long) ((min.lon)/ vcl->deg_inc))) * vcl->deg_inc;
+  ll.lon = ll2.lon = lon;
+
+  every = ( max.lon > min.lon ) ? coord_layer_label_every ( vcl->deg_inc * width / (max.lon - min.lon) ) : 0;
+  for (; ll.lon <= max.lon; ll.lon+=vcl->deg_inc, ll2.lon+=vcl->deg_inc )
+  {
+    a_coords_latlon_to_utm ( &ll, &utm );
+    x1 = ( (utm.easting - center->easting) / xmpp ) + (width / 2);
+    a_coords_latlon_to_utm ( &ll2, &utm );
+    x2 = ( (utm.easting - center->easting) / xmpp ) + (width / 2);
+    coord_layer_add_line ( vcl, x1, height, x2, 0, WEIGHT_MAJOR );
+    if ( vcl->labels && every && (long)round(ll2.lon/vcl->deg_inc) % every == 0 ) {
+      coord_layer_latlon_label ( ll2.lon, TRUE, vcl->deg_inc * 3600.0, buf, sizeof(buf) );
+      (void)coord_layer_add_label ( vcl, vp, x2+2, 1, buf, FALSE );
     }
+  }
 
-    /* Can zoom out more than whole world and so the above can give invalid positions */
-    /* Restrict values properly so drawing doesn't go into a near 'infinite' loop */
-    if ( min.lon < -180.0 )
-      min.lon = -180.0;
-    if ( max.lon > 180.0 )
-      max.lon = 180.0;
-    if ( min.lat < -90.0 )
-      min.lat = -90.0;
-    if ( max.lat > 90.0 )
-      max.lat = 90.0;
-
-    lon = ((double) ((long) ((min.lon)/ vcl->deg_inc))) * vcl->deg_inc;
-    ll.lon = ll2.lon = lon;
-
-    for (; ll.lon <= max.lon; ll.lon+=vcl->deg_inc, ll2.lon+=vcl->deg_inc )
-    {
-      a_coords_latlon_to_utm ( &ll, &utm );
-      x1 = ( (utm.easting - center->easting) / xmpp ) + (width / 2);
-      a_coords_latlon_to_utm ( &ll2, &utm );
-      x2 = ( (utm.easting - center->easting) / xmpp ) + (width / 2);
-      vik_viewport_draw_line (vp, vcl->gc, x1, height, x2, 0, &(vcl->color), vcl->line_thickness);
+  utm = *center;
+  utm.easting = center->easting - ( xmpp * width / 2 );
+
+  a_coords_utm_to_latlon ( &utm, &ll );
+
+  utm.easting = center->easting + ( xmpp * width / 2 );
+
+  a_coords_utm_to_latlon ( &utm, &ll2 );
+
+  /* really lat, just reusing a variable */
+  lon = ((double) ((long) ((min.lat)/ vcl->deg_inc))) * vcl->deg_inc;
+  ll.lat = ll2.lat = lon;
+
+  every = ( max.lat > min.lat ) ? coord_layer_label_every ( vcl->deg_inc * height / (max.lat - min.lat) ) : 0;
+  for (; ll.lat <= max.lat ; ll.lat+=vcl->deg_inc, ll2.lat+=vcl->deg_inc )
+  {
+    a_coords_latlon_to_utm ( &ll, &utm );
+    x1 = (height / 2) - ( (utm.northing - center->northing) / ympp );
+    a_coords_latlon_to_utm ( &ll2, &utm );
+    x2 = (height / 2) - ( (utm.northing - center->northing) / ympp );
+    coord_layer_add_line ( vcl, width, x2, 0, x1, WEIGHT_MAJOR );
+    if ( vcl->labels && every && x1 >= band && (long)round(ll.lat/vcl->deg_inc) % every == 0 ) {
+      coord_layer_latlon_label ( ll.lat, FALSE, vcl->deg_inc * 3600.0, buf, sizeof(buf) );
+      (void)coord_layer_add_label ( vcl, vp, 2, x1+1, buf, FALSE );
     }
+  }
+}
 
-    utm = *center;
-    utm.easting = center->easting - ( xmpp * width / 2 );
+static void coord_layer_utm_to_screen ( VikViewport *vp, const struct UTM *utm, gint *x, gint *y )
+{
+  VikCoord coord;
+  vik_coord_load_from_utm ( &coord, vik_viewport_get_coord_mode(vp), utm );
+  vik_viewport_coord_to_screen ( vp, &coord, x, y );
+}
+
+/**
+ * Kilometres for UTM, or just the digits within the 100km square for MGRS
+ * Returns FALSE when there is nothing to show
+ */
+static gboolean coord_layer_utm_label ( VikCoordLayer *vcl, gdouble value, gdouble spacing, gchar *buf, gsize size )
+{
+  // Grid continued over the equator from the other hemisphere
+  if ( value < 0.0 )
+    value += 10000000.0;
+  else if ( value >= 10000000.0 )
+    value -= 10000000.0;
+
+  if ( vcl->grid == GRID_MGRS ) {
+    gint digits = (gint)round ( log10(100000.0 / spacing) );
+    if ( digits < 1 )
+      return FALSE;
+    g_snprintf ( buf, size, "%0*d", digits, (gint)round(fmod(value, 100000.0) / spacing) );
+  }
+  else if ( spacing < 1000.0 )
+    g_snprintf ( buf, size, "%.1f", value / 1000.0 );
+  else
+    g_snprintf ( buf, size, "%d", (gint)round(value / 1000.0) );
+  return TRUE;
+}
 
-    a_coords_utm_to_latlon ( &utm, &ll );
+/**
+ * UTM or MGRS grid lines, in the zone of the center of the viewport
+ *  and continued into any neighbouring zones in view
+ */
+static void coord_layer_make_utm ( VikCoordLayer *vcl, VikViewport *vp )
+{
+  gint width = vik_viewport_get_width ( vp );
+  gint height = vik_viewport_get_height ( vp );
+  VikCoord coord, coord2;
+  struct LatLon ll;
+  struct UTM center, utm;
+  gchar buf[32];
+
+  vik_viewport_screen_to_coord ( vp, width/2, height/2, &coord );
+  vik_coord_to_latlon ( &coord, &ll );
+  // The UTM system doesn't cover the poles
+  if ( ll.lat < -80.0 || ll.lat > 84.0 )
+    return;
+  if ( coord.mode == VIK_COORD_UTM )
+    a_coords_latlon_to_utm_zone ( &ll, coord.utm_zone, &center );
+  else
+    a_coords_latlon_to_utm ( &ll, &center );
+  gboolean south = ll.lat < 0.0;
+
+  // Measured on the ground, as the viewport's metres per pixel are only nominal in the Lat/Lon based modes
+  vik_viewport_screen_to_coord ( vp, width/2 + 100, height/2, &coord2 );
+  gdouble mpp = vik_coord_diff ( &coord, &coord2 ) / 100.0;
+  if ( mpp <= 0.0 )
+    return;
+  gdouble spacing = 100.0;
+  while ( spacing < 100000.0 && spacing / mpp < GRID_MIN_SPACING )
+    spacing *= 10.0;
+
+  // Extent of the view in the grid's zone, from the corners and the middle of each side
+  gdouble emin = G_MAXDOUBLE, emax = -G_MAXDOUBLE, nmin = G_MAXDOUBLE, nmax = -G_MAXDOUBLE;
+  for ( guint ii = 0; ii < 9; ii++ ) {
+    vik_viewport_screen_to_coord ( vp, (ii % 3) * width / 2, (ii / 3) * height / 2, &coord );
+    vik_coord_to_latlon ( &coord, &ll );
+    ll.lat = CLAMP ( ll.lat, -80.0, 84.0 );
+    a_coords_latlon_to_utm_zone ( &ll, center.zone, &utm );
+    // Keep northings continuous across the equator
+    if ( south && ll.lat >= 0.0 )
+      utm.northing += 10000000.0;
+    else if ( !south && ll.lat < 0.0 )
+      utm.northing -= 10000000.0;
+    emin = MIN ( emin, utm.easting );
+    emax = MAX ( emax, utm.easting );
+    nmin = MIN ( nmin, utm.northing );
+    nmax = MAX ( nmax, utm.northing );
+  }
+  if ( (emax - emin) / spacing > GRID_MAX_LINES || (nmax - nmin) / spacing > GRID_MAX_LINES )
+    return;
 
-    utm.easting = center->easting + ( xmpp * width / 2 );
+  gint band = 0, reserved = 0;
+  if ( vcl->labels ) {
+    band = coord_layer_label_height ( vp ) + 2;
+    g_snprintf ( buf, sizeof(buf), "%d%c", center.zone, center.letter );
+    reserved = coord_layer_add_label ( vcl, vp, 2, 1, buf, FALSE ) + 6;
+  }
+  gint every = coord_layer_label_every ( spacing / mpp );
+
+  utm = center;
+  for ( gdouble ee = ceil(emin/spacing)*spacing; ee <= emax; ee += spacing ) {
+    guint8 weight = fmod(ee, 100000.0) == 0.0 ? WEIGHT_MAJOR : fmod(ee, spacing*10.0) == 0.0 ? WEIGHT_MINOR : WEIGHT_FINE;
+    gint x1 = 0, y1 = 0, x2, y2;
+    gint label_x = G_MININT;
+    for ( guint seg = 0; seg <= GRID_SEGMENTS; seg++ ) {
+      utm.easting = ee;
+      utm.northing = nmax - (nmax - nmin) * seg / GRID_SEGMENTS;
+      coord_layer_utm_to_screen ( vp, &utm, &x2, &y2 );
+      if ( seg > 0 ) {
+        coord_layer_add_line ( vcl, x1, y1, x2, y2, weight );
+        // Where it crosses the top
+        if ( y1 <= 0 && y2 > 0 )
+          label_x = x1 + (x2 - x1) * (0 - y1) / (y2 - y1);
+      }
+      x1 = x2;
+      y1 = y2;
+    }
+    if ( vcl->labels && every && label_x > reserved && (gint64)round(ee/spacing) % every == 0 )
+      if ( coord_layer_utm_label ( vcl, ee, spacing, buf, sizeof(buf) ) )
+        (void)coord_layer_add_label ( vcl, vp, label_x+2, 1, buf, FALSE );
+  }
 
-    a_coords_utm_to_latlon ( &utm, &ll2 );
+  for ( gdouble nn = ceil(nmin/spacing)*spacing; nn <= nmax; nn += spacing ) {
+    guint8 weight = fmod(nn, 100000.0) == 0.0 ? WEIGHT_MAJOR : fmod(nn, spacing*10.0) == 0.0 ? WEIGHT_MINOR : WEIGHT_FINE;
+    gint x1 = 0, y1 = 0, x2, y2;
+    gint label_y = G_MININT;
+    for ( guint seg = 0; seg <= GRID_SEGMENTS; seg++ ) {
+      utm.easting = emin + (emax - emin) * seg / GRID_SEGMENTS;
+      utm.northing = nn;
+      coord_layer_utm_to_screen ( vp, &utm, &x2, &y2 );
+      if ( seg > 0 ) {
+        coord_layer_add_line ( vcl, x1, y1, x2, y2, weight );
+        // Where it crosses the left side
+        if ( x1 <= 0 && x2 > 0 )
+          label_y = y1 + (y2 - y1) * (0 - x1) / (x2 - x1);
+      }
+      x1 = x2;
+      y1 = y2;
+    }
+    if ( vcl->labels && every && label_y >= band && (gint64)round(nn/spacing) % every == 0 )
+      if ( coord_layer_utm_label ( vcl, nn, spacing, buf, sizeof(buf) ) )
+        (void)coord_layer_add_label ( vcl, vp, 2, label_y+1, buf, FALSE );
+  }
 
-    /* really lat, just reusing a variable */
-    lon = ((double) ((long) ((min.lat)/ vcl->deg_inc))) * vcl->deg_inc;
-    ll.lat = ll2.lat = lon;
+  if ( !vcl->labels || vcl->grid != GRID_MGRS )
+    return;
 
-    for (; ll.lat <= max.lat ; ll.lat+=vcl->deg_inc, ll2.lat+=vcl->deg_inc )
-    {
-      a_coords_latlon_to_utm ( &ll, &utm );
-      x1 = (height / 2) - ( (utm.northing - center->northing) / ympp );
-      a_coords_latlon_to_utm ( &ll2, &utm );
-      x2 = (height / 2) - ( (utm.northing - center->northing) / ympp );
-      vik_viewport_draw_line (vp, vcl->gc, width, x2, 0, x1, &(vcl->color), vcl->line_thickness);
+  // Identify each 100km square in the middle of the part of it on screen
+  gdouble e0 = floor ( emin / 100000.0 ), n0 = floor ( nmin / 100000.0 );
+  gdouble e1 = floor ( emax / 100000.0 ), n1 = floor ( nmax / 100000.0 );
+  if ( (e1 - e0 + 1) * (n1 - n0 + 1) > 100 )
+    return;
+  for ( gdouble ee = e0 * 100000.0; ee <= emax; ee += 100000.0 ) {
+    for ( gdouble nn = n0 * 100000.0; nn <= nmax; nn += 100000.0 ) {
+      gint x, y;
+      utm.easting = ( MAX(ee, emin) + MIN(ee + 100000.0, emax) ) / 2;
+      utm.northing = ( MAX(nn, nmin) + MIN(nn + 100000.0, nmax) ) / 2;
+      a_coords_utm_to_mgrs_square ( &utm, buf );
+      coord_layer_utm_to_screen ( vp, &utm, &x, &y );
+      (void)coord_layer_add_label ( vcl, vp, x, y, buf, TRUE );
     }
   }
 }
 
+static void coord_layer_make ( VikCoordLayer *vcl, VikViewport *vp )
+{
+  coord_layer_cache_clear ( vcl );
+
+  if ( vcl->grid != GRID_LATLON )
+    coord_layer_make_utm ( vcl, vp );
+  else if ( vik_viewport_get_coord_mode(vp) != VIK_COORD_UTM )
+    coord_layer_make_latlon ( vcl, vp );
+  else
+    coord_layer_make_latlon_utm ( vcl, vp );
+
+  vcl->cache_center = *vik_viewport_get_center ( vp );
+  vcl->cache_xmpp = vik_viewport_get_xmpp ( vp );
+  vcl->cache_ympp = vik_viewport_get_ympp ( vp );
+  vcl->cache_width = vik_viewport_get_width ( vp );
+  vcl->cache_height = vik_viewport_get_height ( vp );
+  vcl->cache_drawmode = vik_viewport_get_drawmode ( vp );
+  vcl->cache_valid = TRUE;
+}
+
+static void coord_layer_draw ( VikCoordLayer *vcl, VikViewport *vp )
+{
+  if ( !vcl->gc[WEIGHT_MAJOR] ) {
+    return;
+  }
+
+  // When only a section is being drawn (e.g. a scroll strip or a print band),
+  //  the grid and the edge labels are still those of the whole view,
+  //  which are then drawn offset into the section
+  GdkRectangle section = { 0, 0, vik_viewport_get_width(vp), vik_viewport_get_height(vp) };
+  gboolean in_section = vik_viewport_get_section ( vp, &section );
+  if ( in_section )
+    vik_viewport_section_end ( vp );
+  if ( !coord_layer_cache_matches ( vcl, vp ) )
+    coord_layer_make ( vcl, vp );
+  if ( in_section )
+    vik_viewport_section_begin ( vp, &section );
+
+  guint8 thickness[NUM_WEIGHTS] = { vcl->line_thickness, MAX(vcl->line_thickness/2, 1), MAX(vcl->line_thickness/5, 1) };
+  for ( guint ii = 0; ii < vcl->lines->len; ii++ ) {
+    CoordLine *line = &g_array_index ( vcl->lines, CoordLine, ii );
+    if ( MAX(line->x1, line->x2) < section.x || MIN(line->x1, line->x2) > section.x + section.width ||
+         MAX(line->y1, line->y2) < section.y || MIN(line->y1, line->y2) > section.y + section.height )
+      continue;
+    vik_viewport_draw_line ( vp, vcl->gc[line->weight],
+                             line->x1 - section.x, line->y1 - section.y, line->x2 - section.x, line->y2 - section.y,
+                             &vcl->color, thickness[line->weight] );
+  }
+
+  for ( guint ii = 0; ii < vcl->label_list->len; ii++ ) {
+    CoordLabel *label = &g_array_index ( vcl->label_list, CoordLabel, ii );
+    if ( label->x + label->w < section.x || label->x > section.x + section.width ||
+         label->y + label->h < section.y || label->y > section.y + section.height )
+      continue;
+    gint xx = label->x - section.x;
+    gint yy = label->y - section.y;
+    vik_viewport_draw_rectangle ( vp, vcl->bg_gc, TRUE, xx-1, yy, label->w+2, label->h, &vcl->bg_color );
+    vik_viewport_draw_layout ( vp, vcl->gc[WEIGHT_MAJOR], xx, yy, label->pl, &vcl->color );
+  }
+}
+
+static void coord_layer_free_gc ( VikCoordLayer *vcl )
+{
+  for ( guint ii = 0; ii < NUM_WEIGHTS; ii++ ) {
+    if ( vcl->gc[ii] != NULL )
+      ui_gc_unref ( vcl->gc[ii] );
+    vcl->gc[ii] = NULL;
+  }
+  if ( vcl->bg_gc != NULL )
+    ui_gc_unref ( vcl->bg_gc );
+  vcl->bg_gc = NULL;
+}
+
 static void coord_layer_free ( VikCoordLayer *vcl )
 {
-  if ( vcl->gc != NULL )
-    ui_gc_unref ( vcl->gc );
+  coord_layer_free_gc ( vcl );
+  coord_layer_cache_clear ( vcl );
+  g_array_free ( vcl->lines, TRUE );
+  g_array_free ( vcl->label_list, TRUE );
 }
 
 static void coord_layer_update_gc ( VikCoordLayer *vcl, VikViewport *vp )
 {
-  if ( vcl->gc )
-    ui_gc_unref ( vcl->gc );
-  vcl->gc = vik_viewport_new_gc_from_color ( vp, &(vcl->color), vcl->line_thickness );
+  coord_layer_free_gc ( vcl );
+  vcl->gc[WEIGHT_MAJOR] = vik_viewport_new_gc_from_color ( vp, &(vcl->color), vcl->line_thickness );
+  vcl->gc[WEIGHT_MINOR] = vik_viewport_new_gc_from_color ( vp, &(vcl->color), MAX(vcl->line_thickness/2, 1) );
+  vcl->gc[WEIGHT_FINE] = vik_viewport_new_gc_from_color ( vp, &(vcl->color), MAX(vcl->line_thickness/5, 1) );
+  (void)gdk_color_parse ( "white", &vcl->bg_color );
+  vcl->bg_gc = vik_viewport_new_gc_from_color ( vp, &(vcl->bg_color), 1 );
+  // e.g. fonts may have changed
+  vcl->cache_valid = FALSE;
 }
 
 static VikCoordLayer *coord_layer_create ( VikViewport *vp )
@@ -37,6 +37,9 @@
 #include "dem.h"
 #include "dems.h"
 #include "bbox.h"
+#include "mapcache.h"
+#include "maputils.h"
+#include "map_ids.h"
 
 #define DEM_FIXED_NAME "DEM"
 #define MAPS_CACHE_DIR maps_layer_default_dir()
@@ -365,7 +368,8 @@ struct _VikDEMLayer {
   GdkColor *height_colors;
   GdkColor *gradient_colors;
 
-  guchar *pixels;
+  guint id; // Unique in this process, unlike the address which may be reused after a free
+  gint render_id; // Changed whenever the drawn result would be different (atomic)
 
   // right click menu only stuff - similar to mapslayer
   GtkMenu *right_click_menu;
@@ -406,10 +410,17 @@ void vik_dem_layer_init ()
 
 static GdkColor black_color;
 
+static GMutex *tp_mutex;
+static GHashTable *requests = NULL;
+
 // NB Only performed once per program run
 static void vik_dem_class_init ( VikDEMLayerClass *klass )
 {
   gdk_color_parse ( "#000000", &black_color );
+
+  tp_mutex = vik_mutex_new();
+  // Just storing keys only
+  requests = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
 }
 
 #define VIK_SETTINGS_DEM_USERNAME "dem_basic_auth_username"
@@ -497,8 +508,10 @@ static int dem_layer_load_list_thread ( dem_load_thread_data *dltd, gpointer thr
   // ATM as each file is processed the screen is not updated (no mechanism exposed to a_dems_load_list)
   // Thus force draw only at the end, as loading is complete/aborted
   // Test is helpful to prevent Gtk-CRITICAL warnings if the program is exitted whilst loading
-  if ( IS_VIK_LAYER(dltd->vdl) )
+  if ( IS_VIK_LAYER(dltd->vdl) ) {
+    g_atomic_int_inc ( &dltd->vdl->render_id );
     vik_layer_emit_update ( VIK_LAYER(dltd->vdl), FALSE ); // NB update requested from background thread
+  }
 
   return result;
 }
@@ -635,6 +648,7 @@ gboolean dem_layer_set_param ( VikDEMLayer *vdl, VikLayerSetParam *vlsp )
       vdl->files = vlsp->data.sl;
       // Ensure resolving of any relative path names
       util_make_absolute_filenames ( vdl->files, vlsp->dirpath );
+      g_atomic_int_inc ( &vdl->render_id );
 
       // No need for thread if no files
       if ( vdl->files ) {
@@ -789,6 +803,8 @@ static void dem_layer_apply_colors ( VikDEMLayer *vdl )
       vdl->gradient_colors[ii] = color;
     }
   }
+  // Any previously rendered tiles are no longer applicable
+  g_atomic_int_inc ( &vdl->render_id );
 }
 
 static void dem_layer_post_read ( VikDEMLayer *vdl, VikViewport *vp, gboolean from_file )
@@ -802,6 +818,8 @@ static VikDEMLayer *dem_layer_new ( VikViewport *vvp )
 
   vik_layer_set_type ( VIK_LAYER(vdl), VIK_LAYER_DEM );
 
+  static guint ids = 0;
+  vdl->id = ++ids;
   vdl->files = NULL;
 
   vdl->height_colors = g_malloc0 ( sizeof(GdkColor) * DEM_N_HEIGHT_COLORS );
@@ -845,51 +863,73 @@ static inline void pixels_set_area ( guchar* pixels, GdkColor gcolor, guint alph
   }
 }
 
-static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *dem )
+/**
+ * Where the DEM is to be drawn:
+ *  either directly into the viewport or into a Mercator map tile
+ * The tile version has no reliance on the viewport,
+ *  so can be used in a background thread.
+ */
+typedef struct {
+  VikViewport *vp;        // NULL for a tile
+  LatLonBBox bbox;
+  guint width, height;    // Pixels
+  gdouble xmpp;
+  gdouble merc_north;     // Tile only
+  gdouble merc_south;     // Tile only
+} DEMRenderArea;
+
+static void dem_area_latlon_to_screen ( const DEMRenderArea *area, const struct LatLon *ll, gint *x, gint *y )
+{
+  if ( area->vp ) {
+    VikCoord tmp;
+    vik_coord_load_from_latlon ( &tmp, vik_viewport_get_coord_mode(area->vp), ll );
+    vik_viewport_coord_to_screen ( area->vp, &tmp, x, y );
+  }
+  else {
+    *x = (gint)floor ( (ll->lon - area->bbox.west) * area->width / (area->bbox.east - area->bbox.west) );
+    *y = (gint)floor ( (area->merc_north - MERCLAT(ll->lat)) * area->height / (area->merc_north - area->merc_south) );
+  }
+}
+
+static void dem_area_utm_to_screen ( const DEMRenderArea *area, const struct UTM *utm, gint *x, gint *y )
+{
+  if ( area->vp ) {
+    VikCoord tmp;
+    vik_coord_load_from_utm ( &tmp, vik_viewport_get_coord_mode(area->vp), utm );
+    vik_viewport_coord_to_screen ( area->vp, &tmp, x, y );
+  }
+  else {
+    struct LatLon ll;
+    a_coords_utm_to_latlon ( utm, &ll );
+    dem_area_latlon_to_screen ( area, &ll, x, y );
+  }
+}
+
+/**
+ * Draw the DEM values into the RGBA pixels of the area
+ */
+static void dem_render_dem ( VikDEMLayer *vdl, const DEMRenderArea *area, VikDEM *dem, guchar *pixels )
 {
   VikDEMColumn *column, *prevcolumn, *nextcolumn;
 
-  LatLonBBox vp_bbox = vik_viewport_get_bbox ( vp );
   LatLonBBox dem_bbox = vik_dem_get_bbox ( dem );
 
-  /**** Check if viewport and DEM data overlap ****/
-  if ( ! BBOX_INTERSECT(dem_bbox, vp_bbox) ) {
+  /**** Check if area and DEM data overlap ****/
+  if ( ! BBOX_INTERSECT(dem_bbox, area->bbox) ) {
     return;
   }
 
-  const guint width = vik_viewport_get_width ( vp );
-  const guint height = vik_viewport_get_height ( vp );
-
-  /* boxes to show where we have DEM instead of actually drawing the DEM.
-   * useful if we want to see what areas we have coverage for (if we want
-   * to get elevation data for a track) but don't want to cover the map.
-   */
+  const guint width = area->width;
+  const guint height = area->height;
 
-  #if 0
-  /* draw a box if a DEM is loaded. in future I'd like to add an option for this
-   * this is useful if we want to see what areas we have dem for but don't want to
-   * cover the map (or maybe we just need translucent DEM?) */
-  {
-    VikCoord demne, demsw;
-    gint x1, y1, x2, y2;
-    vik_coord_load_from_latlon(&demne, vik_viewport_get_coord_mode(vp), &dem_northeast);
-    vik_coord_load_from_latlon(&demsw, vik_viewport_get_coord_mode(vp), &dem_southwest);
-
-    vik_viewport_coord_to_screen ( vp, &demne, &x1, &y1 );
-    vik_viewport_coord_to_screen ( vp, &demsw, &x2, &y2 );
-
-    if ( x1 > vik_viewport_get_width(vp) ) x1=vik_viewport_get_width(vp);
-    if ( y2 > vik_viewport_get_height(vp) ) y2=vik_viewport_get_height(vp);
-    if ( x2 < 0 ) x2 = 0;
-    if ( y1 < 0 ) y1 = 0;
-    vik_viewport_draw_rectangle ( vp, vik_viewport_get_black_gc(vp), FALSE, x2, y1, x1-x2, y2-y1 );
-    return;
-  }
-  #endif
+  // Use a local copy, as the layer's values may be changed whilst rendering in the background
+  gdouble min_elev = vdl->min_elev;
+  gdouble max_elev = vdl->max_elev;
+  /* verify sane elev interval */
+  if ( max_elev <= min_elev )
+    max_elev = min_elev + 1;
 
   if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
-    VikCoord tmp; /* TODO: don't use coord_load_from_latlon, especially if in latlon drawing mode */
-
     gdouble max_lat_as, max_lon_as, min_lat_as, min_lon_as;  
     gdouble start_lat_as, end_lat_as, start_lon_as, end_lon_as;
 
@@ -901,15 +941,15 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 
     gint16 elev;
 
-    guint skip_factor = ceil ( vik_viewport_get_xmpp(vp) / 80 ); /* todo: smarter calculation. */
+    guint skip_factor = ceil ( area->xmpp / 80 ); /* todo: smarter calculation. */
 
     gdouble nscale_deg = dem->north_scale / ((gdouble) 3600);
     gdouble escale_deg = dem->east_scale / ((gdouble) 3600);
 
-    max_lat_as = vp_bbox.north * 3600;
-    min_lat_as = vp_bbox.south * 3600;
-    max_lon_as = vp_bbox.east * 3600;
-    min_lon_as = vp_bbox.west * 3600;
+    max_lat_as = area->bbox.north * 3600;
+    min_lat_as = area->bbox.south * 3600;
+    max_lon_as = area->bbox.east * 3600;
+    min_lon_as = area->bbox.west * 3600;
 
     start_lat_as = MAX(min_lat_as, dem->min_north);
     end_lat_as   = MIN(max_lat_as, dem->max_north);
@@ -922,14 +962,20 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
     end_lon   = ceil (end_lon_as / dem->east_scale) * escale_deg;
 
     vik_dem_east_north_to_xy ( dem, start_lon_as, start_lat_as, &start_x, &start_y );
+
+    // Keep to the same samples whatever the extent of the area,
+    //  otherwise adjacent tiles (or a panned viewport) would show a different selection of values
+    guint shift = start_x % skip_factor;
+    start_x -= shift;
+    start_lon -= shift * escale_deg;
+    shift = start_y % skip_factor;
+    start_y -= shift;
+    start_lat -= shift * nscale_deg;
+
     guint gradient_skip_factor = 1;
     if(vdl->type == DEM_TYPE_GRADIENT)
 	    gradient_skip_factor = skip_factor;
 
-    /* verify sane elev interval */
-    if ( vdl->max_elev <= vdl->min_elev )
-      vdl->max_elev = vdl->min_elev + 1;
-
     for ( x=start_x, counter.lon = start_lon; counter.lon <= end_lon+escale_deg*skip_factor; counter.lon += escale_deg * skip_factor, x += skip_factor ) {
       // NOTE: ( counter.lon <= end_lon + ESCALE_DEG*SKIP_FACTOR ) is neccessary so in high zoom modes,
       // the leftmost column does also get drawn, if the center point is out of viewport.
@@ -950,7 +996,7 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
           nextcolumn = g_ptr_array_index ( dem->columns, new_x);
 
         for ( y=start_y, counter.lat = start_lat; counter.lat <= end_lat; counter.lat += nscale_deg * skip_factor, y += skip_factor ) {
-          if ( y > column->n_points )
+          if ( y >= column->n_points )
             break;
 
           elev = column->points[y];
@@ -961,8 +1007,7 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 	  box_c = counter;
 	  box_c.lat += (nscale_deg * skip_factor)/2;
           box_c.lon -= (escale_deg * skip_factor)/2;
-	  vik_coord_load_from_latlon(&tmp, vik_viewport_get_coord_mode(vp), &box_c);
-	  vik_viewport_coord_to_screen(vp, &tmp, &box_x, &box_y);
+	  dem_area_latlon_to_screen ( area, &box_c, &box_x, &box_y );
 	  // catch box at borders
 	  if(box_x < 0)
             box_x = 0;
@@ -970,8 +1015,7 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
             box_y = 0;
           box_c.lat -= nscale_deg * skip_factor;
 	  box_c.lon += escale_deg * skip_factor;
-	  vik_coord_load_from_latlon(&tmp, vik_viewport_get_coord_mode(vp), &box_c);
-	  vik_viewport_coord_to_screen(vp, &tmp, &box_width, &box_height);
+	  dem_area_latlon_to_screen ( area, &box_c, &box_width, &box_height );
 	  box_width -= box_x;
 	  box_height -= box_y;
           // catch box at borders
@@ -983,15 +1027,21 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
           if ( (box_x > width) || (box_y > height) )
             continue;
 
+          // Draw to edge
+          if ( ((box_x + box_width) > width) )
+            box_width = width - box_x;
+          if ( ((box_y + box_height) > height) )
+            box_height = height - box_y;
+
           gboolean minimum_level = FALSE;
           if(vdl->type == DEM_TYPE_HEIGHT) {
-            if ( elev != VIK_DEM_INVALID_ELEVATION && elev <= vdl->min_elev ) {
-              // Prevent 'elev - vdl->min_elev' from being negative so can safely use as array index
-              elev = ceil ( vdl->min_elev );
+            if ( elev != VIK_DEM_INVALID_ELEVATION && elev <= min_elev ) {
+              // Prevent 'elev - min_elev' from being negative so can safely use as array index
+              elev = ceil ( min_elev );
               minimum_level = TRUE;
 	    }
-            if ( elev != VIK_DEM_INVALID_ELEVATION && elev > vdl->max_elev )
-              elev = vdl->max_elev;
+            if ( elev != VIK_DEM_INVALID_ELEVATION && elev > max_elev )
+              elev = max_elev;
           }
 
           {
@@ -1029,36 +1079,30 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 
 		change = change / ((skip_factor > 1) ? log(skip_factor) : 0.55); // FIXME: better calc.
 
-                if(change < vdl->min_elev)
-                  // Prevent 'change - vdl->min_elev' from being negative so can safely use as array index
-                  change = ceil ( vdl->min_elev );
+                if(change < min_elev)
+                  // Prevent 'change - min_elev' from being negative so can safely use as array index
+                  change = ceil ( min_elev );
 
-                if(change > vdl->max_elev)
-                  change = vdl->max_elev;
+                if(change > max_elev)
+                  change = max_elev;
 
-                if ( ((box_x + box_width) > width) )
-                  box_width = width - box_x;
-
-                guint index = (gint)floor(((change - vdl->min_elev)/(vdl->max_elev - vdl->min_elev))*(DEM_N_GRADIENT_COLORS-2))+1;
+                guint index = (gint)floor(((change - min_elev)/(max_elev - min_elev))*(DEM_N_GRADIENT_COLORS-2))+1;
                 GdkColor gcolor = vdl->gradient_colors[index];
-                pixels_set_area ( vdl->pixels, gcolor, vdl->alpha, width, box_x, box_y, box_width, box_height );
+                pixels_set_area ( pixels, gcolor, vdl->alpha, width, box_x, box_y, box_width, box_height );
               }
             } else {
               if(vdl->type == DEM_TYPE_HEIGHT) {
                 if ( elev == VIK_DEM_INVALID_ELEVATION )
                   continue; /* don't draw it */
-                // Draw to edge
-                if ( ((box_x + box_width) > width) )
-                  box_width = width - box_x;
                 GdkColor gcolor;
                 /* If 'sea' colour or below the defined mininum draw in the configurable colour */
                 if ( minimum_level )
                   gcolor = vdl->color;
                 else {
-                  guint index = (gint)floor(((elev - vdl->min_elev)/(vdl->max_elev - vdl->min_elev))*(DEM_N_HEIGHT_COLORS-2))+1;
+                  guint index = (gint)floor(((elev - min_elev)/(max_elev - min_elev))*(DEM_N_HEIGHT_COLORS-2))+1;
                   gcolor = vdl->height_colors[index];
                 }
-                pixels_set_area ( vdl->pixels, gcolor, vdl->alpha, width, box_x, box_y, box_width, box_height );
+                pixels_set_area ( pixels, gcolor, vdl->alpha, width, box_x, box_y, box_width, box_height );
               }
             }
           }
@@ -1073,40 +1117,38 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
 
     guint x, y, start_x, start_y;
 
-    VikCoord tmp; /* TODO: don't use coord_load_from_latlon, especially if in latlon drawing mode */
     struct UTM counter;
 
-    guint skip_factor = ceil ( vik_viewport_get_xmpp(vp) / 10 ); /* todo: smarter calculation. */
-
-    VikCoord tleft, tright, bleft, bright;
-
-    vik_viewport_screen_to_coord ( vp, 0, 0, &tleft );
-    vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), 0, &tright );
-    vik_viewport_screen_to_coord ( vp, 0, vik_viewport_get_height(vp), &bleft );
-    vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), vik_viewport_get_height(vp), &bright );
+    guint skip_factor = ceil ( area->xmpp / 10 ); /* todo: smarter calculation. */
 
+    struct UTM tleft, tright, bleft, bright;
+    struct LatLon ll;
 
-    vik_coord_convert(&tleft, VIK_COORD_UTM);
-    vik_coord_convert(&tright, VIK_COORD_UTM);
-    vik_coord_convert(&bleft, VIK_COORD_UTM);
-    vik_coord_convert(&bright, VIK_COORD_UTM);
+    ll.lat = area->bbox.north; ll.lon = area->bbox.west;
+    a_coords_latlon_to_utm ( &ll, &tleft );
+    ll.lat = area->bbox.north; ll.lon = area->bbox.east;
+    a_coords_latlon_to_utm ( &ll, &tright );
+    ll.lat = area->bbox.south; ll.lon = area->bbox.west;
+    a_coords_latlon_to_utm ( &ll, &bleft );
+    ll.lat = area->bbox.south; ll.lon = area->bbox.east;
+    a_coords_latlon_to_utm ( &ll, &bright );
 
-    max_nor = MAX(tleft.north_south, tright.north_south);
-    min_nor = MIN(bleft.north_south, bright.north_south);
-    max_eas = MAX(bright.east_west, tright.east_west);
-    min_eas = MIN(bleft.east_west, tleft.east_west);
+    max_nor = MAX(tleft.northing, tright.northing);
+    min_nor = MIN(bleft.northing, bright.northing);
+    max_eas = MAX(bright.easting, tright.easting);
+    min_eas = MIN(bleft.easting, tleft.easting);
 
     start_nor = MAX(min_nor, dem->min_north);
     end_nor   = MIN(max_nor, dem->max_north);
-    if ( tleft.utm_zone == dem->utm_zone && bleft.utm_zone == dem->utm_zone
-         && (tleft.utm_letter >= 'N') == (dem->utm_letter >= 'N')
-         && (bleft.utm_letter >= 'N') == (dem->utm_letter >= 'N') ) /* if the utm zones/hemispheres are different, min_eas will be bogus */
+    if ( tleft.zone == dem->utm_zone && bleft.zone == dem->utm_zone
+         && (tleft.letter >= 'N') == (dem->utm_letter >= 'N')
+         && (bleft.letter >= 'N') == (dem->utm_letter >= 'N') ) /* if the utm zones/hemispheres are different, min_eas will be bogus */
       start_eas = MAX(min_eas, dem->min_east);
     else
       start_eas = dem->min_east;
-    if ( tright.utm_zone == dem->utm_zone && bright.utm_zone == dem->utm_zone
-         && (tright.utm_letter >= 'N') == (dem->utm_letter >= 'N')
-         && (bright.utm_letter >= 'N') == (dem->utm_letter >= 'N') ) /* if the utm zones/hemispheres are different, min_eas will be bogus */
+    if ( tright.zone == dem->utm_zone && bright.zone == dem->utm_zone
+         && (tright.letter >= 'N') == (dem->utm_letter >= 'N')
+         && (bright.letter >= 'N') == (dem->utm_letter >= 'N') ) /* if the utm zones/hemispheres are different, min_eas will be bogus */
       end_eas = MIN(max_eas, dem->max_east);
     else
       end_eas = dem->max_east;
@@ -1127,30 +1169,29 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
       if ( x >= 0 && x < dem->n_columns ) {
         column = g_ptr_array_index ( dem->columns, x );
         for ( y=start_y, counter.northing = start_nor; counter.northing <= end_nor; counter.northing += dem->north_scale * skip_factor, y += skip_factor ) {
-          if ( y > column->n_points )
+          if ( y >= column->n_points )
             continue;
           elev = column->points[y];
-          if ( elev != VIK_DEM_INVALID_ELEVATION && elev < vdl->min_elev )
-            elev=vdl->min_elev;
-          if ( elev != VIK_DEM_INVALID_ELEVATION && elev > vdl->max_elev )
-            elev=vdl->max_elev;
+          if ( elev != VIK_DEM_INVALID_ELEVATION && elev < min_elev )
+            elev=min_elev;
+          if ( elev != VIK_DEM_INVALID_ELEVATION && elev > max_elev )
+            elev=max_elev;
 
           {
             gint a, b;
-            vik_coord_load_from_utm(&tmp, vik_viewport_get_coord_mode(vp), &counter);
-            vik_viewport_coord_to_screen(vp, &tmp, &a, &b);
-            // Check a & b are in bounds:
-            if ( a < 0 || b < 0 || (a > width) || (b > height) )
+            dem_area_utm_to_screen ( area, &counter, &a, &b );
+            // Check the 2x2 dot is in bounds:
+            if ( a < 1 || b < 1 || (a >= width) || (b >= height) )
               continue;
             if ( elev == VIK_DEM_INVALID_ELEVATION )
               ; /* don't draw it */
             else if ( elev <= 0 ) {
-              pixels_set_area ( vdl->pixels, vdl->color, vdl->alpha, width, a-1, b-1, 2, 2 );
+              pixels_set_area ( pixels, vdl->color, vdl->alpha, width, a-1, b-1, 2, 2 );
             }
             else {
-              guint index = (gint)floor((elev - vdl->min_elev)/(vdl->max_elev - vdl->min_elev)*(DEM_N_HEIGHT_COLORS-2))+1;
+              guint index = (gint)floor((elev - min_elev)/(max_elev - min_elev)*(DEM_N_HEIGHT_COLORS-2))+1;
               GdkColor gcolor = vdl->height_colors[index];
-              pixels_set_area ( vdl->pixels, gcolor, vdl->alpha, width, a-1, b-1, 2, 2 );
+              pixels_set_area ( pixels, gcolor, vdl->alpha, width, a-1, b-1, 2, 2 );
             }
           }
         } /* for y= */
@@ -1159,6 +1200,210 @@ static void vik_dem_layer_draw_dem ( VikDEMLayer *vdl, VikViewport *vp, VikDEM *
   }
 }
 
+// Map tiles are always this size in pixels
+#define DEM_TILE_SIZE 256
+
+typedef struct {
+  VikDEMLayer *vdl;
+  MapCoord ulm;
+  DEMRenderArea area;
+  GPtrArray *dems; // The DEMs overlapping this tile
+  GPtrArray *files; // Their filenames, each holding a reference on the DEM until the render is done
+  gchar *name;
+  const gchar *request;
+} RenderInfo;
+
+static void dem_img_free ( guchar *pixels, gpointer data )
+{
+  g_free ( pixels );
+}
+
+/**
+ * Render the tile and put it into the map cache
+ */
+static void dem_render_tile ( RenderInfo *ri )
+{
+  guchar *pixels = g_malloc0 ( DEM_TILE_SIZE * DEM_TILE_SIZE * 4 );
+  for ( guint ii = 0; ii < ri->dems->len; ii++ )
+    dem_render_dem ( ri->vdl, &ri->area, g_ptr_array_index(ri->dems, ii), pixels );
+
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data ( pixels, GDK_COLORSPACE_RGB, TRUE, 8, DEM_TILE_SIZE, DEM_TILE_SIZE, DEM_TILE_SIZE*4, dem_img_free, NULL );
+  a_mapcache_add ( pixbuf, (mapcache_extra_t){ 0.0, 0 }, ri->ulm.x, ri->ulm.y, ri->ulm.z, MAP_ID_DEM_RENDER, ri->ulm.scale, ri->vdl->alpha, 0.0, 0.0, ri->name );
+  g_object_unref ( pixbuf );
+}
+
+/**
+ * Release the DEM references taken for a render
+ */
+static void render_dems_unref ( GPtrArray *dems, GPtrArray *files )
+{
+  for ( guint ii = 0; ii < files->len; ii++ )
+    a_dems_unref ( g_ptr_array_index(files, ii) );
+  g_ptr_array_free ( files, TRUE );
+  g_ptr_array_free ( dems, TRUE );
+}
+
+static void render_info_free ( RenderInfo *ri )
+{
+  render_dems_unref ( ri->dems, ri->files );
+  g_free ( ri->name );
+  // NB No need to free the request/key - as this is freed by the hash table destructor
+  g_free ( ri );
+}
+
+static int dem_layer_render_thread ( RenderInfo *ri, gpointer threaddata )
+{
+  int res = a_background_thread_progress ( threaddata, 0 );
+  if ( res == 0 )
+    dem_render_tile ( ri );
+
+  g_mutex_lock ( tp_mutex );
+  g_hash_table_remove ( requests, ri->request );
+  g_mutex_unlock ( tp_mutex );
+
+  if ( res == 0 && IS_VIK_LAYER(ri->vdl) )
+    vik_layer_emit_update ( VIK_LAYER(ri->vdl), FALSE ); // NB update requested from background thread
+
+  return res;
+}
+
+static void dem_layer_render_cancel ( RenderInfo *ri )
+{
+  // Nothing to do
+}
+
+#define REQUEST_HASHKEY_FORMAT "%d-%d-%d-%d-%d"
+
+/**
+ * Queue the rendering of the tile in the background,
+ *  unless it has already been requested or there is nothing to draw in it
+ */
+static void dem_layer_tile_add ( VikDEMLayer *vdl, MapCoord *ulm, gdouble xmpp, const gchar *name )
+{
+  VikCoord tl, br;
+  map_utils_iTMS_to_vikcoords ( ulm, &tl, &br );
+
+  DEMRenderArea area;
+  area.vp = NULL;
+  area.bbox.north = tl.north_south;
+  area.bbox.south = br.north_south;
+  area.bbox.east = br.east_west;
+  area.bbox.west = tl.east_west;
+  area.width = DEM_TILE_SIZE;
+  area.height = DEM_TILE_SIZE;
+  area.xmpp = xmpp;
+  area.merc_north = MERCLAT ( area.bbox.north );
+  area.merc_south = MERCLAT ( area.bbox.south );
+
+  // Take a reference on each DEM used, as the layer's list of files may be changed
+  //  (and so the DEMs unloaded) whilst the render is still in progress
+  GPtrArray *dems = g_ptr_array_new ();
+  GPtrArray *files = g_ptr_array_new_with_free_func ( g_free );
+  for ( GList *iter = vdl->files; iter; iter = iter->next ) {
+    VikDEM *dem = a_dems_get ( (const char *)iter->data );
+    if ( dem ) {
+      LatLonBBox dem_bbox = vik_dem_get_bbox ( dem );
+      if ( BBOX_INTERSECT(dem_bbox, area.bbox) ) {
+        // Already loaded, so this just adds a reference
+        g_ptr_array_add ( dems, a_dems_load ( (const char *)iter->data ) );
+        g_ptr_array_add ( files, g_strdup ( (const char *)iter->data ) );
+      }
+    }
+  }
+  if ( dems->len == 0 ) {
+    render_dems_unref ( dems, files );
+    return;
+  }
+
+  gchar *request = g_strdup_printf ( REQUEST_HASHKEY_FORMAT, ulm->x, ulm->y, ulm->z, ulm->scale, g_str_hash(name) );
+
+  g_mutex_lock ( tp_mutex );
+
+  if ( g_hash_table_lookup_extended (requests, request, NULL, NULL ) ) {
+    g_free ( request );
+    g_mutex_unlock ( tp_mutex );
+    render_dems_unref ( dems, files );
+    return;
+  }
+
+  RenderInfo *ri = g_malloc ( sizeof(RenderInfo) );
+  ri->vdl = vdl;
+  ri->ulm = *ulm;
+  ri->area = area;
+  ri->dems = dems;
+  ri->files = files;
+  ri->name = g_strdup ( name );
+  ri->request = request;
+
+  g_hash_table_insert ( requests, request, NULL );
+
+  g_mutex_unlock ( tp_mutex );
+
+  gchar *description = g_strdup_printf ( _("DEM Render %d:%d:%d"), ulm->scale, ulm->x, ulm->y );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(vdl),
+                        description,
+                        (vik_thr_func) dem_layer_render_thread,
+                        ri,
+                        (vik_thr_free_func) render_info_free,
+                        (vik_thr_free_func) dem_layer_render_cancel,
+                        1 );
+  g_free ( description );
+}
+
+/**
+ * Draw from map cache tiles, which get rendered in the background when not available
+ * Only possible for Mercator mode at the standard map zoom levels
+ *
+ * Returns: FALSE if the viewport can not be drawn in this manner
+ */
+static gboolean dem_layer_draw_tiles ( VikDEMLayer *vdl, VikViewport *vp )
+{
+  if ( vik_viewport_get_drawmode(vp) != VIK_VIEWPORT_DRAWMODE_MERCATOR )
+    return FALSE;
+
+  VikCoord ul, br;
+  ul.mode = VIK_COORD_LATLON;
+  br.mode = VIK_COORD_LATLON;
+  vik_viewport_screen_to_coord ( vp, 0, 0, &ul );
+  vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp), vik_viewport_get_height(vp), &br );
+
+  gdouble xzoom = vik_viewport_get_xmpp ( vp );
+  gdouble yzoom = vik_viewport_get_ympp ( vp );
+
+  MapCoord ulm, brm;
+  if ( !map_utils_vikcoord_to_iTMS ( &ul, xzoom, yzoom, &ulm ) ||
+       !map_utils_vikcoord_to_iTMS ( &br, xzoom, yzoom, &brm ) )
+    return FALSE;
+
+  // The tiles are specific to this layer and its current settings
+  gchar *name = g_strdup_printf ( "DEM %u %d", vdl->id, g_atomic_int_get(&vdl->render_id) );
+
+  gint xmin = MIN(ulm.x, brm.x), xmax = MAX(ulm.x, brm.x);
+  gint ymin = MIN(ulm.y, brm.y), ymax = MAX(ulm.y, brm.y);
+
+  for ( gint x = xmin; x <= xmax; x++ ) {
+    for ( gint y = ymin; y <= ymax; y++ ) {
+      ulm.x = x;
+      ulm.y = y;
+      GdkPixbuf *pixbuf = a_mapcache_get ( ulm.x, ulm.y, ulm.z, MAP_ID_DEM_RENDER, ulm.scale, vdl->alpha, 0.0, 0.0, name );
+      if ( pixbuf ) {
+        VikCoord coord;
+        gint xx, yy;
+        map_utils_iTMS_to_vikcoord ( &ulm, &coord );
+        vik_viewport_coord_to_screen ( vp, &coord, &xx, &yy );
+        vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, xx, yy, DEM_TILE_SIZE, DEM_TILE_SIZE );
+        g_object_unref ( pixbuf );
+      }
+      else
+        dem_layer_tile_add ( vdl, &ulm, xzoom, name );
+    }
+  }
+
+  g_free ( name );
+  return TRUE;
+}
+
 /* return the continent for the specified lat, lon */
 /* TODO */
 static const gchar *srtm_continent_dir ( gint lat, gint lon )
@@ -1204,23 +1449,34 @@ static void dem_layer_draw ( VikDEMLayer *vdl, VikViewport *vp )
     dem24k_draw_existence ( vp );
 #endif
 
-  const guint width = vik_viewport_get_width ( vp );
-  const guint height = vik_viewport_get_height ( vp );
+  if ( vdl->type == DEM_TYPE_NONE )
+    return;
+
+  if ( dem_layer_draw_tiles ( vdl, vp ) )
+    return;
+
+  // Otherwise draw the whole viewport directly
+  DEMRenderArea area;
+  area.vp = vp;
+  area.bbox = vik_viewport_get_bbox ( vp );
+  area.width = vik_viewport_get_width ( vp );
+  area.height = vik_viewport_get_height ( vp );
+  area.xmpp = vik_viewport_get_xmpp ( vp );
 
   // RGBA, natural alignment of rows on 4 byte boundary
-  vdl->pixels = g_malloc0 ( sizeof(guchar*) * width * height * 4 );
+  guchar *pixels = g_malloc0 ( area.width * area.height * 4 );
 
   while ( dems_iter ) {
     dem = a_dems_get ( (const char *) (dems_iter->data) );
     if ( dem )
-      vik_dem_layer_draw_dem ( vdl, vp, dem );
+      dem_render_dem ( vdl, &area, dem, pixels );
     dems_iter = dems_iter->next;
   }
 
-  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data ( vdl->pixels, GDK_COLORSPACE_RGB, TRUE, 8, width, height, width*4, NULL, NULL );
-  vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, 0, 0, width, height );
+  GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data ( pixels, GDK_COLORSPACE_RGB, TRUE, 8, area.width, area.height, area.width*4, NULL, NULL );
+  vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, 0, 0, area.width, area.height );
   g_object_unref ( pixbuf );
-  g_free ( vdl->pixels );
+  g_free ( pixels );
 }
 
 static void dem_layer_free ( VikDEMLayer *vdl )
@@ -1523,6 +1779,7 @@ static gboolean dem_layer_add_file ( VikDEMLayer *vdl, const gchar *filename )
       gchar *duped_path = g_strdup(filename);
       vdl->files = g_list_prepend ( vdl->files, duped_path );
       a_dems_load ( duped_path );
+      g_atomic_int_inc ( &vdl->render_id );
       g_debug("%s: %s", __FUNCTION__, duped_path);
     }
     return TRUE;
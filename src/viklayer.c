@@ -22,6 +22,7 @@
  */
 #include "viking.h"
 #include "viklayer_defaults.h"
+#include "trace.h"
 
 /* functions common to all layers. */
 /* TODO longone: rename interface free -> finalize */
@@ -107,6 +108,7 @@ static VikLayerInterface *vik_layer_interfaces[VIK_LAYER_NUM_TYPES] = {
  */
 void vik_layer_redraw ( VikLayer *vl )
 {
+  vl->draw_dirty = TRUE;
   if ( vl->visible && vl->realized ) {
     GThread *thread = vik_window_get_thread ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl)) );
     if ( !thread )
@@ -133,6 +135,8 @@ void vik_layer_redraw ( VikLayer *vl )
  */
 void vik_layer_emit_update ( VikLayer *vl, gboolean is_modified )
 {
+  // Even when invisible, so the change is shown when it becomes visible
+  vl->draw_dirty = TRUE;
   if ( vl->visible && vl->realized ) {
     GThread *thread = vik_window_get_thread ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl)) );
     if ( !thread )
@@ -174,6 +178,7 @@ void vik_layer_emit_update ( VikLayer *vl, gboolean is_modified )
  */
 void vik_layer_emit_update_although_invisible ( VikLayer *vl )
 {
+  vl->draw_dirty = TRUE;
   vik_window_set_redraw_trigger(vl);
   (void)g_idle_add ( (GSourceFunc)idle_draw, vl );
 }
@@ -305,8 +310,51 @@ gboolean vik_layer_properties ( VikLayer *layer, VikViewport *vp, gboolean have_
 void vik_layer_draw ( VikLayer *l, VikViewport *vp )
 {
   if ( l->visible )
-    if ( vik_layer_interfaces[l->type]->draw )
+    if ( vik_layer_interfaces[l->type]->draw ) {
+      gint64 trace_begin = a_trace_begin ();
       vik_layer_interfaces[l->type]->draw ( l, vp );
+      a_trace_end_detail ( vik_layer_interfaces[l->type]->fixed_layer_name, l->name, trace_begin );
+    }
+}
+
+/**
+ * vik_layer_draw_cached:
+ *
+ * Draw the layer by reusing its previous drawing,
+ *  unless the layer has been updated since or the viewport position, zoom or size has changed.
+ * Otherwise the layer is drawn as normal, and the drawing kept for next time
+ *  if there is room for it (see vik_viewport_cache_begin()).
+ * Hidden layers give up their drawing.
+ */
+void vik_layer_draw_cached ( VikLayer *l, VikViewport *vp )
+{
+  if ( !l->visible ) {
+    vik_viewport_cache_free ( l->draw_cache );
+    l->draw_cache = NULL;
+    return;
+  }
+
+  if ( !l->draw_dirty && vik_viewport_cache_paint ( vp, l->draw_cache ) )
+    return;
+
+  l->draw_dirty = FALSE;
+  if ( vik_viewport_cache_begin ( vp, l->draw_cache ) ) {
+    vik_layer_draw ( l, vp );
+    vik_viewport_cache_end ( vp, &l->draw_cache );
+  }
+  else
+    vik_layer_draw ( l, vp );
+}
+
+/**
+ * vik_layer_set_draw_dirty:
+ *
+ * Ensure the layer is fully drawn next time,
+ *  for changes that don't go via vik_layer_emit_update() (e.g. the selection highlight)
+ */
+void vik_layer_set_draw_dirty ( VikLayer *l )
+{
+  l->draw_dirty = TRUE;
 }
 
 void vik_layer_configure ( VikLayer *l, VikViewport *vp )
@@ -318,6 +366,7 @@ void vik_layer_configure ( VikLayer *l, VikViewport *vp )
 
 void vik_layer_change_coord_mode ( VikLayer *l, VikCoordMode mode )
 {
+  l->draw_dirty = TRUE;
   if ( vik_layer_interfaces[l->type]->change_coord_mode )
     vik_layer_interfaces[l->type]->change_coord_mode ( l, mode );
 }
@@ -502,6 +551,7 @@ static void vik_layer_finalize ( VikLayer *vl )
     vik_layer_interfaces[vl->type]->free ( vl );
   if ( vl->name )
     g_free ( vl->name );
+  vik_viewport_cache_free ( vl->draw_cache );
   G_OBJECT_CLASS(parent_class)->finalize(G_OBJECT(vl));
 }
 
@@ -615,6 +665,7 @@ gboolean vik_layer_set_param ( VikLayer *vl, VikLayerSetParam *vlsp )
 
 void vik_layer_post_read ( VikLayer *layer, VikViewport *vp, gboolean from_file )
 {
+  layer->draw_dirty = TRUE;
   if ( vik_layer_interfaces[layer->type]->post_read )
     vik_layer_interfaces[layer->type]->post_read ( layer, vp, from_file );
 }
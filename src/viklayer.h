@@ -62,6 +62,10 @@ struct _VikLayer {
 
   /* for explicit "polymorphism" (function type switching) */
   VikLayerTypeEnum type;
+
+  // The last drawing of the layer, reused until the layer is updated or the view changes
+  VikViewportCache *draw_cache;
+  gboolean draw_dirty;
 };
 
 /* I think most of these are ignored,
@@ -277,6 +281,8 @@ VikLayerInterface *vik_layer_get_interface ( VikLayerTypeEnum type );
 
 void vik_layer_set_type ( VikLayer *vl, VikLayerTypeEnum type );
 void vik_layer_draw ( VikLayer *l, VikViewport *vp );
+void vik_layer_draw_cached ( VikLayer *l, VikViewport *vp );
+void vik_layer_set_draw_dirty ( VikLayer *l );
 void vik_layer_configure ( VikLayer *l, VikViewport *vp );
 void vik_layer_change_coord_mode ( VikLayer *l, VikCoordMode mode );
 void vik_layer_rename ( VikLayer *l, const gchar *new_name );
@@ -39,6 +39,7 @@
 #include "vikmapslayer.h"
 #include "metatile.h"
 #include "map_ids.h"
+#include "trace.h"
 
 #ifdef HAVE_SQLITE3_H
 #include "sqlite3.h"
@@ -1270,86 +1271,104 @@ static void get_filename ( const gchar *cache_dir,
 }
 
 /**
- * Caller has to decrease reference counter of returned
- * GdkPixbuf, when buffer is no longer needed.
+ * Load the tile from disk (or MBTiles or a metatile), as it's not in the mapcache
  */
-static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
-                               gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
+static GdkPixbuf *load_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
+                                gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
 {
-  GdkPixbuf *pixbuf;
-
-  /* get the thing */
-  pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
-                            id, mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
-
-  if ( ! pixbuf ) {
-    VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
-    if ( vik_map_source_is_direct_file_access(map) ) {
-      // ATM MBTiles must be 'a direct access type'
-      if ( vik_map_source_is_mbtiles(map) ) {
-        pixbuf = get_mbtiles_pixbuf ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS );
-        // return now to avoid file tests that aren't appropriate for this map type
-        return pixbuf;
-      }
-      else if ( vik_map_source_is_osm_meta_tiles(map) ) {
-        pixbuf = get_pixbuf_from_metatile ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS );
-        return pixbuf;
-      }
-      else
-        get_filename ( vml->cache_dir, VIK_MAPS_CACHE_LAYOUT_OSM, id, NULL,
-                       mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
-                       vik_map_source_get_file_extension(map) );
+  GdkPixbuf *pixbuf = NULL;
+  VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
+  if ( vik_map_source_is_direct_file_access(map) ) {
+    // ATM MBTiles must be 'a direct access type'
+    if ( vik_map_source_is_mbtiles(map) ) {
+      pixbuf = get_mbtiles_pixbuf ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
+      pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS );
+      // return now to avoid file tests that aren't appropriate for this map type
+      return pixbuf;
+    }
+    else if ( vik_map_source_is_osm_meta_tiles(map) ) {
+      pixbuf = get_pixbuf_from_metatile ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
+      pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, DOWNLOAD_SUCCESS );
+      return pixbuf;
     }
     else
-      get_filename ( vml->cache_dir, vml->cache_layout, id, mapname,
+      get_filename ( vml->cache_dir, VIK_MAPS_CACHE_LAYOUT_OSM, id, NULL,
                      mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
                      vik_map_source_get_file_extension(map) );
+  }
+  else
+    get_filename ( vml->cache_dir, vml->cache_layout, id, mapname,
+                   mapcoord->scale, mapcoord->z, mapcoord->x, mapcoord->y, filename_buf, buf_len,
+                   vik_map_source_get_file_extension(map) );
 
-    if ( g_file_test ( filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
-    {
-      GError *gx = NULL;
-      pixbuf = gdk_pixbuf_new_from_file ( filename_buf, &gx );
+  if ( g_file_test ( filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
+  {
+    GError *gx = NULL;
+    pixbuf = gdk_pixbuf_new_from_file ( filename_buf, &gx );
 
-      /* free the pixbuf on error */
-      if (gx)
-      {
-        if ( gx->domain != GDK_PIXBUF_ERROR || gx->code != GDK_PIXBUF_ERROR_CORRUPT_IMAGE ) {
-          // Report a warning
-          if ( IS_VIK_WINDOW ((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml)) ) {
-            gchar* msg = g_strdup_printf ( _("Couldn't open image file: %s"), gx->message );
-            vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml), msg, VIK_STATUSBAR_INFO );
-            g_free (msg);
-          }
+    /* free the pixbuf on error */
+    if (gx)
+    {
+      if ( gx->domain != GDK_PIXBUF_ERROR || gx->code != GDK_PIXBUF_ERROR_CORRUPT_IMAGE ) {
+        // Report a warning
+        if ( IS_VIK_WINDOW ((VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml)) ) {
+          gchar* msg = g_strdup_printf ( _("Couldn't open image file: %s"), gx->message );
+          vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(vml), msg, VIK_STATUSBAR_INFO );
+          g_free (msg);
         }
+      }
 
-        g_error_free ( gx );
-        if ( pixbuf )
-          g_object_unref ( G_OBJECT(pixbuf) );
-        pixbuf = NULL;
-      } else {
-        // Maintain any download result status value that is already in the mapcache
-        mapcache_extra_t extra = a_mapcache_get_extra ( mapcoord->x, mapcoord->y, mapcoord->z, id, mapcoord->scale,
-                                                        vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
-        guint status = extra.status;
-        if ( extra.status >= DOWNLOAD_SUCCESS ) {
-          // On read in from file, check expiry value
-          GStatBuf buf;
-          if ( g_stat(filename_buf, &buf) == 0 ) {
-            status = DOWNLOAD_SUCCESS;
-            time_t file_time = buf.st_mtime;
-            if ( (time(NULL) - file_time) > vml->cache_expiry_age )
-              status = MAPCACHE_STATUS_FILE_EXPIRED;
-          }
+      g_error_free ( gx );
+      if ( pixbuf )
+        g_object_unref ( G_OBJECT(pixbuf) );
+      pixbuf = NULL;
+    } else {
+      // Maintain any download result status value that is already in the mapcache
+      mapcache_extra_t extra = a_mapcache_get_extra ( mapcoord->x, mapcoord->y, mapcoord->z, id, mapcoord->scale,
+                                                      vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+      guint status = extra.status;
+      if ( extra.status >= DOWNLOAD_SUCCESS ) {
+        // On read in from file, check expiry value
+        GStatBuf buf;
+        if ( g_stat(filename_buf, &buf) == 0 ) {
+          status = DOWNLOAD_SUCCESS;
+          time_t file_time = buf.st_mtime;
+          if ( (time(NULL) - file_time) > vml->cache_expiry_age )
+            status = MAPCACHE_STATUS_FILE_EXPIRED;
         }
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, status );
       }
+      pixbuf = pixbuf_apply_settings ( pixbuf, vml, vp_scale, mapcoord, xshrinkfactor, yshrinkfactor, status );
     }
   }
   return pixbuf;
 }
 
+/**
+ * Caller has to decrease reference counter of returned
+ * GdkPixbuf, when buffer is no longer needed.
+ */
+static GdkPixbuf *get_pixbuf ( VikMapsLayer *vml, guint16 id, guint vp_scale, const gchar* mapname, MapCoord *mapcoord,
+                               gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  GdkPixbuf *pixbuf;
+
+  /* get the thing */
+  pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
+                            id, mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+
+  if ( pixbuf ) {
+    a_trace_count ( VIK_TRACE_TILES_CACHED, 1 );
+    return pixbuf;
+  }
+
+  gint64 trace_begin = a_trace_begin ();
+  pixbuf = load_pixbuf ( vml, id, vp_scale, mapname, mapcoord, filename_buf, buf_len, xshrinkfactor, yshrinkfactor );
+  if ( pixbuf )
+    a_trace_count ( VIK_TRACE_TILES_DECODED, 1 );
+  a_trace_end ( "get_pixbuf", trace_begin );
+  return pixbuf;
+}
+
 static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
 {
   const VikCoord *center = vik_viewport_get_center ( vvp );
@@ -1701,6 +1720,9 @@ static void maps_layer_draw ( VikMapsLayer *vml, VikViewport *vvp )
   {
     VikCoord ul, br;
 
+    // When printing, use tiles from a closer zoom level to match the printer's resolution
+    gboolean detail = vik_viewport_detail_begin ( vvp );
+
     /* Copyright */
     gdouble level = vik_viewport_get_zoom ( vvp );
     LatLonBBox bbox = vik_viewport_get_bbox ( vvp );
@@ -1727,6 +1749,9 @@ static void maps_layer_draw ( VikMapsLayer *vml, VikViewport *vvp )
 
       maps_layer_draw_section ( vml, vvp, &ul, &br );
     }
+
+    if ( detail )
+      vik_viewport_detail_end ( vvp );
   }
 }
 
@@ -1746,6 +1771,7 @@ typedef struct {
   gint mapstoget;
   gint redownload;
   gboolean refresh_display;
+  gboolean report_progress; // FALSE when running within another background job
   VikMapsLayer *vml;
   VikViewport *vvp;
   gboolean map_layer_alive;
@@ -1863,7 +1889,11 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
         gboolean remove_mem_cache = FALSE;
         gboolean need_download = FALSE;
         donemaps++;
-        int res = a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget ); /* this also calls testcancel */
+        int res;
+        if ( mdi->report_progress )
+          res = a_background_thread_progress ( threaddata, ((gdouble)donemaps) / mdi->mapstoget ); /* this also calls testcancel */
+        else
+          res = a_background_testcancel ( threaddata );
         if (res != 0) {
           requests_clear ( mdi->maptype );
           vik_map_source_download_handle_cleanup ( map, handle );
@@ -1930,7 +1960,11 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
 
         DownloadResult_t dr = DOWNLOAD_NOT_REQUIRED;
         if (need_download) {
+          gint64 trace_begin = a_trace_begin ();
           dr = vik_map_source_download ( map, &(mdi->mapcoord), mdi->filename_buf, handle );
+          a_trace_end ( "map_download", trace_begin );
+          if ( dr == DOWNLOAD_SUCCESS )
+            a_trace_count ( VIK_TRACE_TILES_DOWNLOADED, 1 );
           switch ( dr ) {
             case DOWNLOAD_PARAMETERS_ERROR:
             case DOWNLOAD_HTTP_ERROR:
@@ -2118,19 +2152,23 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
   }
 }
 
-static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom, gint download_method )
+/**
+ * Setup the download of the tiles for the area, counting how many are missing
+ * Returns: NULL if nothing could be downloaded for this area
+ */
+static MapDownloadInfo *mdi_new_for_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom, gint download_method )
 {
   MapCoord ulm, brm;
   VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
 
   // Don't ever attempt download on direct access
   if ( vik_map_source_is_direct_file_access ( map ) )
-    return;
+    return NULL;
 
   if (!vik_map_source_coord_to_mapcoord(map, ul, zoom, zoom, &ulm) 
     || !vik_map_source_coord_to_mapcoord(map, br, zoom, zoom, &brm)) {
     g_warning("%s() coord_to_mapcoord() failed", __PRETTY_FUNCTION__);
-    return;
+    return NULL;
   }
 
   MapDownloadInfo *mdi = g_malloc(sizeof(MapDownloadInfo));
@@ -2141,6 +2179,7 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
   mdi->map_layer_alive = TRUE;
   mdi->mutex = vik_mutex_new();
   mdi->refresh_display = TRUE;
+  mdi->report_progress = TRUE;
 
   mdi->cache_dir = g_strdup ( vml->cache_dir );
   mdi->maxlen = strlen ( vml->cache_dir ) + 40;
@@ -2179,6 +2218,15 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
 
   mdi->mapcoord.x = mdi->mapcoord.y = 0; /* for cleanup -- no current map */
 
+  return mdi;
+}
+
+static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom, gint download_method )
+{
+  MapDownloadInfo *mdi = mdi_new_for_section ( vml, vvp, ul, br, zoom, download_method );
+  if ( !mdi )
+    return;
+
   if (mdi->mapstoget) {
     gchar *tmp;
     const gchar *fmt;
@@ -2219,6 +2267,69 @@ void vik_maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikC
   maps_layer_download_section (vml, vvp, ul, br, zoom, REDOWNLOAD_NONE);
 }
 
+/**
+ * vik_maps_layer_download_section_wait:
+ * @vml:        The Map Layer
+ * @vvp:        The Viewport that the map is on
+ * @ul:         Upper left coordinate of the area to be downloaded
+ * @br:         Bottom right coordinate of the area to be downloaded
+ * @zoom:       The zoom level at which the maps are to be download
+ * @threaddata: The background job this is being called from
+ *
+ * Download any missing maps of the area within the calling background thread,
+ *  and wait for any of them already being downloaded by other threads,
+ *  so that the area can then be drawn complete.
+ *
+ * Returns: 0 on success, -1 if the background job has been cancelled
+ */
+gint vik_maps_layer_download_section_wait ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom, gpointer threaddata )
+{
+  // Only when the layer would download maps itself whilst drawing
+  if ( !vml->autodownload ||
+       vik_map_source_get_drawmode(MAPS_LAYER_NTH_TYPE(vml->maptype)) != vik_viewport_get_drawmode(vvp) )
+    return 0;
+  if ( vml->xmapzoom )
+    zoom = vml->xmapzoom;
+
+  MapDownloadInfo *mdi = mdi_new_for_section ( vml, vvp, ul, br, zoom, REDOWNLOAD_NONE );
+  if ( !mdi )
+    return 0;
+
+  gint ans = 0;
+  if ( mdi->mapstoget ) {
+    // The caller redraws once the area is complete
+    mdi->refresh_display = FALSE;
+    mdi->report_progress = FALSE;
+    g_object_weak_ref ( G_OBJECT(mdi->vml), weak_ref_cb, mdi );
+    ans = map_download_thread ( mdi, threaddata );
+    if ( ans ) {
+      mdi_cancel_cleanup ( mdi );
+    }
+    else {
+      // Tiles requested by other threads are skipped above, so wait for them to finish
+      const guint16 id = vik_map_source_get_uniq_id ( MAPS_LAYER_NTH_TYPE(mdi->maptype) );
+      for ( gint x = mdi->x0; x <= mdi->xf && !ans; x++ ) {
+        for ( gint y = mdi->y0; y <= mdi->yf && !ans; y++ ) {
+          gchar *request = create_request_string ( mdi, id, x, y );
+          gboolean pending = TRUE;
+          while ( pending && !ans ) {
+            g_mutex_lock ( rq_mutex );
+            pending = g_hash_table_contains ( requests, request );
+            g_mutex_unlock ( rq_mutex );
+            if ( pending ) {
+              g_usleep ( G_USEC_PER_SEC / 10 );
+              ans = a_background_testcancel ( threaddata );
+            }
+          }
+          g_free ( request );
+        }
+      }
+    }
+  }
+  mdi_free ( mdi );
+  return ans;
+}
+
 static void maps_layer_redownload_bad ( VikMapsLayer *vml )
 {
   start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_BAD );
@@ -65,6 +65,7 @@ void maps_layer_set_cache_default ( VikMapsCacheLayout layout );
 guint vik_maps_layer_get_default_map_type ();
 void maps_layer_register_map_source ( VikMapSource *map );
 void vik_maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom );
+gint vik_maps_layer_download_section_wait ( VikMapsLayer *vml, VikViewport *vvp, VikCoord *ul, VikCoord *br, gdouble zoom, gpointer threaddata );
 guint vik_maps_layer_get_map_type(VikMapsLayer *vml);
 void vik_maps_layer_set_map_type(VikMapsLayer *vml, guint map_type);
 gchar *vik_maps_layer_get_map_label(VikMapsLayer *vml);
@@ -0,0 +1,471 @@
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/**
+ * SECTION:vikroutingofflineengine
+ * @short_description: A routing engine using local OpenStreetMap data
+ *
+ * The #VikRoutingOfflineEngine class finds routes without any network access,
+ * using a road graph built from an OpenStreetMap extract.
+ *
+ * The graph is built on first use and then saved in a binary form,
+ * which is reused until the extract is updated.
+ * Building or loading the graph is done in the background,
+ * and until it is available route requests report that it is not ready.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+
+#include "vikroutingofflineengine.h"
+#include "osmgraph.h"
+#include "compression.h"
+#include "background.h"
+#include "dialog.h"
+#include "dir.h"
+#include "util.h"
+
+static void vik_routing_offline_engine_finalize ( GObject *gob );
+
+static gboolean vik_routing_offline_engine_find ( VikRoutingEngine *self, VikTrwLayer *vtl, struct LatLon start, struct LatLon end );
+static gboolean vik_routing_offline_engine_supports_direction ( VikRoutingEngine *self );
+static gboolean vik_routing_offline_engine_refine ( VikRoutingEngine *self, VikTrwLayer *vtl, VikTrack *vt );
+static gboolean vik_routing_offline_engine_supports_refine ( VikRoutingEngine *self );
+
+typedef struct _VikRoutingOfflineEnginePrivate VikRoutingOfflineEnginePrivate;
+struct _VikRoutingOfflineEnginePrivate
+{
+  gchar *osm_file;
+  gchar *graph_file;
+  gchar *profile;
+};
+
+G_DEFINE_TYPE_WITH_PRIVATE (VikRoutingOfflineEngine, vik_routing_offline_engine, VIK_ROUTING_ENGINE_TYPE)
+#define VIK_ROUTING_OFFLINE_ENGINE_PRIVATE(o)  (vik_routing_offline_engine_get_instance_private (VIK_ROUTING_OFFLINE_ENGINE(o)))
+
+/* properties */
+enum
+{
+  PROP_0,
+
+  PROP_OSM_FILE,
+  PROP_GRAPH_FILE,
+  PROP_PROFILE,
+};
+
+// Graphs by their filename, so several engines (e.g. for each profile) can share one
+static GHashTable *graphs = NULL;
+// Filenames of the graphs being built or loaded in the background
+static GHashTable *graphs_pending = NULL;
+
+static void
+vik_routing_offline_engine_set_property (GObject      *object,
+                          guint         property_id,
+                          const GValue *value,
+                          GParamSpec   *pspec)
+{
+  VikRoutingOfflineEnginePrivate *priv = VIK_ROUTING_OFFLINE_ENGINE_PRIVATE ( object );
+
+  switch (property_id)
+    {
+    case PROP_OSM_FILE:
+      g_free (priv->osm_file);
+      priv->osm_file = g_value_dup_string (value);
+      break;
+
+    case PROP_GRAPH_FILE:
+      g_free (priv->graph_file);
+      priv->graph_file = g_value_dup_string (value);
+      break;
+
+    case PROP_PROFILE:
+      g_free (priv->profile);
+      priv->profile = g_value_dup_string (value);
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+vik_routing_offline_engine_get_property (GObject    *object,
+                          guint       property_id,
+                          GValue     *value,
+                          GParamSpec *pspec)
+{
+  VikRoutingOfflineEnginePrivate *priv = VIK_ROUTING_OFFLINE_ENGINE_PRIVATE ( object );
+
+  switch (property_id)
+    {
+    case PROP_OSM_FILE:
+      g_value_set_string (value, priv->osm_file);
+      break;
+
+    case PROP_GRAPH_FILE:
+      g_value_set_string (value, priv->graph_file);
+      break;
+
+    case PROP_PROFILE:
+      g_value_set_string (value, priv->profile);
+      break;
+
+    default:
+      /* We don't have any other property... */
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void vik_routing_offline_engine_class_init ( VikRoutingOfflineEngineClass *klass )
+{
+  GObjectClass *object_class;
+  VikRoutingEngineClass *parent_class;
+  GParamSpec *pspec = NULL;
+
+  object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = vik_routing_offline_engine_set_property;
+  object_class->get_property = vik_routing_offline_engine_get_property;
+  object_class->finalize = vik_routing_offline_engine_finalize;
+
+  parent_class = VIK_ROUTING_ENGINE_CLASS (klass);
+
+  parent_class->find = vik_routing_offline_engine_find;
+  parent_class->supports_direction = vik_routing_offline_engine_supports_direction;
+  parent_class->refine = vik_routing_offline_engine_refine;
+  parent_class->supports_refine = vik_routing_offline_engine_supports_refine;
+
+  /**
+   * VikRoutingOfflineEngine:osm-file:
+   *
+   * The OpenStreetMap XML extract (optionally bzip2 compressed).
+   */
+  pspec = g_param_spec_string ("osm-file",
+                               "OSM file",
+                               "The OpenStreetMap XML extract to route over",
+                               NULL /* default value */,
+                               G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_OSM_FILE, pspec);
+
+
+  /**
+   * VikRoutingOfflineEngine:graph-file:
+   *
+   * Where the road graph built from the extract is saved.
+   */
+  pspec = g_param_spec_string ("graph-file",
+                               "Graph file",
+                               "Where the road graph built from the extract is saved",
+                               NULL /* default value */,
+                               G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_GRAPH_FILE, pspec);
+
+
+  /**
+   * VikRoutingOfflineEngine:profile:
+   *
+   * The mode of transport: "car", "bike" or "foot".
+   */
+  pspec = g_param_spec_string ("profile",
+                               "Profile",
+                               "The mode of transport: car, bike or foot",
+                               "car" /* default value */,
+                               G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+  g_object_class_install_property (object_class, PROP_PROFILE, pspec);
+
+  graphs = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)osm_graph_free );
+  graphs_pending = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+}
+
+static void vik_routing_offline_engine_init ( VikRoutingOfflineEngine *self )
+{
+  VikRoutingOfflineEnginePrivate *priv = VIK_ROUTING_OFFLINE_ENGINE_PRIVATE ( self );
+
+  priv->osm_file = NULL;
+  priv->graph_file = NULL;
+  priv->profile = NULL;
+}
+
+static void vik_routing_offline_engine_finalize ( GObject *gob )
+{
+  VikRoutingOfflineEnginePrivate *priv = VIK_ROUTING_OFFLINE_ENGINE_PRIVATE ( gob );
+
+  g_free (priv->osm_file);
+  priv->osm_file = NULL;
+  g_free (priv->graph_file);
+  priv->graph_file = NULL;
+  g_free (priv->profile);
+  priv->profile = NULL;
+
+  G_OBJECT_CLASS (vik_routing_offline_engine_parent_class)->finalize(gob);
+}
+
+/**
+ * By default the graph is kept alongside the other Viking files
+ */
+static gchar *
+get_graph_filename ( VikRoutingOfflineEnginePrivate *priv )
+{
+  if ( priv->graph_file )
+    return g_strdup ( priv->graph_file );
+
+  gchar *base = g_path_get_basename ( priv->osm_file );
+  gchar *name = g_strconcat ( base, ".vikroute", NULL );
+  gchar *filename = g_build_filename ( a_get_viking_dir(), name, NULL );
+  g_free ( name );
+  g_free ( base );
+  return filename;
+}
+
+typedef struct {
+  gchar *osm_file;   // May be NULL when only using a saved graph
+  gchar *graph_file;
+  OsmGraph *og;
+} graph_job_t;
+
+/**
+ * Returns: The graph, or NULL if cancelled or it failed
+ */
+static OsmGraph *
+build_graph ( const gchar *osm_file, gpointer threaddata )
+{
+  if ( g_str_has_suffix(osm_file, ".bz2") ) {
+    gchar *tmp_name = uncompress_bzip2 ( osm_file );
+    if ( !tmp_name )
+      return NULL;
+    OsmGraph *og = NULL;
+    if ( a_background_thread_progress ( threaddata, 0.5 ) == 0 )
+      og = osm_graph_new_from_osm_file ( tmp_name );
+    (void)util_remove ( tmp_name );
+    g_free ( tmp_name );
+    return og;
+  }
+  return osm_graph_new_from_osm_file ( osm_file );
+}
+
+/**
+ * Use the saved graph if it is up to date with the extract,
+ * otherwise build it (which may take a while for large extracts) and save it for next time.
+ * Runs in a background thread.
+ */
+static void
+graph_job_thread ( graph_job_t *job, gpointer threaddata )
+{
+  GStatBuf osm_stat, graph_stat;
+  gboolean have_osm = job->osm_file && g_stat ( job->osm_file, &osm_stat ) == 0;
+  if ( g_stat(job->graph_file, &graph_stat) == 0 &&
+       ( !have_osm || graph_stat.st_mtime >= osm_stat.st_mtime ) )
+    job->og = osm_graph_load ( job->graph_file );
+
+  if ( !job->og && have_osm ) {
+    gint64 begin = g_get_monotonic_time ();
+    job->og = build_graph ( job->osm_file, threaddata );
+    if ( job->og ) {
+      g_debug ( "%s: Built graph of %u nodes from %s in %.3f seconds", __FUNCTION__,
+                osm_graph_get_num_nodes(job->og), job->osm_file,
+                (gdouble)(g_get_monotonic_time() - begin) / G_USEC_PER_SEC );
+      (void)osm_graph_save ( job->og, job->graph_file );
+    }
+  }
+  (void)a_background_thread_progress ( threaddata, 1.0 );
+}
+
+// Back in the main thread
+static gboolean
+graph_job_done ( graph_job_t *job )
+{
+  g_hash_table_remove ( graphs_pending, job->graph_file );
+  if ( job->og )
+    g_hash_table_insert ( graphs, job->graph_file, job->og );
+  else {
+    g_warning ( "%s: No graph available from %s", __FUNCTION__, job->graph_file );
+    g_free ( job->graph_file );
+  }
+  g_free ( job->osm_file );
+  g_free ( job );
+  return FALSE;
+}
+
+// NB This is called when the job finishes for whatever reason (i.e. including when cancelled)
+static void
+graph_job_finish ( graph_job_t *job )
+{
+  (void)gdk_threads_add_idle ( (GSourceFunc)graph_job_done, job );
+}
+
+/**
+ * Returns: The graph if it is available,
+ *  otherwise NULL having told the user (and started getting it ready if not already doing so)
+ */
+static OsmGraph *
+vik_routing_offline_engine_get_graph ( VikRoutingEngine *self, VikTrwLayer *vtl )
+{
+  VikRoutingOfflineEnginePrivate *priv = VIK_ROUTING_OFFLINE_ENGINE_PRIVATE ( self );
+
+  if ( !priv->osm_file && !priv->graph_file ) {
+    g_warning ( "%s: No OSM file or graph file set for %s", __FUNCTION__, vik_routing_engine_get_id(self) );
+    return NULL;
+  }
+
+  gchar *graph_file = get_graph_filename ( priv );
+  OsmGraph *og = g_hash_table_lookup ( graphs, graph_file );
+  if ( og ) {
+    g_free ( graph_file );
+    return og;
+  }
+
+  if ( !g_hash_table_contains ( graphs_pending, graph_file ) ) {
+    graph_job_t *job = g_malloc0 ( sizeof(graph_job_t) );
+    job->osm_file = g_strdup ( priv->osm_file );
+    job->graph_file = g_strdup ( graph_file );
+    g_hash_table_add ( graphs_pending, g_strdup(graph_file) );
+
+    gchar *msg = g_strdup_printf ( _("Loading routing graph for %s"), vik_routing_engine_get_label(self) );
+    a_background_thread ( BACKGROUND_POOL_LOCAL,
+                          VIK_GTK_WINDOW_FROM_LAYER(vtl),
+                          msg,
+                          (vik_thr_func)graph_job_thread,
+                          job,
+                          (vik_thr_free_func)graph_job_finish,
+                          NULL,
+                          1 );
+    g_free ( msg );
+  }
+  g_free ( graph_file );
+
+  gchar *msg = g_strdup_printf ( _("The routing graph for %s is not ready yet.\n\nIt is being loaded in the background, so please try again shortly."),
+                                 vik_routing_engine_get_label(self) );
+  a_dialog_info_msg ( VIK_GTK_WINDOW_FROM_LAYER(vtl), msg );
+  g_free ( msg );
+  return NULL;
+}
+
+static OsmGraphProfile
+vik_routing_offline_engine_get_profile ( VikRoutingEngine *self )
+{
+  VikRoutingOfflineEnginePrivate *priv = VIK_ROUTING_OFFLINE_ENGINE_PRIVATE ( self );
+  return osm_graph_profile_from_string ( priv->profile );
+}
+
+/**
+ * Route between the nodes nearest to the positions,
+ *  appending the nodes to the list of nodes so far (without repeating the joining node)
+ */
+static gboolean
+route_between ( OsmGraph *og, OsmGraphProfile profile, const struct LatLon *start, const struct LatLon *end, GArray *nodes )
+{
+  guint from, to;
+  if ( !osm_graph_get_nearest_node ( og, profile, start, &from ) ||
+       !osm_graph_get_nearest_node ( og, profile, end, &to ) )
+    return FALSE;
+
+  guint32 cost;
+  GArray *route = osm_graph_route ( og, profile, from, to, &cost );
+  if ( !route )
+    return FALSE;
+
+  guint skip = ( nodes->len && g_array_index(nodes, guint, nodes->len-1) == g_array_index(route, guint, 0) ) ? 1 : 0;
+  g_array_append_vals ( nodes, route->data + skip*sizeof(guint), route->len - skip );
+  g_array_free ( route, TRUE );
+  return TRUE;
+}
+
+static void
+add_route ( VikTrwLayer *vtl, OsmGraph *og, GArray *nodes, const gchar *name )
+{
+  VikCoordMode mode = vik_trw_layer_get_coord_mode ( vtl );
+  VikTrack *trk = vik_track_new ();
+  trk->is_route = TRUE;
+  for ( guint ii = 0; ii < nodes->len; ii++ ) {
+    struct LatLon ll;
+    osm_graph_get_node_latlon ( og, g_array_index(nodes, guint, ii), &ll );
+    VikTrackpoint *tp = vik_trackpoint_new ();
+    vik_coord_load_from_latlon ( &tp->coord, mode, &ll );
+    trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
+  }
+  trk->trackpoints = g_list_reverse ( trk->trackpoints );
+  vik_track_calculate_bounds ( trk );
+
+  gchar *route_name = g_strdup ( name );
+  vik_trw_layer_filein_add_track ( vtl, route_name, trk );
+  g_free ( route_name );
+}
+
+static gboolean
+vik_routing_offline_engine_find ( VikRoutingEngine *self, VikTrwLayer *vtl, struct LatLon start, struct LatLon end )
+{
+  OsmGraph *og = vik_routing_offline_engine_get_graph ( self, vtl );
+  if ( !og )
+    return FALSE;
+
+  GArray *nodes = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  gboolean ans = route_between ( og, vik_routing_offline_engine_get_profile(self), &start, &end, nodes );
+  if ( ans )
+    add_route ( vtl, og, nodes, vik_routing_engine_get_label(self) );
+  g_array_free ( nodes, TRUE );
+  return ans;
+}
+
+static gboolean
+vik_routing_offline_engine_supports_direction ( VikRoutingEngine *self )
+{
+  return FALSE;
+}
+
+/**
+ * Route via each of the track's points in turn
+ */
+static gboolean
+vik_routing_offline_engine_refine ( VikRoutingEngine *self, VikTrwLayer *vtl, VikTrack *vt )
+{
+  if ( !vt->trackpoints || !vt->trackpoints->next )
+    return FALSE;
+
+  OsmGraph *og = vik_routing_offline_engine_get_graph ( self, vtl );
+  if ( !og )
+    return FALSE;
+
+  OsmGraphProfile profile = vik_routing_offline_engine_get_profile ( self );
+  GArray *nodes = g_array_new ( FALSE, FALSE, sizeof(guint) );
+  gboolean ans = TRUE;
+  for ( GList *iter = vt->trackpoints; ans && iter->next; iter = iter->next ) {
+    struct LatLon start, end;
+    vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->data)->coord, &start );
+    vik_coord_to_latlon ( &VIK_TRACKPOINT(iter->next->data)->coord, &end );
+    ans = route_between ( og, profile, &start, &end, nodes );
+  }
+  if ( ans )
+    add_route ( vtl, og, nodes, vt->name );
+  g_array_free ( nodes, TRUE );
+  return ans;
+}
+
+static gboolean
+vik_routing_offline_engine_supports_refine ( VikRoutingEngine *self )
+{
+  return TRUE;
+}
@@ -35,15 +35,35 @@
 #include "dems.h"
 #include "settings.h"
 
+// The last revision given to any track
+static gint revisions = 0;
+
 VikTrack *vik_track_new()
 {
   VikTrack *tr = g_malloc0 ( sizeof ( VikTrack ) );
   tr->ref_count = 1;
   tr->visible = TRUE;
   vik_track_set_defaults ( tr );
+  vik_track_changed ( tr );
   return tr;
 }
 
+/**
+ * vik_track_changed:
+ *
+ * Note that the trackpoints have been edited, by giving the track a new revision.
+ * Revisions are unique across all tracks, so anything worked out from a track
+ *  can be kept against the revision alone, and is out of date once it differs.
+ * Tracks can be created in background threads, hence the atomic increment.
+ *
+ * vik_track_calculate_bounds() does this, since it is needed after any change of position.
+ * Other edits (e.g. to times or elevations) must call this themselves.
+ */
+void vik_track_changed ( VikTrack *tr )
+{
+  tr->revision = (guint)g_atomic_int_add ( &revisions, 1 ) + 1;
+}
+
 #define VIK_SETTINGS_TRACK_NAME_MODE "track_draw_name_mode"
 #define VIK_SETTINGS_TRACK_NUM_DIST_LABELS "track_number_dist_labels"
 
@@ -199,6 +219,7 @@ void vik_track_free(VikTrack *tr)
   if (tr->property_dialog)
     if ( GTK_IS_WIDGET(tr->property_dialog) )
       gtk_widget_destroy ( GTK_WIDGET(tr->property_dialog) );
+  vik_track_dem_profile_free ( tr->dem_profile );
   g_free ( tr );
 }
 
@@ -349,8 +370,11 @@ void vik_track_add_trackpoint ( VikTrack *tr, VikTrackpoint *tp, gboolean recalc
   tr->trackpoints = g_list_append ( tr->trackpoints, tp );
   if ( adding_first_point )
     vik_track_calculate_bounds ( tr );
-  else if ( recalculate )
-    track_recalculate_bounds_last_tp ( tr );
+  else {
+    if ( recalculate )
+      track_recalculate_bounds_last_tp ( tr );
+    vik_track_changed ( tr );
+  }
 }
 
 /**
@@ -559,6 +583,8 @@ gboolean vik_track_remove_dodgy_first_point ( VikTrack *vt, guint speed, gboolea
             vt->trackpoints = g_list_delete_link ( vt->trackpoints, iter );
             if ( recalc_bounds )
               vik_track_calculate_bounds ( vt );
+            else
+              vik_track_changed ( vt );
 	  }
 	}
       }
@@ -596,6 +622,7 @@ void vik_track_to_routepoints ( VikTrack *tr )
 
     iter = iter->next;
   }
+  vik_track_changed ( tr );
 }
 
 guint vik_track_get_segment_count(const VikTrack *tr)
@@ -683,6 +710,8 @@ guint vik_track_merge_segments(VikTrack *tr)
       num++;
     }
   }
+  if ( num )
+    vik_track_changed ( tr );
   return num;
 }
 
@@ -708,6 +737,7 @@ void vik_track_reverse ( VikTrack *tr )
     }
     iter = iter->prev;
   }
+  vik_track_changed ( tr );
 }
 
 /**
@@ -1299,6 +1329,7 @@ void vik_track_convert ( VikTrack *tr, VikCoordMode dest_mode )
     vik_coord_convert ( &(VIK_TRACKPOINT(iter->data)->coord), dest_mode );
     iter = iter->next;
   }
+  vik_track_changed ( tr );
 }
 
 /* I understood this when I wrote it ... maybe ... Basically it eats up the
@@ -2161,6 +2192,8 @@ void vik_track_calculate_bounds ( VikTrack *trk )
   trk->bbox.east = bottomright.lon;
   trk->bbox.south = bottomright.lat;
   trk->bbox.west = topleft.lon;
+
+  vik_track_changed ( trk );
 }
 
 /**
@@ -2195,6 +2228,7 @@ void vik_track_anonymize_times ( VikTrack *tr )
     }
     tp_iter = tp_iter->next;
   }
+  vik_track_changed ( tr );
 }
 
 /**
@@ -2239,6 +2273,7 @@ void vik_track_interpolate_times ( VikTrack *tr )
 
           tp->timestamp = (cur_dist / tr_dist) * tsdiff + tsfirst;
         }
+        vik_track_changed ( tr );
         // Some points may now have the same time so remove them.
         vik_track_remove_same_time_points ( tr );
       }
@@ -2257,6 +2292,9 @@ gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing )
   gulong num = 0;
   GList *tp_iter;
   gint16 elev;
+  // Reuse the elevations if already looked up (e.g. for the track properties graphs)
+  const VikTrackDEMProfile *dp = vik_track_get_dem_profile ( tr );
+  guint ii = 0;
   tp_iter = tr->trackpoints;
   while ( tp_iter ) {
     // Don't apply if the point already has a value and the overwrite is off
@@ -2264,18 +2302,100 @@ gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing )
       /* TODO: of the 4 possible choices we have for choosing an elevation
        * (trackpoint in between samples), choose the one with the least elevation change
        * as the last */
-      elev = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(tp_iter->data)->coord), VIK_DEM_INTERPOL_BEST );
+      if ( dp )
+        elev = dp->elev[ii];
+      else
+        elev = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(tp_iter->data)->coord), VIK_DEM_INTERPOL_BEST );
 
       if ( elev != VIK_DEM_INVALID_ELEVATION ) {
         VIK_TRACKPOINT(tp_iter->data)->altitude = elev;
 	num++;
       }
     }
+    ii++;
     tp_iter = tp_iter->next;
   }
+  if ( num ) {
+    vik_track_changed ( tr );
+    // Positions are unchanged, so the profile remains valid
+    if ( dp )
+      tr->dem_profile->revision = tr->revision;
+  }
   return num;
 }
 
+/**
+ * vik_track_make_dem_profile:
+ *
+ * Look up the DEM elevation of every trackpoint
+ * Can be used from a background thread, on a copy of the track
+ *  (in which case set the revision of the original track in the profile)
+ *
+ * Returns: A newly allocated profile, to be freed with vik_track_dem_profile_free()
+ *  or given to a track via vik_track_set_dem_profile()
+ */
+VikTrackDEMProfile *vik_track_make_dem_profile ( const VikTrack *tr )
+{
+  VikTrackDEMProfile *dp = g_malloc ( sizeof(VikTrackDEMProfile) );
+  // Read before the lookups, so any DEM change during them makes this out of date
+  dp->dems_generation = a_dems_get_generation ();
+  dp->revision = tr->revision;
+  dp->count = g_list_length ( tr->trackpoints );
+  dp->dist = g_malloc ( sizeof(gdouble) * MAX(dp->count,1) );
+  dp->elev = g_malloc ( sizeof(gint16) * MAX(dp->count,1) );
+
+  gdouble dist = 0.0;
+  guint ii = 0;
+  for ( GList *iter = tr->trackpoints; iter; iter = iter->next ) {
+    if ( iter->prev )
+      dist += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) );
+    dp->dist[ii] = dist;
+    dp->elev[ii] = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(iter->data)->coord), VIK_DEM_INTERPOL_BEST );
+    ii++;
+  }
+  return dp;
+}
+
+void vik_track_dem_profile_free ( VikTrackDEMProfile *dp )
+{
+  if ( !dp )
+    return;
+  g_free ( dp->dist );
+  g_free ( dp->elev );
+  g_free ( dp );
+}
+
+/**
+ * vik_track_set_dem_profile:
+ *
+ * Keep the profile with the track (the track takes ownership of it)
+ */
+void vik_track_set_dem_profile ( VikTrack *tr, VikTrackDEMProfile *dp )
+{
+  if ( tr->dem_profile == dp )
+    return;
+  vik_track_dem_profile_free ( tr->dem_profile );
+  tr->dem_profile = dp;
+}
+
+/**
+ * vik_track_get_dem_profile:
+ *
+ * Returns: The stored profile, or NULL if there isn't one or
+ *  either the trackpoints have changed or the loaded DEMs have changed since it was made
+ */
+const VikTrackDEMProfile *vik_track_get_dem_profile ( VikTrack *tr )
+{
+  VikTrackDEMProfile *dp = tr->dem_profile;
+  if ( !dp )
+    return NULL;
+  if ( dp->dems_generation != a_dems_get_generation() || dp->revision != tr->revision ) {
+    vik_track_set_dem_profile ( tr, NULL );
+    return NULL;
+  }
+  return dp;
+}
+
 /**
  * vik_trackpoint_apply_dem_data:
  * Apply DEM data (if available) to the trackpoint
@@ -2401,6 +2521,8 @@ gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat )
     tp_iter = tp_iter->next;
   }
 
+  if ( num )
+    vik_track_changed ( tr );
   return num;
 }
 
@@ -2419,6 +2541,7 @@ void vik_track_steal_and_append_trackpoints ( VikTrack *t1, VikTrack *t2 )
 
   // Trackpoints updated - so update the bounds
   vik_track_calculate_bounds ( t1 );
+  vik_track_changed ( t2 );
 }
 
 /**
@@ -2455,6 +2578,7 @@ VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
       g_list_free( iter );
 
       prev->next = NULL;
+      vik_track_changed ( tr );
 
       return rv;
     }
@@ -2467,6 +2591,7 @@ VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
   g_list_foreach ( tr->trackpoints, (GFunc) g_free, NULL );
   g_list_free( tr->trackpoints );
   tr->trackpoints = NULL;
+  vik_track_changed ( tr );
   return rv;
 }
 
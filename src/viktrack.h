@@ -77,6 +77,17 @@ typedef enum {
 //   given that they do the same things
 //  Mostly this matters in the display in deciding where and how they are shown
 typedef struct _VikTrack VikTrack;
+
+// The DEM elevation under each trackpoint (and the distance along the track to it)
+//  as of a particular revision of the trackpoints and set of loaded DEMs
+typedef struct {
+  guint revision;
+  guint dems_generation;
+  guint count;
+  gdouble *dist; // Metres
+  gint16 *elev;  // Metres: VIK_DEM_INVALID_ELEVATION if no DEM covers the trackpoint
+} VikTrackDEMProfile;
+
 struct _VikTrack {
   GList *trackpoints;
   gboolean visible;
@@ -97,6 +108,8 @@ struct _VikTrack {
   gboolean has_color;
   GdkColor color;
   LatLonBBox bbox;
+  VikTrackDEMProfile *dem_profile; // Not copied; may be out of date, so access via vik_track_get_dem_profile()
+  guint revision; // Changed on every edit of the trackpoints, see vik_track_changed()
 };
 
 typedef struct {
@@ -118,6 +131,7 @@ void vik_track_set_url_name(VikTrack *tr, const gchar *url_name);
 void vik_track_set_type(VikTrack *tr, const gchar *type);
 void vik_track_set_extensions(VikTrack *tr, const gchar *value);
 void vik_track_ref(VikTrack *tr);
+void vik_track_changed ( VikTrack *tr );
 void vik_track_free(VikTrack *tr);
 VikTrack *vik_track_copy ( const VikTrack *tr, gboolean copy_points );
 void vik_track_set_comment_no_copy(VikTrack *tr, gchar *comment);
@@ -208,6 +222,10 @@ void vik_track_calculate_bounds ( VikTrack *trk );
 void vik_track_anonymize_times ( VikTrack *tr );
 void vik_track_interpolate_times ( VikTrack *tr );
 gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing );
+VikTrackDEMProfile *vik_track_make_dem_profile ( const VikTrack *tr );
+void vik_track_dem_profile_free ( VikTrackDEMProfile *dp );
+void vik_track_set_dem_profile ( VikTrack *tr, VikTrackDEMProfile *dp );
+const VikTrackDEMProfile *vik_track_get_dem_profile ( VikTrack *tr );
 //void vik_track_apply_dem_data_last_trackpoint ( VikTrack *tr );
 gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat );
 
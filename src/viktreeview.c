@@ -59,6 +59,9 @@ struct _VikTreeview {
 
   gboolean was_a_toggle;
   gboolean editing;
+
+  GList *pending_sorts; // of SortPending - see vik_treeview_sort_children_deferred()
+  guint pending_sort_id;
 };
 
 /* TODO: find, make "static" and put up here all non-"a_" functions */
@@ -509,6 +512,8 @@ void vik_treeview_init ( VikTreeview *vt )
 {
   vt->was_a_toggle = FALSE;
   vt->editing = FALSE;
+  vt->pending_sorts = NULL;
+  vt->pending_sort_id = 0;
 
   // ATM The dates are stored on initial creation and updated when items are deleted
   //  this should be good enough for most purposes, although it may get inaccurate if items are edited in a particular manner
@@ -788,6 +793,66 @@ typedef struct _SortTuple
   guint number;
 } SortTuple;
 
+static gint sort_tuple_compare ( gconstpointer a, gconstpointer b, gpointer order );
+
+/**
+ * vik_treeview_add_sublayers:
+ * @vt:          The treeview to operate on
+ * @parent_iter: The level within the treeview to add the items to
+ * @parent:      The layer owning the items
+ * @data:        The sublayer type of all the items
+ * @editable:    Whether the names can be edited
+ * @rows:        The items to add. On return the iter of each item is filled in
+ * @n_rows:      Number of items in @rows
+ * @order:       How the items should be sorted
+ *
+ * Bulk version of vik_treeview_add_sublayer(), intended for when a layer is realized.
+ *
+ * The items are sorted via an index array using the values given in @rows
+ *  (rather than reading each value back out of the tree model as vik_treeview_sort_children() has to)
+ *  and then each row is inserted fully formed in its final position.
+ * Insertion is in reverse order at the front of the level, as prepending to a #GtkTreeStore is constant time,
+ *  whereas appending has to walk all the existing siblings; which for 50,000 waypoints adds up to a long time.
+ *
+ * Hence any items already in the level remain after the newly added ones.
+ */
+void vik_treeview_add_sublayers ( VikTreeview *vt, GtkTreeIter *parent_iter, gpointer parent, gint data, gboolean editable,
+                                  VikTreeviewSublayer *rows, guint n_rows, vik_layer_sort_order_t order )
+{
+  if ( n_rows == 0 )
+    return;
+
+  SortTuple *sort_array = g_new ( SortTuple, n_rows );
+  for ( guint ii = 0; ii < n_rows; ii++ ) {
+    sort_array[ii].offset = ii;
+    // Not owned - only used for comparison
+    sort_array[ii].name = (gchar*)rows[ii].name;
+    sort_array[ii].timestamp = rows[ii].timestamp;
+    sort_array[ii].number = rows[ii].number;
+  }
+
+  if ( order != VL_SO_NONE )
+    g_qsort_with_data ( sort_array, n_rows, sizeof(SortTuple), sort_tuple_compare, GINT_TO_POINTER(order) );
+
+  GtkTreeStore *store = GTK_TREE_STORE(vt->model);
+  for ( gint ii = n_rows-1; ii >= 0; ii-- ) {
+    VikTreeviewSublayer *row = &rows[sort_array[ii].offset];
+    gtk_tree_store_insert_with_values ( store, &row->iter, parent_iter, 0,
+                                        NAME_COLUMN, row->name,
+                                        VISIBLE_COLUMN, row->visible,
+                                        TYPE_COLUMN, VIK_TREEVIEW_TYPE_SUBLAYER,
+                                        ITEM_PARENT_COLUMN, parent,
+                                        ITEM_POINTER_COLUMN, row->item,
+                                        ITEM_DATA_COLUMN, data,
+                                        EDITABLE_COLUMN, editable,
+                                        ICON_COLUMN, row->icon,
+                                        ITEM_TIMESTAMP_COLUMN, row->timestamp,
+                                        ITEM_NUMBER_COLUMN, row->number,
+                                        -1 );
+  }
+  g_free ( sort_array );
+}
+
 /**
  *
  */
@@ -865,9 +930,11 @@ void vik_treeview_sort_children ( VikTreeview *vt, GtkTreeIter *parent, vik_laye
   guint ii = 0;
   do {
     sort_array[ii].offset = ii;
-    gtk_tree_model_get ( model, &child, NAME_COLUMN, &(sort_array[ii].name), -1 );
-    gtk_tree_model_get ( model, &child, ITEM_TIMESTAMP_COLUMN, &(sort_array[ii].timestamp), -1 );
-    gtk_tree_model_get ( model, &child, ITEM_NUMBER_COLUMN, &(sort_array[ii].number), -1 );
+    gtk_tree_model_get ( model, &child,
+                         NAME_COLUMN, &(sort_array[ii].name),
+                         ITEM_TIMESTAMP_COLUMN, &(sort_array[ii].timestamp),
+                         ITEM_NUMBER_COLUMN, &(sort_array[ii].number),
+                         -1 );
     ii++;
   } while ( gtk_tree_model_iter_next (model, &child) );
 
@@ -891,9 +958,88 @@ void vik_treeview_sort_children ( VikTreeview *vt, GtkTreeIter *parent, vik_laye
   g_free ( positions );
 }
 
+typedef struct {
+  GtkTreeRowReference *parent;
+  vik_layer_sort_order_t order;
+} SortPending;
+
+static void sort_pending_free ( gpointer data )
+{
+  SortPending *sp = (SortPending*)data;
+  gtk_tree_row_reference_free ( sp->parent );
+  g_free ( sp );
+}
+
+static gboolean sort_pending_idle ( VikTreeview *vt )
+{
+  vt->pending_sort_id = 0;
+  GList *pending = vt->pending_sorts;
+  vt->pending_sorts = NULL;
+
+  for ( GList *it = pending; it; it = g_list_next(it) ) {
+    SortPending *sp = (SortPending*)it->data;
+    // The level may have been removed in the meantime
+    if ( gtk_tree_row_reference_valid ( sp->parent ) ) {
+      GtkTreePath *path = gtk_tree_row_reference_get_path ( sp->parent );
+      GtkTreeIter parent;
+      if ( gtk_tree_model_get_iter ( vt->model, &parent, path ) )
+        vik_treeview_sort_children ( vt, &parent, sp->order );
+      gtk_tree_path_free ( path );
+    }
+  }
+  g_list_free_full ( pending, sort_pending_free );
+  return FALSE;
+}
+
+/**
+ * vik_treeview_sort_children_deferred:
+ * @vt:     The treeview to operate on
+ * @parent: The level within the treeview to sort
+ * @order:  How the items should be sorted
+ *
+ * As vik_treeview_sort_children() but performed once from an idle callback,
+ *  so adding many items one at a time (e.g. importing into an existing layer)
+ *  only incurs a single sort of the level, rather than a sort per item added.
+ */
+void vik_treeview_sort_children_deferred ( VikTreeview *vt, GtkTreeIter *parent, vik_layer_sort_order_t order )
+{
+  if ( order == VL_SO_NONE )
+    return;
+
+  GtkTreePath *path = gtk_tree_model_get_path ( vt->model, parent );
+
+  // Only need to sort each level once
+  for ( GList *it = vt->pending_sorts; it; it = g_list_next(it) ) {
+    SortPending *sp = (SortPending*)it->data;
+    GtkTreePath *pp = gtk_tree_row_reference_get_path ( sp->parent );
+    gboolean same = pp && !gtk_tree_path_compare ( pp, path );
+    if ( pp )
+      gtk_tree_path_free ( pp );
+    if ( same ) {
+      sp->order = order;
+      gtk_tree_path_free ( path );
+      return;
+    }
+  }
+
+  SortPending *sp = g_malloc ( sizeof(SortPending) );
+  sp->parent = gtk_tree_row_reference_new ( vt->model, path );
+  sp->order = order;
+  gtk_tree_path_free ( path );
+  vt->pending_sorts = g_list_prepend ( vt->pending_sorts, sp );
+
+  if ( !vt->pending_sort_id )
+    vt->pending_sort_id = g_idle_add ( (GSourceFunc)sort_pending_idle, vt );
+}
+
 static void vik_treeview_finalize ( GObject *gob )
 {
   VikTreeview *vt = VIK_TREEVIEW ( gob );
+
+  if ( vt->pending_sort_id )
+    g_source_remove ( vt->pending_sort_id );
+  g_list_free_full ( vt->pending_sorts, sort_pending_free );
+
   VikLayerTypeEnum i;
   for ( i = 0; i < VIK_LAYER_NUM_TYPES; i++ )
     if ( vt->layer_type_icons[i] != NULL )
@@ -100,7 +100,26 @@ void vik_treeview_add_sublayer ( VikTreeview *vt, GtkTreeIter *parent_iter, GtkT
 
 gboolean vik_treeview_get_iter_with_name ( VikTreeview *vt, GtkTreeIter *iter, GtkTreeIter *parent_iter, const gchar *name );
 
+/**
+ * VikTreeviewSublayer:
+ *
+ * Values for one sublayer item, for adding many items at once via vik_treeview_add_sublayers()
+ */
+typedef struct {
+  const gchar *name;
+  gpointer item;
+  GdkPixbuf *icon;
+  gdouble timestamp;
+  guint number;
+  gboolean visible;
+  GtkTreeIter iter; // Set on insertion
+} VikTreeviewSublayer;
+
+void vik_treeview_add_sublayers ( VikTreeview *vt, GtkTreeIter *parent_iter, gpointer parent, gint data, gboolean editable,
+                                  VikTreeviewSublayer *rows, guint n_rows, vik_layer_sort_order_t order );
+
 void vik_treeview_sort_children ( VikTreeview *vt, GtkTreeIter *parent, vik_layer_sort_order_t order );
+void vik_treeview_sort_children_deferred ( VikTreeview *vt, GtkTreeIter *parent, vik_layer_sort_order_t order );
 
 gboolean vik_treeview_key_press ( VikTreeview *vt, GdkEventKey *event );
 
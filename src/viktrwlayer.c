@@ -42,8 +42,8 @@
 #include "garminsymbols.h"
 #include "thumbnails.h"
 #include "background.h"
+#include "trace.h"
 #include "gpx.h"
-#include "geojson.h"
 #include "babel.h"
 #include "dem.h"
 #include "dems.h"
@@ -185,7 +185,6 @@ struct _VikTrwLayer {
   GdkGC *waypoint_gc;
   GdkGC *waypoint_text_gc;
   GdkGC *waypoint_bg_gc;
-  GdkGC *track_graph_point_gc;
 
   gboolean wpbgand;
   VikTrack *current_track; // ATM shared between new tracks and new routes
@@ -224,9 +223,9 @@ struct _VikTrwLayer {
   gboolean drawlabels;
   gboolean drawimages;
   guint8 image_alpha;
-  GHashTable *image_cache;
   guint8 image_size;
-  guint image_cache_size;
+  guint image_cache_size; // No longer used, as the images are held in a cache shared by all layers
+  gint thumbnails_ready;  // A redraw is pending for newly available images (atomic)
 
   /* for waypoint text */
   PangoLayout *wplabellayout;
@@ -248,10 +247,6 @@ struct _VikTrwLayer {
   gchar *external_file;
   gboolean external_loaded;
   gchar *external_dirpath;
-
-#if GTK_CHECK_VERSION (3,0,0)
-  cairo_t *cr; // Reference into vvp - thus do not free this here
-#endif
 };
 
 struct DrawingParams {
@@ -384,9 +379,6 @@ static void trw_layer_goto_waypoint ( menu_array_sublayer values );
 static void trw_layer_waypoint_gc_webpage ( menu_array_sublayer values );
 static void trw_layer_waypoint_webpage ( menu_array_sublayer values );
 
-typedef gpointer menu_array_realize[5];
-static void trw_layer_realize_waypoint ( gpointer id, VikWaypoint *wp, menu_array_realize pass_along );
-static void trw_layer_realize_track ( gpointer id, VikTrack *track, menu_array_realize pass_along );
 
 static void trw_layer_insert_tp_beside_current_tp ( VikTrwLayer *vtl, gboolean before, gboolean is_route );
 static void trw_layer_cancel_current_tp ( VikTrwLayer *vtl, gboolean destroy );
@@ -745,7 +737,6 @@ VikLayerParam trw_layer_params[] = {
   { VIK_LAYER_TRW, "drawimages", VIK_LAYER_PARAM_BOOLEAN, GROUP_IMAGES, N_("Draw Waypoint Images"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_true_default, NULL, NULL },
   { VIK_LAYER_TRW, "image_size", VIK_LAYER_PARAM_UINT, GROUP_IMAGES, N_("Image Size (pixels):"), VIK_LAYER_WIDGET_HSCALE, &params_scales[3], NULL, NULL, image_size_default, NULL, NULL },
   { VIK_LAYER_TRW, "image_alpha", VIK_LAYER_PARAM_UINT, GROUP_IMAGES, N_("Image Alpha:"), VIK_LAYER_WIDGET_HSCALE, &params_scales[4], NULL, NULL, image_alpha_default, NULL, NULL },
-  { VIK_LAYER_TRW, "image_cache_size", VIK_LAYER_PARAM_UINT, GROUP_IMAGES, N_("Image Memory Cache Size:"), VIK_LAYER_WIDGET_HSCALE, &params_scales[5], NULL, NULL, image_cache_size_default, NULL, NULL },
 
   { VIK_LAYER_TRW, "metadatadesc", VIK_LAYER_PARAM_STRING, GROUP_METADATA, N_("Description"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, string_default, NULL, NULL },
   { VIK_LAYER_TRW, "metadataauthor", VIK_LAYER_PARAM_STRING, GROUP_METADATA, N_("Author"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, string_default, NULL, NULL },
@@ -759,6 +750,10 @@ VikLayerParam trw_layer_params[] = {
   { VIK_LAYER_TRW, "external_file", VIK_LAYER_PARAM_STRING, GROUP_FILESYSTEM, N_("Save layer as:"), VIK_LAYER_WIDGET_FILESAVE, GINT_TO_POINTER(VF_FILTER_GPX), NULL, N_("Specify where layer should be saved.  Overwrites file if it exists."), string_default, NULL, NULL },
   { VIK_LAYER_TRW, "reset", VIK_LAYER_PARAM_PTR_DEFAULT, VIK_LAYER_GROUP_NONE, NULL,
     VIK_LAYER_WIDGET_BUTTON, N_("Reset to Defaults"), NULL, NULL, reset_default, NULL, NULL },
+
+  // No longer used, but kept so existing files still read and write it
+  // NB Hidden parameters are at the end so the widget positions in trw_layer_change_param() are unaffected
+  { VIK_LAYER_TRW, "image_cache_size", VIK_LAYER_PARAM_UINT, VIK_LAYER_NOT_IN_PROPERTIES, NULL, VIK_LAYER_WIDGET_HSCALE, &params_scales[5], NULL, NULL, image_cache_size_default, NULL, NULL },
 };
 
 // ENUMERATION MUST BE IN THE SAME ORDER AS THE NAMED PARAMS ABOVE
@@ -805,7 +800,6 @@ enum {
   PARAM_DI,
   PARAM_IS,
   PARAM_IA,
-  PARAM_ICS,
   // Metadata
   PARAM_MDDESC,
   PARAM_MDAUTH,
@@ -818,6 +812,8 @@ enum {
   PARAM_EXTL,
   PARAM_EXTF,
   PARAM_RESET,
+  // Not in properties
+  PARAM_ICS,
   NUM_PARAMS
 };
 
@@ -937,16 +933,9 @@ VikLayerInterface vik_trw_layer_interface = {
   (VikLayerFuncRefresh)                 vik_trw_layer_propwin_main_refresh,
 };
 
-static gboolean have_geojson_export = FALSE;
-
 // NB Only performed once per program run
 static void vik_trwlayer_class_init ( VikTrwLayerClass *klass )
 {
-  gchar* geojson_prog = g_find_program_in_path ( a_geojson_program_export() );
-  if ( geojson_prog ) {
-    have_geojson_export = TRUE;
-    g_free ( geojson_prog );
-  }
 }
 
 /**
@@ -1466,18 +1455,11 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, VikLayerSetParam *vlsp )
       break;
     case PARAM_IS:
       changed = vik_layer_param_change_uint8 ( vlsp->data, &vtl->image_size );
-      if ( changed )
-        g_hash_table_remove_all ( vtl->image_cache );
       break;
     case PARAM_IA:
       changed = vik_layer_param_change_uint8 ( vlsp->data, &vtl->image_alpha );
-      if ( changed )
-        g_hash_table_remove_all ( vtl->image_cache );
       break;
     case PARAM_ICS:
-      // If cache size is made smaller, then reset cache
-      if ( vlsp->data.u < vtl->image_cache_size )
-        g_hash_table_remove_all ( vtl->image_cache );
       changed = vik_layer_param_change_uint ( vlsp->data, &vtl->image_cache_size );
       break;
     case PARAM_WPC:
@@ -1680,14 +1662,10 @@ static void trw_layer_change_param ( GtkWidget *widget, ui_change_values values
       GtkWidget *w2 = ww2[OFFSET + PARAM_IS];
       GtkWidget *w3 = ww1[OFFSET + PARAM_IA];
       GtkWidget *w4 = ww2[OFFSET + PARAM_IA];
-      GtkWidget *w5 = ww1[OFFSET + PARAM_ICS];
-      GtkWidget *w6 = ww2[OFFSET + PARAM_ICS];
       if ( w1 ) gtk_widget_set_sensitive ( w1, vlpd.b );
       if ( w2 ) gtk_widget_set_sensitive ( w2, vlpd.b );
       if ( w3 ) gtk_widget_set_sensitive ( w3, vlpd.b );
       if ( w4 ) gtk_widget_set_sensitive ( w4, vlpd.b );
-      if ( w5 ) gtk_widget_set_sensitive ( w5, vlpd.b );
-      if ( w6 ) gtk_widget_set_sensitive ( w6, vlpd.b );
       break;
     }
     // Alter sensitivity of waypoint label related widgets according to the draw label setting.
@@ -1913,11 +1891,6 @@ static guint strcase_hash(gconstpointer v)
 }
 */
 
-static void pixbuf_free ( GdkPixbuf *pixbuf )
-{
-  g_object_unref ( G_OBJECT(pixbuf) );
-}
-
 // Stick a 1 at the end of the function name to make it more unique
 //  thus more easily searchable in a simple text editor
 static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
@@ -1944,8 +1917,6 @@ static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
   rv->routes = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) vik_track_free );
   rv->routes_iters = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
 
-  rv->image_cache = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, (GDestroyNotify) pixbuf_free ); // Must be performed before set_params via set_defaults
-
   vik_layer_set_defaults ( VIK_LAYER(rv), vvp );
 
   // Param settings that are not available via the GUI
@@ -1994,9 +1965,6 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   if ( trwlayer->waypoint_bg_gc != NULL )
     ui_gc_unref ( trwlayer->waypoint_bg_gc );
 
-  if ( trwlayer->track_graph_point_gc )
-    ui_gc_unref ( trwlayer->track_graph_point_gc );
-
   g_free ( trwlayer->wp_fsize_str );
   g_free ( trwlayer->track_fsize_str );
 
@@ -2009,7 +1977,7 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   if ( trwlayer->tracks_analysis_dialog != NULL )
     gtk_widget_destroy ( GTK_WIDGET(trwlayer->tracks_analysis_dialog) );
 
-  g_hash_table_destroy ( trwlayer->image_cache );
+  a_thumbnails_cancel ( trwlayer );
 
   g_free ( trwlayer->external_file );
   g_free ( trwlayer->external_dirpath );
@@ -2502,6 +2470,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
     tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
 
     vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+    guint projected = 1;
 
     // Draw the first point as something a bit different from the normal points
     // ATM it's slightly bigger and a triangle
@@ -2546,6 +2515,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
              tp->coord.north_south > dp->cn1 && tp->coord.north_south < dp->cn2 ) )
       {
         vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+        projected++;
 
 	/*
 	 * If points are the same in display coordinates, don't draw.
@@ -2675,6 +2645,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
           if ( dp->vtl->coord_mode != VIK_COORD_UTM || tp->coord.utm_zone == dp->center->utm_zone )
           {
             vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
+            projected++;
 
             if ( !drawing_highlight && (dp->vtl->drawmode == DRAWMODE_BY_SPEED) ) {
               main_gc = g_array_index(dp->vtl->track_gc, GdkGC *, track_section_colour_by_speed ( dp->vtl, tp, tp2, average_speed, low_speed, high_speed ));
@@ -2706,6 +2677,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
         useoldvals = FALSE;
       }
     }
+    a_trace_count ( VIK_TRACE_POINTS_PROJECTED, projected );
 
     // Labels drawn after the trackpoints, so the labels are on top
     if ( dp->vtl->track_draw_labels ) {
@@ -2733,6 +2705,16 @@ static void trw_layer_draw_track_cb ( const gpointer id, VikTrack *track, struct
   }
 }
 
+/**
+ * Called from a background thread when an image has become available
+ */
+static void trw_layer_thumbnail_ready ( VikTrwLayer *vtl )
+{
+  // Only the one redraw however many images become available before it happens
+  if ( g_atomic_int_compare_and_exchange ( &vtl->thumbnails_ready, 0, 1 ) )
+    vik_layer_emit_update ( VIK_LAYER(vtl), FALSE );
+}
+
 static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct DrawingParams *dp )
 {
   if ( wp->visible )
@@ -2743,56 +2725,28 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
     gint x, y;
     vik_viewport_coord_to_screen ( dp->vp, &(wp->coord), &x, &y );
 
-    /* if in shrunken_cache, get that. If not, get and add to shrunken_cache */
-
     if ( wp->image && dp->vtl->drawimages )
     {
       if ( dp->vtl->image_alpha == 0)
         return;
 
-      GdkPixbuf *pixbuf = g_hash_table_lookup ( dp->vtl->image_cache, wp->image );
+      GdkPixbuf *pixbuf = a_thumbnails_get_cached ( wp->image, dp->vtl->image_size, dp->vtl->image_alpha,
+                                                    vik_viewport_get_frame(dp->vp),
+                                                    (ThumbnailsReadyFunc)trw_layer_thumbnail_ready, dp->vtl );
       if ( !pixbuf )
-      {
-        gchar *image = wp->image;
-        GdkPixbuf *regularthumb = a_thumbnails_get ( wp->image );
-        if ( ! regularthumb )
-        {
-          regularthumb = a_thumbnails_get_default (); /* cache one 'not yet loaded' for all thumbs not loaded */
-          image = "\x12\x00"; /* this shouldn't occur naturally. */
-        }
-        if ( regularthumb )
-        {
-          if ( dp->vtl->image_size == 128 )
-            pixbuf = regularthumb;
-          else
-          {
-            pixbuf = a_thumbnails_scale_pixbuf(regularthumb, dp->vtl->image_size, dp->vtl->image_size);
-            g_object_unref ( G_OBJECT(regularthumb) );
-          }
-
-          // Apply alpha setting to the image before the pixbuf gets stored in the cache
-          if ( dp->vtl->image_alpha != 255 )
-            pixbuf = ui_pixbuf_set_alpha ( pixbuf, dp->vtl->image_alpha );
-
-          /* needed so 'click picture' tool knows how big the pic is; we don't
-           * store it in the cache because they may have been freed already. */
-          wp->image_width = gdk_pixbuf_get_width ( pixbuf );
-          wp->image_height = gdk_pixbuf_get_height ( pixbuf );
+        // Not available yet (or can't be loaded)
+        pixbuf = a_thumbnails_get_placeholder ( dp->vtl->image_size, dp->vtl->image_alpha );
 
-          if ( g_hash_table_size(dp->vtl->image_cache) < dp->vtl->image_cache_size )
-            g_hash_table_insert ( dp->vtl->image_cache, image, pixbuf );
-        }
-        else
-        {
-          pixbuf = a_thumbnails_get_default (); /* thumbnail not yet loaded */
-        }
-      }
       if ( pixbuf )
       {
         gint w, h;
         w = gdk_pixbuf_get_width ( pixbuf );
         h = gdk_pixbuf_get_height ( pixbuf );
 
+        /* needed so 'click picture' tool knows how big the pic is */
+        wp->image_width = w;
+        wp->image_height = h;
+
         if ( x+(w/2) > 0 && y+(h/2) > 0 && x-(w/2) < dp->width && y-(h/2) < dp->height ) /* always draw within boundaries */
         {
           if ( dp->highlight ) {
@@ -2807,6 +2761,7 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
 
           vik_viewport_draw_pixbuf ( dp->vp, pixbuf, 0, 0, x - (w/2), y - (h/2), w, h );
         }
+        g_object_unref ( pixbuf );
         return; /* if failed to draw picture, default to drawing regular waypoint (below) */
       }
     }
@@ -2939,8 +2894,11 @@ static void trw_layer_draw_with_highlight ( VikTrwLayer *l, VikViewport *vvp, gb
   if ( l->routes_visible )
     g_hash_table_foreach ( l->routes, (GHFunc) trw_layer_draw_track_cb, &dp );
 
-  if (l->waypoints_visible)
+  if (l->waypoints_visible) {
+    // Any images that become available from now on need another redraw
+    g_atomic_int_set ( &l->thumbnails_ready, 0 );
     g_hash_table_foreach ( l->waypoints, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+  }
 }
 
 static void trw_layer_draw ( VikTrwLayer *l, VikViewport *vvp )
@@ -3001,10 +2959,7 @@ static void trw_layer_create_other_gcs ( VikTrwLayer *vtl, VikViewport *vp )
   vtl->waypoint_gc = vik_viewport_new_gc_from_color ( vp, &(vtl->waypoint_color), 2 );
   vtl->waypoint_text_gc = vik_viewport_new_gc_from_color ( vp, &(vtl->waypoint_text_color), 1 );
   vtl->waypoint_bg_gc = vik_viewport_new_gc_from_color ( vp, &(vtl->waypoint_bg_color), 1 );
-#if GTK_CHECK_VERSION (3,0,0)
-  vtl->track_graph_point_gc = vik_viewport_new_gc ( vp, "black", 1 ); // NB Color and thickness unused(?)
-#else
-  vtl->track_graph_point_gc = gdk_gc_new ( gtk_widget_get_window(GTK_WIDGET(vp)) );
+#if !GTK_CHECK_VERSION (3,0,0)
   gdk_gc_set_function ( vtl->waypoint_bg_gc, vtl->wpbgand );
 #endif
 
@@ -3034,8 +2989,6 @@ static void trw_layer_configure ( VikTrwLayer *vtl, VikViewport *vvp )
     ui_gc_unref ( vtl->waypoint_text_gc );
   if ( vtl->waypoint_bg_gc )
     ui_gc_unref ( vtl->waypoint_bg_gc );
-  if ( vtl->track_graph_point_gc )
-    ui_gc_unref ( vtl->track_graph_point_gc );
 
   trw_layer_create_other_gcs ( vtl, vvp );
 }
@@ -3181,63 +3134,115 @@ static VikTrwLayer* trw_layer_create ( VikViewport *vp )
 }
 
 #define SMALL_ICON_SIZE 18
+// Scaled symbols, to avoid rescaling (and leaking) a new icon for every waypoint in the treeview
+static GHashTable *wp_sym_small_cache = NULL;
 /*
  * Can accept a null symbol, and may return null value
+ * The returned icon is owned by the symbol caches - do not unref it
  */
 GdkPixbuf* get_wp_sym_small ( gchar *symbol )
 {
   GdkPixbuf* wp_icon = a_get_wp_sym (symbol);
   // ATM a_get_wp_sym returns a cached icon, with the size dependent on the preferences.
   //  So needing a small icon for the treeview may need some resizing:
-  if ( wp_icon && gdk_pixbuf_get_width ( wp_icon ) != SMALL_ICON_SIZE )
-    wp_icon = gdk_pixbuf_scale_simple ( wp_icon, SMALL_ICON_SIZE, SMALL_ICON_SIZE, GDK_INTERP_BILINEAR );
+  if ( wp_icon && gdk_pixbuf_get_width ( wp_icon ) != SMALL_ICON_SIZE ) {
+    // Key on the canonical symbol name, as the icon itself may be regenerated on preference changes
+    const gchar *sym = a_get_hashed_sym ( symbol );
+    if ( !wp_sym_small_cache )
+      wp_sym_small_cache = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_object_unref );
+    GdkPixbuf *small = g_hash_table_lookup ( wp_sym_small_cache, sym );
+    if ( !small ) {
+      small = gdk_pixbuf_scale_simple ( wp_icon, SMALL_ICON_SIZE, SMALL_ICON_SIZE, GDK_INTERP_BILINEAR );
+      g_hash_table_insert ( wp_sym_small_cache, (gpointer)sym, small );
+    }
+    wp_icon = small;
+  }
   return wp_icon;
 }
 
-static void trw_layer_realize_track ( gpointer id, VikTrack *track, menu_array_realize pass_along )
+/*
+ * Add all the tracks (or routes) to the treeview in one go
+ */
+static void trw_layer_realize_tracks ( VikTrwLayer *vtl, VikTreeview *vt, GHashTable *tracks, GHashTable *tracks_iters, GtkTreeIter *parent_iter, gint subtype )
 {
-  GtkTreeIter *new_iter = g_malloc(sizeof(GtkTreeIter));
+  guint n_rows = g_hash_table_size ( tracks );
+  VikTreeviewSublayer *rows = g_new ( VikTreeviewSublayer, n_rows );
+  // Normally there are only a few distinct track colours, so share the icons
+  GHashTable *icons = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_object_unref );
 
-  GdkPixbuf *pixbuf = NULL;
-
-  if ( track->has_color )
-    pixbuf = ui_pixbuf_new ( &track->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
+  GHashTableIter iter;
+  gpointer key, value;
+  guint ii = 0;
+  g_hash_table_iter_init ( &iter, tracks );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikTrack *track = VIK_TRACK(value);
+    VikTreeviewSublayer *row = &rows[ii++];
+
+    row->icon = NULL;
+    if ( track->has_color ) {
+      guint32 pixel = ((track->color.red & 0xff00) << 16) | ((track->color.green & 0xff00) << 8) | (track->color.blue & 0xff00);
+      row->icon = g_hash_table_lookup ( icons, GUINT_TO_POINTER(pixel) );
+      if ( !row->icon ) {
+        row->icon = ui_pixbuf_new ( &track->color, SMALL_ICON_SIZE, SMALL_ICON_SIZE );
+        g_hash_table_insert ( icons, GUINT_TO_POINTER(pixel), row->icon );
+      }
+    }
 
-  gdouble timestamp = 0;
-  VikTrackpoint *tpt = vik_track_get_tp_first(track);
-  if ( tpt && !isnan(tpt->timestamp) )
-    timestamp = tpt->timestamp;
+    row->timestamp = 0;
+    VikTrackpoint *tpt = vik_track_get_tp_first(track);
+    if ( tpt && !isnan(tpt->timestamp) )
+      row->timestamp = tpt->timestamp;
 
-  vik_treeview_add_sublayer ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[0], (GtkTreeIter *) pass_along[1], track->name, pass_along[2], id, GPOINTER_TO_INT (pass_along[4]), pixbuf, TRUE, timestamp, track->number );
+    row->name = track->name;
+    row->item = key;
+    row->number = track->number;
+    row->visible = track->visible;
+  }
 
-  if ( pixbuf )
-    g_object_unref (pixbuf);
+  vik_treeview_add_sublayers ( vt, parent_iter, vtl, subtype, TRUE, rows, n_rows, vtl->track_sort_order );
 
-  *new_iter = *((GtkTreeIter *) pass_along[1]);
-  if ( track->is_route )
-    g_hash_table_insert ( VIK_TRW_LAYER(pass_along[2])->routes_iters, id, new_iter );
-  else
-    g_hash_table_insert ( VIK_TRW_LAYER(pass_along[2])->tracks_iters, id, new_iter );
+  for ( ii = 0; ii < n_rows; ii++ ) {
+    GtkTreeIter *new_iter = g_malloc(sizeof(GtkTreeIter));
+    *new_iter = rows[ii].iter;
+    g_hash_table_insert ( tracks_iters, rows[ii].item, new_iter );
+  }
 
-  if ( ! track->visible )
-    vik_treeview_item_set_visible ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[1], FALSE );
+  g_hash_table_destroy ( icons );
+  g_free ( rows );
 }
 
-static void trw_layer_realize_waypoint ( gpointer id, VikWaypoint *wp, menu_array_realize pass_along )
+/*
+ * Add all the waypoints to the treeview in one go
+ */
+static void trw_layer_realize_waypoints ( VikTrwLayer *vtl, VikTreeview *vt )
 {
-  GtkTreeIter *new_iter = g_malloc(sizeof(GtkTreeIter));
+  guint n_rows = g_hash_table_size ( vtl->waypoints );
+  VikTreeviewSublayer *rows = g_new ( VikTreeviewSublayer, n_rows );
 
-  gdouble timestamp = 0;
-  if ( !isnan(wp->timestamp) )
-    timestamp = wp->timestamp;
+  GHashTableIter iter;
+  gpointer key, value;
+  guint ii = 0;
+  g_hash_table_iter_init ( &iter, vtl->waypoints );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    VikWaypoint *wp = VIK_WAYPOINT(value);
+    VikTreeviewSublayer *row = &rows[ii++];
+    row->name = wp->name;
+    row->item = key;
+    row->icon = get_wp_sym_small ( wp->symbol );
+    row->timestamp = isnan(wp->timestamp) ? 0 : wp->timestamp;
+    row->number = 0;
+    row->visible = wp->visible;
+  }
 
-  vik_treeview_add_sublayer ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[0], (GtkTreeIter *) pass_along[1], wp->name, pass_along[2], id, GPOINTER_TO_UINT (pass_along[4]), get_wp_sym_small (wp->symbol), TRUE, timestamp, 0 );
+  vik_treeview_add_sublayers ( vt, &(vtl->waypoints_iter), vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, TRUE, rows, n_rows, vtl->wp_sort_order );
 
-  *new_iter = *((GtkTreeIter *) pass_along[1]);
-  g_hash_table_insert ( VIK_TRW_LAYER(pass_along[2])->waypoints_iters, id, new_iter );
+  for ( ii = 0; ii < n_rows; ii++ ) {
+    GtkTreeIter *new_iter = g_malloc(sizeof(GtkTreeIter));
+    *new_iter = rows[ii].iter;
+    g_hash_table_insert ( vtl->waypoints_iters, rows[ii].item, new_iter );
+  }
 
-  if ( ! wp->visible )
-    vik_treeview_item_set_visible ( (VikTreeview *) pass_along[3], (GtkTreeIter *) pass_along[1], FALSE );
+  g_free ( rows );
 }
 
 static void trw_layer_add_sublayer_tracks ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *layer_iter )
@@ -3257,13 +3262,10 @@ static void trw_layer_add_sublayer_routes ( VikTrwLayer *vtl, VikTreeview *vt, G
 
 static void trw_layer_realize ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *layer_iter )
 {
-  GtkTreeIter iter2;
-  menu_array_realize pass_along = { &(vtl->tracks_iter), &iter2, vtl, vt, GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_TRACK) };
-
   if ( g_hash_table_size (vtl->tracks) > 0 ) {
     trw_layer_add_sublayer_tracks ( vtl, vt , layer_iter );
 
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_realize_track, pass_along );
+    trw_layer_realize_tracks ( vtl, vt, vtl->tracks, vtl->tracks_iters, &(vtl->tracks_iter), VIK_TRW_LAYER_SUBLAYER_TRACK );
 
     vik_treeview_item_set_visible ( vt, &(vtl->tracks_iter), vtl->tracks_visible );
   }
@@ -3271,10 +3273,7 @@ static void trw_layer_realize ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *
   if ( g_hash_table_size (vtl->routes) > 0 ) {
     trw_layer_add_sublayer_routes ( vtl, vt, layer_iter );
 
-    pass_along[0] = &(vtl->routes_iter);
-    pass_along[4] = GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_ROUTE);
-
-    g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_realize_track, pass_along );
+    trw_layer_realize_tracks ( vtl, vt, vtl->routes, vtl->routes_iters, &(vtl->routes_iter), VIK_TRW_LAYER_SUBLAYER_ROUTE );
 
     vik_treeview_item_set_visible ( (VikTreeview *) vt, &(vtl->routes_iter), vtl->routes_visible );
   }
@@ -3282,17 +3281,14 @@ static void trw_layer_realize ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *
   if ( g_hash_table_size (vtl->waypoints) > 0 ) {
     trw_layer_add_sublayer_waypoints ( vtl, vt, layer_iter );
 
-    pass_along[0] = &(vtl->waypoints_iter);
-    pass_along[4] = GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_WAYPOINT);
-
-    g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_realize_waypoint, pass_along );
+    trw_layer_realize_waypoints ( vtl, vt );
 
     vik_treeview_item_set_visible ( (VikTreeview *) vt, &(vtl->waypoints_iter), vtl->waypoints_visible );
   }
 
   trw_layer_verify_thumbnails ( vtl );
 
-  trw_layer_sort_all ( vtl );
+  // NB No need to sort, as the items are inserted in the sorted order
 
   trw_update_layer_icon ( vtl );
 }
@@ -4876,11 +4872,9 @@ static void trw_layer_add_menu_items ( VikTrwLayer *vtl, GtkMenu *menu, gpointer
 
   (void)vu_menu_add_item ( export_submenu, _("Export as _GPX..."), NULL, G_CALLBACK(trw_layer_export_gpx), data );
 
-  if ( a_babel_available () )
-    (void)vu_menu_add_item ( export_submenu, _("Export as _KML..."), NULL, G_CALLBACK(trw_layer_export_kml), data );
+  (void)vu_menu_add_item ( export_submenu, _("Export as _KML..."), NULL, G_CALLBACK(trw_layer_export_kml), data );
 
-  if ( have_geojson_export )
-    (void)vu_menu_add_item ( export_submenu, _("Export as GEO_JSON..."), NULL, G_CALLBACK(trw_layer_export_geojson), data );
+  (void)vu_menu_add_item ( export_submenu, _("Export as GEO_JSON..."), NULL, G_CALLBACK(trw_layer_export_geojson), data );
 
   if ( a_babel_available () )
     (void)vu_menu_add_item ( export_submenu, _("Export via GPSbabel..."), NULL, G_CALLBACK(trw_layer_export_babel), data );
@@ -5046,8 +5040,8 @@ void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp
 
     g_hash_table_insert ( vtl->waypoints_iters, GUINT_TO_POINTER(wp_uuid), iter );
 
-    // Sort now as post_read is not called on a realized waypoint
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
+    // Sort (soon) as post_read is not called on a realized waypoint
+    vik_treeview_sort_children_deferred ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
   }
 
   highest_wp_number_add_wp(vtl, wp->name);
@@ -5086,8 +5080,8 @@ void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 
     g_hash_table_insert ( vtl->tracks_iters, GUINT_TO_POINTER(tr_uuid), iter );
 
-    // Sort now as post_read is not called on a realized track
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), vtl->track_sort_order );
+    // Sort (soon) as post_read is not called on a realized track
+    vik_treeview_sort_children_deferred ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), vtl->track_sort_order );
   }
 
   g_hash_table_insert ( vtl->tracks, GUINT_TO_POINTER(tr_uuid), t );
@@ -5120,8 +5114,8 @@ void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 
     g_hash_table_insert ( vtl->routes_iters, GUINT_TO_POINTER(rt_uuid), iter );
 
-    // Sort now as post_read is not called on a realized route
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), vtl->track_sort_order );
+    // Sort (soon) as post_read is not called on a realized route
+    vik_treeview_sort_children_deferred ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), vtl->track_sort_order );
   }
 
   g_hash_table_insert ( vtl->routes, GUINT_TO_POINTER(rt_uuid), t );
@@ -6370,6 +6364,7 @@ static void trw_layer_rotate ( menu_array_sublayer values )
     seg = g_list_first ( track->trackpoints );
     tp = VIK_TRACKPOINT(seg->data);
     tp->newsegment = TRUE;
+    vik_track_changed ( track );
 
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
@@ -7193,6 +7188,7 @@ static void trw_layer_merge_with_other ( menu_array_sublayer values )
         else
           vik_trw_layer_delete_track (vtl, merge_track);
         track->trackpoints = g_list_sort(track->trackpoints, trackpoint_compare);
+        vik_track_changed ( track );
       }
     }
     for (l = merge_list; l != NULL; l = g_list_next(l))
@@ -7486,6 +7482,7 @@ static void trw_layer_merge_by_timestamp ( menu_array_sublayer values )
     }
 
     orig_trk->trackpoints = g_list_sort(orig_trk->trackpoints, trackpoint_compare);
+    vik_track_changed ( orig_trk );
   }
 
   g_list_free(nearby_tracks);
@@ -7506,6 +7503,7 @@ static void trw_layer_split_create_segments ( menu_array_sublayer values )
   if ( vtl->current_tpl && vtl->current_tp_track && !vtl->current_tp_track->is_route ) {
     if ( vtl->current_tpl->next && vtl->current_tpl->prev ) {
         VIK_TRACKPOINT(vtl->current_tpl->data)->newsegment = TRUE;
+        vik_track_changed ( vtl->current_tp_track );
         vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
     }
   }
@@ -7800,6 +7798,7 @@ static void trw_layer_trackpoint_selected_delete ( VikTrwLayer *vtl, VikTrack *t
     // Delete current trackpoint
     vik_trackpoint_free ( vtl->current_tpl->data );
     trk->trackpoints = g_list_delete_link ( trk->trackpoints, vtl->current_tpl );
+    vik_track_changed ( trk );
     trw_layer_cancel_current_tp ( vtl, FALSE );
   }
 }
@@ -9797,6 +9796,7 @@ static void trw_layer_insert_tp_beside_current_tp ( VikTrwLayer *vtl, gboolean b
         index = index + 1;
       // NB no recalculation of bounds since it is inserted between points
       trk->trackpoints = g_list_insert ( trk->trackpoints, tp_new, index );
+      vik_track_changed ( trk );
     }
   }
 
@@ -9898,6 +9898,8 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
     }
   }
   else if ( response == VIK_TRW_LAYER_TPWIN_DATA_CHANGED ) {
+    if ( vtl->current_tp_track )
+      vik_track_changed ( vtl->current_tp_track );
     vik_layer_emit_update ( VIK_LAYER(vtl), trw_layer_modified(vtl) );
   }
 }
@@ -10803,33 +10805,29 @@ static gboolean draw_sync ( gpointer data )
 #endif
 
 /**
- * Draw a specific trackpoint in its own seperate gc
- * ATM This is intended to be called from the embedded graph
+ * Show a specific trackpoint as the viewport's highlight point
+ *  which is drawn on top of the map without redrawing any layers
+ * ATM This is intended to be called from the embedded graph, thus for every mouse movement
+ * @tpl: The trackpoint's entry in the track's list, so no search is needed to select it
+ *  (the caller must ensure it is from the track's current revision)
  */
-void vik_trw_layer_trackpoint_draw ( VikTrwLayer *vtl, VikViewport *vvp, VikTrack *trk, VikTrackpoint *tpt )
+void vik_trw_layer_trackpoint_draw ( VikTrwLayer *vtl, VikViewport *vvp, VikTrack *trk, GList *tpl )
 {
-  if ( !trk || !tpt ) {
-    vik_viewport_surface_tool_destroy ( vvp );
+  if ( !trk || !tpl ) {
+    vik_viewport_set_highlight_point ( vvp, NULL, NULL, 0 );
 
     if ( a_vik_get_auto_trackpoint_select() )
       // Full update as selected trackpoint has probably changed
       vik_layer_emit_update ( VIK_LAYER(vtl), FALSE );
-    else
-      // Basic refresh to clear any previous 'highlighted' trackpoint drawing
-      vik_layer_redraw ( VIK_LAYER(vtl) );
     return;
   }
 
-  // NB using g_list_find() is not particularly efficient (to go from a VikTrackpoint* to the GList* entry)
-  //  as it potentially searching the entire list, and this function can be called a lot.
-  // Hence another reason for the config open
-
   // Don't change the current selected/edit trackpoint if
   //  the Trackpoint Edit dialog is open
   //  or if configured not to change that trackpoint
-  if ( !vtl->tpwin &&
-       a_vik_get_auto_trackpoint_select() ) {
-    trw_layer_select_trackpoint ( vtl, trk, tpt, FALSE );
+  if ( !vtl->tpwin && a_vik_get_auto_trackpoint_select() ) {
+    vtl->current_tpl = tpl;
+    vtl->current_tp_track = trk;
   }
 
   // Workout the colour (NB ignoring 'by speed' mode as that requires more information)
@@ -10842,78 +10840,7 @@ void vik_trw_layer_trackpoint_draw ( VikTrwLayer *vtl, VikViewport *vvp, VikTrac
     else
       color = gdk_color_to_string ( &(vtl->track_color) );
 
-  gint xd, yd;
-  vik_viewport_coord_to_screen ( vvp, &(tpt->coord), &xd, &yd );
-  gint tp_size = vtl->drawpoints_size * 2;
-
-#if GTK_CHECK_VERSION (3,0,0)
-  // Draw on existing tool surface if available
-  VikWindow *vw = VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vtl));
-  VikToolInterface *vti = (VikToolInterface*)vik_window_get_active_tool_interface ( vw );
-  gboolean use_tool_surface = FALSE;
-  cairo_t *trkpt_cr = NULL;
-  if ( vti )
-    if ( vti->create == (VikToolConstructorFunc)tool_edit_create ) {
-      tool_ed_t *te = (tool_ed_t*)vik_window_get_active_tool_data ( vw );
-      if ( te && te->gc ) {
-        use_tool_surface = TRUE;
-        trkpt_cr = te->gc;
-        tool_edit_remove_image ( te );
-      }
-    }
-  // Otherwise create surface to draw on
-  if ( !use_tool_surface ) {
-    // For reasons I don't understand if we don't forceably remove and recreate the surface
-    //  i.e. the when the surface is reused, then GTK may choose to not redraw the viewport
-    ///  despite the queue_redraw() request below;
-    //  otherwise it only updates later on, e.g. when the mouse is moved back over the viewport.
-    if ( vtl->cr )
-      vik_viewport_surface_tool_destroy ( vvp );
-    vtl->cr = vik_viewport_surface_tool_create ( vvp );
-    trkpt_cr = vtl->cr;
-  }
-  if ( trkpt_cr ) {
-    ui_cr_set_color ( trkpt_cr, color );
-    ui_cr_draw_rectangle ( trkpt_cr, TRUE, xd-tp_size, yd-tp_size, 2*tp_size, 2*tp_size );
-    cairo_stroke ( trkpt_cr );
-    gtk_widget_queue_draw ( GTK_WIDGET(vvp) );
-  }
-#else
-  static GdkPixmap *pixmap = NULL;
-
-  gint w2, h2;
-  // Need to check in case window has been resized
-  gint w1 = vik_viewport_get_width ( vvp );
-  gint h1 = vik_viewport_get_height ( vvp );
-
-  if ( !pixmap ) {
-    pixmap = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vvp)), w1, h1, -1 );
-  }
-  gdk_drawable_get_size ( pixmap, &w2, &h2 );
-  if ( w1 != w2 || h1 != h2 ) {
-    g_object_unref ( G_OBJECT(pixmap) );
-    pixmap = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vvp)), w1, h1, -1 );
-  }
-
-  GdkGC *tp_gc = vik_viewport_new_gc ( vvp, color, 1 );
-  gdk_draw_drawable ( pixmap,
-                      tp_gc,
-                      vik_viewport_get_pixmap(vvp),
-                      0, 0, 0, 0, -1, -1 );
-  gdk_draw_rectangle ( pixmap, tp_gc, TRUE, xd-tp_size, yd-tp_size, 2*tp_size, 2*tp_size );
-  g_object_unref ( G_OBJECT(tp_gc) );
-
-  draw_sync_t *passalong;
-  passalong = g_new0 ( draw_sync_t, 1 ); // freed by draw_sync()
-  passalong->vtl = vtl;
-  passalong->pixmap = pixmap;
-  passalong->drawable = gtk_widget_get_window ( GTK_WIDGET(vvp) );
-  passalong->gc = vtl->track_graph_point_gc;
-
-  // draw pixmap when we have time to
-  (void)g_idle_add_full ( G_PRIORITY_HIGH_IDLE + 10, draw_sync, passalong, NULL );
-  vtl->draw_sync_done = FALSE;
-#endif
+  vik_viewport_set_highlight_point ( vvp, &(VIK_TRACKPOINT(tpl->data)->coord), color, vtl->drawpoints_size * 2 );
   g_free ( color );
 }
 
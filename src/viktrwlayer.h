@@ -214,7 +214,7 @@ GHashTable *vik_trw_layer_get_tracks_iters ( VikTrwLayer *vtl );
 GHashTable *vik_trw_layer_get_routes_iters ( VikTrwLayer *vtl );
 GHashTable *vik_trw_layer_get_waypoints_iters ( VikTrwLayer *vtl );
 
-void vik_trw_layer_trackpoint_draw ( VikTrwLayer *vtl, VikViewport *vvp, VikTrack *trk, VikTrackpoint *tpt );
+void vik_trw_layer_trackpoint_draw ( VikTrwLayer *vtl, VikViewport *vvp, VikTrack *trk, GList *tpl );
 
 #define VIK_SETTINGS_LIST_DATE_FORMAT "list_date_format"
 
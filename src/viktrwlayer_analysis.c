@@ -24,6 +24,7 @@
 #include "viking.h"
 #include "viktrwlayer_analysis.h"
 #include "viktrwlayer_tracklist.h"
+#include "background.h"
 
 // Units of each item are in SI Units
 // (as returned by the appropriate internal viking track functions)
@@ -111,40 +112,95 @@ static void val_reset_months ( void )
 		reset_me ( &tracks_months[ii] );
 }
 
+// The values of a single track that are needed for the statistics
+// This is calculated once per track (potentially in a background thread),
+//  and then the various totals are reduced from these summaries
+//  whenever the options change - rather than walking all the trackpoints again.
+typedef struct {
+	gdouble    start_time; // NAN if the track has no times
+	gdouble    end_time;
+	guint      year;       // Only valid when there is a start time
+	GDateMonth month;      // Only valid when there is a start time
+	gdouble    length;
+	gdouble    max_speed;
+	gboolean   has_alt;
+	gdouble    min_alt;
+	gdouble    max_alt;
+	gdouble    elev_gain;
+	gdouble    elev_loss;
+	gboolean   is_route;
+} track_summary_t;
+
 /**
- * @val_analyse_track:
- * @trk: The track to be analyse
+ * @val_summary_key:
+ * @trk:              The track
+ * @prefer_gps_speed: The speed option of the layer of the track
  *
- * Function to collect statistics, using the internal track functions
+ * Any edit of the trackpoints gives the track a new revision,
+ *  so a cached summary is not used once the track has been changed
+ *
+ * Returns: The key of everything the summary of the track depends on
  */
-static void val_analyse_track ( VikTrack *trk, VikTrwLayer *vtl, gboolean include_no_times )
+static guint64 val_summary_key ( VikTrack *trk, gboolean prefer_gps_speed )
 {
-	//val_reset ( TS_TRACK );
-	gdouble min_alt, max_alt, up, down;
-
-	//gdouble  length_gaps = vik_track_get_length_including_gaps (trk);
-	gdouble  length      = 0.0;
-	gdouble  max_speed   = NAN;
-	//gulong   trackpoints = vik_track_get_tp_count (trk);
-	//guint    segments    = vik_track_get_segment_count (trk);
+	return ((guint64)trk->revision << 2) | (trk->is_route ? 2 : 0) | (prefer_gps_speed ? 1 : 0);
+}
 
-	gdouble t1 = NAN;
+/**
+ * @val_summarise_track:
+ * @trk:              The track to be analysed
+ * @prefer_gps_speed: The speed option of the layer of the track
+ * @ts:               Where to store the results
+ *
+ * Function to collect the per track values, using the internal track functions
+ * NB Can be run in a background thread, on a copy of the track
+ */
+static void val_summarise_track ( VikTrack *trk, gboolean prefer_gps_speed, track_summary_t *ts )
+{
+	ts->start_time = NAN;
+	ts->end_time   = NAN;
+	ts->year       = 0;
+	ts->month      = G_DATE_BAD_MONTH;
+	ts->is_route   = trk->is_route;
 
 	// NB Subsecond resolution not needed, as just using the timestamp to get dates
 	if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-		t1 = VIK_TRACKPOINT(g_list_first(trk->trackpoints)->data)->timestamp;
-		gdouble t2 = VIK_TRACKPOINT(g_list_last(trk->trackpoints)->data)->timestamp;
+		ts->start_time = VIK_TRACKPOINT(g_list_first(trk->trackpoints)->data)->timestamp;
+		ts->end_time   = VIK_TRACKPOINT(g_list_last(trk->trackpoints)->data)->timestamp;
+
+		GDate* gdate = g_date_new ();
+		g_date_set_time_t ( gdate, (time_t)ts->start_time );
+		ts->year  = g_date_get_year ( gdate );
+		ts->month = g_date_get_month ( gdate );
+		g_date_free ( gdate );
+	}
+
+	ts->length    = vik_track_get_length ( trk );
+	ts->max_speed = vu_track_get_max_speed ( trk, prefer_gps_speed );
+	ts->has_alt   = vik_track_get_minmax_alt ( trk, &ts->min_alt, &ts->max_alt );
+	vik_track_get_total_elevation_gain ( trk, &ts->elev_gain, &ts->elev_loss );
+}
+
+/**
+ * @val_analyse_summary:
+ * @ts: The summary of the track to be included
+ *
+ * Accumulate the statistics from the track summary
+ */
+static void val_analyse_summary ( track_summary_t *ts, gboolean include_no_times )
+{
+	gdouble t1 = ts->start_time;
+	gdouble t2 = ts->end_time;
 
+	if ( !isnan(t1) ) {
 		// Initialize to the first or smallest/largest value
 		for (guint ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
-			if ( !isnan(t1) ) {
-				if ( !isnan(tracks_stats[ii].start_time) ) {
-					if ( t1 < tracks_stats[ii].start_time )
-						tracks_stats[ii].start_time = t1;
-				}
-				else
+			if ( !isnan(tracks_stats[ii].start_time) ) {
+				if ( t1 < tracks_stats[ii].start_time )
 					tracks_stats[ii].start_time = t1;
 			}
+			else
+				tracks_stats[ii].start_time = t1;
 
 			if ( !isnan(t2) ) {
 				if ( !isnan(tracks_stats[ii].end_time) ) {
@@ -153,9 +209,7 @@ static void val_analyse_track ( VikTrack *trk, VikTrwLayer *vtl, gboolean includ
 				}
 				else
 					tracks_stats[ii].end_time = t2;
-			}
 
-			if ( !isnan(t1) && !isnan(t2) ) {
 				tracks_stats[ii].duration = tracks_stats[ii].duration + (int)(t2-t1);
 			}
 		}
@@ -167,101 +221,66 @@ static void val_analyse_track ( VikTrack *trk, VikTrwLayer *vtl, gboolean includ
 
 		tracks_stats[TS_TRACKS].count++;
 
-		length    = vik_track_get_length (trk);
-		max_speed = vu_track_get_max_speed ( trk, vik_trw_layer_get_prefer_gps_speed(vtl) );
-
 		// NB A route shouldn't have times anyway
-		if ( !trk->is_route ) {
+		if ( !ts->is_route ) {
 			// Eddington number will be in the current Units distance preference
 			gdouble e_len;
 			switch (a_vik_get_units_distance ()) {
-			case VIK_UNITS_DISTANCE_MILES:          e_len = VIK_METERS_TO_MILES(length); break;
-			case VIK_UNITS_DISTANCE_NAUTICAL_MILES: e_len = VIK_METERS_TO_NAUTICAL_MILES(length); break;
+			case VIK_UNITS_DISTANCE_MILES:          e_len = VIK_METERS_TO_MILES(ts->length); break;
+			case VIK_UNITS_DISTANCE_NAUTICAL_MILES: e_len = VIK_METERS_TO_NAUTICAL_MILES(ts->length); break;
 				//VIK_UNITS_DISTANCE_KILOMETRES
-			default: e_len = length/1000.0; break;
+			default: e_len = ts->length/1000.0; break;
 			}
 			gdouble *gd = g_malloc ( sizeof(gdouble) );
 			*gd = e_len;
 			tracks_stats[TS_TRACKS].e_list = g_list_prepend ( tracks_stats[TS_TRACKS].e_list, gd );
 		}
 
-		int ii;
-		for (ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
-			//tracks_stats[ii].trackpoints += trackpoints;
-			//tracks_stats[ii].segments    += segments;
-			tracks_stats[ii].length      += length;
-			//tracks_stats[ii].length_gaps += length_gaps;
-			if ( !isnan(max_speed) )
-				if ( max_speed > tracks_stats[ii].max_speed )
-					tracks_stats[ii].max_speed = max_speed;
-		}
-
-		if ( vik_track_get_minmax_alt (trk, &min_alt, &max_alt) ) {
-			for (ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
-				if ( min_alt < tracks_stats[ii].min_alt )
-					tracks_stats[ii].min_alt = min_alt;
-				if ( max_alt > tracks_stats[ii].max_alt )
-					tracks_stats[ii].max_alt = max_alt;
+		for (guint ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
+			tracks_stats[ii].length += ts->length;
+			if ( !isnan(ts->max_speed) )
+				if ( ts->max_speed > tracks_stats[ii].max_speed )
+					tracks_stats[ii].max_speed = ts->max_speed;
+
+			if ( ts->has_alt ) {
+				if ( ts->min_alt < tracks_stats[ii].min_alt )
+					tracks_stats[ii].min_alt = ts->min_alt;
+				if ( ts->max_alt > tracks_stats[ii].max_alt )
+					tracks_stats[ii].max_alt = ts->max_alt;
 			}
-		}
-
-		vik_track_get_total_elevation_gain (trk, &up, &down );
 
-		for (ii = 0; ii < G_N_ELEMENTS(tracks_stats); ii++) {
-			tracks_stats[ii].elev_gain += up;
-			tracks_stats[ii].elev_loss += down;
+			tracks_stats[ii].elev_gain += ts->elev_gain;
+			tracks_stats[ii].elev_loss += ts->elev_loss;
 		}
 	}
 
 	// Insert into Years data - the track must have a time
 	if ( !isnan(t1) ) {
-		// What Year is it?
-		GDate* gdate = g_date_new ();
-		g_date_set_time_t ( gdate, (time_t)t1 );
-		guint trk_year = g_date_get_year ( gdate );
-
-		// Store track info
-		guint yi = current_year - trk_year;
+		guint yi = current_year - ts->year;
 		if ( yi < YEARS_HELD ) {
 			tracks_years[yi].count++;
-			tracks_years[yi].length += length;
-			tracks_years[yi].elev_gain += up;
-			if ( max_alt > tracks_years[yi].max_alt )
-				tracks_years[yi].max_alt = max_alt;
-			if ( !isnan(max_speed) )
-				 if ( max_speed > tracks_years[yi].max_speed )
-					 tracks_years[yi].max_speed = max_speed;
+			tracks_years[yi].length += ts->length;
+			tracks_years[yi].elev_gain += ts->elev_gain;
+			if ( ts->has_alt && ts->max_alt > tracks_years[yi].max_alt )
+				tracks_years[yi].max_alt = ts->max_alt;
+			if ( !isnan(ts->max_speed) )
+				 if ( ts->max_speed > tracks_years[yi].max_speed )
+					 tracks_years[yi].max_speed = ts->max_speed;
 		}
-		g_date_free ( gdate );
 	}
-	else
-		g_debug ( "%s: %s has no time", __FUNCTION__, trk->name );
 }
 
 /**
- * @val_analyse_track_by_months:
- * @trk: The track to be analysed
+ * @val_analyse_summary_by_months:
+ * @ts: The summary of the track to be included
  *
- * Function to collect statistics, using the internal track functions
  * All tracks passed to this function should be from the same year.
  */
-static void val_analyse_track_by_months ( VikTrack *trk )
+static void val_analyse_summary_by_months ( track_summary_t *ts )
 {
-	// NB Subsecond resolution not needed, as just using the timestamp to get dates
-	if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-		gdouble t1 = VIK_TRACKPOINT(g_list_first(trk->trackpoints)->data)->timestamp;
-
-		GDate* gdate = g_date_new ();
-		g_date_set_time_t ( gdate, (time_t)t1 );
-		GDateMonth mon = g_date_get_month ( gdate );
-		g_date_free ( gdate );
-
-		if ( mon != G_DATE_BAD_MONTH ) {
-			tracks_months[mon-1].count++;
-			tracks_months[mon-1].length += vik_track_get_length (trk);
-		}
-		else
-			g_warning ("%s: Bad month %s", __FUNCTION__, trk->name );
+	if ( ts->month != G_DATE_BAD_MONTH ) {
+		tracks_months[ts->month-1].count++;
+		tracks_months[ts->month-1].length += ts->length;
 	}
 }
 
@@ -479,99 +498,81 @@ static void table_output ( track_stats ts, GtkWidget *content[], gboolean extend
 }
 
 typedef struct {
+	GtkWidget **widgets;
+	GtkWidget *layout;
+	GtkWidget *check_button;
+	GtkWidget *check_button_times;
+	GList *tracks_and_layers;
+	VikLayer *vl;
+	gpointer user_data;
+	VikTrwlayerGetTracksAndLayersFunc get_tracks_and_layers_cb;
+	VikTrwlayerAnalyseCloseFunc on_close_cb;
+	gboolean extended;
 	gboolean include_invisible;
 	gboolean include_no_times;
-	guint year; // Only applicable for month analysis
-} track_options_t;
+	VikWindow *vw;
+	GtkTreeStore *store;
+	GtkWidget *tabs;
+	GtkWidget *sw_years;
+	GtkWidget *sw_months;
+	GtkTreeStore *store_months;
+	guint year;
+	gboolean year_selected; // Otherwise the year shown follows the latest year with data
+	guint month; // 0 = Jan, etc...
+	GHashTable *summaries; // Key (from val_summary_key()) -> track_summary_t* of all tracks analysed so far
+	GHashTable *keys;      // VikTrack* -> key of the tracks in the current list
+	GHashTable *pending;   // Keys being calculated in the background
+	GQueue *queue;         // analyse_item_t* of the tracks still to be copied for the background calculations
+	guint chunk;           // Number of tracks for each background calculation
+	guint jobs;            // Number of background calculations outstanding (including the copying)
+	gboolean closed;
+} analyse_cb_t;
 
-/**
- * val_analyse_item_maybe:
- * @vtlist: A track and the associated layer to consider for analysis
- * @data:   Whether to include invisible items
- *
- * Analyse this particular track
- *  considering whether it should be included depending on it's visibility
- */
-static void val_analyse_item_maybe ( vik_trw_and_track_t *vtlist, const gpointer data )
+static track_summary_t *val_summary_lookup ( analyse_cb_t *acb, VikTrack *trk )
 {
-	track_options_t *tot = (track_options_t*)data;
-	VikTrack *trk = vtlist->trk;
-	VikTrwLayer *vtl = vtlist->vtl;
-
-	// Safety first - items shouldn't be deleted...
-	if ( !IS_VIK_TRW_LAYER(vtl) ) return;
-	if ( !trk ) return;
-
-	if ( !tot->include_invisible ) {
-		// Skip invisible layers or sublayers
-		if ( !VIK_LAYER(vtl)->visible ||
-			 (trk->is_route && !vik_trw_layer_get_routes_visibility(vtl)) ||
-			 (!trk->is_route && !vik_trw_layer_get_tracks_visibility(vtl)) )
-			return;
-
-		// Skip invisible tracks
-		if ( !trk->visible )
-			return;
-	}
-
-	val_analyse_track ( trk, vtl, tot->include_no_times );
+	guint64 *key = g_hash_table_lookup ( acb->keys, trk );
+	return key ? g_hash_table_lookup ( acb->summaries, key ) : NULL;
 }
 
 /**
- * val_analyse_item_by_months:
- * @vtlist: A track and the associated layer to consider for analysis
- * @data:   Whether to include invisible items for the specified year
+ * val_item_included:
+ * @vtlist:            A track and the associated layer to consider for analysis
+ * @include_invisible: Whether to include invisible items
  *
- * Analyse this particular track
- *  considering whether it should be included depending on it's visibility & date
+ * Returns: Whether this particular track should be included depending on it's visibility
  */
-static void val_analyse_item_by_months ( vik_trw_and_track_t *vtlist, const gpointer data )
+static gboolean val_item_included ( vik_trw_and_track_t *vtlist, gboolean include_invisible )
 {
-	track_options_t *tot = (track_options_t*)data;
 	VikTrack *trk = vtlist->trk;
 	VikTrwLayer *vtl = vtlist->vtl;
 
 	// Safety first - items shouldn't be deleted...
-	if ( !IS_VIK_TRW_LAYER(vtl) ) return;
-	if ( !trk ) return;
+	if ( !IS_VIK_TRW_LAYER(vtl) ) return FALSE;
+	if ( !trk ) return FALSE;
 
-	if ( !tot->include_invisible ) {
+	if ( !include_invisible ) {
 		// Skip invisible layers or sublayers
 		if ( !VIK_LAYER(vtl)->visible ||
 			 (trk->is_route && !vik_trw_layer_get_routes_visibility(vtl)) ||
 			 (!trk->is_route && !vik_trw_layer_get_tracks_visibility(vtl)) )
-			return;
+			return FALSE;
 
 		// Skip invisible tracks
 		if ( !trk->visible )
-			return;
-	}
-
-	// Is the track of this year?
-	if ( trk->trackpoints && !isnan(VIK_TRACKPOINT(trk->trackpoints->data)->timestamp) ) {
-		gdouble t1 = VIK_TRACKPOINT(g_list_first(trk->trackpoints)->data)->timestamp;
-		GDate* gdate = g_date_new ();
-		g_date_set_time_t ( gdate, (time_t)t1 );
-		guint trk_year = g_date_get_year ( gdate );
-		g_date_free ( gdate );
-
-		if ( trk_year == tot->year )
-			val_analyse_track_by_months ( trk );
+			return FALSE;
 	}
+	return TRUE;
 }
 
 /**
  * val_analyse:
- * @widgets:           The widget layout
- * @tracks_and_layers: A list of #vik_trw_and_track_t
- * @include_invisible: Whether to include invisible layers and tracks
- * @include_no_times: Whether tracks with no times should be included
- * @extended: Whether this is an extended table output
+ * @acb: The dialog data, with the list of #vik_trw_and_track_t and the options to use
  *
- * Analyse each item in the @tracks_and_layers list
+ * Reduce the statistics from the summary of each analysed item in the list
+ *  (any item still being calculated is not included yet)
  *
  */
-static void val_analyse ( GtkWidget *widgets[], GList *tracks_and_layers, gboolean include_invisible, gboolean include_no_times, gboolean extended )
+static void val_analyse ( analyse_cb_t *acb )
 {
 	val_reset ( TS_TRACKS );
 	val_reset_years ( );
@@ -583,18 +584,19 @@ static void val_analyse ( GtkWidget *widgets[], GList *tracks_and_layers, gboole
 		g_date_free ( gdate );
 	}
 
-	track_options_t *tot = g_malloc0 (sizeof(track_options_t));
-	tot->include_invisible = include_invisible;
-	tot->include_no_times  = include_no_times;
-	GList *gl = g_list_first ( tracks_and_layers );
-	if ( gl ) {
-		g_list_foreach ( gl, (GFunc)val_analyse_item_maybe, tot );
+	for ( GList *gl = acb->tracks_and_layers; gl != NULL; gl = g_list_next(gl) ) {
+		vik_trw_and_track_t *vtlist = (vik_trw_and_track_t*)gl->data;
+		if ( !val_item_included ( vtlist, acb->include_invisible ) )
+			continue;
+		track_summary_t *ts = val_summary_lookup ( acb, vtlist->trk );
+		if ( ts )
+			val_analyse_summary ( ts, acb->include_no_times );
 	}
-	g_free ( tot );
 
-	table_output ( tracks_stats[TS_TRACKS], widgets, extended );
+	table_output ( tracks_stats[TS_TRACKS], acb->widgets, acb->extended );
 
 	g_list_free_full ( tracks_stats[TS_TRACKS].e_list, g_free );
+	tracks_stats[TS_TRACKS].e_list = NULL;
 
 	// Years info...
 	if ( vik_debug ) {
@@ -606,49 +608,29 @@ static void val_analyse ( GtkWidget *widgets[], GList *tracks_and_layers, gboole
 }
 
 // Analyse the specified year
-static void val_analyse_months ( GList *tracks_and_layers, guint year, gboolean include_invisible )
+static void val_analyse_months ( analyse_cb_t *acb )
 {
 	val_reset_months ( );
 
-	track_options_t *tot = g_malloc0 (sizeof(track_options_t));
-	tot->include_invisible = include_invisible;
-	tot->year = year;
-	GList *gl = g_list_first ( tracks_and_layers );
-	if ( gl )
-		g_list_foreach ( gl, (GFunc)val_analyse_item_by_months, tot );
-	g_free ( tot );
+	for ( GList *gl = acb->tracks_and_layers; gl != NULL; gl = g_list_next(gl) ) {
+		vik_trw_and_track_t *vtlist = (vik_trw_and_track_t*)gl->data;
+		if ( !val_item_included ( vtlist, acb->include_invisible ) )
+			continue;
+		track_summary_t *ts = val_summary_lookup ( acb, vtlist->trk );
+		// Is the track of this year?
+		if ( ts && !isnan(ts->start_time) && ts->year == acb->year )
+			val_analyse_summary_by_months ( ts );
+	}
 
 	// Months info...
 	if ( vik_debug ) {
 		for ( guint mi = 0; mi < 12; mi++ ) {
 			if ( tracks_months[mi].count > 0 )
-				g_printf ( "%s: %d: %d %d %5.2f %5.1f %d\n", __FUNCTION__, year, tracks_months[mi].count, (gint)tracks_months[mi].max_alt, tracks_months[mi].max_speed, tracks_months[mi].length/1000, (gint)tracks_months[mi].elev_gain );
+				g_printf ( "%s: %d: %d %d %5.2f %5.1f %d\n", __FUNCTION__, acb->year, tracks_months[mi].count, (gint)tracks_months[mi].max_alt, tracks_months[mi].max_speed, tracks_months[mi].length/1000, (gint)tracks_months[mi].elev_gain );
 		}
 	}
 }
 
-typedef struct {
-	GtkWidget **widgets;
-	GtkWidget *layout;
-	GtkWidget *check_button;
-	GtkWidget *check_button_times;
-	GList *tracks_and_layers;
-	VikLayer *vl;
-	gpointer user_data;
-	VikTrwlayerGetTracksAndLayersFunc get_tracks_and_layers_cb;
-	VikTrwlayerAnalyseCloseFunc on_close_cb;
-	gboolean extended;
-	gboolean include_invisible;
-	gboolean include_no_times;
-	VikWindow *vw;
-	GtkTreeStore *store;
-	GtkWidget *tabs;
-	GtkWidget *sw_months;
-	GtkTreeStore *store_months;
-	guint year;
-	guint month; // 0 = Jan, etc...
-} analyse_cb_t;
-
 #define YEARS_COLS 4
 
 static void years_copy_all ( GtkWidget *tree_view )
@@ -752,13 +734,12 @@ static gboolean years_button_released ( GtkWidget *tree_view,
 		return FALSE;
 
 	gtk_tree_model_get ( model, &iter, 0, &acb->year, -1 );
+	acb->year_selected = TRUE;
 	gchar *label = g_strdup_printf ( "%d", acb->year );
 	gtk_notebook_set_tab_label_text ( GTK_NOTEBOOK(acb->tabs), acb->sw_months, label );
 	g_free ( label );
 
-	vik_window_set_busy_cursor ( acb->vw );
-	val_analyse_months ( acb->tracks_and_layers, acb->year, acb->include_invisible );
-	vik_window_clear_busy_cursor ( acb->vw );
+	val_analyse_months ( acb );
 
 	months_update_store ( acb->store_months );
 
@@ -845,6 +826,277 @@ static void years_display_build ( analyse_cb_t *acb, GtkWidget* scrolledwindow )
 	gtk_container_add ( GTK_CONTAINER(scrolledwindow), view );
 }
 
+/**
+ * analyse_update_pages:
+ *
+ * Only show the per Year and per Month tabs when there is something interesting in them
+ */
+static void analyse_update_pages ( analyse_cb_t *acb )
+{
+	guint num_yrs = 0;
+	for ( guint yi = 0; yi < YEARS_HELD; yi++ )
+		if ( tracks_years[yi].count > 0 )
+			num_yrs++;
+
+	guint num_months = 0;
+	for ( guint mi = 0; mi < 12; mi++ )
+		if ( tracks_months[mi].count > 0 )
+			num_months++;
+
+	gboolean show_years = num_yrs > 1;
+	gboolean show_months = num_yrs > 1 || num_months > 1;
+	gtk_widget_set_visible ( acb->sw_years, show_years );
+	gtk_widget_set_visible ( acb->sw_months, show_months );
+	gtk_notebook_set_show_tabs ( GTK_NOTEBOOK(acb->tabs), show_years || show_months );
+	gtk_notebook_set_show_border ( GTK_NOTEBOOK(acb->tabs), show_years || show_months );
+}
+
+/**
+ * analyse_update:
+ *
+ * Recompute all the displayed values from the track summaries available so far
+ */
+static void analyse_update ( analyse_cb_t *acb )
+{
+	val_analyse ( acb );
+
+	if ( !acb->year_selected ) {
+		// Get latest year with data
+		acb->year = current_year;
+		for ( guint yi = 0; yi < YEARS_HELD; yi++ )
+			if ( tracks_years[yi].count > 0 ) {
+				acb->year = current_year-yi;
+				break;
+			}
+		gchar *label = g_strdup_printf ( "%d", acb->year );
+		gtk_notebook_set_tab_label_text ( GTK_NOTEBOOK(acb->tabs), acb->sw_months, label );
+		g_free ( label );
+	}
+	val_analyse_months ( acb );
+
+	years_update_store ( acb->store );
+	months_update_store ( acb->store_months );
+
+	gtk_widget_show_all ( acb->layout );
+	analyse_update_pages ( acb );
+}
+
+static void analyse_free ( analyse_cb_t *acb )
+{
+	g_free ( acb->widgets );
+	g_list_free_full ( acb->tracks_and_layers, g_free );
+	if ( acb->store )
+		g_object_unref ( acb->store );
+	if ( acb->store_months )
+		g_object_unref ( acb->store_months );
+	g_hash_table_destroy ( acb->summaries );
+	g_hash_table_destroy ( acb->keys );
+	g_hash_table_destroy ( acb->pending );
+	g_free ( acb );
+}
+
+// The background calculations work on copies of the tracks,
+//  as the originals may be changed or deleted whilst the (non modal) dialog is open
+// The copies are made a slice at a time by analyse_feed(),
+//  so the dialog stays responsive however many trackpoints there are
+typedef struct {
+	guint64 key;
+	VikTrack *trk; // A reference to the original whilst queued, then the copy
+	gboolean prefer_gps_speed;
+} analyse_item_t;
+
+typedef struct {
+	analyse_cb_t *acb;
+	analyse_item_t *items;
+	track_summary_t *summaries;
+	guint size;
+	guint n;
+	guint done;
+} analyse_job_t;
+
+static analyse_job_t *analyse_job_new ( analyse_cb_t *acb, guint size )
+{
+	analyse_job_t *aj = g_malloc0 ( sizeof(analyse_job_t) );
+	aj->acb = acb;
+	aj->size = size;
+	aj->items = g_new ( analyse_item_t, size );
+	aj->summaries = g_new ( track_summary_t, size );
+	return aj;
+}
+
+// In the main thread
+static gboolean analyse_job_done ( analyse_job_t *aj )
+{
+	analyse_cb_t *acb = aj->acb;
+	acb->jobs--;
+
+	if ( acb->closed ) {
+		if ( acb->jobs == 0 )
+			analyse_free ( acb );
+	}
+	else {
+		for ( guint ii = 0; ii < aj->n; ii++ ) {
+			g_hash_table_remove ( acb->pending, &aj->items[ii].key );
+			if ( ii < aj->done ) {
+				track_summary_t *ts = g_malloc ( sizeof(track_summary_t) );
+				*ts = aj->summaries[ii];
+				g_hash_table_replace ( acb->summaries, g_memdup(&aj->items[ii].key, sizeof(guint64)), ts );
+			}
+		}
+		// Show the results so far
+		analyse_update ( acb );
+	}
+
+	for ( guint ii = 0; ii < aj->n; ii++ )
+		vik_track_free ( aj->items[ii].trk );
+	g_free ( aj->items );
+	g_free ( aj->summaries );
+	g_free ( aj );
+	return FALSE;
+}
+
+// NB This is called when the job finishes for whatever reason (i.e. including when cancelled)
+//  so it always hands back to the main thread
+static void analyse_job_finish ( analyse_job_t *aj )
+{
+	(void)gdk_threads_add_idle ( (GSourceFunc)analyse_job_done, aj );
+}
+
+static gint analyse_thread ( analyse_job_t *aj, gpointer threaddata )
+{
+	for ( guint ii = 0; ii < aj->n; ii++ ) {
+		gint res = a_background_thread_progress ( threaddata, (gdouble)ii/(gdouble)aj->n );
+		if ( res != 0 ) return -1;
+		val_summarise_track ( aj->items[ii].trk, aj->items[ii].prefer_gps_speed, &aj->summaries[ii] );
+		aj->done = ii+1;
+	}
+	return 0;
+}
+
+static void analyse_job_start ( analyse_job_t *aj )
+{
+	aj->acb->jobs++;
+	a_background_thread ( BACKGROUND_POOL_LOCAL,
+	                      GTK_WINDOW(aj->acb->vw),
+	                      _("Track Statistics"),
+	                      (vik_thr_func)analyse_thread,
+	                      aj,
+	                      (vik_thr_free_func)analyse_job_finish,
+	                      NULL,
+	                      aj->n );
+}
+
+// Below this number of tracks it's not worth the overhead of using the background threads
+#define ANALYSE_SYNC_LIMIT 250
+#define ANALYSE_CHUNK_MIN 100
+// Trackpoints copied in each go in the main thread
+#define ANALYSE_FEED_POINTS 20000
+
+/**
+ * analyse_feed:
+ *
+ * Copy some of the queued tracks and start the background calculations on them
+ * In the main thread, as the tracks can only be safely read from here
+ *
+ * Returns: FALSE once all the tracks have been handed over (or the dialog has been closed)
+ */
+static gboolean analyse_feed ( analyse_cb_t *acb )
+{
+	guint points = 0;
+	analyse_job_t *aj = NULL;
+	while ( !acb->closed && points < ANALYSE_FEED_POINTS && !g_queue_is_empty(acb->queue) ) {
+		if ( !aj )
+			aj = analyse_job_new ( acb, MIN(acb->chunk, g_queue_get_length(acb->queue)) );
+		analyse_item_t *item = g_queue_pop_head ( acb->queue );
+		// Copy the track as it is now, even if it has changed since it was queued,
+		//  as that is still what should be shown for it until the list is next calculated
+		VikTrack *orig = item->trk;
+		item->trk = vik_track_copy ( orig, TRUE );
+		vik_track_free ( orig );
+		points += vik_track_get_tp_count ( item->trk );
+		aj->items[aj->n++] = *item;
+		g_free ( item );
+		if ( aj->n == aj->size ) {
+			analyse_job_start ( aj );
+			aj = NULL;
+		}
+	}
+	if ( aj )
+		analyse_job_start ( aj );
+
+	if ( !acb->closed && !g_queue_is_empty(acb->queue) )
+		return TRUE;
+
+	while ( !g_queue_is_empty(acb->queue) ) {
+		analyse_item_t *item = g_queue_pop_head ( acb->queue );
+		vik_track_free ( item->trk );
+		g_free ( item );
+	}
+	g_queue_free ( acb->queue );
+	acb->queue = NULL;
+	acb->jobs--;
+	if ( acb->closed && acb->jobs == 0 )
+		analyse_free ( acb );
+	return FALSE;
+}
+
+/**
+ * analyse_calculate:
+ *
+ * Calculate the summary of every track in the list that has not already been analysed.
+ * For many tracks this is split into chunks that are processed in parallel by the background threads,
+ *  and the display is updated as each chunk completes.
+ * Only the track revisions are looked at here, the trackpoints are copied later by analyse_feed().
+ */
+static void analyse_calculate ( analyse_cb_t *acb )
+{
+	// Tracks may have been changed since last time, so always get the current keys
+	g_hash_table_remove_all ( acb->keys );
+	GArray *todo = g_array_new ( FALSE, FALSE, sizeof(vik_trw_and_track_t) );
+	for ( GList *gl = acb->tracks_and_layers; gl != NULL; gl = g_list_next(gl) ) {
+		vik_trw_and_track_t *vtt = (vik_trw_and_track_t*)gl->data;
+		if ( !vtt->trk || !IS_VIK_TRW_LAYER(vtt->vtl) )
+			continue;
+		guint64 key = val_summary_key ( vtt->trk, vik_trw_layer_get_prefer_gps_speed(vtt->vtl) );
+		g_hash_table_replace ( acb->keys, vtt->trk, g_memdup(&key, sizeof(guint64)) );
+		if ( !g_hash_table_contains ( acb->summaries, &key ) && !g_hash_table_contains ( acb->pending, &key ) ) {
+			g_hash_table_add ( acb->pending, g_memdup(&key, sizeof(guint64)) );
+			g_array_append_val ( todo, *vtt );
+		}
+	}
+
+	if ( todo->len < ANALYSE_SYNC_LIMIT ) {
+		for ( guint ii = 0; ii < todo->len; ii++ ) {
+			vik_trw_and_track_t *vtt = &g_array_index ( todo, vik_trw_and_track_t, ii );
+			guint64 *key = g_hash_table_lookup ( acb->keys, vtt->trk );
+			g_hash_table_remove ( acb->pending, key );
+			track_summary_t *ts = g_malloc ( sizeof(track_summary_t) );
+			val_summarise_track ( vtt->trk, vik_trw_layer_get_prefer_gps_speed(vtt->vtl), ts );
+			g_hash_table_replace ( acb->summaries, g_memdup(key, sizeof(guint64)), ts );
+		}
+		g_array_free ( todo, TRUE );
+		return;
+	}
+
+	// Several chunks per thread, so results appear progressively
+	acb->chunk = MAX ( ANALYSE_CHUNK_MIN, todo->len / (4*util_get_number_of_cpus()) + 1 );
+	if ( !acb->queue ) {
+		acb->queue = g_queue_new ();
+		acb->jobs++;
+		(void)gdk_threads_add_idle ( (GSourceFunc)analyse_feed, acb );
+	}
+	for ( guint ii = 0; ii < todo->len; ii++ ) {
+		vik_trw_and_track_t *vtt = &g_array_index ( todo, vik_trw_and_track_t, ii );
+		analyse_item_t *item = g_malloc ( sizeof(analyse_item_t) );
+		item->key = *(guint64*)g_hash_table_lookup ( acb->keys, vtt->trk );
+		item->trk = vtt->trk;
+		vik_track_ref ( item->trk );
+		item->prefer_gps_speed = vik_trw_layer_get_prefer_gps_speed ( vtt->vtl );
+		g_queue_push_tail ( acb->queue, item );
+	}
+	g_array_free ( todo, TRUE );
+}
+
 static void include_no_times_toggled_cb ( GtkToggleButton *togglebutton, analyse_cb_t *acb )
 {
 	gboolean value = FALSE;
@@ -852,14 +1104,10 @@ static void include_no_times_toggled_cb ( GtkToggleButton *togglebutton, analyse
 		value = TRUE;
 	acb->include_no_times = value;
 
-	// NB no change to the track list
+	// NB no change to the track list, so nothing new to calculate
 	// NB2 This option has no effect on the per Year output
 
-	vik_window_set_busy_cursor ( acb->vw );
-	val_analyse ( acb->widgets, acb->tracks_and_layers, acb->include_invisible, acb->include_no_times, acb->extended );
-	vik_window_clear_busy_cursor ( acb->vw );
-
-	gtk_widget_show_all ( acb->layout );
+	analyse_update ( acb );
 }
 
 static void include_invisible_toggled_cb ( GtkToggleButton *togglebutton, analyse_cb_t *acb )
@@ -877,18 +1125,12 @@ static void include_invisible_toggled_cb ( GtkToggleButton *togglebutton, analys
 
 	acb->include_invisible = value;
 
+	// Only tracks not previously seen need calculating
 	vik_window_set_busy_cursor ( acb->vw );
-	val_analyse ( acb->widgets, acb->tracks_and_layers, acb->include_invisible, acb->include_no_times, acb->extended );
-	if ( acb->store_months )
-		val_analyse_months ( acb->tracks_and_layers, acb->year, acb->include_invisible );
+	analyse_calculate ( acb );
 	vik_window_clear_busy_cursor ( acb->vw );
 
-	if ( acb->store )
-		years_update_store ( acb->store );
-	if ( acb->store_months )
-		months_update_store ( acb->store_months );
-
-	gtk_widget_show_all ( acb->layout );
+	analyse_update ( acb );
 }
 
 #define MONTHS_COLS 5
@@ -1083,8 +1325,19 @@ static void months_display_build ( analyse_cb_t *acb, GtkWidget* scrolledwindow
  * Multi stage closure - as we need to clear allocations made here
  *  before passing on to the callee so they know when the dialog is closed too
  */
+// The dialog may get destroyed without a response (e.g. via the parent window)
+//  so ensure any subsequent background results don't attempt to update it
+static void analyse_destroyed ( GtkWidget *dialog, analyse_cb_t *data )
+{
+	data->closed = TRUE;
+	if ( data->jobs == 0 )
+		analyse_free ( data );
+}
+
 static void analyse_close ( GtkWidget *dialog, gint resp, analyse_cb_t *data )
 {
+	g_signal_handlers_disconnect_by_func ( G_OBJECT(dialog), G_CALLBACK(analyse_destroyed), data );
+
 	// Save current invisible value for next time
 	gboolean do_invisible = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(data->check_button) );
 	a_settings_set_boolean ( VIK_SETTINGS_ANALYSIS_DO_INVISIBLE, do_invisible );
@@ -1092,17 +1345,13 @@ static void analyse_close ( GtkWidget *dialog, gint resp, analyse_cb_t *data )
 	gboolean do_no_times = gtk_toggle_button_get_active ( GTK_TOGGLE_BUTTON(data->check_button_times) );
 	a_settings_set_boolean ( VIK_SETTINGS_ANALYSIS_DO_NO_TIMES, do_no_times );
 
-	//g_free ( data->layout );
-	g_free ( data->widgets );
-	g_list_free_full ( data->tracks_and_layers, g_free );
-
-	if ( data->store )
-		g_object_unref ( data->store );
-
 	if ( data->on_close_cb )
 		data->on_close_cb ( dialog, resp, data->vl );
 
-	g_free ( data );
+	// Any outstanding background calculations need to finish with the data first
+	data->closed = TRUE;
+	if ( data->jobs == 0 )
+		analyse_free ( data );
 }
 
 /**
@@ -1161,63 +1410,31 @@ GtkWidget* vik_trw_layer_analyse_this ( GtkWindow *window,
 	acb->include_invisible = include_invisible;
 	acb->include_no_times = include_no_times;
 
-	// Analysis seems reasonably quick
-	//  unless you have really large numbers of tracks (i.e. many many thousands or a really slow computer)
-	// One day might store stats in the track itself....
-	vik_window_set_busy_cursor ( acb->vw );
-	val_analyse ( acb->widgets, acb->tracks_and_layers, include_invisible, include_no_times, acb->extended );
-
-	guint num_yrs = 0;
-	for ( guint yi = 0; yi < YEARS_HELD; yi++ )
-		if ( tracks_years[yi].count > 0 )
-			num_yrs++;
-
-	guint num_months = 0;
-	for ( guint mi = 0; mi < 12; mi++ )
-		if ( tracks_months[mi].count > 0 )
-			num_months++;
+	acb->summaries = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, g_free );
+	acb->keys = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+	acb->pending = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
 
-	acb->year = current_year;
-	if ( num_yrs > 0 ) {
-		// Get latest year with data
-		for ( guint yi = 0; yi < YEARS_HELD; yi++ )
-			if ( tracks_years[yi].count > 0 ) {
-				acb->year = current_year-yi;
-				break;
-			}
-	}
-	val_analyse_months ( acb->tracks_and_layers, acb->year, include_invisible );
-
-	// Years or months to be shown, so put infomation into tabs
-	if ( num_yrs > 1 || num_months > 1 ) {
-		acb->tabs = gtk_notebook_new();
-		gtk_notebook_append_page ( GTK_NOTEBOOK(acb->tabs), acb->layout, gtk_label_new(_("Totals")) );
-		gtk_box_pack_start ( GTK_BOX(content), acb->tabs, TRUE, TRUE, 0 );
-	} else
-		gtk_box_pack_start ( GTK_BOX(content), acb->layout, TRUE, TRUE, 0 );
-
-	if ( num_yrs > 1 ) {
-		// Multiple Years so show per year info as well
-		GtkWidget *scrolledwindow = gtk_scrolled_window_new ( NULL, NULL );
-		gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(scrolledwindow), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
-		gtk_notebook_append_page ( GTK_NOTEBOOK(acb->tabs), scrolledwindow, gtk_label_new(_("Years")) );
-
-		years_display_build ( acb, scrolledwindow );
-		years_update_store ( acb->store );
-	}
+	// Analysis of each track is only performed once and then cached for the lifetime of the dialog (unless the track changes)
+	//  with large numbers of tracks this is done in the background, with the display updated as results arrive
+	vik_window_set_busy_cursor ( acb->vw );
+	analyse_calculate ( acb );
+	vik_window_clear_busy_cursor ( acb->vw );
 
-	if ( num_yrs > 1 || num_months > 1 ) {
-		acb->sw_months = gtk_scrolled_window_new ( NULL, NULL );
-		gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(acb->sw_months), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
-		gchar *label = g_strdup_printf ( "%d", acb->year );
-		gtk_notebook_append_page ( GTK_NOTEBOOK(acb->tabs), acb->sw_months, gtk_label_new(label) );
-		g_free ( label );
+	// Years or months maybe shown, so put infomation into tabs
+	//  (which are hidden if there is only the totals to show)
+	acb->tabs = gtk_notebook_new();
+	gtk_notebook_append_page ( GTK_NOTEBOOK(acb->tabs), acb->layout, gtk_label_new(_("Totals")) );
+	gtk_box_pack_start ( GTK_BOX(content), acb->tabs, TRUE, TRUE, 0 );
 
-		months_display_build ( acb, acb->sw_months );
-		months_update_store ( acb->store_months );
-	}
+	acb->sw_years = gtk_scrolled_window_new ( NULL, NULL );
+	gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(acb->sw_years), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
+	gtk_notebook_append_page ( GTK_NOTEBOOK(acb->tabs), acb->sw_years, gtk_label_new(_("Years")) );
+	years_display_build ( acb, acb->sw_years );
 
-	vik_window_clear_busy_cursor ( acb->vw );
+	acb->sw_months = gtk_scrolled_window_new ( NULL, NULL );
+	gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(acb->sw_months), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
+	gtk_notebook_append_page ( GTK_NOTEBOOK(acb->tabs), acb->sw_months, gtk_label_new(NULL) );
+	months_display_build ( acb, acb->sw_months );
 
 	GtkWidget *cb = gtk_check_button_new_with_label ( _("Include Invisible Items") );
 	gtk_toggle_button_set_active ( GTK_TOGGLE_BUTTON(cb), include_invisible );
@@ -1231,9 +1448,13 @@ GtkWidget* vik_trw_layer_analyse_this ( GtkWindow *window,
 
 	gtk_widget_show_all ( dialog );
 
+	// Show whatever has been calculated so far
+	analyse_update ( acb );
+
 	g_signal_connect ( G_OBJECT(cb), "toggled", G_CALLBACK(include_invisible_toggled_cb), acb );
 	g_signal_connect ( G_OBJECT(cbt), "toggled", G_CALLBACK(include_no_times_toggled_cb), acb );
 	g_signal_connect ( G_OBJECT(dialog), "response", G_CALLBACK(analyse_close), acb );
+	g_signal_connect ( G_OBJECT(dialog), "destroy", G_CALLBACK(analyse_destroyed), acb );
 
 	return dialog;
 }
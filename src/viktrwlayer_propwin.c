@@ -26,6 +26,7 @@
 #include "dems.h"
 #include "degrees_converters.h"
 #include "astronomy.h"
+#include "background.h"
 
 #ifdef HAVE_LIBNOVA_LIBNOVA_H
 #include <libnova/libnova.h>
@@ -90,7 +91,6 @@ typedef struct _propsaved {
 
 typedef gpointer ui_change_values[UI_CHG_LAST];
 
-typedef gdouble* (*make_map_func) (const VikTrack*, guint16);
 typedef void (*convert_values_func) (gdouble* values, guint profile_width);
 typedef void (*get_y_text_func) (gchar* ss, guint size, gdouble value);
 #if GTK_CHECK_VERSION (3,0,0)
@@ -100,6 +100,25 @@ typedef void (*draw_extra_func) (gpointer widgets, GtkWidget *window, GdkPixmap
 #endif
 typedef void (*button_update_func) (VikTrackpoint* trackpoint, gpointer widgets, gdouble from_start, guint ix, VikPropWinGraphType_t pwgt);
 
+// Each graph series is kept at a few resolutions, each half the previous one,
+//  so any graph up to the largest width can be resampled from one at most twice as wide
+#define PROFILE_CACHE_BASE_CHUNKS 4096
+#define PROFILE_CACHE_LEVELS 4
+
+typedef struct {
+  guint     revision; // Of the track that the series were made from
+  gboolean  done[PGT_END]; // NB series may still be NULL (e.g. no times in the track)
+  gdouble   *series[PGT_END][PROFILE_CACHE_LEVELS];
+} ProfileCache;
+
+typedef struct _profilejob ProfileJob;
+
+// The nearest trackpoint for each x pixel position of a graph
+typedef struct {
+  GList   *tpl;
+  gdouble from_start; // Metres or seconds, depending on the type of graph
+} GraphPos;
+
 typedef struct _propwidgets {
   gboolean  configure_dialog;
   VikTrwLayer *vtl;
@@ -150,7 +169,15 @@ typedef struct _propwidgets {
   guint     user_cia; // Chunk size set by the user (only for altitude graph ATM)
   gdouble   user_mina;
   gdouble   **values;
-  make_map_func make_map[PGT_END];
+  ProfileCache *cache;
+  ProfileJob *job; // Whilst the cache is being made
+  // Hovering over the graphs uses these rather than working out the nearest trackpoint on every mouse movement
+  // Index by is_time_graph(); remade when the graphs are redrawn or the track is changed
+  GraphPos  *graph_pos[2];
+  guint     graph_pos_width[2];
+  guint     graph_pos_revision; // Of the track they were made from
+  gdouble   marker_pc[2];
+  gboolean  marker_pc_valid[2];
   convert_values_func convert_values[PGT_END];
   get_y_text_func get_y_text[PGT_END];
   draw_extra_func draw_extra[PGT_END];
@@ -177,6 +204,249 @@ static gboolean split_at_marker ( PropWidgets *widgets );
 static void draw_all_graphs ( GtkWidget *widget, PropWidgets *widgets, gboolean resized );
 static GtkWidget *create_statistics_page ( PropWidgets *widgets, VikTrack *tr );
 
+struct _profilejob {
+  PropWidgets  *widgets; // NULL once the widgets have been freed
+  VikTrack     *orig;    // Reference held so the DEM profile can be stored with it
+  VikTrack     *trk;     // Private copy, so the track can be edited whilst this runs
+  guint        revision; // Of the original when copied
+  ProfileCache *pc;      // NULL when only the DEM profile is wanted
+  gboolean     wanted[PGT_END];
+  gboolean     want_dem;
+  guint        count;    // Of those wanted
+  VikTrackDEMProfile *dem;
+  gboolean     cancelled;
+};
+
+static gdouble *profile_make_map ( const VikTrack *trk, VikPropWinGraphType_t pwgt, guint16 num_chunks )
+{
+  switch ( pwgt ) {
+  case PGT_ELEVATION_DISTANCE: return vik_track_make_elevation_map ( trk, num_chunks );
+  case PGT_GRADIENT_DISTANCE:  return vik_track_make_gradient_map ( trk, num_chunks );
+  case PGT_SPEED_TIME:         return vik_track_make_speed_map ( trk, num_chunks );
+  case PGT_DISTANCE_TIME:      return vik_track_make_distance_map ( trk, num_chunks );
+  case PGT_ELEVATION_TIME:     return vik_track_make_time_map_for ( trk, num_chunks, TRACK_VALUE_ELEVATION );
+  case PGT_SPEED_DISTANCE:     return vik_track_make_speed_dist_map ( trk, num_chunks );
+  case PGT_HEART_RATE:         return vik_track_make_time_map_for ( trk, num_chunks, TRACK_VALUE_HEART_RATE );
+  case PGT_CADENCE:            return vik_track_make_time_map_for ( trk, num_chunks, TRACK_VALUE_CADENCE );
+  case PGT_TEMP:               return vik_track_make_time_map_for ( trk, num_chunks, TRACK_VALUE_TEMP );
+  case PGT_POWER:              return vik_track_make_time_map_for ( trk, num_chunks, TRACK_VALUE_POWER );
+  default: return NULL;
+  }
+}
+
+/**
+ * The distance-time values are a running total (taken at the start of each chunk),
+ *  whereas all the others are averages over each chunk
+ */
+static gboolean profile_is_cumulative ( VikPropWinGraphType_t pwgt )
+{
+  return pwgt == PGT_DISTANCE_TIME;
+}
+
+static void profile_cache_free ( ProfileCache *pc )
+{
+  if ( !pc )
+    return;
+  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ )
+    for ( guint lv = 0; lv < PROFILE_CACHE_LEVELS; lv++ )
+      g_free ( pc->series[pwgt][lv] );
+  g_free ( pc );
+}
+
+static inline gdouble profile_mean ( gdouble aa, gdouble bb )
+{
+  if ( isnan(aa) )
+    return bb;
+  if ( isnan(bb) )
+    return aa;
+  return (aa + bb) / 2;
+}
+
+/**
+ * Take ownership of the series made at PROFILE_CACHE_BASE_CHUNKS and derive the smaller resolutions
+ */
+static void profile_cache_set ( ProfileCache *pc, VikPropWinGraphType_t pwgt, gdouble *base )
+{
+  pc->series[pwgt][0] = base;
+  pc->done[pwgt] = TRUE;
+  if ( !base )
+    return;
+  guint len = PROFILE_CACHE_BASE_CHUNKS;
+  for ( guint lv = 1; lv < PROFILE_CACHE_LEVELS; lv++ ) {
+    const gdouble *prev = pc->series[pwgt][lv-1];
+    len /= 2;
+    gdouble *vals = g_malloc ( sizeof(gdouble) * len );
+    for ( guint ii = 0; ii < len; ii++ )
+      vals[ii] = profile_is_cumulative(pwgt) ? prev[2*ii] : profile_mean ( prev[2*ii], prev[2*ii+1] );
+    pc->series[pwgt][lv] = vals;
+  }
+}
+
+/**
+ * Returns: A newly allocated array of @width values, from the smallest cached resolution at least that wide
+ *  Invalid (NAN) values are ignored when averaging, unless that is all there is
+ */
+static gdouble *profile_cache_resample ( const ProfileCache *pc, VikPropWinGraphType_t pwgt, guint width )
+{
+  guint lv = 0;
+  guint len = PROFILE_CACHE_BASE_CHUNKS;
+  while ( lv + 1 < PROFILE_CACHE_LEVELS && len / 2 >= width ) {
+    lv++;
+    len /= 2;
+  }
+  const gdouble *src = pc->series[pwgt][lv];
+  if ( !src )
+    return NULL;
+
+  gdouble *vals = g_malloc ( sizeof(gdouble) * width );
+  const gdouble step = (gdouble)len / width;
+  for ( guint ii = 0; ii < width; ii++ ) {
+    gdouble start = ii * step;
+    gdouble end = start + step;
+    if ( profile_is_cumulative(pwgt) ) {
+      vals[ii] = src[MIN((guint)start, len-1)];
+      continue;
+    }
+    gdouble sum = 0.0;
+    gdouble weight = 0.0;
+    for ( guint jj = (guint)start; jj < len && jj < end; jj++ ) {
+      if ( isnan(src[jj]) )
+        continue;
+      gdouble ww = MIN(end, jj+1) - MAX(start, jj);
+      sum += ww * src[jj];
+      weight += ww;
+    }
+    vals[ii] = weight > 0.0 ? sum / weight : NAN;
+  }
+  return vals;
+}
+
+// Runs in a background thread
+static void profile_job_thread ( ProfileJob *job, gpointer threaddata );
+
+/**
+ * Start making the cache in the background, unless already doing so
+ *  in the meantime the values get calculated directly (as before)
+ */
+static void profile_job_start ( PropWidgets *widgets, gboolean series, gboolean dem )
+{
+  if ( widgets->job || !widgets->tr || !widgets->tr->trackpoints )
+    return;
+  if ( !series && !dem )
+    return;
+
+  ProfileJob *job = g_malloc0 ( sizeof(ProfileJob) );
+  job->widgets = widgets;
+  job->orig = widgets->tr;
+  vik_track_ref ( job->orig );
+  job->trk = vik_track_copy ( widgets->tr, TRUE );
+  job->revision = widgets->tr->revision;
+  if ( series ) {
+    job->pc = g_malloc0 ( sizeof(ProfileCache) );
+    job->pc->revision = job->revision;
+    for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ ) {
+      // Speeds are always needed for the extra drawing on other graphs
+      job->wanted[pwgt] = widgets->event_box[pwgt] || pwgt == PGT_SPEED_TIME;
+      if ( job->wanted[pwgt] )
+        job->count++;
+    }
+  }
+  job->want_dem = dem;
+  if ( dem )
+    job->count++;
+  widgets->job = job;
+
+  gchar *msg = g_strdup_printf ( _("Track profile: %s"), widgets->tr->name );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        VIK_GTK_WINDOW_FROM_LAYER(widgets->vtl),
+                        msg,
+                        (vik_thr_func)profile_job_thread,
+                        job,
+                        NULL, // Freed in profile_job_done()
+                        NULL,
+                        job->count );
+  g_free ( msg );
+}
+
+// Back in the main thread
+static gboolean profile_job_done ( ProfileJob *job )
+{
+  PropWidgets *widgets = job->widgets;
+  if ( widgets ) {
+    widgets->job = NULL;
+    if ( !job->cancelled && job->pc ) {
+      profile_cache_free ( widgets->cache );
+      widgets->cache = job->pc;
+      job->pc = NULL;
+    }
+  }
+  // Keep for any later use, even if the dialog has gone (e.g. applying DEM data)
+  if ( job->dem )
+    vik_track_set_dem_profile ( job->orig, job->dem );
+  profile_cache_free ( job->pc );
+  vik_track_free ( job->trk );
+  vik_track_free ( job->orig );
+  g_free ( job );
+  return FALSE;
+}
+
+static void profile_job_thread ( ProfileJob *job, gpointer threaddata )
+{
+  guint done = 0;
+  for ( VikPropWinGraphType_t pwgt = 0; pwgt < PGT_END; pwgt++ ) {
+    if ( !job->wanted[pwgt] )
+      continue;
+    if ( a_background_testcancel(threaddata) ) {
+      job->cancelled = TRUE;
+      break;
+    }
+    profile_cache_set ( job->pc, pwgt, profile_make_map(job->trk, pwgt, PROFILE_CACHE_BASE_CHUNKS) );
+    (void)a_background_thread_progress ( threaddata, (gdouble)++done / job->count );
+  }
+  if ( job->want_dem && !job->cancelled && !a_background_testcancel(threaddata) ) {
+    job->dem = vik_track_make_dem_profile ( job->trk );
+    job->dem->revision = job->revision;
+  }
+  (void)gdk_threads_add_idle ( (GSourceFunc)profile_job_done, job );
+}
+
+/**
+ * Returns: A newly allocated array of the values for the graph at the current width
+ *
+ * Resampled from the cache when it's still valid for the track,
+ *  otherwise calculated from the track (and the cache remade for next time)
+ */
+static gdouble *profile_get_values ( PropWidgets *widgets, VikPropWinGraphType_t pwgt )
+{
+  VikTrack *trk = widgets->tr;
+  guint width = widgets->profile_width;
+  if ( widgets->cache && width > 0 && width <= PROFILE_CACHE_BASE_CHUNKS ) {
+    // Any edit of the track (whether via this dialog or not) gives it a new revision
+    if ( widgets->cache->revision == trk->revision ) {
+      if ( widgets->cache->done[pwgt] )
+        return profile_cache_resample ( widgets->cache, pwgt, width );
+    }
+    else {
+      profile_cache_free ( widgets->cache );
+      widgets->cache = NULL;
+      profile_job_start ( widgets, TRUE, FALSE );
+    }
+  }
+  return profile_make_map ( trk, pwgt, width );
+}
+
+/**
+ * Returns: The DEM elevations for the track if already available, otherwise NULL
+ *  and when @make is set they will be worked out in the background for the next redraw
+ */
+static const VikTrackDEMProfile *dem_profile_get ( PropWidgets *widgets, gboolean make )
+{
+  const VikTrackDEMProfile *dp = vik_track_get_dem_profile ( widgets->tr );
+  if ( !dp && make )
+    profile_job_start ( widgets, FALSE, TRUE );
+  return dp;
+}
+
 static PropWidgets *prop_widgets_new()
 {
   PropWidgets *widgets = g_malloc0(sizeof(PropWidgets));
@@ -205,6 +475,12 @@ static void prop_widgets_free(PropWidgets *widgets)
      g_free ( widgets->values[pwgt] );
   }
   g_free ( widgets->values );
+  g_free ( widgets->graph_pos[0] );
+  g_free ( widgets->graph_pos[1] );
+  profile_cache_free ( widgets->cache );
+  // Let any outstanding job know not to use these widgets
+  if ( widgets->job )
+    widgets->job->widgets = NULL;
   g_free(widgets);
 }
 
@@ -856,6 +1132,7 @@ static void track_graph_click( GtkWidget *event_box, GdkEventButton *event, Prop
   }
 
   widgets->marker_tp = trackpoint;
+  widgets->marker_pc_valid[0] = widgets->marker_pc_valid[1] = FALSE;
 
   GtkWidget *graph_box;
   gdouble pc = NAN;
@@ -1171,11 +1448,16 @@ static void update_power_buttons ( VikTrackpoint *trackpoint, gpointer ptr, gdou
 static gdouble get_marker_x ( VikPropWinGraphType_t pwgt, PropWidgets *widgets )
 {
   gdouble marker_x = -1.0; // i.e. Don't draw unless we get a valid value
-  gdouble pc = NAN;
-  if ( is_time_graph(pwgt) )
-    pc = tp_percentage_by_time ( widgets->tr, widgets->marker_tp );
-  else
-    pc = tp_percentage_by_distance ( widgets->tr, widgets->marker_tp, widgets->track_length_inc_gaps );
+  gboolean by_time = is_time_graph ( pwgt );
+  // Only work out the position along the track once, rather than on every mouse movement
+  if ( !widgets->marker_pc_valid[by_time] ) {
+    if ( by_time )
+      widgets->marker_pc[by_time] = tp_percentage_by_time ( widgets->tr, widgets->marker_tp );
+    else
+      widgets->marker_pc[by_time] = tp_percentage_by_distance ( widgets->tr, widgets->marker_tp, widgets->track_length_inc_gaps );
+    widgets->marker_pc_valid[by_time] = TRUE;
+  }
+  gdouble pc = widgets->marker_pc[by_time];
   if ( !isnan(pc) ) {
     marker_x = (pc * widgets->profile_width) + MARGIN_X;
   }
@@ -1198,6 +1480,88 @@ static void get_blob_xy ( VikPropWinGraphType_t pwgt, PropWidgets *widgets, gdou
   }
 }
 
+/**
+ * Forget the graph positions, e.g. as the track may have changed
+ */
+static void graph_pos_reset ( PropWidgets *widgets )
+{
+  for ( guint ii = 0; ii < 2; ii++ ) {
+    g_free ( widgets->graph_pos[ii] );
+    widgets->graph_pos[ii] = NULL;
+    widgets->marker_pc_valid[ii] = FALSE;
+  }
+}
+
+/**
+ * Work out the nearest trackpoint for every x position in one go,
+ *  choosing the same trackpoints as vik_track_get_closest_tp_by_percentage_time() and _dist() would
+ */
+static GraphPos *graph_pos_make ( VikTrack *tr, guint width, gboolean by_time )
+{
+  GraphPos *pos = g_malloc0 ( sizeof(GraphPos) * (width+1) );
+  GList *iter = tr->trackpoints;
+  if ( !iter || !width )
+    return pos;
+
+  if ( by_time ) {
+    gdouble t_start = VIK_TRACKPOINT(iter->data)->timestamp;
+    gdouble t_total = VIK_TRACKPOINT(g_list_last(iter)->data)->timestamp - t_start;
+    if ( isnan(t_total) )
+      return pos;
+    for ( guint xx = 0; xx <= width; xx++ ) {
+      gdouble t_pos = t_start + t_total * xx / width;
+      while ( iter->next && VIK_TRACKPOINT(iter->next->data)->timestamp <= t_pos )
+        iter = iter->next;
+      GList *best = iter;
+      if ( iter->next && (VIK_TRACKPOINT(iter->next->data)->timestamp - t_pos) < (t_pos - VIK_TRACKPOINT(iter->data)->timestamp) )
+        best = iter->next;
+      pos[xx].tpl = best;
+      pos[xx].from_start = VIK_TRACKPOINT(best->data)->timestamp - t_start;
+    }
+  }
+  else {
+    gdouble total = vik_track_get_length_including_gaps ( tr );
+    gdouble d_iter = 0.0;
+    gdouble d_next = iter->next ? vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->next->data)->coord) ) : 0.0;
+    for ( guint xx = 0; xx <= width; xx++ ) {
+      gdouble dist = total * xx / width;
+      while ( iter->next && d_next < dist ) {
+        iter = iter->next;
+        d_iter = d_next;
+        if ( iter->next )
+          d_next += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->next->data)->coord) );
+      }
+      if ( iter->next && (d_next - dist) <= (dist - d_iter) ) {
+        pos[xx].tpl = iter->next;
+        pos[xx].from_start = d_next;
+      }
+      else {
+        pos[xx].tpl = iter;
+        pos[xx].from_start = d_iter;
+      }
+    }
+  }
+  return pos;
+}
+
+/**
+ * The track may have been edited whilst this dialog is open (e.g. trackpoints deleted or the track split),
+ *  in which case the track has a new revision and the positions are made again.
+ */
+static GraphPos *graph_pos_get ( PropWidgets *widgets, gboolean by_time, guint ix )
+{
+  if ( widgets->graph_pos_revision != widgets->tr->revision ) {
+    graph_pos_reset ( widgets );
+    widgets->graph_pos_revision = widgets->tr->revision;
+  }
+  if ( !widgets->graph_pos[by_time] || widgets->graph_pos_width[by_time] != widgets->profile_width ) {
+    g_free ( widgets->graph_pos[by_time] );
+    widgets->graph_pos[by_time] = graph_pos_make ( widgets->tr, widgets->profile_width, by_time );
+    widgets->graph_pos_width[by_time] = widgets->profile_width;
+  }
+  return &widgets->graph_pos[by_time][MIN(ix, widgets->graph_pos_width[by_time])];
+}
+
 static void track_graph_move ( GtkWidget *event_box, GdkEventMotion *event, PropWidgets *widgets )
 {
   int mouse_x, mouse_y;
@@ -1215,12 +1579,9 @@ static void track_graph_move ( GtkWidget *event_box, GdkEventMotion *event, Prop
     x = widgets->profile_width;
 
   VikPropWinGraphType_t pwgt = event_box_to_graph_type ( event_box, widgets );
-  gdouble from_start;
-  VikTrackpoint *trackpoint = NULL;
-  if ( is_time_graph(pwgt) )
-    trackpoint = vik_track_get_closest_tp_by_percentage_time ( widgets->tr, (gdouble) x / widgets->profile_width, &from_start );
-  else
-    trackpoint = vik_track_get_closest_tp_by_percentage_dist ( widgets->tr, (gdouble) x / widgets->profile_width, &from_start );
+  GraphPos *gp = graph_pos_get ( widgets, is_time_graph(pwgt), (guint)x );
+  gdouble from_start = gp->from_start;
+  VikTrackpoint *trackpoint = gp->tpl ? VIK_TRACKPOINT(gp->tpl->data) : NULL;
 
   widgets->blob_tp = trackpoint;
 
@@ -1250,8 +1611,8 @@ static void track_graph_move ( GtkWidget *event_box, GdkEventMotion *event, Prop
                                     &widgets->is_blob_drawn );
 #endif
 
-  if ( widgets->graphs && widgets->blob_tp )
-    vik_trw_layer_trackpoint_draw ( widgets->vtl, widgets->vvp, widgets->tr, widgets->blob_tp);
+  if ( widgets->graphs && gp->tpl )
+    vik_trw_layer_trackpoint_draw ( widgets->vtl, widgets->vvp, widgets->tr, gp->tpl );
 }
 
 static void track_graph_leave ( GtkWidget *event_box, GdkEventMotion *event, PropWidgets *widgets )
@@ -1264,6 +1625,7 @@ static void track_graph_leave ( GtkWidget *event_box, GdkEventMotion *event, Pro
  *  Pixmap x axis should be distance based
  */
 static void draw_dem_alt_speed_dist ( VikTrack *tr,
+                                      const VikTrackDEMProfile *dp,
 #if GTK_CHECK_VERSION (3,0,0)
                                       cairo_t *cr,
                                       VikViewport *vvp,
@@ -1283,7 +1645,8 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
                                       gboolean do_speed )
 {
   GList *iter;
-  gdouble total_length = vik_track_get_length_including_gaps(tr);
+  guint ii = 0;
+  gdouble total_length = (dp && dp->count) ? dp->dist[dp->count-1] : vik_track_get_length_including_gaps(tr);
 
   gdouble dist = 0;
   gint h2 = height + MARGIN_Y; // Adjust height for x axis labelling offset
@@ -1300,8 +1663,10 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
   cairo_set_line_width ( cr, GRAPH_OVERLAY_LINE_WIDTH * vik_viewport_get_scale(vvp) );
 #endif
 
-  for (iter = tr->trackpoints; iter; iter = iter->next) {
-    if (iter->prev) {
+  for (iter = tr->trackpoints; iter; iter = iter->next, ii++) {
+    if (dp)
+      dist = dp->dist[ii];
+    else if (iter->prev) {
       dist += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) );
     }
 
@@ -1310,7 +1675,7 @@ static void draw_dem_alt_speed_dist ( VikTrack *tr,
     int y_alt, y_speed;
 
     if (do_dem) {
-      gint16 elev = a_dems_get_elev_by_coord(&(VIK_TRACKPOINT(iter->data)->coord), VIK_DEM_INTERPOL_BEST);
+      gint16 elev = dp ? dp->elev[ii] : a_dems_get_elev_by_coord(&(VIK_TRACKPOINT(iter->data)->coord), VIK_DEM_INTERPOL_BEST);
       if ( elev != VIK_DEM_INVALID_ELEVATION ) {
 	// Convert into height units
 	if (a_vik_get_units_height () == VIK_UNITS_HEIGHT_FEET)
@@ -1854,6 +2219,7 @@ static void draw_dem_gps_speed ( PropWidgets *widgets, GtkWidget *window, cairo_
   }
 
   draw_dem_alt_speed_dist ( widgets->tr,
+                            dem_profile_get ( widgets, widgets->show_dem[PGT_ELEVATION_DISTANCE] ),
                             cr,
                             widgets->vvp,
                             min,
@@ -1889,6 +2255,7 @@ static void draw_dem_gps_speed ( PropWidgets *widgets, GtkWidget *window, GdkPix
   }
 
   draw_dem_alt_speed_dist ( widgets->tr,
+                            dem_profile_get ( widgets, widgets->show_dem[PGT_ELEVATION_DISTANCE] ),
                             GDK_DRAWABLE(pix),
                             dem_alt_gc,
                             gps_speed_gc,
@@ -1916,7 +2283,7 @@ static void evaluate_speeds ( PropWidgets *widgets )
   const VikPropWinGraphType_t pwgt = PGT_SPEED_TIME;
   if ( widgets->values[pwgt] )
     g_free ( widgets->values[pwgt] );
-  widgets->values[pwgt] = vik_track_make_speed_map ( widgets->tr, widgets->profile_width );
+  widgets->values[pwgt] = profile_get_values ( widgets, pwgt );
   if ( widgets->values[pwgt] == NULL )
     return;
   speed_convert ( widgets->values[pwgt], widgets->profile_width );
@@ -1950,6 +2317,7 @@ static void draw_ed_extra ( gpointer ptr, GtkWidget *window, GdkPixmap *pix, Vik
 static void draw_gps_speed_by_dist ( PropWidgets *widgets, GtkWidget *window, cairo_t *cr )
 {
   draw_dem_alt_speed_dist ( widgets->tr,
+                            dem_profile_get ( widgets, FALSE ),
                             cr,
                             widgets->vvp,
                             0.0,
@@ -1972,6 +2340,7 @@ static void draw_gps_speed_by_dist ( PropWidgets *widgets, GtkWidget *window, Gd
   gdk_gc_set_rgb_fg_color ( gc, &color);
 
   draw_dem_alt_speed_dist ( widgets->tr,
+                            dem_profile_get ( widgets, FALSE ),
                             GDK_DRAWABLE(pix),
                             NULL,
                             gc,
@@ -2152,20 +2521,9 @@ static void draw_it ( cairo_t *cr, GtkWidget *image, VikTrack *trk, PropWidgets
   if ( widgets->values[pwgt] )
     g_free ( widgets->values[pwgt] );
 
-  if ( widgets->make_map[pwgt] )
-    widgets->values[pwgt] = widgets->make_map[pwgt] ( trk, widgets->profile_width );
-  else {
-    VikTrackValueType vtvt;
-    switch ( pwgt ) {
-    case PGT_ELEVATION_TIME: vtvt = TRACK_VALUE_ELEVATION; break;
-    case PGT_HEART_RATE:     vtvt = TRACK_VALUE_HEART_RATE; break;
-    case PGT_CADENCE:        vtvt = TRACK_VALUE_CADENCE; break;
-    case PGT_TEMP:           vtvt = TRACK_VALUE_TEMP; break;
-    case PGT_POWER:          vtvt = TRACK_VALUE_POWER; break;
-    default: return; break;
-    }
-    widgets->values[pwgt] = vik_track_make_time_map_for ( trk, widgets->profile_width, vtvt );
-  }
+  widgets->values[pwgt] = profile_get_values ( widgets, pwgt );
+  // Might be redrawn due to the track changing
+  graph_pos_reset ( widgets );
 
   if ( widgets->values[pwgt] == NULL )
     return;
@@ -2694,7 +3052,6 @@ GtkWidget *vik_trw_layer_create_profile ( GtkWidget *window, PropWidgets *widget
   g_debug ( "%s: %f", __FUNCTION__, widgets->alt_create_time );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
-  widgets->make_map[pwgt] = vik_track_make_elevation_map;
   widgets->convert_values[pwgt] = elev_convert;
   widgets->get_y_text[pwgt] = elev_y_text;
   widgets->draw_extra[pwgt] = draw_ed_extra;
@@ -2711,7 +3068,6 @@ GtkWidget *vik_trw_layer_create_gradient ( GtkWidget *window, PropWidgets *widge
   widgets->values[pwgt] = vik_track_make_gradient_map ( widgets->tr, widgets->profile_width );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
-  widgets->make_map[pwgt] = vik_track_make_gradient_map;
   widgets->convert_values[pwgt] = NULL;
   widgets->get_y_text[pwgt] = pct_y_text;
   widgets->draw_extra[pwgt] = draw_gps_speed_extra;
@@ -2728,7 +3084,6 @@ GtkWidget *vik_trw_layer_create_vtdiag ( GtkWidget *window, PropWidgets *widgets
   widgets->values[pwgt] = vik_track_make_speed_map ( widgets->tr, widgets->profile_width );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
-  widgets->make_map[pwgt] = vik_track_make_speed_map;
   widgets->convert_values[pwgt] = speed_convert;
   widgets->get_y_text[pwgt] = speed_y_text;
   widgets->draw_extra[pwgt] = draw_vt_gps_speed_extra;
@@ -2746,7 +3101,6 @@ GtkWidget *vik_trw_layer_create_dtdiag ( GtkWidget *window, PropWidgets *widgets
   widgets->values[pwgt] = vik_track_make_distance_map ( widgets->tr, widgets->profile_width );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
-  widgets->make_map[pwgt] = vik_track_make_distance_map;
   widgets->convert_values[pwgt] = dist_convert;
   widgets->get_y_text[pwgt] = dist_y_text;
   widgets->draw_extra[pwgt] = draw_dt_extra;
@@ -2779,7 +3133,6 @@ GtkWidget *vik_trw_layer_create_sddiag ( GtkWidget *window, PropWidgets *widgets
   widgets->values[pwgt] = vik_track_make_speed_dist_map ( widgets->tr, widgets->profile_width );
   if ( widgets->values[pwgt] == NULL )
     return NULL;
-  widgets->make_map[pwgt] = vik_track_make_speed_dist_map;
   widgets->convert_values[pwgt] = speed_convert;
   widgets->get_y_text[pwgt] = speed_y_text;
   widgets->draw_extra[pwgt] = draw_gps_speed_extra;
@@ -3822,6 +4175,11 @@ void vik_trw_layer_propwin_run ( GtkWindow *parent,
     widgets->event_box[PGT_TEMP] = vik_trw_layer_create_tempdiag(GTK_WIDGET(parent), widgets);
   if ( bool_pref_get(TPW_PREFS_NS"show_power") )
     widgets->event_box[PGT_POWER] = vik_trw_layer_create_powdiag(GTK_WIDGET(parent), widgets);
+
+  // Subsequent redraws (e.g. on resizing) can then avoid going through the whole track again
+  profile_job_start ( widgets, TRUE,
+                      DEM_available && widgets->event_box[PGT_ELEVATION_DISTANCE] && !vik_track_get_dem_profile(tr) );
+
   GtkWidget *graphs = gtk_notebook_new();
 
   if ( bool_pref_get(TPW_PREFS_NS"tabs_on_side") )
@@ -4348,7 +4706,7 @@ gboolean vik_trw_layer_propwin_main_refresh ( VikLayer *vl )
 
   if ( widgets->values[PGT_ELEVATION_DISTANCE] )
     g_free ( widgets->values[PGT_ELEVATION_DISTANCE] );
-  widgets->values[PGT_ELEVATION_DISTANCE] = vik_track_make_elevation_map ( widgets->tr, widgets->profile_width );
+  widgets->values[PGT_ELEVATION_DISTANCE] = profile_get_values ( widgets, PGT_ELEVATION_DISTANCE );
 
   evaluate_speeds ( widgets );
 
@@ -4483,6 +4841,10 @@ gpointer vik_trw_layer_propwin_main ( GtkWindow *parent,
     return NULL;
   }
 
+  profile_job_start ( widgets, TRUE,
+                      main_show_dem && widgets->event_box[PGT_ELEVATION_DISTANCE] &&
+                      a_dems_overlaps_bbox(tr->bbox) && !vik_track_get_dem_profile(tr) );
+
   gtk_container_add ( GTK_CONTAINER(self), graphs );
 
   if ( widgets->event_box[PGT_ELEVATION_DISTANCE] ) {
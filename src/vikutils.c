@@ -672,6 +672,9 @@ static gchar* time_string_tz ( time_t *time, const gchar *format, GTimeZone *tz
 gchar* vu_get_tz_at_location ( const VikCoord* vc )
 {
 	gchar *tz = NULL;
+	// Loaded on first use rather than on startup
+	if ( !kd && a_vik_get_time_ref_frame() == VIK_TIME_REF_WORLD )
+		vu_setup_lat_lon_tz_lookup ();
 	if ( !vc || !kd )
 		return tz;
 
@@ -1295,6 +1298,7 @@ GSList* vu_get_ui_selected_gps_files ( VikWindow *vw, gboolean external )
 #endif
 		gtk_file_filter_add_mime_type ( filter, "application/vnd.google-earth.kml+xml");
 		gtk_file_filter_add_pattern ( filter, "*.fit" );
+		gtk_file_filter_add_pattern ( filter, "*.geojson" );
 		gtk_file_filter_add_mime_type ( filter, "gpx+xml");
 		gtk_file_filter_add_pattern ( filter, "*.gpx" );
 		gtk_file_filter_add_mime_type ( filter, "image/jpeg");
@@ -1321,6 +1325,11 @@ GSList* vu_get_ui_selected_gps_files ( VikWindow *vw, gboolean external )
 		gtk_file_chooser_add_filter (GTK_FILE_CHOOSER(dialog), filter);
 #endif
 
+		filter = gtk_file_filter_new ();
+		gtk_file_filter_set_name( filter, _("GeoJSON") );
+		gtk_file_filter_add_pattern ( filter, "*.geojson" );
+		gtk_file_chooser_add_filter (GTK_FILE_CHOOSER(dialog), filter);
+
 		filter = gtk_file_filter_new ();
 		gtk_file_filter_set_name( filter, _("Google Earth") );
 		gtk_file_filter_add_mime_type ( filter, "application/vnd.google-earth.kml+xml");
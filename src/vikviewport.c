@@ -126,8 +126,67 @@ struct _VikViewport {
   GdkPixmap *snapshot_buffer;
 #endif
   gboolean half_drawn;
+
+  /* layer drawing cache */
+  guint cache_generation;     // Incremented to invalidate all cached drawings
+  GSList *cache_copyrights;   // Held aside whilst a layer's drawing is captured
+  GSList *cache_logos;
+
+  /* scrolling (GTK3+ only) */
+  cairo_surface_t *surface_scroll; // The drawing of the layers, without the decorations on top
+  gdouble scroll_xmpp, scroll_ympp;
+  VikViewportDrawMode scroll_drawmode;
+  VikCoord scroll_center;
+  /* section drawing - the normal extents held aside */
+  gboolean section;
+  GdkRectangle section_rect;
+  VikCoord section_center;
+  gint section_width, section_height;
+
+  /* a single point shown on top of everything, e.g. following the mouse over a track graph */
+  gboolean hl_point;
+  VikCoord hl_coord;
+  gchar *hl_color;
+  gint hl_size;
+  GdkRectangle hl_rect; // Where it was last drawn
+
+  /* rendering into another cairo context (GTK3+ only) - the normal state held aside */
+  gboolean render;
+  cairo_t *render_crt;
+  gint render_width, render_height;
+  GSList *render_copyrights;
+  GSList *render_logos;
+  /* extra resolution for raster layers whilst rendering */
+  guint detail;
+  gboolean detail_on;
+};
+
+/**
+ * The drawing of a single layer, along with the viewport state it was drawn for
+ * Only used in GTK3+ versions
+ */
+struct _VikViewportCache {
+  cairo_surface_t *surface;
+  VikCoord center;
+  VikViewportDrawMode drawmode;
+  gdouble xmpp, ympp;
+  gint width, height;
+  guint generation;
+  GSList *copyrights; // Those added by the layer when drawn
+  GSList *logos;
+  gsize bytes;        // Size of the surface, counted against the budget
+  guint frame;        // When last drawn or painted
+  GList *link;        // Position in the LRU list whilst holding a surface
 };
 
+// Limit on the memory for all cached layer drawings - enough for several full screen drawings
+//  beyond which layers are just drawn directly each time
+#define CACHE_BUDGET (64*1024*1024)
+
+static GQueue cache_lru = G_QUEUE_INIT; // Caches holding a surface, most recently used first
+static gsize cache_bytes = 0;
+static guint cache_frame = 0;           // Incremented by each vik_viewport_clear()
+
 static gdouble
 viewport_utm_zone_width ( VikViewport *vvp )
 {
@@ -488,7 +547,9 @@ void vik_viewport_configure_manually ( VikViewport *vvp, gint width, guint heigh
 
 #if GTK_CHECK_VERSION (3,0,0)
   // Performed after above gc's are reset
-  vik_layers_panel_configure_layers ( vik_window_layers_panel(VIK_WINDOW_FROM_WIDGET(vvp)) );
+  //  (not applicable for an off screen viewport, e.g. as used in the benchmarks)
+  if ( IS_VIK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(vvp))) )
+    vik_layers_panel_configure_layers ( vik_window_layers_panel(VIK_WINDOW_FROM_WIDGET(vvp)) );
 #endif
 }
 
@@ -670,6 +731,8 @@ static void viewport_finalize ( GObject *gob )
     cairo_destroy ( vvp->crt );
   if ( vvp->surface_main )
     cairo_surface_destroy ( vvp->surface_main );
+  if ( vvp->surface_scroll )
+    cairo_surface_destroy ( vvp->surface_scroll );
 #endif
 
   if ( vvp->background_gc )
@@ -684,6 +747,8 @@ static void viewport_finalize ( GObject *gob )
   if ( vvp->black_gc )
     ui_gc_unref ( vvp->black_gc );
 
+  g_free ( vvp->hl_color );
+
   G_OBJECT_CLASS(parent_class)->finalize(gob);
 }
 
@@ -696,6 +761,8 @@ static void viewport_finalize ( GObject *gob )
 void vik_viewport_clear ( VikViewport *vvp )
 {
   g_return_if_fail ( vvp != NULL );
+  // A new frame is being drawn
+  cache_frame++;
 #if GTK_CHECK_VERSION (3,0,0)
   if ( vvp->crt ) {
     // Although could draw fully translucent like this
@@ -976,6 +1043,27 @@ void vik_viewport_draw_logo ( VikViewport *vvp )
   }
 }
 
+/**
+ * vik_viewport_draw_overlay_text:
+ *
+ * Draw (multiline) text in the top left corner, on a plain background so it is readable over any map
+ */
+void vik_viewport_draw_overlay_text ( VikViewport *vvp, const gchar *text )
+{
+  g_return_if_fail ( vvp != NULL );
+
+  PangoRectangle ink_rect, logical_rect;
+  PangoLayout *pl = gtk_widget_create_pango_layout ( GTK_WIDGET(&vvp->drawing_area), NULL );
+  pango_layout_set_font_description ( pl, gtk_widget_get_style(GTK_WIDGET(&vvp->drawing_area))->font_desc );
+  pango_layout_set_text ( pl, text, -1 );
+  pango_layout_get_pixel_extents ( pl, &ink_rect, &logical_rect );
+
+  vik_viewport_draw_rectangle ( vvp, vvp->background_gc, TRUE, 0, 0, logical_rect.width + 2*PAD, logical_rect.height + 2*PAD, &vvp->background_color );
+  vik_viewport_draw_layout ( vvp, vvp->black_gc, PAD, PAD, pl, &vvp->black_color );
+
+  g_object_unref ( pl );
+}
+
 void vik_viewport_set_draw_highlight ( VikViewport *vvp, gboolean draw_highlight )
 {
   vvp->draw_highlight = draw_highlight;
@@ -986,6 +1074,84 @@ gboolean vik_viewport_get_draw_highlight ( VikViewport *vvp )
   return vvp->draw_highlight;
 }
 
+static void highlight_point_rect ( VikViewport *vvp, GdkRectangle *rect )
+{
+  gint xx, yy;
+  vik_viewport_coord_to_screen ( vvp, &vvp->hl_coord, &xx, &yy );
+  rect->x = xx - vvp->hl_size;
+  rect->y = yy - vvp->hl_size;
+  rect->width = rect->height = 2 * vvp->hl_size;
+}
+
+/**
+ * GTK2: Drawn directly onto the window (cr is not used)
+ * GTK3: cr from the "draw" signal
+ */
+static void highlight_point_draw ( VikViewport *vvp, GdkGC *cr )
+{
+  // Recalculated as the viewport may have moved since it was set
+  highlight_point_rect ( vvp, &vvp->hl_rect );
+#if !GTK_CHECK_VERSION (3,0,0)
+  GdkColor color;
+  GdkWindow *win = gtk_widget_get_window ( GTK_WIDGET(vvp) );
+  if ( !win || !gdk_color_parse(vvp->hl_color, &color) )
+    return;
+  GdkGC *gc = gdk_gc_new ( win );
+  gdk_gc_set_rgb_fg_color ( gc, &color );
+  gdk_draw_rectangle ( win, gc, TRUE, vvp->hl_rect.x, vvp->hl_rect.y, vvp->hl_rect.width, vvp->hl_rect.height );
+  g_object_unref ( gc );
+#else
+  ui_cr_set_color ( cr, vvp->hl_color );
+  ui_cr_draw_rectangle ( cr, TRUE, vvp->hl_rect.x, vvp->hl_rect.y, vvp->hl_rect.width, vvp->hl_rect.height );
+#endif
+}
+
+/**
+ * vik_viewport_set_highlight_point:
+ * @coord: Where to show the point, or NULL to remove it
+ * @color: Name of the color to use
+ * @size:  Half the width of the square drawn
+ *
+ * Show a point on top of the map without redrawing any of the layers,
+ *  so it can follow the mouse cheaply - only the area of the previous
+ *  and the new position is updated on screen.
+ */
+void vik_viewport_set_highlight_point ( VikViewport *vvp, const VikCoord *coord, const gchar *color, gint size )
+{
+  g_return_if_fail ( vvp != NULL );
+  GdkRectangle old = vvp->hl_rect;
+  gboolean was_shown = vvp->hl_point;
+
+  vvp->hl_point = (coord != NULL);
+  if ( coord ) {
+    vvp->hl_coord = *coord;
+    vvp->hl_size = size;
+    if ( g_strcmp0(vvp->hl_color, color) ) {
+      g_free ( vvp->hl_color );
+      vvp->hl_color = g_strdup ( color );
+    }
+  }
+
+#if !GTK_CHECK_VERSION (3,0,0)
+  GdkWindow *win = gtk_widget_get_window ( GTK_WIDGET(vvp) );
+  if ( !win || !vvp->scr_buffer )
+    return;
+  // Put back what was underneath
+  if ( was_shown )
+    gdk_draw_drawable ( win, gtk_widget_get_style(GTK_WIDGET(vvp))->bg_gc[0], GDK_DRAWABLE(vvp->scr_buffer),
+                        old.x, old.y, old.x, old.y, old.width, old.height );
+  if ( vvp->hl_point )
+    highlight_point_draw ( vvp, NULL );
+#else
+  if ( was_shown )
+    gtk_widget_queue_draw_area ( GTK_WIDGET(vvp), old.x, old.y, old.width, old.height );
+  if ( vvp->hl_point ) {
+    highlight_point_rect ( vvp, &vvp->hl_rect );
+    gtk_widget_queue_draw_area ( GTK_WIDGET(vvp), vvp->hl_rect.x, vvp->hl_rect.y, vvp->hl_rect.width, vvp->hl_rect.height );
+  }
+#endif
+}
+
 /**
  * GTK2: cr is not used
  * GTK3: Remember GdkGC* is actually cairo_t*
@@ -995,6 +1161,8 @@ void vik_viewport_sync ( VikViewport *vvp, GdkGC *cr )
   g_return_if_fail ( vvp != NULL );
 #if !GTK_CHECK_VERSION (3,0,0)
   gdk_draw_drawable(gtk_widget_get_window(GTK_WIDGET(vvp)), gtk_widget_get_style(GTK_WIDGET(vvp))->bg_gc[0], GDK_DRAWABLE(vvp->scr_buffer), 0, 0, 0, 0, vvp->width, vvp->height);
+  if ( vvp->hl_point )
+    highlight_point_draw ( vvp, NULL );
 #else
   // Avoid using g_message() or similar in the redraw path as that updates the statusbar
   //  and then that seemingly triggers another update and so on!
@@ -1006,6 +1174,8 @@ void vik_viewport_sync ( VikViewport *vvp, GdkGC *cr )
     // Paint all other surfaces...
     if ( vvp->surface_tool )
       ui_cr_surface_paint ( cr, vvp->surface_tool );
+    if ( vvp->hl_point )
+      highlight_point_draw ( vvp, cr );
   } else
     gtk_widget_queue_draw ( GTK_WIDGET(vvp) );
 #endif
@@ -1869,6 +2039,484 @@ void vik_viewport_snapshot_load ( VikViewport *vp )
 #endif
 }
 
+/******** cached layer drawing *******/
+/**
+ * Drop the drawing held by the cache, returning its memory to the budget
+ */
+static void cache_release ( VikViewportCache *cache )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( cache->surface )
+    cairo_surface_destroy ( cache->surface );
+#endif
+  cache->surface = NULL;
+  if ( cache->link ) {
+    g_queue_delete_link ( &cache_lru, cache->link );
+    cache->link = NULL;
+    cache_bytes -= cache->bytes;
+  }
+  cache->bytes = 0;
+}
+
+/**
+ * vik_viewport_cache_paint:
+ *
+ * Paint the cached drawing onto the viewport if it is still valid for
+ *  the current position, zoom level and size of the viewport.
+ * Copyrights and logos the layer gave when it was drawn are also reinstated.
+ *
+ * Returns: TRUE if the cached drawing was used
+ */
+gboolean vik_viewport_cache_paint ( VikViewport *vvp, VikViewportCache *cache )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( !cache || !cache->surface || !vvp->crt || vvp->section )
+    return FALSE;
+  if ( cache->generation != vvp->cache_generation ||
+       cache->width != vvp->width || cache->height != vvp->height ||
+       cache->xmpp != vvp->xmpp || cache->ympp != vvp->ympp ||
+       cache->drawmode != vvp->drawmode ||
+       !vik_coord_equals(&cache->center, &vvp->center) )
+    return FALSE;
+
+  ui_cr_surface_paint ( vvp->crt, cache->surface );
+  for ( GSList *iter = cache->copyrights; iter; iter = iter->next )
+    vik_viewport_add_copyright ( vvp, iter->data );
+  for ( GSList *iter = cache->logos; iter; iter = iter->next )
+    vik_viewport_add_logo ( vvp, iter->data );
+
+  cache->frame = cache_frame;
+  g_queue_unlink ( &cache_lru, cache->link );
+  g_queue_push_head_link ( &cache_lru, cache->link );
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/**
+ * vik_viewport_cache_begin:
+ * @cache: The layer's existing cache (if any), whose drawing is now out of date
+ *
+ * Start capturing the drawing into a separate surface.
+ * If this returns TRUE it must be paired with vik_viewport_cache_end()
+ *
+ * Since in GTK3 all the GCs are references to the viewport's cairo context,
+ *  layers need not know they are being drawn into a different surface.
+ *
+ * Drawings least recently used are dropped to stay within the memory budget,
+ *  but never those used in the current redraw, otherwise each redraw would
+ *  just replace the drawings the next one needs.
+ *
+ * Returns: FALSE if the drawing should not be captured
+ *  (partial drawings are not worth keeping, or when there is no room for it)
+ */
+gboolean vik_viewport_cache_begin ( VikViewport *vvp, VikViewportCache *cache )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  g_return_val_if_fail ( vvp->crt != NULL, FALSE );
+  if ( vvp->section )
+    return FALSE;
+  if ( cache )
+    cache_release ( cache );
+
+  gsize bytes = (gsize)vvp->width * vvp->height * 4;
+  while ( cache_bytes + bytes > CACHE_BUDGET ) {
+    GList *last = g_queue_peek_tail_link ( &cache_lru );
+    if ( !last || ((VikViewportCache*)last->data)->frame == cache_frame )
+      break;
+    cache_release ( last->data );
+  }
+  if ( cache_bytes + bytes > CACHE_BUDGET )
+    return FALSE;
+
+  vvp->cache_copyrights = vvp->copyrights;
+  vvp->copyrights = NULL;
+  vvp->cache_logos = vvp->logos;
+  vvp->logos = NULL;
+  cairo_push_group ( vvp->crt );
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/**
+ * vik_viewport_cache_end:
+ * @cache: The cache to (re)fill, created if necessary
+ *
+ * Finish capturing the drawing, storing it in the cache
+ *  and then putting it on the viewport in the normal way.
+ */
+void vik_viewport_cache_end ( VikViewport *vvp, VikViewportCache **cache )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  g_return_if_fail ( vvp->crt != NULL );
+  cairo_pattern_t *pattern = cairo_pop_group ( vvp->crt );
+
+  VikViewportCache *vvc = *cache;
+  if ( vvc ) {
+    cache_release ( vvc );
+    g_slist_free_full ( vvc->copyrights, g_free );
+    g_slist_free ( vvc->logos );
+  }
+  else {
+    vvc = g_new0 ( VikViewportCache, 1 );
+    *cache = vvc;
+  }
+
+  cairo_surface_t *surface = NULL;
+  if ( cairo_pattern_get_surface(pattern, &surface) == CAIRO_STATUS_SUCCESS ) {
+    vvc->surface = cairo_surface_reference ( surface );
+    vvc->bytes = (gsize)vvp->width * vvp->height * 4;
+    vvc->frame = cache_frame;
+    g_queue_push_head ( &cache_lru, vvc );
+    vvc->link = g_queue_peek_head_link ( &cache_lru );
+    cache_bytes += vvc->bytes;
+  }
+  vvc->center = vvp->center;
+  vvc->drawmode = vvp->drawmode;
+  vvc->xmpp = vvp->xmpp;
+  vvc->ympp = vvp->ympp;
+  vvc->width = vvp->width;
+  vvc->height = vvp->height;
+  vvc->generation = vvp->cache_generation;
+  vvc->copyrights = vvp->copyrights;
+  vvc->logos = vvp->logos;
+
+  vvp->copyrights = vvp->cache_copyrights;
+  vvp->cache_copyrights = NULL;
+  vvp->logos = vvp->cache_logos;
+  vvp->cache_logos = NULL;
+  for ( GSList *iter = vvc->copyrights; iter; iter = iter->next )
+    vik_viewport_add_copyright ( vvp, iter->data );
+  for ( GSList *iter = vvc->logos; iter; iter = iter->next )
+    vik_viewport_add_logo ( vvp, iter->data );
+
+  cairo_set_source ( vvp->crt, pattern );
+  cairo_paint ( vvp->crt );
+  cairo_pattern_destroy ( pattern );
+#endif
+}
+
+/**
+ * vik_viewport_cache_invalidate:
+ *
+ * Stop all existing cached drawings being used
+ *  (e.g. when it is not known what has changed)
+ */
+void vik_viewport_cache_invalidate ( VikViewport *vvp )
+{
+  vvp->cache_generation++;
+}
+
+void vik_viewport_cache_free ( VikViewportCache *cache )
+{
+  if ( !cache )
+    return;
+  cache_release ( cache );
+  g_slist_free_full ( cache->copyrights, g_free );
+  g_slist_free ( cache->logos );
+  g_free ( cache );
+}
+
+/******** scrolling *******/
+/**
+ * vik_viewport_scroll_save:
+ *
+ * Keep the current drawing so it can be reused by vik_viewport_scroll()
+ * Call after the layers have been drawn but before the decorations
+ *  (scale, copyright, etc...) which stay in the same place on screen.
+ */
+void vik_viewport_scroll_save ( VikViewport *vvp )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( !vvp->surface_main )
+    return;
+  if ( vvp->surface_scroll &&
+       (cairo_image_surface_get_width(vvp->surface_scroll) != vvp->width ||
+        cairo_image_surface_get_height(vvp->surface_scroll) != vvp->height) ) {
+    cairo_surface_destroy ( vvp->surface_scroll );
+    vvp->surface_scroll = NULL;
+  }
+  if ( !vvp->surface_scroll )
+    vvp->surface_scroll = cairo_image_surface_create ( CAIRO_FORMAT_ARGB32, vvp->width, vvp->height );
+
+  cairo_surface_flush ( vvp->surface_main );
+  cairo_t *cr = cairo_create ( vvp->surface_scroll );
+  cairo_set_operator ( cr, CAIRO_OPERATOR_SOURCE );
+  ui_cr_surface_paint ( cr, vvp->surface_main );
+  cairo_destroy ( cr );
+
+  vvp->scroll_xmpp = vvp->xmpp;
+  vvp->scroll_ympp = vvp->ympp;
+  vvp->scroll_drawmode = vvp->drawmode;
+  vvp->scroll_center = vvp->center;
+#endif
+}
+
+/**
+ * vik_viewport_scroll:
+ * @dx: Pixels the drawing moves to the right
+ * @dy: Pixels the drawing moves down
+ *
+ * Put the saved drawing back on the viewport moved by the offsets, e.g. following a pan.
+ * The exposed areas (see vik_viewport_scroll_exposed()) and the decorations
+ *  then need drawing by the caller.
+ *
+ * Returns: FALSE if the saved drawing is unusable, so a full redraw is needed
+ */
+gboolean vik_viewport_scroll ( VikViewport *vvp, gint dx, gint dy )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( !vvp->surface_scroll || !vvp->crt )
+    return FALSE;
+  if ( cairo_image_surface_get_width(vvp->surface_scroll) != vvp->width ||
+       cairo_image_surface_get_height(vvp->surface_scroll) != vvp->height ||
+       vvp->scroll_xmpp != vvp->xmpp || vvp->scroll_ympp != vvp->ympp ||
+       vvp->scroll_drawmode != vvp->drawmode )
+    return FALSE;
+  if ( ABS(dx) >= vvp->width || ABS(dy) >= vvp->height )
+    return FALSE;
+  // The saved drawing must be of the view before this move
+  //  (and not from before an earlier move that could not be scrolled)
+  gint x, y;
+  vik_viewport_coord_to_screen ( vvp, &vvp->scroll_center, &x, &y );
+  if ( ABS(x - (vvp->width/2 + dx)) > 1 || ABS(y - (vvp->height/2 + dy)) > 1 )
+    return FALSE;
+
+  ui_cr_clear ( vvp->crt );
+  cairo_set_source_surface ( vvp->crt, vvp->surface_scroll, dx, dy );
+  cairo_paint ( vvp->crt );
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/**
+ * vik_viewport_scroll_exposed:
+ * @rects: Filled in with the areas uncovered by the scroll
+ *
+ * Returns: The number of areas (up to 2)
+ */
+guint vik_viewport_scroll_exposed ( VikViewport *vvp, gint dx, gint dy, GdkRectangle rects[2] )
+{
+  guint nn = 0;
+  if ( dx ) {
+    rects[nn].x = dx > 0 ? 0 : vvp->width + dx;
+    rects[nn].y = 0;
+    rects[nn].width = ABS(dx);
+    rects[nn].height = vvp->height;
+    nn++;
+  }
+  if ( dy ) {
+    // Not including any part already covered above
+    rects[nn].x = dx > 0 ? dx : 0;
+    rects[nn].y = dy > 0 ? 0 : vvp->height + dy;
+    rects[nn].width = vvp->width - ABS(dx);
+    rects[nn].height = ABS(dy);
+    nn++;
+  }
+  return nn;
+}
+
+/**
+ * vik_viewport_section_begin:
+ *
+ * Temporarily make the viewport cover just the given area,
+ *  so layers draw only what appears in it - without needing any changes to the layers.
+ * Must be paired with vik_viewport_section_end()
+ */
+void vik_viewport_section_begin ( VikViewport *vvp, const GdkRectangle *rect )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  g_return_if_fail ( vvp->crt != NULL );
+  g_return_if_fail ( !vvp->section );
+
+  vvp->section = TRUE;
+  vvp->section_rect = *rect;
+  vvp->section_center = vvp->center;
+  vvp->section_width = vvp->width;
+  vvp->section_height = vvp->height;
+
+  gint xx = rect->x + rect->width/2;
+  gint yy = rect->y + rect->height/2;
+  if ( vvp->coord_mode == VIK_COORD_UTM ) {
+    // Stay in the same zone, as the full view does
+    vvp->center.east_west += (xx - vvp->width_2) * vvp->xmpp;
+    vvp->center.north_south += (vvp->height_2 - yy) * vvp->ympp;
+  }
+  else {
+    VikCoord coord;
+    vik_viewport_screen_to_coord ( vvp, xx, yy, &coord );
+    vvp->center = coord;
+  }
+  vvp->width = rect->width;
+  vvp->height = rect->height;
+  vvp->width_2 = vvp->width/2;
+  vvp->height_2 = vvp->height/2;
+
+  cairo_save ( vvp->crt );
+  cairo_translate ( vvp->crt, rect->x, rect->y );
+  cairo_rectangle ( vvp->crt, 0, 0, rect->width, rect->height );
+  cairo_clip ( vvp->crt );
+#endif
+}
+
+void vik_viewport_section_end ( VikViewport *vvp )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  g_return_if_fail ( vvp->section );
+  cairo_restore ( vvp->crt );
+  vvp->center = vvp->section_center;
+  vvp->width = vvp->section_width;
+  vvp->height = vvp->section_height;
+  vvp->width_2 = vvp->width/2;
+  vvp->height_2 = vvp->height/2;
+  vvp->section = FALSE;
+#endif
+}
+
+/**
+ * vik_viewport_get_section:
+ * @rect: Set to the area of the full view being drawn, when in a section
+ *
+ * For layers whose drawing depends on the whole view (rather than only what appears in it),
+ *  the section can be ended to work out that drawing and then begun again.
+ *
+ * Returns: Whether only a section of the view is being drawn
+ */
+gboolean vik_viewport_get_section ( VikViewport *vvp, GdkRectangle *rect )
+{
+  if ( vvp->section && rect )
+    *rect = vvp->section_rect;
+  return vvp->section;
+}
+
+/******** rendering *******/
+/**
+ * vik_viewport_render_begin:
+ * @cr:     Where to draw, e.g. a printer page or a PDF surface
+ * @width:  Size of the area in viewport pixels (at the current zoom level)
+ * @height:
+ * @detail: How many times finer raster layers may draw (e.g. map tiles from a closer zoom level)
+ *
+ * Make all drawing go into the given cairo context instead of the screen,
+ *  so lines and text remain as vectors when the context is a vector surface.
+ * The background is filled in first.
+ * Layers need to be (re)configured afterwards so their GCs refer to the new context,
+ *  and again after vik_viewport_render_end().
+ *
+ * Returns: FALSE if not possible (GTK2 draws via pixmaps only)
+ */
+gboolean vik_viewport_render_begin ( VikViewport *vvp, cairo_t *cr, gint width, gint height, guint detail )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  g_return_val_if_fail ( vvp != NULL && cr != NULL, FALSE );
+  if ( vvp->render || vvp->section )
+    return FALSE;
+
+  vvp->render = TRUE;
+  vvp->render_crt = vvp->crt;
+  vvp->render_width = vvp->width;
+  vvp->render_height = vvp->height;
+  vvp->render_copyrights = vvp->copyrights;
+  vvp->copyrights = NULL;
+  vvp->render_logos = vvp->logos;
+  vvp->logos = NULL;
+
+  vvp->crt = cairo_reference ( cr );
+  vvp->width = width;
+  vvp->height = height;
+  vvp->width_2 = vvp->width/2;
+  vvp->height_2 = vvp->height/2;
+  vvp->detail = MAX ( detail, 1 );
+  configure_common ( vvp );
+
+  cairo_save ( vvp->crt );
+  gdk_cairo_set_source_color ( vvp->crt, &vvp->background_color );
+  cairo_rectangle ( vvp->crt, 0, 0, width, height );
+  cairo_fill ( vvp->crt );
+  cairo_restore ( vvp->crt );
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+void vik_viewport_render_end ( VikViewport *vvp )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  g_return_if_fail ( vvp->render );
+  cairo_destroy ( vvp->crt );
+  vvp->crt = vvp->render_crt;
+  vvp->render_crt = NULL;
+  vvp->width = vvp->render_width;
+  vvp->height = vvp->render_height;
+  vvp->width_2 = vvp->width/2;
+  vvp->height_2 = vvp->height/2;
+  vik_viewport_reset_copyrights ( vvp );
+  vvp->copyrights = vvp->render_copyrights;
+  vvp->render_copyrights = NULL;
+  vik_viewport_reset_logos ( vvp );
+  vvp->logos = vvp->render_logos;
+  vvp->render_logos = NULL;
+  vvp->detail = 1;
+  vvp->render = FALSE;
+  configure_common ( vvp );
+#endif
+}
+
+/**
+ * vik_viewport_detail_begin:
+ *
+ * For raster layers: whilst rendering with extra detail, temporarily
+ *  make the viewport that many times larger at a correspondingly closer zoom level,
+ *  with the drawing scaled back down to fit.
+ * Must be paired with vik_viewport_detail_end() when this returns TRUE.
+ *
+ * Returns: TRUE if the extra detail is in effect
+ */
+gboolean vik_viewport_detail_begin ( VikViewport *vvp )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  if ( !vvp->render || vvp->detail <= 1 || vvp->detail_on )
+    return FALSE;
+  vvp->detail_on = TRUE;
+  vvp->width *= vvp->detail;
+  vvp->height *= vvp->detail;
+  vvp->width_2 = vvp->width/2;
+  vvp->height_2 = vvp->height/2;
+  vvp->xmpp /= vvp->detail;
+  vvp->ympp /= vvp->detail;
+  vvp->xmfactor = mercator_factor ( vvp->xmpp, vvp->scale );
+  vvp->ymfactor = mercator_factor ( vvp->ympp, vvp->scale );
+  cairo_save ( vvp->crt );
+  cairo_scale ( vvp->crt, 1.0/vvp->detail, 1.0/vvp->detail );
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+void vik_viewport_detail_end ( VikViewport *vvp )
+{
+#if GTK_CHECK_VERSION (3,0,0)
+  g_return_if_fail ( vvp->detail_on );
+  cairo_restore ( vvp->crt );
+  vvp->width /= vvp->detail;
+  vvp->height /= vvp->detail;
+  vvp->width_2 = vvp->width/2;
+  vvp->height_2 = vvp->height/2;
+  vvp->xmpp *= vvp->detail;
+  vvp->ympp *= vvp->detail;
+  vvp->xmfactor = mercator_factor ( vvp->xmpp, vvp->scale );
+  vvp->ymfactor = mercator_factor ( vvp->ympp, vvp->scale );
+  vvp->detail_on = FALSE;
+#endif
+}
+
 void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn)
 {
   vp->half_drawn = half_drawn;
@@ -1879,6 +2527,17 @@ gboolean vik_viewport_get_half_drawn( VikViewport *vp )
   return vp->half_drawn;
 }
 
+/**
+ * vik_viewport_get_frame:
+ *
+ * Returns: A number which changes whenever a new frame is drawn,
+ *  e.g. for other caches to know what is in use by the current drawing
+ */
+guint vik_viewport_get_frame ( VikViewport *vvp )
+{
+  return cache_frame;
+}
+
 
 const gchar *vik_viewport_get_drawmode_name(VikViewport *vv, VikViewportDrawMode mode)
  {
@@ -1988,8 +2647,8 @@ void vik_viewport_add_logo ( VikViewport *vp, const GdkPixbuf *logo )
   g_return_if_fail ( vp != NULL );
   if ( logo )
   {
-    GdkPixbuf *found = NULL; /* FIXME (GdkPixbuf*)g_slist_find_custom ( vp->logos, logo, (GCompareFunc)== ); */
-    if ( found == NULL )
+    // Each drawing of a layer adds its logo again (e.g. for every strip drawn when panning)
+    if ( !g_slist_find ( vp->logos, logo ) )
     {
       vp->logos = g_slist_prepend ( vp->logos, (gpointer)logo );
     }
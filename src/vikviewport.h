@@ -125,6 +125,29 @@ void vik_viewport_snapshot_save ( VikViewport *vp );
 void vik_viewport_snapshot_load ( VikViewport *vp );
 void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn);
 gboolean vik_viewport_get_half_drawn( VikViewport *vp );
+guint vik_viewport_get_frame ( VikViewport *vvp );
+
+/* Cached layer drawing */
+typedef struct _VikViewportCache VikViewportCache;
+gboolean vik_viewport_cache_paint ( VikViewport *vvp, VikViewportCache *cache );
+gboolean vik_viewport_cache_begin ( VikViewport *vvp, VikViewportCache *cache );
+void vik_viewport_cache_end ( VikViewport *vvp, VikViewportCache **cache );
+void vik_viewport_cache_invalidate ( VikViewport *vvp );
+void vik_viewport_cache_free ( VikViewportCache *cache );
+
+/* Scrolling */
+void vik_viewport_scroll_save ( VikViewport *vvp );
+gboolean vik_viewport_scroll ( VikViewport *vvp, gint dx, gint dy );
+guint vik_viewport_scroll_exposed ( VikViewport *vvp, gint dx, gint dy, GdkRectangle rects[2] );
+void vik_viewport_section_begin ( VikViewport *vvp, const GdkRectangle *rect );
+void vik_viewport_section_end ( VikViewport *vvp );
+gboolean vik_viewport_get_section ( VikViewport *vvp, GdkRectangle *rect );
+
+/* Rendering elsewhere, e.g. printing */
+gboolean vik_viewport_render_begin ( VikViewport *vvp, cairo_t *cr, gint width, gint height, guint detail );
+void vik_viewport_render_end ( VikViewport *vvp );
+gboolean vik_viewport_detail_begin ( VikViewport *vvp );
+void vik_viewport_detail_end ( VikViewport *vvp );
 
 
 /***************************************************************************************************
@@ -141,6 +164,7 @@ void vik_viewport_surface_tool_destroy ( VikViewport *vvp );
 GdkPixmap *vik_viewport_get_pixmap ( VikViewport *vvp ); /* get pointer to drawing buffer */
 #endif
 void vik_viewport_sync ( VikViewport *vvp, GdkGC *cr );
+void vik_viewport_set_highlight_point ( VikViewport *vvp, const VikCoord *coord, const gchar *color, gint size );
 void vik_viewport_clear ( VikViewport *vvp );
 void vik_viewport_draw_pixbuf ( VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x, gint src_y,
                               gint dest_x, gint dest_y, gint w, gint h );
@@ -162,6 +186,7 @@ void vik_viewport_draw_centermark ( VikViewport *vvp );
 void vik_viewport_set_draw_centermark ( VikViewport *vvp, gboolean draw_centermark );
 gboolean vik_viewport_get_draw_centermark ( VikViewport *vvp );
 void vik_viewport_draw_logo ( VikViewport *vvp );
+void vik_viewport_draw_overlay_text ( VikViewport *vvp, const gchar *text );
 void vik_viewport_set_draw_highlight ( VikViewport *vvp, gboolean draw_highlight );
 gboolean vik_viewport_get_draw_highlight ( VikViewport *vvp );
 
@@ -23,6 +23,7 @@
 #include "viking.h"
 #include "background.h"
 #include "logging.h"
+#include "trace.h"
 #include "acquire.h"
 #include "datasources.h"
 #include "geojson.h"
@@ -103,6 +104,7 @@ static gboolean draw_scroll  ( VikWindow *vw, GdkEventScroll *event );
 static gboolean draw_click  ( VikWindow *vw, GdkEventButton *event );
 static gboolean draw_release ( VikWindow *vw, GdkEventButton *event );
 static gboolean draw_mouse_motion ( VikWindow *vw, GdkEventMotion *event );
+static void motion_flush ( VikWindow *vw );
 static void draw_zoom_cb ( GtkAction *a, VikWindow *vw );
 static void draw_goto_cb ( GtkAction *a, VikWindow *vw );
 static void draw_refresh_cb ( GtkAction *a, VikWindow *vw );
@@ -182,6 +184,10 @@ static gboolean save_file ( GtkAction *a, VikWindow *vw );
 static gboolean save_file_and_exit ( GtkAction *a, VikWindow *vw );
 static gboolean window_save ( VikWindow *vw, VikAggregateLayer *agg, gchar *filename );
 
+#define POINTER_BUFFER_SIZE 50
+// Pointer motion is acted on no more often than this (in microseconds), i.e. ~60 times a second
+#define MOTION_INTERVAL 16000
+
 struct _VikWindow {
   GtkWindow gtkwindow;
   GtkWidget *hpaned;
@@ -241,6 +247,22 @@ struct _VikWindow {
   gboolean single_click_pending;
   guint pending_draw_id;
   guint move_scroll_timeout;
+  // Menu entries that depend on GPSBabel
+  GtkActionGroup *babel_action_group;
+  guint babel_merge_id;
+  // Only the latest pointer motion is acted upon, see draw_mouse_motion()
+  GdkEvent *motion_event;
+  guint motion_id;
+  guint motion_merged;
+  gint64 motion_begin;
+  gint64 motion_last;
+  // What the pointer position in the statusbar was worked out from
+  gchar pointer_buf[POINTER_BUFFER_SIZE];
+  VikCoord pointer_coord;
+  VikViewportDrawMode pointer_drawmode;
+  VikDemInterpol pointer_interpol;
+  vik_units_height_t pointer_height_units;
+  guint pointer_dem_generation;
   guint zoom_scroll_timeout;
   gdouble pinch_gesture_factor;
 
@@ -260,6 +282,7 @@ struct _VikWindow {
   /* half-drawn update */
   VikLayer *trigger;
   VikCoord trigger_center;
+  gboolean redraw_cached; // Next redraw may reuse the unchanged layers' drawings even without a trigger
 
   /* Store at this level for highlighted selection drawing since it applies to the viewport and the layers panel */
   /* Only one of these items can be selected at the same time */
@@ -747,6 +770,12 @@ static void window_finalize ( GObject *gob )
 
   if ( vw->sbiu_id )
     (void)g_source_remove ( vw->sbiu_id );
+  if ( vw->motion_id )
+    (void)g_source_remove ( vw->motion_id );
+  if ( vw->motion_event )
+    gdk_event_free ( vw->motion_event );
+  if ( vw->babel_action_group )
+    g_object_unref ( vw->babel_action_group );
 
   a_background_remove_window ( vw );
   a_logging_remove_window ( vw );
@@ -1893,8 +1922,64 @@ static gboolean window_configure_event ( VikWindow *vw, GdkEventConfigure *event
   return FALSE;
 }
 
+/**
+ * Redraw after a change only affecting how TRW layers are drawn (e.g. the highlight),
+ *  thus any other layers can reuse their existing drawing
+ */
+static void draw_update_trw ( VikWindow *vw )
+{
+  GList *layers = vik_layers_panel_get_all_layers_of_type ( vw->viking_vlp, VIK_LAYER_TRW, FALSE );
+  for ( GList *iter = layers; iter; iter = iter->next )
+    vik_layer_set_draw_dirty ( VIK_LAYER(iter->data) );
+  g_list_free ( layers );
+  vw->redraw_cached = TRUE;
+  draw_update ( vw );
+}
+
+/**
+ * Draw highlight (possibly again but ensures it is on top - especially for when tracks overlap)
+ */
+static void draw_highlight ( VikWindow *vw )
+{
+  if ( vik_viewport_get_draw_highlight (vw->viking_vvp) ) {
+    if ( vw->containing_vtl && (vw->selected_tracks || vw->selected_waypoints ) ) {
+      vik_trw_layer_draw_highlight_items ( vw->containing_vtl, vw->selected_tracks, vw->selected_waypoints, vw->viking_vvp );
+    }
+    else if ( vw->containing_vtl && (vw->selected_track || vw->selected_waypoint) ) {
+      vik_trw_layer_draw_highlight_item ( vw->containing_vtl, vw->selected_track, vw->selected_waypoint, vw->viking_vvp );
+    }
+    else if ( vw->selected_vtl ) {
+      vik_trw_layer_draw_highlight ( vw->selected_vtl, vw->viking_vvp );
+    }
+  }
+}
+
+/**
+ * Other viewport decoration items on top if they are enabled/in use
+ */
+static void draw_decorations ( VikWindow *vw )
+{
+  vik_viewport_draw_scale ( vw->viking_vvp );
+  vik_viewport_draw_copyright ( vw->viking_vvp );
+  vik_viewport_draw_centermark ( vw->viking_vvp );
+  vik_viewport_draw_logo ( vw->viking_vvp );
+  if ( a_trace_get_overlay() ) {
+    gchar *summary = a_trace_get_summary ();
+    vik_viewport_draw_overlay_text ( vw->viking_vvp, summary );
+    g_free ( summary );
+  }
+}
+
 static void draw_redraw ( VikWindow *vw )
 {
+  gint64 trace_begin = a_trace_begin ();
+
+  // Without a specific layer being updated, then what has changed is unknown (e.g. a preference)
+  //  so all layers have to be fully redrawn
+  if ( !vw->trigger && !vw->redraw_cached )
+    vik_viewport_cache_invalidate ( vw->viking_vvp );
+  vw->redraw_cached = FALSE;
+
   VikCoord old_center = vw->trigger_center;
   vw->trigger_center = *(vik_viewport_get_center(vw->viking_vvp));
   VikLayer *new_trigger = vw->trigger;
@@ -1917,27 +2002,43 @@ static void draw_redraw ( VikWindow *vw )
   vik_viewport_clear ( vw->viking_vvp);
   // Main layer drawing
   vik_layers_panel_draw_all ( vw->viking_vlp );
-  // Draw highlight (possibly again but ensures it is on top - especially for when tracks overlap)
-  if ( vik_viewport_get_draw_highlight (vw->viking_vvp) ) {
-    if ( vw->containing_vtl && (vw->selected_tracks || vw->selected_waypoints ) ) {
-      vik_trw_layer_draw_highlight_items ( vw->containing_vtl, vw->selected_tracks, vw->selected_waypoints, vw->viking_vvp );
-    }
-    else if ( vw->containing_vtl && (vw->selected_track || vw->selected_waypoint) ) {
-      vik_trw_layer_draw_highlight_item ( vw->containing_vtl, vw->selected_track, vw->selected_waypoint, vw->viking_vvp );
-    }
-    else if ( vw->selected_vtl ) {
-      vik_trw_layer_draw_highlight ( vw->selected_vtl, vw->viking_vvp );
-    }
-  }
-  // Other viewport decoration items on top if they are enabled/in use
-  vik_viewport_draw_scale ( vw->viking_vvp );
-  vik_viewport_draw_copyright ( vw->viking_vvp );
-  vik_viewport_draw_centermark ( vw->viking_vvp );
-  vik_viewport_draw_logo ( vw->viking_vvp );
+  draw_highlight ( vw );
+  // Keep the layers' drawing for reuse when panning
+  vik_viewport_scroll_save ( vw->viking_vvp );
+  // Ensure the overlay shows this frame
+  a_trace_frame_end ( trace_begin );
+  draw_decorations ( vw );
 
   vik_viewport_set_half_drawn ( vw->viking_vvp, FALSE ); /* just in case. */
 }
 
+/**
+ * Following a pan of the viewport by the given pixel offsets,
+ *  move the existing drawing and then only draw the newly exposed areas
+ *
+ * Returns: FALSE if this wasn't possible and so a full redraw is required
+ */
+static gboolean draw_scroll_blit ( VikWindow *vw, gint dx, gint dy )
+{
+  gint64 trace_begin = a_trace_begin ();
+  if ( !vik_viewport_scroll ( vw->viking_vvp, dx, dy ) )
+    return FALSE;
+
+  GdkRectangle rects[2];
+  guint nn = vik_viewport_scroll_exposed ( vw->viking_vvp, dx, dy, rects );
+  for ( guint ii = 0; ii < nn; ii++ ) {
+    vik_viewport_section_begin ( vw->viking_vvp, &rects[ii] );
+    vik_layers_panel_draw_all ( vw->viking_vlp );
+    draw_highlight ( vw );
+    vik_viewport_section_end ( vw->viking_vvp );
+  }
+  vik_viewport_scroll_save ( vw->viking_vvp );
+  a_trace_frame_end ( trace_begin );
+  draw_decorations ( vw );
+  (void)draw_sync ( vw );
+  return TRUE;
+}
+
 gboolean draw_buf_done = TRUE;
 
 #if !GTK_CHECK_VERSION (3,0,0)
@@ -1963,6 +2064,7 @@ static void vik_window_pan_click (VikWindow *vw, GdkEventButton *event)
 
 static gboolean draw_click (VikWindow *vw, GdkEventButton *event)
 {
+  motion_flush ( vw );
   gtk_widget_grab_focus ( GTK_WIDGET(vw->viking_vvp) );
 
   /* middle button pressed.  we reserve all middle button and scroll events
@@ -1997,15 +2099,21 @@ static void vik_window_pan_move (VikWindow *vw, GdkEventMotion *event)
   if ( vw->pan_x != -1 ) {
     gint new_pan_x = (gint)round(event->x);
     gint new_pan_y = (gint)round(event->y);
+    gint dx = new_pan_x - vw->pan_x;
+    gint dy = new_pan_y - vw->pan_y;
     vik_viewport_set_center_screen ( vw->viking_vvp,
-                                     vik_viewport_get_width(vw->viking_vvp)/2 - new_pan_x + vw->pan_x,
-                                     vik_viewport_get_height(vw->viking_vvp)/2 - new_pan_y + vw->pan_y );
+                                     vik_viewport_get_width(vw->viking_vvp)/2 - dx,
+                                     vik_viewport_get_height(vw->viking_vvp)/2 - dy );
     vw->pan_move = TRUE;
     vw->pan_x = new_pan_x;
     vw->pan_y = new_pan_y;
     if ( vw->pending_draw_id )
       g_source_remove ( vw->pending_draw_id );
-    vw->pending_draw_id = g_timeout_add ( vw->move_scroll_timeout, (GSourceFunc)pending_draw_timeout, vw );
+    vw->pending_draw_id = 0;
+    // Most of the previous drawing is still valid, so just shift it
+    //  (a full redraw occurs when the pan is released)
+    if ( !draw_scroll_blit ( vw, dx, dy ) )
+      vw->pending_draw_id = g_timeout_add ( vw->move_scroll_timeout, (GSourceFunc)pending_draw_timeout, vw );
   }
 }
 
@@ -2033,12 +2141,13 @@ static void get_location_strings ( VikWindow *vw, struct UTM utm, gchar **lat, g
   }
 }
 
-static gboolean draw_mouse_motion (VikWindow *vw, GdkEventMotion *event)
+/**
+ * Act on the latest pointer position
+ */
+static void motion_dispatch ( VikWindow *vw, GdkEventMotion *event )
 {
-  static VikCoord coord;
-  static struct UTM utm;
-  #define BUFFER_SIZE 50
-  static char pointer_buf[BUFFER_SIZE];
+  VikCoord coord;
+  struct UTM utm;
   gchar *lat = NULL, *lon = NULL;
   gint16 alt;
   gdouble zoom;
@@ -2059,9 +2168,6 @@ static gboolean draw_mouse_motion (VikWindow *vw, GdkEventMotion *event)
   toolbox_move(vw->vt, event);
 
   vik_viewport_screen_to_coord ( vw->viking_vvp, x, y, &coord );
-  vik_coord_to_utm ( &coord, &utm );
-
-  get_location_strings ( vw, utm, &lat, &lon );
 
   /* Change interpolate method according to scale */
   zoom = vik_viewport_get_zoom(vw->viking_vvp);
@@ -2071,23 +2177,104 @@ static gboolean draw_mouse_motion (VikWindow *vw, GdkEventMotion *event)
     interpol_method = VIK_DEM_INTERPOL_SIMPLE;
   else
     interpol_method = VIK_DEM_INTERPOL_BEST;
-  if ((alt = a_dems_get_elev_by_coord(&coord, interpol_method)) != VIK_DEM_INVALID_ELEVATION) {
-    if ( a_vik_get_units_height () == VIK_UNITS_HEIGHT_METRES )
-      g_snprintf ( pointer_buf, BUFFER_SIZE, _("%s %s %dm"), lat, lon, alt );
+
+  // Often still the same as last time (e.g. only moved within the same pixel),
+  //  in which case the location strings and DEM lookup need not be redone
+  VikViewportDrawMode drawmode = vik_viewport_get_drawmode ( vw->viking_vvp );
+  vik_units_height_t height_units = a_vik_get_units_height ();
+  guint dem_generation = a_dems_get_generation ();
+  if ( !vw->pointer_buf[0] ||
+       !vik_coord_equals ( &coord, &vw->pointer_coord ) ||
+       drawmode != vw->pointer_drawmode ||
+       interpol_method != vw->pointer_interpol ||
+       height_units != vw->pointer_height_units ||
+       dem_generation != vw->pointer_dem_generation ) {
+    vw->pointer_coord = coord;
+    vw->pointer_drawmode = drawmode;
+    vw->pointer_interpol = interpol_method;
+    vw->pointer_height_units = height_units;
+    vw->pointer_dem_generation = dem_generation;
+
+    vik_coord_to_utm ( &coord, &utm );
+    get_location_strings ( vw, utm, &lat, &lon );
+
+    if ((alt = a_dems_get_elev_by_coord(&coord, interpol_method)) != VIK_DEM_INVALID_ELEVATION) {
+      if ( height_units == VIK_UNITS_HEIGHT_METRES )
+        g_snprintf ( vw->pointer_buf, POINTER_BUFFER_SIZE, _("%s %s %dm"), lat, lon, alt );
+      else
+        g_snprintf ( vw->pointer_buf, POINTER_BUFFER_SIZE, _("%s %s %dft"), lat, lon, (int)VIK_METERS_TO_FEET(alt) );
+    }
     else
-      g_snprintf ( pointer_buf, BUFFER_SIZE, _("%s %s %dft"), lat, lon, (int)VIK_METERS_TO_FEET(alt) );
+      g_snprintf ( vw->pointer_buf, POINTER_BUFFER_SIZE, _("%s %s"), lat, lon );
+    g_free (lat);
+    lat = NULL;
+    g_free (lon);
+    lon = NULL;
+    vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_POSITION, vw->pointer_buf );
   }
-  else
-    g_snprintf ( pointer_buf, BUFFER_SIZE, _("%s %s"), lat, lon );
-  g_free (lat);
-  lat = NULL;
-  g_free (lon);
-  lon = NULL;
-  vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_POSITION, pointer_buf );
 
   // Middle button moving only
   if ( vw->pan_move_middle )
     vik_window_pan_move ( vw, event );
+}
+
+/**
+ * Handle any pending pointer motion now,
+ *  e.g. so a button release is acted on after the motion leading up to it
+ */
+static void motion_flush ( VikWindow *vw )
+{
+  if ( vw->motion_id ) {
+    (void)g_source_remove ( vw->motion_id );
+    vw->motion_id = 0;
+  }
+  if ( !vw->motion_event )
+    return;
+
+  GdkEvent *event = vw->motion_event;
+  vw->motion_event = NULL;
+  motion_dispatch ( vw, (GdkEventMotion*)event );
+  gdk_event_free ( event );
+  vw->motion_last = g_get_monotonic_time ();
+
+  // Covers from the first event received to when it has been dealt with
+  if ( vik_trace_enabled ) {
+    gchar *detail = g_strdup_printf ( "%u events", vw->motion_merged );
+    a_trace_end_detail ( "motion", detail, vw->motion_begin );
+    g_free ( detail );
+  }
+  vw->motion_merged = 0;
+}
+
+static gboolean motion_timeout ( VikWindow *vw )
+{
+  vw->motion_id = 0;
+  motion_flush ( vw );
+  return FALSE;
+}
+
+/**
+ * Pointers can send hundreds of motion events a second,
+ *  far more than can usefully be shown.
+ * So only the latest is kept, to be acted on once all the pending events have been received
+ *  and at most once per frame.
+ */
+static gboolean draw_mouse_motion (VikWindow *vw, GdkEventMotion *event)
+{
+  if ( vw->motion_event )
+    gdk_event_free ( vw->motion_event );
+  else
+    vw->motion_begin = a_trace_begin ();
+  vw->motion_event = gdk_event_copy ( (GdkEvent*)event );
+  vw->motion_merged++;
+
+  if ( !vw->motion_id ) {
+    gint64 wait = vw->motion_last + MOTION_INTERVAL - g_get_monotonic_time ();
+    if ( wait > 0 )
+      vw->motion_id = g_timeout_add_full ( G_PRIORITY_HIGH_IDLE, wait / 1000 + 1, (GSourceFunc)motion_timeout, vw, NULL );
+    else
+      vw->motion_id = g_idle_add_full ( G_PRIORITY_HIGH_IDLE, (GSourceFunc)motion_timeout, vw, NULL );
+  }
 
   /* This is recommended by the GTK+ documentation, but does not work properly.
    * Use deprecated way until GTK+ gets a solution for correct motion hint handling:
@@ -2156,6 +2343,7 @@ static void vik_window_pan_release ( VikWindow *vw, GdkEventButton *event )
 
 static gboolean draw_release ( VikWindow *vw, GdkEventButton *event )
 {
+  motion_flush ( vw );
   gtk_widget_grab_focus ( GTK_WIDGET(vw->viking_vvp) );
 
   if ( event->button == 2 ) {  /* move / pan */
@@ -4905,6 +5093,9 @@ void vik_window_open_file ( VikWindow *vw, const gchar *filename, gboolean chang
       // Not necessarily malformed - could be due to levels of support
       a_dialog_error_msg_extra ( GTK_WINDOW(vw), _("Unable to load FIT file %s"), filename );
       break;
+    case LOAD_TYPE_GEOJSON_FAILURE:
+      a_dialog_error_msg_extra ( GTK_WINDOW(vw), _("Unable to load malformed GeoJSON file %s"), filename );
+      break;
     case LOAD_TYPE_UNSUPPORTED_FAILURE:
       a_dialog_error_msg_extra ( GTK_WINDOW(vw), _("Unsupported file type for %s"), filename );
       break;
@@ -5498,9 +5689,7 @@ static void preferences_cb ( GtkAction *a, VikWindow *vw )
     g_slist_foreach ( window_list, (GFunc) preferences_change_update, NULL );
   }
 
-  // Ensure TZ Lookup initialized
-  if ( a_vik_get_time_ref_frame() == VIK_TIME_REF_WORLD )
-    vu_setup_lat_lon_tz_lookup();
+  // NB TZ Lookup is initialized on first use
 
   toolbar_apply_settings ( vw->viking_vtb, vw->main_vbox, vw->menu_hbox, TRUE );
 
@@ -5694,75 +5883,252 @@ static void save_image_file ( VikWindow *vw, const gchar *fn, guint w, guint h,
   draw_update ( vw );
 }
 
-static void save_image_dir ( VikWindow *vw, const gchar *fn, guint w, guint h, gdouble zoom, gboolean save_as_png, guint tiles_w, guint tiles_h )
+/*
+ * Saving a grid of images is done as a background job, so the UI remains usable:
+ *  the map tiles needed for each image are downloaded first (whilst the previous image is drawn),
+ *  each image is drawn by the main thread (as the layers can only draw into the window's viewport),
+ *  and then the images are encoded and written concurrently in a pool of threads.
+ */
+typedef struct {
+  VikWindow *vw;
+  VikViewport *vvp;
+  gulong destroy_id;
+  gboolean window_gone; // Only accessed in the main thread
+  gchar *dir;
+  guint w, h;
+  gdouble zoom;
+  gboolean save_as_png;
+  guint tiles_w, tiles_h;
+  struct UTM utm_orig;
+  GList *maps;          // The #VikMapsLayer to get tiles for
+  GThreadPool *encoders;
+  GMutex mutex;
+  GCond cond;
+  gboolean drawing;     // Waiting for the main thread to draw an image
+  gint cancelled;
+  gint failures;
+} image_dir_job_t;
+
+typedef struct {
+  image_dir_job_t *job;
+  struct UTM utm;
+  gchar *filename;
+  GdkPixbuf *pixbuf;
+} image_dir_tile_t;
+
+static void image_dir_tile_free ( image_dir_tile_t *tile )
 {
-  gulong size = sizeof(gchar) * (strlen(fn) + 15);
-  gchar *name_of_file = g_malloc ( size );
-  guint x = 1, y = 1;
-  struct UTM utm_orig, utm;
+  if ( tile->pixbuf )
+    g_object_unref ( tile->pixbuf );
+  g_free ( tile->filename );
+  g_free ( tile );
+}
 
-  /* *** copied from above *** */
-  gdouble old_xmpp, old_ympp;
-  GError *error = NULL;
+static void image_dir_window_destroy_cb ( GtkWidget *widget, image_dir_job_t *job )
+{
+  job->window_gone = TRUE;
+}
 
-  /* backup old zoom & set new */
-  old_xmpp = vik_viewport_get_xmpp ( vw->viking_vvp );
-  old_ympp = vik_viewport_get_ympp ( vw->viking_vvp );
-  vik_viewport_set_zoom ( vw->viking_vvp, zoom );
+// Runs in the encoder threads
+static void image_dir_encode ( image_dir_tile_t *tile, image_dir_job_t *job )
+{
+  if ( !g_atomic_int_get(&job->cancelled) ) {
+    GError *error = NULL;
+    if ( !gdk_pixbuf_save ( tile->pixbuf, tile->filename, job->save_as_png ? "png" : "jpeg", &error, NULL ) ) {
+      g_warning ( "Unable to write to file %s: %s", tile->filename, error ? error->message : "" );
+      if ( error )
+        g_error_free ( error );
+      g_atomic_int_inc ( &job->failures );
+    }
+  }
+  image_dir_tile_free ( tile );
+}
 
-  /* reset width and height: do this only once for all images (same size) */
-  vik_viewport_configure_manually ( vw->viking_vvp, w, h );
-  /* *** end copy from above *** */
+// Draw one image in the main thread, leaving the viewport as it was
+static gboolean image_dir_draw_idle ( image_dir_tile_t *tile )
+{
+  image_dir_job_t *job = tile->job;
 
-  g_assert ( vik_viewport_get_coord_mode ( vw->viking_vvp ) == VIK_COORD_UTM );
+  if ( !job->window_gone && !g_atomic_int_get(&job->cancelled) ) {
+    VikViewport *vvp = job->vvp;
+    VikCoord old_center = *vik_viewport_get_center ( vvp );
+    gdouble old_xmpp = vik_viewport_get_xmpp ( vvp );
+    gdouble old_ympp = vik_viewport_get_ympp ( vvp );
 
-  if ( g_mkdir(fn,0777) != 0 )
-    g_warning ( "%s: Failed to create directory %s", __FUNCTION__, fn );
+    vik_viewport_set_zoom ( vvp, job->zoom );
+    vik_viewport_configure_manually ( vvp, job->w, job->h );
+    vik_viewport_set_center_utm ( vvp, &tile->utm, FALSE );
 
-  utm_orig = *((const struct UTM *)vik_viewport_get_center ( vw->viking_vvp ));
+    draw_redraw ( job->vw );
+    tile->pixbuf = vik_viewport_get_pixbuf ( vvp, job->w, job->h );
 
-  for ( y = 1; y <= tiles_h; y++ )
-  {
-    for ( x = 1; x <= tiles_w; x++ )
-    {
-      g_snprintf ( name_of_file, size, "%s%cy%d-x%d.%s", fn, G_DIR_SEPARATOR, y, x, save_as_png ? "png" : "jpg" );
-      utm = utm_orig;
-      if ( tiles_w & 0x1 )
-        utm.easting += ((gdouble)x - ceil(((gdouble)tiles_w)/2)) * (w*zoom);
-      else
-        utm.easting += ((gdouble)x - (((gdouble)tiles_w)+1)/2) * (w*zoom);
-      if ( tiles_h & 0x1 ) /* odd */
-        utm.northing -= ((gdouble)y - ceil(((gdouble)tiles_h)/2)) * (h*zoom);
-      else /* even */
-        utm.northing -= ((gdouble)y - (((gdouble)tiles_h)+1)/2) * (h*zoom);
+    vik_viewport_set_center_coord ( vvp, &old_center, FALSE );
+    vik_viewport_set_xmpp ( vvp, old_xmpp );
+    vik_viewport_set_ympp ( vvp, old_ympp );
+    (void)vik_viewport_configure ( vvp );
+    draw_update ( job->vw );
+
+    if ( !tile->pixbuf ) {
+      g_warning ( "Failed to generate internal pixmap size: %d x %d", job->w, job->h );
+      g_atomic_int_inc ( &job->failures );
+    }
+  }
 
-      /* move to correct place. */
-      vik_viewport_set_center_utm ( vw->viking_vvp, &utm, FALSE );
+  if ( tile->pixbuf )
+    g_thread_pool_push ( job->encoders, tile, NULL );
+  else
+    image_dir_tile_free ( tile );
 
-      draw_redraw ( vw );
+  g_mutex_lock ( &job->mutex );
+  job->drawing = FALSE;
+  g_cond_broadcast ( &job->cond );
+  g_mutex_unlock ( &job->mutex );
+  return FALSE;
+}
 
-      /* save buffer as file. */
-      GdkPixbuf *pixbuf_to_save = vik_viewport_get_pixbuf ( vw->viking_vvp, w, h );
-      gdk_pixbuf_save ( pixbuf_to_save, name_of_file, save_as_png ? "png" : "jpeg", &error, NULL );
-      if (error)
-      {
-        gchar *msg = g_strdup_printf (_("Unable to write to file %s: %s"), name_of_file, error->message );
-        vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, msg );
-        g_free ( msg );
-        g_error_free (error);
+static void image_dir_wait_drawn ( image_dir_job_t *job )
+{
+  g_mutex_lock ( &job->mutex );
+  while ( job->drawing )
+    g_cond_wait ( &job->cond, &job->mutex );
+  g_mutex_unlock ( &job->mutex );
+}
+
+static int image_dir_thread ( image_dir_job_t *job, gpointer threaddata )
+{
+  const guint total = job->tiles_w * job->tiles_h;
+  // Only allow a few images to be waiting to be encoded, so memory usage remains bounded
+  const guint ahead = util_get_number_of_cpus () * 2;
+  guint done = 0;
+  int res = 0;
+
+  for ( guint y = 1; y <= job->tiles_h && !res; y++ ) {
+    for ( guint x = 1; x <= job->tiles_w && !res; x++ ) {
+      image_dir_tile_t *tile = g_malloc0 ( sizeof(image_dir_tile_t) );
+      tile->job = job;
+      tile->filename = g_strdup_printf ( "%s%cy%d-x%d.%s", job->dir, G_DIR_SEPARATOR, y, x, job->save_as_png ? "png" : "jpg" );
+      tile->utm = job->utm_orig;
+      if ( job->tiles_w & 0x1 )
+        tile->utm.easting += ((gdouble)x - ceil(((gdouble)job->tiles_w)/2)) * (job->w*job->zoom);
+      else
+        tile->utm.easting += ((gdouble)x - (((gdouble)job->tiles_w)+1)/2) * (job->w*job->zoom);
+      if ( job->tiles_h & 0x1 ) /* odd */
+        tile->utm.northing -= ((gdouble)y - ceil(((gdouble)job->tiles_h)/2)) * (job->h*job->zoom);
+      else /* even */
+        tile->utm.northing -= ((gdouble)y - (((gdouble)job->tiles_h)+1)/2) * (job->h*job->zoom);
+
+      // Get the maps for this image, whilst the previous one is being drawn
+      struct UTM corner = tile->utm;
+      VikCoord ul, br;
+      corner.easting -= job->w * job->zoom / 2;
+      corner.northing += job->h * job->zoom / 2;
+      vik_coord_load_from_utm ( &ul, VIK_COORD_UTM, &corner );
+      corner.easting += job->w * job->zoom;
+      corner.northing -= job->h * job->zoom;
+      vik_coord_load_from_utm ( &br, VIK_COORD_UTM, &corner );
+      for ( GList *iter = job->maps; iter && !res; iter = g_list_next(iter) )
+        res = vik_maps_layer_download_section_wait ( VIK_MAPS_LAYER(iter->data), job->vvp, &ul, &br, job->zoom, threaddata );
+
+      image_dir_wait_drawn ( job );
+      while ( !res && g_thread_pool_unprocessed(job->encoders) > ahead ) {
+        g_usleep ( G_USEC_PER_SEC / 50 );
+        res = a_background_testcancel ( threaddata );
       }
+      if ( res ) {
+        image_dir_tile_free ( tile );
+        break;
+      }
+
+      g_mutex_lock ( &job->mutex );
+      job->drawing = TRUE;
+      g_mutex_unlock ( &job->mutex );
+      (void)gdk_threads_add_idle ( (GSourceFunc)image_dir_draw_idle, tile );
 
-      g_object_unref ( G_OBJECT(pixbuf_to_save) );
+      done++;
+      res = a_background_thread_progress ( threaddata, (gdouble)done / total );
     }
   }
 
-  vik_viewport_set_center_utm ( vw->viking_vvp, &utm_orig, FALSE );
-  vik_viewport_set_xmpp ( vw->viking_vvp, old_xmpp );
-  vik_viewport_set_ympp ( vw->viking_vvp, old_ympp );
-  (void)vik_viewport_configure ( vw->viking_vvp );
-  draw_update ( vw );
+  image_dir_wait_drawn ( job );
+  g_thread_pool_free ( job->encoders, FALSE, TRUE );
+  job->encoders = NULL;
+  return res;
+}
+
+static void image_dir_cancel ( image_dir_job_t *job )
+{
+  g_atomic_int_set ( &job->cancelled, 1 );
+}
+
+// Report and tidy up in the main thread
+static gboolean image_dir_finish_idle ( image_dir_job_t *job )
+{
+  if ( !job->window_gone ) {
+    gchar *msg;
+    guint total = job->tiles_w * job->tiles_h;
+    if ( job->failures )
+      msg = g_strdup_printf ( _("Failed to generate %d of %d image files"), job->failures, total );
+    else if ( g_atomic_int_get(&job->cancelled) )
+      msg = g_strdup ( _("Image file generation cancelled") );
+    else
+      msg = g_strdup_printf ( _("Generated %d image files in %s"), total, job->dir );
+    vik_statusbar_set_message ( job->vw->viking_vs, VIK_STATUSBAR_INFO, msg );
+    g_free ( msg );
+    g_signal_handler_disconnect ( job->vw, job->destroy_id );
+  }
+
+  g_list_free_full ( job->maps, g_object_unref );
+  g_object_unref ( job->vvp );
+  g_object_unref ( job->vw );
+  g_mutex_clear ( &job->mutex );
+  g_cond_clear ( &job->cond );
+  g_free ( job->dir );
+  g_free ( job );
+  return FALSE;
+}
+
+static void image_dir_free ( image_dir_job_t *job )
+{
+  (void)gdk_threads_add_idle ( (GSourceFunc)image_dir_finish_idle, job );
+}
+
+static void save_image_dir ( VikWindow *vw, const gchar *fn, guint w, guint h, gdouble zoom, gboolean save_as_png, guint tiles_w, guint tiles_h )
+{
+  g_assert ( vik_viewport_get_coord_mode ( vw->viking_vvp ) == VIK_COORD_UTM );
+
+  if ( g_mkdir(fn,0777) != 0 )
+    g_warning ( "%s: Failed to create directory %s", __FUNCTION__, fn );
 
-  g_free ( name_of_file );
+  image_dir_job_t *job = g_malloc0 ( sizeof(image_dir_job_t) );
+  job->vw = g_object_ref ( vw );
+  job->vvp = g_object_ref ( vw->viking_vvp );
+  job->dir = g_strdup ( fn );
+  job->w = w;
+  job->h = h;
+  job->zoom = zoom;
+  job->save_as_png = save_as_png;
+  job->tiles_w = tiles_w;
+  job->tiles_h = tiles_h;
+  job->utm_orig = *((const struct UTM *)vik_viewport_get_center ( vw->viking_vvp ));
+  job->maps = vik_layers_panel_get_all_layers_of_type ( vw->viking_vlp, VIK_LAYER_MAPS, FALSE );
+  g_list_foreach ( job->maps, (GFunc)g_object_ref, NULL );
+  g_mutex_init ( &job->mutex );
+  g_cond_init ( &job->cond );
+  job->encoders = g_thread_pool_new ( (GFunc)image_dir_encode, job, util_get_number_of_cpus(), FALSE, NULL );
+  job->destroy_id = g_signal_connect ( G_OBJECT(vw), "destroy", G_CALLBACK(image_dir_window_destroy_cb), job );
+
+  guint total = tiles_w * tiles_h;
+  gchar *msg = g_strdup_printf ( ngettext("Generating %d image file...", "Generating %d image files...", total), total );
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        GTK_WINDOW(vw),
+                        msg,
+                        (vik_thr_func)image_dir_thread,
+                        job,
+                        (vik_thr_free_func)image_dir_free,
+                        (vik_thr_free_func)image_dir_cancel,
+                        total );
+  vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, msg );
+  g_free ( msg );
 }
 
 static void draw_to_image_file_current_window_cb(GtkWidget* widget,GdkEventButton *event,gpointer *pass_along)
@@ -6259,7 +6625,7 @@ static void toggle_draw_highlight ( GtkAction *a, VikWindow *vw )
     return;
   gtk_check_menu_item_set_active ( GTK_CHECK_MENU_ITEM(check_box), state );
   vik_viewport_set_draw_highlight ( vw->viking_vvp, state );
-  draw_update ( vw );
+  draw_update_trw ( vw );
 }
 
 static void set_bg_color ( GtkAction *a, VikWindow *vw )
@@ -6351,6 +6717,7 @@ static GtkActionEntry entries[] = {
   { "Export",    GTK_STOCK_CONVERT,      N_("_Export All"),               NULL,         N_("Export All TrackWaypoint Layers"),              (GCallback)NULL                  },
   { "ExportGPX", NULL,                   N_("_GPX..."),           	      NULL,         N_("Export as GPX"),                                (GCallback)export_to_gpx         },
   { "ExportSingleGPX", NULL,             N_("_Single GPX File..."),       NULL,         N_("Export to Single GPX File"),                    (GCallback)export_to_single_gpx  },
+  { "ExportKML", NULL,                   N_("_KML..."),           	      NULL,         N_("Export as KML"),                                (GCallback)export_to_kml         },
   { "Acquire",   GTK_STOCK_GO_DOWN,      N_("A_cquire"),                  NULL,         NULL,                                               (GCallback)NULL },
   { "AcquireRouting",   NULL,             N_("_Directions..."),     NULL,         N_("Get driving directions"),           (GCallback)acquire_from_routing   },
 #ifdef VIK_CONFIG_OPENSTREETMAP
@@ -6427,7 +6794,6 @@ static GtkActionEntry debug_entries[] = {
 };
 
 static GtkActionEntry entries_gpsbabel[] = {
-  { "ExportKML", NULL,                   N_("_KML..."),           	      NULL,         N_("Export as KML"),                                (GCallback)export_to_kml },
   { "AcquireGPS",   NULL,                N_("From _GPS..."),           	  NULL,         N_("Transfer data from a GPS device"),              (GCallback)acquire_from_gps      },
   { "AcquireGPSBabel", NULL,             N_("Import File With GPS_Babel..."), NULL,     N_("Import file via GPSBabel converter"),           (GCallback)acquire_from_file },
 };
@@ -6489,6 +6855,60 @@ static gpointer toggle_entries_toolbar_cb[] = {
   (GCallback)tb_view_side_panel_splits_cb,
 };
 
+/**
+ * The GPSBabel menu entries depend on whether it is available,
+ *  which may only become known after the window has been created
+ */
+static void window_update_babel_ui ( VikWindow *window )
+{
+  GError *error = NULL;
+
+  if ( window->babel_merge_id ) {
+    gtk_ui_manager_remove_ui ( window->uim, window->babel_merge_id );
+    window->babel_merge_id = 0;
+  }
+  if ( window->babel_action_group ) {
+    gtk_ui_manager_remove_action_group ( window->uim, window->babel_action_group );
+    g_object_unref ( window->babel_action_group );
+  }
+  window->babel_action_group = gtk_action_group_new ( "BabelActions" );
+  gtk_action_group_set_translation_domain ( window->babel_action_group, PACKAGE_NAME );
+
+  // Use this to see if GPSBabel is available:
+  if ( a_babel_available () ) {
+    // If going to add more entries then might be worth creating a menu_gpsbabel.xml.h file
+    window->babel_merge_id = gtk_ui_manager_add_ui_from_string ( window->uim,
+         "<ui>" \
+         "<menubar name='MainMenu'>" \
+         "<menu action='File'><menu action='Acquire'><menuitem action='AcquireGPS'/></menu></menu>" \
+         "<menu action='File'><menu action='Acquire'><menuitem action='AcquireGPSBabel'/></menu></menu>" \
+         "</menubar>" \
+         "</ui>",
+         -1, &error );
+    if ( window->babel_merge_id )
+      gtk_action_group_add_actions ( window->babel_action_group, entries_gpsbabel, G_N_ELEMENTS (entries_gpsbabel), window );
+  } else if ( a_babel_ready () ) {
+    // Stick in a link to GPSBabel website
+    window->babel_merge_id = gtk_ui_manager_add_ui_from_string ( window->uim,
+         "<ui><menubar name='MainMenu'><menu action='Help'><separator/><menuitem action='GPSBabelURL'/></menu></menubar></ui>",
+         -1, &error );
+    if ( window->babel_merge_id )
+      gtk_action_group_add_actions ( window->babel_action_group, entries_nogpsbabel, G_N_ELEMENTS (entries_nogpsbabel), window );
+  }
+  if ( error ) {
+    g_warning ( "%s: %s", __FUNCTION__, error->message );
+    g_error_free ( error );
+  }
+
+  gtk_ui_manager_insert_action_group ( window->uim, window->babel_action_group, 0 );
+}
+
+static void babel_ready_cb ( gpointer user_data )
+{
+  for ( GSList *sl = window_list; sl; sl = sl->next )
+    window_update_babel_ui ( VIK_WINDOW(sl->data) );
+}
+
 #include "menu.xml.h"
 static void window_create_ui( VikWindow *window )
 {
@@ -6597,36 +7017,19 @@ static void window_create_ui( VikWindow *window )
     toolbar_action_mode_entry_register ( window->viking_vtb, &mode_entries[i] );
   }
 
-  // Use this to see if GPSBabel is available:
-  if ( a_babel_available () ) {
-    // If going to add more entries then might be worth creating a menu_gpsbabel.xml.h file
-    if ( gtk_ui_manager_add_ui_from_string ( uim,
-         "<ui>" \
-         "<menubar name='MainMenu'>" \
-         "<menu action='File'><menu action='Export'><menuitem action='ExportKML'/></menu></menu>" \
-         "<menu action='File'><menu action='Acquire'><menuitem action='AcquireGPS'/></menu></menu>" \
-         "<menu action='File'><menu action='Acquire'><menuitem action='AcquireGPSBabel'/></menu></menu>" \
-         "</menubar>" \
-         "</ui>",
-         -1, &error ) )
-      gtk_action_group_add_actions ( action_group, entries_gpsbabel, G_N_ELEMENTS (entries_gpsbabel), window );
-  } else {
-    // Stick in a link to GPSBabel website
-    if ( gtk_ui_manager_add_ui_from_string ( uim,
-         "<ui><menubar name='MainMenu'><menu action='Help'><separator/><menuitem action='GPSBabelURL'/></menu></menubar></ui>",
-         -1, &error ) )
-      gtk_action_group_add_actions ( action_group, entries_nogpsbabel, G_N_ELEMENTS (entries_nogpsbabel), window );
+  window_update_babel_ui ( window );
+  // Not yet known, so update all windows when it is
+  static gboolean babel_callback_added = FALSE;
+  if ( !a_babel_ready() && !babel_callback_added ) {
+    a_babel_add_ready_callback ( babel_ready_cb, NULL );
+    babel_callback_added = TRUE;
   }
 
   // GeoJSON import capability
-  gchar *gjp = g_find_program_in_path ( a_geojson_program_import() );
-  if ( gjp ) {
-    if ( gtk_ui_manager_add_ui_from_string ( uim,
-         "<ui><menubar name='MainMenu'><menu action='File'><menu action='Acquire'><menuitem action='AcquireGeoJSON'/></menu></menu></menubar></ui>",
-         -1, &error ) )
-      gtk_action_group_add_actions ( action_group, entries_geojson, G_N_ELEMENTS (entries_geojson), window );
-    g_free ( gjp );
-  }
+  if ( gtk_ui_manager_add_ui_from_string ( uim,
+       "<ui><menubar name='MainMenu'><menu action='File'><menu action='Acquire'><menuitem action='AcquireGeoJSON'/></menu></menu></menubar></ui>",
+       -1, &error ) )
+    gtk_action_group_add_actions ( action_group, entries_geojson, G_N_ELEMENTS (entries_geojson), window );
 
   icon_factory = gtk_icon_factory_new ();
   gtk_icon_factory_add_default (icon_factory); 
@@ -6756,6 +7159,17 @@ register_vik_icons ( GtkIconFactory *icon_factory )
   a_register_icon ( icon_factory, VIK_ICON_SUN_MOON );
 }
 
+/**
+ * The highlight of both the previous and the new selection will need drawing
+ */
+static void window_selection_changed ( VikWindow *vw, gpointer vtl )
+{
+  if ( vw->containing_vtl )
+    vik_layer_set_draw_dirty ( VIK_LAYER(vw->containing_vtl) );
+  if ( vtl )
+    vik_layer_set_draw_dirty ( VIK_LAYER(vtl) );
+}
+
 gpointer vik_window_get_selected_trw_layer ( VikWindow *vw )
 {
   return vw->selected_vtl;
@@ -6763,6 +7177,7 @@ gpointer vik_window_get_selected_trw_layer ( VikWindow *vw )
 
 void vik_window_set_selected_trw_layer ( VikWindow *vw, gpointer vtl )
 {
+  window_selection_changed ( vw, vtl );
   vw->selected_vtl   = vtl;
   vw->containing_vtl = vtl;
   /* Clear others */
@@ -6786,6 +7201,7 @@ GHashTable *vik_window_get_selected_tracks ( VikWindow *vw )
 
 void vik_window_set_selected_tracks ( VikWindow *vw, GHashTable *ght, gpointer vtl )
 {
+  window_selection_changed ( vw, vtl );
   vw->selected_tracks = ght;
   vw->containing_vtl  = vtl;
   /* Clear others */
@@ -6805,6 +7221,7 @@ VikTrack* vik_window_get_selected_track ( VikWindow *vw )
 
 void vik_window_set_selected_track ( VikWindow *vw, VikTrack *vt, gpointer vtl )
 {
+  window_selection_changed ( vw, vtl );
   vw->selected_track = vt;
   if ( vt )
     vik_layers_panel_track_add ( vw->viking_vlp, vt, vtl );
@@ -6825,6 +7242,7 @@ GHashTable *vik_window_get_selected_waypoints ( VikWindow *vw )
 
 void vik_window_set_selected_waypoints ( VikWindow *vw, GHashTable *ght, gpointer vtl )
 {
+  window_selection_changed ( vw, vtl );
   vw->selected_waypoints = ght;
   vw->containing_vtl     = vtl;
   /* Clear others */
@@ -6842,6 +7260,7 @@ gpointer vik_window_get_selected_waypoint ( VikWindow *vw )
 
 void vik_window_set_selected_waypoint ( VikWindow *vw, gpointer *vwp, gpointer vtl )
 {
+  window_selection_changed ( vw, vtl );
   vw->selected_waypoint = vwp;
   vw->containing_vtl    = vtl;
   /* Clear others */
@@ -6859,6 +7278,7 @@ gboolean vik_window_clear_selected ( VikWindow *vw )
   }
 
   gboolean need_redraw = FALSE;
+  window_selection_changed ( vw, NULL );
   vw->containing_vtl = NULL;
   if ( vw->selected_vtl != NULL ) {
     vw->selected_vtl = NULL;
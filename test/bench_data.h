@@ -0,0 +1,38 @@
+// Copyright: CC0
+// The synthetic data shared between bench_generate and bench_run
+#ifndef _BENCH_DATA_H
+#define _BENCH_DATA_H
+
+#include <glib.h>
+#include <math.h>
+
+#define BENCH_GPX_FILE "large.gpx"
+#define BENCH_VIK_FILE "tracks.vik"
+// Covers latitudes 51 to 52 and longitudes -2 to -1
+#define BENCH_HGT_FILE "N51W002.hgt"
+#define BENCH_TILES_DIR "tiles"
+#define BENCH_MBTILES_FILE "tiles.mbtiles"
+#define BENCH_TCX_DIR "tcx"
+
+// All the tracks are within the area of the HGT file
+#define BENCH_SOUTH 51.1
+#define BENCH_NORTH 51.9
+#define BENCH_WEST -1.9
+#define BENCH_EAST -1.1
+
+#define BENCH_TILE_ZOOM 13
+#define BENCH_TILES_ACROSS 32
+
+/**
+ * The top left tile of the generated tiles, around the middle of the area
+ */
+static inline void bench_tile_origin ( gint *x, gint *y )
+{
+  gdouble lat = (BENCH_SOUTH + BENCH_NORTH) / 2 * G_PI / 180;
+  gdouble lon = (BENCH_WEST + BENCH_EAST) / 2;
+  gdouble nn = 1 << BENCH_TILE_ZOOM;
+  *x = (gint)floor ( (lon + 180) / 360 * nn ) - BENCH_TILES_ACROSS / 2;
+  *y = (gint)floor ( (1 - log(tan(lat) + 1/cos(lat)) / G_PI) / 2 * nn ) - BENCH_TILES_ACROSS / 2;
+}
+
+#endif
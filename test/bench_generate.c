@@ -0,0 +1,354 @@
+// Copyright: CC0
+// Generate large synthetic data files for bench_run:
+//  a GPX file, a .vik file with many tracks, an SRTM HGT file,
+//  a directory of map tiles, an MBTiles file (when supported)
+//  and a directory of TCX activities
+// run like:
+//  ./bench_generate -d bench_data
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib/gprintf.h>
+#include <math.h>
+#include <stdio.h>
+#ifdef HAVE_SQLITE3_H
+#include <sqlite3.h>
+#endif
+#include "gpx.h"
+#include "gpspoint.h"
+#include "viklayer.h"
+#include "viklayer_defaults.h"
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+#include "download.h"
+#include "bench_data.h"
+
+static gchar *dir = "bench_data";
+static gint gpx_points = 1000000;
+static gint vik_tracks = 5000;
+static gint vik_track_points = 200;
+static gint tcx_files = 200;
+static gint tcx_points = 3600;
+static gboolean force = FALSE;
+
+static GOptionEntry entries[] =
+{
+  { "dir", 'd', 0, G_OPTION_ARG_FILENAME, &dir, "Directory to create the files in", NULL },
+  { "gpx-points", 'n', 0, G_OPTION_ARG_INT, &gpx_points, "Total number of trackpoints in the GPX file", NULL },
+  { "vik-tracks", 't', 0, G_OPTION_ARG_INT, &vik_tracks, "Number of tracks in the .vik file", NULL },
+  { "vik-track-points", 'p', 0, G_OPTION_ARG_INT, &vik_track_points, "Trackpoints per track in the .vik file", NULL },
+  { "tcx-files", 'x', 0, G_OPTION_ARG_INT, &tcx_files, "Number of TCX files", NULL },
+  { "tcx-points", 'y', 0, G_OPTION_ARG_INT, &tcx_points, "Trackpoints per TCX file", NULL },
+  { "force", 'f', 0, G_OPTION_ARG_NONE, &force, "Regenerate files that already exist", NULL },
+  { NULL }
+};
+
+/**
+ * Random walks within the area, with timestamps and altitudes so all the statistics have something to do
+ */
+static void add_tracks ( VikTrwLayer *vtl, GRand *rand, gint total, gint per_track )
+{
+  gint count = 0;
+  gdouble timestamp = 1600000000.0;
+  while ( total > 0 ) {
+    VikTrack *trk = vik_track_new ();
+    gdouble lat = g_rand_double_range ( rand, BENCH_SOUTH, BENCH_NORTH );
+    gdouble lon = g_rand_double_range ( rand, BENCH_WEST, BENCH_EAST );
+    gdouble alt = g_rand_double_range ( rand, 0, 500 );
+    for ( gint ii = 0; ii < per_track && total > 0; ii++, total-- ) {
+      VikTrackpoint *tp = vik_trackpoint_new ();
+      struct LatLon ll = { lat, lon };
+      vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+      tp->timestamp = timestamp;
+      tp->altitude = alt;
+      // Occasional gaps
+      tp->newsegment = ii > 0 && g_rand_int_range ( rand, 0, 1000 ) == 0;
+      trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
+      lat = CLAMP ( lat + g_rand_double_range(rand, -0.0002, 0.0002), BENCH_SOUTH, BENCH_NORTH );
+      lon = CLAMP ( lon + g_rand_double_range(rand, -0.0003, 0.0003), BENCH_WEST, BENCH_EAST );
+      alt += g_rand_double_range ( rand, -2.0, 2.0 );
+      timestamp += g_rand_double_range ( rand, 1.0, 5.0 );
+    }
+    trk->trackpoints = g_list_reverse ( trk->trackpoints );
+    gchar *name = g_strdup_printf ( "Track %d", ++count );
+    vik_trw_layer_add_track ( vtl, name, trk );
+    g_free ( name );
+  }
+}
+
+static gboolean needs_generating ( const gchar *filename )
+{
+  if ( !force && g_file_test(filename, G_FILE_TEST_EXISTS) ) {
+    g_printf ( "Using existing %s\n", filename );
+    return FALSE;
+  }
+  g_printf ( "Generating %s\n", filename );
+  return TRUE;
+}
+
+static gboolean generate_gpx ( GRand *rand )
+{
+  gchar *filename = g_build_filename ( dir, BENCH_GPX_FILE, NULL );
+  gboolean ok = TRUE;
+  if ( needs_generating(filename) ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER ( vik_layer_create(VIK_LAYER_TRW, NULL, FALSE) );
+    add_tracks ( vtl, rand, gpx_points, 10000 );
+    FILE *ff = g_fopen ( filename, "w" );
+    if ( ff ) {
+      a_gpx_write_file ( vtl, ff, NULL, NULL );
+      ok = fclose ( ff ) == 0;
+    }
+    else
+      ok = FALSE;
+    g_object_unref ( vtl );
+  }
+  g_free ( filename );
+  return ok;
+}
+
+static gboolean generate_vik ( GRand *rand )
+{
+  gchar *filename = g_build_filename ( dir, BENCH_VIK_FILE, NULL );
+  gboolean ok = TRUE;
+  if ( needs_generating(filename) ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER ( vik_layer_create(VIK_LAYER_TRW, NULL, FALSE) );
+    add_tracks ( vtl, rand, vik_tracks * vik_track_points, vik_track_points );
+    FILE *ff = g_fopen ( filename, "w" );
+    if ( ff ) {
+      // Just enough of a .vik file for a single TrackWaypoint layer
+      fprintf ( ff, "#VIKING GPS Data file http://viking.sf.net/\nFILE_VERSION=1\n\n" );
+      fprintf ( ff, "~Layer TrackWaypoint\nname=Bench\n\n~LayerData\n" );
+      a_gpspoint_write_file ( vtl, ff, NULL );
+      fprintf ( ff, "~EndLayerData\n~EndLayer\n" );
+      ok = fclose ( ff ) == 0;
+    }
+    else
+      ok = FALSE;
+    g_object_unref ( vtl );
+  }
+  g_free ( filename );
+  return ok;
+}
+
+/**
+ * A 1 arc second SRTM tile of rolling hills
+ */
+static gboolean generate_hgt ( void )
+{
+  gchar *filename = g_build_filename ( dir, BENCH_HGT_FILE, NULL );
+  gboolean ok = TRUE;
+  if ( needs_generating(filename) ) {
+    const gint rows = 3601;
+    gint16 *data = g_new ( gint16, rows * rows );
+    for ( gint yy = 0; yy < rows; yy++ )
+      for ( gint xx = 0; xx < rows; xx++ ) {
+        gdouble elev = 200 + 150 * sin ( xx / 97.0 ) * cos ( yy / 131.0 ) + 40 * sin ( (xx + yy) / 23.0 );
+        data[yy * rows + xx] = GINT16_TO_BE ( (gint16)elev );
+      }
+    GError *error = NULL;
+    ok = g_file_set_contents ( filename, (const gchar*)data, rows * rows * sizeof(gint16), &error );
+    if ( error ) {
+      g_printerr ( "%s\n", error->message );
+      g_error_free ( error );
+    }
+    g_free ( data );
+  }
+  g_free ( filename );
+  return ok;
+}
+
+static GdkPixbuf *make_tile ( gint xx, gint yy )
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, FALSE, 8, 256, 256 );
+  guchar *pixels = gdk_pixbuf_get_pixels ( pixbuf );
+  gint stride = gdk_pixbuf_get_rowstride ( pixbuf );
+  for ( gint row = 0; row < 256; row++ )
+    for ( gint col = 0; col < 256; col++ ) {
+      guchar *pp = pixels + row * stride + col * 3;
+      pp[0] = (guchar)(xx * 8 + col);
+      pp[1] = (guchar)(yy * 8 + row);
+      pp[2] = (guchar)((row ^ col) & 0x3f) + 128;
+    }
+  return pixbuf;
+}
+
+/**
+ * Tiles in the OSM cache layout, i.e. z/x/y.png
+ */
+static gboolean generate_tiles ( void )
+{
+  gchar *tiledir = g_build_filename ( dir, BENCH_TILES_DIR, NULL );
+  gboolean ok = TRUE;
+  if ( needs_generating(tiledir) ) {
+    gint x0, y0;
+    bench_tile_origin ( &x0, &y0 );
+    for ( gint xx = x0; ok && xx < x0 + BENCH_TILES_ACROSS; xx++ ) {
+      gchar *xdir = g_strdup_printf ( "%s%s%d%s%d", tiledir, G_DIR_SEPARATOR_S, BENCH_TILE_ZOOM, G_DIR_SEPARATOR_S, xx );
+      ok = g_mkdir_with_parents ( xdir, 0755 ) == 0;
+      for ( gint yy = y0; ok && yy < y0 + BENCH_TILES_ACROSS; yy++ ) {
+        gchar *filename = g_strdup_printf ( "%s%s%d.png", xdir, G_DIR_SEPARATOR_S, yy );
+        GdkPixbuf *pixbuf = make_tile ( xx, yy );
+        ok = gdk_pixbuf_save ( pixbuf, filename, "png", NULL, NULL );
+        g_object_unref ( pixbuf );
+        g_free ( filename );
+      }
+      g_free ( xdir );
+    }
+  }
+  g_free ( tiledir );
+  return ok;
+}
+
+/**
+ * Activities as typically exported from a training log, one lap each
+ */
+static gboolean generate_tcx ( GRand *rand )
+{
+  gchar *tcxdir = g_build_filename ( dir, BENCH_TCX_DIR, NULL );
+  gboolean ok = TRUE;
+  if ( needs_generating(tcxdir) ) {
+    ok = g_mkdir_with_parents ( tcxdir, 0755 ) == 0;
+    gint64 timestamp = 1600000000;
+    for ( gint nn = 0; ok && nn < tcx_files; nn++ ) {
+      gchar *filename = g_strdup_printf ( "%s%sactivity%04d.tcx", tcxdir, G_DIR_SEPARATOR_S, nn );
+      FILE *ff = g_fopen ( filename, "w" );
+      g_free ( filename );
+      if ( !ff ) {
+        ok = FALSE;
+        break;
+      }
+      fprintf ( ff, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                    "<TrainingCenterDatabase xmlns=\"http://www.garmin.com/xmlschemas/TrainingCenterDatabase/v2\" xmlns:ns3=\"http://www.garmin.com/xmlschemas/ActivityExtension/v2\">\n"
+                    " <Activities>\n  <Activity Sport=\"Running\">\n   <Lap>\n    <Track>\n" );
+      gdouble lat = g_rand_double_range ( rand, BENCH_SOUTH, BENCH_NORTH );
+      gdouble lon = g_rand_double_range ( rand, BENCH_WEST, BENCH_EAST );
+      gdouble alt = g_rand_double_range ( rand, 0, 500 );
+      gchar lat_str[G_ASCII_DTOSTR_BUF_SIZE], lon_str[G_ASCII_DTOSTR_BUF_SIZE], alt_str[G_ASCII_DTOSTR_BUF_SIZE];
+      for ( gint ii = 0; ii < tcx_points; ii++ ) {
+        GDateTime *gdt = g_date_time_new_from_unix_utc ( timestamp++ );
+        gchar *time_str = g_date_time_format ( gdt, "%Y-%m-%dT%H:%M:%SZ" );
+        g_date_time_unref ( gdt );
+        fprintf ( ff, "     <Trackpoint>\n      <Time>%s</Time>\n"
+                      "      <Position><LatitudeDegrees>%s</LatitudeDegrees><LongitudeDegrees>%s</LongitudeDegrees></Position>\n"
+                      "      <AltitudeMeters>%s</AltitudeMeters>\n"
+                      "      <HeartRateBpm><Value>%d</Value></HeartRateBpm>\n"
+                      "      <Extensions><ns3:TPX><ns3:Speed>%.2f</ns3:Speed><ns3:RunCadence>%d</ns3:RunCadence></ns3:TPX></Extensions>\n"
+                      "     </Trackpoint>\n",
+                  time_str,
+                  g_ascii_formatd ( lat_str, sizeof(lat_str), "%.7f", lat ),
+                  g_ascii_formatd ( lon_str, sizeof(lon_str), "%.7f", lon ),
+                  g_ascii_formatd ( alt_str, sizeof(alt_str), "%.1f", alt ),
+                  g_rand_int_range ( rand, 110, 180 ),
+                  g_rand_double_range ( rand, 2.0, 4.0 ),
+                  g_rand_int_range ( rand, 80, 95 ) );
+        g_free ( time_str );
+        lat = CLAMP ( lat + g_rand_double_range(rand, -0.0002, 0.0002), BENCH_SOUTH, BENCH_NORTH );
+        lon = CLAMP ( lon + g_rand_double_range(rand, -0.0003, 0.0003), BENCH_WEST, BENCH_EAST );
+        alt += g_rand_double_range ( rand, -2.0, 2.0 );
+      }
+      fprintf ( ff, "    </Track>\n   </Lap>\n  </Activity>\n </Activities>\n</TrainingCenterDatabase>\n" );
+      ok = fclose ( ff ) == 0;
+    }
+  }
+  g_free ( tcxdir );
+  return ok;
+}
+
+#ifdef HAVE_SQLITE3_H
+static gboolean generate_mbtiles ( void )
+{
+  gchar *filename = g_build_filename ( dir, BENCH_MBTILES_FILE, NULL );
+  gboolean ok = TRUE;
+  if ( needs_generating(filename) ) {
+    (void)g_remove ( filename );
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    ok = sqlite3_open ( filename, &db ) == SQLITE_OK &&
+         sqlite3_exec ( db, "CREATE TABLE metadata (name text, value text);"
+                            "INSERT INTO metadata VALUES ('name', 'bench'), ('format', 'png');"
+                            "CREATE TABLE tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob);"
+                            "CREATE UNIQUE INDEX tile_index ON tiles (zoom_level, tile_column, tile_row);"
+                            "BEGIN;", NULL, NULL, NULL ) == SQLITE_OK &&
+         sqlite3_prepare_v2 ( db, "INSERT INTO tiles VALUES (?, ?, ?, ?);", -1, &stmt, NULL ) == SQLITE_OK;
+    gint x0, y0;
+    bench_tile_origin ( &x0, &y0 );
+    for ( gint xx = x0; ok && xx < x0 + BENCH_TILES_ACROSS; xx++ ) {
+      for ( gint yy = y0; ok && yy < y0 + BENCH_TILES_ACROSS; yy++ ) {
+        GdkPixbuf *pixbuf = make_tile ( xx, yy );
+        gchar *buffer = NULL;
+        gsize size = 0;
+        ok = gdk_pixbuf_save_to_buffer ( pixbuf, &buffer, &size, "png", NULL, NULL );
+        g_object_unref ( pixbuf );
+        if ( !ok )
+          break;
+        // MBTiles use the TMS numbering, i.e. flipped in the y direction
+        sqlite3_bind_int ( stmt, 1, BENCH_TILE_ZOOM );
+        sqlite3_bind_int ( stmt, 2, xx );
+        sqlite3_bind_int ( stmt, 3, (1 << BENCH_TILE_ZOOM) - 1 - yy );
+        sqlite3_bind_blob ( stmt, 4, buffer, size, g_free );
+        ok = sqlite3_step ( stmt ) == SQLITE_DONE;
+        sqlite3_reset ( stmt );
+      }
+    }
+    if ( stmt )
+      sqlite3_finalize ( stmt );
+    if ( ok )
+      ok = sqlite3_exec ( db, "COMMIT;", NULL, NULL, NULL ) == SQLITE_OK;
+    if ( !ok )
+      g_printerr ( "%s\n", sqlite3_errmsg(db) );
+    sqlite3_close ( db );
+  }
+  g_free ( filename );
+  return ok;
+}
+#endif
+
+int main ( int argc, char *argv[] )
+{
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new ( NULL );
+  g_option_context_add_main_entries ( context, entries, NULL );
+  if ( !g_option_context_parse (context, &argc, &argv, &error) ) {
+    g_printerr ( "%s\n", error->message );
+    return 1;
+  }
+  g_option_context_free ( context );
+
+  // Some stuff must be initialized as it gets auto used
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_download_init();
+
+  if ( g_mkdir_with_parents(dir, 0755) != 0 ) {
+    g_printerr ( "Unable to create %s\n", dir );
+    return 1;
+  }
+
+  // Always the same data
+  GRand *rand = g_rand_new_with_seed ( 42 );
+  gboolean ok = generate_gpx ( rand ) &&
+                generate_vik ( rand ) &&
+                generate_hgt () &&
+                generate_tiles () &&
+                generate_tcx ( rand );
+#ifdef HAVE_SQLITE3_H
+  ok = ok && generate_mbtiles ();
+#endif
+  g_rand_free ( rand );
+
+  vik_trwlayer_uninit ();
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+
+  if ( !ok ) {
+    g_printerr ( "Failed to generate the benchmark data\n" );
+    return 1;
+  }
+  return 0;
+}
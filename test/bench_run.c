@@ -0,0 +1,424 @@
+// Copyright: CC0
+// Time various operations over the data created by bench_generate
+// The results are written as tab separated values, for easy comparisons between runs
+// run like:
+//  ./bench_run -d bench_data > results.tsv
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <glib/gprintf.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_SQLITE3_H
+#include <sqlite3.h>
+#endif
+#include "gpx.h"
+#include "gpspoint.h"
+#include "tcx.h"
+#include "dems.h"
+#include "mapcache.h"
+#include "vikutils.h"
+#include "viklayer.h"
+#include "viklayer_defaults.h"
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+#include "download.h"
+#include "bench_data.h"
+
+static gchar *dir = "bench_data";
+static gint dem_lookups = 1000000;
+static gint cache_rounds = 100;
+static gint draws = 10;
+static gint width = 1024;
+static gint height = 768;
+
+static GOptionEntry entries[] =
+{
+  { "dir", 'd', 0, G_OPTION_ARG_FILENAME, &dir, "Directory of the files created by bench_generate", NULL },
+  { "dem-lookups", 'l', 0, G_OPTION_ARG_INT, &dem_lookups, "Number of DEM elevation lookups", NULL },
+  { "cache-rounds", 'c', 0, G_OPTION_ARG_INT, &cache_rounds, "Number of times to get every tile from the map cache", NULL },
+  { "draws", 'r', 0, G_OPTION_ARG_INT, &draws, "Number of times to draw the tracks", NULL },
+  { "width", 'w', 0, G_OPTION_ARG_INT, &width, "Width of the viewport to draw into", NULL },
+  { "height", 'h', 0, G_OPTION_ARG_INT, &height, "Height of the viewport to draw into", NULL },
+  { NULL }
+};
+
+static void report ( const gchar *name, guint64 items, gint64 begin )
+{
+  gdouble secs = (gdouble)(g_get_monotonic_time() - begin) / G_USEC_PER_SEC;
+  g_printf ( "%s\t%" G_GUINT64_FORMAT "\t%.6f\t%.1f\n", name, items, secs, secs > 0 ? items / secs : 0.0 );
+  fflush ( stdout );
+}
+
+static void skipped ( const gchar *name, const gchar *reason )
+{
+  g_printf ( "# %s skipped: %s\n", name, reason );
+}
+
+static guint64 count_trackpoints ( VikTrwLayer *vtl )
+{
+  guint64 count = 0;
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init ( &iter, vik_trw_layer_get_tracks(vtl) );
+  while ( g_hash_table_iter_next (&iter, NULL, &value) )
+    count += vik_track_get_tp_count ( VIK_TRACK(value) );
+  return count;
+}
+
+static VikTrwLayer *read_gpx ( VikViewport *vvp )
+{
+  gchar *filename = g_build_filename ( dir, BENCH_GPX_FILE, NULL );
+  VikTrwLayer *vtl = NULL;
+  FILE *ff = g_fopen ( filename, "r" );
+  if ( ff ) {
+    vtl = VIK_TRW_LAYER ( vik_layer_create(VIK_LAYER_TRW, vvp, FALSE) );
+    gint64 begin = g_get_monotonic_time ();
+    gboolean ok = a_gpx_read_file ( vtl, ff, dir, FALSE );
+    if ( !vvp ) {
+      if ( ok )
+        report ( "gpx_read", count_trackpoints(vtl), begin );
+      else
+        skipped ( "gpx_read", "unable to read the file" );
+    }
+    fclose ( ff );
+    vik_layer_post_read ( VIK_LAYER(vtl), vvp, TRUE );
+  }
+  else
+    skipped ( "gpx_read", "no file" );
+  g_free ( filename );
+  return vtl;
+}
+
+static void time_gpspoint_read ( void )
+{
+  gchar *filename = g_build_filename ( dir, BENCH_VIK_FILE, NULL );
+  FILE *ff = g_fopen ( filename, "r" );
+  if ( ff ) {
+    // Skip the file header, as only the layer data is wanted
+    gchar line[256];
+    while ( fgets(line, sizeof(line), ff) && strncmp(line, "~LayerData", 10) != 0 );
+    VikTrwLayer *vtl = VIK_TRW_LAYER ( vik_layer_create(VIK_LAYER_TRW, NULL, FALSE) );
+    gint64 begin = g_get_monotonic_time ();
+    if ( a_gpspoint_read_file(vtl, ff, dir) )
+      report ( "gpspoint_read", count_trackpoints(vtl), begin );
+    else
+      skipped ( "gpspoint_read", "unable to read the file" );
+    fclose ( ff );
+    g_object_unref ( vtl );
+  }
+  else
+    skipped ( "gpspoint_read", "no file" );
+  g_free ( filename );
+}
+
+static GSList *list_tcx_files ( void )
+{
+  gchar *tcxdir = g_build_filename ( dir, BENCH_TCX_DIR, NULL );
+  GSList *files = NULL;
+  GDir *gdir = g_dir_open ( tcxdir, 0, NULL );
+  if ( gdir ) {
+    const gchar *name;
+    while ( (name = g_dir_read_name(gdir)) )
+      files = g_slist_prepend ( files, g_build_filename(tcxdir, name, NULL) );
+    g_dir_close ( gdir );
+  }
+  g_free ( tcxdir );
+  return g_slist_sort ( files, (GCompareFunc)g_strcmp0 );
+}
+
+/**
+ * Reading the files one after another vs. all at once
+ */
+static void time_tcx_read ( void )
+{
+  GSList *files = list_tcx_files ();
+  guint num = g_slist_length ( files );
+  if ( !num ) {
+    skipped ( "tcx_read", "no files" );
+    return;
+  }
+
+  VikAggregateLayer *val = vik_aggregate_layer_new ( NULL );
+  gint64 begin = g_get_monotonic_time ();
+  guint loaded = 0;
+  for ( GSList *iter = files; iter; iter = iter->next ) {
+    FILE *ff = g_fopen ( iter->data, "r" );
+    if ( ff ) {
+      if ( a_tcx_read_file(val, NULL, ff, iter->data) )
+        loaded++;
+      fclose ( ff );
+    }
+  }
+  if ( loaded == num )
+    report ( "tcx_read", num, begin );
+  else
+    skipped ( "tcx_read", "unable to read the files" );
+  g_object_unref ( val );
+
+  val = vik_aggregate_layer_new ( NULL );
+  begin = g_get_monotonic_time ();
+  if ( a_tcx_read_files(val, NULL, files) == num )
+    report ( "tcx_read_files", num, begin );
+  else
+    skipped ( "tcx_read_files", "unable to read the files" );
+  g_object_unref ( val );
+
+  g_slist_free_full ( files, g_free );
+}
+
+static void time_track_stats ( VikTrwLayer *vtl )
+{
+  guint64 count = 0;
+  gdouble total = 0.0;
+  gint64 begin = g_get_monotonic_time ();
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init ( &iter, vik_trw_layer_get_tracks(vtl) );
+  while ( g_hash_table_iter_next (&iter, NULL, &value) ) {
+    VikTrack *trk = VIK_TRACK ( value );
+    gdouble min_alt, max_alt, up, down;
+    total += vik_track_get_length ( trk );
+    total += vik_track_get_length_including_gaps ( trk );
+    total += vik_track_get_duration ( trk, TRUE );
+    total += vik_track_get_max_speed ( trk );
+    total += vik_track_get_average_speed ( trk );
+    if ( vik_track_get_minmax_alt(trk, &min_alt, &max_alt) )
+      total += max_alt - min_alt;
+    vik_track_get_total_elevation_gain ( trk, &up, &down );
+    total += up - down;
+    count += vik_track_get_tp_count ( trk );
+  }
+  report ( "track_stats", count, begin );
+  g_debug ( "%s: total %f", __FUNCTION__, total );
+}
+
+static void time_dem_lookup ( void )
+{
+  gchar *filename = g_build_filename ( dir, BENCH_HGT_FILE, NULL );
+  gint64 begin = g_get_monotonic_time ();
+  if ( a_dems_load(filename) ) {
+    report ( "dem_load", 1, begin );
+    const struct {
+      const gchar *name;
+      VikDemInterpol method;
+    } methods[] = {
+      { "dem_lookup_none", VIK_DEM_INTERPOL_NONE },
+      { "dem_lookup_simple", VIK_DEM_INTERPOL_SIMPLE },
+      { "dem_lookup_best", VIK_DEM_INTERPOL_BEST },
+    };
+    for ( guint mm = 0; mm < G_N_ELEMENTS(methods); mm++ ) {
+      // Same positions for each method
+      GRand *rand = g_rand_new_with_seed ( 42 );
+      gint64 total = 0;
+      begin = g_get_monotonic_time ();
+      for ( gint ii = 0; ii < dem_lookups; ii++ ) {
+        struct LatLon ll = { g_rand_double_range(rand, BENCH_SOUTH, BENCH_NORTH),
+                             g_rand_double_range(rand, BENCH_WEST, BENCH_EAST) };
+        VikCoord coord;
+        vik_coord_load_from_latlon ( &coord, VIK_COORD_LATLON, &ll );
+        total += a_dems_get_elev_by_coord ( &coord, methods[mm].method );
+      }
+      report ( methods[mm].name, dem_lookups, begin );
+      g_debug ( "%s: total %" G_GINT64_FORMAT, __FUNCTION__, total );
+      g_rand_free ( rand );
+    }
+    a_dems_unref ( filename );
+  }
+  else
+    skipped ( "dem_lookup", "unable to load the file" );
+  g_free ( filename );
+}
+
+typedef struct {
+  gint x, y;
+  GdkPixbuf *pixbuf;
+} Tile;
+
+static GArray *load_tiles ( void )
+{
+  GArray *tiles = g_array_new ( FALSE, FALSE, sizeof(Tile) );
+  gint x0, y0;
+  bench_tile_origin ( &x0, &y0 );
+  gint64 begin = g_get_monotonic_time ();
+  for ( gint xx = x0; xx < x0 + BENCH_TILES_ACROSS; xx++ ) {
+    for ( gint yy = y0; yy < y0 + BENCH_TILES_ACROSS; yy++ ) {
+      gchar *filename = g_strdup_printf ( "%s%s%s%s%d%s%d%s%d.png", dir, G_DIR_SEPARATOR_S, BENCH_TILES_DIR,
+                                          G_DIR_SEPARATOR_S, BENCH_TILE_ZOOM, G_DIR_SEPARATOR_S, xx, G_DIR_SEPARATOR_S, yy );
+      Tile tile = { xx, yy, gdk_pixbuf_new_from_file(filename, NULL) };
+      if ( tile.pixbuf )
+        g_array_append_val ( tiles, tile );
+      g_free ( filename );
+    }
+  }
+  if ( tiles->len )
+    report ( "tile_decode", tiles->len, begin );
+  else
+    skipped ( "tile_decode", "no tiles" );
+  return tiles;
+}
+
+// A type not otherwise in use
+#define BENCH_MAP_TYPE 9999
+
+static void time_mapcache ( GArray *tiles )
+{
+  if ( !tiles->len ) {
+    skipped ( "mapcache", "no tiles" );
+    return;
+  }
+  a_mapcache_init ();
+
+  gint64 begin = g_get_monotonic_time ();
+  for ( guint ii = 0; ii < tiles->len; ii++ ) {
+    Tile *tile = &g_array_index ( tiles, Tile, ii );
+    a_mapcache_add ( tile->pixbuf, (mapcache_extra_t){0.0, 0}, tile->x, tile->y, BENCH_TILE_ZOOM,
+                     BENCH_MAP_TYPE, 0, 255, 1.0, 1.0, NULL );
+  }
+  report ( "mapcache_add", tiles->len, begin );
+
+  // Includes misses when the cache size is smaller than all the tiles
+  guint64 hits = 0;
+  begin = g_get_monotonic_time ();
+  for ( gint rr = 0; rr < cache_rounds; rr++ ) {
+    for ( guint ii = 0; ii < tiles->len; ii++ ) {
+      Tile *tile = &g_array_index ( tiles, Tile, ii );
+      GdkPixbuf *pixbuf = a_mapcache_get ( tile->x, tile->y, BENCH_TILE_ZOOM, BENCH_MAP_TYPE, 0, 255, 1.0, 1.0, NULL );
+      if ( pixbuf ) {
+        hits++;
+        g_object_unref ( pixbuf );
+      }
+    }
+  }
+  report ( "mapcache_get", (guint64)cache_rounds * tiles->len, begin );
+  g_debug ( "%s: %" G_GUINT64_FORMAT " hits", __FUNCTION__, hits );
+
+  a_mapcache_uninit ();
+}
+
+#ifdef HAVE_SQLITE3_H
+static void time_mbtiles_read ( GArray *tiles )
+{
+  gchar *filename = g_build_filename ( dir, BENCH_MBTILES_FILE, NULL );
+  sqlite3 *db = NULL;
+  sqlite3_stmt *stmt = NULL;
+  if ( g_file_test(filename, G_FILE_TEST_EXISTS) &&
+       sqlite3_open_v2(filename, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK &&
+       sqlite3_prepare_v2(db, "SELECT tile_data FROM tiles WHERE zoom_level=? AND tile_column=? AND tile_row=?;", -1, &stmt, NULL) == SQLITE_OK ) {
+    guint64 bytes = 0;
+    gint64 begin = g_get_monotonic_time ();
+    for ( guint ii = 0; ii < tiles->len; ii++ ) {
+      Tile *tile = &g_array_index ( tiles, Tile, ii );
+      sqlite3_bind_int ( stmt, 1, BENCH_TILE_ZOOM );
+      sqlite3_bind_int ( stmt, 2, tile->x );
+      sqlite3_bind_int ( stmt, 3, (1 << BENCH_TILE_ZOOM) - 1 - tile->y );
+      if ( sqlite3_step(stmt) == SQLITE_ROW )
+        bytes += sqlite3_column_bytes ( stmt, 0 );
+      sqlite3_reset ( stmt );
+    }
+    report ( "mbtiles_read", tiles->len, begin );
+    g_debug ( "%s: %" G_GUINT64_FORMAT " bytes", __FUNCTION__, bytes );
+  }
+  else
+    skipped ( "mbtiles_read", "unable to open the file" );
+  if ( stmt )
+    sqlite3_finalize ( stmt );
+  if ( db )
+    sqlite3_close ( db );
+  g_free ( filename );
+}
+#endif
+
+/**
+ * Draw all the tracks into a viewport that is never shown on screen
+ */
+static void time_trw_draw ( void )
+{
+  GtkWidget *window = gtk_offscreen_window_new ();
+  VikViewport *vvp = vik_viewport_new ();
+  gtk_container_add ( GTK_CONTAINER(window), GTK_WIDGET(vvp) );
+  gtk_widget_set_size_request ( GTK_WIDGET(vvp), width, height );
+  gtk_widget_show_all ( window );
+  vik_viewport_configure_manually ( vvp, width, height );
+  // Not part of a window, so no highlights to consider
+  vik_viewport_set_draw_highlight ( vvp, FALSE );
+
+  VikTrwLayer *vtl = read_gpx ( vvp );
+  if ( vtl ) {
+    struct LatLon maxmin[2] = { { BENCH_NORTH, BENCH_EAST }, { BENCH_SOUTH, BENCH_WEST } };
+    vu_zoom_to_show_latlons ( vik_viewport_get_coord_mode(vvp), vvp, maxmin );
+    guint64 count = count_trackpoints ( vtl );
+    gint64 begin = g_get_monotonic_time ();
+    for ( gint ii = 0; ii < draws; ii++ ) {
+      vik_viewport_clear ( vvp );
+      vik_layer_draw ( VIK_LAYER(vtl), vvp );
+    }
+    // Ensure any deferred drawing is included
+    GdkPixbuf *pixbuf = vik_viewport_get_pixbuf ( vvp, width, height );
+    report ( "trw_draw", count * draws, begin );
+    if ( pixbuf )
+      g_object_unref ( pixbuf );
+    g_object_unref ( vtl );
+  }
+  gtk_widget_destroy ( window );
+}
+
+int main ( int argc, char *argv[] )
+{
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new ( NULL );
+  g_option_context_add_main_entries ( context, entries, NULL );
+  if ( !g_option_context_parse (context, &argc, &argv, &error) ) {
+    g_printerr ( "%s\n", error->message );
+    return 1;
+  }
+  g_option_context_free ( context );
+
+  // Drawing needs a display, everything else can be measured without one
+  gboolean have_display = gtk_init_check ( NULL, NULL );
+
+  // Some stuff must be initialized as it gets auto used
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_download_init();
+
+  g_printf ( "benchmark\titems\tseconds\titems_per_second\n" );
+
+  VikTrwLayer *vtl = read_gpx ( NULL );
+  time_gpspoint_read ();
+  if ( vtl ) {
+    time_track_stats ( vtl );
+    g_object_unref ( vtl );
+  }
+  time_dem_lookup ();
+  time_tcx_read ();
+
+  GArray *tiles = load_tiles ();
+  time_mapcache ( tiles );
+#ifdef HAVE_SQLITE3_H
+  time_mbtiles_read ( tiles );
+#else
+  skipped ( "mbtiles_read", "no SQLite support" );
+#endif
+  for ( guint ii = 0; ii < tiles->len; ii++ )
+    g_object_unref ( g_array_index(tiles, Tile, ii).pixbuf );
+  g_array_free ( tiles, TRUE );
+
+  if ( have_display )
+    time_trw_draw ();
+  else
+    skipped ( "trw_draw", "no display" );
+
+  a_dems_uninit ();
+  vik_trwlayer_uninit ();
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+
+  return 0;
+}
@@ -2,4 +2,10 @@
 # Run the test_babel program
 #  Don't actually care what the output is (i.e. don't care if gpsbabel is available or not)
 #  Just confirm that the program runs at all
-./test_babel 1 0 1 0 1 0
+./test_babel 1 0 1 0 1 0 || exit $?
+
+# The GPX output of a command should be read into a layer (gpsbabel is not needed for this)
+if [ -z "$srcdir" ]; then
+  srcdir=.
+fi
+./test_babel 1 0 1 0 1 0 $srcdir/Stonehenge.gpx
@@ -1,8 +1,15 @@
 #!/bin/sh
 # Copyright: CC0
 
-if [ -n "$srcdir" ]; then
-  ./test_file_load $srcdir/Stonehenge.fit
-else
-  ./test_file_load ./Stonehenge.fit
+if [ -z "$srcdir" ]; then
+  srcdir=.
+fi
+
+./test_file_load $srcdir/Stonehenge.fit || exit $?
+
+# Decode several files at once, as when loading a folder of activities
+./test_file_load $srcdir/Stonehenge.fit $srcdir/Stonehenge.fit $srcdir/Stonehenge.fit $srcdir/Stonehenge.fit
+if [ $? != 0 ]; then
+  echo "test_file_load failure on multiple FIT files"
+  exit 1
 fi
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Copyright: CC0
+
+if [ -z "$srcdir" ]; then
+  srcdir=.
+fi
+
+./test_file_load $srcdir/Stonehenge.geojson
+if [ $? != 0 ]; then
+  exit 1
+fi
+
+# Writing what has been read and then reading that back in should give the same items
+outfile=./testout-$$.geojson
+./geojson2geojson $srcdir/Stonehenge.geojson $outfile
+if [ $? != 0 ]; then
+  echo "geojson2geojson failure"
+  exit 1
+fi
+rm $outfile
@@ -48,3 +48,29 @@ if [ $result != 1 ]; then
   echo "gpx2gpx failure $count as result=$result"
   exit 1
 fi
+
+# Writing tracks concurrently must give exactly the same output
+for gpx in RobRoute.gpx GPXv1.1-sample.gpx MultiTrack.gpx; do
+  count=`expr $count + 1`
+  ./gpx2gpx < "$srcdir/$gpx" > ./gpx2gpx-sequential.gpx
+  ./gpx2gpx -p < "$srcdir/$gpx" > ./gpx2gpx-parallel.gpx
+  cmp -s ./gpx2gpx-sequential.gpx ./gpx2gpx-parallel.gpx
+  if [ $? != 0 ]; then
+    echo "gpx2gpx failure $count on $gpx"
+    exit 1
+  fi
+done
+# Check the concurrent writing had several tracks and segments to do
+count=`expr $count + 1`
+result=$(grep -c "<trk>" ./gpx2gpx-parallel.gpx)
+if [ $result != 3 ]; then
+  echo "gpx2gpx failure $count as tracks=$result"
+  exit 1
+fi
+count=`expr $count + 1`
+result=$(grep -c "<trkseg>" ./gpx2gpx-parallel.gpx)
+if [ $result != 6 ]; then
+  echo "gpx2gpx failure $count as segments=$result"
+  exit 1
+fi
+rm ./gpx2gpx-sequential.gpx ./gpx2gpx-parallel.gpx
@@ -0,0 +1,5 @@
+#!/bin/sh
+# Copyright: CC0
+# A small run to check multi-threaded generation matches a single thread
+#  (use heatmap_bench directly with larger values for timings)
+./heatmap_bench -n 200000 -t 4
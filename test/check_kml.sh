@@ -1,8 +1,41 @@
 #!/bin/sh
 # Copyright: CC0
 
-if [ -n "$srcdir" ]; then
-  ./test_file_load $srcdir/Stonehenge.kml
-else
-  ./test_file_load ./Stonehenge.kml
+if [ -z "$srcdir" ]; then
+  srcdir=.
 fi
+
+./test_file_load $srcdir/Stonehenge.kml
+if [ $? != 0 ]; then
+  exit 1
+fi
+
+# Writing what has been read and then reading that back in should give the same result
+outfile1=./testout-$$-1.kml
+outfile2=./testout-$$-2.kml
+for infile in Stonehenge.kml StonehengeTrack.kml
+do
+  ./kml2kml < $srcdir/$infile > $outfile1
+  if [ $? != 0 ]; then
+    echo "kml2kml command failure for $infile"
+    exit 1
+  fi
+  # Timestamped tracks are written as gx:Track with the times
+  if [ $infile = StonehengeTrack.kml ]; then
+    if ! grep -q "<gx:Track>" $outfile1; then
+      echo "kml2kml no track written"
+      exit 1
+    fi
+    if ! grep -q "<when>2011-09-23T15:49:03Z</when>" $outfile1; then
+      echo "kml2kml track times not written"
+      exit 1
+    fi
+  fi
+  ./kml2kml < $outfile1 > $outfile2
+  diff $outfile1 $outfile2
+  if [ $? != 0 ]; then
+    echo "kml2kml produced different result for $infile"
+    exit 1
+  fi
+done
+rm $outfile1 $outfile2
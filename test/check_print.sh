@@ -0,0 +1,24 @@
+#!/bin/sh
+# Copyright: CC0
+
+if [ -z "$srcdir" ]; then
+  srcdir=.
+fi
+
+outfile=./testout-$$.pdf
+./print2pdf $srcdir/Stonehenge.gpx $outfile
+result=$?
+if [ $result = 77 ]; then
+  # Not available in this build
+  rm -f $outfile
+  exit 77
+fi
+if [ $result != 0 ]; then
+  echo "print2pdf command failure"
+  exit 1
+fi
+if ! head -c 5 $outfile | grep -q "%PDF-"; then
+  echo "print2pdf did not produce a PDF"
+  exit 1
+fi
+rm $outfile
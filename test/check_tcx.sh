@@ -1,8 +1,15 @@
 #!/bin/sh
 # Copyright: CC0
 
-if [ -n "$srcdir" ]; then
-  ./test_file_load $srcdir/Stonehenge.tcx
-else
-  ./test_file_load ./Stonehenge.tcx
+if [ -z "$srcdir" ]; then
+  srcdir=.
+fi
+
+./test_file_load $srcdir/Stonehenge.tcx || exit $?
+
+# Read several files at once, as when importing a training history
+./test_file_load $srcdir/Stonehenge.tcx $srcdir/Stonehenge.tcx $srcdir/Stonehenge.tcx $srcdir/Stonehenge.tcx
+if [ $? != 0 ]; then
+  echo "test_file_load failure on multiple TCX files"
+  exit 1
 fi
@@ -0,0 +1,80 @@
+// Copyright: CC0
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib/gprintf.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "viklayer.h"
+#include "viklayer_defaults.h"
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+#include "geojson.h"
+#include "download.h"
+
+// Run as:
+// ./geojson2geojson infile.geojson outfile.geojson
+//
+// Reads the input, writes it out and then reads that back in,
+//  checking the same number of waypoints, tracks and routes are in both
+//
+
+static void print_counts ( const gchar *name, VikTrwLayer *trw )
+{
+  g_printf ( "%s: %d waypoints, %d tracks, %d routes\n", name,
+             g_hash_table_size(vik_trw_layer_get_waypoints(trw)),
+             g_hash_table_size(vik_trw_layer_get_tracks(trw)),
+             g_hash_table_size(vik_trw_layer_get_routes(trw)) );
+}
+
+int main( int argc, char *argv[] )
+{
+  if ( argc != 3 ) {
+    g_printerr ( "No input and output files specified\n" );
+    return 1;
+  }
+
+  // Some stuff must be initialized as it gets auto used
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_download_init();
+
+  VikLayer *vl = vik_layer_create (VIK_LAYER_TRW, NULL, FALSE);
+  VikTrwLayer *trw = VIK_TRW_LAYER (vl);
+  VikLayer *vl2 = vik_layer_create (VIK_LAYER_TRW, NULL, FALSE);
+  VikTrwLayer *trw2 = VIK_TRW_LAYER (vl2);
+
+  gboolean success = a_geojson_read_file ( trw, argv[1] );
+  if ( success ) {
+    FILE *ff = g_fopen ( argv[2], "w" );
+    success = ff && a_geojson_write_file ( trw, ff );
+    if ( ff )
+      fclose ( ff );
+  }
+  if ( success )
+    success = a_geojson_read_file ( trw2, argv[2] );
+
+  if ( success ) {
+    print_counts ( argv[1], trw );
+    print_counts ( argv[2], trw2 );
+    if ( g_hash_table_size(vik_trw_layer_get_waypoints(trw)) != g_hash_table_size(vik_trw_layer_get_waypoints(trw2)) ||
+         g_hash_table_size(vik_trw_layer_get_tracks(trw)) != g_hash_table_size(vik_trw_layer_get_tracks(trw2)) ||
+         g_hash_table_size(vik_trw_layer_get_routes(trw)) != g_hash_table_size(vik_trw_layer_get_routes(trw2)) ) {
+      g_printerr ( "Different items after writing and reading back in\n" );
+      success = FALSE;
+    }
+  }
+
+  g_object_unref ( vl );
+  g_object_unref ( vl2 );
+
+  vik_trwlayer_uninit ();
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+
+  // Convert to exit status
+  return success ? 0 : 1;
+}
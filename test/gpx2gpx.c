@@ -19,6 +19,10 @@ int main(int argc, char *argv[])
   VikLayer *vl = vik_layer_create (VIK_LAYER_TRW, NULL, FALSE);
   VikTrwLayer *trw = VIK_TRW_LAYER (vl);
 
+  // Option to force concurrent writing of tracks, even for small files
+  if ( argc > 1 && g_strcmp0(argv[1], "-p") == 0 )
+    a_gpx_set_write_parallel_threshold ( 0 );
+
   a_gpx_read_file(trw, stdin, NULL, FALSE);
   a_gpx_write_file(trw, stdout, NULL, NULL);
 
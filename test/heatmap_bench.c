@@ -0,0 +1,132 @@
+// Copyright: CC0
+// Time heatmap generation over a synthetic set of tracks,
+//  comparing a single thread against several threads
+//  (and checking both give the same result)
+// run like:
+//  ./heatmap_bench -n 5000000 -t 8
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include "globals.h"
+#include "viktrack.h"
+#include "heatmap_pyramid.h"
+
+#define WIDTH 1024
+#define HEIGHT 768
+
+static gint points = 2000000;
+static gint points_per_track = 2000;
+static gint threads = 0;
+
+static GOptionEntry entries[] =
+{
+  { "points", 'n', 0, G_OPTION_ARG_INT, &points, "Total number of trackpoints", NULL },
+  { "track-points", 'p', 0, G_OPTION_ARG_INT, &points_per_track, "Trackpoints per track", NULL },
+  { "threads", 't', 0, G_OPTION_ARG_INT, &threads, "Threads to use (0 for one per processor)", NULL },
+  { NULL }
+};
+
+// Random walks around the area, so there are some hotspots where they overlap
+static GList *make_tracks ( const HeatmapArea *area )
+{
+  GRand *rand = g_rand_new_with_seed ( 42 );
+  GList *tracks = NULL;
+  gint remaining = points;
+  while ( remaining > 0 ) {
+    VikTrack *trk = vik_track_new ();
+    gdouble lat = g_rand_double_range ( rand, area->bbox.south, area->bbox.north );
+    gdouble lon = g_rand_double_range ( rand, area->bbox.west, area->bbox.east );
+    gdouble timestamp = 1600000000.0;
+    for ( gint ii = 0; ii < points_per_track && remaining > 0; ii++, remaining-- ) {
+      VikTrackpoint *tp = vik_trackpoint_new ();
+      struct LatLon ll = { lat, lon };
+      vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+      tp->timestamp = timestamp;
+      trk->trackpoints = g_list_prepend ( trk->trackpoints, tp );
+      lat += g_rand_double_range ( rand, -0.0002, 0.0002 );
+      lon += g_rand_double_range ( rand, -0.0003, 0.0003 );
+      timestamp += 1.0;
+    }
+    trk->trackpoints = g_list_reverse ( trk->trackpoints );
+    vik_track_calculate_bounds ( trk );
+    tracks = g_list_prepend ( tracks, trk );
+  }
+  g_rand_free ( rand );
+  return tracks;
+}
+
+static HeatmapPyramid *timed_generate ( GList *tracks, const HeatmapArea *area, const heatmap_stamp_t *stamp, guint nn )
+{
+  gint64 begin = g_get_monotonic_time ();
+  HeatmapPyramid *hp = a_heatmap_pyramid_generate ( tracks, area, stamp, nn, NULL, NULL );
+  gdouble secs = (gdouble)(g_get_monotonic_time() - begin) / G_USEC_PER_SEC;
+  g_printf ( "threads %u: %.3f seconds, %u levels\n", nn, secs, hp->num_levels );
+  return hp;
+}
+
+static gboolean same_values ( const heatmap_t *h1, const heatmap_t *h2 )
+{
+  if ( h1->w != h2->w || h1->h != h2->h )
+    return FALSE;
+  // Allow for the different order of the floating point additions
+  for ( guint ii = 0; ii < h1->w * h1->h; ii++ )
+    if ( fabsf(h1->buf[ii] - h2->buf[ii]) > 1e-4 * MAX(1.0, h1->max) )
+      return FALSE;
+  return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new ( NULL );
+  g_option_context_add_main_entries ( context, entries, NULL );
+  if ( !g_option_context_parse (context, &argc, &argv, &error) ) {
+    g_printerr ( "%s\n", error->message );
+    return 1;
+  }
+  g_option_context_free ( context );
+
+  if ( threads == 0 )
+    threads = g_get_num_processors ();
+
+  HeatmapArea area;
+  area.center.lat = 51.18;
+  area.center.lon = -1.83;
+  area.width = WIDTH;
+  area.height = HEIGHT;
+  area.mf = WIDTH / 0.2;
+  area.bbox.west = area.center.lon - 0.1;
+  area.bbox.east = area.center.lon + 0.1;
+  area.bbox.north = DEMERCLAT ( MERCLAT(area.center.lat) + (HEIGHT/2) / area.mf );
+  area.bbox.south = DEMERCLAT ( MERCLAT(area.center.lat) - (HEIGHT/2) / area.mf );
+
+  GList *tracks = make_tracks ( &area );
+  g_printf ( "%d points in %u tracks\n", points, g_list_length(tracks) );
+
+  float pts[5*5];
+  for ( guint ii = 0; ii < G_N_ELEMENTS(pts); ii++ )
+    pts[ii] = 1.0;
+  heatmap_stamp_t *stamp = heatmap_stamp_load ( 5, 5, pts );
+
+  HeatmapPyramid *hp1 = timed_generate ( tracks, &area, stamp, 1 );
+  HeatmapPyramid *hpn = timed_generate ( tracks, &area, stamp, threads );
+
+  int ans = 0;
+  for ( guint ll = 0; ll < hp1->num_levels; ll++ ) {
+    if ( ll >= hpn->num_levels || !same_values(hp1->levels[ll].hm, hpn->levels[ll].hm) ) {
+      g_printerr ( "Level %u differs\n", ll );
+      ans = 1;
+    }
+  }
+  if ( hp1->num_levels < 2 || hp1->levels[0].hm->max <= 0.0 ) {
+    g_printerr ( "Nothing generated\n" );
+    ans = 1;
+  }
+
+  a_heatmap_pyramid_free ( hp1 );
+  a_heatmap_pyramid_free ( hpn );
+  heatmap_stamp_free ( stamp );
+  g_list_free_full ( tracks, (GDestroyNotify)vik_track_free );
+
+  return ans;
+}
@@ -0,0 +1,43 @@
+// Copyright: CC0
+//
+//run like:
+// ./kml2kml < input.kml > output.kml
+//
+#include <stdio.h>
+#include "kml.h"
+#include "viklayer.h"
+#include "viklayer_defaults.h"
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+#include "download.h"
+
+int main(int argc, char *argv[])
+{
+  // Some stuff must be initialized as it gets auto used
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_download_init();
+
+  VikLayer *vl = vik_layer_create (VIK_LAYER_TRW, NULL, FALSE);
+  VikTrwLayer *trw = VIK_TRW_LAYER (vl);
+
+  // Fixed options so the output does not depend on the preferences
+  KmlWritingOptions options = { VIK_KML_EXPORT_UNITS_METRIC, TRUE, FALSE, TRUE };
+
+  int ans = 0;
+  if ( !a_kml_read_file(trw, stdin) || !a_kml_write_file(trw, stdout, &options) )
+    ans = 1;
+
+  g_object_unref ( vl );
+
+  vik_trwlayer_uninit ();
+
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+
+  return ans;
+}
@@ -0,0 +1,124 @@
+// Copyright: CC0
+//
+// Draw a file's layers as they would be printed, into a PDF file
+//run like:
+// ./print2pdf input.gpx output.pdf
+//
+#include <gtk/gtk.h>
+#include <cairo-pdf.h>
+#include "viklayer.h"
+#include "viklayer_defaults.h"
+#include "settings.h"
+#include "preferences.h"
+#include "download.h"
+#include "globals.h"
+#include "file.h"
+#include "modules.h"
+#include "print.h"
+#include "viktrwlayer.h"
+
+#define WIDTH 600
+#define HEIGHT 800
+// Space at the bottom of the page for the scale and copyrights
+#define FOOTER_HEIGHT 64
+
+// Number of pixels in the rows that are not the background colour
+// NB The top byte of CAIRO_FORMAT_RGB24 pixels is unused
+static guint count_drawn ( cairo_surface_t *surface, guint32 background, gint y1, gint y2 )
+{
+  guint count = 0;
+  guchar *data = cairo_image_surface_get_data ( surface );
+  gint stride = cairo_image_surface_get_stride ( surface );
+  for ( gint yy = y1; yy < y2 && yy < HEIGHT; yy++ ) {
+    guint32 *row = (guint32*)(data + yy*stride);
+    for ( gint xx = 0; xx < WIDTH; xx++ )
+      if ( (row[xx] & 0xFFFFFF) != background )
+        count++;
+  }
+  return count;
+}
+
+int main(int argc, char *argv[])
+{
+  if ( argc != 3 )
+    return argc;
+
+  gtk_init ( NULL, NULL );
+
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_download_init();
+  modules_init();
+
+  int result = 0;
+
+  // Never shown on screen
+  GtkWidget *window = gtk_offscreen_window_new ();
+  VikViewport *vvp = vik_viewport_new ();
+  gtk_container_add ( GTK_CONTAINER(window), GTK_WIDGET(vvp) );
+  gtk_widget_show_all ( window );
+  vik_viewport_configure_manually ( vvp, 320, 240 );
+
+  VikAggregateLayer *agg = vik_aggregate_layer_new ();
+  VikLoadType_t lt = a_file_load ( agg, vvp, NULL, argv[1], TRUE, FALSE, NULL );
+  if ( lt < LOAD_TYPE_VIK_FAILURE_NON_FATAL ) {
+    g_printerr ( "Failed to load %s\n", argv[1] );
+    return 1;
+  }
+  GList *layers = vik_aggregate_layer_get_all_layers_of_type ( agg, NULL, VIK_LAYER_TRW, FALSE );
+  if ( layers )
+    (void)vik_trw_layer_auto_set_view ( VIK_TRW_LAYER(layers->data), vvp );
+  g_list_free ( layers );
+  gdouble xmpp = vik_viewport_get_xmpp ( vvp );
+
+  cairo_surface_t *surface = cairo_pdf_surface_create ( argv[2], WIDTH, HEIGHT );
+  cairo_t *cr = cairo_create ( surface );
+  if ( a_print_render(agg, vvp, cr, WIDTH, HEIGHT, 2) ) {
+    // The viewport should be as it was
+    if ( vik_viewport_get_width(vvp) != 320 || vik_viewport_get_height(vvp) != 240 ||
+         vik_viewport_get_xmpp(vvp) != xmpp ) {
+      g_printerr ( "Viewport changed by rendering\n" );
+      result++;
+    }
+  }
+  else {
+    // e.g. GTK2
+    g_printerr ( "Rendering not available\n" );
+    result = 77;
+  }
+  cairo_destroy ( cr );
+  cairo_surface_finish ( surface );
+  if ( cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS ) {
+    g_printerr ( "PDF error: %s\n", cairo_status_to_string(cairo_surface_status(surface)) );
+    result++;
+  }
+  cairo_surface_destroy ( surface );
+
+  // Check the layers have drawn something other than the background
+  if ( result == 0 ) {
+    surface = cairo_image_surface_create ( CAIRO_FORMAT_RGB24, WIDTH, HEIGHT );
+    cr = cairo_create ( surface );
+    (void)a_print_render ( agg, vvp, cr, WIDTH, HEIGHT, 2 );
+    cairo_destroy ( cr );
+    cairo_surface_flush ( surface );
+    // The top right corner is not covered by any layers, the scale, copyrights or logos
+    guint32 background = ((guint32*)cairo_image_surface_get_data(surface))[WIDTH-1] & 0xFFFFFF;
+    if ( count_drawn(surface, background, 0, HEIGHT-FOOTER_HEIGHT) == 0 ) {
+      g_printerr ( "Only the background has been drawn\n" );
+      result++;
+    }
+    cairo_surface_destroy ( surface );
+  }
+
+  g_object_unref ( agg );
+  gtk_widget_destroy ( window );
+
+  vik_trwlayer_uninit ();
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+
+  return result;
+}
@@ -1,9 +1,15 @@
 // Decide the Babel file types capability you wish to list
 // e.g. for read support of waypoints, tracks and routes:
 // run like: ./test_babel 1 0 1 0 1 0
+// Optionally a GPX file can be given as well,
+//  which is read via a shell command to check the data is streamed into a layer
 #include <stdlib.h>
 #include "babel.h"
 #include "preferences.h"
+#include "settings.h"
+#include "globals.h"
+#include "viklayer.h"
+#include "viklayer_defaults.h"
 
 static void print_file_format (gpointer data, gpointer user_data)
 {
@@ -15,22 +21,56 @@ static void print_file_format (gpointer data, gpointer user_data)
 		file->mode.routesRead, file->mode.routesWrite);
 }
 
+static void ready_cb (gpointer user_data)
+{
+	*(gboolean*)user_data = TRUE;
+}
+
+static int read_via_shell (const char *filename)
+{
+	VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create(VIK_LAYER_TRW, NULL, FALSE));
+	gchar *cmd = g_strdup_printf("cat '%s'", filename);
+	gboolean ok = a_babel_convert_from_shellcommand(vtl, cmd, NULL, NULL, NULL, NULL);
+	g_free(cmd);
+	guint tracks = g_hash_table_size(vik_trw_layer_get_tracks(vtl));
+	printf("%s : %d tracks\n", filename, tracks);
+	g_object_unref(vtl);
+	return (ok && tracks > 0) ? 0 : 1;
+}
+
 int main(int argc, char*argv[])
 {
-	// Preferences must be initialized as it gets auto used
+	// Some stuff must be initialized as it gets auto used
+	a_settings_init ();
 	a_preferences_init ();
+	a_vik_preferences_init ();
+	a_layer_defaults_init ();
 
 	a_babel_init();
 	a_babel_post_init ();
+	// gpsbabel's features are found in the background
+	gboolean ready = FALSE;
+	a_babel_add_ready_callback (ready_cb, &ready);
+	a_babel_wait_ready ();
+	if (!ready || !a_babel_ready()) {
+		fprintf(stderr, "Babel features not ready\n");
+		return 1;
+	}
 
-	if (argc != 7) return 1;
+	if (argc != 7 && argc != 8) return 1;
 	BabelMode mode = { atoi(argv[1]),atoi(argv[2]),atoi(argv[3]),atoi(argv[4]),atoi(argv[5]),atoi(argv[6]) };
 	a_babel_foreach_file_with_mode(mode, print_file_format, NULL);
 
+	int ans = 0;
+	if (argc == 8)
+		ans = read_via_shell(argv[7]);
+
 	a_babel_uninit();
 
+	a_layer_defaults_uninit ();
 	a_preferences_uninit ();
+	a_settings_uninit ();
 
-	return 0;
+	return ans;
 }
 
@@ -13,10 +13,12 @@
 #include "globals.h"
 #include "file.h"
 #include "modules.h"
+#include "fit.h"
+#include "tcx.h"
 
 int main(int argc, char *argv[])
 {
-  if ( argc != 2 )
+  if ( argc < 2 )
     return argc;
 
   // Under GTK2, despite perhaps being undefined behaviour - it seemed to work without a $DISPLAY
@@ -39,6 +41,24 @@ int main(int argc, char *argv[])
   VikAggregateLayer* agg = vik_aggregate_layer_new ();
   VikViewport* vp = vik_viewport_new ();
 
+  // Multiple files are read together - ATM only supported for FIT and TCX files
+  if ( argc > 2 ) {
+    GSList *files = NULL;
+    for ( int ii = 1; ii < argc; ii++ )
+      files = g_slist_append ( files, argv[ii] );
+    guint loaded;
+    if ( a_file_check_ext(argv[1], ".tcx") )
+      loaded = a_tcx_read_files ( agg, vp, files );
+    else
+      loaded = a_fit_read_files ( agg, vp, files );
+    g_slist_free ( files );
+    // Each file should be in its own layer
+    guint layers = g_list_length ( (GList*)vik_aggregate_layer_get_children(agg) );
+    if ( loaded == argc-1 && layers == argc-1 )
+      return 0;
+    return 1;
+  }
+
   VikLoadType_t lt = a_file_load ( agg, vp, NULL, argv[1], TRUE, FALSE, NULL );
 
   // Was it some kind of 'success'?
@@ -0,0 +1,48 @@
+// Copyright: CC0
+// Check the MGRS 100km square identifiers and UTM conversions in a given zone
+#include <glib.h>
+#include <string.h>
+#include <math.h>
+#include "coords.h"
+
+static gboolean check_square ( gdouble lat, gdouble lon, const gchar *expected )
+{
+  struct LatLon ll = { lat, lon };
+  struct UTM utm;
+  char square[3];
+  a_coords_latlon_to_utm ( &ll, &utm );
+  a_coords_utm_to_mgrs_square ( &utm, square );
+  if ( strcmp(square, expected) ) {
+    g_printerr ( "%f,%f: got %s expected %s\n", lat, lon, square, expected );
+    return FALSE;
+  }
+  return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+  gboolean ok = TRUE;
+
+  // Washington Monument: 18S UJ 23487 06483
+  ok &= check_square ( 38.889484, -77.035278, "UJ" );
+  // Sydney Opera House: 56H LH
+  ok &= check_square ( -33.8568, 151.2153, "LH" );
+
+  // London is in zone 30, but can be given in zone 31 west of its central meridian
+  struct LatLon ll = { 51.5, -0.1 };
+  struct UTM utm;
+  a_coords_latlon_to_utm_zone ( &ll, 31, &utm );
+  if ( utm.zone != 31 || utm.easting >= 500000.0 ) {
+    g_printerr ( "Forced zone: got %d %f\n", utm.zone, utm.easting );
+    ok = FALSE;
+  }
+  // And back again
+  struct LatLon ll2;
+  a_coords_utm_to_latlon ( &utm, &ll2 );
+  if ( fabs(ll2.lat - ll.lat) > 1e-6 || fabs(ll2.lon - ll.lon) > 1e-6 ) {
+    g_printerr ( "Forced zone round trip: got %f,%f\n", ll2.lat, ll2.lon );
+    ok = FALSE;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+// Copyright: CC0
+// Build a road graph from the sample OSM data and check the routes found,
+//  both directly and after a save and load of the graph
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <unistd.h>
+#include "osmgraph.h"
+
+typedef struct {
+  gdouble lat, lon;
+} Position;
+
+// The nodes of osmgraph_sample.osm
+static const Position A = { 51.0000, -1.0000 };
+static const Position B = { 51.0000, -0.9950 };
+static const Position C = { 51.0000, -0.9900 };
+static const Position D = { 51.0030, -1.0000 };
+static const Position E = { 51.0030, -0.9950 };
+static const Position F = { 51.0030, -0.9900 };
+static const Position G = { 51.0015, -0.9925 };
+
+static guint node_at ( OsmGraph *og, OsmGraphProfile profile, Position pos )
+{
+  struct LatLon ll = { pos.lat, pos.lon };
+  guint node = G_MAXUINT;
+  if ( !osm_graph_get_nearest_node(og, profile, &ll, &node) )
+    g_printerr ( "No node near %f,%f\n", pos.lat, pos.lon );
+  return node;
+}
+
+static gboolean is_at ( OsmGraph *og, guint node, Position pos )
+{
+  struct LatLon ll;
+  osm_graph_get_node_latlon ( og, node, &ll );
+  return fabs(ll.lat - pos.lat) < 1e-7 && fabs(ll.lon - pos.lon) < 1e-7;
+}
+
+/**
+ * Check the route between the first and last positions goes via all the given positions
+ */
+static gboolean check_route ( OsmGraph *og, OsmGraphProfile profile, const Position *via, guint count, guint32 *cost )
+{
+  guint from = node_at ( og, profile, via[0] );
+  guint to = node_at ( og, profile, via[count-1] );
+  GArray *route = osm_graph_route ( og, profile, from, to, cost );
+  gboolean ok = route && route->len == count;
+  for ( guint ii = 0; ok && ii < count; ii++ )
+    ok = is_at ( og, g_array_index(route, guint, ii), via[ii] );
+  if ( !ok )
+    g_printerr ( "Unexpected route for profile %d with %u positions\n", profile, count );
+  if ( route )
+    g_array_free ( route, TRUE );
+  return ok;
+}
+
+static gboolean check_graph ( OsmGraph *og, guint32 costs[] )
+{
+  gboolean ok = TRUE;
+  guint nn = 0;
+
+  // The bench and the way beyond the extract are not included
+  if ( osm_graph_get_num_nodes(og) != 7 ) {
+    g_printerr ( "Unexpected number of nodes %u\n", osm_graph_get_num_nodes(og) );
+    ok = FALSE;
+  }
+  if ( osm_graph_get_num_edges(og, OSM_GRAPH_PROFILE_CAR) != 10 ||
+       osm_graph_get_num_edges(og, OSM_GRAPH_PROFILE_BIKE) != 10 ||
+       osm_graph_get_num_edges(og, OSM_GRAPH_PROFILE_FOOT) != 18 ) {
+    g_printerr ( "Unexpected number of edges\n" );
+    ok = FALSE;
+  }
+
+  // Oneway
+  const Position car1[] = { D, E, F };
+  ok = check_route ( og, OSM_GRAPH_PROFILE_CAR, car1, G_N_ELEMENTS(car1), &costs[nn++] ) && ok;
+  const Position car2[] = { F, C, B, A, D };
+  ok = check_route ( og, OSM_GRAPH_PROFILE_CAR, car2, G_N_ELEMENTS(car2), &costs[nn++] ) && ok;
+  const Position car3[] = { B, C, F };
+  ok = check_route ( og, OSM_GRAPH_PROFILE_CAR, car3, G_N_ELEMENTS(car3), &costs[nn++] ) && ok;
+  // Oneway ignored when walking, along with the footpath short cut
+  const Position foot1[] = { F, E, D };
+  ok = check_route ( og, OSM_GRAPH_PROFILE_FOOT, foot1, G_N_ELEMENTS(foot1), &costs[nn++] ) && ok;
+  const Position foot2[] = { B, G, F };
+  ok = check_route ( og, OSM_GRAPH_PROFILE_FOOT, foot2, G_N_ELEMENTS(foot2), &costs[nn++] ) && ok;
+  // Private, except on foot
+  const Position foot3[] = { E, B };
+  ok = check_route ( og, OSM_GRAPH_PROFILE_FOOT, foot3, G_N_ELEMENTS(foot3), &costs[nn++] ) && ok;
+  const Position bike1[] = { E, F, C, B };
+  ok = check_route ( og, OSM_GRAPH_PROFILE_BIKE, bike1, G_N_ELEMENTS(bike1), &costs[nn++] ) && ok;
+  const Position same[] = { A };
+  ok = check_route ( og, OSM_GRAPH_PROFILE_CAR, same, G_N_ELEMENTS(same), &costs[nn++] ) && ok;
+  if ( costs[nn-1] != 0 ) {
+    g_printerr ( "Non zero cost for the same start and end\n" );
+    ok = FALSE;
+  }
+
+  // Cars can't get to the footpath
+  if ( !is_at(og, node_at(og, OSM_GRAPH_PROFILE_CAR, G), E) ||
+       !is_at(og, node_at(og, OSM_GRAPH_PROFILE_FOOT, G), G) ) {
+    g_printerr ( "Unexpected nearest node\n" );
+    ok = FALSE;
+  }
+  return ok;
+}
+
+#define NUM_ROUTES 8
+
+int main ( int argc, char *argv[] )
+{
+  const gchar *srcdir = g_getenv ( "srcdir" );
+  gchar *osm_file = g_build_filename ( srcdir ? srcdir : ".", "osmgraph_sample.osm", NULL );
+  gchar *graph_file = g_strdup_printf ( "%s/test_osmgraph%d.vikroute", g_get_tmp_dir(), getpid() );
+
+  OsmGraph *og = osm_graph_new_from_osm_file ( osm_file );
+  if ( !og ) {
+    g_printerr ( "Failed to read %s\n", osm_file );
+    return 1;
+  }
+  guint32 costs[NUM_ROUTES];
+  gboolean ok = check_graph ( og, costs );
+
+  if ( !osm_graph_save(og, graph_file) ) {
+    g_printerr ( "Failed to save %s\n", graph_file );
+    return 1;
+  }
+  osm_graph_free ( og );
+
+  og = osm_graph_load ( graph_file );
+  (void)g_remove ( graph_file );
+  if ( !og ) {
+    g_printerr ( "Failed to load %s\n", graph_file );
+    return 1;
+  }
+  guint32 loaded_costs[NUM_ROUTES];
+  ok = check_graph ( og, loaded_costs ) && ok;
+  for ( guint ii = 0; ii < NUM_ROUTES; ii++ ) {
+    if ( costs[ii] != loaded_costs[ii] ) {
+      g_printerr ( "Route %u cost differs after loading\n", ii );
+      ok = FALSE;
+    }
+  }
+  osm_graph_free ( og );
+
+  // Not a graph file
+  if ( osm_graph_load(osm_file) ) {
+    g_printerr ( "Loaded an invalid graph file\n" );
+    ok = FALSE;
+  }
+
+  g_free ( osm_file );
+  g_free ( graph_file );
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+// Copyright: CC0
+// Compare the tile set calculations against simple brute force versions
+//  over random grids of various densities
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include "tileset.h"
+
+#define WIDTH 200
+#define HEIGHT 150
+// Offset so the grid straddles several blocks
+#define XOFF 100
+#define YOFF 37
+
+static gboolean grid[HEIGHT][WIDTH];
+static guint area_of[HEIGHT][WIDTH];
+
+static gboolean occupied ( gint x, gint y )
+{
+  return x >= 0 && y >= 0 && x < WIDTH && y < HEIGHT && grid[y][x];
+}
+
+static guint largest_square ( void )
+{
+  guint best = 0;
+  for ( gint y = 0; y < HEIGHT; y++ )
+    for ( gint x = 0; x < WIDTH; x++ )
+      for ( guint n = best+1; x+n <= WIDTH && y+n <= HEIGHT; n++ ) {
+        gboolean ok = TRUE;
+        for ( guint i = 0; i < n && ok; i++ )
+          for ( guint j = 0; j < n && ok; j++ )
+            ok = grid[y+i][x+j];
+        if ( !ok )
+          break;
+        best = n;
+      }
+  return best;
+}
+
+static guint fill ( gint x, gint y, guint label )
+{
+  guint count = 0;
+  GQueue *queue = g_queue_new ();
+  area_of[y][x] = label;
+  g_queue_push_tail ( queue, GINT_TO_POINTER(y*WIDTH+x) );
+  while ( !g_queue_is_empty(queue) ) {
+    gint pos = GPOINTER_TO_INT(g_queue_pop_head(queue));
+    gint px = pos % WIDTH, py = pos / WIDTH;
+    count++;
+    const gint dd[4][2] = { {1,0}, {-1,0}, {0,1}, {0,-1} };
+    for ( guint k = 0; k < 4; k++ ) {
+      gint nx = px + dd[k][0], ny = py + dd[k][1];
+      if ( occupied(nx, ny) && !area_of[ny][nx] ) {
+        area_of[ny][nx] = label;
+        g_queue_push_tail ( queue, GINT_TO_POINTER(ny*WIDTH+nx) );
+      }
+    }
+  }
+  g_queue_free ( queue );
+  return count;
+}
+
+int main ( int argc, char *argv[] )
+{
+  GRand *rand = g_rand_new_with_seed ( 1 );
+  for ( guint run = 0; run < 12; run++ ) {
+    gint density = 10 + run * 7;
+    memset ( area_of, 0, sizeof(area_of) );
+    TileSet *ts = tile_set_new ();
+    guint size = 0;
+    for ( gint y = 0; y < HEIGHT; y++ )
+      for ( gint x = 0; x < WIDTH; x++ ) {
+        grid[y][x] = g_rand_int_range ( rand, 0, 100 ) < density;
+        if ( grid[y][x] ) {
+          (void)tile_set_add ( ts, x+XOFF, y+YOFF );
+          size++;
+        }
+      }
+    if ( tile_set_size(ts) != size ) {
+      g_printerr ( "run %d: size %d vs %d\n", run, tile_set_size(ts), size );
+      return 1;
+    }
+
+    gint sx = 0, sy = 0;
+    guint square = tile_set_largest_square ( ts, &sx, &sy );
+    if ( square != largest_square() ) {
+      g_printerr ( "run %d: square %d vs %d\n", run, square, largest_square() );
+      return 1;
+    }
+    for ( guint i = 0; i < square; i++ )
+      for ( guint j = 0; j < square; j++ )
+        if ( !tile_set_contains(ts, sx+j, sy+i) ) {
+          g_printerr ( "run %d: square position wrong\n", run );
+          return 1;
+        }
+
+    guint largest = 0, areas = 0;
+    for ( gint y = 0; y < HEIGHT; y++ )
+      for ( gint x = 0; x < WIDTH; x++ )
+        if ( grid[y][x] && !area_of[y][x] ) {
+          guint filled = fill ( x, y, ++areas );
+          if ( filled > largest )
+            largest = filled;
+        }
+    TileSet *area = tile_set_new ();
+    guint count = 0;
+    if ( tile_set_largest_area(ts, area, &count) != largest || count != areas || tile_set_size(area) != largest ) {
+      g_printerr ( "run %d: area %d of %d vs %d of %d\n", run, tile_set_size(area), count, largest, areas );
+      return 1;
+    }
+
+    guint surrounded = 0;
+    for ( gint y = 0; y < HEIGHT; y++ )
+      for ( gint x = 0; x < WIDTH; x++ )
+        if ( grid[y][x] && occupied(x-1,y-1) && occupied(x,y-1) && occupied(x+1,y-1) && occupied(x-1,y)
+             && occupied(x+1,y) && occupied(x-1,y+1) && occupied(x,y+1) && occupied(x+1,y+1) )
+          surrounded++;
+    TileSet *clust = tile_set_new ();
+    if ( tile_set_add_surrounded(clust, ts) != surrounded ) {
+      g_printerr ( "run %d: surrounded %d vs %d\n", run, tile_set_size(clust), surrounded );
+      return 1;
+    }
+
+    TileSet *copy = tile_set_new ();
+    tile_set_assign ( copy, ts );
+    (void)tile_set_add ( copy, 5000, 5000 );
+    TileSet *diff = tile_set_new ();
+    if ( tile_set_add_difference(diff, copy, ts) != 1 || !tile_set_contains(diff, 5000, 5000) ) {
+      g_printerr ( "run %d: difference wrong\n", run );
+      return 1;
+    }
+
+    TileSetIter iter;
+    gint x, y;
+    guint iterated = 0;
+    tile_set_iter_init ( &iter, ts );
+    while ( tile_set_iter_next(&iter, &x, &y) ) {
+      if ( !occupied(x-XOFF, y-YOFF) ) {
+        g_printerr ( "run %d: iterated unknown tile %d,%d\n", run, x, y );
+        return 1;
+      }
+      iterated++;
+    }
+    if ( iterated != size ) {
+      g_printerr ( "run %d: iterated %d vs %d\n", run, iterated, size );
+      return 1;
+    }
+
+    tile_set_free ( ts );
+    tile_set_free ( area );
+    tile_set_free ( clust );
+    tile_set_free ( copy );
+    tile_set_free ( diff );
+  }
+  g_rand_free ( rand );
+  return 0;
+}
@@ -0,0 +1,73 @@
+// Copyright: CC0
+// Record some trace events and check the resulting Chrome trace file
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "trace.h"
+
+static gboolean contains ( const gchar *contents, const gchar *str )
+{
+  if ( strstr(contents, str) )
+    return TRUE;
+  g_printerr ( "Missing %s\n", str );
+  return FALSE;
+}
+
+int main ( int argc, char *argv[] )
+{
+  gboolean ok = TRUE;
+  gchar *filename = g_strdup_printf ( "%s/test_trace%d.json", g_get_tmp_dir(), getpid() );
+
+  // Nothing happens when not enabled
+  a_trace_init ( NULL, FALSE );
+  if ( vik_trace_enabled || a_trace_begin() != 0 ) {
+    g_printerr ( "Tracing unexpectedly enabled\n" );
+    ok = FALSE;
+  }
+
+  a_trace_init ( filename, TRUE );
+  gint64 frame = a_trace_begin ();
+  gint64 begin = a_trace_begin ();
+  g_usleep ( 1000 );
+  a_trace_end ( "test_span", begin );
+  begin = a_trace_begin ();
+  a_trace_end_detail ( "test_detail", "a \"quoted\"\tdetail", begin );
+  a_trace_count ( VIK_TRACE_POINTS_PROJECTED, 40 );
+  a_trace_count ( VIK_TRACE_POINTS_PROJECTED, 2 );
+  a_trace_count ( VIK_TRACE_BACKGROUND_QUEUED, 3 );
+  a_trace_frame_end ( frame );
+  // Frame counters start again
+  a_trace_count ( VIK_TRACE_POINTS_PROJECTED, 1 );
+
+  gchar *summary = a_trace_get_summary ();
+  ok = contains ( summary, "Points projected: 42" ) && ok;
+  ok = contains ( summary, "3 queued" ) && ok;
+  g_free ( summary );
+
+  a_trace_uninit ();
+  if ( vik_trace_enabled ) {
+    g_printerr ( "Tracing still enabled\n" );
+    ok = FALSE;
+  }
+
+  gchar *contents = NULL;
+  if ( g_file_get_contents(filename, &contents, NULL, NULL) ) {
+    ok = contains ( contents, "{\"traceEvents\":[" ) && ok;
+    ok = contains ( contents, "\"name\":\"test_span\"" ) && ok;
+    ok = contains ( contents, "\"detail\":\"a \\\"quoted\\\"\\u0009detail\"" ) && ok;
+    ok = contains ( contents, "\"name\":\"frame\"" ) && ok;
+    ok = contains ( contents, "\"name\":\"points_projected\",\"cat\":\"viking\",\"ph\":\"C\"" ) && ok;
+    ok = contains ( contents, "\"args\":{\"value\":42}" ) && ok;
+    ok = contains ( contents, "\"dropped_events\":0" ) && ok;
+    g_free ( contents );
+    (void)g_remove ( filename );
+  }
+  else {
+    g_printerr ( "Failed to read %s\n", filename );
+    ok = FALSE;
+  }
+
+  g_free ( filename );
+  return ok ? 0 : 1;
+}